@@ -48,30 +48,18 @@ void BluetoothSensorDeviceAdapterBase::ReportSensorDataTelemetry(
     auto parsedSensorData = m_interfaceDescriptor->GetPayloadParser()->ParsePayload(payload);
     for (const auto& sensorData : parsedSensorData)
     {
-        IOTHUB_MESSAGE_HANDLE messageHandle = NULL;
-
         auto telemetryName = sensorData.first;
         auto telemetryMessage = sensorData.second;
         char telemetryPayload[512] = { 0 };
         sprintf(telemetryPayload, "{\"%s\":%s}", telemetryName.c_str(), telemetryMessage.c_str());
         LogInfo("Reporting telemetry: %s", telemetryPayload);
 
-        std::vector<char> telemetryNameBuffer(
-            telemetryName.c_str(), telemetryName.c_str() + telemetryName.size() + 1);
-
-        if ((messageHandle = PnP_CreateTelemetryMessageHandle(m_componentName.c_str(), telemetryPayload)) == NULL)
-        {
-            LogError("Bluetooth Sensor Component %s: PnP_CreateTelemetryMessageHandle failed.", m_componentName.c_str());
-        }
-        else if ((result = IoTHubDeviceClient_SendEventAsync(m_deviceClient, messageHandle,
-                OnTelemetryCallback, static_cast<void*>(telemetryNameBuffer.data()))) != IOTHUB_CLIENT_OK)
+        if ((result = PnpBridgeClient_SendTelemetry(m_deviceClient, m_componentName.c_str(),
+                telemetryPayload)) != IOTHUB_CLIENT_OK)
         {
             LogError("Bluetooth Sensor Component %s: Failed to report sensor data telemetry %s, error=%d",
                 m_componentName.c_str(), telemetryName.c_str(), result);
         }
-
-        IoTHubMessage_Destroy(messageHandle);
-
     }
 }
 
@@ -91,19 +79,6 @@ void BluetoothSensorDeviceAdapterBase::OnInterfaceRegisteredCallback(
     }
 }
 
-// static
-void BluetoothSensorDeviceAdapterBase::OnTelemetryCallback(
-    IOTHUB_CLIENT_CONFIRMATION_RESULT telemetryStatus,
-    void* userContextCallback)
-{
-    if (telemetryStatus != IOTHUB_CLIENT_OK)
-    {
-        LogError("Bluetooth Sensor Component: Telemetry callback reported error: %d, usercontext: 0x%p",
-            telemetryStatus, userContextCallback);
-        return;
-    }
-}
-
 // static
 void BluetoothSensorDeviceAdapterBase::OnPropertyCallback(
     PNPBRIDGE_COMPONENT_HANDLE /*PnpComponentHandle*/,
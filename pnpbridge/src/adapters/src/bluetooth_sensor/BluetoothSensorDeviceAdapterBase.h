@@ -45,10 +45,6 @@ private:
         IOTHUB_CLIENT_RESULT interfaceStatus,
         _In_ void* userInterfaceContext);
 
-    static void OnTelemetryCallback(
-        _In_ IOTHUB_CLIENT_CONFIRMATION_RESULT telemetryStatus,
-        _In_ void* userContextCallback);
-
     const std::shared_ptr<InterfaceDescriptor> m_interfaceDescriptor;
     std::string m_componentName;
     IOTHUB_DEVICE_CLIENT_HANDLE m_deviceClient;
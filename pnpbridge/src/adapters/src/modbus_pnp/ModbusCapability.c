@@ -10,15 +10,6 @@
 #include "ModbusConnection/ModbusConnection.h"
 #include "azure_c_shared_utility/condition.h"
 
-static bool ModbusPnP_ContinueReadTasks = false;
-// This condition variable is used to signal when to stop polling
-// and only serves to establish the event notification mechanism using 
-// azure_c's shared utility library. The lock passed into the Condition_Wait
-// function does not protect against any shared resource, and is instead created
-// to comply with the cross-platform library's function signature
-
-static COND_HANDLE StopPolling;
-
 #pragma region Commands
 
 const ModbusCommand* ModbusPnp_LookupCommand(
@@ -57,8 +48,8 @@ ModbusPnp_CommandHandler(
         return PNP_STATUS_NOT_FOUND;
     }
 
-    uint8_t resultedData[MODBUS_RESPONSE_MAX_LENGTH];
-    memset(resultedData, 0x00, MODBUS_RESPONSE_MAX_LENGTH);
+    uint8_t resultedData[MODBUS_VALUE_MAX_LENGTH];
+    memset(resultedData, 0x00, MODBUS_VALUE_MAX_LENGTH);
 
     CapabilityContext* capContext = calloc(1, sizeof(CapabilityContext));
     if (NULL == capContext)
@@ -68,9 +59,14 @@ ModbusPnp_CommandHandler(
     }
 
     capContext->capability = (ModbusCommand*)command;
-    capContext->hDevice = modbusDevice->hDevice;
     capContext->connectionType = modbusDevice->DeviceConfig->ConnectionType;
-    capContext->hLock = modbusDevice->hConnectionLock;
+    capContext->tcpConnection = modbusDevice->TcpConnection;
+    capContext->rtuBus = modbusDevice->RtuBus;
+    capContext->breaker = &modbusDevice->Breaker;
+    capContext->breakerLock = modbusDevice->hBreakerLock;
+    capContext->breakerClock = modbusDevice->BreakerClock;
+    capContext->clientHandle = modbusDevice->ClientHandle;
+    capContext->clientType = modbusDevice->ClientType;
     capContext->componentName = modbusDevice->ComponentName;
 
     char * CommandValueString = (char*) json_value_get_string(CommandValue);
@@ -141,8 +137,8 @@ void ModbusPnp_PropertyHandler(
 
     char * PropertyValueString = (char*) json_value_get_string(PropertyValue);
 
-    uint8_t resultedData[MODBUS_RESPONSE_MAX_LENGTH];
-    memset(resultedData, 0x00, MODBUS_RESPONSE_MAX_LENGTH);
+    uint8_t resultedData[MODBUS_VALUE_MAX_LENGTH];
+    memset(resultedData, 0x00, MODBUS_VALUE_MAX_LENGTH);
 
     CapabilityContext* capContext = calloc(1, sizeof(CapabilityContext));
     if (!capContext)
@@ -151,9 +147,12 @@ void ModbusPnp_PropertyHandler(
         return;
     }
     capContext->capability = (ModbusProperty*) property;
-    capContext->hDevice = modbusDevice->hDevice;
     capContext->connectionType = modbusDevice->DeviceConfig->ConnectionType;
-    capContext->hLock= modbusDevice->hConnectionLock;
+    capContext->tcpConnection = modbusDevice->TcpConnection;
+    capContext->rtuBus = modbusDevice->RtuBus;
+    capContext->breaker = &modbusDevice->Breaker;
+    capContext->breakerLock = modbusDevice->hBreakerLock;
+    capContext->breakerClock = modbusDevice->BreakerClock;
     capContext->clientHandle = modbusDevice->ClientHandle;
     capContext->clientType = modbusDevice->ClientType;
     capContext->componentName = modbusDevice->ComponentName;
@@ -169,13 +168,6 @@ void ModbusPnp_PropertyHandler(
 
 #pragma region ReadOnlyProperty
 
-void ModbusPnp_ReportPropertyUpdatedCallback(
-    int pnpReportedStatus,
-    void* userContextCallback)
-{
-    LogInfo("ModbusPnp_ReportPropertyUpdatedCallback called, result=%d, property name=%s", pnpReportedStatus, (const char*) userContextCallback);
-}
-
 IOTHUB_CLIENT_RESULT 
 ModbusPnp_ReportReadOnlyProperty(
     CapabilityContext* CapabilityContext ,
@@ -195,80 +187,20 @@ ModbusPnp_ReportReadOnlyProperty(
         return iothubClientResult;
     }
 
-    STRING_HANDLE jsonToSend = NULL;
-
-    if ((jsonToSend = PnP_CreateReportedProperty(ComponentName, PropertyName, PropertyValue)) == NULL)
-    {
-        LogError("Unable to build reported property response for propertyName=%s, propertyValue=%s", PropertyName, PropertyValue);
-    }
-    else
+    // Read-only properties are polled every cycle; the bridge drops values the twin already holds
+    if ((iothubClientResult = PnpBridgeClient_ReportProperty(CapabilityContext->clientHandle, ComponentName, PropertyName,
+            PropertyValue)) != IOTHUB_CLIENT_OK)
     {
-        const char* jsonToSendStr = STRING_c_str(jsonToSend);
-        size_t jsonToSendStrLen = strlen(jsonToSendStr);
-
-        if ((iothubClientResult = PnpBridgeClient_SendReportedState(CapabilityContext->clientHandle, (const unsigned char*)jsonToSendStr, jsonToSendStrLen,
-            ModbusPnp_ReportPropertyUpdatedCallback, (void*)PropertyName)) != IOTHUB_CLIENT_OK)
-        {
-            LogError("Modbus Adapter: Unable to send reported state for device property=%s, error=%d",
-                                PropertyName, iothubClientResult);
-        }
-        else
-        {
-            LogInfo("Modbus Adapter: Sending device information property to IoTHub. propertyName=%s, propertyValue=%s",
-                        PropertyName, PropertyValue);
-        }
-
-        STRING_delete(jsonToSend);
+        LogError("Modbus Adapter: Unable to report device property=%s, error=%d", PropertyName, iothubClientResult);
     }
 
     return iothubClientResult;
 }
 
-int
-ModbusPnp_PollingSingleProperty(
-    void *param)
-{
-    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
-    CapabilityContext* context = param;
-    ModbusProperty* property = context->capability;
-    LogInfo("Start polling task for property \"%s\".", property->Name);
-    uint8_t resultedData[MODBUS_RESPONSE_MAX_LENGTH];
-    memset(resultedData, 0x00, MODBUS_RESPONSE_MAX_LENGTH);
-
-    LOCK_HANDLE lock;
-    lock = Lock_Init();
-    Lock(lock);
-
-    while (ModbusPnP_ContinueReadTasks)
-    {
-        int resultLen = ModbusPnp_ReadCapability(context, Property, resultedData);
-        if (resultLen > 0)
-        {
-            result = ModbusPnp_ReportReadOnlyProperty(context, context->componentName, property->Name, (const char*) resultedData);
-        }
-
-        Condition_Wait(StopPolling, lock, property->DefaultFrequency);
-    }
-
-    Unlock(lock);
-    Lock_Deinit(lock);
-    LogInfo("Stopped polling task for property \"%s\".", property->Name);
-    free(context);
-    ThreadAPI_Exit(THREADAPI_OK);
-    return result;
-}
-
 #pragma endregion
 
 #pragma region SendTelemetry
 
-void ModbusPnp_ReportTelemetryCallback(
-    IOTHUB_CLIENT_CONFIRMATION_RESULT pnpSendEventStatus,
-    void* userContextCallback)
-{
-    LogInfo("ModbusPnp_ReportTelemetryCallback called, result=%d, telemetry name=%s", pnpSendEventStatus, (const char*) userContextCallback);
-}
-
 IOTHUB_CLIENT_RESULT
 ModbusPnp_ReportTelemetry(
     CapabilityContext* CapabilityContext,
@@ -277,7 +209,6 @@ ModbusPnp_ReportTelemetry(
     const char* TelemetryValue)
 {
     IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
-    IOTHUB_MESSAGE_HANDLE messageHandle = NULL;
 
     if (CapabilityContext == NULL)
     {
@@ -289,166 +220,414 @@ ModbusPnp_ReportTelemetry(
         return result;
     }
 
-    char telemetryMessageData[512] = {0};
-    sprintf(telemetryMessageData, "{\"%s\":%s}", TelemetryName, TelemetryValue);
+    char telemetryMessageData[MODBUS_VALUE_MAX_LENGTH + 256] = {0};
+    int messageLength = snprintf(telemetryMessageData, sizeof(telemetryMessageData), "{\"%s\":%s}", TelemetryName, TelemetryValue);
+    if (messageLength < 0 || (size_t) messageLength >= sizeof(telemetryMessageData))
+    {
+        LogError("Modbus Adapter: Telemetry \"%s\" is too long to send.", TelemetryName);
+        return IOTHUB_CLIENT_ERROR;
+    }
 
-    if ((messageHandle = PnP_CreateTelemetryMessageHandle(ComponentName, (const char*) telemetryMessageData)) == NULL)
+    if ((result = PnpBridgeClient_SendTelemetry(CapabilityContext->clientHandle, ComponentName,
+            (const char*) telemetryMessageData)) != IOTHUB_CLIENT_OK)
     {
-        LogError("Modbus Adapter: PnP_CreateTelemetryMessageHandle failed.");
+        LogError("Modbus Adapter: PnpBridgeClient_SendTelemetry failed for device, error=%d", result);
     }
-    else if ((result = PnpBridgeClient_SendEventAsync(CapabilityContext->clientHandle, messageHandle,
-            ModbusPnp_ReportTelemetryCallback, (void*) TelemetryName)) != IOTHUB_CLIENT_OK)
+
+    return result;
+}
+
+#pragma endregion
+
+void StopPollingTasks(
+    void* context)
+{
+    PMODBUS_DEVICE_CONTEXT deviceContext = (PMODBUS_DEVICE_CONTEXT)context;
+
+    Lock(deviceContext->hPollingLock);
+    deviceContext->ContinuePolling = false;
+    if (Condition_Post(deviceContext->StopPolling) != COND_OK)
     {
-        LogError("Modbus Adapter: IoTHub client call to_SendEventAsync failed for device, error=%d", result);
+        LogError("Condition variable could not be signalled.");
     }
+    Unlock(deviceContext->hPollingLock);
+}
 
-    IoTHubMessage_Destroy(messageHandle);
+#pragma region PollReadBlocks
 
-    return result;
+// Returns true if the value of an adaptively polled item moved by its change threshold or more since it last did
+static bool ModbusPnp_HasValueChanged(
+    ModbusReadBlockItem* item,
+    double value)
+{
+    if (item->HasReferenceValue)
+    {
+        double change = (value > item->ReferenceValue) ? value - item->ReferenceValue : item->ReferenceValue - value;
+        if (0 == change || change < item->AdaptivePolling.ChangeThreshold)
+        {
+            return false;
+        }
+    }
+
+    item->HasReferenceValue = true;
+    item->ReferenceValue = value;
+    return true;
 }
 
-int ModbusPnp_PollingSingleTelemetry(
-    void *param)
+IOTHUB_CLIENT_RESULT ModbusPnp_PollReadBlock(
+    ReadBlockContext* context,
+    ModbusPollOutcome* outcome)
 {
     IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
-    CapabilityContext* context = (CapabilityContext*) param;
-    ModbusTelemetry* telemetry = (ModbusTelemetry*) context->capability;
-    LogInfo("Start polling task for telemetry \"%s\".", telemetry->Name);
-    uint8_t resultedData[MODBUS_RESPONSE_MAX_LENGTH];
+    CapabilityContext* capabilityContext = &context->capabilityContext;
+    ModbusReadBlock* block = (ModbusReadBlock*) capabilityContext->capability;
+    uint8_t response[MODBUS_READ_BLOCK_RESPONSE_MAX_LENGTH];
+    char resultedData[MODBUS_VALUE_MAX_LENGTH];
+
+    *outcome = ModbusPollFailed;
+    int responseLength = ModbusPnp_ReadBlock(capabilityContext, block, &context->readRequest, response);
+    if (responseLength <= 0)
+    {
+        // Polls held back by the circuit breaker of the unit never reached the device
+        if (MODBUS_REQUEST_REJECTED != responseLength)
+        {
+            PnpBridgeMetrics_AddCounter(capabilityContext->componentName, PNP_METRIC_DEVICE_IO_ERRORS, 1);
+        }
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    // Decode every value of the block at once, then format and report them one by one
+    const uint8_t* blockData = response + ModbusPnp_GetHeaderSize(capabilityContext->connectionType) + 2;
+    ModbusPnp_DecodeReadBlock(block, blockData, context->values);
 
-    LOCK_HANDLE lock;
-    lock = Lock_Init();
-    Lock(lock);
-    while (ModbusPnP_ContinueReadTasks)
+    *outcome = ModbusPollSteady;
+    for (size_t i = 0; i < block->ItemCount; i++)
     {
-        memset(resultedData, 0x00, MODBUS_RESPONSE_MAX_LENGTH);
-        int resultLen = ModbusPnp_ReadCapability(context, Telemetry, resultedData);
+        ModbusReadBlockItem* item = &block->Items[i];
 
-        if (resultLen > 0) {
-            result = ModbusPnp_ReportTelemetry(context, (const char*) context->componentName,
-                (const char*) telemetry->Name, (const char*) resultedData);
+        // Every value is compared, so that each keeps its own reference value
+        if (0 != block->AdaptivePolling.MinInterval && ModbusPnp_HasValueChanged(item, context->values[i]))
+        {
+            *outcome = ModbusPollChanged;
+        }
+
+        if (ModbusPnp_FormatReadBlockItem(block, item, blockData, context->values[i], resultedData, sizeof(resultedData)) <= 0)
+        {
+            LogError("Failed to parse response for reading block at address %d.", block->StartAddress);
+            continue;
         }
 
-        Condition_Wait(StopPolling, lock, telemetry->DefaultFrequency);
+        if (Telemetry == item->Type)
+        {
+            ModbusTelemetry* telemetry = (ModbusTelemetry*) item->Capability;
+            result = ModbusPnp_ReportTelemetry(capabilityContext, (const char*) capabilityContext->componentName,
+                (const char*) telemetry->Name, (const char*) resultedData);
+        }
+        else
+        {
+            ModbusProperty* property = (ModbusProperty*) item->Capability;
+            result = ModbusPnp_ReportReadOnlyProperty(capabilityContext, capabilityContext->componentName,
+                property->Name, (const char*) resultedData);
+        }
     }
-    Unlock(lock);
-    Lock_Deinit(lock);
 
-    LogInfo("Stopped polling task for telemetry \"%s\".", telemetry->Name);
-    free(context);
-    ThreadAPI_Exit(THREADAPI_OK);
     return result;
 }
 
-#pragma endregion
+static void ModbusPnp_ReportPollingJitter(
+    const ModbusPollQueue* queue)
+{
+    for (size_t i = 0; i < queue->EntryCount; i++)
+    {
+        const ModbusPollEntry* entry = &queue->Entries[i];
+        const ReadBlockContext* context = (const ReadBlockContext*) entry->Context;
+        const ModbusReadBlock* block = (const ModbusReadBlock*) context->capabilityContext.capability;
+
+        for (size_t j = 0; j < block->ItemCount; j++)
+        {
+            const ModbusReadBlockItem* item = &block->Items[j];
+            const char* name = (Telemetry == item->Type) ? ((ModbusTelemetry*) item->Capability)->Name : ((ModbusProperty*) item->Capability)->Name;
+
+            if (0 != entry->MinPeriod)
+            {
+                LogInfo("Polled \"%s\" %u times, lastly every %u ms (adaptive from %u to %u ms): average jitter %u ms, max jitter %u ms, %u polls skipped.",
+                    name, entry->PollCount, entry->Period, entry->MinPeriod, entry->MaxPeriod, ModbusPollEntry_GetAverageJitter(entry), entry->MaxJitter, entry->SkippedCount);
+            }
+            else
+            {
+                LogInfo("Polled \"%s\" %u times every %u ms: average jitter %u ms, max jitter %u ms, %u polls skipped.",
+                    name, entry->PollCount, entry->Period, ModbusPollEntry_GetAverageJitter(entry), entry->MaxJitter, entry->SkippedCount);
+            }
+        }
+    }
+}
 
-void StopPollingTasks()
+// Reports how many read requests per minute the device is polled with at the current periods
+static void ModbusPnp_ReportPollRate(
+    PMODBUS_DEVICE_CONTEXT deviceContext)
 {
-    ModbusPnP_ContinueReadTasks = false;
-    if (Condition_Post(StopPolling) != COND_OK)
+    const ModbusPollQueue* queue = &deviceContext->PollQueue;
+    double pollsPerMinute = 0.0;
+
+    for (size_t i = 0; i < queue->EntryCount; i++)
     {
-        LogError("Condition variable could not be signalled.");
+        if (queue->Entries[i].Period > 0)
+        {
+            pollsPerMinute += 60000.0 / queue->Entries[i].Period;
+        }
     }
+
+    PnpBridgeMetrics_SetGauge(deviceContext->ComponentName, MODBUS_METRIC_POLL_RATE, (int64_t) (pollsPerMinute + 0.5));
 }
 
+int ModbusPnp_PollingScheduler(
+    void *param)
+{
+    PMODBUS_DEVICE_CONTEXT deviceContext = (PMODBUS_DEVICE_CONTEXT) param;
+    ModbusPollQueue* queue = &deviceContext->PollQueue;
+    LogInfo("Start polling task for %d read requests.", (int) queue->EntryCount);
+    ModbusPnp_ReportPollRate(deviceContext);
+
+    Lock(deviceContext->hPollingLock);
+    while (deviceContext->ContinuePolling)
+    {
+        tickcounter_ms_t now = 0;
+        (void) tickcounter_get_current_ms(deviceContext->PollingClock, &now);
+
+        PModbusPollEntry entry = ModbusPollQueue_Peek(queue);
+        if (NULL == entry)
+        {
+            break;
+        }
+
+        if (entry->Deadline > (uint64_t) now)
+        {
+            Condition_Wait(deviceContext->StopPolling, deviceContext->hPollingLock, (int) (entry->Deadline - now));
+            continue;
+        }
+
+        // Poll without holding the polling lock so that a stop request is not held up by device I/O
+        entry = ModbusPollQueue_Pop(queue);
+        Unlock(deviceContext->hPollingLock);
+
+        // On a shared RTU bus, polls that are further behind their deadline go first
+        ReadBlockContext* pollingContext = (ReadBlockContext*) entry->Context;
+        pollingContext->capabilityContext.busDeadlineMs = -(int32_t) ((uint64_t) now - entry->Deadline);
+        ModbusPollOutcome outcome = ModbusPollFailed;
+        (void) ModbusPnp_PollReadBlock(pollingContext, &outcome);
+
+        tickcounter_ms_t end = 0;
+        (void) tickcounter_get_current_ms(deviceContext->PollingClock, &end);
+        PnpBridgeMetrics_ObserveDuration(((ReadBlockContext*) entry->Context)->capabilityContext.componentName,
+            PNP_METRIC_POLL_DURATION, (uint32_t) (end - now));
+
+        // Adaptive polls speed up while their values move and back off while they are flat
+        if (ModbusPollEntry_Adapt(entry, outcome))
+        {
+            ModbusPnp_ReportPollRate(deviceContext);
+        }
+        uint32_t skipped = ModbusPollQueue_Reschedule(queue, entry, (uint64_t) now, (uint64_t) end);
+        if (skipped > 0)
+        {
+            const ModbusReadBlock* block = (const ModbusReadBlock*) ((ReadBlockContext*) entry->Context)->capabilityContext.capability;
+            LogInfo("Polling of block at address %d is running behind, skipped %u polls.", block->StartAddress, skipped);
+        }
+
+        Lock(deviceContext->hPollingLock);
+    }
+    Unlock(deviceContext->hPollingLock);
+
+    ModbusPnp_ReportPollingJitter(queue);
+    LogInfo("Stopped polling task.");
+    ThreadAPI_Exit(THREADAPI_OK);
+    return 0;
+}
+
+bool ModbusPnp_SetReadBlockItem(
+    ModbusReadBlockItem* item,
+    CapabilityType capabilityType,
+    void* capability)
+{
+    const char* name = NULL;
+    const char* startAddress = NULL;
+
+    item->Type = capabilityType;
+    item->Capability = capability;
+    if (Telemetry == capabilityType)
+    {
+        ModbusTelemetry* telemetry = (ModbusTelemetry*) capability;
+        name = telemetry->Name;
+        startAddress = telemetry->StartAddress;
+        item->Length = telemetry->Length;
+        item->Frequency = telemetry->DefaultFrequency;
+        item->AdaptivePolling = telemetry->AdaptivePolling;
+        item->DataType = telemetry->DataType;
+        item->NumberFormat = telemetry->NumberFormat;
+        item->ConversionCoefficient = telemetry->ConversionCoefficient;
+    }
+    else
+    {
+        ModbusProperty* property = (ModbusProperty*) capability;
+        name = property->Name;
+        startAddress = property->StartAddress;
+        item->Length = property->Length;
+        item->Frequency = property->DefaultFrequency;
+        item->AdaptivePolling = property->AdaptivePolling;
+        item->DataType = property->DataType;
+        item->NumberFormat = property->NumberFormat;
+        item->ConversionCoefficient = property->ConversionCoefficient;
+    }
+
+    if (!ModbusConnectionHelper_GetFunctionCode(startAddress, true, &item->FunctionCode, &item->Address))
+    {
+        LogError("Failed to get Modbus function code for \"%s\".", name);
+        return false;
+    }
+    return true;
+}
+
+#pragma endregion
+
 IOTHUB_CLIENT_RESULT ModbusPnp_StartPollingAllTelemetryProperty(
     void* context)
 {
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
     PMODBUS_DEVICE_CONTEXT deviceContext = (PMODBUS_DEVICE_CONTEXT)context;
     const ModbusInterfaceConfig* interfaceConfig = deviceContext->InterfaceConfig;
-    SINGLYLINKEDLIST_HANDLE telemetryList = interfaceConfig->Events;
     int telemetryCount = ModbusPnp_GetListCount(interfaceConfig->Events);
-    LIST_ITEM_HANDLE telemetryItemHandle = NULL;
-
-    SINGLYLINKEDLIST_HANDLE propertyList = interfaceConfig->Properties;
     int propertyCount = ModbusPnp_GetListCount(interfaceConfig->Properties);
-    LIST_ITEM_HANDLE propertyItemHandle = NULL;
+    ModbusReadBlockItem* readBlockItems = NULL;
+    size_t readBlockItemCount = 0;
 
+    deviceContext->PollingTask = NULL;
+    deviceContext->ReadBlocks = NULL;
+    deviceContext->ReadBlockCount = 0;
 
-    // Initialize the polling tasks for telemetry and properties
-    deviceContext->PollingTasks = NULL;
     if (telemetryCount > 0 || propertyCount > 0)
     {
-        deviceContext->PollingTasks = calloc((telemetryCount + propertyCount), sizeof(THREAD_HANDLE));
-        if (NULL == deviceContext->PollingTasks) {
-            return IOTHUB_CLIENT_ERROR;
+        readBlockItems = calloc((telemetryCount + propertyCount), sizeof(ModbusReadBlockItem));
+        if (NULL == readBlockItems) {
+            result = IOTHUB_CLIENT_ERROR;
+            goto exit;
         }
     }
 
-    StopPolling = Condition_Init();
-    ModbusPnP_ContinueReadTasks = true;
-
-    for (int i = 0; i < telemetryCount; i++)
+    // Collect every telemetry and property that has to be polled
+    LIST_ITEM_HANDLE telemetryItemHandle = singlylinkedlist_get_head_item(interfaceConfig->Events);
+    while (NULL != telemetryItemHandle)
     {
-        if (NULL == telemetryItemHandle)
+        ModbusTelemetry* telemetry = (ModbusTelemetry*) singlylinkedlist_item_get_value(telemetryItemHandle);
+        if (ModbusPnp_SetReadBlockItem(&readBlockItems[readBlockItemCount], Telemetry, telemetry))
         {
-            telemetryItemHandle = singlylinkedlist_get_head_item(telemetryList);
-        }
-        else
-        {
-            telemetryItemHandle = singlylinkedlist_get_next_item(telemetryItemHandle);
+            readBlockItemCount++;
         }
+        telemetryItemHandle = singlylinkedlist_get_next_item(telemetryItemHandle);
+    }
 
-        const ModbusTelemetry* telemetry = singlylinkedlist_item_get_value(telemetryItemHandle);
-        CapabilityContext* pollingPayload = calloc(1, sizeof(CapabilityContext));
-        if (!pollingPayload)
-        {
-            LogError("Could not allocate memory for telemetry polling capability context.");
-            continue;
-        }
-        pollingPayload->hDevice = deviceContext->hDevice;
-        pollingPayload->capability = (void*)telemetry;
-        pollingPayload->hLock = deviceContext->hConnectionLock;
-        pollingPayload->connectionType = deviceContext->DeviceConfig->ConnectionType;
-        pollingPayload->clientHandle = deviceContext->ClientHandle;
-        pollingPayload->clientType = deviceContext->ClientType;
-        pollingPayload->componentName = deviceContext->ComponentName;
-
-        if (ThreadAPI_Create(&(deviceContext->PollingTasks[i]), ModbusPnp_PollingSingleTelemetry, (void*)pollingPayload) != THREADAPI_OK)
+    LIST_ITEM_HANDLE propertyItemHandle = singlylinkedlist_get_head_item(interfaceConfig->Properties);
+    while (NULL != propertyItemHandle)
+    {
+        ModbusProperty* property = (ModbusProperty*) singlylinkedlist_item_get_value(propertyItemHandle);
+        if (ModbusPnp_SetReadBlockItem(&readBlockItems[readBlockItemCount], Property, property))
         {
-#ifdef WIN32
-            LogError("Failed to create worker thread for telemetry \"%s\", 0x%x", telemetry->Name, GetLastError());
-#else
-            LogError("Failed to create worker thread for telemetry \"%s\".", telemetry->Name);
-#endif
+            readBlockItemCount++;
         }
+        propertyItemHandle = singlylinkedlist_get_next_item(propertyItemHandle);
     }
 
-    for (int i = 0; i < propertyCount; i++)
+    // Coalesce neighbouring registers into as few read requests as possible
+    if (!ModbusPnp_PlanReadBlocks(readBlockItems, readBlockItemCount, interfaceConfig->MaxReadGap,
+            &deviceContext->ReadBlocks, &deviceContext->ReadBlockCount))
     {
-        if (NULL == propertyItemHandle)
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
+    }
+
+    LogInfo("Polling %d telemetry and %d properties with %d read requests.", telemetryCount, propertyCount, (int) deviceContext->ReadBlockCount);
+
+    if (0 == deviceContext->ReadBlockCount)
+    {
+        goto exit;
+    }
+
+    // A device with more read blocks to poll gets a larger share of a shared RTU bus
+    ModbusRtuBus_SetWeight(deviceContext->RtuBus, (uint32_t) deviceContext->ReadBlockCount);
+
+    // Initialize the polling scheduler, one thread polls every read block of the device
+    if (!ModbusPollQueue_Init(&deviceContext->PollQueue, deviceContext->ReadBlockCount))
+    {
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
+    }
+
+    deviceContext->PollingClock = tickcounter_create();
+    deviceContext->hPollingLock = Lock_Init();
+    deviceContext->StopPolling = Condition_Init();
+    if (NULL == deviceContext->PollingClock || NULL == deviceContext->hPollingLock || NULL == deviceContext->StopPolling)
+    {
+        LogError("Could not create the polling scheduler.");
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
+    }
+
+    for (size_t i = 0; i < deviceContext->ReadBlockCount; i++)
+    {
+        PModbusReadBlock block = &deviceContext->ReadBlocks[i];
+        // The decoded values of the block are kept right after its polling context
+        ReadBlockContext* pollingPayload = calloc(1, sizeof(ReadBlockContext) + (block->ItemCount * sizeof(double)));
+        if (!pollingPayload)
         {
-            propertyItemHandle = singlylinkedlist_get_head_item(propertyList);
+            LogError("Could not allocate memory for read block polling context.");
+            continue;
         }
-        else
+        pollingPayload->values = (double*) (pollingPayload + 1);
+        pollingPayload->capabilityContext.capability = (void*)block;
+        pollingPayload->capabilityContext.tcpConnection = deviceContext->TcpConnection;
+        pollingPayload->capabilityContext.rtuBus = deviceContext->RtuBus;
+        pollingPayload->capabilityContext.breaker = &deviceContext->Breaker;
+        pollingPayload->capabilityContext.breakerLock = deviceContext->hBreakerLock;
+        pollingPayload->capabilityContext.breakerClock = deviceContext->BreakerClock;
+        pollingPayload->capabilityContext.connectionType = deviceContext->DeviceConfig->ConnectionType;
+        pollingPayload->capabilityContext.clientHandle = deviceContext->ClientHandle;
+        pollingPayload->capabilityContext.clientType = deviceContext->ClientType;
+        pollingPayload->capabilityContext.componentName = deviceContext->ComponentName;
+
+        if (IOTHUB_CLIENT_OK != ModbusPnp_SetReadBlockRequest(deviceContext->DeviceConfig, block, &pollingPayload->readRequest))
         {
-            propertyItemHandle = singlylinkedlist_get_next_item(propertyItemHandle);
+            LogError("Failed to create read request for block at address %d.", block->StartAddress);
+            free(pollingPayload);
+            continue;
         }
 
-        const ModbusProperty* property = singlylinkedlist_item_get_value(propertyItemHandle);
-        CapabilityContext* pollingPayload = calloc(1, sizeof(CapabilityContext));
-        if (!pollingPayload)
+        // Every block is first due right away and then on multiples of its frequency from there
+        PModbusPollEntry entry = ModbusPollQueue_Add(&deviceContext->PollQueue, (block->Frequency > 0) ? (uint32_t) block->Frequency : 0, pollingPayload, 0);
+        if (NULL == entry)
         {
-            LogError("Could not allocate memory for property polling capability context.");
+            LogError("Failed to schedule polling of block at address %d.", block->StartAddress);
+            free(pollingPayload);
             continue;
         }
-        pollingPayload->hDevice = deviceContext->hDevice;
-        pollingPayload->capability = (void*)property;
-        pollingPayload->hLock = deviceContext->hConnectionLock;
-        pollingPayload->connectionType = deviceContext->DeviceConfig->ConnectionType;
-        pollingPayload->clientType = deviceContext->ClientType;
-        pollingPayload->clientHandle = deviceContext->ClientHandle;
-        pollingPayload->componentName = deviceContext->ComponentName;
-
-        if (ThreadAPI_Create(&(deviceContext->PollingTasks[telemetryCount + i]), ModbusPnp_PollingSingleProperty, (void*)pollingPayload) != THREADAPI_OK)
+
+        if (0 != block->AdaptivePolling.MinInterval)
         {
+            ModbusPollEntry_SetAdaptive(entry, block->AdaptivePolling.MinInterval, block->AdaptivePolling.MaxInterval);
+        }
+    }
+
+    deviceContext->ContinuePolling = true;
+    if (ThreadAPI_Create(&deviceContext->PollingTask, ModbusPnp_PollingScheduler, (void*)deviceContext) != THREADAPI_OK)
+    {
 #ifdef WIN32
-            LogError("Failed to create worker thread for property \"%s\", 0x%x", property->Name, GetLastError());
+        LogError("Failed to create polling scheduler thread, 0x%x", GetLastError());
 #else
-            LogError("Failed to create worker thread for property \"%s\".", property->Name);
+        LogError("Failed to create polling scheduler thread.");
 #endif
-        }
+        deviceContext->PollingTask = NULL;
+        deviceContext->ContinuePolling = false;
+        result = IOTHUB_CLIENT_ERROR;
     }
 
-    return IOTHUB_CLIENT_OK;
+exit:
+    free(readBlockItems);
+    return result;
 }
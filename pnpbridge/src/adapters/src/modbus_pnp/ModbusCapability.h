@@ -19,7 +19,12 @@ extern "C"
 
 #include <pnpadapter_api.h>
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "ModbusConnection/ModbusConnectionHelper.h"
+#include "ModbusConnection/ModbusTcpPool.h"
+#include "ModbusConnection/ModbusRtuBus.h"
+#include "ModbusReadBlock.h"
+#include "ModbusCircuitBreaker.h"
 
 typedef enum ModbusAccessType
 {
@@ -32,9 +37,11 @@ typedef struct ModbusTelemetry {
     const char*  StartAddress;
     uint16_t Length;
     ModbusDataType  DataType;
+    ModbusNumberFormat NumberFormat;
     double ConversionCoefficient;
     MODBUS_READ_REQUEST  ReadRequest;
     int    DefaultFrequency;
+    ModbusAdaptivePolling AdaptivePolling;
     CapabilityType Type;
 } ModbusTelemetry, *PModbusTelemetry;
 
@@ -45,10 +52,12 @@ typedef struct ModbusProperty {
     const char*  StartAddress;
     uint16_t Length;
     ModbusDataType  DataType;
+    ModbusNumberFormat NumberFormat;
     double ConversionCoefficient;
     MODBUS_READ_REQUEST  ReadRequest;
     MODBUS_WRITE_1_REG_REQUEST WriteRequest;
     int    DefaultFrequency;
+    ModbusAdaptivePolling AdaptivePolling;
     ModbusAccessType Access;
     CapabilityType Type;
 } ModbusProperty, *PModbusProperty;
@@ -65,16 +74,28 @@ typedef struct ModbusCommand {
 
 typedef struct CapabilityContext {
     void* capability;
-    HANDLE hDevice;
-    LOCK_HANDLE hLock;
+    MODBUS_TCP_CONNECTION_HANDLE tcpConnection;
+    MODBUS_RTU_BUS_CLIENT_HANDLE rtuBus;
+    int32_t busDeadlineMs;      // time until the request is due on a shared RTU bus, negative if it is late
+    ModbusCircuitBreaker* breaker;  // health of the unit, shared by every request to it under breakerLock
+    LOCK_HANDLE breakerLock;
+    TICK_COUNTER_HANDLE breakerClock;
     MODBUS_CONNECTION_TYPE connectionType;
     PNP_BRIDGE_CLIENT_HANDLE clientHandle;
     PNP_BRIDGE_IOT_TYPE clientType;
     char * componentName;
 }CapabilityContext;
 
+// Polling context for a block read: the connection details of the device and the prebuilt
+// read request. capabilityContext.capability points to the ModbusReadBlock being polled.
+typedef struct ReadBlockContext {
+    CapabilityContext capabilityContext;
+    MODBUS_READ_REQUEST readRequest;
+    double* values;     // values of the block items decoded from the last read
+}ReadBlockContext;
+
 IOTHUB_CLIENT_RESULT ModbusPnp_StartPollingAllTelemetryProperty(void* context);
-void StopPollingTasks();
+void StopPollingTasks(void* context);
 
 int ModbusPnp_CommandHandler(
     PNPBRIDGE_COMPONENT_HANDLE PnpComponentHandle,
@@ -0,0 +1,95 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ModbusCircuitBreaker.h"
+
+void ModbusCircuitBreaker_Init(
+    ModbusCircuitBreaker* breaker,
+    uint32_t failureThreshold,
+    uint32_t minBackoff,
+    uint32_t maxBackoff)
+{
+    breaker->State = ModbusBreakerClosed;
+    breaker->FailureThreshold = (failureThreshold > 0) ? failureThreshold : 1;
+    breaker->MinBackoff = minBackoff;
+    breaker->MaxBackoff = (maxBackoff > minBackoff) ? maxBackoff : minBackoff;
+    breaker->Backoff = 0;
+    breaker->ConsecutiveFailures = 0;
+    breaker->RetryTime = 0;
+    breaker->TripCount = 0;
+}
+
+bool ModbusCircuitBreaker_Allow(
+    ModbusCircuitBreaker* breaker,
+    uint64_t now)
+{
+    switch (breaker->State)
+    {
+        case ModbusBreakerClosed:
+            return true;
+        case ModbusBreakerOpen:
+            if (now < breaker->RetryTime)
+            {
+                return false;
+            }
+            breaker->State = ModbusBreakerHalfOpen;
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool ModbusCircuitBreaker_RecordSuccess(
+    ModbusCircuitBreaker* breaker)
+{
+    bool changed = (ModbusBreakerClosed != breaker->State);
+
+    breaker->State = ModbusBreakerClosed;
+    breaker->ConsecutiveFailures = 0;
+    breaker->Backoff = 0;
+    return changed;
+}
+
+bool ModbusCircuitBreaker_RecordFailure(
+    ModbusCircuitBreaker* breaker,
+    uint64_t now)
+{
+    switch (breaker->State)
+    {
+        case ModbusBreakerClosed:
+            if (++breaker->ConsecutiveFailures < breaker->FailureThreshold)
+            {
+                return false;
+            }
+            breaker->Backoff = breaker->MinBackoff;
+            breaker->TripCount++;
+            break;
+        case ModbusBreakerHalfOpen:
+        {
+            uint64_t doubled = 2ULL * breaker->Backoff;
+            breaker->Backoff = (doubled < breaker->MaxBackoff) ? (uint32_t)doubled : breaker->MaxBackoff;
+            break;
+        }
+        default:
+            // A request that was let through before the breaker opened, the unit is already left alone
+            return false;
+    }
+
+    breaker->State = ModbusBreakerOpen;
+    breaker->RetryTime = now + breaker->Backoff;
+    return true;
+}
+
+const char* ModbusCircuitBreaker_GetStateName(
+    ModbusBreakerState state)
+{
+    switch (state)
+    {
+        case ModbusBreakerOpen:
+            return "open";
+        case ModbusBreakerHalfOpen:
+            return "halfOpen";
+        default:
+            return "closed";
+    }
+}
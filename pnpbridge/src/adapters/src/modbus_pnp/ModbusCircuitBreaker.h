@@ -0,0 +1,75 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Consecutive failed requests after which a unit is no longer sent requests
+#ifndef MODBUS_BREAKER_FAILURE_THRESHOLD
+#define MODBUS_BREAKER_FAILURE_THRESHOLD 3
+#endif
+
+// Bounds of the time (ms) a unit is left alone before it is probed again, doubled after every failed probe
+#ifndef MODBUS_BREAKER_MIN_BACKOFF_MS
+#define MODBUS_BREAKER_MIN_BACKOFF_MS 1000
+#endif
+#ifndef MODBUS_BREAKER_MAX_BACKOFF_MS
+#define MODBUS_BREAKER_MAX_BACKOFF_MS 60000
+#endif
+
+    typedef enum ModbusBreakerState {
+        ModbusBreakerClosed,    // the unit answers, every request is sent
+        ModbusBreakerOpen,      // the unit failed, requests are rejected until its backoff has elapsed
+        ModbusBreakerHalfOpen   // a single probe request is on its way to the unit
+    } ModbusBreakerState;
+
+    // Health of one Modbus unit. Requests to a unit that keeps failing are rejected without touching the
+    // connection, so that they do not hold up the other units sharing it while they wait out its timeouts.
+    // The breaker is not thread safe, its owner serializes access to it.
+    typedef struct ModbusCircuitBreaker {
+        ModbusBreakerState State;
+        uint32_t FailureThreshold;
+        uint32_t MinBackoff;
+        uint32_t MaxBackoff;
+        uint32_t Backoff;               // ms the unit is left alone after its last failure while open
+        uint32_t ConsecutiveFailures;
+        uint64_t RetryTime;             // time (ms) an open breaker lets a probe through
+        uint32_t TripCount;             // times the breaker opened from closed
+    } ModbusCircuitBreaker;
+
+    void ModbusCircuitBreaker_Init(
+        ModbusCircuitBreaker* breaker,
+        uint32_t failureThreshold,
+        uint32_t minBackoff,
+        uint32_t maxBackoff);
+
+    // Returns true if a request may be sent at now. An open breaker whose backoff has elapsed turns half-open and
+    // lets one request through as a probe; further requests are rejected until the outcome of the probe is recorded.
+    bool ModbusCircuitBreaker_Allow(
+        ModbusCircuitBreaker* breaker,
+        uint64_t now);
+
+    // Records a request that the unit answered. Returns true if the breaker changed state.
+    bool ModbusCircuitBreaker_RecordSuccess(
+        ModbusCircuitBreaker* breaker);
+
+    // Records a request that failed at now. The breaker opens once failures reach the threshold, or the probe of a
+    // half-open breaker failed, in which case the backoff doubles. Returns true if the breaker changed state.
+    bool ModbusCircuitBreaker_RecordFailure(
+        ModbusCircuitBreaker* breaker,
+        uint64_t now);
+
+    const char* ModbusCircuitBreaker_GetStateName(
+        ModbusBreakerState state);
+
+#ifdef __cplusplus
+}
+#endif
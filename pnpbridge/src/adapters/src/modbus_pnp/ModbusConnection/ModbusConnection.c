@@ -21,11 +21,15 @@ int ModbusPnp_GetHeaderSize(
     return headerSize;
 }
 
+// Returns true if response answers request. The exception code of a Modbus exception response is returned in
+// *exceptionCode, which is 0 for any other response.
 bool ValidateModbusResponse(
     MODBUS_CONNECTION_TYPE connectionType,
     uint8_t* response,
-    uint8_t* request)
+    uint8_t* request,
+    uint8_t* exceptionCode)
 {
+    *exceptionCode = 0;
     if (NULL == response)
     {
         return false;
@@ -39,7 +43,8 @@ bool ValidateModbusResponse(
     }
     else if (response[HEADER_SIZE] == request[HEADER_SIZE] + MODBUS_EXCEPTION_CODE)
     {
-        LogError("Modbus exception code: 0x%x", response[HEADER_SIZE + 1]);
+        *exceptionCode = response[HEADER_SIZE + 1];
+        LogError("Modbus exception code: 0x%x", *exceptionCode);
         return false;
     }
     else
@@ -57,42 +62,63 @@ int ProcessModbusResponse(
     size_t responseLength,
     uint8_t* result)
 {
-    int stepSize = 0;
-    int dataOffset = ModbusPnp_GetHeaderSize(connectionType);
-    int resultLength = -1;
+    bool isBit = false;
+    size_t dataSize = 0;
+    size_t dataOffset = ModbusPnp_GetHeaderSize(connectionType);
+    char* resultString = (char*)result;
 
-    // Get excpectd number of bits or registers in the payload
+    // Locate the data in the payload
     switch (response[dataOffset])   // Function code
     {
     case ReadCoils:
     case ReadInputs:
-        stepSize = 1;
+        isBit = true;
+        dataSize = 1;
         dataOffset += 2;            // Header + Function Code (1 uint8_t) + Data Length (1 uint8_t)
         break;
     case ReadHoldingRegisters:
     case ReadInputRegisters:
-        stepSize = 2;
+        dataSize = response[dataOffset + 1];
         dataOffset += 2;            // Header + Function Code (1 uint8_t) + Data Length (1 uint8_t)
         break;
     case WriteCoil:
-        stepSize = 1;
+        isBit = true;
+        dataSize = 2;
         dataOffset += 3;            // Header + Function Code (1 uint8_t) + Address (2 uint8_t)
         break;
     case WriteHoldingRegister:
-        stepSize = 2;
+        dataSize = 2;
         dataOffset += 3;            // Header + Function Code (1 uint8_t) + Address (2 uint8_t)
         break;
+    default:
+        LogError("Unsupported function code 0x%x.", response[dataOffset]);
+        return -1;
+    }
+
+    if (responseLength < dataOffset + dataSize)
+    {
+        LogError("Incomplete response: %d bytes of data expected.", (int)dataSize);
+        return -1;
+    }
+
+    if (isBit)
+    {
+        // Read bits (1 bit)
+        const char* data = (response[dataOffset] & 0b1) ? "true" : "false";
+        return snprintf(resultString, MODBUS_VALUE_MAX_LENGTH, "%s", data);
     }
 
     ModbusDataType dataType = INVALID;
-    int dataLength = 0;
+    uint16_t registerCount = 0;
+    ModbusNumberFormat numberFormat = { ModbusUInt16, ModbusBigEndian, ModbusBigEndian };
     double conversionCoefficient = 1.0;
     switch (capabilityType) {
     case Telemetry:
     {
         ModbusTelemetry* telemetry = (ModbusTelemetry*)capability;
         dataType = telemetry->DataType;
-        dataLength = telemetry->Length;
+        registerCount = telemetry->Length;
+        numberFormat = telemetry->NumberFormat;
         conversionCoefficient = telemetry->ConversionCoefficient;
         break;
     }
@@ -100,7 +126,8 @@ int ProcessModbusResponse(
     {
         ModbusProperty* property = (ModbusProperty*)capability;
         dataType = property->DataType;
-        dataLength = property->Length;
+        registerCount = property->Length;
+        numberFormat = property->NumberFormat;
         conversionCoefficient = property->ConversionCoefficient;
         break;
     }
@@ -108,192 +135,49 @@ int ProcessModbusResponse(
     {
         ModbusCommand* command = (ModbusCommand*)capability;
         dataType = command->DataType;
-        dataLength = command->Length;
+        registerCount = command->Length;
         conversionCoefficient = command->ConversionCoefficient;
         break;
     }
     }
 
-    // Check Endian-ness
-
-    if (stepSize == 1)
+    // A write response echoes the single register written
+    if (WriteHoldingRegister == response[ModbusPnp_GetHeaderSize(connectionType)])
     {
-        // Read bits (1 bit)
-        uint8_t bitVal = (uint8_t)(response[dataOffset] & 0b1);
-        const char* data = (bitVal == (uint8_t)1) ? "true" : "false";
-        resultLength = sprintf_s((char*)result, MODBUS_RESPONSE_MAX_LENGTH, "%s", data);
+        registerCount = 1;
+        numberFormat.Type = ModbusUInt16;
     }
-    else if (stepSize == 2)
+
+    switch (dataType)
     {
-        double value = 0.0;
-        switch (dataType)
-        {
-        case HEXSTRING:
+    case HEXSTRING:
+    case STRING:
+        if ((size_t)registerCount * 2 > dataSize)
         {
-            uint8_t *strBuffer = calloc((dataLength * 2) + 1, sizeof(uint8_t));
-            if (NULL == strBuffer)
-            {
-                LogError("Failed to convert the response to string: Memory allocation failed.");
-                return -1;
-            }
-            // Reverse data array
-            for (int i = 0; i < dataLength * 2; i++)
-            {
-                strBuffer[(dataLength * 2) - i - 1] = response[dataOffset + i];
-            }
-
-            uint8_t temp = 0x00;
-            for (int i = 0; i < dataLength; i++)
-            {
-                temp = strBuffer[i * 2];
-                strBuffer[i * 2] = strBuffer[(i * 2) + 1];
-                strBuffer[(i * 2) + 1] = temp;
-            }
-
-            // Convert Hex string
-            char* strPtr = (char*)result;
-            *(strPtr++) = '\"';
-            resultLength = 1;
-            for (int i = 0; i < (dataLength * 2); i++)
-            {
-                int length = 0;
-                length = sprintf_s(strPtr, MODBUS_RESPONSE_MAX_LENGTH - resultLength - 2, "%02X", (uint8_t)strBuffer[i]);
-                strPtr += length;
-                resultLength += length;
-            }
-
-            if (resultLength < (MODBUS_RESPONSE_MAX_LENGTH - 2))
-            {
-                result[resultLength++] = '\"';
-                result[resultLength++] = '\0';
-            }
-            free(strBuffer);
-            return resultLength;
+            LogError("Incomplete response: %d registers expected.", registerCount);
+            return -1;
         }
-        case STRING:
+        return ModbusValue_FormatString(dataType, response + dataOffset, registerCount, resultString, MODBUS_VALUE_MAX_LENGTH);
+    case NUMERIC:
+    case FLAG:
+    {
+        if ((size_t)ModbusNumber_GetRegisterCount(numberFormat.Type) * 2 > dataSize)
         {
-            uint8_t *strBuffer = calloc((dataLength * 2) + 1, sizeof(uint8_t));
-            if (NULL == strBuffer)
-            {
-                LogError("Failed to convert the response to string: Memory allocation failed.");
-                return -1;
-            }
-            // Reverse data array
-            for (int i = 0; i < dataLength * 2; i++)
-            {
-                strBuffer[(dataLength * 2) - i - 1] = response[dataOffset + i];
-            }
-
-            char temp = 0x00;
-            for (int i = 0; i < dataLength; i++)
-            {
-                temp = strBuffer[i * 2];
-                strBuffer[i * 2] = strBuffer[(i * 2) + 1];
-                strBuffer[(i * 2) + 1] = temp;
-            }
-
-            // Convert non-alpha-numberic char to Hex char
-            char* strPtr = (char*)result;
-            *(strPtr++) = '\"';
-            resultLength = 1;
-            for (int i = 0; i < (dataLength * 2); i++)
-            {
-                int length = 0;
-                if (iscsym(strBuffer[i]) != 0)
-                {
-                    length = sprintf_s(strPtr, MODBUS_RESPONSE_MAX_LENGTH - resultLength - 2, "%c", (char)strBuffer[i]);
-                }
-                else
-                {
-                    length = sprintf_s(strPtr, MODBUS_RESPONSE_MAX_LENGTH - resultLength - 2, "%02X", (uint8_t)strBuffer[i]);
-                }
-
-                strPtr += length;
-                resultLength += length;
-            }
-
-            if (resultLength < (MODBUS_RESPONSE_MAX_LENGTH - 2))
-            {
-                result[resultLength++] = '\"';
-                result[resultLength++] = '\0';
-            }
-            free(strBuffer);
-            return resultLength;
+            LogError("Incomplete response: %d registers expected.", ModbusNumber_GetRegisterCount(numberFormat.Type));
+            return -1;
         }
-        case NUMERIC:
-        {
-            int n = 1;
-            if (dataLength > 1 && *(char *)&n == 1)
-            {
-                // Is little Endian, reverse response array
-                uint8_t temp = 0x00;
-                for (size_t i = dataOffset, j = responseLength - 1; i < ((responseLength - dataOffset) / 2); i++, j--)
-                {
-                    temp = response[i];
-                    response[i] = response[j];
-                    response[j] = temp;
-                }
-            }
 
-            switch (dataLength)
-            {
-                case 1:
-                {
-                    uint16_t rawValue = ((response[dataOffset] << 8) + response[dataOffset + 1]);
-                    value = rawValue * conversionCoefficient;
-                    break;
-                }
-                case 2:
-                {
-                    uint32_t rawValue = 0;
-                    for (int i = 0; i < dataLength; i++)
-                    {
-                        rawValue <<= 16;
-                        rawValue += ((response[dataOffset + i * 2] << 8) + response[dataOffset + 1]);
-                    }
-                    value = rawValue * conversionCoefficient;
-                    break;
-                }
-                case 4:
-                {
-                    uint64_t rawValue = 0;
-                    for (int i = 0; i < dataLength; i++)
-                    {
-                        rawValue <<= 16;
-                        rawValue += ((response[dataOffset + i * 2] << 8) + response[dataOffset + 1]);
-                    }
-                    value = rawValue * conversionCoefficient;
-                    break;
-                }
-            }
-            break;
-        }
-        default:
-            LogError("Unsupported datatype.");
-            return -1;
+        double value = ModbusNumber_Decode(&numberFormat, response + dataOffset) * conversionCoefficient;
+        if (FLAG == dataType)
+        {
+            return snprintf(resultString, MODBUS_VALUE_MAX_LENGTH, "%s", (0 != value) ? "true" : "false");
         }
-        resultLength = sprintf_s((char*)result, MODBUS_RESPONSE_MAX_LENGTH, "%g", value);
+        return ModbusValue_FormatNumber(value, resultString, MODBUS_VALUE_MAX_LENGTH);
     }
-    return resultLength;
-}
-bool ModbusPnp_CloseDevice(
-    MODBUS_CONNECTION_TYPE connectionType,
-    HANDLE hDevice,
-    LOCK_HANDLE hLock)
-{
-    bool result = false;
-    switch (connectionType)
-    {
-        case TCP:
-            result = ModbusTcp_CloseDevice((SOCKET)hDevice, hLock);
-            break;
-        case RTU:
-            result = ModbusRtu_CloseDevice(hDevice, hLock);
-            break;
-        default:
-            break;
+    default:
+        LogError("Unsupported datatype.");
+        return -1;
     }
-    return result;
 }
 
 IOTHUB_CLIENT_RESULT ModbusPnp_SetReadRequest(
@@ -338,46 +222,170 @@ IOTHUB_CLIENT_RESULT ModbusPnp_SetWriteRequest(
     return result;
 }
 
-int ModbusPnp_ReadResponse(
-    MODBUS_CONNECTION_TYPE connectionType,
-    HANDLE handler,
-    uint8_t *responseArr,
-    uint32_t arrLen)
+// Sends a request and reads its response. TCP requests go through the pooled connection of the device, which
+// matches responses to requests by transaction ID, so requests of every component sharing it are in flight
+// together. RTU requests wait for the bus the device shares with every slave on its serial port, and hold it for
+// the whole exchange, whose response is delimited by the inter-frame timing of the line.
+static int ModbusPnp_Exchange(
+    CapabilityContext* capabilityContext,
+    uint8_t* requestArr,
+    int requestArrSize,
+    uint8_t* response,
+    uint32_t responseMaxLength)
 {
-    int result = -1;
-    switch (connectionType)
+    if (TCP == capabilityContext->connectionType)
     {
-        case TCP:
-            result = ModbusTcp_ReadResponse((SOCKET)handler, responseArr, arrLen);
-            break;
-        case RTU:
-            result = ModbusRtu_ReadResponse(handler, responseArr, arrLen);
-            break;
-        default:
-            break;
+        return ModbusTcpPool_Transact(capabilityContext->tcpConnection, requestArr, requestArrSize, response, responseMaxLength);
     }
-    return result;
+
+    HANDLE port;
+    ModbusRtuFrameTiming timing;
+    uint32_t waitMs = 0;
+    if (!ModbusRtuBus_Claim(capabilityContext->rtuBus, capabilityContext->busDeadlineMs, &port, &timing, &waitMs))
+    {
+        return -1;
+    }
+
+    int responseLength = -1;
+    if (requestArrSize != ModbusRtu_SendRequest(port, requestArr, requestArrSize))
+    {
+        LogError("Failed to send request.");
+    }
+    else
+    {
+        responseLength = ModbusRtu_ReadResponse(port, &timing, requestArr, response, responseMaxLength);
+    }
+
+    MODBUS_RTU_BUS_STATISTICS statistics;
+    bool windowEnded = ModbusRtuBus_Yield(capabilityContext->rtuBus, &statistics);
+
+    // Bus metrics are kept under the name of the serial port
+    const char* portName = ModbusRtuBus_GetPortName(capabilityContext->rtuBus);
+    PnpBridgeMetrics_ObserveDuration(portName, MODBUS_METRIC_BUS_WAIT, waitMs);
+    if (windowEnded)
+    {
+        PnpBridgeMetrics_SetGauge(portName, MODBUS_METRIC_BUS_UTILIZATION, statistics.UtilizationPercent);
+        PnpBridgeMetrics_SetGauge(portName, MODBUS_METRIC_BUS_WAITING_REQUESTS, statistics.WaitingRequests);
+    }
+    return responseLength;
 }
 
-int ModbusPnp_SendRequest(
-    MODBUS_CONNECTION_TYPE connectionType,
-    HANDLE handler,
-    uint8_t *requestArr,
-    uint32_t arrLen)
+// Exceptions that tell the unit, or the gateway in front of it, cannot serve requests right now. Others, such as
+// an illegal address, are answers to a request the unit is healthy enough to refuse.
+static bool ModbusPnp_IsUnitFailure(
+    uint8_t exceptionCode)
 {
-    int result = -1;
-    switch (connectionType)
+    switch (exceptionCode)
     {
-        case TCP:
-            result = ModbusTcp_SendRequest((SOCKET)handler, requestArr, arrLen);
-            break;
-        case RTU:
-            result = ModbusRtu_SendRequest(handler, requestArr, arrLen);
-            break;
+        case 0x04:  // server device failure
+        case 0x06:  // server device busy
+        case 0x0A:  // gateway path unavailable
+        case 0x0B:  // gateway target device failed to respond
+            return true;
         default:
-            break;
+            return false;
     }
-    return result;
+}
+
+void ModbusPnp_ReportBreakerState(
+    CapabilityContext* capabilityContext,
+    ModbusBreakerState state)
+{
+    PnpBridgeMetrics_SetGauge(capabilityContext->componentName, MODBUS_METRIC_BREAKER_STATE, (int64_t) state);
+
+    if (NULL != capabilityContext->clientHandle)
+    {
+        char telemetryMessageData[64];
+        (void) snprintf(telemetryMessageData, sizeof(telemetryMessageData), "{\"%s\":\"%s\"}",
+            MODBUS_TELEMETRY_BREAKER_STATE, ModbusCircuitBreaker_GetStateName(state));
+        if (IOTHUB_CLIENT_OK != PnpBridgeClient_SendTelemetry(capabilityContext->clientHandle, capabilityContext->componentName, telemetryMessageData))
+        {
+            LogError("Modbus Adapter: Unable to report circuit breaker state of \"%s\".", capabilityContext->componentName);
+        }
+    }
+}
+
+// Exchanges a request with the unit through its circuit breaker, and validates the response. Requests to a unit
+// that keeps failing are rejected with MODBUS_REQUEST_REJECTED before they wait for the connection, so that they
+// no longer hold up the other units sharing it, until a single probe finds the unit answering again.
+static int ModbusPnp_Transact(
+    CapabilityContext* capabilityContext,
+    uint8_t* requestArr,
+    int requestArrSize,
+    uint8_t* response,
+    uint32_t responseMaxLength)
+{
+    ModbusBreakerState state = ModbusBreakerClosed;
+    bool allowed = true;
+    bool stateChanged = false;
+    tickcounter_ms_t now = 0;
+
+    if (NULL != capabilityContext->breaker)
+    {
+        (void) tickcounter_get_current_ms(capabilityContext->breakerClock, &now);
+        Lock(capabilityContext->breakerLock);
+        state = capabilityContext->breaker->State;
+        allowed = ModbusCircuitBreaker_Allow(capabilityContext->breaker, (uint64_t) now);
+        stateChanged = (state != capabilityContext->breaker->State);
+        state = capabilityContext->breaker->State;
+        Unlock(capabilityContext->breakerLock);
+
+        if (stateChanged)
+        {
+            LogInfo("Probing unresponsive Modbus unit of \"%s\".", capabilityContext->componentName);
+            ModbusPnp_ReportBreakerState(capabilityContext, state);
+        }
+        if (!allowed)
+        {
+            PnpBridgeMetrics_AddCounter(capabilityContext->componentName, MODBUS_METRIC_REJECTED_REQUESTS, 1);
+            return MODBUS_REQUEST_REJECTED;
+        }
+    }
+
+    int responseLength = ModbusPnp_Exchange(capabilityContext, requestArr, requestArrSize, response, responseMaxLength);
+
+    // A unit that answers, even with an exception that refuses the request, is healthy
+    bool unitAnswered = false;
+    uint8_t exceptionCode = 0;
+    if (responseLength >= 0)
+    {
+        if (ValidateModbusResponse(capabilityContext->connectionType, response, requestArr, &exceptionCode))
+        {
+            unitAnswered = true;
+        }
+        else
+        {
+            LogError("Invalid response from Modbus unit of \"%s\".", capabilityContext->componentName);
+            unitAnswered = (0 != exceptionCode && !ModbusPnp_IsUnitFailure(exceptionCode));
+            responseLength = -1;
+        }
+    }
+
+    if (NULL != capabilityContext->breaker)
+    {
+        (void) tickcounter_get_current_ms(capabilityContext->breakerClock, &now);
+        Lock(capabilityContext->breakerLock);
+        stateChanged = unitAnswered ? ModbusCircuitBreaker_RecordSuccess(capabilityContext->breaker) :
+            ModbusCircuitBreaker_RecordFailure(capabilityContext->breaker, (uint64_t) now);
+        state = capabilityContext->breaker->State;
+        uint32_t backoff = capabilityContext->breaker->Backoff;
+        Unlock(capabilityContext->breakerLock);
+
+        if (stateChanged)
+        {
+            if (ModbusBreakerOpen == state)
+            {
+                LogError("Modbus unit of \"%s\" is not answering, holding back its requests for %u ms.", capabilityContext->componentName, backoff);
+            }
+            else
+            {
+                LogInfo("Modbus unit of \"%s\" is answering again.", capabilityContext->componentName);
+            }
+            ModbusPnp_ReportBreakerState(capabilityContext, state);
+        }
+    }
+
+    return responseLength;
 }
 
 int ModbusPnp_ReadCapability(
@@ -387,7 +395,7 @@ int ModbusPnp_ReadCapability(
 {
     uint8_t response[MODBUS_RESPONSE_MAX_LENGTH];
     memset(response, 0x00, MODBUS_RESPONSE_MAX_LENGTH);
-    size_t responseLength = 0;
+    int responseLength = 0;
 
     int resultLength = -1;
 
@@ -442,50 +450,98 @@ int ModbusPnp_ReadCapability(
         goto exit;
     }
 
-    if (LOCK_OK != Lock(capabilityContext->hLock))
+    responseLength = ModbusPnp_Transact(capabilityContext, requestArr, requestArrSize, response, MODBUS_RESPONSE_MAX_LENGTH);
+    if (responseLength < 0)
     {
-        LogError("Device communicate lock is abandoned.");
-        resultLength = -1;
+        LogError("Failed to get read response for capability \"%s\".", capabilityName);
+        resultLength = responseLength;
         goto exit;
     }
 
-    if (requestArrSize != ModbusPnp_SendRequest(capabilityContext->connectionType, capabilityContext->hDevice, requestArr, requestArrSize))
+    resultLength = ProcessModbusResponse(capabilityContext->connectionType, capabilityType, capabilityContext->capability, response, responseLength, resultedData);
+    if (resultLength < 0)
     {
-        LogError("Failed to send read request for capability \"%s\".", capabilityName);
+        LogError("Failed to parse response for reading capability \"%s\".", capabilityName);
         resultLength = -1;
         goto exit;
     }
 
-    responseLength = ModbusPnp_ReadResponse(capabilityContext->connectionType, capabilityContext->hDevice, response, MODBUS_RESPONSE_MAX_LENGTH);
-    if (responseLength < 0)
+exit:
+    return resultLength;
+}
+
+IOTHUB_CLIENT_RESULT ModbusPnp_SetReadBlockRequest(
+    ModbusDeviceConfig* deviceConfig,
+    const ModbusReadBlock* block,
+    MODBUS_READ_REQUEST* readRequest)
+{
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_ERROR;
+    switch (deviceConfig->ConnectionType)
     {
-        LogError("Failed to get read response for capability \"%s\".", capabilityName);
-        resultLength = -1;
-        goto exit;
+        case TCP:
+            result = ModbusTcp_SetReadBlockRequest(block, readRequest, deviceConfig->UnitId);
+            break;
+        case RTU:
+            result = ModbusRtu_SetReadBlockRequest(block, readRequest, deviceConfig->UnitId);
+            break;
+        default:
+            break;
     }
+    return result;
+}
+
+int ModbusPnp_ReadBlock(
+    CapabilityContext* capabilityContext,
+    const ModbusReadBlock* block,
+    MODBUS_READ_REQUEST* readRequest,
+    uint8_t* response)
+{
+    int responseLength = -1;
+    uint8_t* requestArr = NULL;
+    int requestArrSize = 0;
+    const int HEADER_SIZE = ModbusPnp_GetHeaderSize(capabilityContext->connectionType);
 
-    if (ValidateModbusResponse(capabilityContext->connectionType, response, requestArr))
+    switch (capabilityContext->connectionType)
     {
-        resultLength = ProcessModbusResponse(capabilityContext->connectionType, capabilityType, capabilityContext->capability, response, responseLength, resultedData);
+        case TCP:
+            requestArr = readRequest->TcpArr;
+            requestArrSize = sizeof(readRequest->TcpArr);
+            break;
+        case RTU:
+            requestArr = readRequest->RtuArr;
+            requestArrSize = sizeof(readRequest->RtuArr);
+            break;
+        default:
+            LogError("Modbus read is not supported for the connection type.");
+            return -1;
+    }
 
-        if (resultLength < 0)
-        {
-            LogError("Failed to parse response for reading capability \"%s\".", capabilityName);
-            resultLength = -1;
-            goto exit;
-        }
+    memset(response, 0x00, MODBUS_READ_BLOCK_RESPONSE_MAX_LENGTH);
+
+    // Polls of a unit whose requests are held back fail quietly, the breaker logs when it opens and closes
+    responseLength = ModbusPnp_Transact(capabilityContext, requestArr, requestArrSize, response, MODBUS_READ_BLOCK_RESPONSE_MAX_LENGTH);
+    if (MODBUS_REQUEST_REJECTED == responseLength)
+    {
+        goto exit;
     }
-    else
+    else if (responseLength < 0)
     {
-        LogError("Invalid response for reading capability \"%s\".", capabilityName);
-        resultLength = -1;
+        LogError("Failed to get read response for block at address %d.", block->StartAddress);
+        responseLength = -1;
         goto exit;
+    }
 
+    // Function code (1 uint8_t) + Data Length (1 uint8_t) + data
+    uint16_t dataSize = ModbusPnp_GetReadBlockDataSize(block);
+    if (response[HEADER_SIZE + 1] != dataSize || responseLength < HEADER_SIZE + 2 + dataSize)
+    {
+        LogError("Incomplete response for reading block at address %d.", block->StartAddress);
+        responseLength = -1;
+        goto exit;
     }
 
 exit:
-    Unlock(capabilityContext->hLock);
-    return resultLength;
+    return responseLength;
 }
 
 int ModbusPnp_WriteToCapability(
@@ -496,7 +552,7 @@ int ModbusPnp_WriteToCapability(
 {
     uint8_t response[MODBUS_RESPONSE_MAX_LENGTH];
     memset(response, 0x00, MODBUS_RESPONSE_MAX_LENGTH);
-    size_t responseLength = 0;
+    int responseLength = 0;
     int resultLength = -1;
 
     const char* capabilityName = NULL;
@@ -561,46 +617,22 @@ int ModbusPnp_WriteToCapability(
             goto exit;
     }
 
-    if (LOCK_OK != Lock(capabilityContext->hLock))
-    {
-        LogError("Device communicate lock is abandoned.");
-        resultLength = -1;
-        goto exit;
-    }
-
-    if (requestArrSize != ModbusPnp_SendRequest(capabilityContext->connectionType, capabilityContext->hDevice, requestArr, requestArrSize))
-    {
-        LogError("Failed to send write request for capability \"%s\".", capabilityName);
-        resultLength = -1;
-        goto exit;
-    }
-
-    responseLength = ModbusPnp_ReadResponse(capabilityContext->connectionType, capabilityContext->hDevice, response, MODBUS_RESPONSE_MAX_LENGTH);
+    responseLength = ModbusPnp_Transact(capabilityContext, requestArr, requestArrSize, response, MODBUS_RESPONSE_MAX_LENGTH);
     if (responseLength < 0)
     {
         LogError("Failed to get write response for capability \"%s\".", capabilityName);
-        resultLength = -1;
+        resultLength = responseLength;
         goto exit;
     }
 
-    if (ValidateModbusResponse(capabilityContext->connectionType, response, requestArr))
-    {
-        resultLength = ProcessModbusResponse(capabilityContext->connectionType, capabilityType, capabilityContext->capability, response, responseLength, resultedData);
-        if (resultLength < 0)
-        {
-            LogError("Failed to parse response for command \"%s\".", capabilityName);
-            resultLength = -1;
-            goto exit;
-        }
-    }
-    else
+    resultLength = ProcessModbusResponse(capabilityContext->connectionType, capabilityType, capabilityContext->capability, response, responseLength, resultedData);
+    if (resultLength < 0)
     {
-        LogError("Invalid response for command \"%s\".", capabilityName);
+        LogError("Failed to parse response for command \"%s\".", capabilityName);
         resultLength = -1;
         goto exit;
     }
 
 exit:
-    Unlock(capabilityContext->hLock);
     return resultLength;
 }
\ No newline at end of file
@@ -11,15 +11,39 @@ extern "C"
 #include "ModbusConnectionHelper.h"
 #include "ModbusRtuConnection.h"
 #include "ModbusTCPConnection.h"
+#include "ModbusRtuBus.h"
 #include "../ModbusPnp.h"
 #include "../ModbusCapability.h"
+#include "../ModbusReadBlock.h"
+
+// Metrics of shared RTU buses, kept with the serial port name in place of a component name
+#define MODBUS_METRIC_BUS_UTILIZATION "pnpbridge_modbus_bus_utilization_percent"
+#define MODBUS_METRIC_BUS_WAITING_REQUESTS "pnpbridge_modbus_bus_waiting_requests"
+#define MODBUS_METRIC_BUS_WAIT "pnpbridge_modbus_bus_wait_ms"
+
+// Read requests a component sends per minute at the current polling intervals, which adaptive polling varies
+#define MODBUS_METRIC_POLL_RATE "pnpbridge_modbus_polls_per_minute"
+
+// State of the circuit breaker of a component's unit, as a ModbusBreakerState, and the requests it held back
+#define MODBUS_METRIC_BREAKER_STATE "pnpbridge_modbus_breaker_state"
+#define MODBUS_METRIC_REJECTED_REQUESTS "pnpbridge_modbus_rejected_requests_total"
+
+// Telemetry a component sends whenever the circuit breaker of its unit changes state
+#define MODBUS_TELEMETRY_BREAKER_STATE "modbusBreakerState"
+
+// Returned instead of a response length when a request is held back because its unit is failing
+#define MODBUS_REQUEST_REJECTED -2
 
 // ModbusConnection "Public" methods
 
-bool ModbusPnp_CloseDevice(MODBUS_CONNECTION_TYPE connectionType, HANDLE hDevice, LOCK_HANDLE lock);
+int ModbusPnp_GetHeaderSize(MODBUS_CONNECTION_TYPE connectionType);
+void ModbusPnp_ReportBreakerState(CapabilityContext* capabilityContext, ModbusBreakerState state);
+
 IOTHUB_CLIENT_RESULT ModbusPnp_SetReadRequest(ModbusDeviceConfig* deviceConfig, CapabilityType capabilityType, void* capability);
 int ModbusPnp_ReadCapability(CapabilityContext* capabilityContext, CapabilityType capabilityType, uint8_t* resultedData);
 int ModbusPnp_WriteToCapability(CapabilityContext* capabilityContext, CapabilityType capabilityType, char* requestStr, uint8_t* resultedData);
+IOTHUB_CLIENT_RESULT ModbusPnp_SetReadBlockRequest(ModbusDeviceConfig* deviceConfig, const ModbusReadBlock* block, MODBUS_READ_REQUEST* readRequest);
+int ModbusPnp_ReadBlock(CapabilityContext* capabilityContext, const ModbusReadBlock* block, MODBUS_READ_REQUEST* readRequest, uint8_t* response);
 
 #ifdef __cplusplus
 }
@@ -10,7 +10,10 @@ extern "C"
 #include "../ModbusEnum.h"
 
 #define MODBUS_EXCEPTION_CODE 0x80
-#define MODBUS_RESPONSE_MAX_LENGTH 32
+// Largest Modbus PDU, and the largest response carrying it: MBAP header (7) + PDU on TCP, which is longer
+// than Unit ID (1) + PDU + CRC (2) on RTU
+#define MODBUS_PDU_MAX_LENGTH 253
+#define MODBUS_RESPONSE_MAX_LENGTH (7 + MODBUS_PDU_MAX_LENGTH)
 
     // Modbus Operation
     typedef struct _MODBUS_TCP_MBAP_HEADER
@@ -0,0 +1,490 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/singlylinkedlist.h"
+
+#include "ModbusRtuBus.h"
+
+    typedef struct MODBUS_RTU_BUS_TAG MODBUS_RTU_BUS;
+
+    typedef struct MODBUS_RTU_BUS_CLIENT_TAG {
+        MODBUS_RTU_BUS* Bus;
+
+        // Guarded by the bus' lock
+        uint32_t Weight;
+        uint64_t Round;             // last round the client was granted the bus in
+        uint32_t GrantedInRound;    // requests granted the bus in that round
+    } MODBUS_RTU_BUS_CLIENT;
+
+    // A request waiting for the bus, on the stack of the thread that claimed it
+    typedef struct MODBUS_RTU_BUS_WAITER {
+        MODBUS_RTU_BUS_CLIENT* Client;
+        int64_t Deadline;           // on the bus' clock
+        uint64_t Sequence;          // arrival order, breaks ties between equal deadlines
+        bool Granted;
+        COND_HANDLE GrantCondition;
+    } MODBUS_RTU_BUS_WAITER;
+
+    struct MODBUS_RTU_BUS_TAG {
+        MODBUS_RTU_BUS_POOL_HANDLE Pool;
+        char* PortName;
+        MODBUS_RTU_LINE_SETTINGS LineSettings;
+        HANDLE Port;
+        ModbusRtuFrameTiming Timing;
+        size_t RefCount;                // guarded by the pool's lock
+
+        LOCK_HANDLE Lock;               // guards everything below
+        TICK_COUNTER_HANDLE Clock;
+        bool Busy;
+        SINGLYLINKEDLIST_HANDLE Waiters;
+        size_t WaiterCount;
+        uint64_t NextSequence;
+        uint64_t Round;
+
+        tickcounter_ms_t GrantTime;     // when the exchange in progress was granted the bus
+        tickcounter_ms_t WindowStart;
+        uint64_t WindowBusyMs;
+        uint64_t Transactions;
+    };
+
+    typedef struct MODBUS_RTU_BUS_POOL_TAG {
+        LOCK_HANDLE Lock;
+        SINGLYLINKEDLIST_HANDLE Buses;
+        MODBUS_RTU_BUS_OPEN_PORT OpenPort;
+        MODBUS_RTU_BUS_CLOSE_PORT ClosePort;
+    } MODBUS_RTU_BUS_POOL;
+
+static void ModbusRtuBus_DestroyBus(
+    MODBUS_RTU_BUS* bus,
+    bool portOpen)
+{
+    if (portOpen)
+    {
+        if (!bus->Pool->ClosePort(bus->Port))
+        {
+            LogError("Failed to close serial port \"%s\".", bus->PortName);
+        }
+        LogInfo("Serial Port Closed.");
+    }
+
+    if (NULL != bus->Waiters)
+    {
+        singlylinkedlist_destroy(bus->Waiters);
+    }
+    if (NULL != bus->Clock)
+    {
+        tickcounter_destroy(bus->Clock);
+    }
+    if (NULL != bus->Lock)
+    {
+        Lock_Deinit(bus->Lock);
+    }
+    free(bus->PortName);
+    free(bus);
+}
+
+static MODBUS_RTU_BUS* ModbusRtuBus_CreateBus(
+    MODBUS_RTU_BUS_POOL* pool,
+    const char* portName,
+    const MODBUS_RTU_LINE_SETTINGS* lineSettings,
+    const void* portConfig)
+{
+    MODBUS_RTU_BUS* bus = calloc(1, sizeof(MODBUS_RTU_BUS));
+    if (NULL == bus)
+    {
+        LogError("Could not allocate memory for the bus on \"%s\".", portName);
+        return NULL;
+    }
+
+    bus->Pool = pool;
+    bus->LineSettings = *lineSettings;
+    bus->RefCount = 1;
+    ModbusRtu_GetFrameTiming(lineSettings->BaudRate, &bus->Timing);
+    bus->Lock = Lock_Init();
+    bus->Clock = tickcounter_create();
+    bus->Waiters = singlylinkedlist_create();
+    if (0 != mallocAndStrcpy_s(&bus->PortName, portName) || NULL == bus->Lock || NULL == bus->Clock || NULL == bus->Waiters)
+    {
+        LogError("Could not create the bus on \"%s\".", portName);
+        ModbusRtuBus_DestroyBus(bus, false);
+        return NULL;
+    }
+
+    if (!pool->OpenPort(portConfig, &bus->Port))
+    {
+        ModbusRtuBus_DestroyBus(bus, false);
+        return NULL;
+    }
+
+    (void)tickcounter_get_current_ms(bus->Clock, &bus->WindowStart);
+    return bus;
+}
+
+MODBUS_RTU_BUS_POOL_HANDLE ModbusRtuBus_CreatePool(
+    MODBUS_RTU_BUS_OPEN_PORT openPort,
+    MODBUS_RTU_BUS_CLOSE_PORT closePort)
+{
+    if (NULL == openPort || NULL == closePort)
+    {
+        LogError("ModbusRtuBus_CreatePool: Invalid arguments.");
+        return NULL;
+    }
+
+    MODBUS_RTU_BUS_POOL* pool = calloc(1, sizeof(MODBUS_RTU_BUS_POOL));
+    if (NULL == pool)
+    {
+        LogError("Could not allocate memory for the Modbus RTU bus pool.");
+        return NULL;
+    }
+
+    pool->OpenPort = openPort;
+    pool->ClosePort = closePort;
+    pool->Lock = Lock_Init();
+    pool->Buses = singlylinkedlist_create();
+    if (NULL == pool->Lock || NULL == pool->Buses)
+    {
+        LogError("Could not create the Modbus RTU bus pool.");
+        ModbusRtuBus_DestroyPool(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void ModbusRtuBus_DestroyPool(
+    MODBUS_RTU_BUS_POOL_HANDLE pool)
+{
+    if (NULL == pool)
+    {
+        return;
+    }
+
+    if (NULL != pool->Buses)
+    {
+        if (NULL != singlylinkedlist_get_head_item(pool->Buses))
+        {
+            LogError("Modbus RTU bus pool destroyed while buses are still in use.");
+        }
+        singlylinkedlist_destroy(pool->Buses);
+    }
+    if (NULL != pool->Lock)
+    {
+        Lock_Deinit(pool->Lock);
+    }
+    free(pool);
+}
+
+MODBUS_RTU_BUS_CLIENT_HANDLE ModbusRtuBus_Acquire(
+    MODBUS_RTU_BUS_POOL_HANDLE pool,
+    const char* portName,
+    const MODBUS_RTU_LINE_SETTINGS* lineSettings,
+    const void* portConfig)
+{
+    if (NULL == pool || NULL == portName || NULL == lineSettings)
+    {
+        LogError("ModbusRtuBus_Acquire: Invalid arguments.");
+        return NULL;
+    }
+
+    MODBUS_RTU_BUS_CLIENT* client = calloc(1, sizeof(MODBUS_RTU_BUS_CLIENT));
+    if (NULL == client)
+    {
+        LogError("Could not allocate memory for a client of the bus on \"%s\".", portName);
+        return NULL;
+    }
+    client->Weight = 1;
+
+    if (LOCK_OK != Lock(pool->Lock))
+    {
+        LogError("Modbus RTU bus pool lock is abandoned.");
+        free(client);
+        return NULL;
+    }
+
+    LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(pool->Buses);
+    while (NULL != item)
+    {
+        MODBUS_RTU_BUS* existing = (MODBUS_RTU_BUS*)singlylinkedlist_item_get_value(item);
+        if (0 == strcmp(existing->PortName, portName))
+        {
+            const MODBUS_RTU_LINE_SETTINGS* settings = &existing->LineSettings;
+            if (settings->BaudRate != lineSettings->BaudRate || settings->DataBits != lineSettings->DataBits ||
+                settings->StopBits != lineSettings->StopBits || settings->Parity != lineSettings->Parity)
+            {
+                LogError("Serial port \"%s\" is already open at %u baud, %u data bits, stop bits %u and parity %u, not %u baud, %u data bits, stop bits %u and parity %u.",
+                    portName, settings->BaudRate, settings->DataBits, settings->StopBits, settings->Parity,
+                    lineSettings->BaudRate, lineSettings->DataBits, lineSettings->StopBits, lineSettings->Parity);
+                free(client);
+                client = NULL;
+                goto exit;
+            }
+
+            existing->RefCount++;
+            client->Bus = existing;
+            LogInfo("Sharing the bus on \"%s\" with %d other components.", portName, (int)(existing->RefCount - 1));
+            goto exit;
+        }
+        item = singlylinkedlist_get_next_item(item);
+    }
+
+    client->Bus = ModbusRtuBus_CreateBus(pool, portName, lineSettings, portConfig);
+    if (NULL == client->Bus)
+    {
+        free(client);
+        client = NULL;
+    }
+    else if (NULL == singlylinkedlist_add(pool->Buses, client->Bus))
+    {
+        LogError("Could not add the bus on \"%s\" to the pool.", portName);
+        ModbusRtuBus_DestroyBus(client->Bus, true);
+        free(client);
+        client = NULL;
+    }
+
+exit:
+    Unlock(pool->Lock);
+    return client;
+}
+
+void ModbusRtuBus_Release(
+    MODBUS_RTU_BUS_CLIENT_HANDLE client)
+{
+    if (NULL == client)
+    {
+        return;
+    }
+
+    MODBUS_RTU_BUS* bus = client->Bus;
+    MODBUS_RTU_BUS_POOL* pool = bus->Pool;
+    bool lastReference = false;
+
+    Lock(pool->Lock);
+    if (0 == --bus->RefCount)
+    {
+        LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(pool->Buses);
+        while (NULL != item && bus != singlylinkedlist_item_get_value(item))
+        {
+            item = singlylinkedlist_get_next_item(item);
+        }
+        if (NULL != item)
+        {
+            singlylinkedlist_remove(pool->Buses, item);
+        }
+        lastReference = true;
+    }
+    Unlock(pool->Lock);
+
+    free(client);
+    if (lastReference)
+    {
+        ModbusRtuBus_DestroyBus(bus, true);
+    }
+}
+
+void ModbusRtuBus_SetWeight(
+    MODBUS_RTU_BUS_CLIENT_HANDLE client,
+    uint32_t weight)
+{
+    if (NULL == client)
+    {
+        return;
+    }
+
+    Lock(client->Bus->Lock);
+    client->Weight = (0 == weight) ? 1 : weight;
+    Unlock(client->Bus->Lock);
+}
+
+static bool ModbusRtuBus_HasCredit(
+    const MODBUS_RTU_BUS* bus,
+    const MODBUS_RTU_BUS_CLIENT* client)
+{
+    return client->Round != bus->Round || client->GrantedInRound < client->Weight;
+}
+
+// Hands the bus to the waiting request of a client with credit left in the round that has the earliest
+// deadline, starting a new round if no waiting client has any. Returns false if no request is waiting.
+// Called with the bus' lock held.
+static bool ModbusRtuBus_GrantNext(
+    MODBUS_RTU_BUS* bus)
+{
+    LIST_ITEM_HANDLE selectedItem = NULL;
+    MODBUS_RTU_BUS_WAITER* selected = NULL;
+
+    for (int pass = 0; pass < 2 && NULL == selected; pass++)
+    {
+        LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(bus->Waiters);
+        if (NULL == item)
+        {
+            return false;
+        }
+
+        while (NULL != item)
+        {
+            MODBUS_RTU_BUS_WAITER* waiter = (MODBUS_RTU_BUS_WAITER*)singlylinkedlist_item_get_value(item);
+            if (ModbusRtuBus_HasCredit(bus, waiter->Client) &&
+                (NULL == selected || waiter->Deadline < selected->Deadline ||
+                    (waiter->Deadline == selected->Deadline && waiter->Sequence < selected->Sequence)))
+            {
+                selected = waiter;
+                selectedItem = item;
+            }
+            item = singlylinkedlist_get_next_item(item);
+        }
+
+        if (NULL == selected)
+        {
+            // Every waiting client used up its weight, the next round starts
+            bus->Round++;
+        }
+    }
+
+    singlylinkedlist_remove(bus->Waiters, selectedItem);
+    bus->WaiterCount--;
+
+    MODBUS_RTU_BUS_CLIENT* client = selected->Client;
+    if (client->Round != bus->Round)
+    {
+        client->Round = bus->Round;
+        client->GrantedInRound = 0;
+    }
+    client->GrantedInRound++;
+
+    selected->Granted = true;
+    Condition_Post(selected->GrantCondition);
+    return true;
+}
+
+bool ModbusRtuBus_Claim(
+    MODBUS_RTU_BUS_CLIENT_HANDLE client,
+    int32_t deadlineMs,
+    HANDLE* port,
+    ModbusRtuFrameTiming* timing,
+    uint32_t* waitMs)
+{
+    if (NULL == client || NULL == port || NULL == timing)
+    {
+        LogError("ModbusRtuBus_Claim: Invalid arguments.");
+        return false;
+    }
+
+    MODBUS_RTU_BUS* bus = client->Bus;
+    tickcounter_ms_t start = 0;
+    tickcounter_ms_t now = 0;
+
+    if (LOCK_OK != Lock(bus->Lock))
+    {
+        LogError("Device communicate lock is abandoned.");
+        return false;
+    }
+
+    (void)tickcounter_get_current_ms(bus->Clock, &start);
+    if (bus->Busy)
+    {
+        MODBUS_RTU_BUS_WAITER waiter;
+        waiter.Client = client;
+        waiter.Deadline = (int64_t)start + deadlineMs;
+        waiter.Sequence = bus->NextSequence++;
+        waiter.Granted = false;
+        waiter.GrantCondition = Condition_Init();
+        if (NULL == waiter.GrantCondition || NULL == singlylinkedlist_add(bus->Waiters, &waiter))
+        {
+            LogError("Could not queue a request for the bus on \"%s\".", bus->PortName);
+            if (NULL != waiter.GrantCondition)
+            {
+                Condition_Deinit(waiter.GrantCondition);
+            }
+            Unlock(bus->Lock);
+            return false;
+        }
+        bus->WaiterCount++;
+
+        while (!waiter.Granted)
+        {
+            Condition_Wait(waiter.GrantCondition, bus->Lock, 0);
+        }
+        Condition_Deinit(waiter.GrantCondition);
+    }
+    else
+    {
+        bus->Busy = true;
+        if (!ModbusRtuBus_HasCredit(bus, client))
+        {
+            bus->Round++;
+        }
+        if (client->Round != bus->Round)
+        {
+            client->Round = bus->Round;
+            client->GrantedInRound = 0;
+        }
+        client->GrantedInRound++;
+    }
+
+    (void)tickcounter_get_current_ms(bus->Clock, &now);
+    bus->GrantTime = now;
+    *port = bus->Port;
+    *timing = bus->Timing;
+    Unlock(bus->Lock);
+
+    if (NULL != waitMs)
+    {
+        *waitMs = (uint32_t)(now - start);
+    }
+    return true;
+}
+
+bool ModbusRtuBus_Yield(
+    MODBUS_RTU_BUS_CLIENT_HANDLE client,
+    MODBUS_RTU_BUS_STATISTICS* statistics)
+{
+    if (NULL == client)
+    {
+        return false;
+    }
+
+    MODBUS_RTU_BUS* bus = client->Bus;
+    bool windowEnded = false;
+    tickcounter_ms_t now = 0;
+
+    Lock(bus->Lock);
+    (void)tickcounter_get_current_ms(bus->Clock, &now);
+    bus->WindowBusyMs += now - bus->GrantTime;
+    bus->Transactions++;
+
+    tickcounter_ms_t windowLength = now - bus->WindowStart;
+    if (windowLength >= MODBUS_RTU_BUS_UTILIZATION_WINDOW_MS)
+    {
+        if (NULL != statistics)
+        {
+            uint64_t utilization = (100 * bus->WindowBusyMs) / windowLength;
+            statistics->Transactions = bus->Transactions;
+            statistics->UtilizationPercent = (uint32_t)((utilization > 100) ? 100 : utilization);
+            statistics->WaitingRequests = (uint32_t)bus->WaiterCount;
+            windowEnded = true;
+        }
+        bus->WindowStart = now;
+        bus->WindowBusyMs = 0;
+    }
+
+    if (!ModbusRtuBus_GrantNext(bus))
+    {
+        bus->Busy = false;
+    }
+    Unlock(bus->Lock);
+
+    return windowEnded;
+}
+
+const char* ModbusRtuBus_GetPortName(
+    MODBUS_RTU_BUS_CLIENT_HANDLE client)
+{
+    return (NULL == client) ? NULL : client->Bus->PortName;
+}
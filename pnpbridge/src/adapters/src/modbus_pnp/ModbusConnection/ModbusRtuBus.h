@@ -0,0 +1,92 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ModbusRtuFraming.h"
+
+// Bus utilisation is measured over windows of this length
+#ifndef MODBUS_RTU_BUS_UTILIZATION_WINDOW_MS
+#define MODBUS_RTU_BUS_UTILIZATION_WINDOW_MS 10000
+#endif
+
+    // Serial ports shared by every component of the adapter whose slaves are on the same RS-485 line. A port is
+    // opened once, by the first component on it, and exchanges with its slaves are granted the bus one at a time
+    // by weighted round-robin: of the requests waiting, those of components that have not used up their weight in
+    // the current round go first, earliest poll deadline first. A round ends once every waiting component has.
+    typedef struct MODBUS_RTU_BUS_POOL_TAG* MODBUS_RTU_BUS_POOL_HANDLE;
+    typedef struct MODBUS_RTU_BUS_CLIENT_TAG* MODBUS_RTU_BUS_CLIENT_HANDLE;
+
+    // Settings of the line every component on a port must agree on
+    typedef struct MODBUS_RTU_LINE_SETTINGS {
+        uint32_t BaudRate;
+        uint8_t DataBits;
+        uint8_t StopBits;
+        uint8_t Parity;
+    } MODBUS_RTU_LINE_SETTINGS;
+
+    // Opens and configures a port for portConfig, as passed to ModbusRtuBus_Acquire
+    typedef bool(*MODBUS_RTU_BUS_OPEN_PORT)(const void* portConfig, HANDLE* port);
+    typedef bool(*MODBUS_RTU_BUS_CLOSE_PORT)(HANDLE port);
+
+    typedef struct MODBUS_RTU_BUS_STATISTICS {
+        uint64_t Transactions;          // exchanges on the bus since its port was opened
+        uint32_t UtilizationPercent;    // share of the last utilisation window the bus was in use
+        uint32_t WaitingRequests;       // requests waiting for the bus when the window ended
+    } MODBUS_RTU_BUS_STATISTICS;
+
+    MODBUS_RTU_BUS_POOL_HANDLE ModbusRtuBus_CreatePool(
+        MODBUS_RTU_BUS_OPEN_PORT openPort,
+        MODBUS_RTU_BUS_CLOSE_PORT closePort);
+
+    // Every client acquired from the pool must have been released
+    void ModbusRtuBus_DestroyPool(
+        MODBUS_RTU_BUS_POOL_HANDLE pool);
+
+    // Returns a new client of the bus on portName, opening the port with portConfig if no component holds it yet.
+    // Returns NULL if the port could not be opened, or is already open with other line settings.
+    MODBUS_RTU_BUS_CLIENT_HANDLE ModbusRtuBus_Acquire(
+        MODBUS_RTU_BUS_POOL_HANDLE pool,
+        const char* portName,
+        const MODBUS_RTU_LINE_SETTINGS* lineSettings,
+        const void* portConfig);
+
+    // Closes the port once its last client is released
+    void ModbusRtuBus_Release(
+        MODBUS_RTU_BUS_CLIENT_HANDLE client);
+
+    // Sets how many requests of the client are granted the bus per round while others wait, 1 by default
+    void ModbusRtuBus_SetWeight(
+        MODBUS_RTU_BUS_CLIENT_HANDLE client,
+        uint32_t weight);
+
+    // Waits until the bus is granted to a request due in deadlineMs, negative if it is already late, and returns the
+    // port with its frame timing and how long the request waited. ModbusRtuBus_Yield must follow once the exchange
+    // is over. Returns false if the request could not be queued.
+    bool ModbusRtuBus_Claim(
+        MODBUS_RTU_BUS_CLIENT_HANDLE client,
+        int32_t deadlineMs,
+        HANDLE* port,
+        ModbusRtuFrameTiming* timing,
+        uint32_t* waitMs);
+
+    // Hands the bus on to the next waiting request. Returns true, with statistics filled in, if a utilisation
+    // window of the bus ended with this exchange.
+    bool ModbusRtuBus_Yield(
+        MODBUS_RTU_BUS_CLIENT_HANDLE client,
+        MODBUS_RTU_BUS_STATISTICS* statistics);
+
+    const char* ModbusRtuBus_GetPortName(
+        MODBUS_RTU_BUS_CLIENT_HANDLE client);
+
+#ifdef __cplusplus
+}
+#endif
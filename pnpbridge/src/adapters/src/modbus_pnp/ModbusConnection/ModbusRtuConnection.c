@@ -1,9 +1,9 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
-#include "azure_c_shared_utility/threadapi.h"
 #include "ModbusRtuConnection.h"
 #ifndef WIN32
+#include <termios.h>
 #include <unistd.h>
 #endif // WIN32
 
@@ -41,24 +41,16 @@ int ModbusRtu_GetHeaderSize(void)
 }
 
 bool ModbusRtu_CloseDevice(
-    HANDLE hDevice,
-    LOCK_HANDLE hLock)
+    HANDLE hDevice)
 {
     bool result = false;
 
-    if (LOCK_OK != Lock(hLock))
-    {
-        LogError("Device communicate lock could not be acquired.");
-        return result;
-    }
 #ifdef WIN32
     result = (0 != CloseHandle(hDevice)); // CloseHandle returns nonzero value on success
 #else
     result = !(close(hDevice));
 #endif
-    
-    Unlock(hLock);
-    LogInfo("Serial Port Closed.");
+
     return result;
 }
 
@@ -114,6 +106,22 @@ IOTHUB_CLIENT_RESULT ModbusRtu_SetReadRequest(
     return IOTHUB_CLIENT_OK;
 }
 
+IOTHUB_CLIENT_RESULT ModbusRtu_SetReadBlockRequest(
+    const ModbusReadBlock* block,
+    MODBUS_READ_REQUEST* readRequest,
+    uint8_t unitId)
+{
+    readRequest->RtuRequest.UnitID = unitId;
+    readRequest->RtuRequest.Payload.FunctionCode = block->FunctionCode;
+    readRequest->RtuRequest.Payload.StartAddr_Hi = (block->StartAddress >> 8) & 0xff;
+    readRequest->RtuRequest.Payload.StartAddr_Lo = block->StartAddress & 0xff;
+    readRequest->RtuRequest.Payload.ReadLen_Hi = (block->Length >> 8) & 0xff;
+    readRequest->RtuRequest.Payload.ReadLen_Lo = block->Length & 0xff;
+    readRequest->RtuRequest.CRC = GetCRC(readRequest->RtuArr, RTU_REQUEST_SIZE - 2);
+
+    return IOTHUB_CLIENT_OK;
+}
+
 IOTHUB_CLIENT_RESULT ModbusRtu_SetWriteRequest(
     CapabilityType capabilityType,
     void* capability,
@@ -179,6 +187,8 @@ IOTHUB_CLIENT_RESULT ModbusRtu_SetWriteRequest(
     return IOTHUB_CLIENT_OK;
 }
 
+// Discards whatever is left on the line from an earlier exchange before sending the request, and returns once
+// the request has been transmitted so that the response timeout starts when the slave can answer.
 int ModbusRtu_SendRequest(
     HANDLE handler,
     uint8_t *requestArr,
@@ -187,13 +197,13 @@ int ModbusRtu_SendRequest(
 #ifdef WIN32
     if (NULL == handler || NULL == requestArr)
     {
-        LogError("Failed to read response: connection handler and/or the request array is null.");
+        LogError("Failed to send request: connection handler and/or the request array is null.");
         return -1;
     }
 #else
     if (!handler || NULL == requestArr)
     {
-        LogError("Failed to read response: connection handler and/or the request array is null.");
+        LogError("Failed to send request: connection handler and/or the request array is null.");
         return -1;
     }
 #endif
@@ -201,6 +211,8 @@ int ModbusRtu_SendRequest(
     uint32_t totalBytesSent = 0;
 
 #ifdef WIN32
+    PurgeComm(handler, PURGE_RXCLEAR);
+
     DWORD bytesSent = 0;
     if (!WriteFile((HANDLE)handler,
         requestArr,
@@ -212,117 +224,71 @@ int ModbusRtu_SendRequest(
         return -1;
     }
     totalBytesSent = bytesSent;
+    FlushFileBuffers(handler);
 #else
-    totalBytesSent = write(handler, requestArr, arrLen);
-    if (totalBytesSent != arrLen)
+    tcflush(handler, TCIFLUSH);
+
+    ssize_t bytesSent = write(handler, requestArr, arrLen);
+    if (bytesSent != (ssize_t)arrLen)
     {
         LogError("Failed to send request.");
         return -1;
     }
+    totalBytesSent = (uint32_t)bytesSent;
+    tcdrain(handler);
 #endif
 
     return  totalBytesSent;
 }
 
+// Reads the response frame, delimited by the t3.5 silence of the line, and checks its CRC and that it answers
+// the request
 int ModbusRtu_ReadResponse(
     HANDLE handler,
+    const ModbusRtuFrameTiming* timing,
+    const uint8_t *requestArr,
     uint8_t *response,
     uint32_t arrLen)
 {
 #ifdef WIN32
-    if (NULL == handler || NULL == response)
+    if (NULL == handler || NULL == requestArr || NULL == response)
     {
-        LogError("Failed to read response: connection handler and/or the response is null.");
+        LogError("Failed to read response: connection handler, the request and/or the response is null.");
         return -1;
     }
 #else
-    if (!handler || NULL == response)
+    if (!handler || NULL == requestArr || NULL == response)
     {
-        LogError("Failed to read response: connection handler and/or the response is null.");
+        LogError("Failed to read response: connection handler, the request and/or the response is null.");
         return -1;
     }
 #endif
 
-    bool result = false;
-    uint32_t bytesReceived = 0;
-    uint32_t totalBytesReceived = 0;
-    int retry = 0;
-    const int retryLimit = 3;
-
-    while (totalBytesReceived < RTU_HEADER_SIZE && retry < retryLimit)
+    int responseLength = ModbusRtu_ReadFrame(handler, timing, response, arrLen, MODBUS_RTU_RESPONSE_TIMEOUT_MS);
+    if (responseLength < 0)
     {
-#ifdef WIN32
-        DWORD received = 0;
-        result = (FALSE != ReadFile(handler,
-            (response + totalBytesReceived),
-            (arrLen - totalBytesReceived - 1),
-            &received,
-            NULL));
-        bytesReceived = received;
-#else
-        bytesReceived = read(handler, response, (arrLen - totalBytesReceived - 1));
-        result = (bytesReceived > 0);
-#endif
-
-        if (bytesReceived > 0)
-        {
-            totalBytesReceived += bytesReceived;
-        }
-        else
-        {
-            retry++;
-            ThreadAPI_Sleep(2 * 1000);
-        }
+        return -1;
     }
 
-    if (response[1] != WriteCoil && response[1] != WriteHoldingRegister)
+    if (responseLength < RTU_MIN_RESPONSE_SIZE)
     {
-        // Get data length from the PDU
-        uint16_t length = (uint16_t)(response[1] >= MODBUS_EXCEPTION_CODE ? 2 : response[2] + 2);
-        uint32_t expectedResponseLength = length + RTU_HEADER_SIZE + 2; //HEADER_SIZE + CRC_SIZE;
-
-        if (expectedResponseLength != arrLen)
-        {
-            //TODO
-            //Array.Resize<uint8_t>(ref response, expectedResponseLength);
-        }
-
-        while (totalBytesReceived < expectedResponseLength && retry < retryLimit)
-        {
-#ifdef WIN32
-            DWORD received = 0;
-            result = (FALSE != ReadFile(handler,
-                (response + totalBytesReceived),
-                (arrLen - totalBytesReceived - 1),
-                &received,
-                NULL));
-            bytesReceived = received;
-#else
-            bytesReceived = read(handler, response, (arrLen - totalBytesReceived - 1));
-            result = (bytesReceived > 0);
-#endif
+        LogError("Failed to read response: %d bytes are too few for a response frame.", responseLength);
+        return -1;
+    }
 
-            if (bytesReceived > 0)
-            {
-                totalBytesReceived += bytesReceived;
-            }
-            else
-            {
-                retry++;
-                ThreadAPI_Sleep(2 * 1000);
-            }
-        }
+    uint16_t crc = GetCRC(response, responseLength - 2);
+    if (response[responseLength - 2] != (crc & 0xff) || response[responseLength - 1] != ((crc >> 8) & 0xff))
+    {
+        LogError("Failed to read response: CRC mismatch.");
+        return -1;
     }
 
-    if (!result)
+    if (!ModbusRtu_IsResponseTo(requestArr, response, responseLength))
     {
-#ifdef WIN32
-        LogError("Failed to read response: %x.", GetLastError());
-#else
-        LogError("Failed to read response.");
-#endif
+        LogError("Failed to read response: response of unit %d to function %d does not answer request of unit %d to function %d.",
+            response[0], response[1], requestArr[0], requestArr[1]);
         return -1;
     }
 
-    return totalBytesReceived;
-}
\ No newline at end of file
+    return responseLength;
+}
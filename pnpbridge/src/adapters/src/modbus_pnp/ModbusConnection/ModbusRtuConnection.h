@@ -9,18 +9,23 @@ extern "C"
 
 #include "azure_c_shared_utility/xlogging.h"
 #include "../ModbusCapability.h"
+#include "../ModbusReadBlock.h"
 #include "ModbusConnectionHelper.h"
+#include "ModbusRtuFraming.h"
 
 #define RTU_REQUEST_SIZE 8
 #define RTU_HEADER_SIZE 1
+#define RTU_MIN_RESPONSE_SIZE 4 // Unit ID + Function Code + CRC
 
+uint16_t GetCRC(uint8_t *message, size_t length);
 int ModbusRtu_GetHeaderSize(void);
-bool ModbusRtu_CloseDevice(HANDLE hDevice, LOCK_HANDLE lock);
+bool ModbusRtu_CloseDevice(HANDLE hDevice);
 
 IOTHUB_CLIENT_RESULT ModbusRtu_SetReadRequest(CapabilityType capabilityType, void* capability, uint8_t unitId);
+IOTHUB_CLIENT_RESULT ModbusRtu_SetReadBlockRequest(const ModbusReadBlock* block, MODBUS_READ_REQUEST* readRequest, uint8_t unitId);
 IOTHUB_CLIENT_RESULT ModbusRtu_SetWriteRequest(CapabilityType capabilityType, void* capability, char* valueStr);
 int ModbusRtu_SendRequest(HANDLE handler, uint8_t *requestArr, uint32_t arrLen);
-int ModbusRtu_ReadResponse(HANDLE handler, uint8_t *response, uint32_t arrLen);
+int ModbusRtu_ReadResponse(HANDLE handler, const ModbusRtuFrameTiming* timing, const uint8_t *requestArr, uint8_t *response, uint32_t arrLen);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,258 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ModbusRtuFraming.h"
+
+#ifndef WIN32
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#define RTU_CHARACTER_BITS          11      // Start bit, 8 data bits, parity or second stop bit, stop bit
+#define RTU_FIXED_TIMING_BAUD_RATE  19200   // Above this baud rate the silent interval is fixed
+#define RTU_FIXED_FRAME_GAP_US      1750
+
+#define RTU_EXCEPTION_FLAG          0x80
+#define RTU_EXCEPTION_FRAME_LENGTH  5       // Unit ID + Function Code + Exception Code + CRC
+#define RTU_WRITE_FRAME_LENGTH      8       // Unit ID + Function Code + Address + Value or Quantity + CRC
+#define RTU_READ_FRAME_OVERHEAD     5       // Unit ID + Function Code + Byte Count + CRC
+#define RTU_BYTE_COUNT_OFFSET       2
+
+void ModbusRtu_GetFrameTiming(
+    uint32_t baudRate,
+    ModbusRtuFrameTiming* timing)
+{
+    if (0 == baudRate)
+    {
+        LogError("Invalid baud rate 0, assuming %d.", RTU_FIXED_TIMING_BAUD_RATE);
+        baudRate = RTU_FIXED_TIMING_BAUD_RATE;
+    }
+
+    timing->CharacterTimeUs = (uint32_t)((RTU_CHARACTER_BITS * 1000000ULL + baudRate - 1) / baudRate);
+    if (baudRate > RTU_FIXED_TIMING_BAUD_RATE)
+    {
+        timing->FrameGapUs = RTU_FIXED_FRAME_GAP_US;
+    }
+    else
+    {
+        // 3.5 characters
+        timing->FrameGapUs = (uint32_t)((7 * RTU_CHARACTER_BITS * 1000000ULL + 2ULL * baudRate - 1) / (2ULL * baudRate));
+    }
+}
+
+int ModbusRtu_GetExpectedResponseLength(
+    const uint8_t* frame,
+    size_t length)
+{
+    if (length < 2)
+    {
+        return 0;
+    }
+
+    uint8_t functionCode = frame[1];
+    if (functionCode & RTU_EXCEPTION_FLAG)
+    {
+        return RTU_EXCEPTION_FRAME_LENGTH;
+    }
+
+    switch (functionCode)
+    {
+        case 1:     // Read Coils
+        case 2:     // Read Discrete Inputs
+        case 3:     // Read Holding Registers
+        case 4:     // Read Input Registers
+            if (length <= RTU_BYTE_COUNT_OFFSET)
+            {
+                return 0;
+            }
+            return RTU_READ_FRAME_OVERHEAD + frame[RTU_BYTE_COUNT_OFFSET];
+        case 5:     // Write Single Coil
+        case 6:     // Write Single Register
+        case 15:    // Write Multiple Coils
+        case 16:    // Write Multiple Registers
+            return RTU_WRITE_FRAME_LENGTH;
+        default:
+            return -1;
+    }
+}
+
+bool ModbusRtu_IsResponseTo(
+    const uint8_t* request,
+    const uint8_t* response,
+    size_t responseLength)
+{
+    if (responseLength < 2)
+    {
+        return false;
+    }
+
+    return (response[0] == request[0]) && ((response[1] & ~RTU_EXCEPTION_FLAG) == request[1]);
+}
+
+// Waits up to timeoutMs for bytes to arrive on the port and reads those that did, at most size.
+// Returns the number of bytes read, 0 if none arrived in time, or -1 if reading failed.
+static int ModbusRtu_ReadAvailable(
+    HANDLE port,
+    uint8_t* buffer,
+    uint32_t size,
+    uint32_t timeoutMs)
+{
+#ifdef WIN32
+    // Returns as soon as any byte is buffered, or after timeoutMs if none arrives
+    COMMTIMEOUTS timeouts;
+    timeouts.ReadIntervalTimeout = MAXDWORD;
+    timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+    timeouts.ReadTotalTimeoutConstant = (0 == timeoutMs) ? 1 : timeoutMs;
+    timeouts.WriteTotalTimeoutMultiplier = 0;
+    timeouts.WriteTotalTimeoutConstant = 0;
+    if (!SetCommTimeouts(port, &timeouts))
+    {
+        LogError("Failed to set the serial port read timeout: %x.", GetLastError());
+        return -1;
+    }
+
+    DWORD received = 0;
+    if (!ReadFile(port, buffer, size, &received, NULL))
+    {
+        LogError("Failed to read response: %x.", GetLastError());
+        return -1;
+    }
+    return (int)received;
+#else
+    struct pollfd descriptor;
+    descriptor.fd = port;
+    descriptor.events = POLLIN;
+    descriptor.revents = 0;
+
+    int ready = poll(&descriptor, 1, (int)timeoutMs);
+    if (ready < 0)
+    {
+        if (EINTR == errno)
+        {
+            return 0;
+        }
+        LogError("Failed to wait for response: %d.", errno);
+        return -1;
+    }
+    else if (0 == ready)
+    {
+        return 0;
+    }
+
+    ssize_t received = read(port, buffer, size);
+    if (received < 0)
+    {
+        if (EINTR == errno || EAGAIN == errno)
+        {
+            return 0;
+        }
+        LogError("Failed to read response: %d.", errno);
+        return -1;
+    }
+    else if (0 == received && (descriptor.revents & (POLLERR | POLLHUP | POLLNVAL)))
+    {
+        LogError("Failed to read response: the serial port was closed.");
+        return -1;
+    }
+    return (int)received;
+#endif
+}
+
+int ModbusRtu_ReadFrame(
+    HANDLE port,
+    const ModbusRtuFrameTiming* timing,
+    uint8_t* frame,
+    uint32_t capacity,
+    uint32_t responseTimeoutMs)
+{
+    if (NULL == timing || NULL == frame || 0 == capacity)
+    {
+        LogError("Failed to read response: timing and/or the frame buffer is null.");
+        return -1;
+    }
+
+    TICK_COUNTER_HANDLE clock = tickcounter_create();
+    if (NULL == clock)
+    {
+        LogError("Failed to read response: could not create tick counter.");
+        return -1;
+    }
+
+    int result = -1;
+    tickcounter_ms_t start = 0;
+    tickcounter_ms_t now = 0;
+    uint32_t length = 0;
+    uint32_t frameGapMs = (timing->FrameGapUs + 999) / 1000;
+
+    if (0 != tickcounter_get_current_ms(clock, &start))
+    {
+        LogError("Failed to read response: could not read tick counter.");
+        goto exit;
+    }
+
+    for (;;)
+    {
+        int expectedLength = ModbusRtu_GetExpectedResponseLength(frame, length);
+        bool frameIncomplete = (0 == length) || (0 == expectedLength) || ((int)length < expectedLength);
+        uint32_t timeoutMs = frameGapMs;
+
+        if (frameIncomplete)
+        {
+            // Give the slave the response timeout to start answering, extended by the time the bytes of the
+            // frame take on the wire once it has
+            uint32_t deadlineMs = responseTimeoutMs;
+            if (expectedLength > 0)
+            {
+                deadlineMs += (uint32_t)(((uint64_t)expectedLength * timing->CharacterTimeUs + 999) / 1000);
+            }
+
+            if (0 != tickcounter_get_current_ms(clock, &now))
+            {
+                LogError("Failed to read response: could not read tick counter.");
+                goto exit;
+            }
+
+            if (now - start >= deadlineMs)
+            {
+                if (0 == length)
+                {
+                    LogError("Failed to read response: no response within %u ms.", responseTimeoutMs);
+                }
+                else
+                {
+                    LogError("Failed to read response: frame cut short after %u of %d bytes.", length, expectedLength);
+                }
+                goto exit;
+            }
+            timeoutMs = (uint32_t)(deadlineMs - (now - start));
+        }
+
+        if (length == capacity)
+        {
+            LogError("Failed to read response: frame longer than %u bytes.", capacity);
+            goto exit;
+        }
+
+        int received = ModbusRtu_ReadAvailable(port, frame + length, capacity - length, timeoutMs);
+        if (received < 0)
+        {
+            goto exit;
+        }
+        else if (0 == received && !frameIncomplete)
+        {
+            // The line has been silent for t3.5 after the frame
+            result = (int)length;
+            goto exit;
+        }
+
+        length += (uint32_t)received;
+    }
+
+exit:
+    tickcounter_destroy(clock);
+    return result;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifdef WIN32
+#include <Windows.h>
+#else
+typedef int HANDLE;
+#endif
+
+// Time a slave is given to start answering a request
+#define MODBUS_RTU_RESPONSE_TIMEOUT_MS 1000
+
+    // Character timing of a Modbus RTU line. A character is 11 bits: start bit, 8 data bits, parity or a
+    // second stop bit, and stop bit. Above 19200 baud the Modbus specification fixes the silent interval.
+    typedef struct ModbusRtuFrameTiming {
+        uint32_t CharacterTimeUs;
+        uint32_t FrameGapUs;        // t3.5, the silent interval that ends a frame
+    } ModbusRtuFrameTiming;
+
+    void ModbusRtu_GetFrameTiming(
+        uint32_t baudRate,
+        ModbusRtuFrameTiming* timing);
+
+    // Returns the length, CRC included, of the response frame starting with the length bytes received so far,
+    // 0 if more bytes are needed to tell, or -1 if the function code does not tell it.
+    int ModbusRtu_GetExpectedResponseLength(
+        const uint8_t* frame,
+        size_t length);
+
+    // Returns true if the response frame comes from the unit the request was sent to and answers its function
+    // code, either with a result or with an exception. A late answer to an earlier request, or one from another
+    // unit on the line, is not a response to the request.
+    bool ModbusRtu_IsResponseTo(
+        const uint8_t* request,
+        const uint8_t* response,
+        size_t responseLength);
+
+    // Waits up to responseTimeoutMs for a response frame to start, and accumulates it in frame until the line
+    // has been silent for t3.5 after all of the frame the function code announces was received. Frames with a
+    // function code that does not tell their length end at the first t3.5 silence. Bytes arriving after the
+    // announced length within t3.5 are kept, so that the caller sees the frame is not what it expects.
+    // Returns the length of the frame, or -1 if none started in time, it was cut short, or reading failed.
+    int ModbusRtu_ReadFrame(
+        HANDLE port,
+        const ModbusRtuFrameTiming* timing,
+        uint8_t* frame,
+        uint32_t capacity,
+        uint32_t responseTimeoutMs);
+
+#ifdef __cplusplus
+}
+#endif
@@ -3,51 +3,11 @@
 
 #include "ModbusTCPConnection.h"
 
-// Timeout interval for waiting for socket readiness
-#define SOCKET_TIMEOUT_SEC	5
-#define SOCKET_TIMEOUT_USEC	0
-
-#ifdef WIN32
-struct timeval socket_timeout;
-#else
-#define INFINITE 0xFFFFFFFF
-#endif // WIN32
-
-
 int ModbusTcp_GetHeaderSize(void)
 {
     return TCP_HEADER_SIZE;
 }
 
-bool ModbusTcp_CloseDevice(
-    SOCKET socket,
-    LOCK_HANDLE hLock)
-{   
-    if (LOCK_OK != Lock(hLock))
-    {
-        LogError("Device communicate lock could not be acquired.");
-        return false;
-    }
-    shutdown(socket, 1);
-
-    int byteRcvd = 1;
-    uint8_t buffer[MODBUS_RESPONSE_MAX_LENGTH];
-    while (0 < byteRcvd)
-    {
-        byteRcvd = recv(socket, (char*)buffer, MODBUS_RESPONSE_MAX_LENGTH, 0);
-    }
-#ifdef WIN32
-    closesocket(socket);
-    WSACleanup();
-#else
-    close(socket);
-#endif
-    Unlock(hLock);
-
-    LogInfo("Socket Closed.");
-    return true;
-}
-
 IOTHUB_CLIENT_RESULT ModbusTcp_SetReadRequest(
     CapabilityType capabilityType,
     void* capability,
@@ -108,6 +68,26 @@ IOTHUB_CLIENT_RESULT ModbusTcp_SetReadRequest(
     return IOTHUB_CLIENT_OK;
 }
 
+IOTHUB_CLIENT_RESULT ModbusTcp_SetReadBlockRequest(
+    const ModbusReadBlock* block,
+    MODBUS_READ_REQUEST* readRequest,
+    uint8_t unitId)
+{
+    readRequest->TcpRequest.MBAP.ProtocolID_Hi = 0x00;
+    readRequest->TcpRequest.MBAP.ProtocolID_Lo = 0x00;
+    readRequest->TcpRequest.MBAP.Length_Hi = 0x00;
+    readRequest->TcpRequest.MBAP.Length_Lo = 0x06;
+    readRequest->TcpRequest.MBAP.UnitID = unitId;
+
+    readRequest->TcpRequest.Payload.FunctionCode = block->FunctionCode;
+    readRequest->TcpRequest.Payload.StartAddr_Hi = (block->StartAddress >> 8) & 0xff;
+    readRequest->TcpRequest.Payload.StartAddr_Lo = block->StartAddress & 0xff;
+    readRequest->TcpRequest.Payload.ReadLen_Hi = (block->Length >> 8) & 0xff;
+    readRequest->TcpRequest.Payload.ReadLen_Lo = block->Length & 0xff;
+
+    return IOTHUB_CLIENT_OK;
+}
+
 IOTHUB_CLIENT_RESULT ModbusTcp_SetWriteRequest(
     CapabilityType capabilityType,
     void* capability,
@@ -180,99 +160,3 @@ IOTHUB_CLIENT_RESULT ModbusTcp_SetWriteRequest(
 
     return IOTHUB_CLIENT_OK;
 }
-
-int ModbusTcp_SendRequest(
-    SOCKET socket,
-    uint8_t *requestArr,
-    uint32_t arrLen)
-{
-    if (INVALID_SOCKET == socket || 0 == socket || NULL == requestArr)
-    {
-        LogError("Failed to send request: connection handler and/or the request array is null.");
-        return -1;
-    }
-#ifdef WIN32
-    fd_set fds;
-
-    FD_ZERO(&fds);
-    socket_timeout.tv_sec = SOCKET_TIMEOUT_SEC;
-    socket_timeout.tv_usec = SOCKET_TIMEOUT_USEC;
-
-    // Check handler readiness
-    FD_SET(socket, &fds);
-    int socketReady = select(32, NULL, &fds, NULL, &socket_timeout);
-    if (0 == socketReady)
-    {
-        LogError("Socket not ready.");
-        return -1;
-    }
-    else if (SOCKET_ERROR == socketReady)
-    {
-        LogError("Failed to get socket readiness with error: %ld.", WSAGetLastError());
-        return -1;
-    }
-#endif
-    int totalBytesSent = send(socket, (const char*)requestArr, arrLen, 0);
-
-    if (SOCKET_ERROR == totalBytesSent) {
-        // Error setting serial port state
-#ifdef WIN32
-        LogError("Failed to send request through socket with error: %ld.", WSAGetLastError());
-#else
-        LogError("Failed to send request through socket.");
-#endif
-        return -1;
-    }
-
-    return totalBytesSent;
-}
-
-int ModbusTcp_ReadResponse(
-    SOCKET socket,
-    uint8_t *response,
-    uint32_t arrLen)
-{
-    if (INVALID_SOCKET == socket || 0 == socket || NULL == response)
-    {
-        LogError("Failed to read response: connection handler and/or the request array is null.");
-        return -1;
-    }
-
-    int bytesReceived = 0;
-    int totalBytesReceived = 0;
-#ifdef WIN32
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(socket, &fds);
-
-    // Check handler readiness
-    int socketReady = select(32, NULL, &fds, NULL, &socket_timeout);
-    if (0 == socketReady)
-    {
-        LogError("Socket not ready.");
-        return -1;
-    }
-    else if (SOCKET_ERROR == socketReady)
-    {
-        LogError("Failed to get socket readiness with error: %ld.", WSAGetLastError());
-        return -1;
-    }
-#endif
-    bytesReceived = recv(socket, (char*)(response + totalBytesReceived), arrLen - totalBytesReceived, 0);
-
-    if (bytesReceived > 0)
-    {
-        totalBytesReceived += bytesReceived;
-    }
-    else if (SOCKET_ERROR == bytesReceived)
-    {
-#ifdef WIN32
-        LogError("Failed to read from socket with error: %ld.", WSAGetLastError());
-#else
-        LogError("Failed to read from socket.");
-#endif
-        return -1;
-    }
-
-    return totalBytesReceived;
-}
\ No newline at end of file
@@ -9,6 +9,7 @@ extern "C"
 
 #include "azure_c_shared_utility/xlogging.h"
 #include "../ModbusCapability.h"
+#include "../ModbusReadBlock.h"
 #include "ModbusConnectionHelper.h"
 #ifndef WIN32
 #include <sys/termios.h>
@@ -26,12 +27,10 @@ typedef int SOCKET;
 #define TCP_HEADER_SIZE 7 // TransactionID (2 bytes) + ProtocolID (2 bytes) + Length (2 bytes) + UnitID (1 uint8_t)
 
 int ModbusTcp_GetHeaderSize(void);
-bool ModbusTcp_CloseDevice(SOCKET hDevice, LOCK_HANDLE lock);
 
 IOTHUB_CLIENT_RESULT ModbusTcp_SetReadRequest(CapabilityType capabilityType, void* capability, uint8_t unitId);
+IOTHUB_CLIENT_RESULT ModbusTcp_SetReadBlockRequest(const ModbusReadBlock* block, MODBUS_READ_REQUEST* readRequest, uint8_t unitId);
 IOTHUB_CLIENT_RESULT ModbusTcp_SetWriteRequest(CapabilityType capabilityType, void* capability, char* valueStr);
-int ModbusTcp_SendRequest(SOCKET handler, uint8_t *requestArr, uint32_t arrLen);
-int ModbusTcp_ReadResponse(SOCKET handler, uint8_t *response, uint32_t arrLen);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,729 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <winsock2.h>
+#define SHUTDOWN_BOTH SD_BOTH
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define SOCKET_ERROR (-1)
+#define INVALID_SOCKET (~0)
+#define SHUTDOWN_BOTH SHUT_RDWR
+#endif
+
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/singlylinkedlist.h"
+
+#include "ModbusTcpPool.h"
+
+#define MBAP_HEADER_LENGTH          7
+#define MBAP_LENGTH_FIELD_END       6   // Transaction ID (2 bytes) + Protocol ID (2 bytes) + Length (2 bytes)
+#define MBAP_MIN_LENGTH_FIELD       2   // Unit ID + Function Code
+#define MBAP_MAX_LENGTH_FIELD       (MODBUS_TCP_FRAME_MAX_LENGTH - MBAP_LENGTH_FIELD_END)
+
+    // A request sent on the connection and waiting for the response carrying its transaction ID
+    typedef struct MODBUS_TCP_PENDING_REQUEST {
+        bool InUse;
+        bool Completed;
+        uint16_t TransactionId;
+        uint8_t* Response;          // caller's buffer the response is copied to
+        uint32_t ResponseCapacity;
+        int ResponseLength;         // -1 if the connection dropped or the response did not fit
+        COND_HANDLE ResponseCondition;
+    } MODBUS_TCP_PENDING_REQUEST;
+
+    typedef struct MODBUS_TCP_CONNECTION_TAG {
+        MODBUS_TCP_POOL_HANDLE Pool;
+        char* Host;
+        uint16_t Port;
+        size_t RefCount;                    // guarded by the pool's lock
+
+        // Socket is only replaced while holding both locks, SendLock before StateLock, so either is enough to use it
+        SOCKET Socket;                      // INVALID_SOCKET while disconnected
+        LOCK_HANDLE SendLock;               // serializes writes to the socket
+        LOCK_HANDLE StateLock;              // guards everything below
+        bool Connected;
+        bool Stopping;
+        MODBUS_TCP_PENDING_REQUEST PendingRequests[MODBUS_TCP_MAX_OUTSTANDING_REQUESTS];
+        size_t PendingRequestCount;
+        COND_HANDLE SlotCondition;          // posted when a pending request slot is released
+        uint16_t NextTransactionId;
+        uint32_t ConsecutiveTimeouts;
+        uint32_t ReconnectFailures;
+        tickcounter_ms_t NextReconnectTime;
+        COND_HANDLE ReconnectCondition;     // posted when the connection is stopped, to end a reconnect delay early
+        TICK_COUNTER_HANDLE Clock;
+
+        THREAD_HANDLE Receiver;
+        uint8_t RxBuffer[MODBUS_TCP_FRAME_MAX_LENGTH];  // only touched by the receiving thread
+        size_t RxLength;
+    } MODBUS_TCP_CONNECTION;
+
+    typedef struct MODBUS_TCP_POOL_TAG {
+        LOCK_HANDLE Lock;
+        SINGLYLINKEDLIST_HANDLE Connections;
+    } MODBUS_TCP_POOL;
+
+int ModbusTcp_GetFrameLength(
+    const uint8_t* buffer,
+    size_t length)
+{
+    if (length < MBAP_LENGTH_FIELD_END)
+    {
+        return 0;
+    }
+
+    uint16_t protocolId = (uint16_t)((buffer[2] << 8) | buffer[3]);
+    uint16_t lengthField = (uint16_t)((buffer[4] << 8) | buffer[5]);
+    if (0 != protocolId || lengthField < MBAP_MIN_LENGTH_FIELD || lengthField > MBAP_MAX_LENGTH_FIELD)
+    {
+        return -1;
+    }
+
+    size_t frameLength = MBAP_LENGTH_FIELD_END + lengthField;
+    return (length < frameLength) ? 0 : (int)frameLength;
+}
+
+uint32_t ModbusTcp_GetReconnectDelay(
+    uint32_t failureCount)
+{
+    uint32_t delay = MODBUS_TCP_RECONNECT_MIN_DELAY_MS;
+    for (uint32_t i = 0; i < failureCount && delay < MODBUS_TCP_RECONNECT_MAX_DELAY_MS; i++)
+    {
+        delay *= 2;
+    }
+    return (delay < MODBUS_TCP_RECONNECT_MAX_DELAY_MS) ? delay : MODBUS_TCP_RECONNECT_MAX_DELAY_MS;
+}
+
+static void ModbusTcpPool_CloseSocket(
+    SOCKET socketHandle)
+{
+#ifdef WIN32
+    if (SOCKET_ERROR == closesocket(socketHandle))
+    {
+        LogError("Failed to close socket with error: %ld.", WSAGetLastError());
+    }
+    WSACleanup();
+#else
+    if (0 != close(socketHandle))
+    {
+        LogError("Failed to close socket.");
+    }
+#endif
+}
+
+static bool ModbusTcpPool_Connect(
+    const char* host,
+    uint16_t port,
+    SOCKET* socketHandle)
+{
+#ifdef WIN32
+    WSADATA wsaData = { 0 };
+    // Initialize Winsock
+    int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (result != 0) {
+        LogError("WSAStartup failed: %d\n", result);
+        return false;
+    }
+#endif
+
+    // Create socket
+    *socketHandle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (*socketHandle == INVALID_SOCKET) {
+#ifdef WIN32
+        LogError("Failed to create socket with error = %d.", WSAGetLastError());
+        WSACleanup();
+#else
+        LogError("Failed to create socket.");
+#endif
+        return false;
+    }
+
+    // Connect to device
+    struct sockaddr_in deviceAddress;
+    memset(&deviceAddress, 0, sizeof(deviceAddress));
+    deviceAddress.sin_family = AF_INET;
+    deviceAddress.sin_addr.s_addr = inet_addr(host);
+    deviceAddress.sin_port = htons(port);
+
+    if (SOCKET_ERROR == connect(*socketHandle, (struct sockaddr *)& deviceAddress, sizeof(deviceAddress))) {
+#ifdef WIN32
+        LogError("Failed to connect with socket \"%s:%d\" with error: %ld.", host, port, WSAGetLastError());
+#else
+        LogError("Failed to connect with socket \"%s:%d\".", host, port);
+#endif
+        ModbusTcpPool_CloseSocket(*socketHandle);
+        *socketHandle = INVALID_SOCKET;
+        return false;
+    }
+
+    LogInfo("Connected to device at \"%s:%d\".", host, port);
+    return true;
+}
+
+// Closes the socket and fails every pending request. Called with SendLock and StateLock held.
+static void ModbusTcpPool_Disconnect(
+    MODBUS_TCP_CONNECTION* connection)
+{
+    if (INVALID_SOCKET != connection->Socket)
+    {
+        ModbusTcpPool_CloseSocket(connection->Socket);
+        connection->Socket = INVALID_SOCKET;
+    }
+    connection->Connected = false;
+    connection->ConsecutiveTimeouts = 0;
+    connection->RxLength = 0;
+
+    for (size_t i = 0; i < MODBUS_TCP_MAX_OUTSTANDING_REQUESTS; i++)
+    {
+        MODBUS_TCP_PENDING_REQUEST* pending = &connection->PendingRequests[i];
+        if (pending->InUse && !pending->Completed)
+        {
+            pending->ResponseLength = -1;
+            pending->Completed = true;
+            Condition_Post(pending->ResponseCondition);
+        }
+    }
+
+    tickcounter_ms_t now = 0;
+    (void)tickcounter_get_current_ms(connection->Clock, &now);
+    connection->NextReconnectTime = now + ModbusTcp_GetReconnectDelay(connection->ReconnectFailures);
+}
+
+// Hands a received frame to the request waiting for its transaction ID. Called with StateLock held.
+static void ModbusTcpPool_CompleteRequest(
+    MODBUS_TCP_CONNECTION* connection,
+    const uint8_t* frame,
+    int frameLength)
+{
+    uint16_t transactionId = (uint16_t)((frame[0] << 8) | frame[1]);
+    connection->ConsecutiveTimeouts = 0;
+
+    for (size_t i = 0; i < MODBUS_TCP_MAX_OUTSTANDING_REQUESTS; i++)
+    {
+        MODBUS_TCP_PENDING_REQUEST* pending = &connection->PendingRequests[i];
+        if (pending->InUse && !pending->Completed && pending->TransactionId == transactionId)
+        {
+            if ((uint32_t)frameLength <= pending->ResponseCapacity)
+            {
+                memcpy(pending->Response, frame, frameLength);
+                pending->ResponseLength = frameLength;
+            }
+            else
+            {
+                LogError("Response of %d bytes for transaction %d does not fit the response buffer.", frameLength, transactionId);
+                pending->ResponseLength = -1;
+            }
+            pending->Completed = true;
+            Condition_Post(pending->ResponseCondition);
+            return;
+        }
+    }
+
+    // The request gave up waiting for it
+    LogInfo("Dropped response to transaction %d from \"%s:%d\": no request is waiting for it.", transactionId, connection->Host, connection->Port);
+}
+
+static int ModbusTcpPool_ReceiverThread(
+    void* context)
+{
+    MODBUS_TCP_CONNECTION* connection = (MODBUS_TCP_CONNECTION*)context;
+
+    for (;;)
+    {
+        Lock(connection->StateLock);
+        if (connection->Stopping)
+        {
+            Unlock(connection->StateLock);
+            break;
+        }
+
+        if (!connection->Connected)
+        {
+            tickcounter_ms_t now = 0;
+            (void)tickcounter_get_current_ms(connection->Clock, &now);
+            if (now < connection->NextReconnectTime)
+            {
+                Condition_Wait(connection->ReconnectCondition, connection->StateLock, (int)(connection->NextReconnectTime - now));
+                Unlock(connection->StateLock);
+                continue;
+            }
+            Unlock(connection->StateLock);
+
+            SOCKET socketHandle = INVALID_SOCKET;
+            bool connected = ModbusTcpPool_Connect(connection->Host, connection->Port, &socketHandle);
+
+            Lock(connection->SendLock);
+            Lock(connection->StateLock);
+            if (connected && !connection->Stopping)
+            {
+                connection->Socket = socketHandle;
+                connection->Connected = true;
+                connection->ReconnectFailures = 0;
+            }
+            else
+            {
+                if (connected)
+                {
+                    ModbusTcpPool_CloseSocket(socketHandle);
+                }
+                connection->ReconnectFailures++;
+                (void)tickcounter_get_current_ms(connection->Clock, &now);
+                connection->NextReconnectTime = now + ModbusTcp_GetReconnectDelay(connection->ReconnectFailures);
+            }
+            Unlock(connection->StateLock);
+            Unlock(connection->SendLock);
+            continue;
+        }
+
+        SOCKET socketHandle = connection->Socket;
+        Unlock(connection->StateLock);
+
+        // The socket stays open until this thread closes it, shutting it down is what ends this receive
+        int bytesReceived = recv(socketHandle, (char*)(connection->RxBuffer + connection->RxLength),
+            (int)(sizeof(connection->RxBuffer) - connection->RxLength), 0);
+
+        if (bytesReceived <= 0)
+        {
+            Lock(connection->SendLock);
+            Lock(connection->StateLock);
+            if (!connection->Stopping)
+            {
+                LogError("Connection to \"%s:%d\" was lost, reconnecting.", connection->Host, connection->Port);
+            }
+            ModbusTcpPool_Disconnect(connection);
+            Unlock(connection->StateLock);
+            Unlock(connection->SendLock);
+            continue;
+        }
+
+        Lock(connection->StateLock);
+        connection->RxLength += bytesReceived;
+
+        // Hand out every complete frame and keep the start of the next one
+        size_t offset = 0;
+        int frameLength = 0;
+        while (0 < (frameLength = ModbusTcp_GetFrameLength(connection->RxBuffer + offset, connection->RxLength - offset)))
+        {
+            ModbusTcpPool_CompleteRequest(connection, connection->RxBuffer + offset, frameLength);
+            offset += frameLength;
+        }
+
+        if (frameLength < 0)
+        {
+            // Framing is lost, the next receive ends once the socket is shut down and the connection is remade
+            LogError("Received an invalid Modbus TCP frame from \"%s:%d\", reconnecting.", connection->Host, connection->Port);
+            shutdown(connection->Socket, SHUTDOWN_BOTH);
+            connection->RxLength = 0;
+        }
+        else if (offset > 0)
+        {
+            memmove(connection->RxBuffer, connection->RxBuffer + offset, connection->RxLength - offset);
+            connection->RxLength -= offset;
+        }
+        Unlock(connection->StateLock);
+    }
+
+    return 0;
+}
+
+static void ModbusTcpPool_DestroyConnection(
+    MODBUS_TCP_CONNECTION* connection)
+{
+    if (NULL != connection->Receiver)
+    {
+        Lock(connection->SendLock);
+        Lock(connection->StateLock);
+        connection->Stopping = true;
+        if (INVALID_SOCKET != connection->Socket)
+        {
+            shutdown(connection->Socket, SHUTDOWN_BOTH);
+        }
+        Condition_Post(connection->ReconnectCondition);
+        Unlock(connection->StateLock);
+        Unlock(connection->SendLock);
+
+        int res = 0;
+        if (THREADAPI_OK != ThreadAPI_Join(connection->Receiver, &res))
+        {
+            LogError("Failed to stop the receiving thread of \"%s:%d\".", connection->Host, connection->Port);
+        }
+    }
+
+    if (INVALID_SOCKET != connection->Socket)
+    {
+        ModbusTcpPool_CloseSocket(connection->Socket);
+    }
+
+    for (size_t i = 0; i < MODBUS_TCP_MAX_OUTSTANDING_REQUESTS; i++)
+    {
+        if (NULL != connection->PendingRequests[i].ResponseCondition)
+        {
+            Condition_Deinit(connection->PendingRequests[i].ResponseCondition);
+        }
+    }
+    if (NULL != connection->SlotCondition)
+    {
+        Condition_Deinit(connection->SlotCondition);
+    }
+    if (NULL != connection->ReconnectCondition)
+    {
+        Condition_Deinit(connection->ReconnectCondition);
+    }
+    if (NULL != connection->StateLock)
+    {
+        Lock_Deinit(connection->StateLock);
+    }
+    if (NULL != connection->SendLock)
+    {
+        Lock_Deinit(connection->SendLock);
+    }
+    if (NULL != connection->Clock)
+    {
+        tickcounter_destroy(connection->Clock);
+    }
+    free(connection->Host);
+    free(connection);
+}
+
+static MODBUS_TCP_CONNECTION* ModbusTcpPool_CreateConnection(
+    MODBUS_TCP_POOL_HANDLE pool,
+    const char* host,
+    uint16_t port)
+{
+    MODBUS_TCP_CONNECTION* connection = calloc(1, sizeof(MODBUS_TCP_CONNECTION));
+    if (NULL == connection)
+    {
+        LogError("Could not allocate memory for the connection to \"%s:%d\".", host, port);
+        return NULL;
+    }
+
+    connection->Pool = pool;
+    connection->Port = port;
+    connection->RefCount = 1;
+    connection->Socket = INVALID_SOCKET;
+
+    bool initialized = (0 == mallocAndStrcpy_s(&connection->Host, host));
+    connection->SendLock = Lock_Init();
+    connection->StateLock = Lock_Init();
+    connection->SlotCondition = Condition_Init();
+    connection->ReconnectCondition = Condition_Init();
+    connection->Clock = tickcounter_create();
+    initialized = initialized && NULL != connection->SendLock && NULL != connection->StateLock &&
+        NULL != connection->SlotCondition && NULL != connection->ReconnectCondition && NULL != connection->Clock;
+    for (size_t i = 0; i < MODBUS_TCP_MAX_OUTSTANDING_REQUESTS; i++)
+    {
+        connection->PendingRequests[i].ResponseCondition = Condition_Init();
+        initialized = initialized && NULL != connection->PendingRequests[i].ResponseCondition;
+    }
+
+    if (!initialized)
+    {
+        LogError("Could not create the connection to \"%s:%d\".", host, port);
+        ModbusTcpPool_DestroyConnection(connection);
+        return NULL;
+    }
+
+    if (!ModbusTcpPool_Connect(host, port, &connection->Socket))
+    {
+        ModbusTcpPool_DestroyConnection(connection);
+        return NULL;
+    }
+    connection->Connected = true;
+
+    if (THREADAPI_OK != ThreadAPI_Create(&connection->Receiver, ModbusTcpPool_ReceiverThread, connection))
+    {
+        LogError("Failed to create the receiving thread of \"%s:%d\".", host, port);
+        connection->Receiver = NULL;
+        ModbusTcpPool_DestroyConnection(connection);
+        return NULL;
+    }
+
+    return connection;
+}
+
+MODBUS_TCP_POOL_HANDLE ModbusTcpPool_Create(void)
+{
+    MODBUS_TCP_POOL* pool = calloc(1, sizeof(MODBUS_TCP_POOL));
+    if (NULL == pool)
+    {
+        LogError("Could not allocate memory for the Modbus TCP connection pool.");
+        return NULL;
+    }
+
+    pool->Lock = Lock_Init();
+    pool->Connections = singlylinkedlist_create();
+    if (NULL == pool->Lock || NULL == pool->Connections)
+    {
+        LogError("Could not create the Modbus TCP connection pool.");
+        ModbusTcpPool_Destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void ModbusTcpPool_Destroy(
+    MODBUS_TCP_POOL_HANDLE pool)
+{
+    if (NULL == pool)
+    {
+        return;
+    }
+
+    if (NULL != pool->Connections)
+    {
+        if (NULL != singlylinkedlist_get_head_item(pool->Connections))
+        {
+            LogError("Modbus TCP connection pool destroyed while connections are still in use.");
+        }
+        singlylinkedlist_destroy(pool->Connections);
+    }
+    if (NULL != pool->Lock)
+    {
+        Lock_Deinit(pool->Lock);
+    }
+    free(pool);
+}
+
+MODBUS_TCP_CONNECTION_HANDLE ModbusTcpPool_Acquire(
+    MODBUS_TCP_POOL_HANDLE pool,
+    const char* host,
+    uint16_t port)
+{
+    if (NULL == pool || NULL == host)
+    {
+        LogError("ModbusTcpPool_Acquire: Invalid arguments.");
+        return NULL;
+    }
+
+    MODBUS_TCP_CONNECTION* connection = NULL;
+    if (LOCK_OK != Lock(pool->Lock))
+    {
+        LogError("Modbus TCP connection pool lock is abandoned.");
+        return NULL;
+    }
+
+    LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(pool->Connections);
+    while (NULL != item)
+    {
+        MODBUS_TCP_CONNECTION* existing = (MODBUS_TCP_CONNECTION*)singlylinkedlist_item_get_value(item);
+        if (existing->Port == port && 0 == strcmp(existing->Host, host))
+        {
+            existing->RefCount++;
+            connection = existing;
+            LogInfo("Sharing the connection to \"%s:%d\" with %d other components.", host, port, (int)(existing->RefCount - 1));
+            goto exit;
+        }
+        item = singlylinkedlist_get_next_item(item);
+    }
+
+    connection = ModbusTcpPool_CreateConnection(pool, host, port);
+    if (NULL != connection && NULL == singlylinkedlist_add(pool->Connections, connection))
+    {
+        LogError("Could not add the connection to \"%s:%d\" to the pool.", host, port);
+        ModbusTcpPool_DestroyConnection(connection);
+        connection = NULL;
+    }
+
+exit:
+    Unlock(pool->Lock);
+    return connection;
+}
+
+void ModbusTcpPool_Release(
+    MODBUS_TCP_CONNECTION_HANDLE connection)
+{
+    if (NULL == connection)
+    {
+        return;
+    }
+
+    MODBUS_TCP_POOL* pool = connection->Pool;
+    bool lastReference = false;
+
+    Lock(pool->Lock);
+    if (0 == --connection->RefCount)
+    {
+        LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(pool->Connections);
+        while (NULL != item && connection != singlylinkedlist_item_get_value(item))
+        {
+            item = singlylinkedlist_get_next_item(item);
+        }
+        if (NULL != item)
+        {
+            singlylinkedlist_remove(pool->Connections, item);
+        }
+        lastReference = true;
+    }
+    Unlock(pool->Lock);
+
+    if (lastReference)
+    {
+        ModbusTcpPool_DestroyConnection(connection);
+        LogInfo("Socket Closed.");
+    }
+}
+
+// Claims a pending request slot under a transaction ID no other pending request uses. Called with StateLock held.
+static MODBUS_TCP_PENDING_REQUEST* ModbusTcpPool_ClaimSlot(
+    MODBUS_TCP_CONNECTION* connection)
+{
+    MODBUS_TCP_PENDING_REQUEST* slot = NULL;
+    for (size_t i = 0; i < MODBUS_TCP_MAX_OUTSTANDING_REQUESTS; i++)
+    {
+        if (!connection->PendingRequests[i].InUse)
+        {
+            slot = &connection->PendingRequests[i];
+            break;
+        }
+    }
+
+    bool inUse = true;
+    uint16_t transactionId = 0;
+    while (inUse)
+    {
+        transactionId = connection->NextTransactionId++;
+        inUse = false;
+        for (size_t i = 0; i < MODBUS_TCP_MAX_OUTSTANDING_REQUESTS; i++)
+        {
+            if (connection->PendingRequests[i].InUse && connection->PendingRequests[i].TransactionId == transactionId)
+            {
+                inUse = true;
+                break;
+            }
+        }
+    }
+
+    slot->InUse = true;
+    slot->Completed = false;
+    slot->TransactionId = transactionId;
+    slot->ResponseLength = -1;
+    connection->PendingRequestCount++;
+    return slot;
+}
+
+// Called with StateLock held
+static void ModbusTcpPool_ReleaseSlot(
+    MODBUS_TCP_CONNECTION* connection,
+    MODBUS_TCP_PENDING_REQUEST* slot)
+{
+    slot->InUse = false;
+    slot->Response = NULL;
+    connection->PendingRequestCount--;
+    Condition_Post(connection->SlotCondition);
+}
+
+int ModbusTcpPool_Transact(
+    MODBUS_TCP_CONNECTION_HANDLE connection,
+    const uint8_t* request,
+    uint32_t requestLength,
+    uint8_t* response,
+    uint32_t responseLength)
+{
+    if (NULL == connection || NULL == request || NULL == response ||
+        requestLength < MBAP_HEADER_LENGTH || requestLength > MODBUS_TCP_FRAME_MAX_LENGTH)
+    {
+        LogError("ModbusTcpPool_Transact: Invalid arguments.");
+        return -1;
+    }
+
+    int result = -1;
+    uint8_t frame[MODBUS_TCP_FRAME_MAX_LENGTH];
+    memcpy(frame, request, requestLength);
+
+    if (LOCK_OK != Lock(connection->StateLock))
+    {
+        LogError("Device communicate lock is abandoned.");
+        return -1;
+    }
+
+    while (connection->Connected && MODBUS_TCP_MAX_OUTSTANDING_REQUESTS == connection->PendingRequestCount)
+    {
+        Condition_Wait(connection->SlotCondition, connection->StateLock, 0);
+    }
+
+    if (!connection->Connected)
+    {
+        LogError("Not connected to \"%s:%d\", reconnecting.", connection->Host, connection->Port);
+        Unlock(connection->StateLock);
+        return -1;
+    }
+
+    MODBUS_TCP_PENDING_REQUEST* slot = ModbusTcpPool_ClaimSlot(connection);
+    slot->Response = response;
+    slot->ResponseCapacity = responseLength;
+    frame[0] = (slot->TransactionId >> 8) & 0xff;
+    frame[1] = slot->TransactionId & 0xff;
+    Unlock(connection->StateLock);
+
+    // Send the whole frame, requests from other threads may be interleaved only between frames
+    bool sent = true;
+    Lock(connection->SendLock);
+    uint32_t totalBytesSent = 0;
+    while (INVALID_SOCKET != connection->Socket && totalBytesSent < requestLength)
+    {
+        int bytesSent = send(connection->Socket, (const char*)(frame + totalBytesSent), (int)(requestLength - totalBytesSent), 0);
+        if (SOCKET_ERROR == bytesSent || 0 == bytesSent)
+        {
+#ifdef WIN32
+            LogError("Failed to send request through socket with error: %ld.", WSAGetLastError());
+#else
+            LogError("Failed to send request through socket.");
+#endif
+            // Have the receiving thread drop the connection and reconnect
+            shutdown(connection->Socket, SHUTDOWN_BOTH);
+            break;
+        }
+        totalBytesSent += bytesSent;
+    }
+    sent = (totalBytesSent == requestLength);
+    Unlock(connection->SendLock);
+
+    Lock(connection->StateLock);
+    if (sent)
+    {
+        tickcounter_ms_t start = 0;
+        tickcounter_ms_t now = 0;
+        (void)tickcounter_get_current_ms(connection->Clock, &start);
+        now = start;
+        while (!slot->Completed && now - start < MODBUS_TCP_RESPONSE_TIMEOUT_MS)
+        {
+            Condition_Wait(slot->ResponseCondition, connection->StateLock, (int)(MODBUS_TCP_RESPONSE_TIMEOUT_MS - (now - start)));
+            (void)tickcounter_get_current_ms(connection->Clock, &now);
+        }
+
+        if (slot->Completed)
+        {
+            result = slot->ResponseLength;
+        }
+        else
+        {
+            LogError("Timed out waiting for the response to transaction %d from \"%s:%d\".", slot->TransactionId, connection->Host, connection->Port);
+            if (++connection->ConsecutiveTimeouts >= MODBUS_TCP_MAX_CONSECUTIVE_TIMEOUTS && connection->Connected)
+            {
+                // Nothing is coming back on this connection, have the receiving thread reconnect it
+                LogError("Connection to \"%s:%d\" is not answering, reconnecting.", connection->Host, connection->Port);
+                shutdown(connection->Socket, SHUTDOWN_BOTH);
+                connection->ConsecutiveTimeouts = 0;
+            }
+        }
+    }
+    ModbusTcpPool_ReleaseSlot(connection, slot);
+    Unlock(connection->StateLock);
+
+    return result;
+}
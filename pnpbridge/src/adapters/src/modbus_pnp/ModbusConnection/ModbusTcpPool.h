@@ -0,0 +1,74 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Requests in flight per connection. Further requests wait for one of them to be answered.
+#define MODBUS_TCP_MAX_OUTSTANDING_REQUESTS 16
+#define MODBUS_TCP_RESPONSE_TIMEOUT_MS      5000
+
+// A connection that answers none of this many requests in a row is dropped and reconnected
+#define MODBUS_TCP_MAX_CONSECUTIVE_TIMEOUTS 3
+
+// Delay before reconnecting a dropped connection, doubled after every failed attempt up to the maximum
+#define MODBUS_TCP_RECONNECT_MIN_DELAY_MS   500
+#define MODBUS_TCP_RECONNECT_MAX_DELAY_MS   60000
+
+// MBAP header (7 bytes) + the largest PDU (253 bytes)
+#define MODBUS_TCP_FRAME_MAX_LENGTH         260
+
+    // Modbus TCP connections shared by every component of the adapter talking to the same host and port, with
+    // several requests in flight per connection matched to their responses by MBAP transaction ID. A connection
+    // that drops is reconnected in the background, requests fail until it is back.
+    typedef struct MODBUS_TCP_POOL_TAG* MODBUS_TCP_POOL_HANDLE;
+    typedef struct MODBUS_TCP_CONNECTION_TAG* MODBUS_TCP_CONNECTION_HANDLE;
+
+    MODBUS_TCP_POOL_HANDLE ModbusTcpPool_Create(void);
+
+    // Every connection acquired from the pool must have been released
+    void ModbusTcpPool_Destroy(
+        MODBUS_TCP_POOL_HANDLE pool);
+
+    // Returns the connection to host:port, connecting it if no component holds it yet. Returns NULL if a new
+    // connection could not be established.
+    MODBUS_TCP_CONNECTION_HANDLE ModbusTcpPool_Acquire(
+        MODBUS_TCP_POOL_HANDLE pool,
+        const char* host,
+        uint16_t port);
+
+    // Closes the connection once the last component holding it releases it
+    void ModbusTcpPool_Release(
+        MODBUS_TCP_CONNECTION_HANDLE connection);
+
+    // Sends request, a complete MBAP frame whose transaction ID is filled in here, and waits for its response.
+    // Returns the length of the response copied to response, or -1 if the request could not be sent, timed out
+    // or its response does not fit in responseLength bytes.
+    int ModbusTcpPool_Transact(
+        MODBUS_TCP_CONNECTION_HANDLE connection,
+        const uint8_t* request,
+        uint32_t requestLength,
+        uint8_t* response,
+        uint32_t responseLength);
+
+    // Returns the length of the MBAP frame at the start of buffer once all of it has been received, 0 if more
+    // bytes are needed, or -1 if the header is not a valid Modbus TCP header.
+    int ModbusTcp_GetFrameLength(
+        const uint8_t* buffer,
+        size_t length);
+
+    // Returns the delay before the next attempt to reconnect after failureCount failed attempts
+    uint32_t ModbusTcp_GetReconnectDelay(
+        uint32_t failureCount);
+
+#ifdef __cplusplus
+}
+#endif
@@ -39,9 +39,41 @@ int ModbusPnp_GetListCount(
 
 #pragma region Parser
 
+// Data types naming a number of a fixed size and encoding
+static const struct {
+    const char* Name;
+    ModbusNumberType Type;
+} ModbusNumberTypeNames[] = {
+    { "uint16", ModbusUInt16 },
+    { "int16", ModbusInt16 },
+    { "uint32", ModbusUInt32 },
+    { "int32", ModbusInt32 },
+    { "uint64", ModbusUInt64 },
+    { "int64", ModbusInt64 },
+    { "float32", ModbusFloat32 },
+    { "float64", ModbusFloat64 }
+};
+
+bool ToModbusNumberType(
+    const char* dataType,
+    ModbusNumberType* numberType)
+{
+    for (size_t i = 0; i < sizeof(ModbusNumberTypeNames) / sizeof(ModbusNumberTypeNames[0]); i++)
+    {
+        if (strcmpcasei(dataType, ModbusNumberTypeNames[i].Name) == 0)
+        {
+            *numberType = ModbusNumberTypeNames[i].Type;
+            return true;
+        }
+    }
+    return false;
+}
+
 ModbusDataType ToModbusDataTypeEnum(
     const char* dataType)
 {
+    ModbusNumberType numberType;
+
     if (strcmpcasei(dataType, "hexstring") == 0) {
         return HEXSTRING;
     }
@@ -52,7 +84,8 @@ ModbusDataType ToModbusDataTypeEnum(
         || strcmpcasei(dataType, "float") == 0
         || strcmpcasei(dataType, "double") == 0
         || strcmpcasei(dataType, "int") == 0
-        || strcmpcasei(dataType, "integer") == 0)
+        || strcmpcasei(dataType, "integer") == 0
+        || ToModbusNumberType(dataType, &numberType))
     {
         return NUMERIC;
     }
@@ -65,6 +98,125 @@ ModbusDataType ToModbusDataTypeEnum(
     return INVALID;
 }
 
+static bool ModbusPnp_ParseByteOrder(
+    JSON_Object* CapabilityArgs,
+    const char* Key,
+    ModbusByteOrder* ByteOrder)
+{
+    const char* byteOrder = json_object_dotget_string(CapabilityArgs, Key);
+    if (NULL == byteOrder || strcmpcasei(byteOrder, "big") == 0)
+    {
+        *ByteOrder = ModbusBigEndian;
+        return true;
+    }
+    else if (strcmpcasei(byteOrder, "little") == 0)
+    {
+        *ByteOrder = ModbusLittleEndian;
+        return true;
+    }
+    return false;
+}
+
+// Parses how the registers of a numeric telemetry or property make up its value: the number its "dataType" names,
+// or for the generic numeric data types the unsigned integer of its "length", in the optional "wordOrder" and
+// "byteOrder", both big endian by default.
+IOTHUB_CLIENT_RESULT ModbusPnp_ParseNumberFormat(
+    ModbusNumberFormat* NumberFormat,
+    JSON_Object* CapabilityArgs,
+    const char* Name,
+    const char* DataTypeStr,
+    uint16_t Length)
+{
+    memset(NumberFormat, 0, sizeof(ModbusNumberFormat));
+
+    if (ToModbusNumberType(DataTypeStr, &NumberFormat->Type))
+    {
+        if (ModbusNumber_GetRegisterCount(NumberFormat->Type) != Length)
+        {
+            LogError("\"length\" of \"%s\" must be %d for \"dataType\" \"%s\".", Name, ModbusNumber_GetRegisterCount(NumberFormat->Type), DataTypeStr);
+            return IOTHUB_CLIENT_INVALID_ARG;
+        }
+    }
+    else
+    {
+        switch (Length)
+        {
+            case 1:
+                NumberFormat->Type = ModbusUInt16;
+                break;
+            case 2:
+                NumberFormat->Type = ModbusUInt32;
+                break;
+            case 4:
+                NumberFormat->Type = ModbusUInt64;
+                break;
+            default:
+                LogError("\"length\" of \"%s\" must be 1, 2 or 4 for \"dataType\" \"%s\".", Name, DataTypeStr);
+                return IOTHUB_CLIENT_INVALID_ARG;
+        }
+    }
+
+    if (!ModbusPnp_ParseByteOrder(CapabilityArgs, "wordOrder", &NumberFormat->WordOrder))
+    {
+        LogError("\"wordOrder\" of \"%s\" is in valid.", Name);
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    if (!ModbusPnp_ParseByteOrder(CapabilityArgs, "byteOrder", &NumberFormat->ByteOrder))
+    {
+        LogError("\"byteOrder\" of \"%s\" is in valid.", Name);
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    return IOTHUB_CLIENT_OK;
+}
+
+// Parses the optional adaptive polling settings of a telemetry or property. Without them it is polled at its
+// default frequency.
+IOTHUB_CLIENT_RESULT ModbusPnp_ParseAdaptivePolling(
+    ModbusAdaptivePolling* AdaptivePolling,
+    JSON_Object* CapabilityArgs,
+    const char* Name,
+    ModbusDataType DataType)
+{
+    memset(AdaptivePolling, 0, sizeof(ModbusAdaptivePolling));
+
+    JSON_Object* adaptiveArgs = json_object_dotget_object(CapabilityArgs, PNP_CONFIG_ADAPTER_INTERFACE_ADAPTIVE_POLLING);
+    if (NULL == adaptiveArgs)
+    {
+        return IOTHUB_CLIENT_OK;
+    }
+
+    // The change threshold is compared against numbers
+    if (NUMERIC != DataType && FLAG != DataType)
+    {
+        LogError("\"%s\" of \"%s\" requires a numeric or boolean \"dataType\".", PNP_CONFIG_ADAPTER_INTERFACE_ADAPTIVE_POLLING, Name);
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    double minInterval = json_object_dotget_number(adaptiveArgs, "minInterval");
+    double maxInterval = json_object_dotget_number(adaptiveArgs, "maxInterval");
+    double changeThreshold = json_object_dotget_number(adaptiveArgs, "changeThreshold");
+    if (minInterval < 1 || minInterval > UINT32_MAX)
+    {
+        LogError("\"minInterval\" of \"%s\" is in valid.", Name);
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    if (maxInterval < minInterval || maxInterval > UINT32_MAX)
+    {
+        LogError("\"maxInterval\" of \"%s\" is in valid.", Name);
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    if (changeThreshold < 0)
+    {
+        LogError("\"changeThreshold\" of \"%s\" is in valid.", Name);
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    AdaptivePolling->MinInterval = (uint32_t)minInterval;
+    AdaptivePolling->MaxInterval = (uint32_t)maxInterval;
+    AdaptivePolling->ChangeThreshold = changeThreshold;
+    return IOTHUB_CLIENT_OK;
+}
+
 IOTHUB_CLIENT_RESULT ModbusPnp_ParseInterfaceConfig(
     PModbusInterfaceConfig * ModbusInterfaceConfig,
     JSON_Object* ConfigObj)
@@ -79,6 +231,13 @@ IOTHUB_CLIENT_RESULT ModbusPnp_ParseInterfaceConfig(
     (*ModbusInterfaceConfig)->Properties = singlylinkedlist_create();
     (*ModbusInterfaceConfig)->Commands = singlylinkedlist_create();
 
+    // Number of unused registers a block read may span to cover neighbouring capabilities, -1 disables coalescing
+    (*ModbusInterfaceConfig)->MaxReadGap = MODBUS_DEFAULT_MAX_READ_GAP;
+    if (JSONNumber == json_value_get_type(json_object_dotget_value(ConfigObj, PNP_CONFIG_ADAPTER_INTERFACE_MAX_READ_GAP)))
+    {
+        (*ModbusInterfaceConfig)->MaxReadGap = (int)json_object_dotget_number(ConfigObj, PNP_CONFIG_ADAPTER_INTERFACE_MAX_READ_GAP);
+    }
+
     JSON_Object* telemetryList = json_object_dotget_object(ConfigObj, "telemetry");
     for (size_t i = 0; i < json_object_get_count(telemetryList); i++)
     {
@@ -126,6 +285,15 @@ IOTHUB_CLIENT_RESULT ModbusPnp_ParseInterfaceConfig(
             return IOTHUB_CLIENT_INVALID_ARG;
         }
 
+        if (NUMERIC == telemetry->DataType)
+        {
+            IOTHUB_CLIENT_RESULT numberFormatResult = ModbusPnp_ParseNumberFormat(&telemetry->NumberFormat, telemetryArgs, name, dataTypeStr, telemetry->Length);
+            if (IOTHUB_CLIENT_OK != numberFormatResult)
+            {
+                return numberFormatResult;
+            }
+        }
+
         telemetry->DefaultFrequency = (int)json_object_dotget_number(telemetryArgs, "defaultFrequency");
         if (0 == telemetry->DefaultFrequency)
         {
@@ -140,6 +308,12 @@ IOTHUB_CLIENT_RESULT ModbusPnp_ParseInterfaceConfig(
             return IOTHUB_CLIENT_INVALID_ARG;
         }
 
+        IOTHUB_CLIENT_RESULT adaptivePollingResult = ModbusPnp_ParseAdaptivePolling(&telemetry->AdaptivePolling, telemetryArgs, name, telemetry->DataType);
+        if (IOTHUB_CLIENT_OK != adaptivePollingResult)
+        {
+            return adaptivePollingResult;
+        }
+
         singlylinkedlist_add((*ModbusInterfaceConfig)->Events, telemetry);
     }
 
@@ -191,6 +365,15 @@ IOTHUB_CLIENT_RESULT ModbusPnp_ParseInterfaceConfig(
             return IOTHUB_CLIENT_INVALID_ARG;
         }
 
+        if (NUMERIC == property->DataType)
+        {
+            IOTHUB_CLIENT_RESULT numberFormatResult = ModbusPnp_ParseNumberFormat(&property->NumberFormat, propertyArgs, name, dataTypeStr, property->Length);
+            if (IOTHUB_CLIENT_OK != numberFormatResult)
+            {
+                return numberFormatResult;
+            }
+        }
+
         property->DefaultFrequency = (int)json_object_dotget_number(propertyArgs, "defaultFrequency");
         if (0 == property->DefaultFrequency)
         {
@@ -212,6 +395,12 @@ IOTHUB_CLIENT_RESULT ModbusPnp_ParseInterfaceConfig(
             return IOTHUB_CLIENT_INVALID_ARG;
         }
 
+        IOTHUB_CLIENT_RESULT adaptivePollingResult = ModbusPnp_ParseAdaptivePolling(&property->AdaptivePolling, propertyArgs, name, property->DataType);
+        if (IOTHUB_CLIENT_OK != adaptivePollingResult)
+        {
+            return adaptivePollingResult;
+        }
+
         singlylinkedlist_add((*ModbusInterfaceConfig)->Properties, property);
     }
 
@@ -405,6 +594,29 @@ int ModbusPnP_ParseTcpSettings(
 SINGLYLINKEDLIST_HANDLE ModbusDeviceList = NULL;
 int ModbusDeviceCount = 0;
 
+#ifndef WIN32
+// Returns the termios speed for baudRate, or B0 if the baud rate is not a standard one
+static speed_t ModbusPnp_GetSerialSpeed(
+    uint32_t baudRate)
+{
+    switch (baudRate)
+    {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+#ifdef B230400
+        case 230400: return B230400;
+#endif
+        default: return B0;
+    }
+}
+#endif
+
 int ModbusPnp_OpenSerial(
     MODBUS_RTU_CONFIG* rtuConfig,
     HANDLE *serialHandle)
@@ -449,12 +661,13 @@ int ModbusPnp_OpenSerial(
 
     LogInfo("Opened com port %s", rtuConfig->Port);
 
+    // Reads return whatever has been received right away, responses are delimited by ModbusRtu_ReadFrame
     COMMTIMEOUTS timeouts;
-    timeouts.ReadIntervalTimeout = 3 * 1000;
-    timeouts.ReadTotalTimeoutMultiplier = 1;
-    timeouts.ReadTotalTimeoutConstant = 1;
-    timeouts.WriteTotalTimeoutMultiplier = 1;
-    timeouts.WriteTotalTimeoutConstant = 1;
+    timeouts.ReadIntervalTimeout = MAXDWORD;
+    timeouts.ReadTotalTimeoutMultiplier = 0;
+    timeouts.ReadTotalTimeoutConstant = 0;
+    timeouts.WriteTotalTimeoutMultiplier = 0;
+    timeouts.WriteTotalTimeoutConstant = 0;
     if (!SetCommTimeouts(*serialHandle, &timeouts))
     {
         int error = GetLastError();
@@ -462,9 +675,37 @@ int ModbusPnp_OpenSerial(
         return IOTHUB_CLIENT_INVALID_ARG;
     }
 #else
+    speed_t speed = ModbusPnp_GetSerialSpeed(rtuConfig->BaudRate);
+    if (B0 == speed)
+    {
+        LogError("Unsupported baud rate %u for com port %s", rtuConfig->BaudRate, rtuConfig->Port);
+        close(*serialHandle);
+        *serialHandle = INVALID_FILE;
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
     struct termios settings;
-    tcgetattr(*serialHandle, &settings);
-    cfsetospeed(&settings, rtuConfig->BaudRate);
+    if (0 != tcgetattr(*serialHandle, &settings))
+    {
+        LogError("Failed to open com port %s, %d", rtuConfig->Port, errno);
+        close(*serialHandle);
+        *serialHandle = INVALID_FILE;
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    // Raw binary mode. Reads return whatever has been received right away, responses are delimited by
+    // ModbusRtu_ReadFrame waiting on the port.
+    settings.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF);
+    settings.c_oflag &= ~OPOST;
+    settings.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    settings.c_cflag |= (CLOCAL | CREAD);
+    settings.c_cflag &= ~CSIZE;
+    settings.c_cflag |= (7 == rtuConfig->DataBits) ? CS7 : CS8;
+    settings.c_cc[VMIN] = 0;
+    settings.c_cc[VTIME] = 0;
+    cfsetispeed(&settings, speed);
+    cfsetospeed(&settings, speed);
+
     if (rtuConfig->Parity == NOPARITY)
     {
         settings.c_cflag &= ~PARENB;
@@ -492,74 +733,26 @@ int ModbusPnp_OpenSerial(
         settings.c_cflag |= CSTOPB;
     }
 
-    tcsetattr(*serialHandle, TCSANOW, &settings);
-    tcflush(*serialHandle, TCOFLUSH);
-#endif
-    return IOTHUB_CLIENT_OK;
-}
-
-int ModbusPnp_OpenSocket(
-    MODBUS_TCP_CONFIG* tcpConfig,
-    SOCKET *socketHandle)
-{
-    int result = 0;
-#ifdef WIN32
-    WSADATA wsaData = { 0 };
-    // Initialize Winsock
-    result = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (result != 0) {
-        LogError("WSAStartup failed: %d\n", result);
+    if (0 != tcsetattr(*serialHandle, TCSANOW, &settings))
+    {
+        LogError("Failed to configure com port %s, %d", rtuConfig->Port, errno);
+        close(*serialHandle);
+        *serialHandle = INVALID_FILE;
         return IOTHUB_CLIENT_INVALID_ARG;
     }
-#endif
-
-    // Create socket
-    *socketHandle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (*socketHandle == INVALID_SOCKET) {
-#ifdef WIN32
-        LogError("Failed to create socket with error = %d.", WSAGetLastError());
-#else
-        LogError("Failed to create socket.");
-#endif
-        goto ExitOnError;
-    }
-
-    // Connect to device
-    struct sockaddr_in deviceAddress;
-    deviceAddress.sin_family = AF_INET;
-    deviceAddress.sin_addr.s_addr = inet_addr(tcpConfig->Host);
-    deviceAddress.sin_port = htons(tcpConfig->Port);
-
-    result = connect(*socketHandle, (struct sockaddr *)& deviceAddress, sizeof(deviceAddress));
-    if (result == SOCKET_ERROR) {
-#ifdef WIN32
-        LogError("Failed to connect with socket \"%s:%d\" with error: %ld.", tcpConfig->Host, tcpConfig->Port, WSAGetLastError());
-#else
-        LogError("Failed to connect with socket \"%s:%d\".", tcpConfig->Host, tcpConfig->Port);
-#endif
-
-#ifdef WIN32
-        if (SOCKET_ERROR == closesocket(*socketHandle))
-        {
-            LogError("Failed to close socket with error: %ld.", WSAGetLastError());
-        }
-#else
-        if (!(close(*socketHandle)))
-        {
-            LogError("Failed to close socket");
-        }
+    tcflush(*serialHandle, TCIOFLUSH);
 
+    LogInfo("Opened com port %s", rtuConfig->Port);
 #endif
-        goto ExitOnError;
-    }
-    LogInfo("Connected to device at \"%s:%d\".", tcpConfig->Host, tcpConfig->Port);
     return IOTHUB_CLIENT_OK;
+}
 
-ExitOnError:
-#ifdef WIN32
-    WSACleanup();
-#endif
-    return IOTHUB_CLIENT_INVALID_ARG;
+// Opens the port of an RTU bus, called by the bus pool for the first component on the port
+static bool ModbusPnp_OpenBusPort(
+    const void* portConfig,
+    HANDLE* port)
+{
+    return IOTHUB_CLIENT_OK == ModbusPnp_OpenSerial((MODBUS_RTU_CONFIG*)portConfig, port);
 }
 
 #pragma endregion
@@ -626,26 +819,44 @@ void ModbusPnp_FreePropertyList(
 void Modbus_CleanupPollingTasks(
     PMODBUS_DEVICE_CONTEXT deviceContext)
 {
-    if (NULL != deviceContext->PollingTasks)
+    if (NULL != deviceContext->PollingTask)
     {
-        StopPollingTasks();
-        const ModbusInterfaceConfig* interfaceConfig = (PModbusInterfaceConfig)(deviceContext->InterfaceConfig);
-        int telemetryCount = ModbusPnp_GetListCount(interfaceConfig->Events);
-        int propertyCount = ModbusPnp_GetListCount(interfaceConfig->Properties);
-        int threadCount = telemetryCount + propertyCount;
+        StopPollingTasks(deviceContext);
 
-        for (int i = 0; i < threadCount; i++)
+        int res = 0;
+        int result = ThreadAPI_Join(deviceContext->PollingTask, &res);
+        if (result != THREADAPI_OK)
         {
-            int res = 0;
-            int result = ThreadAPI_Join(deviceContext->PollingTasks[i], &res);
-            if (result != THREADAPI_OK)
-            {
-                LogError("Failed to stop thread. error: %02X.", result);
-            }
-            //TODO: To be able to stop sleeping thread
+            LogError("Failed to stop thread. error: %02X.", result);
         }
-        free(deviceContext->PollingTasks);
+        deviceContext->PollingTask = NULL;
+    }
+
+    for (size_t i = 0; i < deviceContext->PollQueue.EntryCount; i++)
+    {
+        free(deviceContext->PollQueue.Entries[i].Context);
+    }
+    ModbusPollQueue_Deinit(&deviceContext->PollQueue);
+
+    if (NULL != deviceContext->StopPolling)
+    {
+        Condition_Deinit(deviceContext->StopPolling);
+        deviceContext->StopPolling = NULL;
+    }
+    if (NULL != deviceContext->hPollingLock)
+    {
+        Lock_Deinit(deviceContext->hPollingLock);
+        deviceContext->hPollingLock = NULL;
+    }
+    if (NULL != deviceContext->PollingClock)
+    {
+        tickcounter_destroy(deviceContext->PollingClock);
+        deviceContext->PollingClock = NULL;
     }
+
+    ModbusPnp_FreeReadBlocks(deviceContext->ReadBlocks, deviceContext->ReadBlockCount);
+    deviceContext->ReadBlocks = NULL;
+    deviceContext->ReadBlockCount = 0;
 }
 
 IOTHUB_CLIENT_RESULT
@@ -665,6 +876,7 @@ Modbus_StartPnpComponent(
     deviceContext->ClientHandle = PnpComponentHandleGetClientHandle(PnpComponentHandle);
 
     PnpComponentHandleSetContext(PnpComponentHandle, deviceContext);
+    PnpBridgeMetrics_SetGauge(deviceContext->ComponentName, MODBUS_METRIC_BREAKER_STATE, (int64_t) deviceContext->Breaker.State);
 
     // Start polling all telemetry
     return ModbusPnp_StartPollingAllTelemetryProperty(deviceContext);
@@ -694,6 +906,8 @@ IOTHUB_CLIENT_RESULT Modbus_DestroyPnpAdapter(
         }
         singlylinkedlist_destroy(adapterContext->InterfaceDefinitions);
     }
+    ModbusTcpPool_Destroy(adapterContext->TcpPool);
+    ModbusRtuBus_DestroyPool(adapterContext->RtuBusPool);
     free(adapterContext);
     return result;
 }
@@ -713,6 +927,24 @@ IOTHUB_CLIENT_RESULT Modbus_CreatePnpAdapter(
 
     adapterContext->InterfaceDefinitions = singlylinkedlist_create();
 
+    // TCP connections are shared by every component talking to the same host and port
+    adapterContext->TcpPool = ModbusTcpPool_Create();
+    if (NULL == adapterContext->TcpPool)
+    {
+        LogError("Could not create the Modbus TCP connection pool.");
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
+    }
+
+    // Serial ports are opened once and shared by every component whose slave is on the same RS-485 line
+    adapterContext->RtuBusPool = ModbusRtuBus_CreatePool(ModbusPnp_OpenBusPort, ModbusRtu_CloseDevice);
+    if (NULL == adapterContext->RtuBusPool)
+    {
+        LogError("Could not create the Modbus RTU bus pool.");
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
+    }
+
     if (AdapterGlobalConfig == NULL)
     {
         LogError("Modbus adapter requires associated global parameters in config");
@@ -825,13 +1057,22 @@ exit:
     return result;
 }
 
-IOTHUB_CLIENT_RESULT Modbus_DestroyPnpComponent(
-    PNPBRIDGE_COMPONENT_HANDLE PnpComponentHandle)
+// Frees a device context, releasing its connection if the component was not stopped
+static void Modbus_FreeDeviceContext(
+    PMODBUS_DEVICE_CONTEXT deviceContext)
 {
-    PMODBUS_DEVICE_CONTEXT deviceContext = PnpComponentHandleGetContext(PnpComponentHandle);
-
     if (NULL == deviceContext) {
-        return IOTHUB_CLIENT_OK;
+        return;
+    }
+
+    if (NULL != deviceContext->TcpConnection)
+    {
+        ModbusTcpPool_Release(deviceContext->TcpConnection);
+    }
+
+    if (NULL != deviceContext->RtuBus)
+    {
+        ModbusRtuBus_Release(deviceContext->RtuBus);
     }
 
     if (NULL != deviceContext->DeviceConfig)
@@ -844,11 +1085,23 @@ IOTHUB_CLIENT_RESULT Modbus_DestroyPnpComponent(
         free(deviceContext->ComponentName);
     }
 
-    if (NULL != deviceContext)
+    if (NULL != deviceContext->hBreakerLock)
     {
-        free(deviceContext);
+        Lock_Deinit(deviceContext->hBreakerLock);
     }
 
+    if (NULL != deviceContext->BreakerClock)
+    {
+        tickcounter_destroy(deviceContext->BreakerClock);
+    }
+
+    free(deviceContext);
+}
+
+IOTHUB_CLIENT_RESULT Modbus_DestroyPnpComponent(
+    PNPBRIDGE_COMPONENT_HANDLE PnpComponentHandle)
+{
+    Modbus_FreeDeviceContext(PnpComponentHandleGetContext(PnpComponentHandle));
     return IOTHUB_CLIENT_OK;
 }
 
@@ -888,6 +1141,17 @@ Modbus_CreatePnpComponent(
     // Allocate and copy component name into device context
     mallocAndStrcpy_s((char**)&deviceContext->ComponentName, ComponentName);
 
+    // Every request to the unit goes through its circuit breaker
+    ModbusCircuitBreaker_Init(&deviceContext->Breaker, MODBUS_BREAKER_FAILURE_THRESHOLD, MODBUS_BREAKER_MIN_BACKOFF_MS, MODBUS_BREAKER_MAX_BACKOFF_MS);
+    deviceContext->hBreakerLock = Lock_Init();
+    deviceContext->BreakerClock = tickcounter_create();
+    if (NULL == deviceContext->hBreakerLock || NULL == deviceContext->BreakerClock)
+    {
+        LogError("Could not create the circuit breaker of the device.");
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
+    }
+
     // Populate interface config from adapter's supported interface definitions
 
     PMODBUS_ADAPTER_CONTEXT adapterContext = PnpAdapterHandleGetContext(AdapterHandle);
@@ -899,16 +1163,6 @@ Modbus_CreatePnpComponent(
         goto exit;
     }
 
-    // Initialize interface's connection lock
-
-    deviceContext->hConnectionLock = Lock_Init();
-    if (NULL == deviceContext->hConnectionLock)
-    {
-        result = IOTHUB_CLIENT_ERROR;
-        LogError("Failed to create a valid lock handle for device connection.");
-        goto exit;
-    }
-
     // Parse interface specific device config
     ModbusDeviceConfig* deviceConfig = calloc(1, sizeof(ModbusDeviceConfig));
     if (!deviceConfig)
@@ -917,6 +1171,7 @@ Modbus_CreatePnpComponent(
         result = IOTHUB_CLIENT_ERROR;
         goto exit;
     }
+    deviceContext->DeviceConfig = deviceConfig;
     deviceConfig->ConnectionType = UNKOWN;
     result = Modbus_ParseDeviceConfig(AdapterComponentConfig, deviceConfig);
     if (result != IOTHUB_CLIENT_OK)
@@ -928,24 +1183,35 @@ Modbus_CreatePnpComponent(
     // Open the device
     if (deviceConfig->ConnectionType == RTU)
     {
-        result = ModbusPnp_OpenSerial(&(deviceConfig->ConnectionConfig.RtuConfig), 
-                    &(deviceContext->hDevice));
-        if (IOTHUB_CLIENT_OK != result)
+        MODBUS_RTU_LINE_SETTINGS lineSettings;
+        lineSettings.BaudRate = deviceConfig->ConnectionConfig.RtuConfig.BaudRate;
+        lineSettings.DataBits = deviceConfig->ConnectionConfig.RtuConfig.DataBits;
+        lineSettings.StopBits = deviceConfig->ConnectionConfig.RtuConfig.StopBits;
+        lineSettings.Parity = deviceConfig->ConnectionConfig.RtuConfig.Parity;
+
+        deviceContext->RtuBus = ModbusRtuBus_Acquire(adapterContext->RtuBusPool,
+                    deviceConfig->ConnectionConfig.RtuConfig.Port,
+                    &lineSettings,
+                    &(deviceConfig->ConnectionConfig.RtuConfig));
+        if (NULL == deviceContext->RtuBus)
         {
             LogError("Failed to open serial connection to \"%s\".", 
                         deviceConfig->ConnectionConfig.RtuConfig.Port);
+            result = IOTHUB_CLIENT_INVALID_ARG;
             goto exit;
         }
     }
     else if (deviceConfig->ConnectionType == TCP)
     {
-        result = ModbusPnp_OpenSocket(&(deviceConfig->ConnectionConfig.TcpConfig), 
-                    (SOCKET*)&(deviceContext->hDevice));
-        if (IOTHUB_CLIENT_OK != result)
+        deviceContext->TcpConnection = ModbusTcpPool_Acquire(adapterContext->TcpPool,
+                    deviceConfig->ConnectionConfig.TcpConfig.Host,
+                    deviceConfig->ConnectionConfig.TcpConfig.Port);
+        if (NULL == deviceContext->TcpConnection)
         {
             LogError("Failed to open socket connection to \"%s:%d\".", 
                 deviceConfig->ConnectionConfig.TcpConfig.Host, 
                 deviceConfig->ConnectionConfig.TcpConfig.Port);
+            result = IOTHUB_CLIENT_INVALID_ARG;
             goto exit;
         }
     }
@@ -954,8 +1220,6 @@ Modbus_CreatePnpComponent(
         goto exit;
     }
 
-    deviceContext->DeviceConfig = deviceConfig;
-
     // Set read requests for telemetry
     if (NULL != deviceContext->InterfaceConfig->Events)
     {
@@ -967,7 +1231,8 @@ Modbus_CreatePnpComponent(
             if (IOTHUB_CLIENT_OK != result)
             {
                 LogError("Failed to create read request for telemetry \"%s\".", telemetry->Name);
-                return IOTHUB_CLIENT_INVALID_ARG;
+                result = IOTHUB_CLIENT_INVALID_ARG;
+                goto exit;
             }
             telemetryHandle = singlylinkedlist_get_next_item(telemetryHandle);
         }
@@ -996,7 +1261,8 @@ Modbus_CreatePnpComponent(
             if (IOTHUB_CLIENT_OK != result)
             {
                 LogError("Failed to create read request for telemetry \"%s\".", property->Name);
-                return IOTHUB_CLIENT_INVALID_ARG;
+                result = IOTHUB_CLIENT_INVALID_ARG;
+                goto exit;
             }
             propertyhandle = singlylinkedlist_get_next_item(propertyhandle);
         }
@@ -1143,7 +1409,8 @@ Modbus_CreatePnpComponent(
 exit:
     if (result != IOTHUB_CLIENT_OK)
     {
-        Modbus_DestroyPnpComponent(BridgeComponentHandle);
+        // The context is only set on the component handle on success
+        Modbus_FreeDeviceContext(deviceContext);
     }
 
     return result;
@@ -1159,14 +1426,13 @@ IOTHUB_CLIENT_RESULT Modbus_StopPnpComponent(
 
     Modbus_CleanupPollingTasks(deviceContext);
 
-    if (INVALID_FILE != deviceContext->hDevice) {
-
-        ModbusPnp_CloseDevice(deviceContext->DeviceConfig->ConnectionType, deviceContext->hDevice, 
-            deviceContext->hConnectionLock);
+    if (NULL != deviceContext->TcpConnection) {
+        ModbusTcpPool_Release(deviceContext->TcpConnection);
+        deviceContext->TcpConnection = NULL;
     }
-
-    if (NULL != deviceContext->hConnectionLock) {
-        Lock_Deinit(deviceContext->hConnectionLock);
+    else if (NULL != deviceContext->RtuBus) {
+        ModbusRtuBus_Release(deviceContext->RtuBus);
+        deviceContext->RtuBus = NULL;
     }
 
     return IOTHUB_CLIENT_OK;
@@ -13,6 +13,7 @@ extern "C"
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include <ctype.h>
 #ifdef WIN32
 #include <Windows.h>
@@ -51,6 +52,11 @@ typedef int SOCKET;
 #endif
 
 #include "ModbusEnum.h"
+#include "ModbusReadBlock.h"
+#include "ModbusPollScheduler.h"
+#include "ModbusCircuitBreaker.h"
+#include "ModbusConnection/ModbusTcpPool.h"
+#include "ModbusConnection/ModbusRtuBus.h"
 
     typedef struct _MODBUS_RTU_CONFIG
     {
@@ -86,23 +92,43 @@ typedef int SOCKET;
         SINGLYLINKEDLIST_HANDLE Events;
         SINGLYLINKEDLIST_HANDLE Properties;
         SINGLYLINKEDLIST_HANDLE Commands;
+        int MaxReadGap;
     } ModbusInterfaceConfig, *PModbusInterfaceConfig;
 
     typedef struct _MODBUS_DEVICE_CONTEXT {
-        HANDLE hDevice;
-        LOCK_HANDLE hConnectionLock;
+        // Connection of a TCP device, shared with every component talking to the same host and port
+        MODBUS_TCP_CONNECTION_HANDLE TcpConnection;
+        // Serial bus of an RTU device, shared with every component whose slave is on the same port
+        MODBUS_RTU_BUS_CLIENT_HANDLE RtuBus;
         PNP_BRIDGE_CLIENT_HANDLE ClientHandle;
         THREAD_HANDLE ModbusDeviceWorker;
 
+        // Health of the unit, which holds back requests to it while it keeps failing
+        ModbusCircuitBreaker Breaker;
+        LOCK_HANDLE hBreakerLock;
+        TICK_COUNTER_HANDLE BreakerClock;
+
         PModbusDeviceConfig DeviceConfig;
         PModbusInterfaceConfig InterfaceConfig;
-        THREAD_HANDLE* PollingTasks;
+        PModbusReadBlock ReadBlocks;
+        size_t ReadBlockCount;
+
+        // All read blocks of the device are polled by a single scheduler thread in deadline order
+        ModbusPollQueue PollQueue;
+        THREAD_HANDLE PollingTask;
+        TICK_COUNTER_HANDLE PollingClock;
+        LOCK_HANDLE hPollingLock;
+        COND_HANDLE StopPolling;
+        bool ContinuePolling;
+
         char * ComponentName;
         PNP_BRIDGE_IOT_TYPE ClientType;
     } MODBUS_DEVICE_CONTEXT, *PMODBUS_DEVICE_CONTEXT;
 
     typedef struct _MODBUS_ADAPTER_CONTEXT {
         SINGLYLINKEDLIST_HANDLE InterfaceDefinitions;
+        MODBUS_TCP_POOL_HANDLE TcpPool;
+        MODBUS_RTU_BUS_POOL_HANDLE RtuBusPool;
     } MODBUS_ADAPTER_CONTEXT, * PMODBUS_ADAPTER_CONTEXT;
 
     int ModbusPnp_GetListCount(SINGLYLINKEDLIST_HANDLE list);
@@ -126,6 +152,8 @@ typedef int SOCKET;
     #define PNP_CONFIG_ADAPTER_INTERFACE_UNITID "unit_id"
     #define PNP_CONFIG_ADAPTER_INTERFACE_TCP "tcp"
     #define PNP_CONFIG_ADAPTER_INTERFACE_RTU "rtu"
+    #define PNP_CONFIG_ADAPTER_INTERFACE_MAX_READ_GAP "maxReadGap"
+    #define PNP_CONFIG_ADAPTER_INTERFACE_ADAPTIVE_POLLING "adaptivePolling"
 
     // TODO: Fix this missing reference
     #ifndef AZURE_UNREFERENCED_PARAMETER
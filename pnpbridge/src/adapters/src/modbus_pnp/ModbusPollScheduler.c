@@ -0,0 +1,243 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "ModbusPollScheduler.h"
+
+static void ModbusPollQueue_Swap(
+    ModbusPollQueue* queue,
+    size_t left,
+    size_t right)
+{
+    PModbusPollEntry entry = queue->Heap[left];
+    queue->Heap[left] = queue->Heap[right];
+    queue->Heap[right] = entry;
+}
+
+static void ModbusPollQueue_SiftUp(
+    ModbusPollQueue* queue,
+    size_t index)
+{
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / 2;
+        if (queue->Heap[parent]->Deadline <= queue->Heap[index]->Deadline)
+        {
+            break;
+        }
+        ModbusPollQueue_Swap(queue, parent, index);
+        index = parent;
+    }
+}
+
+static void ModbusPollQueue_SiftDown(
+    ModbusPollQueue* queue,
+    size_t index)
+{
+    for (;;)
+    {
+        size_t smallest = index;
+        size_t left = (2 * index) + 1;
+        size_t right = left + 1;
+
+        if (left < queue->HeapCount && queue->Heap[left]->Deadline < queue->Heap[smallest]->Deadline)
+        {
+            smallest = left;
+        }
+        if (right < queue->HeapCount && queue->Heap[right]->Deadline < queue->Heap[smallest]->Deadline)
+        {
+            smallest = right;
+        }
+        if (smallest == index)
+        {
+            break;
+        }
+        ModbusPollQueue_Swap(queue, smallest, index);
+        index = smallest;
+    }
+}
+
+static void ModbusPollQueue_Push(
+    ModbusPollQueue* queue,
+    PModbusPollEntry entry)
+{
+    queue->Heap[queue->HeapCount] = entry;
+    queue->HeapCount++;
+    ModbusPollQueue_SiftUp(queue, queue->HeapCount - 1);
+}
+
+bool ModbusPollQueue_Init(
+    ModbusPollQueue* queue,
+    size_t capacity)
+{
+    memset(queue, 0, sizeof(ModbusPollQueue));
+    if (0 == capacity)
+    {
+        return true;
+    }
+
+    queue->Entries = calloc(capacity, sizeof(ModbusPollEntry));
+    queue->Heap = calloc(capacity, sizeof(PModbusPollEntry));
+    if (NULL == queue->Entries || NULL == queue->Heap)
+    {
+        LogError("Could not allocate memory for Modbus poll queue.");
+        ModbusPollQueue_Deinit(queue);
+        return false;
+    }
+
+    queue->Capacity = capacity;
+    return true;
+}
+
+void ModbusPollQueue_Deinit(
+    ModbusPollQueue* queue)
+{
+    free(queue->Entries);
+    free(queue->Heap);
+    memset(queue, 0, sizeof(ModbusPollQueue));
+}
+
+PModbusPollEntry ModbusPollQueue_Add(
+    ModbusPollQueue* queue,
+    uint32_t period,
+    void* context,
+    uint64_t firstDeadline)
+{
+    if (queue->EntryCount >= queue->Capacity)
+    {
+        return NULL;
+    }
+
+    PModbusPollEntry entry = &queue->Entries[queue->EntryCount];
+    queue->EntryCount++;
+
+    memset(entry, 0, sizeof(ModbusPollEntry));
+    entry->Deadline = firstDeadline;
+    entry->Period = period;
+    entry->Context = context;
+
+    ModbusPollQueue_Push(queue, entry);
+    return entry;
+}
+
+PModbusPollEntry ModbusPollQueue_Peek(
+    const ModbusPollQueue* queue)
+{
+    return (queue->HeapCount > 0) ? queue->Heap[0] : NULL;
+}
+
+PModbusPollEntry ModbusPollQueue_Pop(
+    ModbusPollQueue* queue)
+{
+    if (0 == queue->HeapCount)
+    {
+        return NULL;
+    }
+
+    PModbusPollEntry entry = queue->Heap[0];
+    queue->HeapCount--;
+    if (queue->HeapCount > 0)
+    {
+        queue->Heap[0] = queue->Heap[queue->HeapCount];
+        ModbusPollQueue_SiftDown(queue, 0);
+    }
+
+    return entry;
+}
+
+uint32_t ModbusPollQueue_Reschedule(
+    ModbusPollQueue* queue,
+    PModbusPollEntry entry,
+    uint64_t startTime,
+    uint64_t endTime)
+{
+    uint32_t skipped = 0;
+    uint32_t jitter = (startTime > entry->Deadline) ? (uint32_t)(startTime - entry->Deadline) : 0;
+
+    entry->PollCount++;
+    entry->TotalJitter += jitter;
+    if (jitter > entry->MaxJitter)
+    {
+        entry->MaxJitter = jitter;
+    }
+
+    if (0 == entry->Period)
+    {
+        entry->Deadline = endTime;
+    }
+    else
+    {
+        entry->Deadline += entry->Period;
+
+        // Skip the polls whose whole period has already gone by, the next one starts late by less than a period
+        if (endTime >= entry->Deadline + entry->Period)
+        {
+            uint64_t behind = (endTime - entry->Deadline) / entry->Period;
+            entry->Deadline += behind * entry->Period;
+            skipped = (uint32_t)behind;
+            entry->SkippedCount += skipped;
+        }
+    }
+
+    ModbusPollQueue_Push(queue, entry);
+    return skipped;
+}
+
+void ModbusPollEntry_SetAdaptive(
+    PModbusPollEntry entry,
+    uint32_t minPeriod,
+    uint32_t maxPeriod)
+{
+    entry->MinPeriod = minPeriod;
+    entry->MaxPeriod = (maxPeriod > minPeriod) ? maxPeriod : minPeriod;
+
+    // Start at the configured period, within the bounds
+    if (entry->Period < entry->MinPeriod)
+    {
+        entry->Period = entry->MinPeriod;
+    }
+    else if (entry->Period > entry->MaxPeriod)
+    {
+        entry->Period = entry->MaxPeriod;
+    }
+}
+
+bool ModbusPollEntry_Adapt(
+    PModbusPollEntry entry,
+    ModbusPollOutcome outcome)
+{
+    uint32_t period = entry->Period;
+
+    if (0 == entry->MinPeriod)
+    {
+        return false;
+    }
+
+    if (ModbusPollChanged == outcome)
+    {
+        period = entry->MinPeriod;
+    }
+    else if (ModbusPollSteady == outcome)
+    {
+        uint64_t doubled = 2ULL * entry->Period;
+        period = (doubled < entry->MaxPeriod) ? (uint32_t)doubled : entry->MaxPeriod;
+    }
+
+    if (period == entry->Period)
+    {
+        return false;
+    }
+
+    entry->Period = period;
+    return true;
+}
+
+uint32_t ModbusPollEntry_GetAverageJitter(
+    const ModbusPollEntry* entry)
+{
+    return (entry->PollCount > 0) ? (uint32_t)(entry->TotalJitter / entry->PollCount) : 0;
+}
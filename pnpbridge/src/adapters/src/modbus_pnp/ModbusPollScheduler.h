@@ -0,0 +1,96 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+    // How a poll went, which decides the next period of an adaptive poll
+    typedef enum ModbusPollOutcome {
+        ModbusPollFailed,       // the device could not be read
+        ModbusPollSteady,       // no value moved past its change threshold
+        ModbusPollChanged       // at least one value moved past its change threshold
+    } ModbusPollOutcome;
+
+    // A periodic poll. Deadlines advance by whole periods from the first deadline, so the time a poll
+    // takes never shifts the schedule; polls that are more than a period late are skipped.
+    typedef struct ModbusPollEntry {
+        uint64_t Deadline;      // next time (ms) the poll is due
+        uint32_t Period;        // ms between polls
+        uint32_t MinPeriod;     // bounds of the period of an adaptive poll, both 0 for a fixed period
+        uint32_t MaxPeriod;
+        void* Context;
+
+        // Statistics on how late polls started relative to their deadline
+        uint32_t PollCount;
+        uint32_t SkippedCount;
+        uint32_t MaxJitter;
+        uint64_t TotalJitter;
+    } ModbusPollEntry, *PModbusPollEntry;
+
+    // Min-heap of poll entries keyed by deadline, with storage for a fixed number of entries
+    typedef struct ModbusPollQueue {
+        PModbusPollEntry Entries;
+        size_t EntryCount;
+        PModbusPollEntry* Heap;
+        size_t HeapCount;
+        size_t Capacity;
+    } ModbusPollQueue;
+
+    bool ModbusPollQueue_Init(
+        ModbusPollQueue* queue,
+        size_t capacity);
+
+    void ModbusPollQueue_Deinit(
+        ModbusPollQueue* queue);
+
+    // Adds a poll that is first due at firstDeadline. Returns NULL if the queue is full.
+    PModbusPollEntry ModbusPollQueue_Add(
+        ModbusPollQueue* queue,
+        uint32_t period,
+        void* context,
+        uint64_t firstDeadline);
+
+    // Returns the entry with the earliest deadline, or NULL if no entry is scheduled
+    PModbusPollEntry ModbusPollQueue_Peek(
+        const ModbusPollQueue* queue);
+
+    // Removes and returns the entry with the earliest deadline, or NULL if no entry is scheduled
+    PModbusPollEntry ModbusPollQueue_Pop(
+        ModbusPollQueue* queue);
+
+    // Records the jitter of a popped entry that started polling at startTime, moves its deadline to the next
+    // period that has not fully elapsed by endTime and puts it back in the queue.
+    // Returns the number of polls that were skipped because they were already a period late.
+    uint32_t ModbusPollQueue_Reschedule(
+        ModbusPollQueue* queue,
+        PModbusPollEntry entry,
+        uint64_t startTime,
+        uint64_t endTime);
+
+    // Lets the period of an entry adapt between minPeriod and maxPeriod, see ModbusPollEntry_Adapt
+    void ModbusPollEntry_SetAdaptive(
+        PModbusPollEntry entry,
+        uint32_t minPeriod,
+        uint32_t maxPeriod);
+
+    // Adapts the period of a popped adaptive entry to the outcome of its poll before it is rescheduled: a change
+    // drops it to the minimum period, a steady poll doubles it up to the maximum and a failed one keeps it.
+    // Returns true if the period changed.
+    bool ModbusPollEntry_Adapt(
+        PModbusPollEntry entry,
+        ModbusPollOutcome outcome);
+
+    uint32_t ModbusPollEntry_GetAverageJitter(
+        const ModbusPollEntry* entry);
+
+#ifdef __cplusplus
+}
+#endif
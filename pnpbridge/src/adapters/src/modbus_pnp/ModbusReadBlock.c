@@ -0,0 +1,254 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "ModbusReadBlock.h"
+
+static bool ModbusPnp_IsBitFunctionCode(
+    uint8_t functionCode)
+{
+    return (ReadCoils == functionCode || ReadInputs == functionCode);
+}
+
+static int ModbusPnp_CompareAdaptivePolling(
+    const ModbusAdaptivePolling* a,
+    const ModbusAdaptivePolling* b)
+{
+    if (a->MinInterval != b->MinInterval)
+    {
+        return (a->MinInterval < b->MinInterval) ? -1 : 1;
+    }
+    if (a->MaxInterval != b->MaxInterval)
+    {
+        return (a->MaxInterval < b->MaxInterval) ? -1 : 1;
+    }
+    if (a->ChangeThreshold != b->ChangeThreshold)
+    {
+        return (a->ChangeThreshold < b->ChangeThreshold) ? -1 : 1;
+    }
+    return 0;
+}
+
+static int ModbusPnp_CompareReadBlockItems(
+    const void* left,
+    const void* right)
+{
+    const ModbusReadBlockItem* a = *(const ModbusReadBlockItem* const*)left;
+    const ModbusReadBlockItem* b = *(const ModbusReadBlockItem* const*)right;
+
+    if (a->FunctionCode != b->FunctionCode)
+    {
+        return (a->FunctionCode < b->FunctionCode) ? -1 : 1;
+    }
+    if (a->Frequency != b->Frequency)
+    {
+        return (a->Frequency < b->Frequency) ? -1 : 1;
+    }
+    int adaptivePolling = ModbusPnp_CompareAdaptivePolling(&a->AdaptivePolling, &b->AdaptivePolling);
+    if (0 != adaptivePolling)
+    {
+        return adaptivePolling;
+    }
+    if (a->Address != b->Address)
+    {
+        return (a->Address < b->Address) ? -1 : 1;
+    }
+    // Keep the configuration order for items at the same address so planning is deterministic
+    return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+void ModbusPnp_FreeReadBlocks(
+    PModbusReadBlock blocks,
+    size_t blockCount)
+{
+    if (NULL == blocks)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < blockCount; i++)
+    {
+        free(blocks[i].Items);
+    }
+    free(blocks);
+}
+
+bool ModbusPnp_PlanReadBlocks(
+    const ModbusReadBlockItem* items,
+    size_t itemCount,
+    int maxGap,
+    PModbusReadBlock* blocks,
+    size_t* blockCount)
+{
+    bool result = false;
+    const ModbusReadBlockItem** sorted = NULL;
+    PModbusReadBlock planned = NULL;
+    size_t plannedCount = 0;
+
+    *blocks = NULL;
+    *blockCount = 0;
+
+    if (0 == itemCount)
+    {
+        return true;
+    }
+
+    sorted = calloc(itemCount, sizeof(ModbusReadBlockItem*));
+    planned = calloc(itemCount, sizeof(ModbusReadBlock));
+    if (NULL == sorted || NULL == planned)
+    {
+        LogError("Could not allocate memory for Modbus read block plan.");
+        goto exit;
+    }
+
+    for (size_t i = 0; i < itemCount; i++)
+    {
+        sorted[i] = &items[i];
+    }
+    qsort((void*)sorted, itemCount, sizeof(ModbusReadBlockItem*), ModbusPnp_CompareReadBlockItems);
+
+    // Sweep the items in address order and grow the current block for as long as the next item
+    // shares its function code, frequency and adaptive polling, is close enough and keeps the block within limits.
+    size_t first = 0;
+    while (first < itemCount)
+    {
+        const ModbusReadBlockItem* item = sorted[first];
+        uint32_t maxLength = ModbusPnp_IsBitFunctionCode(item->FunctionCode) ? MODBUS_READ_MAX_BITS : MODBUS_READ_MAX_REGISTERS;
+        uint32_t start = item->Address;
+        uint32_t end = (uint32_t)item->Address + item->Length;
+        size_t last = first + 1;
+
+        while (maxGap >= 0 && last < itemCount)
+        {
+            const ModbusReadBlockItem* next = sorted[last];
+            uint32_t nextEnd = (uint32_t)next->Address + next->Length;
+
+            if (next->FunctionCode != item->FunctionCode ||
+                next->Frequency != item->Frequency ||
+                0 != ModbusPnp_CompareAdaptivePolling(&next->AdaptivePolling, &item->AdaptivePolling) ||
+                (next->Address > end && (next->Address - end) > (uint32_t)maxGap) ||
+                ((nextEnd > end ? nextEnd : end) - start) > maxLength)
+            {
+                break;
+            }
+
+            if (nextEnd > end)
+            {
+                end = nextEnd;
+            }
+            last++;
+        }
+
+        PModbusReadBlock block = &planned[plannedCount];
+        block->FunctionCode = item->FunctionCode;
+        block->Frequency = item->Frequency;
+        block->AdaptivePolling = item->AdaptivePolling;
+        block->StartAddress = (uint16_t)start;
+        block->Length = (uint16_t)(end - start);
+        block->ItemCount = last - first;
+        block->Items = calloc(block->ItemCount, sizeof(ModbusReadBlockItem));
+        if (NULL == block->Items)
+        {
+            LogError("Could not allocate memory for Modbus read block plan.");
+            goto exit;
+        }
+        plannedCount++;
+
+        for (size_t i = 0; i < block->ItemCount; i++)
+        {
+            block->Items[i] = *sorted[first + i];
+        }
+
+        first = last;
+    }
+
+    *blocks = planned;
+    *blockCount = plannedCount;
+    planned = NULL;
+    result = true;
+
+exit:
+    ModbusPnp_FreeReadBlocks(planned, plannedCount);
+    free((void*)sorted);
+    return result;
+}
+
+uint16_t ModbusPnp_GetReadBlockDataSize(
+    const ModbusReadBlock* block)
+{
+    if (ModbusPnp_IsBitFunctionCode(block->FunctionCode))
+    {
+        return (uint16_t)((block->Length + 7) / 8);
+    }
+
+    return (uint16_t)(block->Length * 2);
+}
+
+void ModbusPnp_DecodeReadBlock(
+    const ModbusReadBlock* block,
+    const uint8_t* blockData,
+    double* values)
+{
+    if (ModbusPnp_IsBitFunctionCode(block->FunctionCode))
+    {
+        for (size_t i = 0; i < block->ItemCount; i++)
+        {
+            uint16_t bit = (uint16_t)(block->Items[i].Address - block->StartAddress);
+            values[i] = (blockData[bit / 8] & (1 << (bit % 8))) ? 1.0 : 0.0;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < block->ItemCount; i++)
+    {
+        const ModbusReadBlockItem* item = &block->Items[i];
+        if (NUMERIC == item->DataType || FLAG == item->DataType)
+        {
+            values[i] = ModbusNumber_Decode(&item->NumberFormat, blockData + ((item->Address - block->StartAddress) * 2));
+        }
+        else
+        {
+            values[i] = 0.0;
+        }
+    }
+
+    for (size_t i = 0; i < block->ItemCount; i++)
+    {
+        values[i] *= block->Items[i].ConversionCoefficient;
+    }
+}
+
+int ModbusPnp_FormatReadBlockItem(
+    const ModbusReadBlock* block,
+    const ModbusReadBlockItem* item,
+    const uint8_t* blockData,
+    double value,
+    char* result,
+    size_t size)
+{
+    int length = -1;
+
+    if (ModbusPnp_IsBitFunctionCode(block->FunctionCode) || FLAG == item->DataType)
+    {
+        const char* text = (0 != value) ? "true" : "false";
+        length = snprintf(result, size, "%s", text);
+        return (length < 0 || (size_t)length >= size) ? -1 : length;
+    }
+
+    switch (item->DataType)
+    {
+        case NUMERIC:
+            return ModbusValue_FormatNumber(value, result, size);
+        case STRING:
+        case HEXSTRING:
+            return ModbusValue_FormatString(item->DataType, blockData + ((item->Address - block->StartAddress) * 2), item->Length, result, size);
+        default:
+            LogError("Unsupported datatype.");
+            return -1;
+    }
+}
@@ -0,0 +1,106 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ModbusEnum.h"
+#include "ModbusValue.h"
+
+// Protocol limits on the number of registers or bits a single read request may ask for
+#define MODBUS_READ_MAX_REGISTERS 125
+#define MODBUS_READ_MAX_BITS 2000
+
+// Largest read response: MBAP header (7) + function code (1) + byte count (1) + data (2 * 125) + CRC (2)
+#define MODBUS_READ_BLOCK_RESPONSE_MAX_LENGTH 261
+
+// Default number of unused registers (or bits) a block read may span between two capabilities
+#define MODBUS_DEFAULT_MAX_READ_GAP 8
+
+    // Optional adaptive polling of a telemetry or property. While its value is flat the polling interval doubles
+    // from its frequency up to MaxInterval; once it moves by ChangeThreshold or more it drops to MinInterval.
+    typedef struct ModbusAdaptivePolling {
+        uint32_t MinInterval;       // ms, 0 if the capability is polled at a fixed frequency
+        uint32_t MaxInterval;       // ms
+        double ChangeThreshold;     // in converted units, 0 for any change
+    } ModbusAdaptivePolling;
+
+    // A telemetry or property polled as part of a block read
+    typedef struct ModbusReadBlockItem {
+        CapabilityType Type;
+        void* Capability;
+        uint8_t FunctionCode;
+        uint16_t Address;   // zero based Modbus address
+        uint16_t Length;    // number of registers or bits
+        int Frequency;
+        ModbusAdaptivePolling AdaptivePolling;
+
+        // How the value of the item is decoded from the registers or bits read
+        ModbusDataType DataType;
+        ModbusNumberFormat NumberFormat;
+        double ConversionCoefficient;
+
+        // Value of an adaptively polled item when it last moved past its change threshold
+        bool HasReferenceValue;
+        double ReferenceValue;
+    } ModbusReadBlockItem;
+
+    // A single read request covering one or more capabilities that share a function code and polling frequency
+    typedef struct ModbusReadBlock {
+        uint8_t FunctionCode;
+        uint16_t StartAddress;
+        uint16_t Length;
+        int Frequency;
+        ModbusAdaptivePolling AdaptivePolling;
+        size_t ItemCount;
+        ModbusReadBlockItem* Items;
+    } ModbusReadBlock, *PModbusReadBlock;
+
+    // Groups items into the smallest set of block reads such that every block only contains items with the same
+    // function code, frequency and adaptive polling, spans at most the protocol limit and leaves at most maxGap unused addresses
+    // between neighbouring items. A negative maxGap disables coalescing and plans one block per item.
+    // On success *blocks must be released with ModbusPnp_FreeReadBlocks.
+    bool ModbusPnp_PlanReadBlocks(
+        const ModbusReadBlockItem* items,
+        size_t itemCount,
+        int maxGap,
+        PModbusReadBlock* blocks,
+        size_t* blockCount);
+
+    void ModbusPnp_FreeReadBlocks(
+        PModbusReadBlock blocks,
+        size_t blockCount);
+
+    // Returns the number of data bytes a read response for the block carries
+    uint16_t ModbusPnp_GetReadBlockDataSize(
+        const ModbusReadBlock* block);
+
+    // Decodes the values of all items of a block read in one pass over its data, then applies their conversion
+    // coefficients. values has room for one value per item. Bits decode to 0 or 1; STRING and HEXSTRING items,
+    // which are formatted from the data, decode to 0.
+    void ModbusPnp_DecodeReadBlock(
+        const ModbusReadBlock* block,
+        const uint8_t* blockData,
+        double* values);
+
+    // Formats the value of an item decoded by ModbusPnp_DecodeReadBlock. Returns the length of the text, or -1 if
+    // the item cannot be formatted or the text does not fit in size.
+    int ModbusPnp_FormatReadBlockItem(
+        const ModbusReadBlock* block,
+        const ModbusReadBlockItem* item,
+        const uint8_t* blockData,
+        double value,
+        char* result,
+        size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,128 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ModbusValue.h"
+
+uint16_t ModbusNumber_GetRegisterCount(
+    ModbusNumberType type)
+{
+    switch (type)
+    {
+        case ModbusUInt32:
+        case ModbusInt32:
+        case ModbusFloat32:
+            return 2;
+        case ModbusUInt64:
+        case ModbusInt64:
+        case ModbusFloat64:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+double ModbusNumber_Decode(
+    const ModbusNumberFormat* format,
+    const uint8_t* data)
+{
+    uint16_t registerCount = ModbusNumber_GetRegisterCount(format->Type);
+    uint64_t raw = 0;
+
+    // Gather the registers most significant first
+    for (uint16_t i = 0; i < registerCount; i++)
+    {
+        const uint8_t* reg = data + 2 * ((ModbusBigEndian == format->WordOrder) ? i : registerCount - 1 - i);
+        uint16_t word = (ModbusBigEndian == format->ByteOrder) ? (uint16_t)((reg[0] << 8) | reg[1]) : (uint16_t)((reg[1] << 8) | reg[0]);
+        raw = (raw << 16) | word;
+    }
+
+    switch (format->Type)
+    {
+        case ModbusInt16:
+            return (double)(int16_t)raw;
+        case ModbusUInt32:
+            return (double)(uint32_t)raw;
+        case ModbusInt32:
+            return (double)(int32_t)(uint32_t)raw;
+        case ModbusUInt64:
+            return (double)raw;
+        case ModbusInt64:
+            return (double)(int64_t)raw;
+        case ModbusFloat32:
+        {
+            uint32_t bits = (uint32_t)raw;
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            return (double)value;
+        }
+        case ModbusFloat64:
+        {
+            double value;
+            memcpy(&value, &raw, sizeof(value));
+            return value;
+        }
+        default:
+            return (double)(uint16_t)raw;
+    }
+}
+
+int ModbusValue_FormatNumber(
+    double value,
+    char* result,
+    size_t size)
+{
+    // 15 significant digits show every 32-bit integer exactly and scaled values without binary noise
+    int length = snprintf(result, size, "%.15g", value);
+    return (length < 0 || (size_t)length >= size) ? -1 : length;
+}
+
+int ModbusValue_FormatString(
+    ModbusDataType dataType,
+    const uint8_t* data,
+    uint16_t registerCount,
+    char* result,
+    size_t size)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+    size_t length = 0;
+
+    if (size < 3)
+    {
+        return -1;
+    }
+    result[length++] = '\"';
+
+    for (uint16_t i = 0; i < registerCount; i++)
+    {
+        const uint8_t* reg = data + 2 * (registerCount - 1 - i);
+        for (int j = 0; j < 2; j++)
+        {
+            uint8_t c = reg[j];
+            if (STRING == dataType && (isalnum(c) || '_' == c))
+            {
+                if (length + 1 >= size - 1)
+                {
+                    return -1;
+                }
+                result[length++] = (char)c;
+            }
+            else
+            {
+                if (length + 2 >= size - 1)
+                {
+                    return -1;
+                }
+                result[length++] = hexDigits[c >> 4];
+                result[length++] = hexDigits[c & 0x0F];
+            }
+        }
+    }
+
+    result[length++] = '\"';
+    result[length] = '\0';
+    return (int)length;
+}
@@ -0,0 +1,73 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ModbusEnum.h"
+
+// Longest formatted value: a quoted hex string of the 125 registers a read response carries at most
+#define MODBUS_VALUE_MAX_LENGTH 512
+
+    typedef enum ModbusNumberType
+    {
+        ModbusUInt16,
+        ModbusInt16,
+        ModbusUInt32,
+        ModbusInt32,
+        ModbusUInt64,
+        ModbusInt64,
+        ModbusFloat32,
+        ModbusFloat64
+    } ModbusNumberType;
+
+    typedef enum ModbusByteOrder
+    {
+        ModbusBigEndian,        // most significant first, the order Modbus sends the bytes of a register in
+        ModbusLittleEndian
+    } ModbusByteOrder;
+
+    // How a number is laid out in one or more consecutive registers
+    typedef struct ModbusNumberFormat
+    {
+        ModbusNumberType Type;
+        ModbusByteOrder WordOrder;  // order of the registers of a multi-register number
+        ModbusByteOrder ByteOrder;  // order of the two bytes within each register
+    } ModbusNumberFormat;
+
+    // Returns the number of registers a number of the type takes
+    uint16_t ModbusNumber_GetRegisterCount(
+        ModbusNumberType type);
+
+    // Decodes a number from the registers at data, as received from the device
+    double ModbusNumber_Decode(
+        const ModbusNumberFormat* format,
+        const uint8_t* data);
+
+    // Formats a decoded number. Returns the length of the text, or -1 if it does not fit in size.
+    int ModbusValue_FormatNumber(
+        double value,
+        char* result,
+        size_t size);
+
+    // Formats registers as a quoted STRING or HEXSTRING. The registers are taken last first, the bytes of each
+    // register most significant first. A STRING shows letters, digits and underscores as they are and other bytes
+    // in hex. Returns the length of the text, or -1 if it does not fit in size.
+    int ModbusValue_FormatString(
+        ModbusDataType dataType,
+        const uint8_t* data,
+        uint16_t registerCount,
+        char* result,
+        size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -288,6 +288,26 @@ JsonRpc::RpcCall(
     return out_packet;
 }
 
+bool
+JsonRpc::CancelCall(
+    void*               CallContext
+)
+{
+    bool cancelled = false;
+
+    s_OutstandingCallsMutex.lock();
+    for (auto iterator = s_OutstandingCalls.begin(); iterator != s_OutstandingCalls.end(); iterator++) {
+        if (iterator->second == CallContext) {
+            s_OutstandingCalls.erase(iterator);
+            cancelled = true;
+            break;
+        }
+    }
+    s_OutstandingCallsMutex.unlock();
+
+    return cancelled;
+}
+
 const char*
 JsonRpc::RpcNotification(
     const char*         Method,
@@ -92,6 +92,13 @@ public:
         JSON_Value*         Parameters
     );
 
+    // Forgets an outstanding call so that its result callback is never made.
+    // Returns false if the result is already being delivered.
+    bool
+    CancelCall(
+        void*               CallContext
+    );
+
 private:
     std::map<size_t, void*>                     s_OutstandingCalls;
     std::mutex                                  s_OutstandingCallsMutex;
@@ -15,10 +15,14 @@
 
 #include "json_rpc_protocol_handler.hpp"
 
+// Time to wait for the JSON-RPC server to answer a command
+#define JSON_RPC_COMMAND_TIMEOUT_MS 60000
+
 class JsonRpcCallContext {
 public:
     COND_HANDLE Condition;
     LOCK_HANDLE Lock;
+    bool Completed;
     unsigned char** CommandResponse;
     size_t* CommandResponseSize;
     int* CommandResponseStatus;
@@ -130,19 +134,21 @@ int JsonRpcProtocolHandler::OnPnpCommandCallback(
     }
 
     JsonRpcCallContext call;
-    int * responseStatus = &result;
+    int responseStatus = PNP_STATUS_SUCCESS;
     call.CommandResponse = CommandResponse;
     call.CommandResponseSize = CommandResponseSize;
-    call.CommandResponseStatus = responseStatus;
-    const char* call_str = s_JsonRpc->RpcCall(json_method, CommandValue, &call);
-
-    printf("Generated JSON %s\n", call_str);
-
+    call.CommandResponseStatus = &responseStatus;
+    call.Completed = false;
 
-    // Create event
+    // Create event before the call can complete
     call.Condition = Condition_Init();
     call.Lock = Lock_Init();
 
+    // The call takes ownership of its parameters, the command value stays owned by the bridge
+    const char* call_str = s_JsonRpc->RpcCall(json_method, json_value_deep_copy(CommandValue), &call);
+
+    printf("Generated JSON %s\n", call_str);
+
     // Send appropriate command over json rpc, return success
     printf("Publishing command call on %s : %s\n", tx_topic, call_str);
     s_ConnectionManager->Publish(tx_topic, call_str, strlen(call_str));
@@ -150,14 +156,27 @@ int JsonRpcProtocolHandler::OnPnpCommandCallback(
 
     printf("Waiting for response\n");
     Lock(call.Lock);
-    Condition_Wait(call.Condition, call.Lock, 0);
+    while (!call.Completed)
+    {
+        if ((Condition_Wait(call.Condition, call.Lock, JSON_RPC_COMMAND_TIMEOUT_MS) == COND_TIMEOUT) &&
+            !call.Completed && s_JsonRpc->CancelCall(&call))
+        {
+            // No result callback can reach the call context after it is cancelled
+            LogError("Component %s: Timeout waiting for response to command %s", s_ComponentName.c_str(), CommandName);
+            responseStatus = PNP_STATUS_TIMEOUT;
+            break;
+        }
+    }
     Unlock(call.Lock);
 
-    printf("Response length %d, %s\n", (int) *CommandResponseSize, *CommandResponse);
+    if (call.Completed)
+    {
+        printf("Response length %d, %s\n", (int) *CommandResponseSize, *CommandResponse);
+    }
     Condition_Deinit(call.Condition);
     Lock_Deinit(call.Lock);
 
-    result = *responseStatus;
+    result = responseStatus;
 
     return result;
 }
@@ -189,6 +208,7 @@ JsonRpcProtocolHandler::RpcResultCallback(
     json_free_serialized_string(response_str);
 
     Lock(ctx->Lock);
+    ctx->Completed = true;
     Condition_Post(ctx->Condition);
     Unlock(ctx->Lock);
 
@@ -203,7 +223,6 @@ JsonRpcProtocolHandler::RpcNotificationCallback(
 {
     JsonRpcProtocolHandler *ph = static_cast<JsonRpcProtocolHandler*>(Context);
     const char* tname = nullptr;
-    IOTHUB_MESSAGE_HANDLE messageHandle = NULL;
     IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
 
     auto iterator = ph->s_Telemetry.find(Method);
@@ -225,21 +244,20 @@ JsonRpcProtocolHandler::RpcNotificationCallback(
                 sprintf(telemetryMessage, telemetryMessageFormat, tname, out);
             }
 
-            if ((messageHandle = PnP_CreateTelemetryMessageHandle(ph->s_ComponentName.c_str(), telemetryMessage)) == NULL)
+            if (telemetryMessage == NULL)
             {
-                LogError("Mqtt Pnp Component: PnP_CreateTelemetryMessageHandle failed.");
+                LogError("Mqtt Pnp Component: Could not allocate telemetry message.");
             }
-            else if (((result = PnpBridgeClient_SendEventAsync(ph->s_ClientHandle, messageHandle,
-                        NULL, NULL)) != IOTHUB_CLIENT_OK))
+            else if (((result = PnpBridgeClient_SendTelemetry(ph->s_ClientHandle, ph->s_ComponentName.c_str(),
+                        telemetryMessage)) != IOTHUB_CLIENT_OK))
             {
-                LogError("Mqtt Pnp Component: IoTHub's client call to _SendEventAsync failed, error=%d", result);
+                LogError("Mqtt Pnp Component: PnpBridgeClient_SendTelemetry failed, error=%d", result);
             }
             else
             {
                 LogInfo("Mqtt Pnp Component: Reported telemetry %s with parameters %s", tname, out);
             }
 
-            IoTHubMessage_Destroy(messageHandle);
             json_free_serialized_string(out);
             if (telemetryMessage)
             {
@@ -11,8 +11,26 @@
 #include <map>
 #include <atomic>
 #include <thread>
+
+#ifdef WIN32
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "mqtt_manager.hpp"
 
+// How often the reactor services an idle connection so the MQTT client can
+// send keep-alive pings and time out operations. Well below keepAliveInterval.
+#define MQTT_KEEP_ALIVE_TIMER_MS 1000
+
+// How long Connect waits for the broker's CONNACK
+#define MQTT_CONNECT_TIMEOUT_SEC 30
+
 void
 MqttConnectionManager::Subscribe(
     const char*         Topic,
@@ -25,14 +43,19 @@ MqttConnectionManager::Subscribe(
 
     printf("mqtt-pnp: subscribing to MQTT topic %s\n", Topic);
 
+    std::unique_lock<std::recursive_mutex> lock(s_ClientLock);
     if (mqtt_client_subscribe(s_MqttClientHandle, GetNextPacketId(), subscribe, 1) != 0) {
         printf("mqtt-pnp: MQTT subscribe failed\n");
+        lock.unlock();
         Disconnect();
         throw std::invalid_argument("Problem subscribing to MQTT channel");
     }
 
     // Add to mapping
     s_Topics.insert(std::pair<std::string, MqttProtocolHandler*>(std::string(Topic), ProtocolHandler));
+    lock.unlock();
+
+    MqttReactor::Instance().Wake(this);
 }
 
 uint16_t
@@ -62,13 +85,20 @@ MqttConnectionManager::Publish(
         throw std::runtime_error("Couldn't allocate MQTT publish message");
     }
 
-     if (mqtt_client_publish(s_MqttClientHandle, msg)) {
+    std::unique_lock<std::recursive_mutex> lock(s_ClientLock);
+    if (mqtt_client_publish(s_MqttClientHandle, msg)) {
         mqttmessage_destroy(msg);
+        lock.unlock();
         Disconnect();
         throw std::invalid_argument("Error publishing MQTT message");
     } else {
         mqttmessage_destroy(msg);
     }
+    lock.unlock();
+
+    // Let the reactor flush anything the socket could not take immediately
+    // and pick up the acknowledgement flow for this message.
+    MqttReactor::Instance().Wake(this);
 
 }
 
@@ -87,7 +117,12 @@ MqttConnectionManager::Connect(
     mqtt_options.useCleanSession = true;
     mqtt_options.qualityOfServiceValue = DELIVER_AT_MOST_ONCE;
     // todo: port, qos
-    SOCKETIO_CONFIG socket_config = { Server, Port, NULL };
+
+    // The socket is opened here rather than by socketio so that the reactor can
+    // wait on it. socketio treats it as an already connected socket and takes
+    // ownership of it.
+    MQTT_REACTOR_SOCKET socket = OpenSocket(Server, Port);
+    SOCKETIO_CONFIG socket_config = { Server, Port, &socket };
 
     s_MqttClientHandle =
         mqtt_client_init(
@@ -123,11 +158,21 @@ MqttConnectionManager::Connect(
         );
 
     if (!s_MqttClientHandle) {
+#ifdef WIN32
+        closesocket(socket);
+#else
+        close(socket);
+#endif
         throw std::runtime_error("Couldn't allocate new mqtt client handle");
     }
 
     s_XioHandle = xio_create(socketio_get_interface_description(), &socket_config);
     if (!s_XioHandle) {
+#ifdef WIN32
+        closesocket(socket);
+#else
+        close(socket);
+#endif
         mqtt_client_deinit(s_MqttClientHandle);
         s_MqttClientHandle = nullptr;
         throw std::runtime_error("Couldn't create xio handle");
@@ -144,26 +189,110 @@ MqttConnectionManager::Connect(
         throw std::invalid_argument("Could not connect to MQTT");
     }
 
-    // Wait for successful connection
-    s_ProcessOperation = true;
-    while (s_ProcessOperation) {
-        mqtt_client_dowork(s_MqttClientHandle);
+    // Hand the connection to the reactor and wait for it to process the CONNACK
+    {
+        std::lock_guard<std::mutex> lock(s_OperationLock);
+        s_ProcessOperation = true;
+        s_OperationSuccess = false;
     }
-    
+
+    // Marked before registering, the reactor may report an error as soon as it services the socket
+    s_Registered = true;
+    MqttReactor::Instance().Register(this, socket, std::chrono::milliseconds(MQTT_KEEP_ALIVE_TIMER_MS));
+
+    {
+        std::unique_lock<std::mutex> lock(s_OperationLock);
+        s_OperationCondition.wait_for(lock, std::chrono::seconds(MQTT_CONNECT_TIMEOUT_SEC),
+                                      [this]() { return !s_ProcessOperation; });
+    }
+
     if (!s_OperationSuccess) {
         Disconnect();
         throw std::invalid_argument("Problem getting connect ACK from MQTT");
     }
+}
+
+MQTT_REACTOR_SOCKET
+MqttConnectionManager::OpenSocket(
+    const char*         Server,
+    int                 Port
+)
+{
+    struct addrinfo hints = { 0 };
+    struct addrinfo* addresses = nullptr;
+    char portString[16];
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    snprintf(portString, sizeof(portString), "%d", Port);
+
+    if (Server == nullptr || getaddrinfo(Server, portString, &hints, &addresses) != 0) {
+        throw std::invalid_argument("Couldn't resolve MQTT server address");
+    }
 
-    // Start worker thread
-    s_RunWorker = true;
-    s_WorkerThread = std::thread([&]()
-    {
-        while (s_RunWorker) {
-            mqtt_client_dowork(s_MqttClientHandle);
+#ifdef WIN32
+    MQTT_REACTOR_SOCKET socket = INVALID_SOCKET;
+#else
+    MQTT_REACTOR_SOCKET socket = -1;
+#endif
+
+    for (struct addrinfo* address = addresses; address != nullptr; address = address->ai_next) {
+        socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+#ifdef WIN32
+        if (socket == INVALID_SOCKET) {
+            continue;
+        }
+        if (connect(socket, address->ai_addr, (int) address->ai_addrlen) == 0) {
+            break;
+        }
+        closesocket(socket);
+        socket = INVALID_SOCKET;
+#else
+        if (socket < 0) {
+            continue;
         }
-    });
-    // s_WorkerThread.detach();
+        if (connect(socket, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+        close(socket);
+        socket = -1;
+#endif
+    }
+
+    freeaddrinfo(addresses);
+
+    // The reactor only calls into socketio when there is data, so reads must never block
+#ifdef WIN32
+    u_long nonBlocking = 1;
+    if (socket == INVALID_SOCKET) {
+        throw std::invalid_argument("Couldn't connect to MQTT server");
+    }
+    if (ioctlsocket(socket, FIONBIO, &nonBlocking) != 0) {
+        closesocket(socket);
+        throw std::runtime_error("Couldn't make MQTT socket non-blocking");
+    }
+#else
+    if (socket < 0) {
+        throw std::invalid_argument("Couldn't connect to MQTT server");
+    }
+    int flags = fcntl(socket, F_GETFL, 0);
+    if (flags < 0 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) != 0) {
+        close(socket);
+        throw std::runtime_error("Couldn't make MQTT socket non-blocking");
+    }
+#endif
+
+    return socket;
+}
+
+void
+MqttConnectionManager::DoWork()
+{
+    std::lock_guard<std::recursive_mutex> lock(s_ClientLock);
+    if (s_MqttClientHandle) {
+        mqtt_client_dowork(s_MqttClientHandle);
+    }
 }
 
 void
@@ -177,6 +306,7 @@ MqttConnectionManager::OnRecv(
 
     auto topic_str = std::string(topicName);
 
+    // Runs on the reactor thread under s_ClientLock, which also guards s_Topics
     auto iterator = s_Topics.find(topic_str);
     if (iterator != s_Topics.end()) {
         handler_for_topic = iterator->second;
@@ -201,12 +331,16 @@ MqttConnectionManager::OnComplete(
     switch (Result) {
     case MQTT_CLIENT_ON_CONNACK:
         printf("mqtt-pnp: got MQTT CONNACK\n");
-        s_OperationSuccess = true;
-        s_ProcessOperation = false;
+        {
+            std::lock_guard<std::mutex> lock(s_OperationLock);
+            s_OperationSuccess = true;
+            s_ProcessOperation = false;
+        }
+        s_OperationCondition.notify_all();
         break;
     case MQTT_CLIENT_ON_DISCONNECT:
         printf("mqtt-pnp: got MQTT DISCONNECT\n");
-        // todo stop read thread here
+        StopServicing();
         break;
     default:
         break;
@@ -220,18 +354,38 @@ MqttConnectionManager::OnError(
 )
 {
     printf("mqtt-pnp: MQTT error callback\n");
-    s_OperationSuccess = false;
-    s_ProcessOperation = false;
+
+    // The socket stays open after an error and would keep the reactor waking up
+    StopServicing();
+
+    {
+        std::lock_guard<std::mutex> lock(s_OperationLock);
+        s_OperationSuccess = false;
+        s_ProcessOperation = false;
+    }
+    s_OperationCondition.notify_all();
+}
+
+void
+MqttConnectionManager::StopServicing()
+{
+    if (s_Registered.exchange(false)) {
+        MqttReactor::Instance().Retire(this);
+    }
 }
 
 void
 MqttConnectionManager::Disconnect()
 {
     printf("mqtt-pnp: disconnect request\n");
-    bool workerRunning = s_RunWorker;
-    if (s_RunWorker) {
-        s_RunWorker = false;
-    }
+
+    // Take the connection off the reactor before the socket is closed; once
+    // unregistered the reactor no longer calls DoWork for this connection. This
+    // is done even if a callback already retired it, the reactor may not have yet.
+    s_Registered = false;
+    MqttReactor::Instance().Unregister(this);
+
+    std::lock_guard<std::recursive_mutex> lock(s_ClientLock);
     mqtt_client_disconnect(s_MqttClientHandle,
                            [](void* Context)
                             {
@@ -239,8 +393,4 @@ MqttConnectionManager::Disconnect()
                                 xio_close(mcm->s_XioHandle, [](void* /*Context*/) { }, Context);
                             },
                             this);
-
-    if (workerRunning) {
-        s_WorkerThread.join();
-    }
 }
\ No newline at end of file
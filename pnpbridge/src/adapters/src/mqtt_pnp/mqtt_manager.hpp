@@ -1,7 +1,10 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 #pragma once
+#include <mutex>
+#include <condition_variable>
 #include "mqtt_protocol_handler.hpp"
+#include "mqtt_reactor.hpp"
 class MqttConnectionManager {
 public:
     void
@@ -26,6 +29,11 @@ public:
     void
     Disconnect();
 
+    // Called by the MQTT reactor thread when the socket is readable, work was
+    // requested through MqttReactor::Wake or the keep-alive timer expired.
+    void
+    DoWork();
+
 private:
     MQTT_CLIENT_HANDLE      s_MqttClientHandle = nullptr;
     XIO_HANDLE              s_XioHandle = nullptr;
@@ -33,8 +41,23 @@ private:
     bool                    s_OperationSuccess = false;
     std::atomic<uint16_t>   s_NextPacketId{0};
     std::map<std::string, MqttProtocolHandler*> s_Topics;
-    std::thread             s_WorkerThread;
-    bool                    s_RunWorker = true;
+    std::atomic<bool>       s_Registered{false};
+
+    // Serializes calls into the MQTT client between the reactor thread and
+    // callers of Subscribe/Publish/Disconnect. Recursive because MQTT callbacks
+    // run under it and may publish or disconnect.
+    std::recursive_mutex    s_ClientLock;
+
+    // Used by Connect to wait for the reactor to process the CONNACK
+    std::mutex              s_OperationLock;
+    std::condition_variable s_OperationCondition;
+
+    static
+    MQTT_REACTOR_SOCKET
+    OpenSocket(
+        const char*         Server,
+        int                 Port
+    );
 
     void
     OnRecv(
@@ -54,6 +77,10 @@ private:
         MQTT_CLIENT_EVENT_ERROR     Error
     );
 
+    // Takes the connection off the reactor from an MQTT callback, once
+    void
+    StopServicing();
+
     uint16_t
     GetNextPacketId();
 };
\ No newline at end of file
@@ -0,0 +1,339 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <cerrno>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+
+#ifndef WIN32
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+#include "azure_umqtt_c/mqtt_client.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "mqtt_manager.hpp"
+#include "mqtt_reactor.hpp"
+
+// Maximum number of socket events handled per wakeup
+#define MQTT_REACTOR_MAX_EVENTS 64
+
+#ifdef WIN32
+// WSAPoll cannot wait on a wake event, so on Windows the wait is bounded
+// to pick up publish requests made from other threads promptly.
+#define MQTT_REACTOR_MAX_WAIT_MS 50
+#endif
+
+MqttReactor&
+MqttReactor::Instance()
+{
+    static MqttReactor reactor;
+    return reactor;
+}
+
+MqttReactor::MqttReactor()
+{
+#ifndef WIN32
+    s_EpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (s_EpollFd < 0) {
+        throw std::runtime_error("Couldn't create MQTT reactor epoll instance");
+    }
+
+    s_WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s_WakeFd < 0) {
+        close(s_EpollFd);
+        throw std::runtime_error("Couldn't create MQTT reactor wake event");
+    }
+
+    struct epoll_event event = { 0 };
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(s_EpollFd, EPOLL_CTL_ADD, s_WakeFd, &event) != 0) {
+        close(s_WakeFd);
+        close(s_EpollFd);
+        throw std::runtime_error("Couldn't register MQTT reactor wake event");
+    }
+#endif
+}
+
+MqttReactor::~MqttReactor()
+{
+    {
+        std::lock_guard<std::recursive_mutex> lock(s_Lock);
+        s_Connections.clear();
+        s_Running = false;
+    }
+
+    Signal();
+    if (s_Thread.joinable()) {
+        s_Thread.join();
+    }
+
+#ifndef WIN32
+    close(s_WakeFd);
+    close(s_EpollFd);
+#endif
+}
+
+void
+MqttReactor::Register(
+    MqttConnectionManager*  Connection,
+    MQTT_REACTOR_SOCKET     Socket,
+    std::chrono::milliseconds
+                            TimerInterval
+)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Lock);
+
+#ifndef WIN32
+    struct epoll_event event = { 0 };
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.ptr = Connection;
+    if (epoll_ctl(s_EpollFd, EPOLL_CTL_ADD, Socket, &event) != 0) {
+        throw std::runtime_error("Couldn't add MQTT socket to reactor");
+    }
+#endif
+
+    Registration registration;
+    registration.Socket = Socket;
+    registration.TimerInterval = TimerInterval;
+    registration.NextTimer = std::chrono::steady_clock::now();
+    registration.WorkPending = true;
+    s_Connections[Connection] = registration;
+
+    StartLocked();
+    Signal();
+}
+
+void
+MqttReactor::Unregister(
+    MqttConnectionManager*  Connection
+)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Lock);
+
+    // A pending retirement must not outlive the connection
+    {
+        std::lock_guard<std::mutex> retireLock(s_RetireLock);
+        s_Retired.erase(std::remove(s_Retired.begin(), s_Retired.end(), Connection), s_Retired.end());
+    }
+
+    auto iterator = s_Connections.find(Connection);
+    if (iterator == s_Connections.end()) {
+        return;
+    }
+
+#ifndef WIN32
+    epoll_ctl(s_EpollFd, EPOLL_CTL_DEL, iterator->second.Socket, nullptr);
+#endif
+    s_Connections.erase(iterator);
+
+    // The thread exits on its own once there is nothing left to service;
+    // it is joined the next time a connection is registered.
+    if (s_Connections.empty()) {
+        s_Running = false;
+        Signal();
+    }
+}
+
+void
+MqttReactor::Retire(
+    MqttConnectionManager*  Connection
+)
+{
+    {
+        std::lock_guard<std::mutex> lock(s_RetireLock);
+        s_Retired.push_back(Connection);
+    }
+
+    Signal();
+}
+
+void
+MqttReactor::UnregisterRetiredLocked()
+{
+    std::vector<MqttConnectionManager*> retired;
+    {
+        std::lock_guard<std::mutex> lock(s_RetireLock);
+        retired.swap(s_Retired);
+    }
+
+    for (auto connection : retired) {
+        Unregister(connection);
+    }
+}
+
+void
+MqttReactor::Wake(
+    MqttConnectionManager*  Connection
+)
+{
+    {
+        std::lock_guard<std::recursive_mutex> lock(s_Lock);
+        auto iterator = s_Connections.find(Connection);
+        if (iterator == s_Connections.end()) {
+            return;
+        }
+        iterator->second.WorkPending = true;
+    }
+
+    Signal();
+}
+
+void
+MqttReactor::StartLocked()
+{
+    s_Running = true;
+
+    // A thread that has not yet observed the stop request simply keeps going
+    if (s_ThreadActive) {
+        return;
+    }
+
+    if (s_Thread.joinable()) {
+        s_Thread.join();
+    }
+
+    s_ThreadActive = true;
+    s_Thread = std::thread([this]() { Run(); });
+}
+
+void
+MqttReactor::Signal()
+{
+#ifndef WIN32
+    uint64_t one = 1;
+    if (write(s_WakeFd, &one, sizeof(one)) < 0) {
+        // The counter is already non-zero, the reactor will wake anyway
+    }
+#endif
+}
+
+int
+MqttReactor::GetWaitTimeoutLocked()
+{
+    auto now = std::chrono::steady_clock::now();
+    auto timeout = std::chrono::milliseconds::max();
+
+    for (auto& connection : s_Connections) {
+        if (connection.second.WorkPending) {
+            return 0;
+        }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(connection.second.NextTimer - now);
+        timeout = std::min(timeout, std::max(remaining, std::chrono::milliseconds(0)));
+    }
+
+#ifdef WIN32
+    timeout = std::min(timeout, std::chrono::milliseconds(MQTT_REACTOR_MAX_WAIT_MS));
+#endif
+
+    return (timeout == std::chrono::milliseconds::max()) ? -1 : (int) timeout.count();
+}
+
+void
+MqttReactor::Run()
+{
+    LogInfo("mqtt-pnp: reactor thread started");
+
+    for (;;) {
+        int timeout;
+        {
+            // The decision to exit is made under the lock so that a concurrent
+            // Register either keeps this thread alive or starts a new one.
+            std::lock_guard<std::recursive_mutex> lock(s_Lock);
+
+            // A socket left open after an error or hangup would otherwise keep the
+            // level-triggered wait returning right away
+            UnregisterRetiredLocked();
+            if (!s_Running) {
+                s_ThreadActive = false;
+                break;
+            }
+            timeout = GetWaitTimeoutLocked();
+        }
+
+#ifndef WIN32
+        struct epoll_event events[MQTT_REACTOR_MAX_EVENTS];
+        int count = epoll_wait(s_EpollFd, events, MQTT_REACTOR_MAX_EVENTS, timeout);
+        if (count < 0 && errno != EINTR) {
+            LogError("mqtt-pnp: reactor epoll_wait failed with %d", errno);
+        }
+#else
+        std::vector<WSAPOLLFD> pollFds;
+        std::vector<MqttConnectionManager*> pollConnections;
+        {
+            std::lock_guard<std::recursive_mutex> lock(s_Lock);
+            for (auto& connection : s_Connections) {
+                WSAPOLLFD pollFd = { 0 };
+                pollFd.fd = connection.second.Socket;
+                pollFd.events = POLLRDNORM;
+                pollFds.push_back(pollFd);
+                pollConnections.push_back(connection.first);
+            }
+        }
+
+        int count = 0;
+        if (pollFds.empty()) {
+            Sleep(timeout < 0 ? MQTT_REACTOR_MAX_WAIT_MS : timeout);
+        } else if ((count = WSAPoll(pollFds.data(), (ULONG) pollFds.size(), timeout)) == SOCKET_ERROR) {
+            LogError("mqtt-pnp: reactor WSAPoll failed with %d", WSAGetLastError());
+            count = 0;
+        }
+#endif
+
+        std::lock_guard<std::recursive_mutex> lock(s_Lock);
+
+        // Mark every connection whose socket has something for us
+#ifndef WIN32
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == nullptr) {
+                uint64_t value;
+                if (read(s_WakeFd, &value, sizeof(value)) < 0) {
+                    // Spurious wakeup, nothing to drain
+                }
+                continue;
+            }
+
+            auto iterator = s_Connections.find(static_cast<MqttConnectionManager*>(events[i].data.ptr));
+            if (iterator != s_Connections.end()) {
+                iterator->second.WorkPending = true;
+            }
+        }
+#else
+        for (size_t i = 0; count > 0 && i < pollFds.size(); i++) {
+            if (pollFds[i].revents != 0) {
+                auto iterator = s_Connections.find(pollConnections[i]);
+                if (iterator != s_Connections.end()) {
+                    iterator->second.WorkPending = true;
+                }
+            }
+        }
+#endif
+
+        // Service ready connections and the ones whose timer expired. DoWork may
+        // unregister connections, so collect them first and look each one up again.
+        auto now = std::chrono::steady_clock::now();
+        std::vector<MqttConnectionManager*> ready;
+        for (auto& connection : s_Connections) {
+            if (connection.second.WorkPending || connection.second.NextTimer <= now) {
+                ready.push_back(connection.first);
+            }
+        }
+
+        for (auto connection : ready) {
+            auto iterator = s_Connections.find(connection);
+            if (iterator == s_Connections.end()) {
+                continue;
+            }
+
+            iterator->second.WorkPending = false;
+            iterator->second.NextTimer = now + iterator->second.TimerInterval;
+            connection->DoWork();
+        }
+    }
+
+    LogInfo("mqtt-pnp: reactor thread stopped");
+}
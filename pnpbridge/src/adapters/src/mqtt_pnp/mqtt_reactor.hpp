@@ -0,0 +1,112 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+#ifdef WIN32
+#include <winsock2.h>
+typedef SOCKET MQTT_REACTOR_SOCKET;
+#else
+typedef int MQTT_REACTOR_SOCKET;
+#endif
+
+class MqttConnectionManager;
+
+// The MQTT reactor drives every MqttConnectionManager in the process from a single
+// event loop thread. The thread sleeps until one of the broker sockets is readable,
+// a connection asks to be serviced (for example after a publish) or a connection's
+// keep-alive timer expires, and only then calls into the MQTT client.
+class MqttReactor {
+public:
+    static
+    MqttReactor&
+    Instance();
+
+    // Starts servicing Connection. Socket must stay open until Unregister returns.
+    void
+    Register(
+        MqttConnectionManager*  Connection,
+        MQTT_REACTOR_SOCKET     Socket,
+        std::chrono::milliseconds
+                                TimerInterval
+    );
+
+    // Stops servicing Connection. When this returns the reactor is not, and will not
+    // again be, inside Connection's DoWork.
+    void
+    Unregister(
+        MqttConnectionManager*  Connection
+    );
+
+    // Stops servicing Connection from an MQTT callback, which may run under a client lock
+    // the reactor thread takes while holding its own. The reactor thread unregisters the
+    // connection before it next waits for its socket.
+    void
+    Retire(
+        MqttConnectionManager*  Connection
+    );
+
+    // Asks the reactor to service Connection as soon as possible.
+    void
+    Wake(
+        MqttConnectionManager*  Connection
+    );
+
+    ~MqttReactor();
+
+private:
+    MqttReactor();
+    MqttReactor(const MqttReactor&) = delete;
+    MqttReactor& operator=(const MqttReactor&) = delete;
+
+    struct Registration {
+        MQTT_REACTOR_SOCKET     Socket;
+        std::chrono::milliseconds
+                                TimerInterval;
+        std::chrono::steady_clock::time_point
+                                NextTimer;
+        bool                    WorkPending;
+    };
+
+    // Held by the reactor thread while it calls into a connection so that Unregister
+    // cannot return while a connection is being serviced. Recursive because MQTT
+    // callbacks may disconnect their own connection from the reactor thread.
+    std::recursive_mutex        s_Lock;
+    std::map<MqttConnectionManager*, Registration>
+                                s_Connections;
+    std::thread                 s_Thread;
+    std::atomic<bool>           s_Running{false};
+    bool                        s_ThreadActive = false;
+
+    // Connections to unregister, guarded by a lock of their own that is never held
+    // while taking another
+    std::mutex                  s_RetireLock;
+    std::vector<MqttConnectionManager*>
+                                s_Retired;
+
+#ifndef WIN32
+    int                         s_EpollFd = -1;
+    int                         s_WakeFd = -1;
+#endif
+
+    void
+    Run();
+
+    void
+    StartLocked();
+
+    void
+    UnregisterRetiredLocked();
+
+    void
+    Signal();
+
+    int
+    GetWaitTimeoutLocked();
+};
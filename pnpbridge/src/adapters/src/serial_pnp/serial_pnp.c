@@ -8,6 +8,7 @@
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/tickcounter.h"
 
 // TODO: Fix this missing reference
 #ifndef AZURE_UNREFERENCED_PARAMETER
@@ -26,150 +27,240 @@ typedef int HANDLE;
 typedef short USHORT;
 typedef uint16_t UINT16;
 
+#include <ctype.h>
 #include <errno.h>
 #include <string.h>
 #include <fcntl.h>
 
+#include <poll.h>
 #include <termios.h>
 #include <unistd.h>
+#include <sys/uio.h>
 #endif
 
 #include "parson.h"
 
 #include "serial_pnp.h"
 
+static void SerialPnp_FailOutstandingCommands(
+    PSERIAL_DEVICE_CONTEXT serialDevice);
+
+static void SerialPnp_CompleteCommand(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    byte* packet,
+    DWORD length);
+
+int SerialPnp_GetListCount(
+    SINGLYLINKEDLIST_HANDLE list);
+
+static IOTHUB_CLIENT_RESULT SerialPnp_DescriptorHashRequest(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    uint32_t* hash);
+
+static IOTHUB_CLIENT_RESULT SerialPnp_LoadCachedDescriptor(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    uint32_t hash,
+    byte** desc,
+    DWORD* length);
+
+static void SerialPnp_StoreCachedDescriptor(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    uint32_t hash,
+    const byte* desc,
+    DWORD length);
+
+// Hands a received frame to the command waiting for it, or handles it as an event. Frames are decoded in place,
+// only command responses, which the command thread reads after the receiver has moved on, are copied.
+static void SerialPnp_DispatchPacket(
+    PSERIAL_DEVICE_CONTEXT deviceContext,
+    const byte* packet,
+    DWORD length)
+{
+    if (SERIALPNP_PACKET_TYPE_COMMAND_RESPONSE == packet[SERIALPNP_PACKET_PACKET_TYPE_OFFSET])
+    {
+        byte* response = malloc(length);
+        if (NULL == response)
+        {
+            LogError("Error out of memory");
+            return;
+        }
+        memcpy(response, packet, length);
+        SerialPnp_CompleteCommand(deviceContext, response, length);
+    }
+    else
+    {
+        SerialPnp_UnsolicitedPacket(deviceContext, (byte*)packet, length);
+    }
+}
+
 int SerialPnp_UartReceiver(
     void* context)
 {
-    int result = 0;
     PSERIAL_DEVICE_CONTEXT deviceContext = (PSERIAL_DEVICE_CONTEXT)context;
+    const byte* packet = NULL;
+    DWORD length = 0;
 
-    while (result >= 0) {
-        byte* desc = NULL;
-        DWORD length;
-
-        SerialPnp_RxPacket(deviceContext, &desc, &length, 0x00);
-        if (desc != NULL)
-        {
-            SerialPnp_UnsolicitedPacket(deviceContext, desc, length);
-            free(desc);
-        }
+    // Runs until the port is closed or the device goes away
+    while (IOTHUB_CLIENT_OK == SerialPnp_ReadPacket(deviceContext, &packet, &length, 0x00, 0))
+    {
+        SerialPnp_DispatchPacket(deviceContext, packet, length);
     }
 
+    SerialPnp_FailOutstandingCommands(deviceContext);
     return IOTHUB_CLIENT_OK;
 }
 
-IOTHUB_CLIENT_RESULT SerialPnp_TxPacket(
-    PSERIAL_DEVICE_CONTEXT serialDevice,
-    byte* OutPacket,
-    int Length)
+#ifndef WIN32
+static void SerialPnp_DispatchPackets(
+    PSERIAL_DEVICE_CONTEXT deviceContext)
 {
-    DWORD write_size = 0;
-    int error = 0;
+    const byte* packet = NULL;
+    size_t packetLength = 0;
+    SERIALPNP_RX_DECODE_RESULT decodeResult;
 
-    DWORD txLength = 1 + Length; // "+1" for start of frame byte
-    // First iterate through and find out our new length
-    for (int i = 0; i < Length; i++)
+    while (SERIALPNP_RX_DECODE_NEED_MORE != (decodeResult = SerialPnp_RxDecoder_Decode(&deviceContext->RxDecoder, 0x00, &packet, &packetLength)))
     {
-        if ((SERIALPNP_START_OF_FRAME_BYTE == OutPacket[i]) || (SERIALPNP_ESCAPE_BYTE == OutPacket[i]))
+        if (SERIALPNP_RX_DECODE_OVERFLOW == decodeResult)
         {
-            txLength++;
+            LogError("Filled Rx buffer. Protocol is bad.");
+            continue;
         }
+        SerialPnp_DispatchPacket(deviceContext, packet, (DWORD)packetLength);
     }
+}
+
+// Reactor callback, in place of SerialPnp_UartReceiver: reads what the port has available and dispatches the
+// frames it completes
+static bool SerialPnp_OnPortReadable(
+    void* context)
+{
+    PSERIAL_DEVICE_CONTEXT deviceContext = (PSERIAL_DEVICE_CONTEXT)context;
+    size_t chunkSize = 0;
+
+    // Frames read along with the descriptor response are still in the decoder on the first call
+    SerialPnp_DispatchPackets(deviceContext);
 
-    // Now construct outgoing buffer
-    byte* SerialPnp_TxPacket = malloc(sizeof(byte) * txLength);
-    if (!SerialPnp_TxPacket)
+    byte* chunk = SerialPnp_RxDecoder_GetChunk(&deviceContext->RxDecoder, &chunkSize);
+    ssize_t bytesRead = read(deviceContext->hSerial, (void*)chunk, chunkSize);
+    if (bytesRead < 0 && (EINTR == errno || EAGAIN == errno))
     {
-        LogError("Error out of memory");
-        return IOTHUB_CLIENT_ERROR;
+        return true;
     }
-    txLength = 1;
-    SerialPnp_TxPacket[0] = 0x5A; // Start of frame
-    for (int i = 0; i < Length; i++)
+    if (bytesRead <= 0)
     {
-        // Escape these bytes where necessary
-        if ((SERIALPNP_START_OF_FRAME_BYTE == OutPacket[i]) || (SERIALPNP_ESCAPE_BYTE == OutPacket[i]))
-        {
-            SerialPnp_TxPacket[txLength++] = SERIALPNP_ESCAPE_BYTE;
-            SerialPnp_TxPacket[txLength++] = (byte)(OutPacket[i] - 1);
-        }
-        else
-        {
-            SerialPnp_TxPacket[txLength++] = OutPacket[i];
-        }
+        // 0 is a hang up, the device will not send anything more
+        LogError("read failed: %d", (0 == bytesRead) ? 0 : errno);
+        PnpBridgeMetrics_AddCounter(deviceContext->ComponentName, PNP_METRIC_DEVICE_IO_ERRORS, 1);
+        SerialPnp_FailOutstandingCommands(deviceContext);
+        return false;
     }
 
+    SerialPnp_RxDecoder_SetChunkLength(&deviceContext->RxDecoder, (size_t)bytesRead);
+    SerialPnp_DispatchPackets(deviceContext);
+    return true;
+}
+#endif
 
-#ifdef WIN32
-    if (!WriteFile(serialDevice->hSerial, SerialPnp_TxPacket, txLength, &write_size, &serialDevice->osWriter))
+IOTHUB_CLIENT_RESULT SerialPnp_TxPacket(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    byte* OutPacket,
+    int Length)
+{
+    DWORD write_size = 0;
+    DWORD txLength = 0;
+    size_t consumed = 0;
+    int error = 0;
+
+    // The frame is escaped and written a piece at a time, without copying the packet where it needs no escaping
+    do
     {
-        // Write returned immediately, but is asynchronous
-        if (ERROR_IO_PENDING != (error = GetLastError()))
+#ifdef WIN32
+        byte txBuffer[SERIALPNP_TX_CHUNK_SIZE];
+        txLength = 0;
+        if (0 == consumed)
         {
-            // Write returned actual error and not just pending
-            LogError("write failed: %d", error);
-            return IOTHUB_CLIENT_ERROR;
+            txBuffer[txLength++] = SERIALPNP_START_OF_FRAME_BYTE;
         }
-        else
+        txLength += (DWORD)SerialPnp_TxEncoder_Escape(OutPacket, (size_t)Length, &consumed, txBuffer + txLength, sizeof(txBuffer) - txLength);
+
+        if (!WriteFile(serialDevice->hSerial, txBuffer, txLength, &write_size, &serialDevice->osWriter))
         {
-            if (!GetOverlappedResult(serialDevice->hSerial, &serialDevice->osWriter, &write_size, TRUE))
+            // Write returned immediately, but is asynchronous
+            if (ERROR_IO_PENDING != (error = GetLastError()))
             {
-                error = GetLastError();
+                // Write returned actual error and not just pending
                 LogError("write failed: %d", error);
+                PnpBridgeMetrics_AddCounter(serialDevice->ComponentName, PNP_METRIC_DEVICE_IO_ERRORS, 1);
                 return IOTHUB_CLIENT_ERROR;
             }
+            else
+            {
+                if (!GetOverlappedResult(serialDevice->hSerial, &serialDevice->osWriter, &write_size, TRUE))
+                {
+                    error = GetLastError();
+                    LogError("write failed: %d", error);
+                    PnpBridgeMetrics_AddCounter(serialDevice->ComponentName, PNP_METRIC_DEVICE_IO_ERRORS, 1);
+                    return IOTHUB_CLIENT_ERROR;
+                }
+            }
         }
-    }
 #else
-    if ((write_size = write(serialDevice->hSerial, (const void *)SerialPnp_TxPacket, (size_t)txLength)) == -1)
-    {
-        LogError("write failed");
-        error = -1;
-    }
-#endif
-
-    if (write_size != txLength)
-    {
-        LogError("Timeout while writing");
-        return IOTHUB_CLIENT_INDEFINITE_TIME;
-    }
-    free(SerialPnp_TxPacket);
-    return IOTHUB_CLIENT_OK;
-}
+        static const byte startOfFrame = SERIALPNP_START_OF_FRAME_BYTE;
+        struct iovec segments[SERIALPNP_TX_SEGMENT_COUNT];
+        int segmentCount = 0;
+        txLength = 0;
+        if (0 == consumed)
+        {
+            segments[segmentCount].iov_base = (void*)&startOfFrame;
+            segments[segmentCount++].iov_len = 1;
+            txLength++;
+        }
 
-const EventDefinition* SerialPnp_LookupEvent(
-    SINGLYLINKEDLIST_HANDLE interfaceDefinitions,
-    char* EventName,
-    int InterfaceId)
-{
-    const InterfaceDefinition* interfaceDef;
-    LIST_ITEM_HANDLE interfaceDefHandle = singlylinkedlist_get_head_item(interfaceDefinitions);
+        // Runs that need no escaping go out straight from the packet, escaped bytes from a constant sequence
+        while (consumed < (size_t)Length && segmentCount < SERIALPNP_TX_SEGMENT_COUNT)
+        {
+            size_t run = SerialPnp_TxEncoder_GetRun(OutPacket + consumed, (size_t)Length - consumed);
+            if (0 == run)
+            {
+                segments[segmentCount].iov_base = (void*)SerialPnp_TxEncoder_GetEscapeSequence(OutPacket[consumed]);
+                segments[segmentCount++].iov_len = SERIALPNP_ESCAPE_SEQUENCE_LENGTH;
+                txLength += SERIALPNP_ESCAPE_SEQUENCE_LENGTH;
+                consumed++;
+            }
+            else
+            {
+                segments[segmentCount].iov_base = OutPacket + consumed;
+                segments[segmentCount++].iov_len = run;
+                txLength += (DWORD)run;
+                consumed += run;
+            }
+        }
 
-    for (int i = 0; i < InterfaceId - 1; i++)
-    {
-        if (NULL == interfaceDefHandle)
+        ssize_t written = writev(serialDevice->hSerial, segments, segmentCount);
+        if (written < 0)
         {
-            return NULL;
+            LogError("write failed: %d", errno);
+            error = -1;
         }
-        interfaceDefHandle = singlylinkedlist_get_next_item(interfaceDefHandle);
-    }
-    interfaceDef = singlylinkedlist_item_get_value(interfaceDefHandle);
+        write_size = (written < 0) ? 0 : (DWORD)written;
+#endif
 
-    SINGLYLINKEDLIST_HANDLE events = interfaceDef->Events;
-    LIST_ITEM_HANDLE eventDef = singlylinkedlist_get_head_item(events);
-    const EventDefinition* ev;
-    while (NULL != eventDef)
-    {
-        ev = singlylinkedlist_item_get_value(eventDef);
-        if (strcmp(ev->defintion.Name, EventName) == 0)
+        if (write_size != txLength)
         {
-            return ev;
+            LogError("Timeout while writing");
+            PnpBridgeMetrics_AddCounter(serialDevice->ComponentName, PNP_METRIC_DEVICE_IO_ERRORS, 1);
+            return IOTHUB_CLIENT_INDEFINITE_TIME;
         }
-        eventDef = singlylinkedlist_get_next_item(eventDef);
-    }
+    } while (consumed < (size_t)Length);
+
+    return IOTHUB_CLIENT_OK;
+}
 
-    return NULL;
+// Interface numbers in packets count from 1. 0 also stands for the first interface.
+static size_t SerialPnp_GetInterfaceIndex(
+    int InterfaceId)
+{
+    return (InterfaceId > 0) ? (size_t)(InterfaceId - 1) : 0;
 }
 
 byte* SerialPnp_StringSchemaToBinary(
@@ -179,96 +270,277 @@ byte* SerialPnp_StringSchemaToBinary(
 {
     byte* bd = NULL;
     char* data = (char*)buffer;
+    size_t size = (String == schema) ? strlen(data) : SerialPnp_GetSchemaSize(schema);
 
-    if ((Float == schema) || (Int == schema))
+    if ((Invalid == schema) || (String < schema))
     {
-        bd = malloc(sizeof(byte) * 4);
-        if (!bd)
-        {
-            LogError("Error out of memory");
-            return NULL;
-        }
-        *length = 4;
+        LogError("Unknown schema");
+        return NULL;
+    }
 
-        if (schema == Float)
-        {
-            float x = 0;
-            x = (float)atof(data);
-            memcpy(bd, &x, sizeof(float));
-        }
-        else if (schema == Int)
-        {
-            int x;
-            x = atoi(data);
-            memcpy(bd, &x, sizeof(int));
-        }
+    // A String value may be empty, the allocation never is
+    bd = malloc(size + 1);
+    if (!bd)
+    {
+        LogError("Error out of memory");
+        return NULL;
+    }
+    *length = (int)size;
+
+    // Values go on the wire LSB first, as the hosts the bridge runs on store them
+    if (Byte == schema)
+    {
+        bd[0] = (byte)atoi(data);
     }
     else if (Boolean == schema)
     {
-        bd = malloc(sizeof(byte) * 1);
-        if (!bd)
-        {
-            LogError("Error out of memory");
-            return NULL;
-        }
-
-        *length = 1;
-        if (strcmp(data, "true"))
+        if ((0 == strcmp(data, "true")) || (0 == strcmp(data, "1")))
         {
             bd[0] = 1;
         }
-        else if (strcmp(data, "false"))
+        else if ((0 == strcmp(data, "false")) || (0 == strcmp(data, "0")))
         {
             bd[0] = 0;
         }
         else
         {
+            LogError("Invalid boolean value %s", data);
             free(bd);
             *length = 0;
             bd = NULL;
         }
     }
+    else if (Float == schema)
+    {
+        float x = (float)atof(data);
+        memcpy(bd, &x, sizeof(x));
+    }
+    else if (Double == schema)
+    {
+        double x = strtod(data, NULL);
+        memcpy(bd, &x, sizeof(x));
+    }
+    else if (Int == schema)
+    {
+        int32_t x = (int32_t)atoi(data);
+        memcpy(bd, &x, sizeof(x));
+    }
+    else if (Long == schema)
+    {
+        int64_t x = (int64_t)strtoll(data, NULL, 10);
+        memcpy(bd, &x, sizeof(x));
+    }
     else
     {
-        LogError("Unknown schema");
+        memcpy(bd, data, size);
     }
 
     return bd;
 }
 
+// SerialPnp_FormatValue formats a received value into buffer if it fits there, otherwise into an allocation.
+// Returns NULL on failure. The caller frees the result if it is not buffer.
+static char* SerialPnp_FormatValue(
+    Schema schema,
+    const byte* Data,
+    DWORD length,
+    char* buffer,
+    size_t bufferSize)
+{
+    size_t formattedLength = SerialPnp_GetFormattedLength(schema, length);
+    char* rxstrdata = buffer;
+
+    if (formattedLength > bufferSize)
+    {
+        rxstrdata = malloc(formattedLength);
+        if (!rxstrdata)
+        {
+            LogError("Error out of memory");
+            return NULL;
+        }
+    }
+
+    if (!SerialPnp_FormatBinarySchema(schema, Data, length, rxstrdata, formattedLength))
+    {
+        LogError("Unknown schema");
+        if (rxstrdata != buffer)
+        {
+            free(rxstrdata);
+        }
+        return NULL;
+    }
+
+    return rxstrdata;
+}
+
 char* SerialPnp_BinarySchemaToString(
     Schema schema,
     byte* Data,
-    byte length)
+    DWORD length)
+{
+    // Formatted straight into an allocation the caller owns
+    return SerialPnp_FormatValue(schema, Data, length, NULL, 0);
+}
+
+// SerialPnp_ParseNotification resolves the event or property a notification is about, by name or, when the
+// name length is 0, by its position in the interface descriptor. Returns false if the packet is too short;
+// *definition is NULL if the descriptor declares no such event or property.
+static bool SerialPnp_ParseNotification(
+    PSERIAL_DEVICE_CONTEXT device,
+    const byte* packet,
+    DWORD length,
+    SERIALPNP_DISPATCH_KIND kind,
+    const void** definition,
+    DWORD* dataOffset)
 {
-    const int MAXRXSTRLEN = 12; // longest case INT_MIN = -2147483648 (11 characters + 1)
-    char* rxstrdata = malloc(MAXRXSTRLEN);
-    if (!rxstrdata)
+    *definition = NULL;
+
+    if (length <= SERIALPNP_PACKET_NAME_OFFSET)
     {
-        LogError("Error out of memory");
-        return NULL;
+        return false;
     }
 
-    if ((Float == schema) && (4 == length))
+    byte rxInterfaceId = packet[SERIALPNP_PACKET_INTERFACE_NUMBER_OFFSET];
+    byte rxNameLength = packet[SERIALPNP_PACKET_NAME_LENGTH_OFFSET];
+
+    if (0 == rxNameLength)
     {
-        sprintf_s(rxstrdata, MAXRXSTRLEN, "%.6f", *((float*)Data));
+        *definition = SerialPnp_Dispatch_FindByIndex(device->Dispatch, SerialPnp_GetInterfaceIndex(rxInterfaceId),
+            kind, packet[SERIALPNP_PACKET_NOTIFICATION_INDEX_OFFSET]);
+        *dataOffset = SERIALPNP_PACKET_NOTIFICATION_INDEX_OFFSET + 1;
     }
-    else if (((Int == schema) && (4 == length)))
+    else if (length < (DWORD)SERIALPNP_PACKET_NAME_OFFSET + rxNameLength)
     {
-        sprintf_s(rxstrdata, MAXRXSTRLEN, "%d", *((int*)Data));
+        return false;
     }
-    else if (((Boolean == schema) && (1 == length)))
+    else
     {
-        sprintf_s(rxstrdata, MAXRXSTRLEN, "%d", *((int*)Data));
+        *definition = SerialPnp_Dispatch_FindByName(device->Dispatch, SerialPnp_GetInterfaceIndex(rxInterfaceId),
+            kind, (const char*)(packet + SERIALPNP_PACKET_NAME_OFFSET), rxNameLength);
+        *dataOffset = SERIALPNP_PACKET_NAME_OFFSET + rxNameLength;
+    }
+
+    return true;
+}
+
+// SerialPnp_SetLastReportedValue records the value a property was last reported with, so that the device
+// pushing the same value again is not reported again
+static void SerialPnp_SetLastReportedValue(
+    PSERIAL_DEVICE_CONTEXT device,
+    PropertyDefinition* prop,
+    const char* value)
+{
+    size_t valueLength = strlen(value);
+
+    Lock(device->PropertyLock);
+    if (valueLength < sizeof(prop->LastReportedValue))
+    {
+        memcpy(prop->LastReportedValue, value, valueLength + 1);
     }
     else
     {
-        LogError("Unknown schema");
-        free(rxstrdata);
-        return NULL;
+        // Too long to be a value the device pushes, so it never matches one
+        prop->LastReportedValue[0] = '\0';
     }
+    Unlock(device->PropertyLock);
+}
 
-    return rxstrdata;
+// SerialPnp_ReportPropertyNotification reports a property value the device pushed. Devices may push their
+// properties periodically rather than on change, so a repeat of the value last reported is dropped here.
+static void SerialPnp_ReportPropertyNotification(
+    PSERIAL_DEVICE_CONTEXT device,
+    PropertyDefinition* prop,
+    const char* value)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    Lock(device->PropertyLock);
+    bool unchanged = (0 == strcmp(prop->LastReportedValue, value));
+    Unlock(device->PropertyLock);
+
+    if (unchanged)
+    {
+        return;
+    }
+
+    if ((result = PnpBridgeClient_ReportProperty(device->ClientHandle, device->ComponentName, prop->defintion.Name,
+            value)) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Serial Pnp Adapter: Unable to report device property=%s, error=%d", prop->defintion.Name, result);
+        return;
+    }
+
+    SerialPnp_SetLastReportedValue(device, prop, value);
+}
+
+// Interface of an event batch notification being formatted
+typedef struct _SERIALPNP_EVENT_BATCH_CONTEXT
+{
+    PSERIAL_DEVICE_CONTEXT Device;
+    size_t InterfaceIndex;
+} SERIALPNP_EVENT_BATCH_CONTEXT, *PSERIALPNP_EVENT_BATCH_CONTEXT;
+
+// SerialPnp_LookupBatchedEvent resolves an event batch entry of the interface the batch context is for
+static bool SerialPnp_LookupBatchedEvent(
+    void* context,
+    uint8_t index,
+    const char** name,
+    Schema* schema)
+{
+    PSERIALPNP_EVENT_BATCH_CONTEXT batch = (PSERIALPNP_EVENT_BATCH_CONTEXT)context;
+    const EventDefinition* ev = SerialPnp_Dispatch_FindByIndex(batch->Device->Dispatch, batch->InterfaceIndex,
+        SERIALPNP_DISPATCH_EVENT, index);
+
+    if (!ev)
+    {
+        LogError("Couldn't find event %d", index);
+        return false;
+    }
+
+    *name = ev->defintion.Name;
+    *schema = ev->DataSchema;
+    return true;
+}
+
+// SerialPnp_SendBatchedEvents sends a telemetry message of batched events
+static void SerialPnp_SendBatchedEvents(
+    void* context,
+    const char* message)
+{
+    PSERIALPNP_EVENT_BATCH_CONTEXT batch = (PSERIALPNP_EVENT_BATCH_CONTEXT)context;
+    IOTHUB_CLIENT_RESULT result;
+
+    LogInfo("%s", message);
+    if ((result = PnpBridgeClient_SendTelemetry(batch->Device->ClientHandle, batch->Device->ComponentName, message))
+        != IOTHUB_CLIENT_OK)
+    {
+        LogError("Serial Pnp Adapter: PnpBridgeClient_SendTelemetry failed, error=%d", result);
+    }
+}
+
+// SerialPnp_SendEventBatch sends the events of an event batch notification as one telemetry message. Entries of
+// events the descriptor does not declare, or whose values cannot be formatted, are left out of the message.
+static void SerialPnp_SendEventBatch(
+    PSERIAL_DEVICE_CONTEXT device,
+    const byte* packet,
+    DWORD length)
+{
+    DWORD entriesOffset = SERIALPNP_PACKET_PAYLOAD_OFFSET + SERIALPNP_PAYLOAD_EVENT_BATCH_ENTRIES_OFFSET;
+    SERIALPNP_EVENT_BATCH_CONTEXT batch;
+
+    if (length < entriesOffset)
+    {
+        LogError("Event batch notification too short");
+        return;
+    }
+
+    batch.Device = device;
+    batch.InterfaceIndex = SerialPnp_GetInterfaceIndex(packet[SERIALPNP_PACKET_INTERFACE_NUMBER_OFFSET]);
+    if (!SerialPnp_FormatEventBatch(packet + entriesOffset, length - entriesOffset, SerialPnp_LookupBatchedEvent,
+            SerialPnp_SendBatchedEvents, &batch))
+    {
+        LogError("Event batch notification truncated or out of memory");
+    }
 }
 
 void SerialPnp_UnsolicitedPacket(
@@ -279,129 +551,97 @@ void SerialPnp_UnsolicitedPacket(
     // Got an event
     if (SERIALPNP_PACKET_TYPE_EVENT_NOTIFICATION == packet[SERIALPNP_PACKET_PACKET_TYPE_OFFSET])
     {
-        byte rxInterfaceId = packet[SERIALPNP_PACKET_INTERFACE_NUMBER_OFFSET];
-        byte rxNameLength = packet[SERIALPNP_PACKET_NAME_LENGTH_OFFSET];
-        DWORD rxDataSize = length - rxNameLength - SERIALPNP_PACKET_NAME_OFFSET;
+        const EventDefinition* ev;
+        DWORD rxDataOffset;
 
-        char* event_name = malloc(sizeof(char) * (rxNameLength + 1));
-        if (!event_name)
+        if (!SerialPnp_ParseNotification(device, packet, length, SERIALPNP_DISPATCH_EVENT, (const void**)&ev,
+                &rxDataOffset))
         {
-            LogError("Error out of memory");
+            LogError("Event notification too short");
             return;
         }
-        memcpy(event_name, packet + SERIALPNP_PACKET_NAME_OFFSET, rxNameLength);
-        event_name[rxNameLength] = '\0';
 
-        const EventDefinition* ev = SerialPnp_LookupEvent(device->InterfaceDefinitions, event_name, rxInterfaceId);
         if (!ev)
         {
             LogError("Couldn't find event");
-            free(event_name);
-            return;
-        }
-
-        byte* rxData = malloc(sizeof(byte) * rxDataSize);
-        if (!rxData)
-        {
-            LogError("Error out of memory");
-            free(event_name);
             return;
         }
 
-        memcpy(rxData, packet + SERIALPNP_PACKET_NAME_OFFSET + rxNameLength, rxDataSize);
-
-        char* rxstrdata = SerialPnp_BinarySchemaToString(ev->DataSchema, rxData, (byte)rxDataSize);
+        char valueBuffer[SERIALPNP_MAX_VALUE_STRING_LENGTH];
+        char* rxstrdata = SerialPnp_FormatValue(ev->DataSchema, packet + rxDataOffset, length - rxDataOffset,
+            valueBuffer, sizeof(valueBuffer));
         if (!rxstrdata)
         {
-            LogError("Unknown schema");
-            free(event_name);
-            free(rxData);
             return;
         }
         LogInfo("%s: %s", ev->defintion.Name, rxstrdata);
 
         SerialPnp_SendEventAsync(device, ev->defintion.Name, rxstrdata);
 
-        free(event_name);
-        free(rxData);
+        if (rxstrdata != valueBuffer)
+        {
+            free(rxstrdata);
+        }
     }
-    // Got a property update
+    // Got a property update, pushed by the device or sent in answer to a property write
     else if (SERIALPNP_PACKET_TYPE_PROPERTY_NOTIFICATION == packet[SERIALPNP_PACKET_PACKET_TYPE_OFFSET])
     {
-        // TODO
-    }
-}
+        const PropertyDefinition* prop;
+        DWORD rxDataOffset;
 
-const PropertyDefinition* SerialPnp_LookupProperty(
-    SINGLYLINKEDLIST_HANDLE interfaceDefinitions,
-    const char* propertyName,
-    int InterfaceId)
-{
-    LIST_ITEM_HANDLE interfaceDefHandle = singlylinkedlist_get_head_item(interfaceDefinitions);
-    const InterfaceDefinition* interfaceDef;
-
-    for (int i = 0; i < InterfaceId - 1; i++)
-    {
-        if (NULL == interfaceDefHandle)
+        if (!SerialPnp_ParseNotification(device, packet, length, SERIALPNP_DISPATCH_PROPERTY, (const void**)&prop,
+                &rxDataOffset))
         {
-            return NULL;
+            LogError("Property notification too short");
+            return;
         }
-        interfaceDefHandle = singlylinkedlist_get_next_item(interfaceDefHandle);
-    }
-    interfaceDef = singlylinkedlist_item_get_value(interfaceDefHandle);
-    if (NULL == interfaceDef)
-    {
-        return NULL;
-    }
 
-    SINGLYLINKEDLIST_HANDLE property = interfaceDef->Properties;
-    LIST_ITEM_HANDLE eventDef = singlylinkedlist_get_head_item(property);
-    const PropertyDefinition* ev;
-    while (NULL != eventDef)
-    {
-        ev = singlylinkedlist_item_get_value(eventDef);
-        if (strcmp(ev->defintion.Name, propertyName) == 0)
+        if (!prop)
         {
-            return ev;
+            LogError("Couldn't find property");
+            return;
         }
-        eventDef = singlylinkedlist_get_next_item(eventDef);
-    }
 
-    return NULL;
-}
+        char valueBuffer[SERIALPNP_MAX_VALUE_STRING_LENGTH];
+        char* rxstrdata = SerialPnp_FormatValue(prop->DataSchema, packet + rxDataOffset, length - rxDataOffset,
+            valueBuffer, sizeof(valueBuffer));
+        if (!rxstrdata)
+        {
+            return;
+        }
+        LogInfo("%s: %s", prop->defintion.Name, rxstrdata);
 
-const CommandDefinition* SerialPnp_LookupCommand(
-    SINGLYLINKEDLIST_HANDLE interfaceDefinitions,
-    const char* commandName,
-    int InterfaceId)
-{
-    LIST_ITEM_HANDLE interfaceDefHandle = singlylinkedlist_get_head_item(interfaceDefinitions);
-    const InterfaceDefinition* interfaceDef;
+        // The definition is owned by the device context, only the lookup tables hand it out as const
+        SerialPnp_ReportPropertyNotification(device, (PropertyDefinition*)prop, rxstrdata);
 
-    for (int i = 0; i < InterfaceId - 1; i++)
-    {
-        if (NULL == interfaceDefHandle)
+        if (rxstrdata != valueBuffer)
         {
-            return NULL;
+            free(rxstrdata);
         }
-        interfaceDefHandle = singlylinkedlist_get_next_item(interfaceDefHandle);
     }
-    interfaceDef = singlylinkedlist_item_get_value(interfaceDefHandle);
-
-    SINGLYLINKEDLIST_HANDLE command = interfaceDef->Commands;
-    LIST_ITEM_HANDLE eventDef = singlylinkedlist_get_head_item(command);
-    const CommandDefinition* ev;
-    while (NULL != eventDef)
+    // Got several events in one frame
+    else if (SERIALPNP_PACKET_TYPE_EVENT_BATCH_NOTIFICATION == packet[SERIALPNP_PACKET_PACKET_TYPE_OFFSET])
     {
-        ev = singlylinkedlist_item_get_value(eventDef);
-        if (strcmp(ev->defintion.Name, commandName) == 0)
-        {
-            return ev;
-        }
-        eventDef = singlylinkedlist_get_next_item(eventDef);
+        SerialPnp_SendEventBatch(device, packet, length);
     }
+}
+
+const PropertyDefinition* SerialPnp_LookupProperty(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    const char* propertyName,
+    int InterfaceId)
+{
+    return SerialPnp_Dispatch_FindByName(serialDevice->Dispatch, SerialPnp_GetInterfaceIndex(InterfaceId),
+        SERIALPNP_DISPATCH_PROPERTY, propertyName, strlen(propertyName));
+}
 
-    return NULL;
+const CommandDefinition* SerialPnp_LookupCommand(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    const char* commandName,
+    int InterfaceId)
+{
+    return SerialPnp_Dispatch_FindByName(serialDevice->Dispatch, SerialPnp_GetInterfaceIndex(InterfaceId),
+        SERIALPNP_DISPATCH_COMMAND, commandName, strlen(commandName));
 }
 
 IOTHUB_CLIENT_RESULT SerialPnp_PropertyHandler(
@@ -409,7 +649,7 @@ IOTHUB_CLIENT_RESULT SerialPnp_PropertyHandler(
     const char* property,
     char* data)
 {
-    const PropertyDefinition* prop = SerialPnp_LookupProperty(serialDevice->InterfaceDefinitions, property, 0);
+    const PropertyDefinition* prop = SerialPnp_LookupProperty(serialDevice, property, 0);
     byte* input = (byte*)data;
 
     if (NULL == prop)
@@ -438,7 +678,7 @@ IOTHUB_CLIENT_RESULT SerialPnp_PropertyHandler(
     txPacket[SERIALPNP_PACKET_PACKET_LENGTH_OFFSET] = (byte)(txlength & 0xFF);
     txPacket[SERIALPNP_PACKET_PACKET_LENGTH_OFFSET + 1] = (byte)(txlength >> 8);
     txPacket[SERIALPNP_PACKET_PACKET_TYPE_OFFSET] = SERIALPNP_PACKET_TYPE_PROPERTY_REQUEST;
-    // txPacket[3] is reserved
+    txPacket[SERIALPNP_PACKET_REQUEST_ID_OFFSET] = (byte)0; // property responses are notifications, not matched
     txPacket[SERIALPNP_PACKET_INTERFACE_NUMBER_OFFSET] = (byte)0;
     txPacket[SERIALPNP_PACKET_NAME_LENGTH_OFFSET] = (byte)nameLength;
 
@@ -447,7 +687,9 @@ IOTHUB_CLIENT_RESULT SerialPnp_PropertyHandler(
 
     LogInfo("Setting property %s to %s", property, input);
 
+    Lock(serialDevice->CommandLock);
     SerialPnp_TxPacket(serialDevice, txPacket, txlength);
+    Unlock(serialDevice->CommandLock);
 
     free(inputPayload);
     free(txPacket);
@@ -455,93 +697,318 @@ IOTHUB_CLIENT_RESULT SerialPnp_PropertyHandler(
     return IOTHUB_CLIENT_OK;
 }
 
+// SerialPnp_GetRemainingTime returns false once Deadline has passed, otherwise the milliseconds left
+static bool SerialPnp_GetRemainingTime(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    tickcounter_ms_t Deadline,
+    int* RemainingMs)
+{
+    tickcounter_ms_t now = 0;
+    if (0 != tickcounter_get_current_ms(serialDevice->CommandClock, &now) || now >= Deadline)
+    {
+        return false;
+    }
+    *RemainingMs = (int)(Deadline - now);
+    return true;
+}
+
+// SerialPnp_ReserveCommand waits for a free outstanding command slot and assigns it a request ID. Must be called
+// with CommandResponseWaitLock held.
+static SERIALPNP_OUTSTANDING_COMMAND* SerialPnp_ReserveCommand(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    const char* command,
+    byte nameLength,
+    tickcounter_ms_t deadline)
+{
+    int remainingMs = 0;
+
+    // Firmware that ignores request IDs can only be sent one command at a time
+    while (!serialDevice->ReceiverStopped &&
+           serialDevice->OutstandingCommandCount >= (serialDevice->RequestIdsEchoed ? SERIALPNP_MAX_OUTSTANDING_COMMANDS : 1))
+    {
+        if (!SerialPnp_GetRemainingTime(serialDevice, deadline, &remainingMs) ||
+            COND_OK != Condition_Wait(serialDevice->CommandSlotCondition, serialDevice->CommandResponseWaitLock, remainingMs))
+        {
+            LogError("Timeout waiting to send command %s, %d commands outstanding", command,
+                (int)serialDevice->OutstandingCommandCount);
+            return NULL;
+        }
+    }
+
+    if (serialDevice->ReceiverStopped)
+    {
+        // Pass the wake up on to the next command waiting for a slot
+        Condition_Post(serialDevice->CommandSlotCondition);
+        LogError("Device is not connected, command %s not sent", command);
+        return NULL;
+    }
+
+    SERIALPNP_OUTSTANDING_COMMAND* outstanding = NULL;
+    for (int i = 0; i < SERIALPNP_MAX_OUTSTANDING_COMMANDS; i++)
+    {
+        if (!serialDevice->OutstandingCommands[i].InUse)
+        {
+            outstanding = &serialDevice->OutstandingCommands[i];
+            break;
+        }
+    }
+
+    // Request IDs wrap from 255 to 1, skipping IDs of commands still waiting. There are always more IDs than slots.
+    bool idInUse;
+    do
+    {
+        if (0 == ++serialDevice->NextRequestId)
+        {
+            serialDevice->NextRequestId = 1;
+        }
+        idInUse = false;
+        for (int i = 0; i < SERIALPNP_MAX_OUTSTANDING_COMMANDS; i++)
+        {
+            if (serialDevice->OutstandingCommands[i].InUse &&
+                serialDevice->OutstandingCommands[i].RequestId == serialDevice->NextRequestId)
+            {
+                idInUse = true;
+                break;
+            }
+        }
+    } while (idInUse);
+
+    outstanding->InUse = true;
+    outstanding->Completed = false;
+    outstanding->RequestId = serialDevice->NextRequestId;
+    outstanding->Sequence = serialDevice->NextCommandSequence++;
+    outstanding->Name = command;
+    outstanding->NameLength = nameLength;
+    outstanding->Response = NULL;
+    outstanding->ResponseLength = 0;
+    serialDevice->OutstandingCommandCount++;
+
+    return outstanding;
+}
+
+// SerialPnp_ReleaseCommand frees an outstanding command slot. Must be called with CommandResponseWaitLock held.
+static void SerialPnp_ReleaseCommand(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    SERIALPNP_OUTSTANDING_COMMAND* outstanding)
+{
+    if (NULL != outstanding->Response)
+    {
+        free(outstanding->Response);
+        outstanding->Response = NULL;
+    }
+    outstanding->InUse = false;
+    outstanding->Name = NULL;
+    serialDevice->OutstandingCommandCount--;
+    Condition_Post(serialDevice->CommandSlotCondition);
+}
+
+// SerialPnp_CompleteCommand hands a command response packet to the command waiting for it, matched by request ID.
+// Responses from firmware that ignores the request ID carry 0 and go to the oldest command of the same name.
+// Takes ownership of the packet.
+static void SerialPnp_CompleteCommand(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    byte* packet,
+    DWORD length)
+{
+    SERIALPNP_OUTSTANDING_COMMAND* outstanding = NULL;
+    byte requestId = packet[SERIALPNP_PACKET_REQUEST_ID_OFFSET];
+
+    Lock(serialDevice->CommandResponseWaitLock);
+
+    for (int i = 0; i < SERIALPNP_MAX_OUTSTANDING_COMMANDS; i++)
+    {
+        SERIALPNP_OUTSTANDING_COMMAND* candidate = &serialDevice->OutstandingCommands[i];
+        if (!candidate->InUse || candidate->Completed)
+        {
+            continue;
+        }
+
+        if (0 != requestId)
+        {
+            if (candidate->RequestId == requestId)
+            {
+                outstanding = candidate;
+                break;
+            }
+        }
+        else if (length >= (DWORD)(SERIALPNP_PACKET_NAME_OFFSET + candidate->NameLength) &&
+                 packet[SERIALPNP_PACKET_NAME_LENGTH_OFFSET] == candidate->NameLength &&
+                 0 == memcmp(packet + SERIALPNP_PACKET_NAME_OFFSET, candidate->Name, candidate->NameLength) &&
+                 (NULL == outstanding || (int)(candidate->Sequence - outstanding->Sequence) < 0))
+        {
+            outstanding = candidate;
+        }
+    }
+
+    if (NULL != outstanding)
+    {
+        if (0 != requestId && !serialDevice->RequestIdsEchoed)
+        {
+            LogInfo("Device %s echoes request IDs, pipelining commands", serialDevice->ComponentName);
+            serialDevice->RequestIdsEchoed = true;
+
+            // The window just opened, let every command waiting for a slot through
+            for (size_t i = serialDevice->OutstandingCommandCount; i < SERIALPNP_MAX_OUTSTANDING_COMMANDS; i++)
+            {
+                Condition_Post(serialDevice->CommandSlotCondition);
+            }
+        }
+        outstanding->Response = packet;
+        outstanding->ResponseLength = length;
+        outstanding->Completed = true;
+        Condition_Post(outstanding->ResponseCondition);
+    }
+    else
+    {
+        LogInfo("Dropping response with request ID %d, its command timed out", requestId);
+        free(packet);
+    }
+
+    Unlock(serialDevice->CommandResponseWaitLock);
+}
+
+// SerialPnp_FailOutstandingCommands wakes every command waiting on the device once no more responses can arrive
+static void SerialPnp_FailOutstandingCommands(
+    PSERIAL_DEVICE_CONTEXT serialDevice)
+{
+    Lock(serialDevice->CommandResponseWaitLock);
+    serialDevice->ReceiverStopped = true;
+    for (int i = 0; i < SERIALPNP_MAX_OUTSTANDING_COMMANDS; i++)
+    {
+        if (serialDevice->OutstandingCommands[i].InUse)
+        {
+            Condition_Post(serialDevice->OutstandingCommands[i].ResponseCondition);
+        }
+    }
+    Condition_Post(serialDevice->CommandSlotCondition);
+    Unlock(serialDevice->CommandResponseWaitLock);
+}
+
 IOTHUB_CLIENT_RESULT SerialPnp_CommandHandler(
     PSERIAL_DEVICE_CONTEXT serialDevice,
     const char* command,
     char* data,
     char** response)
 {
-    Lock(serialDevice->CommandLock);
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+    byte* inputPayload = NULL;
+    byte* txPacket = NULL;
+    SERIALPNP_OUTSTANDING_COMMAND* outstanding = NULL;
+    tickcounter_ms_t deadline = 0;
+    int remainingMs = 0;
 
-    const CommandDefinition* cmd = SerialPnp_LookupCommand(serialDevice->InterfaceDefinitions, command, 0);
+    const CommandDefinition* cmd = SerialPnp_LookupCommand(serialDevice, command, 0);
     byte* input = (byte*)data;
 
     if (NULL == cmd)
     {
-        Unlock(serialDevice->CommandLock);
         return IOTHUB_CLIENT_ERROR;
     }
 
     // Otherwise serialize data
     int length = 0;
-    byte* inputPayload = SerialPnp_StringSchemaToBinary(cmd->RequestSchema, input, &length);
+    inputPayload = SerialPnp_StringSchemaToBinary(cmd->RequestSchema, input, &length);
     if (!inputPayload)
     {
-        Unlock(serialDevice->CommandLock);
         return IOTHUB_CLIENT_ERROR;
     }
 
     int nameLength = (int)strlen(command);
     int txlength = SERIALPNP_PACKET_NAME_OFFSET + nameLength + length;
-    byte* txPacket = malloc(txlength);
+    txPacket = malloc(txlength);
     if (!txPacket)
     {
         LogError("Error out of memory");
-        free(inputPayload);
-        Unlock(serialDevice->CommandLock);
-        return IOTHUB_CLIENT_ERROR;
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
     }
 
     txPacket[SERIALPNP_PACKET_PACKET_LENGTH_OFFSET] = (byte)(txlength & 0xFF);
     txPacket[SERIALPNP_PACKET_PACKET_LENGTH_OFFSET + 1] = (byte)(txlength >> 8);
     txPacket[SERIALPNP_PACKET_PACKET_TYPE_OFFSET] = SERIALPNP_PACKET_TYPE_COMMAND_REQUEST;
-    // txPacket[3] is reserved
     txPacket[SERIALPNP_PACKET_INTERFACE_NUMBER_OFFSET] = (byte)0;
     txPacket[SERIALPNP_PACKET_NAME_LENGTH_OFFSET] = (byte)nameLength;
 
     memcpy(txPacket + SERIALPNP_PACKET_NAME_OFFSET, command, nameLength);
     memcpy(txPacket + SERIALPNP_PACKET_NAME_OFFSET + nameLength, inputPayload, length);
 
-    LogInfo("Invoking command %s to %s", command, input);
+    if (0 != tickcounter_get_current_ms(serialDevice->CommandClock, &deadline))
+    {
+        LogError("Failed to read the command clock");
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
+    }
+    deadline += SERIALPNP_COMMAND_TIMEOUT_MS;
+
+    Lock(serialDevice->CommandResponseWaitLock);
+    outstanding = SerialPnp_ReserveCommand(serialDevice, command, (byte)nameLength, deadline);
+    Unlock(serialDevice->CommandResponseWaitLock);
+    if (NULL == outstanding)
+    {
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
+    }
+
+    txPacket[SERIALPNP_PACKET_REQUEST_ID_OFFSET] = outstanding->RequestId;
+
+    LogInfo("Invoking command %s to %s, request ID %d", command, input, outstanding->RequestId);
 
-    if (IOTHUB_CLIENT_OK != SerialPnp_TxPacket(serialDevice, txPacket, txlength))
+    Lock(serialDevice->CommandLock);
+    result = SerialPnp_TxPacket(serialDevice, txPacket, txlength);
+    Unlock(serialDevice->CommandLock);
+    if (IOTHUB_CLIENT_OK != result)
     {
         LogError("Error: command not sent to device.");
-        free(inputPayload);
-        free(txPacket);
-        Unlock(serialDevice->CommandLock);
-        return IOTHUB_CLIENT_ERROR;
+        goto exit;
     }
 
     Lock(serialDevice->CommandResponseWaitLock);
-    if (COND_OK != Condition_Wait(serialDevice->CommandResponseWaitCondition, serialDevice->CommandResponseWaitLock, 60000))
+    while (!outstanding->Completed && !serialDevice->ReceiverStopped)
+    {
+        if (!SerialPnp_GetRemainingTime(serialDevice, deadline, &remainingMs) ||
+            COND_OK != Condition_Wait(outstanding->ResponseCondition, serialDevice->CommandResponseWaitLock, remainingMs))
+        {
+            break;
+        }
+    }
+    if (!outstanding->Completed)
     {
-        LogError("Timeout waiting for response from device");
-        free(inputPayload);
-        free(txPacket);
-        Unlock(serialDevice->CommandLock);
         Unlock(serialDevice->CommandResponseWaitLock);
-        return IOTHUB_CLIENT_ERROR;
+        LogError("Timeout waiting for response from device to command %s, request ID %d", command, outstanding->RequestId);
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
     }
     Unlock(serialDevice->CommandResponseWaitLock);
 
-    byte* responsePacket = serialDevice->pbMainBuffer;
+    // The slot stays reserved until released below, so the response can be read without the lock
     int dataOffset = SERIALPNP_PACKET_NAME_OFFSET + nameLength;
-    byte* commandResponse = responsePacket + dataOffset;
-    char* stval = SerialPnp_BinarySchemaToString(cmd->ResponseSchema, commandResponse, (byte)length);
-    free(inputPayload);
-    free(responsePacket);
-    free(txPacket);
+    if (outstanding->ResponseLength < (DWORD)dataOffset)
+    {
+        LogError("Response to command %s is too short", command);
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
+    }
 
+    char* stval = SerialPnp_BinarySchemaToString(cmd->ResponseSchema, outstanding->Response + dataOffset,
+        outstanding->ResponseLength - (DWORD)dataOffset);
     if (!stval)
     {
-        Unlock(serialDevice->CommandLock);
-        return IOTHUB_CLIENT_ERROR;
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
     }
 
     *response = stval;
-    Unlock(serialDevice->CommandLock);
-    return IOTHUB_CLIENT_OK;
+
+exit:
+    if (NULL != outstanding)
+    {
+        Lock(serialDevice->CommandResponseWaitLock);
+        SerialPnp_ReleaseCommand(serialDevice, outstanding);
+        Unlock(serialDevice->CommandResponseWaitLock);
+    }
+    free(inputPayload);
+    free(txPacket);
+    return result;
 }
 
 void SerialPnp_ParseDescriptor(
@@ -850,6 +1317,82 @@ IOTHUB_CLIENT_RESULT SerialPnp_FindSerialDevices()
 }
 #endif
 
+// Lays the parsed interface definitions out in the tables events, properties and commands are looked up in
+static IOTHUB_CLIENT_RESULT SerialPnp_BuildDispatch(
+    PSERIAL_DEVICE_CONTEXT deviceContext)
+{
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+    size_t interfaceCount = (size_t)SerialPnp_GetListCount(deviceContext->InterfaceDefinitions);
+    SERIALPNP_DISPATCH_INTERFACE_SIZE* interfaceSizes = calloc(interfaceCount + 1, sizeof(SERIALPNP_DISPATCH_INTERFACE_SIZE));
+    LIST_ITEM_HANDLE interfaceItem;
+    size_t i;
+
+    if (NULL == interfaceSizes)
+    {
+        LogError("Error out of memory");
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    interfaceItem = singlylinkedlist_get_head_item(deviceContext->InterfaceDefinitions);
+    for (i = 0; NULL != interfaceItem; i++)
+    {
+        const InterfaceDefinition* def = singlylinkedlist_item_get_value(interfaceItem);
+        interfaceSizes[i].Counts[SERIALPNP_DISPATCH_EVENT] = SerialPnp_GetListCount(def->Events);
+        interfaceSizes[i].Counts[SERIALPNP_DISPATCH_PROPERTY] = SerialPnp_GetListCount(def->Properties);
+        interfaceSizes[i].Counts[SERIALPNP_DISPATCH_COMMAND] = SerialPnp_GetListCount(def->Commands);
+        interfaceItem = singlylinkedlist_get_next_item(interfaceItem);
+    }
+
+    deviceContext->Dispatch = SerialPnp_Dispatch_Create(interfaceSizes, interfaceCount);
+    free(interfaceSizes);
+    if (NULL == deviceContext->Dispatch)
+    {
+        LogError("Failed to allocate dispatch tables for %lu interfaces", (unsigned long)interfaceCount);
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    interfaceItem = singlylinkedlist_get_head_item(deviceContext->InterfaceDefinitions);
+    for (i = 0; NULL != interfaceItem; i++)
+    {
+        const InterfaceDefinition* def = singlylinkedlist_item_get_value(interfaceItem);
+        LIST_ITEM_HANDLE item;
+
+        for (item = singlylinkedlist_get_head_item(def->Events); NULL != item; item = singlylinkedlist_get_next_item(item))
+        {
+            const EventDefinition* ev = singlylinkedlist_item_get_value(item);
+            if (!SerialPnp_Dispatch_Add(deviceContext->Dispatch, i, SERIALPNP_DISPATCH_EVENT, ev->defintion.Name, ev))
+            {
+                LogError("Failed to add event %s of interface %s", ev->defintion.Name, def->Id);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+        }
+
+        for (item = singlylinkedlist_get_head_item(def->Properties); NULL != item; item = singlylinkedlist_get_next_item(item))
+        {
+            const PropertyDefinition* prop = singlylinkedlist_item_get_value(item);
+            if (!SerialPnp_Dispatch_Add(deviceContext->Dispatch, i, SERIALPNP_DISPATCH_PROPERTY, prop->defintion.Name, prop))
+            {
+                LogError("Failed to add property %s of interface %s", prop->defintion.Name, def->Id);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+        }
+
+        for (item = singlylinkedlist_get_head_item(def->Commands); NULL != item; item = singlylinkedlist_get_next_item(item))
+        {
+            const CommandDefinition* cmd = singlylinkedlist_item_get_value(item);
+            if (!SerialPnp_Dispatch_Add(deviceContext->Dispatch, i, SERIALPNP_DISPATCH_COMMAND, cmd->defintion.Name, cmd))
+            {
+                LogError("Failed to add command %s of interface %s", cmd->defintion.Name, def->Id);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+        }
+
+        interfaceItem = singlylinkedlist_get_next_item(interfaceItem);
+    }
+
+    return result;
+}
+
 int SerialPnp_ParseInterfaceConfig(
     void* context)
 {
@@ -857,6 +1400,23 @@ int SerialPnp_ParseInterfaceConfig(
     DWORD length;
     PSERIAL_DEVICE_CONTEXT deviceContext = context;
     int retries = SERIALPNP_RESET_OR_DESCRIPTOR_MAX_RETRIES;
+    uint32_t descriptorHash = 0;
+    bool hashReported = false;
+
+    // A device whose descriptor is cached is neither reset nor asked for its descriptor
+    if (NULL != deviceContext->DescriptorCachePath)
+    {
+        hashReported = (IOTHUB_CLIENT_OK == SerialPnp_DescriptorHashRequest(deviceContext, &descriptorHash));
+        if (hashReported &&
+            IOTHUB_CLIENT_OK == SerialPnp_LoadCachedDescriptor(deviceContext, descriptorHash, &desc, &length))
+        {
+            LogInfo("Using cached descriptor of length %d", length);
+            SerialPnp_ParseDescriptor(deviceContext->InterfaceDefinitions, desc, length);
+            free(desc);
+            return SerialPnp_BuildDispatch(deviceContext);
+        }
+    }
+
     while (IOTHUB_CLIENT_OK != SerialPnp_ResetDevice(deviceContext))
     {
         LogError("Error sending reset request. Retrying...");
@@ -879,8 +1439,14 @@ int SerialPnp_ParseInterfaceConfig(
         ThreadAPI_Sleep(5000);
     }
 
+    if (hashReported)
+    {
+        SerialPnp_StoreCachedDescriptor(deviceContext, descriptorHash, desc, length);
+    }
+
     SerialPnp_ParseDescriptor(deviceContext->InterfaceDefinitions, desc, length);
-    return IOTHUB_CLIENT_OK;
+    free(desc);
+    return SerialPnp_BuildDispatch(deviceContext);
 }
 
 #ifndef WIN32
@@ -1004,11 +1570,10 @@ IOTHUB_CLIENT_RESULT SerialPnp_OpenDevice(
         return -1;
     }
 #else 
-    char *portname = "/dev/ttyACM0";
-    int fd = open(portname, O_RDWR | O_NOCTTY | O_SYNC);
+    int fd = open(port, O_RDWR | O_NOCTTY | O_SYNC);
     if (fd < 0)
     {
-        LogError("error %d opening %s: %s", errno, portname, strerror(errno));
+        LogError("error %d opening %s: %s", errno, port, strerror(errno));
         return -1;
     }
 
@@ -1042,27 +1607,62 @@ exit:
     return result;
 }
 
-IOTHUB_CLIENT_RESULT SerialPnp_RxPacket(
+IOTHUB_CLIENT_RESULT SerialPnp_ReadPacket(
     PSERIAL_DEVICE_CONTEXT serialDevice,
-    byte** receivedPacket,
+    const byte** receivedPacket,
     DWORD* length,
-    char packetType)
+    char packetType,
+    int timeoutMs)
 {
-    byte inb = 0;
     DWORD dwRead = 0;
     *receivedPacket = NULL;
     *length = 0;
     int error = 0;
+    tickcounter_ms_t deadline = 0;
+    int remainingMs = 0;
+
+    if (0 != timeoutMs)
+    {
+        if (0 != tickcounter_get_current_ms(serialDevice->CommandClock, &deadline))
+        {
+            LogError("Failed to read the clock");
+            return IOTHUB_CLIENT_ERROR;
+        }
+        deadline += timeoutMs;
+    }
 
-#ifdef WIN32
     while (true)
     {
-        if (!ReadFile(serialDevice->hSerial, &inb, 1, &dwRead, &serialDevice->osReader)) // if completed asynchronously, wait. 
+        const byte* packet = NULL;
+        size_t packetLength = 0;
+        SERIALPNP_RX_DECODE_RESULT decodeResult = SerialPnp_RxDecoder_Decode(&serialDevice->RxDecoder, (byte)packetType, &packet, &packetLength);
+
+        if (SERIALPNP_RX_DECODE_OVERFLOW == decodeResult)
+        {
+            // The decoder dropped the frame and resynchronizes on the next start of frame byte
+            LogError("Filled Rx buffer. Protocol is bad.");
+            continue;
+        }
+
+        if (SERIALPNP_RX_DECODE_PACKET == decodeResult)
+        {
+            *receivedPacket = packet;
+            *length = (DWORD)packetLength;
+            break;
+        }
+
+        // Decoder has consumed everything read so far, read whatever the port has available
+        size_t chunkSize = 0;
+        byte* chunk = SerialPnp_RxDecoder_GetChunk(&serialDevice->RxDecoder, &chunkSize);
+
+#ifdef WIN32
+        if (!ReadFile(serialDevice->hSerial, chunk, (DWORD)chunkSize, &dwRead, &serialDevice->osReader)) // if completed asynchronously, wait. 
         {
             if (ERROR_IO_PENDING != (error = GetLastError()))
             {
                 // Read returned actual error and not just pending
                 LogError("read failed: %d", error);
+                PnpBridgeMetrics_AddCounter(serialDevice->ComponentName, PNP_METRIC_DEVICE_IO_ERRORS, 1);
                 return IOTHUB_CLIENT_ERROR;
             }
             else
@@ -1071,87 +1671,75 @@ IOTHUB_CLIENT_RESULT SerialPnp_RxPacket(
                 {
                     error = GetLastError();
                     LogError("read failed: %d", error);
+                    PnpBridgeMetrics_AddCounter(serialDevice->ComponentName, PNP_METRIC_DEVICE_IO_ERRORS, 1);
                     return IOTHUB_CLIENT_ERROR;
                 }
             }
 
         }
 
-        // Read can be successful but with no bytes actually read, shouldn't happen though
-        if (dwRead == 0)
+        if (0 == dwRead && 0 != timeoutMs && !SerialPnp_GetRemainingTime(serialDevice, deadline, &remainingMs))
         {
-            continue;
+            return IOTHUB_CLIENT_ERROR;
         }
-        //LogInfo("read completed successfully");
 #else
-    while ((dwRead = read(serialDevice->hSerial, (void*)&inb, 1)) != -1)
-    {
-#endif
-        // Check for a start of packet byte
-        if (SERIALPNP_START_OF_FRAME_BYTE == inb)
+        if (0 != timeoutMs)
         {
-            serialDevice->RxBufferIndex = 0;
-            serialDevice->RxEscaped = false;
-            continue;
-        }
-
-        // Check for an escape byte
-        if (SERIALPNP_ESCAPE_BYTE == inb)
-        {
-            serialDevice->RxEscaped = true;
-            continue;
+            struct pollfd pollFd = { serialDevice->hSerial, POLLIN, 0 };
+            if (!SerialPnp_GetRemainingTime(serialDevice, deadline, &remainingMs))
+            {
+                return IOTHUB_CLIENT_ERROR;
+            }
+            int ready = poll(&pollFd, 1, remainingMs);
+            if (ready <= 0)
+            {
+                // Timed out or interrupted, the deadline is checked again before waiting any longer
+                continue;
+            }
         }
 
-        // If last byte was an escape byte, increment current byte by 1
-        if (serialDevice->RxEscaped)
+        ssize_t bytesRead = read(serialDevice->hSerial, (void*)chunk, chunkSize);
+        if (bytesRead <= 0)
         {
-            inb++;
-            serialDevice->RxEscaped = false;
+            // 0 is a hang up, the device will not send anything more
+            LogError("read failed: %d", (0 == bytesRead) ? 0 : errno);
+            PnpBridgeMetrics_AddCounter(serialDevice->ComponentName, PNP_METRIC_DEVICE_IO_ERRORS, 1);
+            return IOTHUB_CLIENT_ERROR;
         }
+        dwRead = (DWORD)bytesRead;
+#endif
 
-        serialDevice->RxBuffer[serialDevice->RxBufferIndex++] = (byte)inb;
+        // Read can be successful but with no bytes actually read, shouldn't happen though
+        SerialPnp_RxDecoder_SetChunkLength(&serialDevice->RxDecoder, dwRead);
+    }
+    return IOTHUB_CLIENT_OK;
+}
 
-        if (serialDevice->RxBufferIndex >= MAX_BUFFER_SIZE)
-        {
-            LogError("Filled Rx buffer. Protocol is bad.");
-            return IOTHUB_CLIENT_ERROR;
-        }
+IOTHUB_CLIENT_RESULT SerialPnp_RxPacket(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    byte** receivedPacket,
+    DWORD* length,
+    char packetType,
+    int timeoutMs)
+{
+    const byte* packet = NULL;
+    IOTHUB_CLIENT_RESULT result = SerialPnp_ReadPacket(serialDevice, &packet, length, packetType, timeoutMs);
 
-        // Minimum packet length is 4, so once we are >= 4 begin checking
-        // the receieve buffer length against the length field.
-        if (serialDevice->RxBufferIndex >= SERIALPNP_MIN_PACKET_LENGTH)
-        {
-            int PacketLength = (int)((serialDevice->RxBuffer[0]) | (serialDevice->RxBuffer[1] << 8)); // LSB first, L-endian
+    *receivedPacket = NULL;
+    if (IOTHUB_CLIENT_OK != result)
+    {
+        *length = 0;
+        return result;
+    }
 
-            if (((int)serialDevice->RxBufferIndex == PacketLength) && (packetType == 0x00 || packetType == serialDevice->RxBuffer[2]))
-            {
-                *receivedPacket = malloc(serialDevice->RxBufferIndex * sizeof(byte));
-                if (NULL == *receivedPacket)
-                {
-                    LogError("Error out of memory");
-                    return IOTHUB_CLIENT_ERROR;
-                }
-                *length = serialDevice->RxBufferIndex;
-                memcpy(*receivedPacket, serialDevice->RxBuffer, serialDevice->RxBufferIndex);
-                serialDevice->RxBufferIndex = 0; // This should be reset anyway. Deliver the newly receieved packet
-
-                // both the main thread and this thread can be waiting for packets, 
-                // but this function that does the reading only runs on this thread
-                // command responses are expected on the main thread
-                if (SERIALPNP_PACKET_TYPE_COMMAND_RESPONSE == serialDevice->RxBuffer[SERIALPNP_PACKET_PACKET_TYPE_OFFSET])
-                {
-                    // signal the main thread in this case, pass back the buffer 
-                    // using the pointer in the serial context instead of the return value
-                    serialDevice->pbMainBuffer = *receivedPacket;
-                    *receivedPacket = NULL;
-                    Lock(serialDevice->CommandResponseWaitLock);
-                    Condition_Post(serialDevice->CommandResponseWaitCondition);
-                    Unlock(serialDevice->CommandResponseWaitLock);
-                }
-                break;
-            }
-        }
+    *receivedPacket = malloc(*length);
+    if (NULL == *receivedPacket)
+    {
+        LogError("Error out of memory");
+        *length = 0;
+        return IOTHUB_CLIENT_ERROR;
     }
+    memcpy(*receivedPacket, packet, *length);
     return IOTHUB_CLIENT_OK;
 }
 
@@ -1160,7 +1748,7 @@ IOTHUB_CLIENT_RESULT SerialPnp_ResetDevice(
 {
     IOTHUB_CLIENT_RESULT error = IOTHUB_CLIENT_OK;
     // Prepare packet
-    byte resetPacket[3] = { 0 }; // packet header
+    byte resetPacket[4] = { 0 }; // packet header
     byte* responsePacket = NULL;
     resetPacket[SERIALPNP_PACKET_PACKET_LENGTH_OFFSET] = 4; // length 4
     resetPacket[SERIALPNP_PACKET_PACKET_LENGTH_OFFSET + 1] = 0;
@@ -1176,7 +1764,7 @@ IOTHUB_CLIENT_RESULT SerialPnp_ResetDevice(
     LogInfo("Sent reset request");
 
     DWORD length;
-    if (IOTHUB_CLIENT_OK != SerialPnp_RxPacket(serialDevice, &responsePacket, &length, 0x02))
+    if (IOTHUB_CLIENT_OK != SerialPnp_RxPacket(serialDevice, &responsePacket, &length, 0x02, 0))
     {
         LogError("Error receiving response packet");
         error = IOTHUB_CLIENT_ERROR;
@@ -1215,7 +1803,7 @@ IOTHUB_CLIENT_RESULT SerialPnp_DeviceDescriptorRequest(
     DWORD* length)
 {
     // Prepare packet
-    byte txPacket[3] = { 0 }; // packet header
+    byte txPacket[4] = { 0 }; // packet header
     txPacket[SERIALPNP_PACKET_PACKET_LENGTH_OFFSET] = 4; // length 4
     txPacket[SERIALPNP_PACKET_PACKET_LENGTH_OFFSET + 1] = 0;
     txPacket[SERIALPNP_PACKET_PACKET_TYPE_OFFSET] = SERIALPNP_PACKET_TYPE_DESCRIPTOR_REQUEST;
@@ -1228,7 +1816,7 @@ IOTHUB_CLIENT_RESULT SerialPnp_DeviceDescriptorRequest(
     }
     LogInfo("Sent descriptor request");
 
-    if (IOTHUB_CLIENT_OK != SerialPnp_RxPacket(serialDevice, desc, length, 0x04))
+    if (IOTHUB_CLIENT_OK != SerialPnp_RxPacket(serialDevice, desc, length, 0x04, 0))
     {
         LogError("Error receiving response packet");
         free(*desc);
@@ -1254,11 +1842,173 @@ IOTHUB_CLIENT_RESULT SerialPnp_DeviceDescriptorRequest(
     return IOTHUB_CLIENT_OK;
 }
 
-void SerialPnp_SendEventCallback(
-    IOTHUB_CLIENT_CONFIRMATION_RESULT pnpSendEventStatus,
-    void* userContextCallback)
+// SerialPnp_DescriptorHash is the FNV-1a hash the device reports for its descriptor payload
+static uint32_t SerialPnp_DescriptorHash(
+    const byte* payload,
+    size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= payload[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// SerialPnp_DescriptorHashRequest asks the device for the hash of its descriptor. Fails if the device does not
+// answer within SERIALPNP_DESCRIPTOR_HASH_TIMEOUT_MS, as firmware without descriptor caching support does.
+static IOTHUB_CLIENT_RESULT SerialPnp_DescriptorHashRequest(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    uint32_t* hash)
+{
+    byte txPacket[4] = { 0 }; // packet header
+    byte* responsePacket = NULL;
+    DWORD length = 0;
+    txPacket[SERIALPNP_PACKET_PACKET_LENGTH_OFFSET] = 4; // length 4
+    txPacket[SERIALPNP_PACKET_PACKET_LENGTH_OFFSET + 1] = 0;
+    txPacket[SERIALPNP_PACKET_PACKET_TYPE_OFFSET] = SERIALPNP_PACKET_TYPE_DESCRIPTOR_HASH_REQUEST;
+
+    if (IOTHUB_CLIENT_OK != SerialPnp_TxPacket(serialDevice, txPacket, 4))
+    {
+        LogError("Error sending descriptor hash request packet");
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    if (IOTHUB_CLIENT_OK != SerialPnp_RxPacket(serialDevice, &responsePacket, &length,
+            SERIALPNP_PACKET_TYPE_DESCRIPTOR_HASH_RESPONSE, SERIALPNP_DESCRIPTOR_HASH_TIMEOUT_MS))
+    {
+        LogInfo("Device did not report a descriptor hash, descriptor is not cached");
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    if (length < SERIALPNP_DESCRIPTOR_HASH_RESPONSE_LENGTH)
+    {
+        LogError("Bad descriptor hash response");
+        free(responsePacket);
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    const byte* payload = responsePacket + SERIALPNP_PACKET_PAYLOAD_OFFSET;
+    *hash = (uint32_t)payload[0] | ((uint32_t)payload[1] << 8) | ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24);
+    free(responsePacket);
+
+    LogInfo("Device reported descriptor hash %08x", *hash);
+    return IOTHUB_CLIENT_OK;
+}
+
+// Cache files hold the descriptor response packet as received, behind a header of the magic, the format version,
+// the descriptor hash and the packet length, all LSB first
+#define SERIALPNP_DESCRIPTOR_CACHE_MAGIC   0x43445053 // "SPDC"
+#define SERIALPNP_DESCRIPTOR_CACHE_VERSION 1
+#define SERIALPNP_DESCRIPTOR_CACHE_HEADER_LENGTH 16
+
+static void SerialPnp_WriteUint32(
+    byte* buffer,
+    uint32_t value)
+{
+    buffer[0] = (byte)(value & 0xFF);
+    buffer[1] = (byte)((value >> 8) & 0xFF);
+    buffer[2] = (byte)((value >> 16) & 0xFF);
+    buffer[3] = (byte)((value >> 24) & 0xFF);
+}
+
+static uint32_t SerialPnp_ReadUint32(
+    const byte* buffer)
+{
+    return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+// SerialPnp_LoadCachedDescriptor reads the descriptor cached for the device's port. It fails unless the cached
+// descriptor hashes to the hash the device reported, which also rejects files damaged on disk.
+static IOTHUB_CLIENT_RESULT SerialPnp_LoadCachedDescriptor(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    uint32_t hash,
+    byte** desc,
+    DWORD* length)
+{
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_ERROR;
+    byte header[SERIALPNP_DESCRIPTOR_CACHE_HEADER_LENGTH];
+    byte* cached = NULL;
+
+    FILE* cacheFile = fopen(serialDevice->DescriptorCachePath, "rb");
+    if (NULL == cacheFile)
+    {
+        LogInfo("No cached descriptor in %s", serialDevice->DescriptorCachePath);
+        goto exit;
+    }
+
+    if (fread(header, 1, sizeof(header), cacheFile) != sizeof(header) ||
+        SERIALPNP_DESCRIPTOR_CACHE_MAGIC != SerialPnp_ReadUint32(header) ||
+        SERIALPNP_DESCRIPTOR_CACHE_VERSION != SerialPnp_ReadUint32(header + 4) ||
+        hash != SerialPnp_ReadUint32(header + 8))
+    {
+        LogInfo("Cached descriptor in %s does not match the device", serialDevice->DescriptorCachePath);
+        goto exit;
+    }
+
+    uint32_t cachedLength = SerialPnp_ReadUint32(header + 12);
+    if (cachedLength < SERIALPNP_PACKET_PAYLOAD_OFFSET || cachedLength > 0xFFFF ||
+        NULL == (cached = malloc(cachedLength)) ||
+        fread(cached, 1, cachedLength, cacheFile) != cachedLength ||
+        hash != SerialPnp_DescriptorHash(cached + SERIALPNP_PACKET_PAYLOAD_OFFSET, cachedLength - SERIALPNP_PACKET_PAYLOAD_OFFSET))
+    {
+        LogError("Cached descriptor in %s is damaged", serialDevice->DescriptorCachePath);
+        goto exit;
+    }
+
+    *desc = cached;
+    *length = cachedLength;
+    cached = NULL;
+    result = IOTHUB_CLIENT_OK;
+
+exit:
+    if (NULL != cacheFile)
+    {
+        fclose(cacheFile);
+    }
+    free(cached);
+    return result;
+}
+
+static void SerialPnp_StoreCachedDescriptor(
+    PSERIAL_DEVICE_CONTEXT serialDevice,
+    uint32_t hash,
+    const byte* desc,
+    DWORD length)
 {
-    LogInfo("SerialDataSendEventCallback called, result=%d, telemetry=%s", pnpSendEventStatus, (char*) userContextCallback);
+    byte header[SERIALPNP_DESCRIPTOR_CACHE_HEADER_LENGTH];
+
+    if (hash != SerialPnp_DescriptorHash(desc + SERIALPNP_PACKET_PAYLOAD_OFFSET, length - SERIALPNP_PACKET_PAYLOAD_OFFSET))
+    {
+        LogError("Descriptor does not match the hash the device reported, descriptor is not cached");
+        return;
+    }
+
+    SerialPnp_WriteUint32(header, SERIALPNP_DESCRIPTOR_CACHE_MAGIC);
+    SerialPnp_WriteUint32(header + 4, SERIALPNP_DESCRIPTOR_CACHE_VERSION);
+    SerialPnp_WriteUint32(header + 8, hash);
+    SerialPnp_WriteUint32(header + 12, length);
+
+    // A partly written file fails the hash check when it is loaded
+    FILE* cacheFile = fopen(serialDevice->DescriptorCachePath, "wb");
+    if (NULL == cacheFile)
+    {
+        LogError("Failed to open %s to cache the descriptor", serialDevice->DescriptorCachePath);
+        return;
+    }
+
+    if (fwrite(header, 1, sizeof(header), cacheFile) != sizeof(header) ||
+        fwrite(desc, 1, length, cacheFile) != length)
+    {
+        LogError("Failed to write the descriptor to %s", serialDevice->DescriptorCachePath);
+    }
+    else
+    {
+        LogInfo("Cached descriptor in %s", serialDevice->DescriptorCachePath);
+    }
+
+    fclose(cacheFile);
 }
 
 IOTHUB_CLIENT_RESULT SerialPnp_SendEventAsync(
@@ -1267,23 +2017,33 @@ IOTHUB_CLIENT_RESULT SerialPnp_SendEventAsync(
     char* TelemetryData)
 {
     IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
-    IOTHUB_MESSAGE_HANDLE messageHandle = NULL;
 
+    char messageBuffer[SERIALPNP_TELEMETRY_MESSAGE_LENGTH];
+    char* telemetryMessageData = messageBuffer;
+    size_t messageSize = strlen(TelemetryName) + strlen(TelemetryData) + 6; // {"":}, terminator
 
-    char telemetryMessageData[512] = { 0 };
-    sprintf(telemetryMessageData, "{\"%s\":%s}", TelemetryName, TelemetryData);
-
-    if ((messageHandle = PnP_CreateTelemetryMessageHandle(DeviceContext->ComponentName, telemetryMessageData)) == NULL)
+    // String values can make the message longer than the buffer
+    if (messageSize > sizeof(messageBuffer))
     {
-        LogError("Serial Pnp Adapter: PnP_CreateTelemetryMessageHandle failed.");
+        telemetryMessageData = malloc(messageSize);
+        if (!telemetryMessageData)
+        {
+            LogError("Error out of memory");
+            return IOTHUB_CLIENT_ERROR;
+        }
     }
-    else if ((result = PnpBridgeClient_SendEventAsync(DeviceContext->ClientHandle, messageHandle,
-            SerialPnp_SendEventCallback, (void*)TelemetryName)) != IOTHUB_CLIENT_OK)
+    sprintf_s(telemetryMessageData, messageSize, "{\"%s\":%s}", TelemetryName, TelemetryData);
+
+    if ((result = PnpBridgeClient_SendTelemetry(DeviceContext->ClientHandle, DeviceContext->ComponentName,
+            telemetryMessageData)) != IOTHUB_CLIENT_OK)
     {
-        LogError("Serial Pnp Adapter: IoTHub client call to _SendEventAsync failed, error=%d", result);
+        LogError("Serial Pnp Adapter: PnpBridgeClient_SendTelemetry failed, error=%d", result);
     }
 
-    IoTHubMessage_Destroy(messageHandle);
+    if (telemetryMessageData != messageBuffer)
+    {
+        free(telemetryMessageData);
+    }
 
     return result;
 }
@@ -1317,7 +2077,6 @@ static void SerialPnp_PropertyUpdateHandler(
     IOTHUB_CLIENT_RESULT iothubClientResult;
     PSERIAL_DEVICE_CONTEXT deviceContext = PnpComponentHandleGetContext(PnpComponentHandle);
 
-    STRING_HANDLE jsonToSend = NULL;
     const char * PropertyValueString = json_value_get_string(PropertyValue);
     size_t PropertyValueLen = strlen(PropertyValueString);
 
@@ -1325,42 +2084,60 @@ static void SerialPnp_PropertyUpdateHandler(
 
     if (NULL != deviceContext)
     {
-        LIST_ITEM_HANDLE interfaceDefHandle = singlylinkedlist_get_head_item(deviceContext->InterfaceDefinitions);
-        const InterfaceDefinition* interfaceDef = singlylinkedlist_item_get_value(interfaceDefHandle);
-
-        propertyCount = SerialPnp_GetListCount(interfaceDef->Properties);
+        propertyCount = (int)SerialPnp_Dispatch_GetCount(deviceContext->Dispatch, 0, SERIALPNP_DISPATCH_PROPERTY);
 
         if ((PropertyName != NULL) && (PropertyValueString != NULL) && (propertyCount > 0))
         {
 
             LogInfo("Serial Pnp Adapter: Processed property. PropertyUpdated = %.*s", (int)PropertyValueLen, PropertyValueString);
 
-            SerialPnp_PropertyHandler(deviceContext, PropertyName, (char*) PropertyValueString);
+            // The written value is reported before it is sent to the device, so that the device's answer with the
+            // value it took is reported after it, and only if it differs. It goes through the same path as the
+            // device's own reports, so a reported property cache does not hold a value the twin no longer has.
+            // It is reported as the device's answer would be formatted, so an answer with the same value matches.
+            const PropertyDefinition* prop = SerialPnp_LookupProperty(deviceContext, PropertyName, 0);
+            char valueBuffer[SERIALPNP_MAX_VALUE_STRING_LENGTH];
+            char* reportedValue = (char*)PropertyValueString;
+            if (NULL != prop)
+            {
+                int binaryLength = 0;
+                byte* binaryValue = SerialPnp_StringSchemaToBinary(prop->DataSchema, (byte*)PropertyValueString,
+                    &binaryLength);
+                if (NULL != binaryValue)
+                {
+                    char* formattedValue = SerialPnp_FormatValue(prop->DataSchema, binaryValue, (DWORD)binaryLength,
+                        valueBuffer, sizeof(valueBuffer));
+                    if (NULL != formattedValue)
+                    {
+                        reportedValue = formattedValue;
+                    }
+                    free(binaryValue);
+                }
+            }
 
-            if ((jsonToSend = PnP_CreateReportedProperty(deviceContext->ComponentName, PropertyName, PropertyValueString)) == NULL)
+            if ((iothubClientResult = PnpBridgeClient_ReportProperty((PNP_BRIDGE_CLIENT_HANDLE)userContextCallback,
+                    deviceContext->ComponentName, PropertyName, reportedValue)) != IOTHUB_CLIENT_OK)
             {
-                LogError("Serial Pnp Adapter: Unable to build reported property response for propertyName=%s, propertyValue=%s",
-                    PropertyName, PropertyValueString);
+                LogError("Serial Pnp Adapter: Unable to send reported state for device property=%s, error=%d",
+                    PropertyName, iothubClientResult);
             }
             else
             {
-                const char* jsonToSendStr = STRING_c_str(jsonToSend);
-                size_t jsonToSendStrLen = strlen(jsonToSendStr);
+                LogInfo("Serial Pnp Adapter: Sending device information property to IoTHub. propertyName=%s, propertyValue=%s",
+                    PropertyName, reportedValue);
 
-                if ((iothubClientResult = PnpBridgeClient_SendReportedState((PNP_BRIDGE_CLIENT_HANDLE)userContextCallback, (const unsigned char*)jsonToSendStr, jsonToSendStrLen,
-                    NULL, NULL)) != IOTHUB_CLIENT_OK)
+                if (NULL != prop)
                 {
-                    LogError("Serial Pnp Adapter: Unable to send reported state for device property=%s, error=%d",
-                        PropertyName, iothubClientResult);
-                }
-                else
-                {
-                    LogInfo("Serial Pnp Adapter: Sending device information property to IoTHub. propertyName=%s, propertyValue=%s",
-                        PropertyName, PropertyValueString);
+                    SerialPnp_SetLastReportedValue(deviceContext, (PropertyDefinition*)prop, reportedValue);
                 }
+            }
 
-                STRING_delete(jsonToSend);
+            if ((reportedValue != PropertyValueString) && (reportedValue != valueBuffer))
+            {
+                free(reportedValue);
             }
+
+            SerialPnp_PropertyHandler(deviceContext, PropertyName, (char*) PropertyValueString);
         }
     }
 }
@@ -1401,9 +2178,7 @@ SerialPnp_CommandUpdateHandler(
     size_t* CommandResponseSize)
 {
     PSERIAL_DEVICE_CONTEXT deviceContext = PnpComponentHandleGetContext(PnpComponentHandle);
-    LIST_ITEM_HANDLE interfaceDefHandle = singlylinkedlist_get_head_item(deviceContext->InterfaceDefinitions);
-    const InterfaceDefinition* interfaceDef = singlylinkedlist_item_get_value(interfaceDefHandle);
-    int commandCount = SerialPnp_GetListCount(interfaceDef->Commands);
+    int commandCount = (int)SerialPnp_Dispatch_GetCount(deviceContext->Dispatch, 0, SERIALPNP_DISPATCH_COMMAND);
 
     char* response = NULL;
     char* requestData = (char*) json_value_get_string(CommandValue);
@@ -1433,6 +2208,27 @@ SerialPnp_StartPnpComponent(
 
     PnpComponentHandleSetContext(PnpComponentHandle, deviceContext);
 
+    // Events can only be decoded once the descriptor is parsed, and both threads read from the port
+    if (NULL != deviceContext->SerialDeviceWorker)
+    {
+        ThreadAPI_Join(deviceContext->SerialDeviceWorker, NULL);
+        deviceContext->SerialDeviceWorker = NULL;
+    }
+
+#ifndef WIN32
+    if (NULL != deviceContext->Reactor)
+    {
+        deviceContext->ReactorPort = SerialPnp_Reactor_AddPort(deviceContext->Reactor, deviceContext->hSerial,
+            SerialPnp_OnPortReadable, deviceContext);
+        if (NULL == deviceContext->ReactorPort)
+        {
+            LogError("Failed to add %s to the reactor", deviceContext->ComponentName);
+            return IOTHUB_CLIENT_ERROR;
+        }
+        return IOTHUB_CLIENT_OK;
+    }
+#endif
+
     // Start telemetry thread
     if (ThreadAPI_Create(&deviceContext->TelemetryWorkerHandle, SerialPnp_UartReceiver, deviceContext) != THREADAPI_OK) {
         LogError("ThreadAPI_Create failed");
@@ -1481,6 +2277,7 @@ void SerialPnp_FreeEventDefinition(
         free(e);
         eventItem = singlylinkedlist_get_next_item(eventItem);
     }
+    singlylinkedlist_destroy(events);
 }
 
 void SerialPnp_FreeCommandDefinition(
@@ -1499,6 +2296,7 @@ void SerialPnp_FreeCommandDefinition(
         free(c);
         cmdItem = singlylinkedlist_get_next_item(cmdItem);
     }
+    singlylinkedlist_destroy(cmds);
 }
 
 void SerialPnp_FreePropertiesDefinition(
@@ -1521,6 +2319,7 @@ void SerialPnp_FreePropertiesDefinition(
         free(p);
         propItem = singlylinkedlist_get_next_item(propItem);
     }
+    singlylinkedlist_destroy(props);
 }
 
 IOTHUB_CLIENT_RESULT SerialPnp_StopPnpComponent(
@@ -1547,15 +2346,123 @@ IOTHUB_CLIENT_RESULT SerialPnp_StopPnpComponent(
         CloseHandle(deviceContext->osReader.hEvent);
     }
 #else
+    if (NULL != deviceContext->ReactorPort)
+    {
+        // The reactor stops calling back before the port is closed
+        SerialPnp_Reactor_RemovePort(deviceContext->ReactorPort);
+        deviceContext->ReactorPort = NULL;
+        SerialPnp_FailOutstandingCommands(deviceContext);
+    }
     if (0 < deviceContext->hSerial)
     {
         close(deviceContext->hSerial);
     }
 #endif
-    ThreadAPI_Join(deviceContext->TelemetryWorkerHandle, NULL);
+    if (NULL != deviceContext->TelemetryWorkerHandle)
+    {
+        ThreadAPI_Join(deviceContext->TelemetryWorkerHandle, NULL);
+        deviceContext->TelemetryWorkerHandle = NULL;
+    }
+    return IOTHUB_CLIENT_OK;
+}
+
+// SerialPnp_GetDescriptorCachePath names the cache file of a port after the configured prefix, with characters of
+// the port name that cannot be part of a file name replaced
+static char* SerialPnp_GetDescriptorCachePath(
+    const char* cachePathPrefix,
+    const char* port)
+{
+    char path[SERIALPNP_DESCRIPTOR_CACHE_MAX_PATH];
+    int pathLength = snprintf(path, sizeof(path), "%s-", cachePathPrefix);
+    if (pathLength < 0 || pathLength >= (int)sizeof(path) - 1)
+    {
+        LogError("Descriptor cache path for %s is too long, descriptor is not cached", port);
+        return NULL;
+    }
+
+    for (const char* c = port; '\0' != *c && pathLength < (int)sizeof(path) - 1; c++)
+    {
+        path[pathLength++] = (isalnum((unsigned char)*c) || '.' == *c || '-' == *c) ? *c : '_';
+    }
+    path[pathLength] = '\0';
+
+    if (pathLength >= (int)sizeof(path) - 1 ||
+        snprintf(path + pathLength, sizeof(path) - pathLength, ".desc") >= (int)(sizeof(path) - pathLength))
+    {
+        LogError("Descriptor cache path for %s is too long, descriptor is not cached", port);
+        return NULL;
+    }
+
+    char* cachePath = NULL;
+    if (0 != mallocAndStrcpy_s(&cachePath, path))
+    {
+        LogError("Error out of memory");
+        return NULL;
+    }
+    return cachePath;
+}
+
+static IOTHUB_CLIENT_RESULT SerialPnp_InitCommandState(
+    PSERIAL_DEVICE_CONTEXT deviceContext)
+{
+    deviceContext->CommandLock = Lock_Init();
+    deviceContext->CommandResponseWaitLock = Lock_Init();
+    deviceContext->CommandSlotCondition = Condition_Init();
+    deviceContext->PropertyLock = Lock_Init();
+    deviceContext->CommandClock = tickcounter_create();
+    if (NULL == deviceContext->CommandLock ||
+        NULL == deviceContext->CommandResponseWaitLock ||
+        NULL == deviceContext->CommandSlotCondition ||
+        NULL == deviceContext->PropertyLock ||
+        NULL == deviceContext->CommandClock)
+    {
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    for (int i = 0; i < SERIALPNP_MAX_OUTSTANDING_COMMANDS; i++)
+    {
+        deviceContext->OutstandingCommands[i].ResponseCondition = Condition_Init();
+        if (NULL == deviceContext->OutstandingCommands[i].ResponseCondition)
+        {
+            return IOTHUB_CLIENT_ERROR;
+        }
+    }
+
     return IOTHUB_CLIENT_OK;
 }
 
+static void SerialPnp_DeinitCommandState(
+    PSERIAL_DEVICE_CONTEXT deviceContext)
+{
+    for (int i = 0; i < SERIALPNP_MAX_OUTSTANDING_COMMANDS; i++)
+    {
+        if (NULL != deviceContext->OutstandingCommands[i].ResponseCondition)
+        {
+            Condition_Deinit(deviceContext->OutstandingCommands[i].ResponseCondition);
+        }
+    }
+    if (NULL != deviceContext->CommandClock)
+    {
+        tickcounter_destroy(deviceContext->CommandClock);
+    }
+    if (NULL != deviceContext->PropertyLock)
+    {
+        Lock_Deinit(deviceContext->PropertyLock);
+    }
+    if (NULL != deviceContext->CommandSlotCondition)
+    {
+        Condition_Deinit(deviceContext->CommandSlotCondition);
+    }
+    if (NULL != deviceContext->CommandResponseWaitLock)
+    {
+        Lock_Deinit(deviceContext->CommandResponseWaitLock);
+    }
+    if (NULL != deviceContext->CommandLock)
+    {
+        Lock_Deinit(deviceContext->CommandLock);
+    }
+}
+
 IOTHUB_CLIENT_RESULT SerialPnp_DestroyPnpComponent(
     PNPBRIDGE_COMPONENT_HANDLE PnpComponentHandle)
 {
@@ -1565,6 +2472,8 @@ IOTHUB_CLIENT_RESULT SerialPnp_DestroyPnpComponent(
         return IOTHUB_CLIENT_OK;
     }
 
+    SerialPnp_Dispatch_Destroy(deviceContext->Dispatch);
+
     if (deviceContext->InterfaceDefinitions)
     {
         LIST_ITEM_HANDLE interfaceItem = singlylinkedlist_get_head_item(deviceContext->InterfaceDefinitions);
@@ -1590,6 +2499,12 @@ IOTHUB_CLIENT_RESULT SerialPnp_DestroyPnpComponent(
         free(deviceContext->ComponentName);
     }
 
+    if (deviceContext->DescriptorCachePath)
+    {
+        free(deviceContext->DescriptorCachePath);
+    }
+
+    SerialPnp_DeinitCommandState(deviceContext);
     free(deviceContext);
 
     return IOTHUB_CLIENT_OK;
@@ -1602,7 +2517,6 @@ SerialPnp_CreatePnpComponent(
     const JSON_Object* AdapterComponentConfig,
     PNPBRIDGE_COMPONENT_HANDLE BridgeComponentHandle)
 {
-    AZURE_UNREFERENCED_PARAMETER(AdapterHandle);
     IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
 
     if (strlen(ComponentName) > PNP_MAXIMUM_COMPONENT_LENGTH)
@@ -1680,33 +2594,30 @@ SerialPnp_CreatePnpComponent(
     }
     memset(deviceContext, 0, sizeof(SERIAL_DEVICE_CONTEXT));
     mallocAndStrcpy_s((char**)&deviceContext->ComponentName, ComponentName);
-    deviceContext->RxBufferIndex = 0;
-    deviceContext->RxEscaped = false;
+    SerialPnp_RxDecoder_Init(&deviceContext->RxDecoder, deviceContext->RxBuffer, sizeof(deviceContext->RxBuffer));
 
-    deviceContext->CommandLock = Lock_Init();
-    deviceContext->CommandResponseWaitLock = Lock_Init();
-    deviceContext->CommandResponseWaitCondition = Condition_Init();
-    if (NULL == deviceContext->CommandLock ||
-        NULL == deviceContext->CommandResponseWaitLock ||
-        NULL == deviceContext->CommandResponseWaitCondition)
+    if (IOTHUB_CLIENT_OK != SerialPnp_InitCommandState(deviceContext))
     {
-        if (NULL != deviceContext->CommandLock)
-        {
-            Lock_Deinit(deviceContext->CommandLock);
-        }
-        if (NULL != deviceContext->CommandResponseWaitLock)
-        {
-            Lock_Deinit(deviceContext->CommandResponseWaitLock);
-        }
-        if (NULL != deviceContext->CommandResponseWaitCondition)
-        {
-            Lock_Deinit(deviceContext->CommandResponseWaitCondition);
-        }
+        LogError("Failed to initialize command state");
+        SerialPnp_DeinitCommandState(deviceContext);
+        free(deviceContext->ComponentName);
+        free(deviceContext);
         result = IOTHUB_CLIENT_ERROR;
         goto exit;
     }
     deviceContext->InterfaceDefinitions = singlylinkedlist_create();
 
+    PSERIAL_ADAPTER_CONTEXT adapterContext = PnpAdapterHandleGetContext(AdapterHandle);
+    if (NULL != adapterContext)
+    {
+        if (NULL != adapterContext->DescriptorCachePath)
+        {
+            deviceContext->DescriptorCachePath = SerialPnp_GetDescriptorCachePath(adapterContext->DescriptorCachePath,
+                useComDeviceInterface ? seriaDevice->InterfaceName : port);
+        }
+        deviceContext->Reactor = adapterContext->Reactor;
+    }
+
     // Open device and store handle in device context
     result = SerialPnp_OpenDevice(useComDeviceInterface ? seriaDevice->InterfaceName : port, baudRate, deviceContext);
 
@@ -1739,19 +2650,62 @@ exit:
     return result;
 }
 
+IOTHUB_CLIENT_RESULT SerialPnp_DestroyPnpAdapter(
+    PNPBRIDGE_ADAPTER_HANDLE AdapterHandle);
+
 IOTHUB_CLIENT_RESULT SerialPnp_CreatePnpAdapter(
     const JSON_Object* AdapterGlobalConfig,
     PNPBRIDGE_ADAPTER_HANDLE AdapterHandle)
 {
-    AZURE_UNREFERENCED_PARAMETER(AdapterGlobalConfig);
-    AZURE_UNREFERENCED_PARAMETER(AdapterHandle);
+    PSERIAL_ADAPTER_CONTEXT adapterContext = calloc(1, sizeof(SERIAL_ADAPTER_CONTEXT));
+    if (NULL == adapterContext)
+    {
+        LogError("Error out of memory");
+        return IOTHUB_CLIENT_ERROR;
+    }
+    PnpAdapterHandleSetContext(AdapterHandle, adapterContext);
+
+    // Descriptors are not cached without a cache path prefix
+    const char* cachePath = json_object_dotget_string(AdapterGlobalConfig, PNP_CONFIG_ADAPTER_SERIALPNP_DESCRIPTOR_CACHE_PATH);
+    if (NULL != cachePath && 0 != mallocAndStrcpy_s(&adapterContext->DescriptorCachePath, cachePath))
+    {
+        LogError("Error out of memory");
+        SerialPnp_DestroyPnpAdapter(AdapterHandle);
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    // Without reactor threads, every port has a thread of its own reading it
+    const char* reactorThreads = json_object_dotget_string(AdapterGlobalConfig, PNP_CONFIG_ADAPTER_SERIALPNP_REACTOR_THREADS);
+    if (NULL != reactorThreads && 0 < atoi(reactorThreads))
+    {
+#ifdef WIN32
+        LogError("Serial PnP reactor threads are not supported on Windows, every port is read by a thread of its own");
+#else
+        if (NULL == (adapterContext->Reactor = SerialPnp_Reactor_Create((size_t)atoi(reactorThreads))))
+        {
+            LogError("Failed to start %s reactor threads", reactorThreads);
+            SerialPnp_DestroyPnpAdapter(AdapterHandle);
+            return IOTHUB_CLIENT_ERROR;
+        }
+        LogInfo("Serial PnP ports are read by %s reactor threads", reactorThreads);
+#endif
+    }
     return IOTHUB_CLIENT_OK;
 }
 
 IOTHUB_CLIENT_RESULT SerialPnp_DestroyPnpAdapter(
     PNPBRIDGE_ADAPTER_HANDLE AdapterHandle)
 {
-    AZURE_UNREFERENCED_PARAMETER(AdapterHandle);
+    PSERIAL_ADAPTER_CONTEXT adapterContext = PnpAdapterHandleGetContext(AdapterHandle);
+    if (NULL != adapterContext)
+    {
+#ifndef WIN32
+        SerialPnp_Reactor_Destroy(adapterContext->Reactor);
+#endif
+        free(adapterContext->DescriptorCachePath);
+        free(adapterContext);
+        PnpAdapterHandleSetContext(AdapterHandle, NULL);
+    }
     return IOTHUB_CLIENT_OK;
 }
 
@@ -3,22 +3,40 @@
 #pragma once
 #include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/tickcounter.h"
 
-#define MAX_BUFFER_SIZE 4096
+#include "serial_pnp_dispatch.h"
+#include "serial_pnp_format.h"
+#include "serial_pnp_framing.h"
+#include "serial_pnp_reactor.h"
 
 #define SERIALPNP_RESET_OR_DESCRIPTOR_MAX_RETRIES 3
 
-#define SERIALPNP_MIN_PACKET_LENGTH 4
-#define SERIALPNP_START_OF_FRAME_BYTE 0x5A
-#define SERIALPNP_ESCAPE_BYTE         0xEF
+// Commands in flight per device once the device has shown it echoes request IDs. Until then commands are sent
+// one at a time, as firmware that ignores the request ID answers them.
+#define SERIALPNP_MAX_OUTSTANDING_COMMANDS 16
+#define SERIALPNP_COMMAND_TIMEOUT_MS       60000
+
+// Time a device is given to answer a descriptor hash request. Firmware that does not support it never answers.
+#define SERIALPNP_DESCRIPTOR_HASH_TIMEOUT_MS 500
+#define SERIALPNP_DESCRIPTOR_CACHE_MAX_PATH  512
+
+// Frames are sent straight from the packet, escaped a piece at a time: on Linux as at most this many iovecs per
+// writev, on Windows through a buffer of this many bytes per write.
+#define SERIALPNP_TX_SEGMENT_COUNT 64
+#define SERIALPNP_TX_CHUNK_SIZE    256
 
 // Offsets of fields within the packet relative to the start of packet
 #define SERIALPNP_PACKET_PACKET_LENGTH_OFFSET    0
 #define SERIALPNP_PACKET_PACKET_TYPE_OFFSET      2
+#define SERIALPNP_PACKET_REQUEST_ID_OFFSET       3
 #define SERIALPNP_PACKET_PAYLOAD_OFFSET          4
 #define SERIALPNP_PACKET_INTERFACE_NUMBER_OFFSET 4
 #define SERIALPNP_PACKET_NAME_LENGTH_OFFSET      5
 #define SERIALPNP_PACKET_NAME_OFFSET             6
+// An event or property notification whose name length is 0 carries the event's or property's position in the
+// interface descriptor, in the byte where the name would start
+#define SERIALPNP_PACKET_NOTIFICATION_INDEX_OFFSET 6
 
 // Offsets of fields within the packet relative to the start of payload
 #define SERIALPNP_PAYLOAD_INTERFACE_NUMBER_OFFSET 0
@@ -35,6 +53,15 @@
 #define SERIALPNP_PACKET_TYPE_PROPERTY_REQUEST      0x07
 #define SERIALPNP_PACKET_TYPE_PROPERTY_NOTIFICATION 0x08
 #define SERIALPNP_PACKET_TYPE_EVENT_NOTIFICATION    0x0A
+#define SERIALPNP_PACKET_TYPE_DESCRIPTOR_HASH_REQUEST  0x0B
+#define SERIALPNP_PACKET_TYPE_DESCRIPTOR_HASH_RESPONSE 0x0C
+#define SERIALPNP_PACKET_TYPE_EVENT_BATCH_NOTIFICATION 0x0D
+
+// Event batch payload: the interface number, followed by one entry per event (see serial_pnp_format.h)
+#define SERIALPNP_PAYLOAD_EVENT_BATCH_ENTRIES_OFFSET 1
+
+// Descriptor hash response payload: FNV-1a hash of the descriptor payload, LSB first
+#define SERIALPNP_DESCRIPTOR_HASH_RESPONSE_LENGTH (SERIALPNP_PACKET_PAYLOAD_OFFSET + 4)
 
 #ifdef __cplusplus
 extern "C"
@@ -48,18 +75,6 @@ extern "C"
         byte PacketType;
     } SerialPnPPacketHeader;
 
-    typedef enum Schema
-    {
-        Invalid = 0,
-        Byte,
-        Float,
-        Double,
-        Int,
-        Long,
-        Boolean,
-        String
-    } Schema;
-
     typedef struct FieldDefinition
     {
         char* Name;
@@ -82,6 +97,8 @@ extern "C"
         bool Required;
         bool Writeable;
         Schema DataSchema;
+        // Value last reported for the property, "" until it is first reported. Guarded by the device's PropertyLock.
+        char LastReportedValue[SERIALPNP_MAX_VALUE_STRING_LENGTH];
     } PropertyDefinition;
 
     typedef struct CommandDefinition
@@ -100,6 +117,20 @@ extern "C"
         SINGLYLINKEDLIST_HANDLE Commands;
     } InterfaceDefinition;
 
+    // A command sent to the device and waiting for its response. Request ID 0 is never used, it is what firmware
+    // that ignores the request ID sends back.
+    typedef struct SERIALPNP_OUTSTANDING_COMMAND {
+        bool InUse;
+        bool Completed;
+        byte RequestId;
+        unsigned int Sequence;      // order the command was sent in, to match responses without a request ID
+        const char* Name;
+        byte NameLength;
+        byte* Response;             // response packet, owned by the waiting command once Completed
+        DWORD ResponseLength;
+        COND_HANDLE ResponseCondition;
+    } SERIALPNP_OUTSTANDING_COMMAND;
+
     typedef enum DefinitionType {
         Telemetry,
         Property,
@@ -111,28 +142,56 @@ extern "C"
         PNP_BRIDGE_CLIENT_HANDLE ClientHandle;
         PNP_BRIDGE_IOT_TYPE ClientType;
         char * ComponentName;
-        byte RxBuffer[MAX_BUFFER_SIZE]; // Temporary buffer that gets filled by the reading thread. TODO: maximum buffer size
-        byte* pbMainBuffer;             // pointer used to pass buffers back to the main thread
-        LOCK_HANDLE CommandLock;
-        LOCK_HANDLE CommandResponseWaitLock;
-        COND_HANDLE CommandResponseWaitCondition;
+        SERIALPNP_RX_DECODER RxDecoder; // Receive framing state, filled by the reading thread
+        byte RxBuffer[SERIALPNP_RX_BUFFER_SIZE]; // frames are read into and decoded in place in this buffer
+        LOCK_HANDLE CommandLock;             // serializes writes to the port
+        LOCK_HANDLE CommandResponseWaitLock; // guards the outstanding command table
+        COND_HANDLE CommandSlotCondition;    // posted when an outstanding command slot is released
+        LOCK_HANDLE PropertyLock;            // guards the last reported values of the device's properties
+        SERIALPNP_OUTSTANDING_COMMAND OutstandingCommands[SERIALPNP_MAX_OUTSTANDING_COMMANDS];
+        size_t OutstandingCommandCount;
+        byte NextRequestId;
+        unsigned int NextCommandSequence;
+        bool RequestIdsEchoed;               // a response carried a request ID, so commands can be pipelined
+        bool ReceiverStopped;                // the port was closed, no more responses will arrive
+        TICK_COUNTER_HANDLE CommandClock;
+        char* DescriptorCachePath;           // file the parsed descriptor is cached in, NULL if caching is off
 #ifdef WIN32
         OVERLAPPED osReader;
         OVERLAPPED osWriter;
 #endif
-        unsigned int RxBufferIndex;
-        bool RxEscaped;
         THREAD_HANDLE SerialDeviceWorker;
         THREAD_HANDLE TelemetryWorkerHandle;
+        SERIALPNP_REACTOR_HANDLE Reactor;            // reads the port once started, NULL if a thread of its own does
+        SERIALPNP_REACTOR_PORT_HANDLE ReactorPort;
         // list of interface definitions on this serial device
         SINGLYLINKEDLIST_HANDLE InterfaceDefinitions;
+        // name and index lookup of InterfaceDefinitions, NULL until the descriptor is parsed
+        SERIALPNP_DISPATCH_HANDLE Dispatch;
     } SERIAL_DEVICE_CONTEXT, *PSERIAL_DEVICE_CONTEXT;
 
+    // Adapter context, shared by the components of the adapter
+    typedef struct _SERIAL_ADAPTER_CONTEXT {
+        char* DescriptorCachePath;           // prefix of descriptor cache files, NULL if caching is off
+        SERIALPNP_REACTOR_HANDLE Reactor;    // NULL if every port has a receiving thread of its own
+    } SERIAL_ADAPTER_CONTEXT, *PSERIAL_ADAPTER_CONTEXT;
+
+    // Waits for a packet of packetType, or of any type if packetType is 0. A timeoutMs of 0 waits until the port
+    // is closed. The packet is decoded in place, *receivedPacket points into RxBuffer until the next read.
+    IOTHUB_CLIENT_RESULT SerialPnp_ReadPacket(
+        PSERIAL_DEVICE_CONTEXT serialDevice,
+        const byte** receivedPacket,
+        DWORD* length,
+        char packetType,
+        int timeoutMs);
+
+    // As SerialPnp_ReadPacket, but returns a copy of the packet the caller frees
     IOTHUB_CLIENT_RESULT SerialPnp_RxPacket(
         PSERIAL_DEVICE_CONTEXT serialDevice,
         byte** receivedPacket,
         DWORD* length,
-        char packetType);
+        char packetType,
+        int timeoutMs);
 
     IOTHUB_CLIENT_RESULT SerialPnp_TxPacket(
         PSERIAL_DEVICE_CONTEXT serialDevice,
@@ -162,6 +221,8 @@ extern "C"
         char* TelemetryData);
 
     // Serial Pnp Adapter Config
+    #define PNP_CONFIG_ADAPTER_SERIALPNP_DESCRIPTOR_CACHE_PATH "descriptor_cache_path"
+    #define PNP_CONFIG_ADAPTER_SERIALPNP_REACTOR_THREADS "reactor_threads"
     #define PNP_CONFIG_ADAPTER_SERIALPNP_COMPORT "com_port"
     #define PNP_CONFIG_ADAPTER_SERIALPNP_USEDEFAULT "use_com_device_interface"
     #define PNP_CONFIG_ADAPTER_SERIALPNP_BAUDRATE "baud_rate"
@@ -0,0 +1,234 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "serial_pnp_dispatch.h"
+
+// Smallest number of name index slots of a non-empty table
+#define SERIALPNP_DISPATCH_MIN_SLOTS 4
+
+typedef struct _SERIALPNP_DISPATCH_ENTRY {
+    const char* Name;
+    size_t NameLength;
+    uint32_t Hash;
+    const void* Definition;
+} SERIALPNP_DISPATCH_ENTRY;
+
+typedef struct _SERIALPNP_DISPATCH_TABLE {
+    SERIALPNP_DISPATCH_ENTRY* Entries;  // in the order they were added, an entry's position is its index
+    size_t Count;
+    size_t Capacity;
+    // Open addressed name index with linear probing. Each slot holds an entry's index plus one, 0 when the slot
+    // is empty. The number of slots is a power of two of at least twice the capacity, so probes stay short.
+    uint16_t* Slots;
+    size_t SlotMask;
+} SERIALPNP_DISPATCH_TABLE;
+
+typedef struct _SERIALPNP_DISPATCH {
+    size_t InterfaceCount;
+    SERIALPNP_DISPATCH_TABLE* Tables;   // SERIALPNP_DISPATCH_KIND_COUNT tables per interface
+} SERIALPNP_DISPATCH;
+
+static uint32_t SerialPnp_Dispatch_Hash(
+    const char* name,
+    size_t nameLength)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < nameLength; i++)
+    {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t SerialPnp_Dispatch_GetSlotCount(
+    size_t capacity)
+{
+    size_t slots = SERIALPNP_DISPATCH_MIN_SLOTS;
+
+    if (0 == capacity)
+    {
+        return 0;
+    }
+
+    while (slots < capacity * 2)
+    {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+static SERIALPNP_DISPATCH_TABLE* SerialPnp_Dispatch_GetTable(
+    SERIALPNP_DISPATCH_HANDLE dispatch,
+    size_t interfaceIndex,
+    SERIALPNP_DISPATCH_KIND kind)
+{
+    if ((NULL == dispatch) || (interfaceIndex >= dispatch->InterfaceCount) ||
+        ((unsigned int)kind >= SERIALPNP_DISPATCH_KIND_COUNT))
+    {
+        return NULL;
+    }
+    return &dispatch->Tables[interfaceIndex * SERIALPNP_DISPATCH_KIND_COUNT + kind];
+}
+
+// Returns the slot holding name or, if name is not in the table, the empty slot where it would go
+static uint16_t* SerialPnp_Dispatch_FindSlot(
+    SERIALPNP_DISPATCH_TABLE* table,
+    const char* name,
+    size_t nameLength,
+    uint32_t hash)
+{
+    size_t slot = hash & table->SlotMask;
+
+    while (0 != table->Slots[slot])
+    {
+        const SERIALPNP_DISPATCH_ENTRY* entry = &table->Entries[table->Slots[slot] - 1];
+        if ((entry->Hash == hash) && (entry->NameLength == nameLength) &&
+            (0 == memcmp(entry->Name, name, nameLength)))
+        {
+            break;
+        }
+        slot = (slot + 1) & table->SlotMask;
+    }
+
+    return &table->Slots[slot];
+}
+
+SERIALPNP_DISPATCH_HANDLE SerialPnp_Dispatch_Create(
+    const SERIALPNP_DISPATCH_INTERFACE_SIZE* interfaceSizes,
+    size_t interfaceCount)
+{
+    size_t tableCount = interfaceCount * SERIALPNP_DISPATCH_KIND_COUNT;
+    size_t entryCount = 0;
+    size_t slotCount = 0;
+
+    for (size_t i = 0; i < interfaceCount; i++)
+    {
+        for (int kind = 0; kind < SERIALPNP_DISPATCH_KIND_COUNT; kind++)
+        {
+            size_t count = interfaceSizes[i].Counts[kind];
+            if (count >= UINT16_MAX)
+            {
+                return NULL;
+            }
+            entryCount += count;
+            slotCount += SerialPnp_Dispatch_GetSlotCount(count);
+        }
+    }
+
+    // Header, tables, entries and slots, in that order, so that every part is suitably aligned
+    size_t size = sizeof(SERIALPNP_DISPATCH) + tableCount * sizeof(SERIALPNP_DISPATCH_TABLE) +
+        entryCount * sizeof(SERIALPNP_DISPATCH_ENTRY) + slotCount * sizeof(uint16_t);
+    SERIALPNP_DISPATCH* dispatch = calloc(1, size);
+    if (NULL == dispatch)
+    {
+        return NULL;
+    }
+
+    dispatch->InterfaceCount = interfaceCount;
+    dispatch->Tables = (SERIALPNP_DISPATCH_TABLE*)(dispatch + 1);
+
+    SERIALPNP_DISPATCH_ENTRY* entries = (SERIALPNP_DISPATCH_ENTRY*)(dispatch->Tables + tableCount);
+    uint16_t* slots = (uint16_t*)(entries + entryCount);
+
+    for (size_t i = 0; i < interfaceCount; i++)
+    {
+        for (int kind = 0; kind < SERIALPNP_DISPATCH_KIND_COUNT; kind++)
+        {
+            SERIALPNP_DISPATCH_TABLE* table = &dispatch->Tables[i * SERIALPNP_DISPATCH_KIND_COUNT + kind];
+            size_t tableSlots = SerialPnp_Dispatch_GetSlotCount(interfaceSizes[i].Counts[kind]);
+
+            table->Entries = entries;
+            table->Capacity = interfaceSizes[i].Counts[kind];
+            table->Slots = slots;
+            table->SlotMask = (0 == tableSlots) ? 0 : tableSlots - 1;
+
+            entries += table->Capacity;
+            slots += tableSlots;
+        }
+    }
+
+    return dispatch;
+}
+
+void SerialPnp_Dispatch_Destroy(
+    SERIALPNP_DISPATCH_HANDLE dispatch)
+{
+    free(dispatch);
+}
+
+bool SerialPnp_Dispatch_Add(
+    SERIALPNP_DISPATCH_HANDLE dispatch,
+    size_t interfaceIndex,
+    SERIALPNP_DISPATCH_KIND kind,
+    const char* name,
+    const void* definition)
+{
+    SERIALPNP_DISPATCH_TABLE* table = SerialPnp_Dispatch_GetTable(dispatch, interfaceIndex, kind);
+    if ((NULL == table) || (NULL == name) || (table->Count == table->Capacity))
+    {
+        return false;
+    }
+
+    size_t nameLength = strlen(name);
+    uint32_t hash = SerialPnp_Dispatch_Hash(name, nameLength);
+    uint16_t* slot = SerialPnp_Dispatch_FindSlot(table, name, nameLength, hash);
+
+    SERIALPNP_DISPATCH_ENTRY* entry = &table->Entries[table->Count];
+    entry->Name = name;
+    entry->NameLength = nameLength;
+    entry->Hash = hash;
+    entry->Definition = definition;
+    table->Count++;
+
+    // A repeated name keeps resolving to its first definition, the later one is only reachable by index
+    if (0 == *slot)
+    {
+        *slot = (uint16_t)table->Count;
+    }
+    return true;
+}
+
+const void* SerialPnp_Dispatch_FindByName(
+    SERIALPNP_DISPATCH_HANDLE dispatch,
+    size_t interfaceIndex,
+    SERIALPNP_DISPATCH_KIND kind,
+    const char* name,
+    size_t nameLength)
+{
+    SERIALPNP_DISPATCH_TABLE* table = SerialPnp_Dispatch_GetTable(dispatch, interfaceIndex, kind);
+    if ((NULL == table) || (NULL == name) || (0 == table->Count))
+    {
+        return NULL;
+    }
+
+    uint16_t* slot = SerialPnp_Dispatch_FindSlot(table, name, nameLength, SerialPnp_Dispatch_Hash(name, nameLength));
+    return (0 == *slot) ? NULL : table->Entries[*slot - 1].Definition;
+}
+
+const void* SerialPnp_Dispatch_FindByIndex(
+    SERIALPNP_DISPATCH_HANDLE dispatch,
+    size_t interfaceIndex,
+    SERIALPNP_DISPATCH_KIND kind,
+    size_t index)
+{
+    SERIALPNP_DISPATCH_TABLE* table = SerialPnp_Dispatch_GetTable(dispatch, interfaceIndex, kind);
+    if ((NULL == table) || (index >= table->Count))
+    {
+        return NULL;
+    }
+
+    return table->Entries[index].Definition;
+}
+
+size_t SerialPnp_Dispatch_GetCount(
+    SERIALPNP_DISPATCH_HANDLE dispatch,
+    size_t interfaceIndex,
+    SERIALPNP_DISPATCH_KIND kind)
+{
+    SERIALPNP_DISPATCH_TABLE* table = SerialPnp_Dispatch_GetTable(dispatch, interfaceIndex, kind);
+    return (NULL == table) ? 0 : table->Count;
+}
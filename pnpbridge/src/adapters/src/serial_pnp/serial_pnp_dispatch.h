@@ -0,0 +1,84 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+//
+// Serial PnP dispatch tables. Once a device descriptor is parsed, the events, properties and commands of each
+// interface are laid out in flat tables, in the order the descriptor lists them, so that they can be resolved
+// either by their position in that order or by name through an open addressed FNV-1a index. Everything is held
+// in one allocation made when the tables are created.
+//
+// Lookups take the name as a (pointer, length) pair so that names can be resolved straight out of a received
+// packet, without copying them or terminating them.
+//
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef enum SERIALPNP_DISPATCH_KIND
+    {
+        SERIALPNP_DISPATCH_EVENT = 0,
+        SERIALPNP_DISPATCH_PROPERTY,
+        SERIALPNP_DISPATCH_COMMAND,
+        SERIALPNP_DISPATCH_KIND_COUNT
+    } SERIALPNP_DISPATCH_KIND;
+
+    // Number of entries of each kind an interface has room for
+    typedef struct _SERIALPNP_DISPATCH_INTERFACE_SIZE {
+        size_t Counts[SERIALPNP_DISPATCH_KIND_COUNT];
+    } SERIALPNP_DISPATCH_INTERFACE_SIZE;
+
+    typedef struct _SERIALPNP_DISPATCH* SERIALPNP_DISPATCH_HANDLE;
+
+    // Allocates empty tables for interfaceCount interfaces, sized from interfaceSizes. Returns NULL if out of
+    // memory or if an interface has more than UINT16_MAX - 1 entries of one kind.
+    SERIALPNP_DISPATCH_HANDLE SerialPnp_Dispatch_Create(
+        const SERIALPNP_DISPATCH_INTERFACE_SIZE* interfaceSizes,
+        size_t interfaceCount);
+
+    // Frees the tables. Names and definitions added to them are not owned by the tables and are not freed.
+    void SerialPnp_Dispatch_Destroy(
+        SERIALPNP_DISPATCH_HANDLE dispatch);
+
+    // Appends definition to the table of the given kind in interface interfaceIndex. Its index is the number of
+    // entries of that kind added to the interface before it. name must stay valid for the lifetime of the tables.
+    // If the table already holds name, the name keeps resolving to the earlier definition.
+    // Returns false if the table is full.
+    bool SerialPnp_Dispatch_Add(
+        SERIALPNP_DISPATCH_HANDLE dispatch,
+        size_t interfaceIndex,
+        SERIALPNP_DISPATCH_KIND kind,
+        const char* name,
+        const void* definition);
+
+    // Returns the definition whose name is exactly the nameLength characters at name, or NULL if there is none.
+    const void* SerialPnp_Dispatch_FindByName(
+        SERIALPNP_DISPATCH_HANDLE dispatch,
+        size_t interfaceIndex,
+        SERIALPNP_DISPATCH_KIND kind,
+        const char* name,
+        size_t nameLength);
+
+    // Returns the definition at position index, or NULL if there is none.
+    const void* SerialPnp_Dispatch_FindByIndex(
+        SERIALPNP_DISPATCH_HANDLE dispatch,
+        size_t interfaceIndex,
+        SERIALPNP_DISPATCH_KIND kind,
+        size_t index);
+
+    // Returns the number of entries of the given kind added to interface interfaceIndex, 0 if dispatch is NULL.
+    size_t SerialPnp_Dispatch_GetCount(
+        SERIALPNP_DISPATCH_HANDLE dispatch,
+        size_t interfaceIndex,
+        SERIALPNP_DISPATCH_KIND kind);
+
+#ifdef __cplusplus
+}
+#endif
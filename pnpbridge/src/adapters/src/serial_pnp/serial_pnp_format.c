@@ -0,0 +1,224 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "serial_pnp_format.h"
+
+size_t SerialPnp_GetSchemaSize(
+    Schema schema)
+{
+    switch (schema)
+    {
+    case Byte:
+    case Boolean:
+        return 1;
+    case Float:
+    case Int:
+        return 4;
+    case Double:
+    case Long:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+size_t SerialPnp_GetFormattedLength(
+    Schema schema,
+    size_t length)
+{
+    return (String == schema) ? (2 + (6 * length) + 1) : SERIALPNP_MAX_VALUE_STRING_LENGTH;
+}
+
+// Formats a String value as a JSON string
+static void SerialPnp_FormatString(
+    const uint8_t* data,
+    size_t length,
+    char* rxstrdata)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    char* out = rxstrdata;
+
+    *out++ = '"';
+    for (size_t i = 0; (i < length) && (0 != data[i]); i++)
+    {
+        uint8_t c = data[i];
+        if (('"' == c) || ('\\' == c))
+        {
+            *out++ = '\\';
+            *out++ = (char)c;
+        }
+        else if (c < 0x20)
+        {
+            *out++ = '\\';
+            *out++ = 'u';
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = hexDigits[c >> 4];
+            *out++ = hexDigits[c & 0xF];
+        }
+        else
+        {
+            *out++ = (char)c;
+        }
+    }
+    *out++ = '"';
+    *out = '\0';
+}
+
+bool SerialPnp_FormatBinarySchema(
+    Schema schema,
+    const uint8_t* data,
+    size_t length,
+    char* rxstrdata,
+    size_t rxstrdataSize)
+{
+    size_t size = SerialPnp_GetSchemaSize(schema);
+
+    if (((String != schema) && ((0 == size) || (length < size))) ||
+        (rxstrdataSize < SerialPnp_GetFormattedLength(schema, length)))
+    {
+        return false;
+    }
+
+    // data points into a received packet, so it is copied out rather than read in place where it may be unaligned
+    if (Byte == schema)
+    {
+        (void)snprintf(rxstrdata, rxstrdataSize, "%u", (unsigned int)data[0]);
+    }
+    else if (Boolean == schema)
+    {
+        (void)snprintf(rxstrdata, rxstrdataSize, "%s", (0 != data[0]) ? "true" : "false");
+    }
+    else if (Float == schema)
+    {
+        float x;
+        memcpy(&x, data, sizeof(x));
+        // JSON has no infinities or NaNs
+        (void)snprintf(rxstrdata, rxstrdataSize, isfinite(x) ? "%.6f" : "null", x);
+    }
+    else if (Double == schema)
+    {
+        double x;
+        memcpy(&x, data, sizeof(x));
+        (void)snprintf(rxstrdata, rxstrdataSize, isfinite(x) ? "%.17g" : "null", x);
+    }
+    else if (Int == schema)
+    {
+        int32_t x;
+        memcpy(&x, data, sizeof(x));
+        (void)snprintf(rxstrdata, rxstrdataSize, "%" PRId32, x);
+    }
+    else if (Long == schema)
+    {
+        int64_t x;
+        memcpy(&x, data, sizeof(x));
+        (void)snprintf(rxstrdata, rxstrdataSize, "%" PRId64, x);
+    }
+    else
+    {
+        SerialPnp_FormatString(data, length, rxstrdata);
+    }
+
+    return true;
+}
+
+// Closes a message of batched events and sends it, unless it is empty
+static void SerialPnp_SendEventBatchMessage(
+    char* message,
+    size_t messageLength,
+    SERIALPNP_EVENT_BATCH_SEND send,
+    void* context)
+{
+    if (messageLength <= 1)
+    {
+        return;
+    }
+
+    message[messageLength++] = '}';
+    message[messageLength] = '\0';
+    send(context, message);
+}
+
+bool SerialPnp_FormatEventBatch(
+    const uint8_t* entries,
+    size_t length,
+    SERIALPNP_EVENT_BATCH_LOOKUP lookup,
+    SERIALPNP_EVENT_BATCH_SEND send,
+    void* context)
+{
+    char messageBuffer[SERIALPNP_TELEMETRY_MESSAGE_LENGTH];
+    char* message = messageBuffer;
+    size_t messageSize = 3; // {}, terminator
+    size_t messageLength = 0;
+    size_t offset;
+    const char* name;
+    Schema schema;
+
+    // First pass checks the entries fit and sizes the message
+    for (offset = 0; offset < length; offset += SERIALPNP_EVENT_BATCH_ENTRY_HEADER_LENGTH + entries[offset + 1])
+    {
+        if ((length - offset < SERIALPNP_EVENT_BATCH_ENTRY_HEADER_LENGTH) ||
+            (length - offset - SERIALPNP_EVENT_BATCH_ENTRY_HEADER_LENGTH < entries[offset + 1]))
+        {
+            return false;
+        }
+
+        if (lookup(context, entries[offset], &name, &schema))
+        {
+            // "name":value,
+            messageSize += strlen(name) + 4 + SerialPnp_GetFormattedLength(schema, entries[offset + 1]);
+        }
+    }
+
+    if (messageSize > sizeof(messageBuffer))
+    {
+        message = malloc(messageSize);
+        if (!message)
+        {
+            return false;
+        }
+    }
+
+    uint8_t batched[256 / 8] = { 0 };
+    message[messageLength++] = '{';
+    for (offset = 0; offset < length; offset += SERIALPNP_EVENT_BATCH_ENTRY_HEADER_LENGTH + entries[offset + 1])
+    {
+        uint8_t index = entries[offset];
+        if (!lookup(context, index, &name, &schema))
+        {
+            continue;
+        }
+
+        if (batched[index / 8] & (1 << (index % 8)))
+        {
+            SerialPnp_SendEventBatchMessage(message, messageLength, send, context);
+            memset(batched, 0, sizeof(batched));
+            messageLength = 1;
+        }
+
+        int nameLength = snprintf(message + messageLength, messageSize - messageLength, "%s\"%s\":",
+            (1 == messageLength) ? "" : ",", name);
+        if (!SerialPnp_FormatBinarySchema(schema, entries + offset + SERIALPNP_EVENT_BATCH_ENTRY_HEADER_LENGTH,
+                entries[offset + 1], message + messageLength + nameLength, messageSize - messageLength - nameLength))
+        {
+            message[messageLength] = '\0';
+            continue;
+        }
+        messageLength += strlen(message + messageLength);
+        batched[index / 8] |= (uint8_t)(1 << (index % 8));
+    }
+    SerialPnp_SendEventBatchMessage(message, messageLength, send, context);
+
+    if (message != messageBuffer)
+    {
+        free(message);
+    }
+
+    return true;
+}
@@ -0,0 +1,87 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+//
+// Serial PnP value formatting. Devices send event and property values in binary, LSB first, in the schema the
+// interface descriptor declares for them; they are formatted here as the JSON values they are reported with.
+// An event batch notification carries the values of several events, which are formatted into telemetry messages
+// of one JSON object each.
+//
+// Values are read straight out of a received packet, so they may be unaligned and are never assumed to be
+// terminated.
+//
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest value string a binary value of a fixed size schema is formatted as, -FLT_MAX with 6 decimals (47 characters
+// + 1) rounded up. String values can be longer and are formatted into an allocation when they do not fit.
+#define SERIALPNP_MAX_VALUE_STRING_LENGTH 64
+
+// Telemetry messages up to this long are built on the stack, longer ones (with long String values) are allocated
+#define SERIALPNP_TELEMETRY_MESSAGE_LENGTH 512
+
+// Event batch entries: the event's index in the interface descriptor, the value's length and the value
+#define SERIALPNP_EVENT_BATCH_ENTRY_HEADER_LENGTH 2
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef enum Schema
+    {
+        Invalid = 0,
+        Byte,
+        Float,
+        Double,
+        Int,
+        Long,
+        Boolean,
+        String
+    } Schema;
+
+    // Describes the event at position index of the batch's interface. Returns false if there is no such event.
+    typedef bool (*SERIALPNP_EVENT_BATCH_LOOKUP)(void* context, uint8_t index, const char** name, Schema* schema);
+
+    // Takes a telemetry message of batched events, a JSON object of at least one event
+    typedef void (*SERIALPNP_EVENT_BATCH_SEND)(void* context, const char* message);
+
+    // Size of a value of a fixed size schema on the wire, 0 for String, whose values take the rest of the field
+    size_t SerialPnp_GetSchemaSize(
+        Schema schema);
+
+    // Room SerialPnp_FormatBinarySchema needs to format a value of the given schema and length, including the
+    // terminator. String values are quoted and every byte may have to be escaped as \u00XX.
+    size_t SerialPnp_GetFormattedLength(
+        Schema schema,
+        size_t length);
+
+    // Formats a binary value as JSON. Values of fixed size schemas may be followed by padding, as the device
+    // library answers every command and property request with 4 bytes whatever the schema. A String value ends
+    // at the field's end or at a terminator, whichever comes first. Returns false if the value is too short for
+    // its schema or rxstrdataSize is less than SerialPnp_GetFormattedLength.
+    bool SerialPnp_FormatBinarySchema(
+        Schema schema,
+        const uint8_t* data,
+        size_t length,
+        char* rxstrdata,
+        size_t rxstrdataSize);
+
+    // Formats the length bytes of event batch entries at entries as telemetry messages and hands each to send.
+    // Entries lookup does not know of, or whose values cannot be formatted, are left out. An event batched more
+    // than once starts a new message, as a message holds one value per event. Returns false, having sent
+    // nothing, if an entry runs past the end of the entries or if out of memory.
+    bool SerialPnp_FormatEventBatch(
+        const uint8_t* entries,
+        size_t length,
+        SERIALPNP_EVENT_BATCH_LOOKUP lookup,
+        SERIALPNP_EVENT_BATCH_SEND send,
+        void* context);
+
+#ifdef __cplusplus
+}
+#endif
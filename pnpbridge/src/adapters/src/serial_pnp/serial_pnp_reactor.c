@@ -0,0 +1,308 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/lock.h"
+
+#include "serial_pnp_reactor.h"
+
+// Ready ports handled per wake up of a reactor thread
+#define SERIALPNP_REACTOR_MAX_EVENTS 64
+
+typedef struct _SERIALPNP_REACTOR_THREAD SERIALPNP_REACTOR_THREAD;
+
+typedef struct _SERIALPNP_REACTOR_PORT {
+    int Fd;
+    SERIALPNP_REACTOR_CALLBACK Callback;
+    void* Context;
+    SERIALPNP_REACTOR_THREAD* Thread;
+    bool Watching;                              // in the epoll set and still to be called back
+    struct _SERIALPNP_REACTOR_PORT* NextRetired;
+} SERIALPNP_REACTOR_PORT;
+
+struct _SERIALPNP_REACTOR_THREAD {
+    int EpollFd;
+    int WakeFd;                                 // eventfd in the epoll set, wakes the thread to free ports or stop
+    LOCK_HANDLE Lock;                           // held while callbacks run, guards everything below
+    size_t PortCount;
+    // Removed ports. An event for a port can already have been taken out of the epoll set when the port is
+    // removed, so removed ports are only freed by their thread, once it is done with the events it holds.
+    SERIALPNP_REACTOR_PORT* RetiredPorts;
+    bool Stopping;
+    THREAD_HANDLE Thread;
+};
+
+typedef struct _SERIALPNP_REACTOR {
+    size_t ThreadCount;
+    SERIALPNP_REACTOR_THREAD* Threads;
+} SERIALPNP_REACTOR;
+
+static void SerialPnp_Reactor_Wake(
+    SERIALPNP_REACTOR_THREAD* thread)
+{
+    uint64_t one = 1;
+    if (sizeof(one) != write(thread->WakeFd, &one, sizeof(one)))
+    {
+        LogError("Failed to wake reactor thread: %d", errno);
+    }
+}
+
+static void SerialPnp_Reactor_FreeRetiredPorts(
+    SERIALPNP_REACTOR_THREAD* thread)
+{
+    while (NULL != thread->RetiredPorts)
+    {
+        SERIALPNP_REACTOR_PORT* port = thread->RetiredPorts;
+        thread->RetiredPorts = port->NextRetired;
+        free(port);
+    }
+}
+
+static int SerialPnp_Reactor_Run(
+    void* context)
+{
+    SERIALPNP_REACTOR_THREAD* thread = context;
+    struct epoll_event events[SERIALPNP_REACTOR_MAX_EVENTS];
+    bool stopping = false;
+
+    while (!stopping)
+    {
+        int count = epoll_wait(thread->EpollFd, events, SERIALPNP_REACTOR_MAX_EVENTS, -1);
+        if (count < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            LogError("epoll_wait failed: %d", errno);
+            break;
+        }
+
+        Lock(thread->Lock);
+        for (int i = 0; i < count; i++)
+        {
+            SERIALPNP_REACTOR_PORT* port = events[i].data.ptr;
+            if (NULL == port)
+            {
+                uint64_t wakeCount;
+                (void)read(thread->WakeFd, &wakeCount, sizeof(wakeCount));
+                continue;
+            }
+
+            if (port->Watching && !port->Callback(port->Context))
+            {
+                (void)epoll_ctl(thread->EpollFd, EPOLL_CTL_DEL, port->Fd, NULL);
+                port->Watching = false;
+            }
+        }
+        SerialPnp_Reactor_FreeRetiredPorts(thread);
+        stopping = thread->Stopping;
+        Unlock(thread->Lock);
+    }
+
+    return 0;
+}
+
+static bool SerialPnp_Reactor_InitThread(
+    SERIALPNP_REACTOR_THREAD* thread)
+{
+    struct epoll_event wakeEvent;
+
+    thread->EpollFd = epoll_create1(EPOLL_CLOEXEC);
+    thread->WakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (thread->EpollFd < 0 || thread->WakeFd < 0)
+    {
+        LogError("Failed to create reactor epoll set: %d", errno);
+        return false;
+    }
+
+    memset(&wakeEvent, 0, sizeof(wakeEvent));
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.ptr = NULL;
+    if (0 != epoll_ctl(thread->EpollFd, EPOLL_CTL_ADD, thread->WakeFd, &wakeEvent))
+    {
+        LogError("Failed to add reactor wake up event: %d", errno);
+        return false;
+    }
+
+    if (NULL == (thread->Lock = Lock_Init()))
+    {
+        LogError("Failed to create reactor lock");
+        return false;
+    }
+
+    if (THREADAPI_OK != ThreadAPI_Create(&thread->Thread, SerialPnp_Reactor_Run, thread))
+    {
+        LogError("Failed to start reactor thread");
+        thread->Thread = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+SERIALPNP_REACTOR_HANDLE SerialPnp_Reactor_Create(
+    size_t threadCount)
+{
+    SERIALPNP_REACTOR* reactor = calloc(1, sizeof(SERIALPNP_REACTOR));
+    if (NULL == reactor || 0 == threadCount ||
+        NULL == (reactor->Threads = calloc(threadCount, sizeof(SERIALPNP_REACTOR_THREAD))))
+    {
+        LogError("Failed to allocate a reactor with %lu threads", (unsigned long)threadCount);
+        free(reactor);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        reactor->Threads[i].EpollFd = -1;
+        reactor->Threads[i].WakeFd = -1;
+    }
+
+    for (reactor->ThreadCount = 0; reactor->ThreadCount < threadCount; reactor->ThreadCount++)
+    {
+        if (!SerialPnp_Reactor_InitThread(&reactor->Threads[reactor->ThreadCount]))
+        {
+            // Cleans up the partially initialized thread as well
+            reactor->ThreadCount++;
+            SerialPnp_Reactor_Destroy(reactor);
+            return NULL;
+        }
+    }
+
+    return reactor;
+}
+
+void SerialPnp_Reactor_Destroy(
+    SERIALPNP_REACTOR_HANDLE reactor)
+{
+    if (NULL == reactor)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < reactor->ThreadCount; i++)
+    {
+        SERIALPNP_REACTOR_THREAD* thread = &reactor->Threads[i];
+
+        if (NULL != thread->Thread)
+        {
+            Lock(thread->Lock);
+            thread->Stopping = true;
+            Unlock(thread->Lock);
+            SerialPnp_Reactor_Wake(thread);
+            ThreadAPI_Join(thread->Thread, NULL);
+        }
+
+        if (0 != thread->PortCount)
+        {
+            LogError("Reactor destroyed with %lu ports still added", (unsigned long)thread->PortCount);
+        }
+        SerialPnp_Reactor_FreeRetiredPorts(thread);
+
+        if (NULL != thread->Lock)
+        {
+            Lock_Deinit(thread->Lock);
+        }
+        if (thread->WakeFd >= 0)
+        {
+            close(thread->WakeFd);
+        }
+        if (thread->EpollFd >= 0)
+        {
+            close(thread->EpollFd);
+        }
+    }
+
+    free(reactor->Threads);
+    free(reactor);
+}
+
+SERIALPNP_REACTOR_PORT_HANDLE SerialPnp_Reactor_AddPort(
+    SERIALPNP_REACTOR_HANDLE reactor,
+    int fd,
+    SERIALPNP_REACTOR_CALLBACK callback,
+    void* context)
+{
+    SERIALPNP_REACTOR_THREAD* thread = NULL;
+    struct epoll_event event;
+
+    if (NULL == reactor || NULL == callback)
+    {
+        LogError("Invalid parameter: reactor=%p, callback=%p", reactor, callback);
+        return NULL;
+    }
+
+    SERIALPNP_REACTOR_PORT* port = calloc(1, sizeof(SERIALPNP_REACTOR_PORT));
+    if (NULL == port)
+    {
+        LogError("Error out of memory");
+        return NULL;
+    }
+
+    // Port counts only change under their thread's lock. A slightly stale count only makes the spread less even.
+    for (size_t i = 0; i < reactor->ThreadCount; i++)
+    {
+        if (NULL == thread || reactor->Threads[i].PortCount < thread->PortCount)
+        {
+            thread = &reactor->Threads[i];
+        }
+    }
+
+    port->Fd = fd;
+    port->Callback = callback;
+    port->Context = context;
+    port->Thread = thread;
+    port->Watching = true;
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = port;
+
+    // The port can be called back as soon as it is in the epoll set, so it is added under the lock
+    Lock(thread->Lock);
+    if (0 != epoll_ctl(thread->EpollFd, EPOLL_CTL_ADD, fd, &event))
+    {
+        LogError("Failed to add fd %d to the reactor: %d", fd, errno);
+        Unlock(thread->Lock);
+        free(port);
+        return NULL;
+    }
+    thread->PortCount++;
+    Unlock(thread->Lock);
+
+    return port;
+}
+
+void SerialPnp_Reactor_RemovePort(
+    SERIALPNP_REACTOR_PORT_HANDLE port)
+{
+    if (NULL == port)
+    {
+        return;
+    }
+
+    SERIALPNP_REACTOR_THREAD* thread = port->Thread;
+
+    Lock(thread->Lock);
+    if (port->Watching)
+    {
+        (void)epoll_ctl(thread->EpollFd, EPOLL_CTL_DEL, port->Fd, NULL);
+        port->Watching = false;
+    }
+    port->NextRetired = thread->RetiredPorts;
+    thread->RetiredPorts = port;
+    thread->PortCount--;
+    Unlock(thread->Lock);
+
+    SerialPnp_Reactor_Wake(thread);
+}
@@ -0,0 +1,51 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+//
+// Serial PnP reactor. Rather than every port having a thread blocked reading it, a few reactor threads wait on
+// all the ports at once with epoll and call a port's callback when the port has bytes to read or has hung up.
+// A port is served by a single thread, the one with the fewest ports when the port is added, so its callback
+// never runs concurrently with itself. Linux only.
+//
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct _SERIALPNP_REACTOR* SERIALPNP_REACTOR_HANDLE;
+    typedef struct _SERIALPNP_REACTOR_PORT* SERIALPNP_REACTOR_PORT_HANDLE;
+
+    // Called on a reactor thread when the port is readable or has hung up. The callback should read once, what
+    // the port has available, so that it does not hold up the other ports of its thread. Returning false stops
+    // watching the port, as is done when it hung up.
+    typedef bool (*SERIALPNP_REACTOR_CALLBACK)(void* context);
+
+    // Starts threadCount reactor threads. Returns NULL on failure.
+    SERIALPNP_REACTOR_HANDLE SerialPnp_Reactor_Create(
+        size_t threadCount);
+
+    // Stops the reactor threads. Every port must have been removed.
+    void SerialPnp_Reactor_Destroy(
+        SERIALPNP_REACTOR_HANDLE reactor);
+
+    // Starts watching fd. Returns NULL on failure.
+    SERIALPNP_REACTOR_PORT_HANDLE SerialPnp_Reactor_AddPort(
+        SERIALPNP_REACTOR_HANDLE reactor,
+        int fd,
+        SERIALPNP_REACTOR_CALLBACK callback,
+        void* context);
+
+    // Stops watching the port and releases it. Once this returns the callback is not running and is not called
+    // again, so its context can be freed and fd closed. Must be called once per port, and not from its callback.
+    void SerialPnp_Reactor_RemovePort(
+        SERIALPNP_REACTOR_PORT_HANDLE port);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,864 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "bench_hub.h"
+#include "bench_devices.h"
+
+#define BENCH_DEVICES_PATH_SIZE 64
+#define BENCH_DEVICES_BUFFER_SIZE 4096
+#define BENCH_DEVICES_TOPIC_SIZE 128
+
+// Serial PnP framing, see serial_pnp_framing.h
+#define BENCH_SERIAL_START_OF_FRAME 0x5A
+#define BENCH_SERIAL_ESCAPE 0xEF
+#define BENCH_SERIAL_RESET_REQUEST 0x01
+#define BENCH_SERIAL_RESET_RESPONSE 0x02
+#define BENCH_SERIAL_DESCRIPTOR_REQUEST 0x03
+#define BENCH_SERIAL_DESCRIPTOR_RESPONSE 0x04
+#define BENCH_SERIAL_EVENT_NOTIFICATION 0x0A
+#define BENCH_SERIAL_SCHEMA_INT 4
+
+// MQTT 3.1.1 control packet types
+#define BENCH_MQTT_CONNECT 1
+#define BENCH_MQTT_PUBLISH 3
+#define BENCH_MQTT_PUBREL 6
+#define BENCH_MQTT_SUBSCRIBE 8
+#define BENCH_MQTT_PINGREQ 12
+#define BENCH_MQTT_DISCONNECT 14
+
+// One serial port, Modbus TCP connection or MQTT connection served by the child process
+typedef struct _BENCH_ENDPOINT {
+    int Fd;
+    uint8_t In[BENCH_DEVICES_BUFFER_SIZE];
+    size_t InLength;
+
+    // Serial frame being received
+    bool InFrame;
+    bool Escaped;
+
+    // Whether the endpoint reports readings, set once the serial descriptor was served or the MQTT
+    // connection subscribed
+    bool Reporting;
+    uint64_t NextReportMs;
+    char Topic[BENCH_DEVICES_TOPIC_SIZE];
+} BENCH_ENDPOINT, *PBENCH_ENDPOINT;
+
+typedef struct _BENCH_DEVICES {
+    BENCH_DEVICE_TYPE Type;
+    int Count;
+    unsigned int IntervalMs;
+    pid_t Pid;
+
+    // Serial devices: pseudo terminal masters, and slaves kept open so a master does not hang up while
+    // the bridge has its port closed
+    int* MasterFds;
+    int* SlaveFds;
+    char (*SerialPorts)[BENCH_DEVICES_PATH_SIZE];
+
+    // Modbus and MQTT: listening socket
+    int ListenFd;
+    uint16_t Port;
+
+    // Child process only
+    PBENCH_ENDPOINT* Endpoints;
+    int EndpointCount;
+} BENCH_DEVICES, *PBENCH_DEVICES;
+
+static uint16_t BenchDevices_Stamp(void)
+{
+    return (uint16_t)(Bench_GetTimeMs() & BENCH_STAMP_MASK);
+}
+
+static void BenchDevices_Write(
+    PBENCH_ENDPOINT Endpoint,
+    const uint8_t* Data,
+    size_t Length)
+{
+    // Readings are dropped rather than queued when the bridge does not keep up, as a device would
+    ssize_t written = send(Endpoint->Fd, Data, Length, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (written < 0 && ENOTSOCK == errno)
+    {
+        written = write(Endpoint->Fd, Data, Length);
+    }
+    (void)written;
+}
+
+static PBENCH_ENDPOINT BenchDevices_AddEndpoint(
+    PBENCH_DEVICES Devices,
+    int Fd)
+{
+    PBENCH_ENDPOINT* endpoints = realloc(Devices->Endpoints, (Devices->EndpointCount + 1) * sizeof(PBENCH_ENDPOINT));
+    PBENCH_ENDPOINT endpoint = calloc(1, sizeof(BENCH_ENDPOINT));
+    if (NULL == endpoints || NULL == endpoint)
+    {
+        free(endpoint);
+        if (NULL != endpoints)
+        {
+            Devices->Endpoints = endpoints;
+        }
+        close(Fd);
+        return NULL;
+    }
+
+    (void)fcntl(Fd, F_SETFL, fcntl(Fd, F_GETFL) | O_NONBLOCK);
+    endpoint->Fd = Fd;
+    Devices->Endpoints = endpoints;
+    Devices->Endpoints[Devices->EndpointCount++] = endpoint;
+    return endpoint;
+}
+
+static void BenchDevices_RemoveEndpoint(
+    PBENCH_DEVICES Devices,
+    int Index)
+{
+    close(Devices->Endpoints[Index]->Fd);
+    free(Devices->Endpoints[Index]);
+    Devices->Endpoints[Index] = Devices->Endpoints[--Devices->EndpointCount];
+}
+
+#pragma region Serial
+
+static void BenchDevices_SerialSend(
+    PBENCH_ENDPOINT Endpoint,
+    const uint8_t* Packet,
+    size_t Length)
+{
+    uint8_t frame[2 * BENCH_DEVICES_BUFFER_SIZE + 1];
+    size_t frameLength = 0;
+
+    frame[frameLength++] = BENCH_SERIAL_START_OF_FRAME;
+    for (size_t i = 0; i < Length; i++)
+    {
+        if (BENCH_SERIAL_START_OF_FRAME == Packet[i] || BENCH_SERIAL_ESCAPE == Packet[i])
+        {
+            frame[frameLength++] = BENCH_SERIAL_ESCAPE;
+            frame[frameLength++] = (uint8_t)(Packet[i] - 1);
+        }
+        else
+        {
+            frame[frameLength++] = Packet[i];
+        }
+    }
+    BenchDevices_Write(Endpoint, frame, frameLength);
+}
+
+static size_t BenchDevices_PutString(
+    uint8_t* Buffer,
+    size_t Offset,
+    const char* Value)
+{
+    size_t length = strlen(Value);
+    Buffer[Offset++] = (uint8_t)length;
+    memcpy(Buffer + Offset, Value, length);
+    return Offset + length;
+}
+
+// One interface with a single Int event, BENCH_STAMP_FIELD
+static void BenchDevices_SerialSendDescriptor(
+    PBENCH_ENDPOINT Endpoint)
+{
+    static const char interfaceId[] = "dtmi:com:example:PnpBridgeBench;1";
+    uint8_t packet[256];
+    size_t length = 4;
+
+    packet[length++] = 1; // version
+    length = BenchDevices_PutString(packet, length, "pnpbridge_bench");
+
+    packet[length++] = 0x05; // interface
+    packet[length++] = (uint8_t)(sizeof(interfaceId) - 1);
+    packet[length++] = 0;
+    memcpy(packet + length, interfaceId, sizeof(interfaceId) - 1);
+    length += sizeof(interfaceId) - 1;
+
+    packet[length++] = 0x03; // event
+    length = BenchDevices_PutString(packet, length, BENCH_STAMP_FIELD);
+    length = BenchDevices_PutString(packet, length, "Stamp");
+    length = BenchDevices_PutString(packet, length, "Time the reading was taken");
+    length = BenchDevices_PutString(packet, length, "ms");
+    packet[length++] = BENCH_SERIAL_SCHEMA_INT;
+    packet[length++] = 0;
+
+    packet[0] = (uint8_t)(length & 0xFF);
+    packet[1] = (uint8_t)(length >> 8);
+    packet[2] = BENCH_SERIAL_DESCRIPTOR_RESPONSE;
+    packet[3] = 0;
+    BenchDevices_SerialSend(Endpoint, packet, length);
+}
+
+static void BenchDevices_SerialReport(
+    PBENCH_ENDPOINT Endpoint)
+{
+    uint8_t packet[32];
+    size_t length = 4;
+    int32_t stamp = BenchDevices_Stamp();
+
+    packet[length++] = 1; // interface index, 1-based
+    length = BenchDevices_PutString(packet, length, BENCH_STAMP_FIELD);
+    memcpy(packet + length, &stamp, sizeof(stamp)); // the bridge reads Int values in host byte order
+    length += sizeof(stamp);
+
+    packet[0] = (uint8_t)length;
+    packet[1] = 0;
+    packet[2] = BENCH_SERIAL_EVENT_NOTIFICATION;
+    packet[3] = 0;
+    BenchDevices_SerialSend(Endpoint, packet, length);
+}
+
+static void BenchDevices_SerialPacket(
+    PBENCH_DEVICES Devices,
+    PBENCH_ENDPOINT Endpoint)
+{
+    switch (Endpoint->In[2])
+    {
+        case BENCH_SERIAL_RESET_REQUEST:
+        {
+            const uint8_t response[4] = { 4, 0, BENCH_SERIAL_RESET_RESPONSE, 0 };
+            Endpoint->Reporting = false;
+            BenchDevices_SerialSend(Endpoint, response, sizeof(response));
+            break;
+        }
+        case BENCH_SERIAL_DESCRIPTOR_REQUEST:
+            BenchDevices_SerialSendDescriptor(Endpoint);
+            Endpoint->Reporting = true;
+            Endpoint->NextReportMs = Bench_GetTimeMs() + Devices->IntervalMs;
+            break;
+        default:
+            // Commands and property requests are not part of the benchmark
+            break;
+    }
+}
+
+static void BenchDevices_SerialReceive(
+    PBENCH_DEVICES Devices,
+    PBENCH_ENDPOINT Endpoint,
+    const uint8_t* Data,
+    size_t Length)
+{
+    for (size_t i = 0; i < Length; i++)
+    {
+        uint8_t value = Data[i];
+        if (BENCH_SERIAL_START_OF_FRAME == value)
+        {
+            Endpoint->InFrame = true;
+            Endpoint->Escaped = false;
+            Endpoint->InLength = 0;
+            continue;
+        }
+        if (!Endpoint->InFrame)
+        {
+            continue;
+        }
+        if (BENCH_SERIAL_ESCAPE == value)
+        {
+            Endpoint->Escaped = true;
+            continue;
+        }
+        if (Endpoint->Escaped)
+        {
+            value++;
+            Endpoint->Escaped = false;
+        }
+        if (Endpoint->InLength == sizeof(Endpoint->In))
+        {
+            Endpoint->InFrame = false;
+            continue;
+        }
+
+        Endpoint->In[Endpoint->InLength++] = value;
+        if (Endpoint->InLength >= 4 && Endpoint->InLength == (size_t)(Endpoint->In[0] | (Endpoint->In[1] << 8)))
+        {
+            BenchDevices_SerialPacket(Devices, Endpoint);
+            Endpoint->InFrame = false;
+        }
+    }
+}
+
+static bool BenchDevices_OpenSerialPorts(
+    PBENCH_DEVICES Devices)
+{
+    for (int i = 0; i < Devices->Count; i++)
+    {
+        struct termios tty;
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || 0 != grantpt(master) || 0 != unlockpt(master) ||
+            0 != ptsname_r(master, Devices->SerialPorts[i], BENCH_DEVICES_PATH_SIZE))
+        {
+            LogError("BenchDevices: failed to create a pseudo terminal: %s", strerror(errno));
+            if (master >= 0)
+            {
+                close(master);
+            }
+            return false;
+        }
+        Devices->MasterFds[i] = master;
+
+        // The port carries binary frames, no byte may be translated on the way
+        int slave = open(Devices->SerialPorts[i], O_RDWR | O_NOCTTY);
+        if (slave < 0 || 0 != tcgetattr(slave, &tty))
+        {
+            LogError("BenchDevices: failed to open %s: %s", Devices->SerialPorts[i], strerror(errno));
+            if (slave >= 0)
+            {
+                close(slave);
+            }
+            return false;
+        }
+        cfmakeraw(&tty);
+        (void)tcsetattr(slave, TCSANOW, &tty);
+        Devices->SlaveFds[i] = slave;
+    }
+    return true;
+}
+
+#pragma endregion
+
+#pragma region Modbus
+
+static void BenchDevices_ModbusRequest(
+    PBENCH_ENDPOINT Endpoint,
+    const uint8_t* Request,
+    size_t Length)
+{
+    uint8_t response[9 + 2 * 125];
+    size_t responseLength = 8;
+    uint8_t functionCode = Request[7];
+    uint16_t count = (Length >= 12) ? (uint16_t)((Request[10] << 8) | Request[11]) : 0;
+
+    memcpy(response, Request, 7); // transaction id, protocol id and unit id
+    response[7] = functionCode;
+
+    if ((3 == functionCode || 4 == functionCode) && count >= 1 && count <= 125)
+    {
+        // Holding and input registers all read as the time of the request
+        uint16_t stamp = BenchDevices_Stamp();
+        response[responseLength++] = (uint8_t)(2 * count);
+        for (uint16_t i = 0; i < count; i++)
+        {
+            response[responseLength++] = (uint8_t)(stamp >> 8);
+            response[responseLength++] = (uint8_t)(stamp & 0xFF);
+        }
+    }
+    else if ((1 == functionCode || 2 == functionCode) && count >= 1 && count <= 2000)
+    {
+        uint8_t bytes = (uint8_t)((count + 7) / 8);
+        response[responseLength++] = bytes;
+        memset(response + responseLength, 0, bytes);
+        responseLength += bytes;
+    }
+    else if ((5 == functionCode || 6 == functionCode) && Length == 12)
+    {
+        // Single writes are acknowledged by echoing the request
+        memcpy(response + 8, Request + 8, 4);
+        responseLength += 4;
+    }
+    else
+    {
+        response[7] = (uint8_t)(functionCode | 0x80);
+        response[responseLength++] = 0x01; // illegal function
+    }
+
+    response[4] = (uint8_t)((responseLength - 6) >> 8);
+    response[5] = (uint8_t)((responseLength - 6) & 0xFF);
+    BenchDevices_Write(Endpoint, response, responseLength);
+}
+
+static void BenchDevices_ModbusReceive(
+    PBENCH_ENDPOINT Endpoint)
+{
+    size_t offset = 0;
+    while (Endpoint->InLength - offset >= 8)
+    {
+        const uint8_t* request = Endpoint->In + offset;
+        size_t length = 6 + (size_t)((request[4] << 8) | request[5]);
+        if (Endpoint->InLength - offset < length)
+        {
+            break;
+        }
+        BenchDevices_ModbusRequest(Endpoint, request, length);
+        offset += length;
+    }
+    memmove(Endpoint->In, Endpoint->In + offset, Endpoint->InLength - offset);
+    Endpoint->InLength -= offset;
+}
+
+#pragma endregion
+
+#pragma region Mqtt
+
+static size_t BenchDevices_MqttPutLength(
+    uint8_t* Buffer,
+    size_t Length)
+{
+    size_t used = 0;
+    do
+    {
+        uint8_t digit = (uint8_t)(Length % 128);
+        Length /= 128;
+        Buffer[used++] = (uint8_t)(digit | ((Length > 0) ? 0x80 : 0));
+    } while (Length > 0);
+    return used;
+}
+
+static void BenchDevices_MqttReport(
+    PBENCH_ENDPOINT Endpoint)
+{
+    char payload[96];
+    uint8_t packet[BENCH_DEVICES_TOPIC_SIZE + sizeof(payload) + 8];
+    size_t topicLength = strlen(Endpoint->Topic);
+    int payloadLength = snprintf(payload, sizeof(payload), "{\"jsonrpc\":\"2.0\",\"method\":\"%s\",\"params\":%u}",
+        BENCH_STAMP_FIELD, (unsigned int)BenchDevices_Stamp());
+
+    size_t length = 0;
+    packet[length++] = BENCH_MQTT_PUBLISH << 4; // QoS 0
+    length += BenchDevices_MqttPutLength(packet + length, 2 + topicLength + (size_t)payloadLength);
+    packet[length++] = (uint8_t)(topicLength >> 8);
+    packet[length++] = (uint8_t)(topicLength & 0xFF);
+    memcpy(packet + length, Endpoint->Topic, topicLength);
+    length += topicLength;
+    memcpy(packet + length, payload, (size_t)payloadLength);
+    length += (size_t)payloadLength;
+    BenchDevices_Write(Endpoint, packet, length);
+}
+
+// Handles one control packet, returns false when the connection is to be closed
+static bool BenchDevices_MqttPacket(
+    PBENCH_DEVICES Devices,
+    PBENCH_ENDPOINT Endpoint,
+    uint8_t Header,
+    const uint8_t* Body,
+    size_t Length)
+{
+    switch (Header >> 4)
+    {
+        case BENCH_MQTT_CONNECT:
+        {
+            const uint8_t connack[4] = { 0x20, 0x02, 0x00, 0x00 };
+            BenchDevices_Write(Endpoint, connack, sizeof(connack));
+            break;
+        }
+        case BENCH_MQTT_PUBLISH:
+        {
+            // Requests from the bridge are acknowledged and otherwise ignored
+            uint8_t qos = (Header >> 1) & 0x03;
+            size_t topicLength = (Length >= 2) ? (size_t)((Body[0] << 8) | Body[1]) : Length;
+            if (qos > 0 && Length >= 4 + topicLength)
+            {
+                uint8_t ack[4] = { (1 == qos) ? 0x40 : 0x50, 0x02, Body[2 + topicLength], Body[3 + topicLength] };
+                BenchDevices_Write(Endpoint, ack, sizeof(ack));
+            }
+            break;
+        }
+        case BENCH_MQTT_PUBREL:
+            if (Length >= 2)
+            {
+                const uint8_t pubcomp[4] = { 0x70, 0x02, Body[0], Body[1] };
+                BenchDevices_Write(Endpoint, pubcomp, sizeof(pubcomp));
+            }
+            break;
+        case BENCH_MQTT_SUBSCRIBE:
+        {
+            uint8_t suback[4 + 64];
+            size_t filters = 0;
+            size_t offset = 2;
+            if (Length < 2)
+            {
+                return false;
+            }
+            while (offset + 2 <= Length && filters < 64)
+            {
+                size_t topicLength = (size_t)((Body[offset] << 8) | Body[offset + 1]);
+                if (offset + 3 + topicLength > Length)
+                {
+                    return false;
+                }
+                if (0 == filters && topicLength < sizeof(Endpoint->Topic))
+                {
+                    memcpy(Endpoint->Topic, Body + offset + 2, topicLength);
+                    Endpoint->Topic[topicLength] = '\0';
+                }
+                suback[4 + filters++] = 0x00; // granted QoS 0
+                offset += 3 + topicLength;
+            }
+            suback[0] = 0x90;
+            suback[1] = (uint8_t)(2 + filters);
+            suback[2] = Body[0];
+            suback[3] = Body[1];
+            BenchDevices_Write(Endpoint, suback, 4 + filters);
+
+            Endpoint->Reporting = true;
+            Endpoint->NextReportMs = Bench_GetTimeMs() + Devices->IntervalMs;
+            break;
+        }
+        case BENCH_MQTT_PINGREQ:
+        {
+            const uint8_t pingresp[2] = { 0xD0, 0x00 };
+            BenchDevices_Write(Endpoint, pingresp, sizeof(pingresp));
+            break;
+        }
+        case BENCH_MQTT_DISCONNECT:
+            return false;
+        default:
+            break;
+    }
+    return true;
+}
+
+static bool BenchDevices_MqttReceive(
+    PBENCH_DEVICES Devices,
+    PBENCH_ENDPOINT Endpoint)
+{
+    size_t offset = 0;
+    for (;;)
+    {
+        size_t length = 0;
+        size_t used = 1;
+        unsigned int shift = 0;
+        bool complete = false;
+
+        while (offset + used < Endpoint->InLength && used <= 4)
+        {
+            uint8_t digit = Endpoint->In[offset + used++];
+            length |= (size_t)(digit & 0x7F) << shift;
+            shift += 7;
+            if (0 == (digit & 0x80))
+            {
+                complete = true;
+                break;
+            }
+        }
+        if (!complete || Endpoint->InLength - offset - used < length)
+        {
+            if (Endpoint->InLength - offset == sizeof(Endpoint->In))
+            {
+                return false; // a packet larger than the buffer is not expected from the bridge
+            }
+            break;
+        }
+
+        if (!BenchDevices_MqttPacket(Devices, Endpoint, Endpoint->In[offset], Endpoint->In + offset + used, length))
+        {
+            return false;
+        }
+        offset += used + length;
+    }
+    memmove(Endpoint->In, Endpoint->In + offset, Endpoint->InLength - offset);
+    Endpoint->InLength -= offset;
+    return true;
+}
+
+#pragma endregion
+
+static bool BenchDevices_Listen(
+    PBENCH_DEVICES Devices)
+{
+    struct sockaddr_in address;
+    socklen_t addressLength = sizeof(address);
+    int reuse = 1;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+
+    Devices->ListenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (Devices->ListenFd < 0 ||
+        0 != setsockopt(Devices->ListenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) ||
+        0 != bind(Devices->ListenFd, (struct sockaddr*)&address, sizeof(address)) ||
+        0 != listen(Devices->ListenFd, Devices->Count + 16) ||
+        0 != getsockname(Devices->ListenFd, (struct sockaddr*)&address, &addressLength))
+    {
+        LogError("BenchDevices: failed to listen on 127.0.0.1: %s", strerror(errno));
+        return false;
+    }
+    Devices->Port = ntohs(address.sin_port);
+    return true;
+}
+
+// Returns false when the endpoint is closed
+static bool BenchDevices_Receive(
+    PBENCH_DEVICES Devices,
+    PBENCH_ENDPOINT Endpoint)
+{
+    if (BENCH_DEVICE_SERIAL == Devices->Type)
+    {
+        uint8_t data[BENCH_DEVICES_BUFFER_SIZE];
+        ssize_t received = read(Endpoint->Fd, data, sizeof(data));
+        if (received > 0)
+        {
+            BenchDevices_SerialReceive(Devices, Endpoint, data, (size_t)received);
+        }
+        return true;
+    }
+
+    ssize_t received = recv(Endpoint->Fd, Endpoint->In + Endpoint->InLength, sizeof(Endpoint->In) - Endpoint->InLength, 0);
+    if (0 == received || (received < 0 && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno))
+    {
+        return false;
+    }
+    if (received < 0)
+    {
+        return true;
+    }
+
+    Endpoint->InLength += (size_t)received;
+    if (BENCH_DEVICE_MODBUS == Devices->Type)
+    {
+        BenchDevices_ModbusReceive(Endpoint);
+        return true;
+    }
+    return BenchDevices_MqttReceive(Devices, Endpoint);
+}
+
+// Event loop of the child process, never returns
+static void BenchDevices_Run(
+    PBENCH_DEVICES Devices)
+{
+    struct pollfd* fds = NULL;
+    int capacity = 0;
+
+    for (;;)
+    {
+        uint64_t now = Bench_GetTimeMs();
+        int timeout = -1;
+        int count = 0;
+
+        // Readings that are due go out before waiting again
+        for (int i = 0; i < Devices->EndpointCount; i++)
+        {
+            PBENCH_ENDPOINT endpoint = Devices->Endpoints[i];
+            if (!endpoint->Reporting)
+            {
+                continue;
+            }
+            if (endpoint->NextReportMs <= now)
+            {
+                if (BENCH_DEVICE_SERIAL == Devices->Type)
+                {
+                    BenchDevices_SerialReport(endpoint);
+                }
+                else
+                {
+                    BenchDevices_MqttReport(endpoint);
+                }
+                // Do not burst to catch up after a stall
+                endpoint->NextReportMs += Devices->IntervalMs;
+                if (endpoint->NextReportMs <= now)
+                {
+                    endpoint->NextReportMs = now + Devices->IntervalMs;
+                }
+            }
+            int wait = (int)(endpoint->NextReportMs - now);
+            if (timeout < 0 || wait < timeout)
+            {
+                timeout = wait;
+            }
+        }
+
+        if (capacity < Devices->EndpointCount + 1)
+        {
+            capacity = 2 * (Devices->EndpointCount + 1);
+            struct pollfd* grown = realloc(fds, capacity * sizeof(struct pollfd));
+            if (NULL == grown)
+            {
+                _exit(1);
+            }
+            fds = grown;
+        }
+        for (int i = 0; i < Devices->EndpointCount; i++)
+        {
+            fds[count].fd = Devices->Endpoints[i]->Fd;
+            fds[count++].events = POLLIN;
+        }
+        if (Devices->ListenFd >= 0)
+        {
+            fds[count].fd = Devices->ListenFd;
+            fds[count++].events = POLLIN;
+        }
+
+        if (poll(fds, (nfds_t)count, timeout) <= 0)
+        {
+            continue;
+        }
+
+        // Walk backwards so closed endpoints can be swapped out without skipping one
+        for (int i = Devices->EndpointCount - 1; i >= 0; i--)
+        {
+            if ((0 != (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) && !BenchDevices_Receive(Devices, Devices->Endpoints[i]))
+            {
+                BenchDevices_RemoveEndpoint(Devices, i);
+            }
+        }
+
+        if (Devices->ListenFd >= 0 && 0 != (fds[count - 1].revents & POLLIN))
+        {
+            int connection = accept(Devices->ListenFd, NULL, NULL);
+            if (connection >= 0)
+            {
+                (void)BenchDevices_AddEndpoint(Devices, connection);
+            }
+        }
+    }
+}
+
+static void BenchDevices_Free(
+    PBENCH_DEVICES Devices)
+{
+    for (int i = 0; i < Devices->Count; i++)
+    {
+        if (NULL != Devices->MasterFds && Devices->MasterFds[i] >= 0)
+        {
+            close(Devices->MasterFds[i]);
+        }
+        if (NULL != Devices->SlaveFds && Devices->SlaveFds[i] >= 0)
+        {
+            close(Devices->SlaveFds[i]);
+        }
+    }
+    if (Devices->ListenFd >= 0)
+    {
+        close(Devices->ListenFd);
+    }
+    free(Devices->MasterFds);
+    free(Devices->SlaveFds);
+    free(Devices->SerialPorts);
+    free(Devices);
+}
+
+BENCH_DEVICES_HANDLE BenchDevices_Start(
+    BENCH_DEVICE_TYPE Type,
+    int Count,
+    unsigned int IntervalMs)
+{
+    PBENCH_DEVICES devices = calloc(1, sizeof(BENCH_DEVICES));
+    if (NULL == devices)
+    {
+        LogError("BenchDevices: out of memory");
+        return NULL;
+    }
+
+    devices->Type = Type;
+    devices->Count = Count;
+    devices->IntervalMs = (0 == IntervalMs) ? 1 : IntervalMs;
+    devices->ListenFd = -1;
+
+    if (BENCH_DEVICE_SERIAL == Type)
+    {
+        devices->MasterFds = malloc(Count * sizeof(int));
+        devices->SlaveFds = malloc(Count * sizeof(int));
+        devices->SerialPorts = calloc(Count, BENCH_DEVICES_PATH_SIZE);
+        if (NULL == devices->MasterFds || NULL == devices->SlaveFds || NULL == devices->SerialPorts)
+        {
+            LogError("BenchDevices: out of memory");
+            devices->Count = 0;
+            goto error;
+        }
+        for (int i = 0; i < Count; i++)
+        {
+            devices->MasterFds[i] = -1;
+            devices->SlaveFds[i] = -1;
+        }
+        if (!BenchDevices_OpenSerialPorts(devices))
+        {
+            goto error;
+        }
+    }
+    else if (!BenchDevices_Listen(devices))
+    {
+        goto error;
+    }
+
+    (void)fflush(stdout);
+    devices->Pid = fork();
+    if (devices->Pid < 0)
+    {
+        LogError("BenchDevices: fork failed: %s", strerror(errno));
+        goto error;
+    }
+
+    if (0 == devices->Pid)
+    {
+        // Exit with the bench, however it ends
+        (void)prctl(PR_SET_PDEATHSIG, SIGKILL);
+        for (int i = 0; i < Count && BENCH_DEVICE_SERIAL == Type; i++)
+        {
+            if (NULL == BenchDevices_AddEndpoint(devices, devices->MasterFds[i]))
+            {
+                _exit(1);
+            }
+        }
+        if (devices->ListenFd >= 0)
+        {
+            (void)fcntl(devices->ListenFd, F_SETFL, fcntl(devices->ListenFd, F_GETFL) | O_NONBLOCK);
+        }
+        BenchDevices_Run(devices);
+        _exit(0);
+    }
+
+    // The child owns the masters and the listening socket now
+    for (int i = 0; i < Count && BENCH_DEVICE_SERIAL == Type; i++)
+    {
+        close(devices->MasterFds[i]);
+        devices->MasterFds[i] = -1;
+        close(devices->SlaveFds[i]);
+        devices->SlaveFds[i] = -1;
+    }
+    if (devices->ListenFd >= 0)
+    {
+        close(devices->ListenFd);
+        devices->ListenFd = -1;
+    }
+    return devices;
+
+error:
+    BenchDevices_Free(devices);
+    return NULL;
+}
+
+void BenchDevices_Stop(
+    BENCH_DEVICES_HANDLE Devices)
+{
+    PBENCH_DEVICES devices = (PBENCH_DEVICES)Devices;
+    if (NULL == devices)
+    {
+        return;
+    }
+
+    (void)kill(devices->Pid, SIGKILL);
+    (void)waitpid(devices->Pid, NULL, 0);
+    BenchDevices_Free(devices);
+}
+
+const char* BenchDevices_GetSerialPort(
+    BENCH_DEVICES_HANDLE Devices,
+    int Index)
+{
+    PBENCH_DEVICES devices = (PBENCH_DEVICES)Devices;
+    return (BENCH_DEVICE_SERIAL == devices->Type && Index >= 0 && Index < devices->Count) ? devices->SerialPorts[Index] : NULL;
+}
+
+uint16_t BenchDevices_GetPort(
+    BENCH_DEVICES_HANDLE Devices)
+{
+    return ((PBENCH_DEVICES)Devices)->Port;
+}
@@ -0,0 +1,58 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+typedef enum BENCH_DEVICE_TYPE {
+    // Serial PnP MCUs, each on its own pseudo terminal
+    BENCH_DEVICE_SERIAL,
+    // Modbus TCP slaves sharing one listening socket, told apart by unit id
+    BENCH_DEVICE_MODBUS,
+    // JSON-RPC devices behind a local MQTT broker, one connection per component
+    BENCH_DEVICE_MQTT
+} BENCH_DEVICE_TYPE;
+
+typedef struct _BENCH_DEVICES* BENCH_DEVICES_HANDLE;
+
+/**
+* @brief    BenchDevices_Start simulates Count devices in a child process, so that their CPU time is not counted
+*           against the bridge. Every device reports BENCH_STAMP_FIELD each IntervalMs milliseconds: serial devices
+*           send it as an event, the Modbus slave returns it from every register it is polled for and the broker
+*           publishes it as a JSON-RPC notification on the topic each connection subscribed to.
+*
+* @returns  Handle to the devices on success and NULL on failure
+*/
+BENCH_DEVICES_HANDLE BenchDevices_Start(
+    BENCH_DEVICE_TYPE Type,
+    int Count,
+    unsigned int IntervalMs);
+
+/**
+* @brief    BenchDevices_Stop kills the child process. Serial ports hang up, sockets are reset.
+*/
+void BenchDevices_Stop(
+    BENCH_DEVICES_HANDLE Devices);
+
+/**
+* @brief    BenchDevices_GetSerialPort returns the pseudo terminal path of serial device Index.
+*/
+const char* BenchDevices_GetSerialPort(
+    BENCH_DEVICES_HANDLE Devices,
+    int Index);
+
+/**
+* @brief    BenchDevices_GetPort returns the 127.0.0.1 TCP port of the Modbus slave or MQTT broker.
+*/
+uint16_t BenchDevices_GetPort(
+    BENCH_DEVICES_HANDLE Devices);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,540 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/singlylinkedlist.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+
+#include "pnp_bridge_client.h"
+#include "pnp_component_index.h"
+
+#include "bench_hub.h"
+
+// Message property the bridge stores the component name in, see PnP_CreateTelemetryMessageHandle
+#define BENCH_HUB_COMPONENT_PROPERTY "$.sub"
+
+#define BENCH_HUB_LATENCY_BUCKETS (BENCH_STAMP_MASK + 1)
+
+// Confirmation the hub owes the bridge
+typedef struct _BENCH_HUB_PENDING {
+    uint64_t DueMs;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK EventCallback;
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK ReportedStateCallback;
+    void* Context;
+    bool Fail;
+} BENCH_HUB_PENDING;
+
+typedef struct _BENCH_HUB_COMPONENT {
+    char* ComponentName;
+    uint64_t Messages;
+} BENCH_HUB_COMPONENT, *PBENCH_HUB_COMPONENT;
+
+typedef struct _BENCH_HUB {
+    unsigned int ConfirmationLatencyMs;
+    double FailureRate;
+    uint32_t RandomState;
+
+    // Lock protects everything below; Condition wakes the confirmation thread when a confirmation is queued
+    // or the hub is stopping
+    LOCK_HANDLE Lock;
+    COND_HANDLE Condition;
+    THREAD_HANDLE ConfirmationThread;
+    bool Stop;
+
+    // Min-heap of pending confirmations ordered by DueMs
+    BENCH_HUB_PENDING* Pending;
+    size_t PendingCount;
+    size_t PendingCapacity;
+
+    // List of PBENCH_HUB_COMPONENT, indexed by name in ComponentIndex
+    SINGLYLINKEDLIST_HANDLE Components;
+    PNP_COMPONENT_INDEX_HANDLE ComponentIndex;
+
+    BENCH_HUB_STATS Stats;
+    uint32_t* LatencyCounts;
+} BENCH_HUB, *PBENCH_HUB;
+
+uint64_t Bench_GetTimeMs(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+// xorshift32, a fixed seed keeps the failures of two runs comparable
+static bool BenchHub_NextFails(
+    PBENCH_HUB Hub)
+{
+    uint32_t x = Hub->RandomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    Hub->RandomState = x;
+    return ((double)x / 4294967296.0) < Hub->FailureRate;
+}
+
+// Called with the hub lock held
+static bool BenchHub_PushPending(
+    PBENCH_HUB Hub,
+    const BENCH_HUB_PENDING* Confirmation)
+{
+    if (Hub->PendingCount == Hub->PendingCapacity)
+    {
+        size_t capacity = (0 == Hub->PendingCapacity) ? 256 : Hub->PendingCapacity * 2;
+        BENCH_HUB_PENDING* pending = realloc(Hub->Pending, capacity * sizeof(BENCH_HUB_PENDING));
+        if (NULL == pending)
+        {
+            return false;
+        }
+        Hub->Pending = pending;
+        Hub->PendingCapacity = capacity;
+    }
+
+    size_t i = Hub->PendingCount++;
+    while (i > 0 && Hub->Pending[(i - 1) / 2].DueMs > Confirmation->DueMs)
+    {
+        Hub->Pending[i] = Hub->Pending[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    Hub->Pending[i] = *Confirmation;
+    return true;
+}
+
+// Called with the hub lock held and at least one confirmation pending
+static BENCH_HUB_PENDING BenchHub_PopPending(
+    PBENCH_HUB Hub)
+{
+    BENCH_HUB_PENDING top = Hub->Pending[0];
+    BENCH_HUB_PENDING last = Hub->Pending[--Hub->PendingCount];
+    size_t i = 0;
+
+    for (;;)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= Hub->PendingCount)
+        {
+            break;
+        }
+        if (child + 1 < Hub->PendingCount && Hub->Pending[child + 1].DueMs < Hub->Pending[child].DueMs)
+        {
+            child++;
+        }
+        if (last.DueMs <= Hub->Pending[child].DueMs)
+        {
+            break;
+        }
+        Hub->Pending[i] = Hub->Pending[child];
+        i = child;
+    }
+    if (Hub->PendingCount > 0)
+    {
+        Hub->Pending[i] = last;
+    }
+    return top;
+}
+
+static void BenchHub_Confirm(
+    const BENCH_HUB_PENDING* Confirmation,
+    bool Destroying)
+{
+    if (NULL != Confirmation->EventCallback)
+    {
+        Confirmation->EventCallback(Destroying ? IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY :
+            (Confirmation->Fail ? IOTHUB_CLIENT_CONFIRMATION_ERROR : IOTHUB_CLIENT_CONFIRMATION_OK), Confirmation->Context);
+    }
+    else if (NULL != Confirmation->ReportedStateCallback)
+    {
+        Confirmation->ReportedStateCallback((Destroying || Confirmation->Fail) ? 500 : 204, Confirmation->Context);
+    }
+}
+
+// Fires confirmations once they are due. Callbacks run without the hub lock, they can send again.
+static int BenchHub_ConfirmationThread(
+    void* context)
+{
+    PBENCH_HUB hub = (PBENCH_HUB)context;
+
+    Lock(hub->Lock);
+    while (!hub->Stop)
+    {
+        uint64_t now = Bench_GetTimeMs();
+        if (0 == hub->PendingCount)
+        {
+            (void)Condition_Wait(hub->Condition, hub->Lock, 0);
+        }
+        else if (hub->Pending[0].DueMs > now)
+        {
+            (void)Condition_Wait(hub->Condition, hub->Lock, (int)(hub->Pending[0].DueMs - now));
+        }
+        else
+        {
+            BENCH_HUB_PENDING confirmation = BenchHub_PopPending(hub);
+            if (NULL != confirmation.EventCallback)
+            {
+                if (confirmation.Fail)
+                {
+                    hub->Stats.Failed++;
+                }
+                else
+                {
+                    hub->Stats.Confirmed++;
+                }
+            }
+            Unlock(hub->Lock);
+            BenchHub_Confirm(&confirmation, false);
+            Lock(hub->Lock);
+        }
+    }
+    Unlock(hub->Lock);
+
+    return 0;
+}
+
+static IOTHUB_CLIENT_RESULT BenchHub_QueueConfirmation(
+    PBENCH_HUB Hub,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK EventCallback,
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK ReportedStateCallback,
+    void* Context)
+{
+    BENCH_HUB_PENDING confirmation;
+    confirmation.DueMs = Bench_GetTimeMs() + Hub->ConfirmationLatencyMs;
+    confirmation.EventCallback = EventCallback;
+    confirmation.ReportedStateCallback = ReportedStateCallback;
+    confirmation.Context = Context;
+    confirmation.Fail = BenchHub_NextFails(Hub);
+
+    // The confirmation thread only needs waking when this confirmation is due before the ones it waits for
+    bool wake = (0 == Hub->PendingCount) || (confirmation.DueMs < Hub->Pending[0].DueMs);
+    if (!BenchHub_PushPending(Hub, &confirmation))
+    {
+        LogError("BenchHub: failed to queue a confirmation");
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    if (wake)
+    {
+        Condition_Post(Hub->Condition);
+    }
+    return IOTHUB_CLIENT_OK;
+}
+
+// Records the latency of every reading in a message. Called with the hub lock held.
+static void BenchHub_RecordReadings(
+    PBENCH_HUB Hub,
+    const char* Body,
+    uint64_t Now)
+{
+    const char* field = Body;
+    while (NULL != (field = strstr(field, "\"" BENCH_STAMP_FIELD "\":")))
+    {
+        char* end = NULL;
+        field += sizeof(BENCH_STAMP_FIELD) + 2;
+        long stamp = strtol(field, &end, 10);
+        if (end != field)
+        {
+            uint32_t latency = (uint32_t)((Now - (uint64_t)stamp) & BENCH_STAMP_MASK);
+            Hub->LatencyCounts[latency]++;
+            Hub->Stats.Readings++;
+            if (latency > Hub->Stats.LatencyMaxMs)
+            {
+                Hub->Stats.LatencyMaxMs = latency;
+            }
+        }
+    }
+}
+
+IOTHUB_CLIENT_RESULT BenchHub_SendEventAsync(
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    IOTHUB_MESSAGE_HANDLE EventMessageHandle,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK EventConfirmationCallback,
+    void* UserContextCallback)
+{
+    PBENCH_HUB hub = (PBENCH_HUB)ClientHandle;
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+    uint64_t now = Bench_GetTimeMs();
+    const char* body = NULL;
+    char* bodyCopy = NULL;
+
+    if (NULL == hub || NULL == EventMessageHandle)
+    {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    // The bridge destroys the message once this returns, everything needed is read here
+    if (IOTHUBMESSAGE_STRING == IoTHubMessage_GetContentType(EventMessageHandle))
+    {
+        body = IoTHubMessage_GetString(EventMessageHandle);
+    }
+    else
+    {
+        const unsigned char* buffer = NULL;
+        size_t size = 0;
+        if (IOTHUB_MESSAGE_OK == IoTHubMessage_GetByteArray(EventMessageHandle, &buffer, &size) &&
+            NULL != (bodyCopy = malloc(size + 1)))
+        {
+            memcpy(bodyCopy, buffer, size);
+            bodyCopy[size] = '\0';
+            body = bodyCopy;
+        }
+    }
+    const char* componentName = IoTHubMessage_GetProperty(EventMessageHandle, BENCH_HUB_COMPONENT_PROPERTY);
+
+    Lock(hub->Lock);
+    if (hub->Stop)
+    {
+        result = IOTHUB_CLIENT_ERROR;
+        goto exit;
+    }
+
+    hub->Stats.Messages++;
+    if (NULL != body)
+    {
+        hub->Stats.MessageBytes += strlen(body);
+        BenchHub_RecordReadings(hub, body, now);
+    }
+
+    if (NULL != componentName)
+    {
+        PBENCH_HUB_COMPONENT component = PnP_ComponentIndex_Find(hub->ComponentIndex, componentName, strlen(componentName));
+        if (NULL != component)
+        {
+            if (0 == component->Messages++)
+            {
+                hub->Stats.ComponentsReporting++;
+            }
+        }
+    }
+
+    result = BenchHub_QueueConfirmation(hub, EventConfirmationCallback, NULL, UserContextCallback);
+
+exit:
+    Unlock(hub->Lock);
+    free(bodyCopy);
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT BenchHub_SendReportedState(
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const unsigned char* ReportedState,
+    size_t Size,
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK ReportedStateCallback,
+    void* UserContextCallback)
+{
+    PBENCH_HUB hub = (PBENCH_HUB)ClientHandle;
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+
+    if (NULL == hub || NULL == ReportedState || 0 == Size)
+    {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    Lock(hub->Lock);
+    if (hub->Stop)
+    {
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        hub->Stats.ReportedStates++;
+        result = BenchHub_QueueConfirmation(hub, NULL, ReportedStateCallback, UserContextCallback);
+    }
+    Unlock(hub->Lock);
+
+    return result;
+}
+
+BENCH_HUB_HANDLE BenchHub_Create(
+    unsigned int ConfirmationLatencyMs,
+    double FailureRate)
+{
+    PBENCH_HUB hub = calloc(1, sizeof(BENCH_HUB));
+    if (NULL == hub)
+    {
+        LogError("BenchHub: out of memory");
+        return NULL;
+    }
+
+    hub->ConfirmationLatencyMs = ConfirmationLatencyMs;
+    hub->FailureRate = FailureRate;
+    hub->RandomState = 0x9E3779B9;
+
+    if (NULL == (hub->Lock = Lock_Init()) ||
+        NULL == (hub->Condition = Condition_Init()) ||
+        NULL == (hub->Components = singlylinkedlist_create()) ||
+        NULL == (hub->ComponentIndex = PnP_ComponentIndex_Create(16)) ||
+        NULL == (hub->LatencyCounts = calloc(BENCH_HUB_LATENCY_BUCKETS, sizeof(uint32_t))))
+    {
+        LogError("BenchHub: failed to allocate the hub");
+        goto error;
+    }
+
+    if (THREADAPI_OK != ThreadAPI_Create(&hub->ConfirmationThread, BenchHub_ConfirmationThread, hub))
+    {
+        LogError("BenchHub: failed to start the confirmation thread");
+        goto error;
+    }
+
+    return hub;
+
+error:
+    hub->ConfirmationThread = NULL;
+    BenchHub_Destroy(hub);
+    return NULL;
+}
+
+void BenchHub_Destroy(
+    BENCH_HUB_HANDLE Hub)
+{
+    PBENCH_HUB hub = (PBENCH_HUB)Hub;
+    if (NULL == hub)
+    {
+        return;
+    }
+
+    if (NULL != hub->ConfirmationThread)
+    {
+        Lock(hub->Lock);
+        hub->Stop = true;
+        Condition_Post(hub->Condition);
+        Unlock(hub->Lock);
+        ThreadAPI_Join(hub->ConfirmationThread, NULL);
+    }
+
+    // Nothing can queue once Stop is set
+    while (hub->PendingCount > 0)
+    {
+        BENCH_HUB_PENDING confirmation = BenchHub_PopPending(hub);
+        BenchHub_Confirm(&confirmation, true);
+    }
+    free(hub->Pending);
+
+    if (NULL != hub->Components)
+    {
+        LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(hub->Components);
+        while (NULL != item)
+        {
+            PBENCH_HUB_COMPONENT component = (PBENCH_HUB_COMPONENT)singlylinkedlist_item_get_value(item);
+            free(component->ComponentName);
+            free(component);
+            item = singlylinkedlist_get_next_item(item);
+        }
+        singlylinkedlist_destroy(hub->Components);
+    }
+    if (NULL != hub->ComponentIndex)
+    {
+        PnP_ComponentIndex_Destroy(hub->ComponentIndex);
+    }
+    if (NULL != hub->Condition)
+    {
+        Condition_Deinit(hub->Condition);
+    }
+    if (NULL != hub->Lock)
+    {
+        Lock_Deinit(hub->Lock);
+    }
+    free(hub->LatencyCounts);
+    free(hub);
+}
+
+bool BenchHub_AddComponent(
+    BENCH_HUB_HANDLE Hub,
+    const char* ComponentName)
+{
+    PBENCH_HUB hub = (PBENCH_HUB)Hub;
+    bool result = false;
+
+    PBENCH_HUB_COMPONENT component = calloc(1, sizeof(BENCH_HUB_COMPONENT));
+    if (NULL == component || 0 != mallocAndStrcpy_s(&component->ComponentName, ComponentName))
+    {
+        LogError("BenchHub: out of memory");
+        free(component);
+        return false;
+    }
+
+    Lock(hub->Lock);
+    LIST_ITEM_HANDLE item = singlylinkedlist_add(hub->Components, component);
+    if (NULL == item)
+    {
+        LogError("BenchHub: out of memory");
+    }
+    else if (!PnP_ComponentIndex_Add(hub->ComponentIndex, component->ComponentName, component))
+    {
+        LogError("BenchHub: component %s is already registered", ComponentName);
+        (void)singlylinkedlist_remove(hub->Components, item);
+    }
+    else
+    {
+        result = true;
+    }
+    Unlock(hub->Lock);
+
+    if (!result)
+    {
+        free(component->ComponentName);
+        free(component);
+    }
+    return result;
+}
+
+void BenchHub_ResetStats(
+    BENCH_HUB_HANDLE Hub)
+{
+    PBENCH_HUB hub = (PBENCH_HUB)Hub;
+
+    Lock(hub->Lock);
+    memset(&hub->Stats, 0, sizeof(hub->Stats));
+    memset(hub->LatencyCounts, 0, BENCH_HUB_LATENCY_BUCKETS * sizeof(uint32_t));
+    LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(hub->Components);
+    while (NULL != item)
+    {
+        ((PBENCH_HUB_COMPONENT)singlylinkedlist_item_get_value(item))->Messages = 0;
+        item = singlylinkedlist_get_next_item(item);
+    }
+    Unlock(hub->Lock);
+}
+
+// Smallest latency at or below which Percentile of the readings arrived. Called with the hub lock held.
+static uint32_t BenchHub_GetPercentile(
+    PBENCH_HUB Hub,
+    double Percentile)
+{
+    uint64_t target = (uint64_t)(Percentile * (double)Hub->Stats.Readings + 0.5);
+    uint64_t seen = 0;
+
+    if (0 == target)
+    {
+        target = 1;
+    }
+    for (uint32_t latency = 0; latency < BENCH_HUB_LATENCY_BUCKETS; latency++)
+    {
+        seen += Hub->LatencyCounts[latency];
+        if (seen >= target)
+        {
+            return latency;
+        }
+    }
+    return 0;
+}
+
+void BenchHub_GetStats(
+    BENCH_HUB_HANDLE Hub,
+    BENCH_HUB_STATS* Stats)
+{
+    PBENCH_HUB hub = (PBENCH_HUB)Hub;
+
+    Lock(hub->Lock);
+    *Stats = hub->Stats;
+    if (hub->Stats.Readings > 0)
+    {
+        Stats->LatencyP50Ms = BenchHub_GetPercentile(hub, 0.50);
+        Stats->LatencyP99Ms = BenchHub_GetPercentile(hub, 0.99);
+    }
+    Unlock(hub->Lock);
+}
@@ -0,0 +1,83 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iothub_device_client.h"
+#include "iothub_module_client.h"
+
+// Telemetry field the simulated devices report. Its value is the time the reading was taken, in milliseconds
+// modulo 65536 as a Modbus register can hold it, so the hub can tell how long the reading took to arrive.
+#define BENCH_STAMP_FIELD "stamp"
+#define BENCH_STAMP_MASK 0xFFFF
+
+// Milliseconds on a clock shared by the bridge and the simulated devices, which run in a separate process
+uint64_t Bench_GetTimeMs(void);
+
+typedef struct _BENCH_HUB* BENCH_HUB_HANDLE;
+
+typedef struct _BENCH_HUB_STATS {
+    uint64_t Messages;
+    uint64_t MessageBytes;
+    uint64_t Readings;
+    uint64_t ReportedStates;
+    uint64_t Confirmed;
+    uint64_t Failed;
+
+    // Number of components registered with BenchHub_AddComponent that sent at least one message
+    size_t ComponentsReporting;
+
+    // Time from a reading being taken by a device to it reaching the hub
+    uint32_t LatencyP50Ms;
+    uint32_t LatencyP99Ms;
+    uint32_t LatencyMaxMs;
+} BENCH_HUB_STATS;
+
+/**
+* @brief    BenchHub_Create starts an in-process IoT Hub stand-in. The handle is used as the bridge's client handle,
+*           messages and reported state sent to it are recorded and confirmed from a separate thread.
+*
+* @param    ConfirmationLatencyMs   Time between a message being sent and its confirmation callback
+*
+* @param    FailureRate             Fraction of messages and reported state updates confirmed with an error, 0 to 1
+*
+* @returns  Handle to the hub on success and NULL on failure
+*/
+BENCH_HUB_HANDLE BenchHub_Create(
+    unsigned int ConfirmationLatencyMs,
+    double FailureRate);
+
+/**
+* @brief    BenchHub_Destroy confirms every pending message with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, as the
+*           IoT Hub client does when it is destroyed, and frees the hub.
+*/
+void BenchHub_Destroy(
+    BENCH_HUB_HANDLE Hub);
+
+/**
+* @brief    BenchHub_AddComponent registers a component whose messages the hub expects, so that
+*           BENCH_HUB_STATS.ComponentsReporting can tell when every component is up.
+*/
+bool BenchHub_AddComponent(
+    BENCH_HUB_HANDLE Hub,
+    const char* ComponentName);
+
+void BenchHub_ResetStats(
+    BENCH_HUB_HANDLE Hub);
+
+void BenchHub_GetStats(
+    BENCH_HUB_HANDLE Hub,
+    BENCH_HUB_STATS* Stats);
+
+#ifdef __cplusplus
+}
+#endif
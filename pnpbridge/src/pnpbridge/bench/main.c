@@ -0,0 +1,526 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+//
+// pnpbridge_bench runs the bridge core and the Serial PnP, Modbus TCP and MQTT adapters against simulated
+// devices and an in-process IoT Hub stand-in, one adapter at a time, and reports the telemetry throughput,
+// the device to hub latency and the CPU and memory used by the bridge for each adapter.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "pnpbridge_common.h"
+#include "pnpadapter_manager.h"
+#include "configuration_parser.h"
+
+#include "bench_hub.h"
+#include "bench_devices.h"
+
+extern PPNP_BRIDGE g_PnpBridge;
+
+// How long an adapter has to get every component reporting before its measurement starts
+#define BENCH_WARMUP_TIMEOUT_MS 30000
+#define BENCH_SAMPLE_INTERVAL_MS 100
+
+#define BENCH_IDENTITY "bench"
+#define BENCH_MQTT_TOPIC "bench/" BENCH_STAMP_FIELD
+
+typedef struct _BENCH_OPTIONS {
+    bool Adapters[3];
+    int Devices;
+    unsigned int IntervalMs;
+    unsigned int DurationSec;
+    unsigned int HubLatencyMs;
+    double HubFailureRate;
+    unsigned int SerialReactorThreads;
+    const char* ConfigPath;
+    const char* JsonPath;
+    bool Verbose;
+} BENCH_OPTIONS;
+
+typedef struct _BENCH_RESULT {
+    BENCH_HUB_STATS Hub;
+    double Seconds;
+    double CpuPercent;
+    double RssMb;
+    int Threads;
+    bool AllReporting;
+} BENCH_RESULT;
+
+static const char* const BenchAdapterNames[] = { "serial", "modbus", "mqtt" };
+static const char* const BenchAdapterIds[] = { "serial-pnp-interface", "modbus-pnp-interface", "mqtt-pnp-interface" };
+
+static void Bench_Usage(void)
+{
+    printf("Usage: pnpbridge_bench [options]\n"
+        "  --adapters LIST        adapters to run, comma separated: serial,modbus,mqtt (default all)\n"
+        "  --devices N            simulated devices per adapter (default 4)\n"
+        "  --interval MS          milliseconds between two readings of a device (default 100)\n"
+        "  --duration S           seconds measured per adapter (default 10)\n"
+        "  --hub-latency MS       milliseconds before IoT Hub confirms a message (default 20)\n"
+        "  --hub-failure-rate P   fraction of messages IoT Hub fails, 0 to 1 (default 0)\n"
+        "  --serial-reactor-threads N\n"
+        "                         read the serial ports from N reactor threads rather than a thread per\n"
+        "                         port (default 0, a thread per port)\n"
+        "  --config FILE          bridge configuration whose settings, other than its components and\n"
+        "                         adapter global configs, are applied to every run\n"
+        "  --json FILE            also write one JSON object per adapter to FILE\n"
+        "  --verbose              keep the bridge's logging on\n");
+}
+
+static bool Bench_ParseOptions(
+    int argc,
+    char* argv[],
+    BENCH_OPTIONS* Options)
+{
+    memset(Options, 0, sizeof(*Options));
+    Options->Adapters[0] = Options->Adapters[1] = Options->Adapters[2] = true;
+    Options->Devices = 4;
+    Options->IntervalMs = 100;
+    Options->DurationSec = 10;
+    Options->HubLatencyMs = 20;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (0 == strcmp(argv[i], "--verbose"))
+        {
+            Options->Verbose = true;
+            continue;
+        }
+        if (NULL == value)
+        {
+            return false;
+        }
+
+        if (0 == strcmp(argv[i], "--adapters"))
+        {
+            Options->Adapters[0] = (NULL != strstr(value, BenchAdapterNames[0]));
+            Options->Adapters[1] = (NULL != strstr(value, BenchAdapterNames[1]));
+            Options->Adapters[2] = (NULL != strstr(value, BenchAdapterNames[2]));
+        }
+        else if (0 == strcmp(argv[i], "--devices"))
+        {
+            Options->Devices = atoi(value);
+        }
+        else if (0 == strcmp(argv[i], "--interval"))
+        {
+            Options->IntervalMs = (unsigned int)atoi(value);
+        }
+        else if (0 == strcmp(argv[i], "--duration"))
+        {
+            Options->DurationSec = (unsigned int)atoi(value);
+        }
+        else if (0 == strcmp(argv[i], "--hub-latency"))
+        {
+            Options->HubLatencyMs = (unsigned int)atoi(value);
+        }
+        else if (0 == strcmp(argv[i], "--hub-failure-rate"))
+        {
+            Options->HubFailureRate = atof(value);
+        }
+        else if (0 == strcmp(argv[i], "--serial-reactor-threads"))
+        {
+            Options->SerialReactorThreads = (unsigned int)atoi(value);
+        }
+        else if (0 == strcmp(argv[i], "--config"))
+        {
+            Options->ConfigPath = value;
+        }
+        else if (0 == strcmp(argv[i], "--json"))
+        {
+            Options->JsonPath = value;
+        }
+        else
+        {
+            return false;
+        }
+        i++;
+    }
+
+    return Options->Devices > 0 && Options->IntervalMs > 0 && Options->DurationSec > 0 &&
+        Options->HubFailureRate >= 0 && Options->HubFailureRate <= 1;
+}
+
+// Builds the bridge configuration for one adapter: the settings of the --config file with the simulated
+// devices as components
+static JSON_Value* Bench_CreateConfig(
+    const BENCH_OPTIONS* Options,
+    BENCH_DEVICE_TYPE Type,
+    BENCH_DEVICES_HANDLE Devices)
+{
+    JSON_Value* config = (NULL != Options->ConfigPath) ? json_parse_file(Options->ConfigPath) : json_value_init_object();
+    JSON_Object* root = json_value_get_object(config);
+    if (NULL == root)
+    {
+        LogError("Bench: failed to read the configuration %s", Options->ConfigPath);
+        json_value_free(config);
+        return NULL;
+    }
+
+    JSON_Value* components = json_value_init_array();
+    JSON_Value* globalConfigs = json_value_init_object();
+    JSON_Value* adapterConfig = NULL;
+    (void)json_object_set_value(root, PNP_CONFIG_DEVICES, components);
+    (void)json_object_set_value(root, PNP_CONFIG_ADAPTER_GLOBAL, globalConfigs);
+
+    const char* adapterId = BenchAdapterIds[Type];
+    switch (Type)
+    {
+        case BENCH_DEVICE_SERIAL:
+            if (Options->SerialReactorThreads > 0)
+            {
+                char threads[16];
+                (void)snprintf(threads, sizeof(threads), "%u", Options->SerialReactorThreads);
+                adapterConfig = json_value_init_object();
+                (void)json_object_set_string(json_value_get_object(adapterConfig), "reactor_threads", threads);
+            }
+            break;
+        case BENCH_DEVICE_MODBUS:
+            adapterConfig = json_parse_string(
+                "{\"" BENCH_IDENTITY "\":{\"telemetry\":{\"" BENCH_STAMP_FIELD "\":{\"startAddress\":\"40001\",\"length\":1,"
+                "\"dataType\":\"integer\",\"defaultFrequency\":0,\"conversionCoefficient\":1}}}}");
+            (void)json_object_dotset_number(json_value_get_object(adapterConfig),
+                BENCH_IDENTITY ".telemetry." BENCH_STAMP_FIELD ".defaultFrequency", Options->IntervalMs);
+            break;
+        case BENCH_DEVICE_MQTT:
+            adapterConfig = json_parse_string(
+                "{\"" BENCH_IDENTITY "\":[{\"type\":\"telemetry\",\"json_rpc_method\":\"" BENCH_STAMP_FIELD "\","
+                "\"name\":\"" BENCH_STAMP_FIELD "\",\"rx_topic\":\"" BENCH_MQTT_TOPIC "\"}]}");
+            break;
+    }
+    if (NULL != adapterConfig)
+    {
+        (void)json_object_set_value(json_value_get_object(globalConfigs), adapterId, adapterConfig);
+    }
+
+    for (int i = 0; i < Options->Devices; i++)
+    {
+        char name[32];
+        JSON_Value* component = json_value_init_object();
+        JSON_Object* componentObject = json_value_get_object(component);
+        (void)snprintf(name, sizeof(name), "%s%d", BenchAdapterNames[Type], i + 1);
+        (void)json_object_set_string(componentObject, PNP_CONFIG_COMPONENT_NAME, name);
+        (void)json_object_set_string(componentObject, PNP_CONFIG_ADAPTER_ID, adapterId);
+
+        JSON_Value* deviceConfig = json_value_init_object();
+        JSON_Object* deviceObject = json_value_get_object(deviceConfig);
+        switch (Type)
+        {
+            case BENCH_DEVICE_SERIAL:
+                (void)json_object_set_string(deviceObject, "com_port", BenchDevices_GetSerialPort(Devices, i));
+                (void)json_object_set_string(deviceObject, "use_com_device_interface", "false");
+                (void)json_object_set_string(deviceObject, "baud_rate", "115200");
+                break;
+            case BENCH_DEVICE_MODBUS:
+                (void)json_object_set_number(deviceObject, "unit_id", (double)(i % 247 + 1));
+                (void)json_object_dotset_string(deviceObject, "tcp.host", "127.0.0.1");
+                (void)json_object_dotset_number(deviceObject, "tcp.port", BenchDevices_GetPort(Devices));
+                (void)json_object_set_string(deviceObject, "modbus_identity", BENCH_IDENTITY);
+                break;
+            case BENCH_DEVICE_MQTT:
+                (void)json_object_set_string(deviceObject, "mqtt_server", "127.0.0.1");
+                (void)json_object_set_number(deviceObject, "mqtt_port", BenchDevices_GetPort(Devices));
+                (void)json_object_set_string(deviceObject, "mqtt_protocol", "json_rpc");
+                (void)json_object_set_string(deviceObject, "mqtt_identity", BENCH_IDENTITY);
+                break;
+        }
+        (void)json_object_set_value(componentObject, PNP_CONFIG_DEVICE_ADAPTER_CONFIG, deviceConfig);
+        (void)json_array_append_value(json_value_get_array(components), component);
+    }
+
+    return config;
+}
+
+static double Bench_GetCpuSeconds(void)
+{
+    struct rusage usage;
+    (void)getrusage(RUSAGE_SELF, &usage);
+    return (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+        (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static double Bench_GetRssMb(void)
+{
+    long pages = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (NULL != statm)
+    {
+        if (1 != fscanf(statm, "%*s %ld", &pages))
+        {
+            pages = 0;
+        }
+        fclose(statm);
+    }
+    return (double)pages * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+static int Bench_GetThreadCount(void)
+{
+    int threads = 0;
+    char line[128];
+    FILE* status = fopen("/proc/self/status", "r");
+    if (NULL != status)
+    {
+        while (NULL != fgets(line, sizeof(line), status))
+        {
+            if (1 == sscanf(line, "Threads: %d", &threads))
+            {
+                break;
+            }
+        }
+        fclose(status);
+    }
+    return threads;
+}
+
+static bool Bench_Run(
+    const BENCH_OPTIONS* Options,
+    BENCH_DEVICE_TYPE Type,
+    BENCH_RESULT* Result)
+{
+    bool result = false;
+    JSON_Value* config = NULL;
+    BENCH_HUB_HANDLE hub = NULL;
+    BENCH_HUB_STATS stats;
+    bool started = false;
+
+    memset(Result, 0, sizeof(*Result));
+
+    // Devices are forked before any bridge thread exists
+    BENCH_DEVICES_HANDLE devices = BenchDevices_Start(Type, Options->Devices, Options->IntervalMs);
+    if (NULL == devices)
+    {
+        goto exit;
+    }
+
+    if (NULL == (config = Bench_CreateConfig(Options, Type, devices)) ||
+        NULL == (hub = BenchHub_Create(Options->HubLatencyMs, Options->HubFailureRate)))
+    {
+        goto exit;
+    }
+
+    for (int i = 0; i < Options->Devices; i++)
+    {
+        char name[32];
+        (void)snprintf(name, sizeof(name), "%s%d", BenchAdapterNames[Type], i + 1);
+        if (!BenchHub_AddComponent(hub, name))
+        {
+            goto exit;
+        }
+    }
+
+    // The hub stands in for the IoT Hub client, components pick it up as their client handle on start
+    g_PnpBridge = calloc(1, sizeof(PNP_BRIDGE));
+    if (NULL == g_PnpBridge)
+    {
+        LogError("Bench: out of memory");
+        goto exit;
+    }
+    g_PnpBridge->IotHandle.u1.IotModule.moduleHandle = (IOTHUB_MODULE_CLIENT_HANDLE)hub;
+    g_PnpBridge->IotHandle.ClientHandleInitialized = true;
+    g_PnpBridge->IotHandle.Connected = true;
+    g_PnpBridge->IoTClientType = PNP_BRIDGE_IOT_TYPE_DEVICE;
+    g_PnpBridge->Configuration.JsonConfig = config;
+
+    if (IOTHUB_CLIENT_OK != PnpAdapterManager_BuildAdaptersAndComponents(&g_PnpBridge->PnpMgr, config, PNP_BRIDGE_IOT_TYPE_DEVICE) ||
+        IOTHUB_CLIENT_OK != PnpAdapterManager_StartComponents(g_PnpBridge->PnpMgr))
+    {
+        LogError("Bench: failed to start the %s components", BenchAdapterNames[Type]);
+        goto exit;
+    }
+    started = true;
+
+    // Connections, descriptors and subscriptions are not part of the measurement
+    uint64_t deadline = Bench_GetTimeMs() + BENCH_WARMUP_TIMEOUT_MS;
+    do
+    {
+        ThreadAPI_Sleep(BENCH_SAMPLE_INTERVAL_MS);
+        BenchHub_GetStats(hub, &stats);
+    } while (stats.ComponentsReporting < (size_t)Options->Devices && Bench_GetTimeMs() < deadline);
+
+    BenchHub_ResetStats(hub);
+    double cpuStart = Bench_GetCpuSeconds();
+    uint64_t start = Bench_GetTimeMs();
+    uint64_t end = start + (uint64_t)Options->DurationSec * 1000;
+    while (Bench_GetTimeMs() < end)
+    {
+        ThreadAPI_Sleep(BENCH_SAMPLE_INTERVAL_MS);
+        double rss = Bench_GetRssMb();
+        if (rss > Result->RssMb)
+        {
+            Result->RssMb = rss;
+        }
+        int threads = Bench_GetThreadCount();
+        if (threads > Result->Threads)
+        {
+            Result->Threads = threads;
+        }
+    }
+
+    BenchHub_GetStats(hub, &Result->Hub);
+    Result->Seconds = (double)(Bench_GetTimeMs() - start) / 1000.0;
+    Result->CpuPercent = 100.0 * (Bench_GetCpuSeconds() - cpuStart) / Result->Seconds;
+    Result->AllReporting = (Result->Hub.ComponentsReporting == (size_t)Options->Devices);
+    result = true;
+
+exit:
+    // The serial adapter reads its port until it hangs up, its devices go first. Other devices stay up
+    // until their components have disconnected.
+    if (BENCH_DEVICE_SERIAL == Type)
+    {
+        BenchDevices_Stop(devices);
+        devices = NULL;
+    }
+    if (NULL != g_PnpBridge)
+    {
+        if (started)
+        {
+            PnpAdapterManager_StopComponents(g_PnpBridge->PnpMgr);
+        }
+        // As the IoT Hub client, the hub is destroyed between stopping and destroying the components
+        BenchHub_Destroy(hub);
+        hub = NULL;
+        if (NULL != g_PnpBridge->PnpMgr)
+        {
+            PnpAdapterManager_DestroyComponents(g_PnpBridge->PnpMgr);
+            PnpAdapterManager_ReleaseManager(g_PnpBridge->PnpMgr);
+        }
+        free(g_PnpBridge);
+        g_PnpBridge = NULL;
+    }
+    BenchHub_Destroy(hub);
+    BenchDevices_Stop(devices);
+    json_value_free(config);
+    return result;
+}
+
+static void Bench_WriteJson(
+    FILE* File,
+    const BENCH_OPTIONS* Options,
+    BENCH_DEVICE_TYPE Type,
+    const BENCH_RESULT* Result)
+{
+    JSON_Value* value = json_value_init_object();
+    JSON_Object* object = json_value_get_object(value);
+
+    (void)json_object_set_string(object, "adapter", BenchAdapterNames[Type]);
+    (void)json_object_set_number(object, "devices", Options->Devices);
+    (void)json_object_set_number(object, "interval_ms", Options->IntervalMs);
+    (void)json_object_set_number(object, "hub_latency_ms", Options->HubLatencyMs);
+    (void)json_object_set_number(object, "hub_failure_rate", Options->HubFailureRate);
+    (void)json_object_set_number(object, "seconds", Result->Seconds);
+    (void)json_object_set_number(object, "messages_per_sec", (double)Result->Hub.Messages / Result->Seconds);
+    (void)json_object_set_number(object, "readings_per_sec", (double)Result->Hub.Readings / Result->Seconds);
+    (void)json_object_set_number(object, "bytes_per_sec", (double)Result->Hub.MessageBytes / Result->Seconds);
+    (void)json_object_set_number(object, "latency_p50_ms", Result->Hub.LatencyP50Ms);
+    (void)json_object_set_number(object, "latency_p99_ms", Result->Hub.LatencyP99Ms);
+    (void)json_object_set_number(object, "latency_max_ms", Result->Hub.LatencyMaxMs);
+    (void)json_object_set_number(object, "messages_confirmed", (double)Result->Hub.Confirmed);
+    (void)json_object_set_number(object, "messages_failed", (double)Result->Hub.Failed);
+    (void)json_object_set_number(object, "reported_states", (double)Result->Hub.ReportedStates);
+    (void)json_object_set_number(object, "components_reporting", (double)Result->Hub.ComponentsReporting);
+    (void)json_object_set_number(object, "cpu_percent", Result->CpuPercent);
+    (void)json_object_set_number(object, "rss_mb", Result->RssMb);
+    (void)json_object_set_number(object, "threads", Result->Threads);
+    if (BENCH_DEVICE_SERIAL == Type)
+    {
+        (void)json_object_set_number(object, "serial_reactor_threads", Options->SerialReactorThreads);
+    }
+
+    char* serialized = json_serialize_to_string(value);
+    if (NULL != serialized)
+    {
+        fprintf(File, "%s\n", serialized);
+        json_free_serialized_string(serialized);
+    }
+    json_value_free(value);
+}
+
+int main(int argc, char* argv[])
+{
+    BENCH_OPTIONS options;
+    FILE* jsonFile = NULL;
+    int exitCode = 0;
+
+    if (!Bench_ParseOptions(argc, argv, &options))
+    {
+        Bench_Usage();
+        return 2;
+    }
+
+    if (NULL != options.JsonPath && NULL == (jsonFile = fopen(options.JsonPath, "w")))
+    {
+        fprintf(stderr, "Failed to open %s\n", options.JsonPath);
+        return 2;
+    }
+
+    // Logging would dominate the CPU time of the telemetry path
+    if (!options.Verbose)
+    {
+        xlogging_set_log_function(NULL);
+    }
+
+    if (0 != platform_init())
+    {
+        fprintf(stderr, "platform_init failed\n");
+        return 1;
+    }
+
+    printf("%d devices per adapter, one reading every %u ms, IoT Hub confirms after %u ms and fails %.1f%%\n\n",
+        options.Devices, options.IntervalMs, options.HubLatencyMs, 100.0 * options.HubFailureRate);
+    printf("%-8s %10s %10s %8s %8s %8s %8s %8s %8s %8s\n",
+        "adapter", "msgs/s", "reads/s", "p50 ms", "p99 ms", "max ms", "failed", "cpu %", "rss MB", "threads");
+
+    for (int type = BENCH_DEVICE_SERIAL; type <= BENCH_DEVICE_MQTT; type++)
+    {
+        BENCH_RESULT result;
+        if (!options.Adapters[type])
+        {
+            continue;
+        }
+
+        if (!Bench_Run(&options, (BENCH_DEVICE_TYPE)type, &result))
+        {
+            printf("%-8s failed to run\n", BenchAdapterNames[type]);
+            exitCode = 1;
+            continue;
+        }
+
+        printf("%-8s %10.1f %10.1f %8u %8u %8u %8llu %8.1f %8.1f %8d%s\n",
+            BenchAdapterNames[type],
+            (double)result.Hub.Messages / result.Seconds,
+            (double)result.Hub.Readings / result.Seconds,
+            result.Hub.LatencyP50Ms,
+            result.Hub.LatencyP99Ms,
+            result.Hub.LatencyMaxMs,
+            (unsigned long long)result.Hub.Failed,
+            result.CpuPercent,
+            result.RssMb,
+            result.Threads,
+            result.AllReporting ? "" : "  (not every component reported)");
+        if (!result.AllReporting)
+        {
+            exitCode = 1;
+        }
+        if (NULL != jsonFile)
+        {
+            Bench_WriteJson(jsonFile, &options, (BENCH_DEVICE_TYPE)type, &result);
+        }
+    }
+
+    platform_deinit();
+    if (NULL != jsonFile)
+    {
+        fclose(jsonFile);
+    }
+    return exitCode;
+}
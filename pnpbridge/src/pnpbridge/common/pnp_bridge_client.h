@@ -7,7 +7,14 @@
 #include "iothub_device_client.h"
 #include "iothub_module_client.h"
 
-#ifdef USE_MODULE_CLIENT
+#if defined(PNPBRIDGE_BENCH)
+    // pnpbridge_bench links the core against an in-process IoT Hub stand-in, see bench/bench_hub.c
+    typedef IOTHUB_DEVICE_CLIENT_HANDLE PNP_BRIDGE_CLIENT_HANDLE;
+    IOTHUB_CLIENT_RESULT BenchHub_SendReportedState(PNP_BRIDGE_CLIENT_HANDLE ClientHandle, const unsigned char* ReportedState, size_t Size, IOTHUB_CLIENT_REPORTED_STATE_CALLBACK ReportedStateCallback, void* UserContextCallback);
+    IOTHUB_CLIENT_RESULT BenchHub_SendEventAsync(PNP_BRIDGE_CLIENT_HANDLE ClientHandle, IOTHUB_MESSAGE_HANDLE EventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK EventConfirmationCallback, void* UserContextCallback);
+    #define PnpBridgeClient_SendReportedState(iotHubClientHandle, reportedState, size, reportedStateCallback, userContextCallback) BenchHub_SendReportedState(iotHubClientHandle, reportedState, size, reportedStateCallback, userContextCallback)
+    #define PnpBridgeClient_SendEventAsync(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback) BenchHub_SendEventAsync(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback)
+#elif defined(USE_MODULE_CLIENT)
     typedef IOTHUB_MODULE_CLIENT_HANDLE PNP_BRIDGE_CLIENT_HANDLE;
     #define PnpBridgeClient_SendReportedState(iotHubClientHandle, reportedState, size, reportedStateCallback, userContextCallback) IoTHubModuleClient_SendReportedState(iotHubClientHandle, reportedState, size, reportedStateCallback, userContextCallback)
     #define PnpBridgeClient_SendEventAsync(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback) IoTHubModuleClient_SendEventAsync(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback)
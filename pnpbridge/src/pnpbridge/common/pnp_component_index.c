@@ -0,0 +1,204 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Header associated with this .c file
+#include "pnp_component_index.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// IoT core utility related header files
+#include "azure_c_shared_utility/xlogging.h"
+
+// Smallest number of slots allocated for an index.
+#define PNP_COMPONENT_INDEX_MIN_CAPACITY 16
+
+typedef struct PNP_COMPONENT_INDEX_ENTRY_TAG
+{
+    const char* name;
+    size_t nameSize;
+    uint32_t hash;
+    void* value;
+} PNP_COMPONENT_INDEX_ENTRY;
+
+typedef struct PNP_COMPONENT_INDEX_TAG
+{
+    // Open addressed table with linear probing. capacity is always a power of two and
+    // count is kept at or below half of capacity so probe sequences stay short.
+    PNP_COMPONENT_INDEX_ENTRY* entries;
+    size_t capacity;
+    size_t count;
+} PNP_COMPONENT_INDEX;
+
+//
+// HashComponentName computes the 32-bit FNV-1a hash of the first nameSize characters of name.
+//
+static uint32_t HashComponentName(const char* name, size_t nameSize)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < nameSize; i++)
+    {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t GetCapacityForCount(size_t count)
+{
+    size_t capacity = PNP_COMPONENT_INDEX_MIN_CAPACITY;
+    while (capacity < count * 2)
+    {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+//
+// FindSlot returns the slot holding (name, nameSize) or, if the name is not present, the empty slot where it would be inserted.
+//
+static PNP_COMPONENT_INDEX_ENTRY* FindSlot(PNP_COMPONENT_INDEX_ENTRY* entries, size_t capacity, const char* name, size_t nameSize, uint32_t hash)
+{
+    size_t mask = capacity - 1;
+    size_t slot = hash & mask;
+
+    while (entries[slot].name != NULL)
+    {
+        if (entries[slot].hash == hash && entries[slot].nameSize == nameSize &&
+            memcmp(entries[slot].name, name, nameSize) == 0)
+        {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return &entries[slot];
+}
+
+static bool GrowIndex(PNP_COMPONENT_INDEX* componentIndex)
+{
+    size_t newCapacity = componentIndex->capacity * 2;
+    PNP_COMPONENT_INDEX_ENTRY* newEntries = calloc(newCapacity, sizeof(PNP_COMPONENT_INDEX_ENTRY));
+    if (newEntries == NULL)
+    {
+        LogError("Unable to grow component index to %lu entries", (unsigned long)newCapacity);
+        return false;
+    }
+
+    for (size_t i = 0; i < componentIndex->capacity; i++)
+    {
+        PNP_COMPONENT_INDEX_ENTRY* entry = &componentIndex->entries[i];
+        if (entry->name != NULL)
+        {
+            *FindSlot(newEntries, newCapacity, entry->name, entry->nameSize, entry->hash) = *entry;
+        }
+    }
+
+    free(componentIndex->entries);
+    componentIndex->entries = newEntries;
+    componentIndex->capacity = newCapacity;
+    return true;
+}
+
+PNP_COMPONENT_INDEX_HANDLE PnP_ComponentIndex_Create(size_t expectedCount)
+{
+    PNP_COMPONENT_INDEX* componentIndex = calloc(1, sizeof(PNP_COMPONENT_INDEX));
+    if (componentIndex == NULL)
+    {
+        LogError("Unable to allocate component index");
+    }
+    else
+    {
+        componentIndex->capacity = GetCapacityForCount(expectedCount);
+        if ((componentIndex->entries = calloc(componentIndex->capacity, sizeof(PNP_COMPONENT_INDEX_ENTRY))) == NULL)
+        {
+            LogError("Unable to allocate component index with %lu entries", (unsigned long)componentIndex->capacity);
+            free(componentIndex);
+            componentIndex = NULL;
+        }
+    }
+
+    return componentIndex;
+}
+
+void PnP_ComponentIndex_Destroy(PNP_COMPONENT_INDEX_HANDLE componentIndex)
+{
+    if (componentIndex != NULL)
+    {
+        free(componentIndex->entries);
+        free(componentIndex);
+    }
+}
+
+bool PnP_ComponentIndex_Add(PNP_COMPONENT_INDEX_HANDLE componentIndex, const char* componentName, void* value)
+{
+    bool result = false;
+
+    if (componentIndex == NULL || componentName == NULL)
+    {
+        LogError("Invalid parameter: componentIndex=%p, componentName=%p", componentIndex, componentName);
+    }
+    else if ((componentIndex->count + 1) * 2 > componentIndex->capacity && !GrowIndex(componentIndex))
+    {
+        LogError("Unable to add component %s to index", componentName);
+    }
+    else
+    {
+        size_t nameSize = strlen(componentName);
+        uint32_t hash = HashComponentName(componentName, nameSize);
+        PNP_COMPONENT_INDEX_ENTRY* entry = FindSlot(componentIndex->entries, componentIndex->capacity, componentName, nameSize, hash);
+
+        if (entry->name != NULL)
+        {
+            LogError("Component %s is already in the index", componentName);
+        }
+        else
+        {
+            entry->name = componentName;
+            entry->nameSize = nameSize;
+            entry->hash = hash;
+            entry->value = value;
+            componentIndex->count++;
+            result = true;
+        }
+    }
+
+    return result;
+}
+
+void* PnP_ComponentIndex_Find(PNP_COMPONENT_INDEX_HANDLE componentIndex, const char* componentName, size_t componentNameSize)
+{
+    void* value = NULL;
+
+    if (componentIndex != NULL && componentName != NULL && componentIndex->count != 0)
+    {
+        PNP_COMPONENT_INDEX_ENTRY* entry = FindSlot(componentIndex->entries, componentIndex->capacity, componentName,
+            componentNameSize, HashComponentName(componentName, componentNameSize));
+        if (entry->name != NULL)
+        {
+            value = entry->value;
+        }
+    }
+
+    return value;
+}
+
+bool PnP_ComponentIndex_Contains(PNP_COMPONENT_INDEX_HANDLE componentIndex, const char* componentName)
+{
+    bool result = false;
+
+    if (componentIndex != NULL && componentName != NULL && componentIndex->count != 0)
+    {
+        size_t nameSize = strlen(componentName);
+        result = (FindSlot(componentIndex->entries, componentIndex->capacity, componentName, nameSize,
+            HashComponentName(componentName, nameSize))->name != NULL);
+    }
+
+    return result;
+}
+
+size_t PnP_ComponentIndex_GetCount(PNP_COMPONENT_INDEX_HANDLE componentIndex)
+{
+    return (componentIndex != NULL) ? componentIndex->count : 0;
+}
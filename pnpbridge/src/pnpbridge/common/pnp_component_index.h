@@ -0,0 +1,62 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+//
+// PnP component index is an exact-match hash table from a component name to an opaque value (typically the
+// component handle owned by the adapter manager). It is used to route device twin updates and device methods
+// to the right component without walking every adapter's component list.
+//
+// Lookups take the name as a (pointer, length) pair so that non-NULL terminated names, such as the component
+// portion of a device method name returned by PnP_ParseCommandName, can be resolved without copying.
+//
+
+#ifndef PNP_COMPONENT_INDEX_H
+#define PNP_COMPONENT_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct PNP_COMPONENT_INDEX_TAG* PNP_COMPONENT_INDEX_HANDLE;
+
+//
+// PnP_ComponentIndex_Create allocates an empty index sized to hold expectedCount components without rehashing.
+//
+PNP_COMPONENT_INDEX_HANDLE PnP_ComponentIndex_Create(size_t expectedCount);
+
+//
+// PnP_ComponentIndex_Destroy frees the index. Names and values added to the index are not owned by it and are not freed.
+//
+void PnP_ComponentIndex_Destroy(PNP_COMPONENT_INDEX_HANDLE componentIndex);
+
+//
+// PnP_ComponentIndex_Add adds componentName to the index. componentName must stay valid for the lifetime of the index.
+// Returns false if the name is already present or if the index could not grow.
+//
+bool PnP_ComponentIndex_Add(PNP_COMPONENT_INDEX_HANDLE componentIndex, const char* componentName, void* value);
+
+//
+// PnP_ComponentIndex_Find returns the value stored for the component whose name is exactly the componentNameSize
+// characters at componentName, or NULL if there is no such component.
+//
+void* PnP_ComponentIndex_Find(PNP_COMPONENT_INDEX_HANDLE componentIndex, const char* componentName, size_t componentNameSize);
+
+//
+// PnP_ComponentIndex_Contains returns true if the NULL terminated componentName is in the index.
+//
+bool PnP_ComponentIndex_Contains(PNP_COMPONENT_INDEX_HANDLE componentIndex, const char* componentName);
+
+//
+// PnP_ComponentIndex_GetCount returns the number of components in the index.
+//
+size_t PnP_ComponentIndex_GetCount(PNP_COMPONENT_INDEX_HANDLE componentIndex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PNP_COMPONENT_INDEX_H */
@@ -8,6 +8,7 @@
 #include "iothub.h"
 #include "iothub_device_client.h"
 #include "iothub_module_client.h"
+#include "iothub_client_core.h"
 #include "iothub_client_options.h"
 #include "iothubtransportmqtt.h"
 #include "pnp_device_client.h"
@@ -81,11 +82,18 @@ IOTHUB_DEVICE_CLIENT_HANDLE PnP_CreateDeviceClientHandle(const PNP_DEVICE_CONFIG
         result = false;
     }
     // Optionally, set the callback function that processes incoming device methods, which is the channel PnP Commands are transferred over
-    else if ((pnpDeviceConfiguration->deviceMethodCallback != NULL) && (iothubResult = IoTHubDeviceClient_SetDeviceMethodCallback(deviceHandle, pnpDeviceConfiguration->deviceMethodCallback, NULL)) != IOTHUB_CLIENT_OK)
+    else if ((pnpDeviceConfiguration->inboundDeviceMethodCallback == NULL) && (pnpDeviceConfiguration->deviceMethodCallback != NULL) && (iothubResult = IoTHubDeviceClient_SetDeviceMethodCallback(deviceHandle, pnpDeviceConfiguration->deviceMethodCallback, NULL)) != IOTHUB_CLIENT_OK)
     {
         LogError("Unable to set device method callback, error=%d", iothubResult);
         result = false;
     }
+    // Optionally, set the callback function for device methods that are answered after the callback returns. The device client
+    // has no such setter, its handle is passed to the client core instead.
+    else if ((pnpDeviceConfiguration->inboundDeviceMethodCallback != NULL) && (iothubResult = IoTHubClientCore_SetDeviceMethodCallback_Ex(deviceHandle, pnpDeviceConfiguration->inboundDeviceMethodCallback, (void*)deviceHandle)) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Unable to set inbound device method callback, error=%d", iothubResult);
+        result = false;
+    }
     // Optionall, set the callback function that processes device twin changes from the IoTHub, which is the channel that PnP Properties are 
     // transferred over. This will also automatically retrieve the full twin for the application on startup.
     else if ((pnpDeviceConfiguration->deviceTwinCallback != NULL) && (iothubResult = IoTHubDeviceClient_SetDeviceTwinCallback(deviceHandle, pnpDeviceConfiguration->deviceTwinCallback, (void*)deviceHandle)) != IOTHUB_CLIENT_OK)
@@ -93,6 +101,12 @@ IOTHUB_DEVICE_CLIENT_HANDLE PnP_CreateDeviceClientHandle(const PNP_DEVICE_CONFIG
         LogError("Unable to set device twin callback, error=%d", iothubResult);
         result = false;
     }
+    // Optionally, set the callback function that is notified when the connection to the IoTHub is lost or restored.
+    else if ((pnpDeviceConfiguration->connectionStatusCallback != NULL) && (iothubResult = IoTHubDeviceClient_SetConnectionStatusCallback(deviceHandle, pnpDeviceConfiguration->connectionStatusCallback, NULL)) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Unable to set connection status callback, error=%d", iothubResult);
+        result = false;
+    }
     // Enabling auto url encode will have the underlying SDK perform URL encoding operations automatically.
     else if ((iothubResult = IoTHubDeviceClient_SetOption(deviceHandle, OPTION_AUTO_URL_ENCODE_DECODE, &urlAutoEncodeDecode)) != IOTHUB_CLIENT_OK)
     {
@@ -184,6 +198,7 @@ IOTHUB_MODULE_CLIENT_HANDLE PnP_CreateModuleClientHandle(const PNP_DEVICE_CONFIG
         result = false;
     }
     // Optionally, set the callback function that processes incoming device methods, which is the channel PnP Commands are transferred over
+    // Module clients have no core handle to answer a method with later, so inboundDeviceMethodCallback is not used here.
     else if ((pnpModuleConfiguration->deviceMethodCallback != NULL) && (iothubResult = IoTHubModuleClient_SetModuleMethodCallback(moduleClientHandle, pnpModuleConfiguration->deviceMethodCallback, NULL)) != IOTHUB_CLIENT_OK)
     {
         LogError("Unable to set device method callback for module client, error=%d", iothubResult);
@@ -196,6 +211,12 @@ IOTHUB_MODULE_CLIENT_HANDLE PnP_CreateModuleClientHandle(const PNP_DEVICE_CONFIG
         LogError("Unable to set device twin callback for module client, error=%d", iothubResult);
         result = false;
     }
+    // Optionally, set the callback function that is notified when the connection to the IoTHub is lost or restored.
+    else if ((pnpModuleConfiguration->connectionStatusCallback != NULL) && (iothubResult = IoTHubModuleClient_SetConnectionStatusCallback(moduleClientHandle, pnpModuleConfiguration->connectionStatusCallback, NULL)) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Unable to set connection status callback for module client, error=%d", iothubResult);
+        result = false;
+    }
     // Enabling auto url encode will have the underlying SDK perform URL encoding operations automatically.
     else if ((iothubResult = IoTHubModuleClient_SetOption(moduleClientHandle, OPTION_AUTO_URL_ENCODE_DECODE, &urlAutoEncodeDecode)) != IOTHUB_CLIENT_OK)
     {
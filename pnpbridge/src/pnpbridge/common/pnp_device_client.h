@@ -6,6 +6,7 @@
 
 #include "iothub_device_client.h"
 #include "iothub_module_client.h"
+#include "iothub_client_core.h"
 
 //
 // Whether we're using a connection string or DPS provisioning for device credentials
@@ -46,9 +47,16 @@ typedef struct PNP_DEVICE_CONFIGURATION_TAG
     // Callback for IoT Hub device methods, which is the mechanism PnP commands use.  If PnP commands
     // are not used, this should be NULL to conserve memory and bandwidth.
     IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC deviceMethodCallback;
+    // Callback for IoT Hub device methods that are answered later with IoTHubClientCore_DeviceMethodResponse, so that
+    // a slow command does not hold up the IoT Hub client's callback thread. When set, deviceMethodCallback is not used.
+    // Only device clients support it, module clients always use deviceMethodCallback.
+    IOTHUB_CLIENT_INBOUND_DEVICE_METHOD_CALLBACK inboundDeviceMethodCallback;
     // Callback for IoT Hub device twin notifications, which is the mechanism PnP properties from service use.
     // If PnP properties are not configured by the server, this should be NULL to conserve memory and bandwidth.
     IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback;
+    // Callback for changes of the connection to IoT Hub, e.g. to restore reported state after a reconnect.
+    // This may be NULL.
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback;
     // User Agent String: User/Solution defined product identifuier sent to IoT Hub service
     const char * UserAgentString;
 } PNP_DEVICE_CONFIGURATION;
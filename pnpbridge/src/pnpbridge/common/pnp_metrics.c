@@ -0,0 +1,592 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Header associated with this .c file
+#include "pnp_metrics.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pnp_component_index.h"
+
+// IoT core utility related header files
+#include "azure_c_shared_utility/xlogging.h"
+
+// Upper bounds in milliseconds of the histogram buckets, an implicit last bucket holds everything larger
+static const uint32_t g_histogramBounds[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000 };
+#define PNP_METRICS_BUCKET_COUNT (sizeof(g_histogramBounds) / sizeof(g_histogramBounds[0]) + 1)
+
+// Name bridge metrics are stored under. PnP component names cannot be empty, so this never collides.
+static const char g_bridgeComponentName[] = "";
+
+typedef struct PNP_METRIC_FAMILY_TAG
+{
+    char* name;
+    PNP_METRIC_TYPE type;
+} PNP_METRIC_FAMILY;
+
+typedef struct PNP_METRIC_SERIES_TAG
+{
+    const PNP_METRIC_FAMILY* family;
+    // Value of a counter or gauge
+    int64_t value;
+    // Observations of a histogram
+    uint64_t bucketCounts[PNP_METRICS_BUCKET_COUNT];
+    uint64_t count;
+    uint64_t sum;
+    uint32_t max;
+} PNP_METRIC_SERIES;
+
+typedef struct PNP_METRICS_COMPONENT_TAG
+{
+    char* name;
+    PNP_COMPONENT_INDEX_HANDLE seriesIndex;
+    PNP_METRIC_SERIES** series;
+    size_t seriesCount;
+    size_t seriesCapacity;
+} PNP_METRICS_COMPONENT;
+
+typedef struct PNP_METRICS_TAG
+{
+    PNP_COMPONENT_INDEX_HANDLE familyIndex;
+    PNP_METRIC_FAMILY** families;
+    size_t familyCount;
+    size_t familyCapacity;
+
+    PNP_COMPONENT_INDEX_HANDLE componentIndex;
+    PNP_METRICS_COMPONENT** components;
+    size_t componentCount;
+    size_t componentCapacity;
+} PNP_METRICS;
+
+typedef struct PNP_METRICS_BUFFER_TAG
+{
+    char* data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} PNP_METRICS_BUFFER;
+
+static char* CopyString(const char* value)
+{
+    size_t length = strlen(value) + 1;
+    char* copy = malloc(length);
+    if (copy != NULL)
+    {
+        memcpy(copy, value, length);
+    }
+    return copy;
+}
+
+//
+// AppendPointer adds value to a growable array of pointers.
+//
+static bool AppendPointer(void*** items, size_t* count, size_t* capacity, void* value)
+{
+    if (*count == *capacity)
+    {
+        size_t newCapacity = (*capacity == 0) ? 8 : (*capacity * 2);
+        void** newItems = realloc(*items, newCapacity * sizeof(void*));
+        if (newItems == NULL)
+        {
+            return false;
+        }
+        *items = newItems;
+        *capacity = newCapacity;
+    }
+
+    (*items)[*count] = value;
+    (*count)++;
+    return true;
+}
+
+//
+// Append adds length characters of text to the buffer. After a failed allocation the buffer ignores further
+// text and its result is discarded.
+//
+static void Append(PNP_METRICS_BUFFER* buffer, const char* text, size_t length)
+{
+    if (buffer->failed)
+    {
+        return;
+    }
+
+    if (buffer->length + length + 1 > buffer->capacity)
+    {
+        size_t newCapacity = (buffer->capacity == 0) ? 1024 : buffer->capacity;
+        while (buffer->length + length + 1 > newCapacity)
+        {
+            newCapacity *= 2;
+        }
+
+        char* newData = realloc(buffer->data, newCapacity);
+        if (newData == NULL)
+        {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = newData;
+        buffer->capacity = newCapacity;
+    }
+
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+}
+
+static void AppendString(PNP_METRICS_BUFFER* buffer, const char* text)
+{
+    Append(buffer, text, strlen(text));
+}
+
+static void AppendFormat(PNP_METRICS_BUFFER* buffer, const char* format, ...)
+{
+    char text[64];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    if (length > 0)
+    {
+        Append(buffer, text, ((size_t)length < sizeof(text)) ? (size_t)length : sizeof(text) - 1);
+    }
+}
+
+// Escapes '\', '"' and control characters, which is valid both for Prometheus label values and JSON strings
+static void AppendEscaped(PNP_METRICS_BUFFER* buffer, const char* text)
+{
+    for (const char* character = text; *character != '\0'; character++)
+    {
+        if (*character == '\\' || *character == '"')
+        {
+            Append(buffer, "\\", 1);
+            Append(buffer, character, 1);
+        }
+        else if (*character == '\n')
+        {
+            Append(buffer, "\\n", 2);
+        }
+        else if ((unsigned char)*character < 0x20)
+        {
+            // Not representable in a Prometheus label value, dropped
+        }
+        else
+        {
+            Append(buffer, character, 1);
+        }
+    }
+}
+
+static char* FinishBuffer(PNP_METRICS_BUFFER* buffer)
+{
+    if (buffer->failed)
+    {
+        LogError("Unable to allocate metrics text");
+        free(buffer->data);
+        return NULL;
+    }
+    return buffer->data;
+}
+
+static void DestroyComponent(PNP_METRICS_COMPONENT* component)
+{
+    for (size_t i = 0; i < component->seriesCount; i++)
+    {
+        free(component->series[i]);
+    }
+    free(component->series);
+    PnP_ComponentIndex_Destroy(component->seriesIndex);
+    free(component->name);
+    free(component);
+}
+
+static PNP_METRIC_FAMILY* GetFamily(PNP_METRICS* metrics, const char* metricName, PNP_METRIC_TYPE type)
+{
+    PNP_METRIC_FAMILY* family = PnP_ComponentIndex_Find(metrics->familyIndex, metricName, strlen(metricName));
+    if (family != NULL)
+    {
+        if (family->type != type)
+        {
+            LogError("Metric %s is updated as a different type than it was created with", metricName);
+            return NULL;
+        }
+        return family;
+    }
+
+    if ((family = calloc(1, sizeof(PNP_METRIC_FAMILY))) == NULL)
+    {
+        LogError("Unable to allocate metric %s", metricName);
+        return NULL;
+    }
+
+    family->type = type;
+    if (((family->name = CopyString(metricName)) == NULL) ||
+        !AppendPointer((void***)&metrics->families, &metrics->familyCount, &metrics->familyCapacity, family))
+    {
+        LogError("Unable to add metric %s", metricName);
+        free(family->name);
+        free(family);
+        return NULL;
+    }
+
+    if (!PnP_ComponentIndex_Add(metrics->familyIndex, family->name, family))
+    {
+        LogError("Unable to index metric %s", metricName);
+        metrics->familyCount--;
+        free(family->name);
+        free(family);
+        return NULL;
+    }
+
+    return family;
+}
+
+static PNP_METRICS_COMPONENT* GetComponent(PNP_METRICS* metrics, const char* componentName)
+{
+    PNP_METRICS_COMPONENT* component = PnP_ComponentIndex_Find(metrics->componentIndex, componentName, strlen(componentName));
+    if (component != NULL)
+    {
+        return component;
+    }
+
+    if ((component = calloc(1, sizeof(PNP_METRICS_COMPONENT))) == NULL)
+    {
+        LogError("Unable to allocate metrics of component %s", componentName);
+        return NULL;
+    }
+
+    if (((component->name = CopyString(componentName)) == NULL) ||
+        ((component->seriesIndex = PnP_ComponentIndex_Create(0)) == NULL) ||
+        !AppendPointer((void***)&metrics->components, &metrics->componentCount, &metrics->componentCapacity, component))
+    {
+        LogError("Unable to add metrics of component %s", componentName);
+        DestroyComponent(component);
+        return NULL;
+    }
+
+    if (!PnP_ComponentIndex_Add(metrics->componentIndex, component->name, component))
+    {
+        LogError("Unable to index metrics of component %s", componentName);
+        metrics->componentCount--;
+        DestroyComponent(component);
+        return NULL;
+    }
+
+    return component;
+}
+
+static PNP_METRIC_SERIES* GetSeries(PNP_METRICS* metrics, const char* componentName, const char* metricName, PNP_METRIC_TYPE type)
+{
+    PNP_METRICS_COMPONENT* component = GetComponent(metrics, (componentName != NULL) ? componentName : g_bridgeComponentName);
+    if (component == NULL)
+    {
+        return NULL;
+    }
+
+    PNP_METRIC_SERIES* series = PnP_ComponentIndex_Find(component->seriesIndex, metricName, strlen(metricName));
+    if (series != NULL)
+    {
+        if (series->family->type != type)
+        {
+            LogError("Metric %s is updated as a different type than it was created with", metricName);
+            return NULL;
+        }
+        return series;
+    }
+
+    const PNP_METRIC_FAMILY* family = GetFamily(metrics, metricName, type);
+    if (family == NULL)
+    {
+        return NULL;
+    }
+
+    if ((series = calloc(1, sizeof(PNP_METRIC_SERIES))) == NULL)
+    {
+        LogError("Unable to allocate metric %s", metricName);
+        return NULL;
+    }
+
+    series->family = family;
+    if (!AppendPointer((void***)&component->series, &component->seriesCount, &component->seriesCapacity, series))
+    {
+        LogError("Unable to add metric %s", metricName);
+        free(series);
+        return NULL;
+    }
+
+    // The series is keyed on the family's copy of the name
+    if (!PnP_ComponentIndex_Add(component->seriesIndex, family->name, series))
+    {
+        LogError("Unable to index metric %s", metricName);
+        component->seriesCount--;
+        free(series);
+        return NULL;
+    }
+
+    return series;
+}
+
+PNP_METRICS_HANDLE PnP_Metrics_Create(void)
+{
+    PNP_METRICS* metrics = calloc(1, sizeof(PNP_METRICS));
+    if (metrics == NULL)
+    {
+        LogError("Unable to allocate metrics");
+        return NULL;
+    }
+
+    if (((metrics->familyIndex = PnP_ComponentIndex_Create(0)) == NULL) ||
+        ((metrics->componentIndex = PnP_ComponentIndex_Create(0)) == NULL))
+    {
+        LogError("Unable to allocate metrics");
+        PnP_Metrics_Destroy(metrics);
+        return NULL;
+    }
+
+    return metrics;
+}
+
+void PnP_Metrics_Destroy(PNP_METRICS_HANDLE metrics)
+{
+    if (metrics != NULL)
+    {
+        for (size_t i = 0; i < metrics->componentCount; i++)
+        {
+            DestroyComponent(metrics->components[i]);
+        }
+        free(metrics->components);
+        PnP_ComponentIndex_Destroy(metrics->componentIndex);
+
+        for (size_t i = 0; i < metrics->familyCount; i++)
+        {
+            free(metrics->families[i]->name);
+            free(metrics->families[i]);
+        }
+        free(metrics->families);
+        PnP_ComponentIndex_Destroy(metrics->familyIndex);
+
+        free(metrics);
+    }
+}
+
+bool PnP_Metrics_AddCounter(PNP_METRICS_HANDLE metrics, const char* componentName, const char* metricName, uint64_t delta)
+{
+    PNP_METRIC_SERIES* series = GetSeries(metrics, componentName, metricName, PNP_METRIC_TYPE_COUNTER);
+    if (series == NULL)
+    {
+        return false;
+    }
+
+    series->value += (int64_t)delta;
+    return true;
+}
+
+bool PnP_Metrics_AddGauge(PNP_METRICS_HANDLE metrics, const char* componentName, const char* metricName, int64_t delta)
+{
+    PNP_METRIC_SERIES* series = GetSeries(metrics, componentName, metricName, PNP_METRIC_TYPE_GAUGE);
+    if (series == NULL)
+    {
+        return false;
+    }
+
+    series->value += delta;
+    return true;
+}
+
+bool PnP_Metrics_SetGauge(PNP_METRICS_HANDLE metrics, const char* componentName, const char* metricName, int64_t value)
+{
+    PNP_METRIC_SERIES* series = GetSeries(metrics, componentName, metricName, PNP_METRIC_TYPE_GAUGE);
+    if (series == NULL)
+    {
+        return false;
+    }
+
+    series->value = value;
+    return true;
+}
+
+bool PnP_Metrics_Observe(PNP_METRICS_HANDLE metrics, const char* componentName, const char* metricName, uint32_t valueMs)
+{
+    PNP_METRIC_SERIES* series = GetSeries(metrics, componentName, metricName, PNP_METRIC_TYPE_HISTOGRAM);
+    if (series == NULL)
+    {
+        return false;
+    }
+
+    size_t bucket = 0;
+    while (bucket < PNP_METRICS_BUCKET_COUNT - 1 && valueMs > g_histogramBounds[bucket])
+    {
+        bucket++;
+    }
+
+    series->bucketCounts[bucket]++;
+    series->count++;
+    series->sum += valueMs;
+    if (valueMs > series->max)
+    {
+        series->max = valueMs;
+    }
+    return true;
+}
+
+static void AppendLabels(PNP_METRICS_BUFFER* buffer, const PNP_METRICS_COMPONENT* component, const char* bound)
+{
+    bool hasComponent = (component->name[0] != '\0');
+    if (!hasComponent && bound == NULL)
+    {
+        return;
+    }
+
+    AppendString(buffer, "{");
+    if (hasComponent)
+    {
+        AppendString(buffer, "component=\"");
+        AppendEscaped(buffer, component->name);
+        AppendString(buffer, "\"");
+    }
+    if (bound != NULL)
+    {
+        AppendString(buffer, hasComponent ? ",le=\"" : "le=\"");
+        AppendString(buffer, bound);
+        AppendString(buffer, "\"");
+    }
+    AppendString(buffer, "}");
+}
+
+static void AppendTextSeries(PNP_METRICS_BUFFER* buffer, const PNP_METRICS_COMPONENT* component, const PNP_METRIC_SERIES* series)
+{
+    const char* name = series->family->name;
+
+    if (series->family->type != PNP_METRIC_TYPE_HISTOGRAM)
+    {
+        AppendString(buffer, name);
+        AppendLabels(buffer, component, NULL);
+        AppendFormat(buffer, " %" PRId64 "\n", series->value);
+        return;
+    }
+
+    // Prometheus buckets are cumulative
+    uint64_t cumulativeCount = 0;
+    char bound[16];
+    for (size_t i = 0; i < PNP_METRICS_BUCKET_COUNT; i++)
+    {
+        cumulativeCount += series->bucketCounts[i];
+        if (i < PNP_METRICS_BUCKET_COUNT - 1)
+        {
+            (void)snprintf(bound, sizeof(bound), "%" PRIu32, g_histogramBounds[i]);
+        }
+        else
+        {
+            (void)snprintf(bound, sizeof(bound), "+Inf");
+        }
+
+        AppendString(buffer, name);
+        AppendString(buffer, "_bucket");
+        AppendLabels(buffer, component, bound);
+        AppendFormat(buffer, " %" PRIu64 "\n", cumulativeCount);
+    }
+
+    AppendString(buffer, name);
+    AppendString(buffer, "_sum");
+    AppendLabels(buffer, component, NULL);
+    AppendFormat(buffer, " %" PRIu64 "\n", series->sum);
+
+    AppendString(buffer, name);
+    AppendString(buffer, "_count");
+    AppendLabels(buffer, component, NULL);
+    AppendFormat(buffer, " %" PRIu64 "\n", series->count);
+}
+
+char* PnP_Metrics_FormatText(PNP_METRICS_HANDLE metrics)
+{
+    static const char* typeNames[] = { "counter", "gauge", "histogram" };
+    PNP_METRICS_BUFFER buffer = { NULL, 0, 0, false };
+
+    AppendString(&buffer, "");
+
+    // Series of one metric have to be listed together, under a single TYPE line
+    for (size_t i = 0; i < metrics->familyCount; i++)
+    {
+        const PNP_METRIC_FAMILY* family = metrics->families[i];
+        AppendString(&buffer, "# TYPE ");
+        AppendString(&buffer, family->name);
+        AppendString(&buffer, " ");
+        AppendString(&buffer, typeNames[family->type]);
+        AppendString(&buffer, "\n");
+
+        for (size_t j = 0; j < metrics->componentCount; j++)
+        {
+            const PNP_METRICS_COMPONENT* component = metrics->components[j];
+            const PNP_METRIC_SERIES* series = PnP_ComponentIndex_Find(component->seriesIndex, family->name, strlen(family->name));
+            if (series != NULL)
+            {
+                AppendTextSeries(&buffer, component, series);
+            }
+        }
+    }
+
+    return FinishBuffer(&buffer);
+}
+
+static void AppendJsonComponent(PNP_METRICS_BUFFER* buffer, const PNP_METRICS_COMPONENT* component)
+{
+    AppendString(buffer, "{");
+    for (size_t i = 0; i < component->seriesCount; i++)
+    {
+        const PNP_METRIC_SERIES* series = component->series[i];
+
+        AppendString(buffer, (i > 0) ? ",\"" : "\"");
+        AppendEscaped(buffer, series->family->name);
+        AppendString(buffer, "\":");
+
+        if (series->family->type != PNP_METRIC_TYPE_HISTOGRAM)
+        {
+            AppendFormat(buffer, "%" PRId64, series->value);
+        }
+        else
+        {
+            AppendFormat(buffer, "{\"count\":%" PRIu64, series->count);
+            AppendFormat(buffer, ",\"avg\":%" PRIu64, (series->count > 0) ? series->sum / series->count : 0);
+            AppendFormat(buffer, ",\"max\":%" PRIu32 "}", series->max);
+        }
+    }
+    AppendString(buffer, "}");
+}
+
+char* PnP_Metrics_FormatJson(PNP_METRICS_HANDLE metrics)
+{
+    PNP_METRICS_BUFFER buffer = { NULL, 0, 0, false };
+    const PNP_METRICS_COMPONENT* bridge = PnP_ComponentIndex_Find(metrics->componentIndex, g_bridgeComponentName, 0);
+    bool first = true;
+
+    AppendString(&buffer, "{\"bridge\":");
+    if (bridge != NULL)
+    {
+        AppendJsonComponent(&buffer, bridge);
+    }
+    else
+    {
+        AppendString(&buffer, "{}");
+    }
+
+    AppendString(&buffer, ",\"components\":{");
+    for (size_t i = 0; i < metrics->componentCount; i++)
+    {
+        const PNP_METRICS_COMPONENT* component = metrics->components[i];
+        if (component != bridge)
+        {
+            AppendString(&buffer, first ? "\"" : ",\"");
+            AppendEscaped(&buffer, component->name);
+            AppendString(&buffer, "\":");
+            AppendJsonComponent(&buffer, component);
+            first = false;
+        }
+    }
+    AppendString(&buffer, "}}");
+
+    return FinishBuffer(&buffer);
+}
@@ -0,0 +1,78 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+//
+// PnP metrics is a registry of counters, gauges and latency histograms kept per component. A metric is
+// created the first time it is updated, and its type is fixed by that first update. Metrics updated with a
+// NULL component name belong to the bridge itself.
+//
+// The registry can be formatted in the Prometheus text exposition format, with the component as a label,
+// or as a JSON object suitable for telemetry.
+//
+// The registry is not thread safe, callers serialize access to it.
+//
+
+#ifndef PNP_METRICS_H
+#define PNP_METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct PNP_METRICS_TAG* PNP_METRICS_HANDLE;
+
+typedef enum PNP_METRIC_TYPE_TAG
+{
+    PNP_METRIC_TYPE_COUNTER,
+    PNP_METRIC_TYPE_GAUGE,
+    PNP_METRIC_TYPE_HISTOGRAM
+} PNP_METRIC_TYPE;
+
+PNP_METRICS_HANDLE PnP_Metrics_Create(void);
+
+void PnP_Metrics_Destroy(PNP_METRICS_HANDLE metrics);
+
+//
+// PnP_Metrics_AddCounter adds delta to counter metricName of componentName. Returns false if metricName is
+// not a counter or could not be allocated.
+//
+bool PnP_Metrics_AddCounter(PNP_METRICS_HANDLE metrics, const char* componentName, const char* metricName, uint64_t delta);
+
+//
+// PnP_Metrics_AddGauge adds delta, which can be negative, to gauge metricName of componentName.
+//
+bool PnP_Metrics_AddGauge(PNP_METRICS_HANDLE metrics, const char* componentName, const char* metricName, int64_t delta);
+
+//
+// PnP_Metrics_SetGauge sets gauge metricName of componentName to value.
+//
+bool PnP_Metrics_SetGauge(PNP_METRICS_HANDLE metrics, const char* componentName, const char* metricName, int64_t value);
+
+//
+// PnP_Metrics_Observe records a duration in milliseconds in histogram metricName of componentName.
+//
+bool PnP_Metrics_Observe(PNP_METRICS_HANDLE metrics, const char* componentName, const char* metricName, uint32_t valueMs);
+
+//
+// PnP_Metrics_FormatText returns every metric in the Prometheus text exposition format, or NULL if it could
+// not be allocated. The caller frees the returned string.
+//
+char* PnP_Metrics_FormatText(PNP_METRICS_HANDLE metrics);
+
+//
+// PnP_Metrics_FormatJson returns every metric as {"bridge":{...},"components":{"name":{...}}}, where a
+// histogram is an object with its count, average and maximum, or NULL if it could not be allocated. The caller
+// frees the returned string.
+//
+char* PnP_Metrics_FormatJson(PNP_METRICS_HANDLE metrics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PNP_METRICS_H */
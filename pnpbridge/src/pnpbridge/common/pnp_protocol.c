@@ -169,26 +169,15 @@ static void VisitComponentProperties(const char* objectName, JSON_Value* value,
 // IsJsonObjectAComponentInModel checks whether the objectName, read from the top-level child of the desired device twin JSON, 
 // is in componentsInModel that the application passed into us.
 //
-static bool IsJsonObjectAComponentInModel(const char* objectName, const char** componentsInModel, size_t numComponentsInModel)
+static bool IsJsonObjectAComponentInModel(const char* objectName, PNP_COMPONENT_INDEX_HANDLE componentsInModel)
 {
-    bool result = false;
-
-    for (size_t i = 0; i < numComponentsInModel; i++)
-    {
-        if (strcmp(objectName, componentsInModel[i]) == 0)
-        {
-            result = true;
-            break;
-        }
-    }
-
-    return result;
+    return PnP_ComponentIndex_Contains(componentsInModel, objectName);
 }
 
 //
 // VisitDesiredObject visits each child JSON element of the desired device twin.  As we parse each property out, we invoke the application's passed in pnpPropertyCallback.
 //
-static bool VisitDesiredObject(JSON_Object* desiredObject, const char** componentsInModel, size_t numComponentsInModel, PnP_PropertyCallbackFunction pnpPropertyCallback, void* userContextCallback)
+static bool VisitDesiredObject(JSON_Object* desiredObject, PNP_COMPONENT_INDEX_HANDLE componentsInModel, PnP_PropertyCallbackFunction pnpPropertyCallback, void* userContextCallback)
 {
     JSON_Value* versionValue = NULL;
     size_t numChildren;
@@ -223,7 +212,7 @@ static bool VisitDesiredObject(JSON_Object* desiredObject, const char** componen
                 continue;
             }
 
-            if ((json_type(value) == JSONObject) && IsJsonObjectAComponentInModel(name, componentsInModel, numComponentsInModel))
+            if ((json_type(value) == JSONObject) && IsJsonObjectAComponentInModel(name, componentsInModel))
             {
                 // If this current JSON is an element AND the name is one of the componentsInModel that the application knows about,
                 // then this json element represents a component.
@@ -275,7 +264,7 @@ static JSON_Object* GetDesiredJson(DEVICE_TWIN_UPDATE_STATE updateState, JSON_Va
     return desiredObject;
 }
 
-bool PnP_ProcessTwinData(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char* payload, size_t size, const char** componentsInModel, size_t numComponentsInModel, PnP_PropertyCallbackFunction pnpPropertyCallback, void* userContextCallback)
+bool PnP_ProcessTwinData(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char* payload, size_t size, PNP_COMPONENT_INDEX_HANDLE componentsInModel, PnP_PropertyCallbackFunction pnpPropertyCallback, void* userContextCallback)
 {
     char* jsonStr = NULL;
     JSON_Value* rootValue = NULL;
@@ -300,7 +289,7 @@ bool PnP_ProcessTwinData(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned ch
     else
     {
         // Visit each sub-element in the desired portion of the twin JSON and invoke pnpPropertyCallback as appropriate.
-        result = VisitDesiredObject(desiredObject, componentsInModel, numComponentsInModel, pnpPropertyCallback, userContextCallback);
+        result = VisitDesiredObject(desiredObject, componentsInModel, pnpPropertyCallback, userContextCallback);
     }
 
     json_value_free(rootValue);
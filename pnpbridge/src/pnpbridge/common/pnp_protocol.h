@@ -14,6 +14,7 @@
 #include "iothub_client_core_common.h"
 #include "iothub_message.h"
 #include "parson.h"
+#include "pnp_component_index.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -26,6 +27,7 @@ extern "C"
 #define PNP_STATUS_BAD_FORMAT 400
 #define PNP_STATUS_NOT_FOUND  404
 #define PNP_STATUS_INTERNAL_ERROR 500
+#define PNP_STATUS_TIMEOUT 504
 
 //
 // The PnP convention defines the maximum length of a component 
@@ -82,9 +84,9 @@ IOTHUB_MESSAGE_HANDLE PnP_CreateTelemetryMessageHandle(const char* componentName
 //
 // PnP_ProcessTwinData is invoked by the application when a device twin arrives to its device twin processing callback.
 // PnP_ProcessTwinData will visit the children of the desired portion of the twin and invoke the device's pnpPropertyCallback
-// function for each property that it visits.
+// function for each property that it visits. Top-level objects whose name is in componentsInModel are treated as components.
 // 
-bool PnP_ProcessTwinData(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char* payload, size_t size, const char** componentsInModel, size_t numComponentsInModel, PnP_PropertyCallbackFunction pnpPropertyCallback, void* userContextCallback);
+bool PnP_ProcessTwinData(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char* payload, size_t size, PNP_COMPONENT_INDEX_HANDLE componentsInModel, PnP_PropertyCallbackFunction pnpPropertyCallback, void* userContextCallback);
 
 
 
@@ -0,0 +1,394 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Header associated with this .c file
+#include "pnp_reported_property_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pnp_component_index.h"
+
+// IoT core utility related header files
+#include "azure_c_shared_utility/xlogging.h"
+
+// Name the root component is stored under. PnP component names cannot be empty, so this never collides.
+static const char g_rootComponentName[] = "";
+
+// IoTHub needs the "__t":"c" marker on top-level reported objects that represent components
+static const char g_componentMarker[] = "\"__t\":\"c\"";
+
+typedef struct PNP_REPORTED_PROPERTY_TAG
+{
+    char* name;
+    // Value the twin holds as far as the cache knows, NULL if it was never reported
+    char* reportedValue;
+    // Value that goes out with the next patch, NULL if the property is not pending
+    char* pendingValue;
+} PNP_REPORTED_PROPERTY;
+
+typedef struct PNP_REPORTED_PROPERTY_COMPONENT_TAG
+{
+    char* name;
+    PNP_COMPONENT_INDEX_HANDLE propertyIndex;
+    PNP_REPORTED_PROPERTY** properties;
+    size_t propertyCount;
+    size_t propertyCapacity;
+    size_t pendingCount;
+} PNP_REPORTED_PROPERTY_COMPONENT;
+
+typedef struct PNP_REPORTED_PROPERTY_CACHE_TAG
+{
+    PNP_COMPONENT_INDEX_HANDLE componentIndex;
+    PNP_REPORTED_PROPERTY_COMPONENT** components;
+    size_t componentCount;
+    size_t componentCapacity;
+    size_t pendingCount;
+} PNP_REPORTED_PROPERTY_CACHE;
+
+typedef struct PNP_PATCH_BUFFER_TAG
+{
+    char* data;
+    size_t length;
+    size_t capacity;
+} PNP_PATCH_BUFFER;
+
+static char* CopyString(const char* value)
+{
+    size_t length = strlen(value) + 1;
+    char* copy = malloc(length);
+    if (copy != NULL)
+    {
+        memcpy(copy, value, length);
+    }
+    return copy;
+}
+
+//
+// AppendPointer adds value to a growable array of pointers.
+//
+static bool AppendPointer(void*** items, size_t* count, size_t* capacity, void* value)
+{
+    if (*count == *capacity)
+    {
+        size_t newCapacity = (*capacity == 0) ? 8 : (*capacity * 2);
+        void** newItems = realloc(*items, newCapacity * sizeof(void*));
+        if (newItems == NULL)
+        {
+            return false;
+        }
+        *items = newItems;
+        *capacity = newCapacity;
+    }
+
+    (*items)[*count] = value;
+    (*count)++;
+    return true;
+}
+
+static bool AppendToPatch(PNP_PATCH_BUFFER* patch, const char* text)
+{
+    size_t length = strlen(text);
+    if (patch->length + length + 1 > patch->capacity)
+    {
+        size_t newCapacity = (patch->capacity == 0) ? 256 : patch->capacity;
+        while (patch->length + length + 1 > newCapacity)
+        {
+            newCapacity *= 2;
+        }
+
+        char* newData = realloc(patch->data, newCapacity);
+        if (newData == NULL)
+        {
+            return false;
+        }
+        patch->data = newData;
+        patch->capacity = newCapacity;
+    }
+
+    memcpy(patch->data + patch->length, text, length + 1);
+    patch->length += length;
+    return true;
+}
+
+static void DestroyComponent(PNP_REPORTED_PROPERTY_COMPONENT* component)
+{
+    for (size_t i = 0; i < component->propertyCount; i++)
+    {
+        free(component->properties[i]->name);
+        free(component->properties[i]->reportedValue);
+        free(component->properties[i]->pendingValue);
+        free(component->properties[i]);
+    }
+    free(component->properties);
+    PnP_ComponentIndex_Destroy(component->propertyIndex);
+    free(component->name);
+    free(component);
+}
+
+static PNP_REPORTED_PROPERTY_COMPONENT* GetComponent(PNP_REPORTED_PROPERTY_CACHE* propertyCache, const char* componentName)
+{
+    PNP_REPORTED_PROPERTY_COMPONENT* component = PnP_ComponentIndex_Find(propertyCache->componentIndex, componentName, strlen(componentName));
+    if (component != NULL)
+    {
+        return component;
+    }
+
+    if ((component = calloc(1, sizeof(PNP_REPORTED_PROPERTY_COMPONENT))) == NULL)
+    {
+        LogError("Unable to allocate reported property cache component");
+        return NULL;
+    }
+
+    if (((component->name = CopyString(componentName)) == NULL) ||
+        ((component->propertyIndex = PnP_ComponentIndex_Create(0)) == NULL) ||
+        !AppendPointer((void***)&propertyCache->components, &propertyCache->componentCount, &propertyCache->componentCapacity, component))
+    {
+        LogError("Unable to add component %s to reported property cache", componentName);
+        DestroyComponent(component);
+        return NULL;
+    }
+
+    if (!PnP_ComponentIndex_Add(propertyCache->componentIndex, component->name, component))
+    {
+        LogError("Unable to index component %s in reported property cache", componentName);
+        propertyCache->componentCount--;
+        DestroyComponent(component);
+        return NULL;
+    }
+
+    return component;
+}
+
+static PNP_REPORTED_PROPERTY* GetProperty(PNP_REPORTED_PROPERTY_COMPONENT* component, const char* propertyName)
+{
+    PNP_REPORTED_PROPERTY* property = PnP_ComponentIndex_Find(component->propertyIndex, propertyName, strlen(propertyName));
+    if (property != NULL)
+    {
+        return property;
+    }
+
+    if ((property = calloc(1, sizeof(PNP_REPORTED_PROPERTY))) == NULL)
+    {
+        LogError("Unable to allocate reported property cache entry");
+        return NULL;
+    }
+
+    if (((property->name = CopyString(propertyName)) == NULL) ||
+        !AppendPointer((void***)&component->properties, &component->propertyCount, &component->propertyCapacity, property))
+    {
+        LogError("Unable to add property %s to reported property cache", propertyName);
+        free(property->name);
+        free(property);
+        return NULL;
+    }
+
+    if (!PnP_ComponentIndex_Add(component->propertyIndex, property->name, property))
+    {
+        LogError("Unable to index property %s in reported property cache", propertyName);
+        component->propertyCount--;
+        free(property->name);
+        free(property);
+        return NULL;
+    }
+
+    return property;
+}
+
+//
+// AppendComponentToPatch writes the pending properties of a component. Properties of the root component are written at
+// the top level of the patch, others are written into an object named after the component.
+//
+static bool AppendComponentToPatch(PNP_PATCH_BUFFER* patch, const PNP_REPORTED_PROPERTY_COMPONENT* component, bool* firstField)
+{
+    bool isRoot = (component->name[0] == '\0');
+    bool firstProperty = true;
+
+    if (!isRoot)
+    {
+        if ((!*firstField && !AppendToPatch(patch, ",")) ||
+            !AppendToPatch(patch, "\"") || !AppendToPatch(patch, component->name) || !AppendToPatch(patch, "\":{") ||
+            !AppendToPatch(patch, g_componentMarker))
+        {
+            return false;
+        }
+        *firstField = false;
+        firstProperty = false;
+    }
+
+    for (size_t i = 0; i < component->propertyCount; i++)
+    {
+        const PNP_REPORTED_PROPERTY* property = component->properties[i];
+        if (property->pendingValue == NULL)
+        {
+            continue;
+        }
+
+        bool first = isRoot ? *firstField : firstProperty;
+        if ((!first && !AppendToPatch(patch, ",")) ||
+            !AppendToPatch(patch, "\"") || !AppendToPatch(patch, property->name) || !AppendToPatch(patch, "\":") ||
+            !AppendToPatch(patch, property->pendingValue))
+        {
+            return false;
+        }
+        *firstField = false;
+        firstProperty = false;
+    }
+
+    return isRoot || AppendToPatch(patch, "}");
+}
+
+PNP_REPORTED_PROPERTY_CACHE_HANDLE PnP_ReportedPropertyCache_Create(void)
+{
+    PNP_REPORTED_PROPERTY_CACHE* propertyCache = calloc(1, sizeof(PNP_REPORTED_PROPERTY_CACHE));
+    if (propertyCache == NULL)
+    {
+        LogError("Unable to allocate reported property cache");
+    }
+    else if ((propertyCache->componentIndex = PnP_ComponentIndex_Create(0)) == NULL)
+    {
+        free(propertyCache);
+        propertyCache = NULL;
+    }
+
+    return propertyCache;
+}
+
+void PnP_ReportedPropertyCache_Destroy(PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache)
+{
+    if (propertyCache != NULL)
+    {
+        for (size_t i = 0; i < propertyCache->componentCount; i++)
+        {
+            DestroyComponent(propertyCache->components[i]);
+        }
+        free(propertyCache->components);
+        PnP_ComponentIndex_Destroy(propertyCache->componentIndex);
+        free(propertyCache);
+    }
+}
+
+PNP_REPORTED_PROPERTY_CACHE_RESULT PnP_ReportedPropertyCache_Update(PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache,
+    const char* componentName, const char* propertyName, const char* propertyValue)
+{
+    PNP_REPORTED_PROPERTY_COMPONENT* component;
+    PNP_REPORTED_PROPERTY* property;
+
+    if (((component = GetComponent(propertyCache, (componentName != NULL) ? componentName : g_rootComponentName)) == NULL) ||
+        ((property = GetProperty(component, propertyName)) == NULL))
+    {
+        return PNP_REPORTED_PROPERTY_CACHE_ERROR;
+    }
+
+    const char* currentValue = (property->pendingValue != NULL) ? property->pendingValue : property->reportedValue;
+    if ((currentValue != NULL) && (strcmp(currentValue, propertyValue) == 0))
+    {
+        return PNP_REPORTED_PROPERTY_CACHE_UNCHANGED;
+    }
+
+    // The value went back to what the twin holds before the pending change was sent
+    if ((property->pendingValue != NULL) && (property->reportedValue != NULL) && (strcmp(property->reportedValue, propertyValue) == 0))
+    {
+        free(property->pendingValue);
+        property->pendingValue = NULL;
+        component->pendingCount--;
+        propertyCache->pendingCount--;
+        return PNP_REPORTED_PROPERTY_CACHE_UNCHANGED;
+    }
+
+    char* pendingValue = CopyString(propertyValue);
+    if (pendingValue == NULL)
+    {
+        LogError("Unable to store value of property %s", propertyName);
+        return PNP_REPORTED_PROPERTY_CACHE_ERROR;
+    }
+
+    if (property->pendingValue == NULL)
+    {
+        component->pendingCount++;
+        propertyCache->pendingCount++;
+    }
+    free(property->pendingValue);
+    property->pendingValue = pendingValue;
+
+    return PNP_REPORTED_PROPERTY_CACHE_PENDING;
+}
+
+size_t PnP_ReportedPropertyCache_GetPendingCount(PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache)
+{
+    return propertyCache->pendingCount;
+}
+
+char* PnP_ReportedPropertyCache_TakePatch(PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache)
+{
+    PNP_PATCH_BUFFER patch = { NULL, 0, 0 };
+    bool firstField = true;
+
+    if (propertyCache->pendingCount == 0)
+    {
+        return NULL;
+    }
+
+    if (!AppendToPatch(&patch, "{"))
+    {
+        goto error;
+    }
+
+    for (size_t i = 0; i < propertyCache->componentCount; i++)
+    {
+        if ((propertyCache->components[i]->pendingCount > 0) &&
+            !AppendComponentToPatch(&patch, propertyCache->components[i], &firstField))
+        {
+            goto error;
+        }
+    }
+
+    if (!AppendToPatch(&patch, "}"))
+    {
+        goto error;
+    }
+
+    // The patch is built, what it holds is now the reported state
+    for (size_t i = 0; i < propertyCache->componentCount; i++)
+    {
+        PNP_REPORTED_PROPERTY_COMPONENT* component = propertyCache->components[i];
+        for (size_t j = 0; (component->pendingCount > 0) && (j < component->propertyCount); j++)
+        {
+            PNP_REPORTED_PROPERTY* property = component->properties[j];
+            if (property->pendingValue != NULL)
+            {
+                free(property->reportedValue);
+                property->reportedValue = property->pendingValue;
+                property->pendingValue = NULL;
+                component->pendingCount--;
+            }
+        }
+    }
+    propertyCache->pendingCount = 0;
+
+    return patch.data;
+
+error:
+    LogError("Unable to build reported property patch");
+    free(patch.data);
+    return NULL;
+}
+
+void PnP_ReportedPropertyCache_Resync(PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache)
+{
+    for (size_t i = 0; i < propertyCache->componentCount; i++)
+    {
+        PNP_REPORTED_PROPERTY_COMPONENT* component = propertyCache->components[i];
+        for (size_t j = 0; j < component->propertyCount; j++)
+        {
+            PNP_REPORTED_PROPERTY* property = component->properties[j];
+            if ((property->pendingValue == NULL) && (property->reportedValue != NULL))
+            {
+                property->pendingValue = property->reportedValue;
+                property->reportedValue = NULL;
+                component->pendingCount++;
+                propertyCache->pendingCount++;
+            }
+        }
+    }
+}
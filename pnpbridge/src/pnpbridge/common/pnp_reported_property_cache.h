@@ -0,0 +1,68 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+//
+// PnP reported property cache remembers the last value reported for each (component, property) pair so that
+// reports of an unchanged value can be dropped. Changed values are held as pending until they are taken out as
+// a single twin PATCH that covers every component with pending changes.
+//
+// Property values are JSON text, e.g. "\"1.0.2\"" or "42", and are compared verbatim.
+//
+
+#ifndef PNP_REPORTED_PROPERTY_CACHE_H
+#define PNP_REPORTED_PROPERTY_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct PNP_REPORTED_PROPERTY_CACHE_TAG* PNP_REPORTED_PROPERTY_CACHE_HANDLE;
+
+typedef enum PNP_REPORTED_PROPERTY_CACHE_RESULT
+{
+    // The value differs from what was last reported and will be part of the next patch
+    PNP_REPORTED_PROPERTY_CACHE_PENDING,
+    // The value is what the twin already holds, there is nothing to report
+    PNP_REPORTED_PROPERTY_CACHE_UNCHANGED,
+    // The value could not be stored, report it directly
+    PNP_REPORTED_PROPERTY_CACHE_ERROR
+} PNP_REPORTED_PROPERTY_CACHE_RESULT;
+
+PNP_REPORTED_PROPERTY_CACHE_HANDLE PnP_ReportedPropertyCache_Create(void);
+
+void PnP_ReportedPropertyCache_Destroy(PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache);
+
+//
+// PnP_ReportedPropertyCache_Update records propertyValue for propertyName on componentName. componentName is NULL
+// for a property of the root component.
+//
+PNP_REPORTED_PROPERTY_CACHE_RESULT PnP_ReportedPropertyCache_Update(PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache,
+    const char* componentName, const char* propertyName, const char* propertyValue);
+
+//
+// PnP_ReportedPropertyCache_GetPendingCount returns the number of properties waiting to be reported.
+//
+size_t PnP_ReportedPropertyCache_GetPendingCount(PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache);
+
+//
+// PnP_ReportedPropertyCache_TakePatch returns a twin PATCH with every pending property, grouped by component, and
+// marks them as reported. The caller frees the returned string. Returns NULL if nothing is pending or on failure,
+// in which case the properties stay pending.
+//
+char* PnP_ReportedPropertyCache_TakePatch(PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache);
+
+//
+// PnP_ReportedPropertyCache_Resync marks every known property as pending again, so that the next patch restores
+// the whole reported state after the twin may have missed updates (e.g. after a reconnect or a failed send).
+//
+void PnP_ReportedPropertyCache_Resync(PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PNP_REPORTED_PROPERTY_CACHE_H */
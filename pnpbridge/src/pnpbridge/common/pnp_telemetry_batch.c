@@ -0,0 +1,325 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Header associated with this .c file
+#include "pnp_telemetry_batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// IoT core utility related header files
+#include "azure_c_shared_utility/xlogging.h"
+
+// Number of field names a batch has room for before it grows
+#define PNP_TELEMETRY_BATCH_INITIAL_FIELD_CAPACITY 16
+
+typedef struct PNP_TELEMETRY_BATCH_FIELD_TAG
+{
+    // Position of the quoted field name in the batch buffer
+    size_t offset;
+    size_t length;
+} PNP_TELEMETRY_BATCH_FIELD;
+
+typedef struct PNP_TELEMETRY_BATCH_TAG
+{
+    // "{" followed by the comma separated fields of every reading. The closing brace is added by
+    // PnP_TelemetryBatch_GetMessage; the buffer has room for it and the terminating NULL.
+    char* buffer;
+    size_t length;
+    size_t maxMessageSize;
+
+    PNP_TELEMETRY_BATCH_FIELD* fields;
+    size_t fieldCount;
+    size_t fieldCapacity;
+
+    size_t readingCount;
+    uint64_t firstReadingTime;
+} PNP_TELEMETRY_BATCH;
+
+static const char* SkipWhitespace(const char* position, const char* end)
+{
+    while (position < end && (*position == ' ' || *position == '\t' || *position == '\r' || *position == '\n'))
+    {
+        position++;
+    }
+    return position;
+}
+
+//
+// SkipString returns the position after the JSON string starting at position, or NULL if the string is not terminated.
+//
+static const char* SkipString(const char* position, const char* end)
+{
+    for (position++; position < end; position++)
+    {
+        if (*position == '\\')
+        {
+            position++;
+        }
+        else if (*position == '"')
+        {
+            return position + 1;
+        }
+    }
+    return NULL;
+}
+
+//
+// SkipValue returns the position of the ',' or '}' that ends the JSON value starting at position, or NULL if there is none.
+//
+static const char* SkipValue(const char* position, const char* end)
+{
+    int depth = 0;
+    while (position < end)
+    {
+        switch (*position)
+        {
+            case '"':
+                position = SkipString(position, end);
+                if (position == NULL)
+                {
+                    return NULL;
+                }
+                continue;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case ']':
+                depth--;
+                break;
+            case '}':
+                if (depth == 0)
+                {
+                    return position;
+                }
+                depth--;
+                break;
+            case ',':
+                if (depth == 0)
+                {
+                    return position;
+                }
+                break;
+            default:
+                break;
+        }
+        position++;
+    }
+    return NULL;
+}
+
+static bool ReserveFields(PNP_TELEMETRY_BATCH* batch, size_t count)
+{
+    if (count <= batch->fieldCapacity)
+    {
+        return true;
+    }
+
+    size_t capacity = batch->fieldCapacity * 2;
+    while (capacity < count)
+    {
+        capacity *= 2;
+    }
+
+    PNP_TELEMETRY_BATCH_FIELD* fields = realloc(batch->fields, capacity * sizeof(PNP_TELEMETRY_BATCH_FIELD));
+    if (fields == NULL)
+    {
+        LogError("Unable to grow telemetry batch to %lu fields", (unsigned long)capacity);
+        return false;
+    }
+
+    batch->fields = fields;
+    batch->fieldCapacity = capacity;
+    return true;
+}
+
+static bool ContainsField(const PNP_TELEMETRY_BATCH* batch, const char* name, size_t nameLength)
+{
+    for (size_t i = 0; i < batch->fieldCount; i++)
+    {
+        if (batch->fields[i].length == nameLength && memcmp(batch->buffer + batch->fields[i].offset, name, nameLength) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+PNP_TELEMETRY_BATCH_HANDLE PnP_TelemetryBatch_Create(size_t maxMessageSize)
+{
+    PNP_TELEMETRY_BATCH* batch;
+
+    // The smallest useful message is {"a":0}
+    if (maxMessageSize < 7)
+    {
+        LogError("Telemetry batch size %lu is too small", (unsigned long)maxMessageSize);
+        return NULL;
+    }
+
+    if ((batch = calloc(1, sizeof(PNP_TELEMETRY_BATCH))) == NULL)
+    {
+        LogError("Unable to allocate telemetry batch");
+    }
+    else if (((batch->buffer = malloc(maxMessageSize + 1)) == NULL) ||
+             ((batch->fields = malloc(PNP_TELEMETRY_BATCH_INITIAL_FIELD_CAPACITY * sizeof(PNP_TELEMETRY_BATCH_FIELD))) == NULL))
+    {
+        LogError("Unable to allocate telemetry batch buffers");
+        PnP_TelemetryBatch_Destroy(batch);
+        batch = NULL;
+    }
+    else
+    {
+        batch->maxMessageSize = maxMessageSize;
+        batch->fieldCapacity = PNP_TELEMETRY_BATCH_INITIAL_FIELD_CAPACITY;
+        PnP_TelemetryBatch_Clear(batch);
+    }
+
+    return batch;
+}
+
+void PnP_TelemetryBatch_Destroy(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch)
+{
+    if (telemetryBatch != NULL)
+    {
+        free(telemetryBatch->buffer);
+        free(telemetryBatch->fields);
+        free(telemetryBatch);
+    }
+}
+
+PNP_TELEMETRY_BATCH_RESULT PnP_TelemetryBatch_Add(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch, const char* telemetryData, uint64_t now)
+{
+    const char* end = telemetryData + strlen(telemetryData);
+    const char* position = SkipWhitespace(telemetryData, end);
+    size_t firstNewField = telemetryBatch->fieldCount;
+    bool duplicate = false;
+
+    if (position == end || *position != '{')
+    {
+        return PNP_TELEMETRY_BATCH_NOT_BATCHABLE;
+    }
+
+    const char* fieldsStart = SkipWhitespace(position + 1, end);
+    const char* fieldsEnd = fieldsStart;
+    position = fieldsStart;
+
+    // Walk the top level fields of the reading and record where their names are relative to fieldsStart
+    while (position < end && *position != '}')
+    {
+        if (*position != '"')
+        {
+            goto not_batchable;
+        }
+
+        const char* name = position;
+        if ((position = SkipString(position, end)) == NULL)
+        {
+            goto not_batchable;
+        }
+        size_t nameLength = (size_t)(position - name);
+
+        position = SkipWhitespace(position, end);
+        if (position == end || *position != ':')
+        {
+            goto not_batchable;
+        }
+        if ((position = SkipValue(position + 1, end)) == NULL)
+        {
+            goto not_batchable;
+        }
+
+        // The value ends at the ',' or '}', trailing whitespace is left out of the batch
+        fieldsEnd = position;
+        while (fieldsEnd > name && (fieldsEnd[-1] == ' ' || fieldsEnd[-1] == '\t' || fieldsEnd[-1] == '\r' || fieldsEnd[-1] == '\n'))
+        {
+            fieldsEnd--;
+        }
+
+        duplicate = duplicate || ContainsField(telemetryBatch, name, nameLength);
+
+        if (!ReserveFields(telemetryBatch, telemetryBatch->fieldCount + 1))
+        {
+            goto not_batchable;
+        }
+        telemetryBatch->fields[telemetryBatch->fieldCount].offset = (size_t)(name - fieldsStart);
+        telemetryBatch->fields[telemetryBatch->fieldCount].length = nameLength;
+        telemetryBatch->fieldCount++;
+
+        if (*position == ',')
+        {
+            position = SkipWhitespace(position + 1, end);
+        }
+    }
+
+    // An empty object, or anything after the closing brace, is sent as it is
+    if (position == end || telemetryBatch->fieldCount == firstNewField || SkipWhitespace(position + 1, end) != end)
+    {
+        goto not_batchable;
+    }
+
+    size_t fieldsLength = (size_t)(fieldsEnd - fieldsStart);
+    size_t separatorLength = (telemetryBatch->readingCount > 0) ? 1 : 0;
+
+    // Room is needed for the opening and closing braces
+    if (fieldsLength + 2 > telemetryBatch->maxMessageSize)
+    {
+        goto not_batchable;
+    }
+    if (duplicate || (telemetryBatch->length + separatorLength + fieldsLength + 1 > telemetryBatch->maxMessageSize))
+    {
+        telemetryBatch->fieldCount = firstNewField;
+        return PNP_TELEMETRY_BATCH_FULL;
+    }
+
+    if (separatorLength > 0)
+    {
+        telemetryBatch->buffer[telemetryBatch->length++] = ',';
+    }
+    memcpy(telemetryBatch->buffer + telemetryBatch->length, fieldsStart, fieldsLength);
+
+    // Field names were recorded relative to the reading, move them to where the reading now is in the buffer
+    for (size_t i = firstNewField; i < telemetryBatch->fieldCount; i++)
+    {
+        telemetryBatch->fields[i].offset += telemetryBatch->length;
+    }
+    telemetryBatch->length += fieldsLength;
+
+    if (telemetryBatch->readingCount == 0)
+    {
+        telemetryBatch->firstReadingTime = now;
+    }
+    telemetryBatch->readingCount++;
+
+    return PNP_TELEMETRY_BATCH_ADDED;
+
+not_batchable:
+    telemetryBatch->fieldCount = firstNewField;
+    return PNP_TELEMETRY_BATCH_NOT_BATCHABLE;
+}
+
+size_t PnP_TelemetryBatch_GetReadingCount(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch)
+{
+    return telemetryBatch->readingCount;
+}
+
+uint64_t PnP_TelemetryBatch_GetFirstReadingTime(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch)
+{
+    return telemetryBatch->firstReadingTime;
+}
+
+const char* PnP_TelemetryBatch_GetMessage(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch)
+{
+    telemetryBatch->buffer[telemetryBatch->length] = '}';
+    telemetryBatch->buffer[telemetryBatch->length + 1] = '\0';
+    return telemetryBatch->buffer;
+}
+
+void PnP_TelemetryBatch_Clear(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch)
+{
+    telemetryBatch->buffer[0] = '{';
+    telemetryBatch->length = 1;
+    telemetryBatch->fieldCount = 0;
+    telemetryBatch->readingCount = 0;
+    telemetryBatch->firstReadingTime = 0;
+}
@@ -0,0 +1,71 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+//
+// PnP telemetry batch coalesces the telemetry readings of one component into a single multi-field JSON message.
+// Each reading is a JSON object such as {"temperature":21.5}; its fields are appended to the batch as long as the
+// resulting message stays within the configured size and none of its field names is already in the batch.
+//
+// The batch only looks at the top level of each reading to find its field names, the values are copied verbatim.
+//
+
+#ifndef PNP_TELEMETRY_BATCH_H
+#define PNP_TELEMETRY_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct PNP_TELEMETRY_BATCH_TAG* PNP_TELEMETRY_BATCH_HANDLE;
+
+typedef enum PNP_TELEMETRY_BATCH_RESULT
+{
+    // The reading's fields were added to the batch
+    PNP_TELEMETRY_BATCH_ADDED,
+    // The reading does not fit in the batch with what is already in it, send the batch and add the reading again
+    PNP_TELEMETRY_BATCH_FULL,
+    // The reading is not a JSON object or is too large for a message on its own, send it as it is
+    PNP_TELEMETRY_BATCH_NOT_BATCHABLE
+} PNP_TELEMETRY_BATCH_RESULT;
+
+//
+// PnP_TelemetryBatch_Create allocates an empty batch whose messages are at most maxMessageSize characters long.
+//
+PNP_TELEMETRY_BATCH_HANDLE PnP_TelemetryBatch_Create(size_t maxMessageSize);
+
+void PnP_TelemetryBatch_Destroy(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch);
+
+//
+// PnP_TelemetryBatch_Add adds the fields of the JSON object in telemetryData to the batch. now is the current time in
+// milliseconds and is remembered when the batch was empty, so that the caller can bound how long readings wait.
+//
+PNP_TELEMETRY_BATCH_RESULT PnP_TelemetryBatch_Add(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch, const char* telemetryData, uint64_t now);
+
+//
+// PnP_TelemetryBatch_GetReadingCount returns the number of readings added since the batch was last cleared.
+//
+size_t PnP_TelemetryBatch_GetReadingCount(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch);
+
+//
+// PnP_TelemetryBatch_GetFirstReadingTime returns the time passed to PnP_TelemetryBatch_Add for the oldest reading in the batch.
+//
+uint64_t PnP_TelemetryBatch_GetFirstReadingTime(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch);
+
+//
+// PnP_TelemetryBatch_GetMessage returns the batch as a JSON object. The string is owned by the batch and stays valid
+// until the next call to PnP_TelemetryBatch_Add or PnP_TelemetryBatch_Clear.
+//
+const char* PnP_TelemetryBatch_GetMessage(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch);
+
+void PnP_TelemetryBatch_Clear(PNP_TELEMETRY_BATCH_HANDLE telemetryBatch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PNP_TELEMETRY_BATCH_H */
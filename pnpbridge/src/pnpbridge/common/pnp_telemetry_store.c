@@ -0,0 +1,506 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Header associated with this .c file
+#include "pnp_telemetry_store.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// IoT core utility related header files
+#include "azure_c_shared_utility/xlogging.h"
+
+// A record is the length of its payload and the CRC32 of the payload, both little endian, followed by the payload.
+// The payload is the NULL terminated component name followed by the message.
+#define PNP_TELEMETRY_STORE_RECORD_HEADER_SIZE 8
+
+// The cursor file holds the read sequence, the read offset and the CRC32 of both, little endian
+#define PNP_TELEMETRY_STORE_CURSOR_SIZE 12
+
+#define PNP_TELEMETRY_STORE_MAX_PATH 4096
+
+typedef struct PNP_TELEMETRY_STORE_TAG
+{
+    char* pathPrefix;
+    size_t segmentSize;
+    size_t maxSegments;
+
+    // Segment and offset of the oldest message that has not been replayed
+    uint32_t readSequence;
+    size_t readOffset;
+    FILE* readFile;
+
+    // Segment and offset new messages are appended at
+    uint32_t writeSequence;
+    size_t writeOffset;
+    FILE* writeFile;
+
+    FILE* cursorFile;
+
+    // Messages left in each segment, indexed by sequence modulo maxSegments
+    size_t* segmentMessageCounts;
+    size_t messageCount;
+    size_t droppedCount;
+
+    // Buffer records are read into during replay
+    unsigned char* recordBuffer;
+    size_t recordBufferSize;
+
+    uint32_t crcTable[256];
+} PNP_TELEMETRY_STORE;
+
+static void InitializeCrcTable(uint32_t* crcTable)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (0xEDB88320 ^ (crc >> 1)) : (crc >> 1);
+        }
+        crcTable[i] = crc;
+    }
+}
+
+// Continues a CRC32 (IEEE 802.3) over data. Start with crc 0.
+static uint32_t UpdateCrc(const uint32_t* crcTable, uint32_t crc, const unsigned char* data, size_t length)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void WriteUint32(unsigned char* buffer, uint32_t value)
+{
+    buffer[0] = (unsigned char)(value & 0xFF);
+    buffer[1] = (unsigned char)((value >> 8) & 0xFF);
+    buffer[2] = (unsigned char)((value >> 16) & 0xFF);
+    buffer[3] = (unsigned char)((value >> 24) & 0xFF);
+}
+
+static uint32_t ReadUint32(const unsigned char* buffer)
+{
+    return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+static FILE* OpenSegment(PNP_TELEMETRY_STORE* telemetryStore, uint32_t sequence, const char* mode)
+{
+    char segmentPath[PNP_TELEMETRY_STORE_MAX_PATH];
+    (void)snprintf(segmentPath, sizeof(segmentPath), "%s-%010lu.seg", telemetryStore->pathPrefix, (unsigned long)sequence);
+    return fopen(segmentPath, mode);
+}
+
+static void RemoveSegment(PNP_TELEMETRY_STORE* telemetryStore, uint32_t sequence)
+{
+    char segmentPath[PNP_TELEMETRY_STORE_MAX_PATH];
+    (void)snprintf(segmentPath, sizeof(segmentPath), "%s-%010lu.seg", telemetryStore->pathPrefix, (unsigned long)sequence);
+    if (remove(segmentPath) != 0)
+    {
+        LogError("Unable to remove telemetry store segment %s", segmentPath);
+    }
+}
+
+static size_t* GetSegmentMessageCount(PNP_TELEMETRY_STORE* telemetryStore, uint32_t sequence)
+{
+    return &telemetryStore->segmentMessageCounts[sequence % telemetryStore->maxSegments];
+}
+
+static bool SaveCursor(PNP_TELEMETRY_STORE* telemetryStore)
+{
+    unsigned char cursor[PNP_TELEMETRY_STORE_CURSOR_SIZE];
+    WriteUint32(cursor, telemetryStore->readSequence);
+    WriteUint32(cursor + 4, (uint32_t)telemetryStore->readOffset);
+    WriteUint32(cursor + 8, UpdateCrc(telemetryStore->crcTable, 0, cursor, 8));
+
+    if ((fseek(telemetryStore->cursorFile, 0, SEEK_SET) != 0) ||
+        (fwrite(cursor, 1, sizeof(cursor), telemetryStore->cursorFile) != sizeof(cursor)) ||
+        (fflush(telemetryStore->cursorFile) != 0))
+    {
+        LogError("Unable to save telemetry store cursor");
+        return false;
+    }
+    return true;
+}
+
+static void LoadCursor(PNP_TELEMETRY_STORE* telemetryStore)
+{
+    unsigned char cursor[PNP_TELEMETRY_STORE_CURSOR_SIZE];
+    if (fread(cursor, 1, sizeof(cursor), telemetryStore->cursorFile) != sizeof(cursor))
+    {
+        // New store
+        return;
+    }
+
+    if (ReadUint32(cursor + 8) != UpdateCrc(telemetryStore->crcTable, 0, cursor, 8))
+    {
+        LogError("Telemetry store cursor of %s is corrupted, starting from the first segment", telemetryStore->pathPrefix);
+        return;
+    }
+
+    telemetryStore->readSequence = ReadUint32(cursor);
+    telemetryStore->readOffset = ReadUint32(cursor + 4);
+}
+
+// Reads the record at the current position of file into the record buffer. Returns the size of the record, or 0
+// if there is no complete record with a valid CRC.
+static size_t ReadRecord(PNP_TELEMETRY_STORE* telemetryStore, FILE* file)
+{
+    unsigned char header[PNP_TELEMETRY_STORE_RECORD_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header))
+    {
+        return 0;
+    }
+
+    size_t payloadLength = ReadUint32(header);
+    if ((payloadLength == 0) || (payloadLength > telemetryStore->segmentSize - PNP_TELEMETRY_STORE_RECORD_HEADER_SIZE))
+    {
+        return 0;
+    }
+
+    if (payloadLength + 1 > telemetryStore->recordBufferSize)
+    {
+        unsigned char* recordBuffer = realloc(telemetryStore->recordBuffer, payloadLength + 1);
+        if (recordBuffer == NULL)
+        {
+            LogError("Unable to allocate telemetry store record buffer");
+            return 0;
+        }
+        telemetryStore->recordBuffer = recordBuffer;
+        telemetryStore->recordBufferSize = payloadLength + 1;
+    }
+
+    if ((fread(telemetryStore->recordBuffer, 1, payloadLength, file) != payloadLength) ||
+        (ReadUint32(header + 4) != UpdateCrc(telemetryStore->crcTable, 0, telemetryStore->recordBuffer, payloadLength)) ||
+        (memchr(telemetryStore->recordBuffer, '\0', payloadLength) == NULL))
+    {
+        return 0;
+    }
+
+    telemetryStore->recordBuffer[payloadLength] = '\0';
+    return PNP_TELEMETRY_STORE_RECORD_HEADER_SIZE + payloadLength;
+}
+
+// Counts the valid records of a segment from offset on. Returns the offset after the last valid record.
+static size_t ScanSegment(PNP_TELEMETRY_STORE* telemetryStore, FILE* file, size_t offset, size_t* messageCount)
+{
+    *messageCount = 0;
+    if (fseek(file, (long)offset, SEEK_SET) != 0)
+    {
+        return offset;
+    }
+
+    size_t recordSize;
+    while ((recordSize = ReadRecord(telemetryStore, file)) != 0)
+    {
+        offset += recordSize;
+        (*messageCount)++;
+    }
+    return offset;
+}
+
+// Moves the read position to the start of the next segment and deletes the current one
+static void AdvanceReadSegment(PNP_TELEMETRY_STORE* telemetryStore)
+{
+    uint32_t sequence = telemetryStore->readSequence;
+
+    if (telemetryStore->readFile != NULL)
+    {
+        fclose(telemetryStore->readFile);
+        telemetryStore->readFile = NULL;
+    }
+
+    // The cursor moves first, so that a crash in between never leaves it on a deleted segment
+    telemetryStore->readSequence++;
+    telemetryStore->readOffset = 0;
+    (void)SaveCursor(telemetryStore);
+    RemoveSegment(telemetryStore, sequence);
+}
+
+static void DropSegmentMessages(PNP_TELEMETRY_STORE* telemetryStore, const char* reason)
+{
+    size_t* segmentMessageCount = GetSegmentMessageCount(telemetryStore, telemetryStore->readSequence);
+
+    if (*segmentMessageCount > 0)
+    {
+        LogError("Telemetry store %s: dropping %lu messages, %s", telemetryStore->pathPrefix,
+            (unsigned long)*segmentMessageCount, reason);
+    }
+    telemetryStore->droppedCount += *segmentMessageCount;
+    telemetryStore->messageCount -= *segmentMessageCount;
+    *segmentMessageCount = 0;
+    AdvanceReadSegment(telemetryStore);
+}
+
+// Starts a new segment for appending, dropping the oldest segment when the store is full
+static bool RotateWriteSegment(PNP_TELEMETRY_STORE* telemetryStore)
+{
+    uint32_t sequence = telemetryStore->writeSequence + 1;
+
+    if ((size_t)(sequence - telemetryStore->readSequence) >= telemetryStore->maxSegments)
+    {
+        DropSegmentMessages(telemetryStore, "the store is full");
+    }
+
+    FILE* writeFile = OpenSegment(telemetryStore, sequence, "w+b");
+    if (writeFile == NULL)
+    {
+        LogError("Unable to create telemetry store segment %lu", (unsigned long)sequence);
+        return false;
+    }
+
+    fclose(telemetryStore->writeFile);
+    telemetryStore->writeFile = writeFile;
+    telemetryStore->writeSequence = sequence;
+    telemetryStore->writeOffset = 0;
+    *GetSegmentMessageCount(telemetryStore, sequence) = 0;
+    return true;
+}
+
+// Finds the segments left by a previous run and counts their messages
+static bool LoadSegments(PNP_TELEMETRY_STORE* telemetryStore)
+{
+    uint32_t sequence = telemetryStore->readSequence;
+    size_t offset = telemetryStore->readOffset;
+    size_t endOffset = offset;
+    FILE* file;
+
+    telemetryStore->writeSequence = sequence;
+    while (((size_t)(sequence - telemetryStore->readSequence) < telemetryStore->maxSegments) &&
+        ((file = OpenSegment(telemetryStore, sequence, "rb")) != NULL))
+    {
+        size_t segmentMessageCount = 0;
+        endOffset = ScanSegment(telemetryStore, file, offset, &segmentMessageCount);
+        fclose(file);
+
+        *GetSegmentMessageCount(telemetryStore, sequence) = segmentMessageCount;
+        telemetryStore->messageCount += segmentMessageCount;
+        telemetryStore->writeSequence = sequence;
+        sequence++;
+        offset = 0;
+    }
+
+    if (telemetryStore->writeSequence == sequence)
+    {
+        // No segment yet
+        telemetryStore->writeFile = OpenSegment(telemetryStore, sequence, "w+b");
+        telemetryStore->readOffset = 0;
+        endOffset = 0;
+    }
+    else
+    {
+        // A record torn by a crash at the end of the last segment is overwritten by the next message
+        telemetryStore->writeFile = OpenSegment(telemetryStore, telemetryStore->writeSequence, "r+b");
+    }
+
+    if ((telemetryStore->writeFile == NULL) || (fseek(telemetryStore->writeFile, (long)endOffset, SEEK_SET) != 0))
+    {
+        LogError("Unable to open telemetry store segment %lu for writing", (unsigned long)telemetryStore->writeSequence);
+        return false;
+    }
+    telemetryStore->writeOffset = endOffset;
+    return true;
+}
+
+PNP_TELEMETRY_STORE_HANDLE PnP_TelemetryStore_Open(const char* pathPrefix, size_t segmentSize, size_t maxSegments)
+{
+    PNP_TELEMETRY_STORE* telemetryStore = NULL;
+    char cursorPath[PNP_TELEMETRY_STORE_MAX_PATH];
+
+    if ((pathPrefix == NULL) || (segmentSize <= PNP_TELEMETRY_STORE_RECORD_HEADER_SIZE) || (segmentSize > UINT32_MAX) ||
+        (maxSegments < 2))
+    {
+        LogError("Invalid telemetry store parameters, a segment must hold a record and there must be at least 2 segments");
+        return NULL;
+    }
+
+    if ((telemetryStore = calloc(1, sizeof(PNP_TELEMETRY_STORE))) == NULL)
+    {
+        LogError("Unable to allocate telemetry store");
+        return NULL;
+    }
+
+    InitializeCrcTable(telemetryStore->crcTable);
+    telemetryStore->segmentSize = segmentSize;
+    telemetryStore->maxSegments = maxSegments;
+
+    if (((telemetryStore->pathPrefix = malloc(strlen(pathPrefix) + 1)) == NULL) ||
+        ((telemetryStore->segmentMessageCounts = calloc(maxSegments, sizeof(size_t))) == NULL))
+    {
+        LogError("Unable to allocate telemetry store");
+        PnP_TelemetryStore_Close(telemetryStore);
+        return NULL;
+    }
+    strcpy(telemetryStore->pathPrefix, pathPrefix);
+
+    (void)snprintf(cursorPath, sizeof(cursorPath), "%s.cursor", pathPrefix);
+    if ((telemetryStore->cursorFile = fopen(cursorPath, "r+b")) != NULL)
+    {
+        LoadCursor(telemetryStore);
+    }
+    else if ((telemetryStore->cursorFile = fopen(cursorPath, "w+b")) == NULL)
+    {
+        LogError("Unable to create telemetry store cursor %s", cursorPath);
+        PnP_TelemetryStore_Close(telemetryStore);
+        return NULL;
+    }
+
+    if (!LoadSegments(telemetryStore) || !SaveCursor(telemetryStore))
+    {
+        PnP_TelemetryStore_Close(telemetryStore);
+        return NULL;
+    }
+
+    if (telemetryStore->messageCount > 0)
+    {
+        LogInfo("Telemetry store %s holds %lu messages from a previous run", pathPrefix, (unsigned long)telemetryStore->messageCount);
+    }
+
+    return telemetryStore;
+}
+
+void PnP_TelemetryStore_Close(PNP_TELEMETRY_STORE_HANDLE telemetryStore)
+{
+    if (telemetryStore != NULL)
+    {
+        if (telemetryStore->readFile != NULL)
+        {
+            fclose(telemetryStore->readFile);
+        }
+        if (telemetryStore->writeFile != NULL)
+        {
+            fclose(telemetryStore->writeFile);
+        }
+        if (telemetryStore->cursorFile != NULL)
+        {
+            fclose(telemetryStore->cursorFile);
+        }
+        free(telemetryStore->recordBuffer);
+        free(telemetryStore->segmentMessageCounts);
+        free(telemetryStore->pathPrefix);
+        free(telemetryStore);
+    }
+}
+
+bool PnP_TelemetryStore_Append(PNP_TELEMETRY_STORE_HANDLE telemetryStore, const char* componentName, const char* message)
+{
+    const char* name = (componentName != NULL) ? componentName : "";
+    size_t nameLength = strlen(name) + 1;
+    size_t messageLength = strlen(message);
+    size_t recordSize = PNP_TELEMETRY_STORE_RECORD_HEADER_SIZE + nameLength + messageLength;
+    unsigned char header[PNP_TELEMETRY_STORE_RECORD_HEADER_SIZE];
+
+    if (recordSize > telemetryStore->segmentSize)
+    {
+        LogError("Telemetry message of %lu bytes does not fit in a telemetry store segment", (unsigned long)messageLength);
+        return false;
+    }
+
+    if ((telemetryStore->writeOffset + recordSize > telemetryStore->segmentSize) && !RotateWriteSegment(telemetryStore))
+    {
+        return false;
+    }
+
+    uint32_t crc = UpdateCrc(telemetryStore->crcTable, 0, (const unsigned char*)name, nameLength);
+    crc = UpdateCrc(telemetryStore->crcTable, crc, (const unsigned char*)message, messageLength);
+    WriteUint32(header, (uint32_t)(nameLength + messageLength));
+    WriteUint32(header + 4, crc);
+
+    if ((fwrite(header, 1, sizeof(header), telemetryStore->writeFile) != sizeof(header)) ||
+        (fwrite(name, 1, nameLength, telemetryStore->writeFile) != nameLength) ||
+        (fwrite(message, 1, messageLength, telemetryStore->writeFile) != messageLength) ||
+        (fflush(telemetryStore->writeFile) != 0))
+    {
+        LogError("Unable to write telemetry store segment %lu", (unsigned long)telemetryStore->writeSequence);
+        clearerr(telemetryStore->writeFile);
+        (void)fseek(telemetryStore->writeFile, (long)telemetryStore->writeOffset, SEEK_SET);
+        return false;
+    }
+
+    telemetryStore->writeOffset += recordSize;
+    (*GetSegmentMessageCount(telemetryStore, telemetryStore->writeSequence))++;
+    telemetryStore->messageCount++;
+    return true;
+}
+
+size_t PnP_TelemetryStore_Replay(PNP_TELEMETRY_STORE_HANDLE telemetryStore, size_t maxMessages,
+    PNP_TELEMETRY_STORE_SEND_CALLBACK sendCallback, void* userContext)
+{
+    size_t sentCount = 0;
+
+    while ((sentCount < maxMessages) && (telemetryStore->messageCount > 0))
+    {
+        size_t* segmentMessageCount = GetSegmentMessageCount(telemetryStore, telemetryStore->readSequence);
+        if (*segmentMessageCount == 0)
+        {
+            // The rest of the segment was corrupted
+            DropSegmentMessages(telemetryStore, "they are corrupted");
+            continue;
+        }
+
+        if ((telemetryStore->readFile == NULL) &&
+            ((telemetryStore->readFile = OpenSegment(telemetryStore, telemetryStore->readSequence, "rb")) == NULL))
+        {
+            DropSegmentMessages(telemetryStore, "their segment cannot be opened");
+            continue;
+        }
+
+        // Data buffered from the segment being written can be stale, seek to drop it
+        if (((telemetryStore->readSequence == telemetryStore->writeSequence) ||
+            (ftell(telemetryStore->readFile) != (long)telemetryStore->readOffset)) &&
+            (fseek(telemetryStore->readFile, (long)telemetryStore->readOffset, SEEK_SET) != 0))
+        {
+            LogError("Unable to read telemetry store segment %lu", (unsigned long)telemetryStore->readSequence);
+            break;
+        }
+
+        size_t recordSize = ReadRecord(telemetryStore, telemetryStore->readFile);
+        if (recordSize == 0)
+        {
+            if (telemetryStore->readSequence == telemetryStore->writeSequence)
+            {
+                LogError("Unable to read telemetry store segment %lu", (unsigned long)telemetryStore->readSequence);
+                break;
+            }
+            DropSegmentMessages(telemetryStore, "they are corrupted");
+            continue;
+        }
+
+        const char* componentName = (const char*)telemetryStore->recordBuffer;
+        const char* message = componentName + strlen(componentName) + 1;
+        if (!sendCallback((*componentName != '\0') ? componentName : NULL, message, userContext))
+        {
+            break;
+        }
+
+        telemetryStore->readOffset += recordSize;
+        (*segmentMessageCount)--;
+        telemetryStore->messageCount--;
+        sentCount++;
+
+        if ((*segmentMessageCount == 0) && (telemetryStore->readSequence != telemetryStore->writeSequence))
+        {
+            AdvanceReadSegment(telemetryStore);
+        }
+        else
+        {
+            (void)SaveCursor(telemetryStore);
+        }
+    }
+
+    return sentCount;
+}
+
+size_t PnP_TelemetryStore_GetMessageCount(PNP_TELEMETRY_STORE_HANDLE telemetryStore)
+{
+    return telemetryStore->messageCount;
+}
+
+size_t PnP_TelemetryStore_GetDroppedCount(PNP_TELEMETRY_STORE_HANDLE telemetryStore)
+{
+    return telemetryStore->droppedCount;
+}
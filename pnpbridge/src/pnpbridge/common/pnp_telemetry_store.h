@@ -0,0 +1,73 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+//
+// PnP telemetry store is a persistent FIFO of telemetry messages, used to keep telemetry while IoT Hub cannot be
+// reached and to replay it in order once it can. Messages are appended to segment files named
+// "<pathPrefix>-<sequence>.seg" that hold at most segmentSize bytes each. When all maxSegments segments are in use,
+// the oldest segment is deleted together with the messages it still holds, so the store never takes more than
+// segmentSize * maxSegments bytes of disk.
+//
+// Each record carries a CRC32 of its contents. Records that fail the check, e.g. because the bridge stopped in
+// the middle of writing them, are dropped when the store is opened or replayed. The position of the oldest
+// message that has not been replayed is kept in "<pathPrefix>.cursor", so messages survive a restart of the bridge.
+//
+// The store is not thread safe, callers serialize access to it.
+//
+
+#ifndef PNP_TELEMETRY_STORE_H
+#define PNP_TELEMETRY_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct PNP_TELEMETRY_STORE_TAG* PNP_TELEMETRY_STORE_HANDLE;
+
+//
+// PNP_TELEMETRY_STORE_SEND_CALLBACK is called by PnP_TelemetryStore_Replay for each message in order. It returns
+// true if the message was sent; on false the message stays in the store and the replay stops.
+//
+typedef bool(*PNP_TELEMETRY_STORE_SEND_CALLBACK)(const char* componentName, const char* message, void* userContext);
+
+//
+// PnP_TelemetryStore_Open opens the store at pathPrefix, creating it if it does not exist yet, and counts the
+// messages it holds. The directory of pathPrefix must exist.
+//
+PNP_TELEMETRY_STORE_HANDLE PnP_TelemetryStore_Open(const char* pathPrefix, size_t segmentSize, size_t maxSegments);
+
+void PnP_TelemetryStore_Close(PNP_TELEMETRY_STORE_HANDLE telemetryStore);
+
+//
+// PnP_TelemetryStore_Append adds message of componentName at the end of the store. Returns false if the message
+// is larger than a segment or could not be written.
+//
+bool PnP_TelemetryStore_Append(PNP_TELEMETRY_STORE_HANDLE telemetryStore, const char* componentName, const char* message);
+
+//
+// PnP_TelemetryStore_Replay passes up to maxMessages of the oldest messages to sendCallback and removes the ones
+// it sent. Returns the number of messages sent.
+//
+size_t PnP_TelemetryStore_Replay(PNP_TELEMETRY_STORE_HANDLE telemetryStore, size_t maxMessages,
+    PNP_TELEMETRY_STORE_SEND_CALLBACK sendCallback, void* userContext);
+
+//
+// PnP_TelemetryStore_GetMessageCount returns the number of messages waiting to be replayed.
+//
+size_t PnP_TelemetryStore_GetMessageCount(PNP_TELEMETRY_STORE_HANDLE telemetryStore);
+
+//
+// PnP_TelemetryStore_GetDroppedCount returns the number of messages dropped since the store was opened, because
+// the store was full or they were corrupted.
+//
+size_t PnP_TelemetryStore_GetDroppedCount(PNP_TELEMETRY_STORE_HANDLE telemetryStore);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PNP_TELEMETRY_STORE_H */
@@ -0,0 +1,90 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct _BRIDGE_METRICS* BRIDGE_METRICS_HANDLE;
+
+/**
+* @brief    BridgeMetrics_Create starts the bridge-wide metrics registry, which keeps counters, gauges and
+*           latency histograms per component.
+*
+* @param    EndpointPath            Path of a Unix domain socket serving the metrics in the Prometheus text
+*                                   format over HTTP, NULL for no endpoint
+*
+* @param    TelemetryIntervalMs     Interval in milliseconds at which the metrics are sent as bridge telemetry,
+*                                   0 to not send them
+*
+* @returns  Handle to the registry on success and NULL on failure
+*/
+BRIDGE_METRICS_HANDLE BridgeMetrics_Create(
+    const char* EndpointPath,
+    unsigned int TelemetryIntervalMs);
+
+/**
+* @brief    BridgeMetrics_Stop closes the endpoint and stops sending metrics telemetry. Metrics can still be
+*           updated until the registry is destroyed. It must be called while the client handle is still valid.
+*/
+void BridgeMetrics_Stop(
+    BRIDGE_METRICS_HANDLE Metrics);
+
+/**
+* @brief    BridgeMetrics_Destroy stops the registry if needed and frees it. It must be called after the client
+*           handle has been destroyed, so that no telemetry confirmation is still pending.
+*/
+void BridgeMetrics_Destroy(
+    BRIDGE_METRICS_HANDLE Metrics);
+
+void BridgeMetrics_AddCounter(
+    BRIDGE_METRICS_HANDLE Metrics,
+    const char* ComponentName,
+    const char* MetricName,
+    uint64_t Delta);
+
+void BridgeMetrics_AddGauge(
+    BRIDGE_METRICS_HANDLE Metrics,
+    const char* ComponentName,
+    const char* MetricName,
+    int64_t Delta);
+
+void BridgeMetrics_SetGauge(
+    BRIDGE_METRICS_HANDLE Metrics,
+    const char* ComponentName,
+    const char* MetricName,
+    int64_t Value);
+
+void BridgeMetrics_ObserveDuration(
+    BRIDGE_METRICS_HANDLE Metrics,
+    const char* ComponentName,
+    const char* MetricName,
+    uint32_t DurationMs);
+
+/**
+* @brief    BridgeMetrics_TrackMessage counts a telemetry message handed to the IoT Hub client and returns the
+*           context to pass to BridgeMetrics_CompleteMessage once the message is confirmed or has failed.
+*
+* @returns  Tracking context, NULL if Metrics is NULL or the context could not be allocated
+*/
+void* BridgeMetrics_TrackMessage(
+    BRIDGE_METRICS_HANDLE Metrics,
+    const char* ComponentName);
+
+/**
+* @brief    BridgeMetrics_CompleteMessage records the outcome and confirmation latency of a tracked message and
+*           frees the tracking context. Tracking can be NULL.
+*/
+void BridgeMetrics_CompleteMessage(
+    void* Tracking,
+    bool Confirmed);
+
+#ifdef __cplusplus
+}
+#endif
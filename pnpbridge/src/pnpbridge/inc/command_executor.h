@@ -0,0 +1,97 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "iothub_client_core.h"
+#include "pnpadapter_api.h"
+
+typedef struct _COMMAND_EXECUTOR* COMMAND_EXECUTOR_HANDLE;
+
+/**
+* @brief    CommandExecutor_Create starts the bridge-wide command executor. Commands are taken off the IoT Hub
+*           client's callback thread and run on a worker thread of their component, so that a slow device only
+*           delays commands of its own component. Commands of one component run one at a time, in order.
+*
+* @param    TimeoutMs       Time in milliseconds after which a command that has not completed is answered
+*                           with PNP_STATUS_TIMEOUT
+*
+* @returns  Handle to the executor on success and NULL on failure
+*/
+COMMAND_EXECUTOR_HANDLE CommandExecutor_Create(
+    unsigned int TimeoutMs);
+
+/**
+* @brief    CommandExecutor_Destroy answers the commands that have not started with PNP_STATUS_INTERNAL_ERROR,
+*           waits for running commands to complete and stops the executor. It must be called before the
+*           components are stopped and while the client handle commands are answered on is still valid.
+*/
+void CommandExecutor_Destroy(
+    COMMAND_EXECUTOR_HANDLE Executor);
+
+/**
+* @brief    CommandExecutor_Submit queues a command for a component. The command is always answered through
+*           IoTHubClientCore_DeviceMethodResponse, also when it cannot be queued.
+*
+* @param    Executor            Handle returned by CommandExecutor_Create
+*
+* @param    ClientHandle        Client handle the command arrived on
+*
+* @param    MethodId            Method handle of the command, used to answer it
+*
+* @param    ComponentHandle     Component the command is routed to
+*
+* @param    CommandName         Name of the command, without the component prefix
+*
+* @param    CommandValue        Payload of the command. The executor takes ownership of it.
+*/
+void CommandExecutor_Submit(
+    COMMAND_EXECUTOR_HANDLE Executor,
+    IOTHUB_CLIENT_CORE_HANDLE ClientHandle,
+    METHOD_HANDLE MethodId,
+    PNPBRIDGE_COMPONENT_HANDLE ComponentHandle,
+    const char* CommandName,
+    JSON_Value* CommandValue);
+
+/**
+* @brief    CommandExecutor_Run queues a command for a component like CommandExecutor_Submit, and waits for its
+*           answer. It is for IoT Hub clients that answer a method when its callback returns, such as module
+*           clients. The wait ends after the executor's timeout at the latest, with PNP_STATUS_TIMEOUT.
+*
+* @param    CommandValue        Payload of the command. The executor takes ownership of it.
+*
+* @param    Response            Receives the response of the command, to be freed by the caller. NULL if the
+*                               command has no response.
+*
+* @param    ResponseSize        Receives the size of the response
+*
+* @returns  Status of the command
+*/
+int CommandExecutor_Run(
+    COMMAND_EXECUTOR_HANDLE Executor,
+    PNPBRIDGE_COMPONENT_HANDLE ComponentHandle,
+    const char* CommandName,
+    JSON_Value* CommandValue,
+    unsigned char** Response,
+    size_t* ResponseSize);
+
+/**
+* @brief    CommandExecutor_SendResponse answers a command.
+*
+* @remarks  When Response is NULL an empty JSON object is sent, since IoT Hub requires a payload.
+*/
+IOTHUB_CLIENT_RESULT CommandExecutor_SendResponse(
+    IOTHUB_CLIENT_CORE_HANDLE ClientHandle,
+    METHOD_HANDLE MethodId,
+    int Status,
+    const unsigned char* Response,
+    size_t ResponseSize);
+
+#ifdef __cplusplus
+}
+#endif
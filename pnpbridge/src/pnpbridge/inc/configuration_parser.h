@@ -160,6 +160,31 @@ JSON_Array*,
 Configuration_GetDevices, JSON_Value*, config
     );
 
+MOCKABLE_FUNCTION(,
+JSON_Object*,
+Configuration_GetTelemetryBatchingParameters, JSON_Value*, config
+    );
+
+MOCKABLE_FUNCTION(,
+JSON_Object*,
+Configuration_GetReportedPropertyCacheParameters, JSON_Value*, config
+    );
+
+MOCKABLE_FUNCTION(,
+JSON_Object*,
+Configuration_GetCommandExecutionParameters, JSON_Value*, config
+    );
+
+MOCKABLE_FUNCTION(,
+JSON_Object*,
+Configuration_GetStoreAndForwardParameters, JSON_Value*, config
+    );
+
+MOCKABLE_FUNCTION(,
+JSON_Object*,
+Configuration_GetMetricsParameters, JSON_Value*, config
+    );
+
 
 #ifdef __cplusplus
 }
@@ -289,6 +289,117 @@ extern "C"
         PNPBRIDGE_COMPONENT_HANDLE, ComponentHandle
     );
 
+    /**
+    * @brief    PnpBridgeClient_SendTelemetry sends a telemetry reading for a component. When telemetry
+    *           batching is configured the reading is coalesced with the component's other pending readings
+    *           into one message, otherwise it is sent right away.
+
+    * @param    ClientHandle           Client handle of the component
+    *
+    * @param    ComponentName          Name of the component the reading belongs to
+    *
+    * @param    TelemetryData          Reading as a JSON object, e.g. {"temperature":21.5}
+    *
+    * @returns  IOTHUB_CLIENT_OK on success and other IOTHUB_CLIENT_RESULT values on failure
+    */
+    MOCKABLE_FUNCTION(,
+        IOTHUB_CLIENT_RESULT,
+        PnpBridgeClient_SendTelemetry,
+        PNP_BRIDGE_CLIENT_HANDLE, ClientHandle,
+        const char*, ComponentName,
+        const char*, TelemetryData
+    );
+
+    /**
+    * @brief    PnpBridgeClient_ReportProperty reports the current value of a read-only property of a component.
+    *           When the reported property cache is configured, a value the twin already holds is not sent again
+    *           and changed values of all components are merged into one twin patch, otherwise it is sent right away.
+
+    * @param    ClientHandle           Client handle of the component
+    *
+    * @param    ComponentName          Name of the component the property belongs to
+    *
+    * @param    PropertyName           Name of the property
+    *
+    * @param    PropertyValue          Value of the property as JSON, e.g. "\"1.0.2\""
+    *
+    * @returns  IOTHUB_CLIENT_OK on success and other IOTHUB_CLIENT_RESULT values on failure
+    */
+    MOCKABLE_FUNCTION(,
+        IOTHUB_CLIENT_RESULT,
+        PnpBridgeClient_ReportProperty,
+        PNP_BRIDGE_CLIENT_HANDLE, ClientHandle,
+        const char*, ComponentName,
+        const char*, PropertyName,
+        const char*, PropertyValue
+    );
+
+    // Metrics the bridge keeps for every component. Adapters can update them, or their own metrics, through
+    // PnpBridgeMetrics_AddCounter, PnpBridgeMetrics_SetGauge and PnpBridgeMetrics_ObserveDuration.
+#define PNP_METRIC_MESSAGES_SENT "pnpbridge_messages_sent_total"
+#define PNP_METRIC_MESSAGES_CONFIRMED "pnpbridge_messages_confirmed_total"
+#define PNP_METRIC_MESSAGES_FAILED "pnpbridge_messages_failed_total"
+#define PNP_METRIC_MESSAGES_IN_FLIGHT "pnpbridge_messages_in_flight"
+#define PNP_METRIC_CONFIRMATION_LATENCY "pnpbridge_confirmation_latency_ms"
+#define PNP_METRIC_COMMAND_LATENCY "pnpbridge_command_latency_ms"
+#define PNP_METRIC_COMMANDS_FAILED "pnpbridge_commands_failed_total"
+#define PNP_METRIC_POLL_DURATION "pnpbridge_poll_duration_ms"
+#define PNP_METRIC_DEVICE_IO_ERRORS "pnpbridge_device_io_errors_total"
+
+    /**
+    * @brief    PnpBridgeMetrics_AddCounter adds to a counter metric of a component. It does nothing when bridge
+    *           metrics are not configured.
+
+    * @param    ComponentName          Name of the component the metric belongs to, NULL for the bridge itself
+    *
+    * @param    MetricName             Name of the metric, e.g. PNP_METRIC_DEVICE_IO_ERRORS
+    *
+    * @param    Delta                  Value added to the counter
+    */
+    MOCKABLE_FUNCTION(,
+        void,
+        PnpBridgeMetrics_AddCounter,
+        const char*, ComponentName,
+        const char*, MetricName,
+        uint64_t, Delta
+    );
+
+    /**
+    * @brief    PnpBridgeMetrics_SetGauge sets a gauge metric of a component. It does nothing when bridge metrics
+    *           are not configured.
+
+    * @param    ComponentName          Name of the component the metric belongs to, NULL for the bridge itself
+    *
+    * @param    MetricName             Name of the metric
+    *
+    * @param    Value                  Value of the gauge
+    */
+    MOCKABLE_FUNCTION(,
+        void,
+        PnpBridgeMetrics_SetGauge,
+        const char*, ComponentName,
+        const char*, MetricName,
+        int64_t, Value
+    );
+
+    /**
+    * @brief    PnpBridgeMetrics_ObserveDuration records a duration in a latency histogram of a component. It does
+    *           nothing when bridge metrics are not configured.
+
+    * @param    ComponentName          Name of the component the metric belongs to, NULL for the bridge itself
+    *
+    * @param    MetricName             Name of the metric, e.g. PNP_METRIC_POLL_DURATION
+    *
+    * @param    DurationMs             Duration in milliseconds
+    */
+    MOCKABLE_FUNCTION(,
+        void,
+        PnpBridgeMetrics_ObserveDuration,
+        const char*, ComponentName,
+        const char*, MetricName,
+        uint32_t, DurationMs
+    );
+
 
     /*
         PnpAdapter Binding info
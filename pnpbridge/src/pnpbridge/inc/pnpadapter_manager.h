@@ -34,6 +34,26 @@ extern "C"
         unsigned int NumComponents;
         SINGLYLINKEDLIST_HANDLE PnpAdapterHandleList;
         char ** ComponentsInModel;
+
+        // Exact-match index from component name to PPNPADAPTER_COMPONENT_TAG, keyed on ComponentsInModel
+        PNP_COMPONENT_INDEX_HANDLE ComponentIndex;
+
+        // Coalesces component telemetry before it is sent, NULL when telemetry batching is not configured
+        TELEMETRY_PIPELINE_HANDLE TelemetryPipeline;
+
+        // Drops unchanged read-only properties and merges the rest into one twin patch, NULL when the
+        // reported property cache is not configured
+        REPORTED_PROPERTY_PIPELINE_HANDLE ReportedPropertyPipeline;
+
+        // Runs component commands off the IoT Hub client's callback thread
+        COMMAND_EXECUTOR_HANDLE CommandExecutor;
+
+        // Keeps telemetry on disk while IoT Hub cannot be reached, NULL when store and forward is not configured
+        STORE_AND_FORWARD_HANDLE StoreAndForward;
+
+        // Counters, gauges and latency histograms of the bridge and its components, NULL when bridge metrics
+        // are not configured
+        BRIDGE_METRICS_HANDLE Metrics;
     } PNP_ADAPTER_MANAGER, * PPNP_ADAPTER_MANAGER;
 
 
@@ -130,6 +150,18 @@ extern "C"
     void PnpAdapterManager_ReleaseComponentsInModel(
         PPNP_ADAPTER_MANAGER adapterMgr);
 
+    /**
+    * @brief    PnpAdapterManager_GetComponentHandleFromComponentName looks up a component by its exact name
+    *
+    * @remarks  ComponentName does not need to be NULL terminated; only the first ComponentNameSize characters
+                are used and they must match the whole component name
+
+    * @param    ComponentName       Name of the component to look up
+    *
+    * @param    ComponentNameSize   Number of characters in ComponentName
+    *
+    * @returns  The component handle on success and NULL if no component has that name
+    */
     PPNPADAPTER_COMPONENT_TAG PnpAdapterManager_GetComponentHandleFromComponentName(
         const char * ComponentName,
         size_t ComponentNameSize);
@@ -146,8 +178,24 @@ extern "C"
         size_t size,
         void* userContextCallback);
 
-    // Device Method callback is invoked by IoT SDK when a device method arrives.
+    // Connection status callback is invoked by IoT SDK when the connection to IoT Hub changes state.
+    void PnpAdapterManager_ConnectionStatusCallback(
+        IOTHUB_CLIENT_CONNECTION_STATUS result,
+        IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
+        void* userContextCallback);
+
+    // Device Method callback is invoked by IoT SDK when a device method arrives. The method is answered
+    // later through the command executor, userContextCallback is the client handle it arrived on.
     int PnpAdapterManager_DeviceMethodCallback(
+        const char* methodName,
+        const unsigned char* payload,
+        size_t size,
+        METHOD_HANDLE methodId,
+        void* userContextCallback);
+
+    // Module Method callback is invoked by IoT SDK when a method arrives on the module client. Module clients
+    // answer a method when the callback returns, so it waits for the command executor, at most the command timeout.
+    int PnpAdapterManager_ModuleMethodCallback(
         const char* methodName,
         const unsigned char* payload,
         size_t size,
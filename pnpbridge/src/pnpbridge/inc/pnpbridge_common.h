@@ -51,6 +51,11 @@ extern "C"
 
 // Pnp Bridge headers
 #include "configuration_parser.h"
+#include "store_and_forward.h"
+#include "telemetry_pipeline.h"
+#include "reported_property_pipeline.h"
+#include "command_executor.h"
+#include "bridge_metrics.h"
 #include "pnpadapter_manager.h"
 
 #include <assert.h>
@@ -120,6 +125,40 @@ int Map_GetIndexValueFromKey(MAP_HANDLE handle, const char* key);
 #define PNP_CONFIG_TRUE "true"
 #define PNP_CONFIG_FALSE "false"
 
+#define PNP_CONFIG_TELEMETRY_BATCHING "pnp_bridge_telemetry_batching"
+#define PNP_CONFIG_TELEMETRY_BATCHING_MAX_MESSAGE_SIZE "max_message_size"
+#define PNP_CONFIG_TELEMETRY_BATCHING_MAX_LATENCY_MS "max_latency_ms"
+
+// Telemetry is metered by IoT Hub in 4 KB blocks, so by default a batch fills one block
+#define PNP_TELEMETRY_BATCHING_DEFAULT_MAX_MESSAGE_SIZE 4096
+#define PNP_TELEMETRY_BATCHING_DEFAULT_MAX_LATENCY_MS 1000
+
+#define PNP_CONFIG_REPORTED_PROPERTY_CACHE "pnp_bridge_reported_property_cache"
+#define PNP_CONFIG_REPORTED_PROPERTY_CACHE_FLUSH_INTERVAL_MS "flush_interval_ms"
+
+#define PNP_REPORTED_PROPERTY_CACHE_DEFAULT_FLUSH_INTERVAL_MS 1000
+
+#define PNP_CONFIG_COMMAND_EXECUTION "pnp_bridge_command_execution"
+#define PNP_CONFIG_COMMAND_EXECUTION_TIMEOUT_MS "timeout_ms"
+
+// IoT Hub gives up on a direct method after 30 seconds unless the caller asks for longer
+#define PNP_COMMAND_EXECUTION_DEFAULT_TIMEOUT_MS 30000
+
+#define PNP_CONFIG_STORE_AND_FORWARD "pnp_bridge_store_and_forward"
+#define PNP_CONFIG_STORE_AND_FORWARD_PATH "path"
+#define PNP_CONFIG_STORE_AND_FORWARD_SEGMENT_SIZE "segment_size"
+#define PNP_CONFIG_STORE_AND_FORWARD_MAX_SEGMENTS "max_segments"
+#define PNP_CONFIG_STORE_AND_FORWARD_REPLAY_RATE "replay_rate"
+
+// By default the store keeps up to 16 MB of telemetry
+#define PNP_STORE_AND_FORWARD_DEFAULT_SEGMENT_SIZE 1048576
+#define PNP_STORE_AND_FORWARD_DEFAULT_MAX_SEGMENTS 16
+#define PNP_STORE_AND_FORWARD_DEFAULT_REPLAY_RATE 100
+
+#define PNP_CONFIG_METRICS "pnp_bridge_metrics"
+#define PNP_CONFIG_METRICS_ENDPOINT "endpoint"
+#define PNP_CONFIG_METRICS_TELEMETRY_INTERVAL_MS "telemetry_interval_ms"
+
 #define PNPBRIDGE_MAX_PATH 2048
 
 // Mode agnostic iot and pnp handle
@@ -140,6 +179,9 @@ typedef struct _MX_IOT_HANDLE_TAG {
 
     bool IsModule;
     bool ClientHandleInitialized;
+
+    // Whether the client is authenticated with IoT Hub, as last reported by its connection status callback
+    bool Connected;
 } MX_IOT_HANDLE_TAG;
 
 typedef enum PNP_BRIDGE_STATE {
@@ -0,0 +1,74 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "pnp_bridge_client.h"
+
+typedef struct _REPORTED_PROPERTY_PIPELINE* REPORTED_PROPERTY_PIPELINE_HANDLE;
+
+/**
+* @brief    ReportedPropertyPipeline_Create starts the bridge-wide reported property pipeline. Reports of a
+*           value the twin already holds are dropped; changed values of all components are merged into one
+*           twin PATCH that is sent at most once per FlushIntervalMs.
+*
+* @param    FlushIntervalMs     Longest time in milliseconds a changed property waits before it is reported
+*
+* @returns  Handle to the pipeline on success and NULL on failure
+*/
+REPORTED_PROPERTY_PIPELINE_HANDLE ReportedPropertyPipeline_Create(
+    unsigned int FlushIntervalMs);
+
+/**
+* @brief    ReportedPropertyPipeline_Destroy sends the pending patch and stops the pipeline. It must be called
+*           while the client handle used for submitted properties is still valid.
+*/
+void ReportedPropertyPipeline_Destroy(
+    REPORTED_PROPERTY_PIPELINE_HANDLE Pipeline);
+
+/**
+* @brief    ReportedPropertyPipeline_Submit queues a read-only property value of a component.
+*
+* @param    Pipeline            Handle returned by ReportedPropertyPipeline_Create
+*
+* @param    ClientHandle        Client handle the component's properties are reported on
+*
+* @param    ComponentName       Name of the component the property belongs to, NULL for the root component
+*
+* @param    PropertyName        Name of the property
+*
+* @param    PropertyValue       Value of the property as JSON, e.g. "\"1.0.2\""
+*
+* @returns  IOTHUB_CLIENT_OK on success and other IOTHUB_CLIENT_RESULT values on failure
+*/
+IOTHUB_CLIENT_RESULT ReportedPropertyPipeline_Submit(
+    REPORTED_PROPERTY_PIPELINE_HANDLE Pipeline,
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName,
+    const char* PropertyName,
+    const char* PropertyValue);
+
+/**
+* @brief    ReportedPropertyPipeline_Resync reports every known property again in one patch, for when the twin
+*           may have missed updates while the connection to IoT Hub was down.
+*/
+void ReportedPropertyPipeline_Resync(
+    REPORTED_PROPERTY_PIPELINE_HANDLE Pipeline);
+
+/**
+* @brief    ReportedPropertyPipeline_SendReportedProperty reports a single property immediately.
+*/
+IOTHUB_CLIENT_RESULT ReportedPropertyPipeline_SendReportedProperty(
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName,
+    const char* PropertyName,
+    const char* PropertyValue);
+
+#ifdef __cplusplus
+}
+#endif
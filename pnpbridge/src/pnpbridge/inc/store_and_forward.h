@@ -0,0 +1,74 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "pnp_bridge_client.h"
+
+typedef struct _STORE_AND_FORWARD* STORE_AND_FORWARD_HANDLE;
+
+/**
+* @brief    StoreAndForward_Create opens the bridge-wide telemetry store. While IoT Hub cannot be reached,
+*           telemetry is written to disk instead of being sent; once the connection is back it is replayed
+*           in order, at most ReplayRate messages per second, before new telemetry is sent directly again.
+*           Telemetry left in the store by a previous run is replayed as well.
+*
+* @param    Path            Path prefix of the store's files. The directory must exist.
+*
+* @param    SegmentSize     Size in bytes of each store file
+*
+* @param    MaxSegments     Number of store files. When all are full the oldest one is dropped.
+*
+* @param    ReplayRate      Messages per second sent from the store after a reconnect
+*
+* @returns  Handle to the store on success and NULL on failure
+*/
+STORE_AND_FORWARD_HANDLE StoreAndForward_Create(
+    const char* Path,
+    size_t SegmentSize,
+    size_t MaxSegments,
+    unsigned int ReplayRate);
+
+/**
+* @brief    StoreAndForward_Destroy stops replaying and closes the store. Telemetry that was not replayed
+*           stays on disk for the next run.
+*/
+void StoreAndForward_Destroy(
+    STORE_AND_FORWARD_HANDLE StoreAndForward);
+
+/**
+* @brief    StoreAndForward_Submit sends a telemetry message, or stores it if IoT Hub cannot be reached or
+*           older telemetry is still waiting to be replayed.
+*
+* @param    StoreAndForward     Handle returned by StoreAndForward_Create
+*
+* @param    ClientHandle        Client handle the component's telemetry is sent on
+*
+* @param    ComponentName       Name of the component the message belongs to
+*
+* @param    TelemetryData       Telemetry message body
+*
+* @returns  IOTHUB_CLIENT_OK on success and other IOTHUB_CLIENT_RESULT values on failure
+*/
+IOTHUB_CLIENT_RESULT StoreAndForward_Submit(
+    STORE_AND_FORWARD_HANDLE StoreAndForward,
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName,
+    const char* TelemetryData);
+
+/**
+* @brief    StoreAndForward_SetConnected tells the store whether IoT Hub can be reached. The store starts
+*           disconnected, so telemetry is stored until the client authenticates.
+*/
+void StoreAndForward_SetConnected(
+    STORE_AND_FORWARD_HANDLE StoreAndForward,
+    bool Connected);
+
+#ifdef __cplusplus
+}
+#endif
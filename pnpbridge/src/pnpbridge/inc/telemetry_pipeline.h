@@ -0,0 +1,72 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "pnp_bridge_client.h"
+#include "store_and_forward.h"
+
+typedef struct _TELEMETRY_PIPELINE* TELEMETRY_PIPELINE_HANDLE;
+
+/**
+* @brief    TelemetryPipeline_Create starts the bridge-wide telemetry pipeline. Readings submitted for the
+*           same component are coalesced into one multi-field message, which is sent once it would grow
+*           beyond MaxMessageSize or once its oldest reading has waited MaxLatencyMs.
+*
+* @param    MaxMessageSize      Largest telemetry message body in bytes the pipeline builds
+*
+* @param    MaxLatencyMs        Longest time in milliseconds a reading waits before it is sent
+*
+* @param    StoreAndForward     Store batches are handed to instead of being sent, NULL to send them directly
+*
+* @returns  Handle to the pipeline on success and NULL on failure
+*/
+TELEMETRY_PIPELINE_HANDLE TelemetryPipeline_Create(
+    size_t MaxMessageSize,
+    unsigned int MaxLatencyMs,
+    STORE_AND_FORWARD_HANDLE StoreAndForward);
+
+/**
+* @brief    TelemetryPipeline_Destroy sends every pending batch and stops the pipeline. It must be called
+*           while the client handles used for submitted telemetry are still valid.
+*/
+void TelemetryPipeline_Destroy(
+    TELEMETRY_PIPELINE_HANDLE Pipeline);
+
+/**
+* @brief    TelemetryPipeline_Submit queues a telemetry reading for a component.
+*
+* @remarks  TelemetryData should be a JSON object; anything else is sent right away as its own message.
+*
+* @param    Pipeline            Handle returned by TelemetryPipeline_Create
+*
+* @param    ClientHandle        Client handle the component's telemetry is sent on
+*
+* @param    ComponentName       Name of the component the reading belongs to
+*
+* @param    TelemetryData       Reading as a JSON object, e.g. {"temperature":21.5}
+*
+* @returns  IOTHUB_CLIENT_OK on success and other IOTHUB_CLIENT_RESULT values on failure
+*/
+IOTHUB_CLIENT_RESULT TelemetryPipeline_Submit(
+    TELEMETRY_PIPELINE_HANDLE Pipeline,
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName,
+    const char* TelemetryData);
+
+/**
+* @brief    TelemetryPipeline_SendMessage sends a telemetry message for a component immediately.
+*/
+IOTHUB_CLIENT_RESULT TelemetryPipeline_SendMessage(
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName,
+    const char* TelemetryData);
+
+#ifdef __cplusplus
+}
+#endif
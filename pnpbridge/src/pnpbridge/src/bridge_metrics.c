@@ -0,0 +1,524 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "pnpbridge_common.h"
+
+#include "bridge_metrics.h"
+#include "pnp_metrics.h"
+
+#include "azure_c_shared_utility/tickcounter.h"
+
+#ifndef WIN32
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+extern PPNP_BRIDGE g_PnpBridge;
+
+// Interval in milliseconds at which the endpoint thread checks whether it has to stop
+#define BRIDGE_METRICS_ENDPOINT_POLL_MS 250
+
+// Longest time in milliseconds the endpoint waits for a client's request
+#define BRIDGE_METRICS_REQUEST_TIMEOUT_MS 1000
+
+#define BRIDGE_METRICS_MAX_REQUEST_SIZE 1024
+
+static const char BridgeMetrics_TelemetryName[] = "BridgeMetrics";
+
+typedef struct _BRIDGE_METRICS {
+    // Lock protects Registry and Stop; Condition wakes the telemetry thread when the registry is stopping
+    LOCK_HANDLE Lock;
+    COND_HANDLE Condition;
+    PNP_METRICS_HANDLE Registry;
+    TICK_COUNTER_HANDLE Clock;
+    bool Stop;
+
+    char* EndpointPath;
+    int EndpointSocket;
+    THREAD_HANDLE EndpointThread;
+
+    unsigned int TelemetryIntervalMs;
+    THREAD_HANDLE TelemetryThread;
+} BRIDGE_METRICS, *PBRIDGE_METRICS;
+
+// Telemetry message handed to the IoT Hub client and not confirmed yet
+typedef struct _BRIDGE_METRICS_MESSAGE {
+    PBRIDGE_METRICS Metrics;
+    uint64_t SendTime;
+    char ComponentName[1];
+} BRIDGE_METRICS_MESSAGE, *PBRIDGE_METRICS_MESSAGE;
+
+static uint64_t BridgeMetrics_GetTime(
+    PBRIDGE_METRICS Metrics)
+{
+    tickcounter_ms_t now = 0;
+    (void)tickcounter_get_current_ms(Metrics->Clock, &now);
+    return (uint64_t)now;
+}
+
+static bool BridgeMetrics_IsStopping(
+    PBRIDGE_METRICS Metrics)
+{
+    Lock(Metrics->Lock);
+    bool stop = Metrics->Stop;
+    Unlock(Metrics->Lock);
+    return stop;
+}
+
+static char* BridgeMetrics_FormatText(
+    PBRIDGE_METRICS Metrics)
+{
+    Lock(Metrics->Lock);
+    char* text = PnP_Metrics_FormatText(Metrics->Registry);
+    Unlock(Metrics->Lock);
+    return text;
+}
+
+#ifndef WIN32
+
+static bool BridgeMetrics_SendAll(
+    int Socket,
+    const char* Data,
+    size_t Size)
+{
+    while (Size > 0)
+    {
+        ssize_t sent = send(Socket, Data, Size, MSG_NOSIGNAL);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        Data += sent;
+        Size -= (size_t)sent;
+    }
+    return true;
+}
+
+// Answers one HTTP request with the metrics. Clients that send no request, e.g. "socat - UNIX-CONNECT:<path>",
+// get the metrics once the request timeout has passed.
+static void BridgeMetrics_ServeClient(
+    PBRIDGE_METRICS Metrics,
+    int ClientSocket)
+{
+    char request[BRIDGE_METRICS_MAX_REQUEST_SIZE + 1];
+    size_t requestSize = 0;
+    struct timeval timeout = { BRIDGE_METRICS_REQUEST_TIMEOUT_MS / 1000, (BRIDGE_METRICS_REQUEST_TIMEOUT_MS % 1000) * 1000 };
+
+    (void)setsockopt(ClientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    while (requestSize < BRIDGE_METRICS_MAX_REQUEST_SIZE)
+    {
+        ssize_t received = recv(ClientSocket, request + requestSize, BRIDGE_METRICS_MAX_REQUEST_SIZE - requestSize, 0);
+        if (received <= 0)
+        {
+            break;
+        }
+        requestSize += (size_t)received;
+        request[requestSize] = '\0';
+        if (NULL != strstr(request, "\r\n\r\n"))
+        {
+            break;
+        }
+    }
+    request[requestSize] = '\0';
+
+    if ((requestSize > 0) && (0 != strncmp(request, "GET ", 4)))
+    {
+        static const char notAllowed[] = "HTTP/1.0 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        (void)BridgeMetrics_SendAll(ClientSocket, notAllowed, sizeof(notAllowed) - 1);
+        return;
+    }
+
+    char* text = BridgeMetrics_FormatText(Metrics);
+    if (NULL == text)
+    {
+        static const char unavailable[] = "HTTP/1.0 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        (void)BridgeMetrics_SendAll(ClientSocket, unavailable, sizeof(unavailable) - 1);
+        return;
+    }
+
+    char header[160];
+    size_t textSize = strlen(text);
+    int headerSize = snprintf(header, sizeof(header),
+        "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+        (unsigned long)textSize);
+
+    if (requestSize > 0)
+    {
+        (void)(BridgeMetrics_SendAll(ClientSocket, header, (size_t)headerSize) &&
+            BridgeMetrics_SendAll(ClientSocket, text, textSize));
+    }
+    else
+    {
+        (void)BridgeMetrics_SendAll(ClientSocket, text, textSize);
+    }
+    free(text);
+}
+
+static int BridgeMetrics_EndpointThread(
+    void* context)
+{
+    PBRIDGE_METRICS metrics = (PBRIDGE_METRICS)context;
+
+    // Requests are rare and small, they are answered one at a time
+    while (!BridgeMetrics_IsStopping(metrics))
+    {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(metrics->EndpointSocket, &readSet);
+        struct timeval timeout = { 0, BRIDGE_METRICS_ENDPOINT_POLL_MS * 1000 };
+
+        if (select(metrics->EndpointSocket + 1, &readSet, NULL, NULL, &timeout) <= 0)
+        {
+            continue;
+        }
+
+        int clientSocket = accept(metrics->EndpointSocket, NULL, NULL);
+        if (clientSocket >= 0)
+        {
+            BridgeMetrics_ServeClient(metrics, clientSocket);
+            close(clientSocket);
+        }
+    }
+
+    return 0;
+}
+
+static bool BridgeMetrics_OpenEndpoint(
+    PBRIDGE_METRICS Metrics)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (strlen(Metrics->EndpointPath) >= sizeof(address.sun_path))
+    {
+        LogError("Bridge metrics: Endpoint path %s is too long", Metrics->EndpointPath);
+        return false;
+    }
+    strcpy(address.sun_path, Metrics->EndpointPath);
+
+    // A socket left behind by a previous run would make bind fail
+    (void)unlink(Metrics->EndpointPath);
+
+    if (((Metrics->EndpointSocket = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) ||
+        (bind(Metrics->EndpointSocket, (struct sockaddr*)&address, sizeof(address)) != 0) ||
+        (listen(Metrics->EndpointSocket, 4) != 0))
+    {
+        LogError("Bridge metrics: Could not listen on %s", Metrics->EndpointPath);
+        return false;
+    }
+
+    if (ThreadAPI_Create(&Metrics->EndpointThread, BridgeMetrics_EndpointThread, Metrics) != THREADAPI_OK)
+    {
+        LogError("Bridge metrics: Could not start endpoint thread");
+        Metrics->EndpointThread = NULL;
+        return false;
+    }
+
+    LogInfo("Bridge metrics: Serving metrics on %s", Metrics->EndpointPath);
+    return true;
+}
+
+static void BridgeMetrics_CloseEndpoint(
+    PBRIDGE_METRICS Metrics)
+{
+    if (Metrics->EndpointSocket >= 0)
+    {
+        close(Metrics->EndpointSocket);
+        Metrics->EndpointSocket = -1;
+        (void)unlink(Metrics->EndpointPath);
+    }
+}
+
+#else
+
+static bool BridgeMetrics_OpenEndpoint(
+    PBRIDGE_METRICS Metrics)
+{
+    LogError("Bridge metrics: The metrics endpoint %s is not supported on Windows", Metrics->EndpointPath);
+    return false;
+}
+
+static void BridgeMetrics_CloseEndpoint(
+    PBRIDGE_METRICS Metrics)
+{
+    AZURE_UNREFERENCED_PARAMETER(Metrics);
+}
+
+#endif
+
+static void BridgeMetrics_SendTelemetry(
+    const char* MetricsJson)
+{
+    // Metrics are a snapshot, there is no point in keeping them while disconnected
+    if ((NULL == g_PnpBridge) || !g_PnpBridge->IotHandle.ClientHandleInitialized || !g_PnpBridge->IotHandle.Connected)
+    {
+        return;
+    }
+
+    size_t messageSize = strlen(MetricsJson) + sizeof(BridgeMetrics_TelemetryName) + 8;
+    char* message = malloc(messageSize);
+    if (NULL == message)
+    {
+        LogError("Bridge metrics: Could not allocate metrics telemetry");
+        return;
+    }
+
+    (void)snprintf(message, messageSize, "{\"%s\":%s}", BridgeMetrics_TelemetryName, MetricsJson);
+    (void)TelemetryPipeline_SendMessage(g_PnpBridge->IotHandle.u1.IotModule.moduleHandle, NULL, message);
+    free(message);
+}
+
+static int BridgeMetrics_TelemetryThread(
+    void* context)
+{
+    PBRIDGE_METRICS metrics = (PBRIDGE_METRICS)context;
+
+    Lock(metrics->Lock);
+    while (!metrics->Stop)
+    {
+        Condition_Wait(metrics->Condition, metrics->Lock, (int)metrics->TelemetryIntervalMs);
+        if (metrics->Stop)
+        {
+            break;
+        }
+
+        char* json = PnP_Metrics_FormatJson(metrics->Registry);
+        Unlock(metrics->Lock);
+
+        if (NULL != json)
+        {
+            BridgeMetrics_SendTelemetry(json);
+            free(json);
+        }
+
+        Lock(metrics->Lock);
+    }
+    Unlock(metrics->Lock);
+
+    return 0;
+}
+
+BRIDGE_METRICS_HANDLE BridgeMetrics_Create(
+    const char* EndpointPath,
+    unsigned int TelemetryIntervalMs)
+{
+    PBRIDGE_METRICS metrics = calloc(1, sizeof(BRIDGE_METRICS));
+    if (NULL == metrics)
+    {
+        LogError("Bridge metrics: Could not allocate metrics");
+        return NULL;
+    }
+
+    metrics->EndpointSocket = -1;
+    metrics->TelemetryIntervalMs = TelemetryIntervalMs;
+
+    if (((metrics->Registry = PnP_Metrics_Create()) == NULL) ||
+        ((metrics->Lock = Lock_Init()) == NULL) ||
+        ((metrics->Condition = Condition_Init()) == NULL) ||
+        ((metrics->Clock = tickcounter_create()) == NULL) ||
+        ((NULL != EndpointPath) && (mallocAndStrcpy_s(&metrics->EndpointPath, EndpointPath) != 0)))
+    {
+        LogError("Bridge metrics: Could not initialize metrics");
+        goto exit;
+    }
+
+    if ((NULL != metrics->EndpointPath) && !BridgeMetrics_OpenEndpoint(metrics))
+    {
+        goto exit;
+    }
+
+    if (TelemetryIntervalMs > 0)
+    {
+        if (ThreadAPI_Create(&metrics->TelemetryThread, BridgeMetrics_TelemetryThread, metrics) != THREADAPI_OK)
+        {
+            LogError("Bridge metrics: Could not start telemetry thread");
+            metrics->TelemetryThread = NULL;
+            goto exit;
+        }
+        LogInfo("Bridge metrics: Sending metrics telemetry every %u ms", TelemetryIntervalMs);
+    }
+
+    return metrics;
+
+exit:
+    BridgeMetrics_Destroy(metrics);
+    return NULL;
+}
+
+void BridgeMetrics_Stop(
+    BRIDGE_METRICS_HANDLE Metrics)
+{
+    PBRIDGE_METRICS metrics = (PBRIDGE_METRICS)Metrics;
+
+    if ((NULL == metrics) || (NULL == metrics->Lock))
+    {
+        return;
+    }
+
+    Lock(metrics->Lock);
+    metrics->Stop = true;
+    Condition_Post(metrics->Condition);
+    Unlock(metrics->Lock);
+
+    int threadResult = 0;
+    if (NULL != metrics->EndpointThread)
+    {
+        ThreadAPI_Join(metrics->EndpointThread, &threadResult);
+        metrics->EndpointThread = NULL;
+    }
+    if (NULL != metrics->TelemetryThread)
+    {
+        ThreadAPI_Join(metrics->TelemetryThread, &threadResult);
+        metrics->TelemetryThread = NULL;
+    }
+
+    BridgeMetrics_CloseEndpoint(metrics);
+}
+
+void BridgeMetrics_Destroy(
+    BRIDGE_METRICS_HANDLE Metrics)
+{
+    PBRIDGE_METRICS metrics = (PBRIDGE_METRICS)Metrics;
+
+    if (NULL == metrics)
+    {
+        return;
+    }
+
+    BridgeMetrics_Stop(metrics);
+
+    PnP_Metrics_Destroy(metrics->Registry);
+    if (NULL != metrics->Condition)
+    {
+        Condition_Deinit(metrics->Condition);
+    }
+    if (NULL != metrics->Lock)
+    {
+        Lock_Deinit(metrics->Lock);
+    }
+    if (NULL != metrics->Clock)
+    {
+        tickcounter_destroy(metrics->Clock);
+    }
+    free(metrics->EndpointPath);
+    free(metrics);
+}
+
+void BridgeMetrics_AddCounter(
+    BRIDGE_METRICS_HANDLE Metrics,
+    const char* ComponentName,
+    const char* MetricName,
+    uint64_t Delta)
+{
+    PBRIDGE_METRICS metrics = (PBRIDGE_METRICS)Metrics;
+
+    Lock(metrics->Lock);
+    (void)PnP_Metrics_AddCounter(metrics->Registry, ComponentName, MetricName, Delta);
+    Unlock(metrics->Lock);
+}
+
+void BridgeMetrics_AddGauge(
+    BRIDGE_METRICS_HANDLE Metrics,
+    const char* ComponentName,
+    const char* MetricName,
+    int64_t Delta)
+{
+    PBRIDGE_METRICS metrics = (PBRIDGE_METRICS)Metrics;
+
+    Lock(metrics->Lock);
+    (void)PnP_Metrics_AddGauge(metrics->Registry, ComponentName, MetricName, Delta);
+    Unlock(metrics->Lock);
+}
+
+void BridgeMetrics_SetGauge(
+    BRIDGE_METRICS_HANDLE Metrics,
+    const char* ComponentName,
+    const char* MetricName,
+    int64_t Value)
+{
+    PBRIDGE_METRICS metrics = (PBRIDGE_METRICS)Metrics;
+
+    Lock(metrics->Lock);
+    (void)PnP_Metrics_SetGauge(metrics->Registry, ComponentName, MetricName, Value);
+    Unlock(metrics->Lock);
+}
+
+void BridgeMetrics_ObserveDuration(
+    BRIDGE_METRICS_HANDLE Metrics,
+    const char* ComponentName,
+    const char* MetricName,
+    uint32_t DurationMs)
+{
+    PBRIDGE_METRICS metrics = (PBRIDGE_METRICS)Metrics;
+
+    Lock(metrics->Lock);
+    (void)PnP_Metrics_Observe(metrics->Registry, ComponentName, MetricName, DurationMs);
+    Unlock(metrics->Lock);
+}
+
+void* BridgeMetrics_TrackMessage(
+    BRIDGE_METRICS_HANDLE Metrics,
+    const char* ComponentName)
+{
+    PBRIDGE_METRICS metrics = (PBRIDGE_METRICS)Metrics;
+
+    if (NULL == metrics)
+    {
+        return NULL;
+    }
+
+    size_t nameSize = (NULL != ComponentName) ? strlen(ComponentName) : 0;
+    PBRIDGE_METRICS_MESSAGE message = malloc(sizeof(BRIDGE_METRICS_MESSAGE) + nameSize);
+    if (NULL == message)
+    {
+        LogError("Bridge metrics: Could not allocate message tracking");
+        return NULL;
+    }
+
+    message->Metrics = metrics;
+    message->SendTime = BridgeMetrics_GetTime(metrics);
+    memcpy(message->ComponentName, (NULL != ComponentName) ? ComponentName : "", nameSize + 1);
+
+    Lock(metrics->Lock);
+    (void)PnP_Metrics_AddCounter(metrics->Registry, ComponentName, PNP_METRIC_MESSAGES_SENT, 1);
+    (void)PnP_Metrics_AddGauge(metrics->Registry, ComponentName, PNP_METRIC_MESSAGES_IN_FLIGHT, 1);
+    Unlock(metrics->Lock);
+
+    return message;
+}
+
+void BridgeMetrics_CompleteMessage(
+    void* Tracking,
+    bool Confirmed)
+{
+    PBRIDGE_METRICS_MESSAGE message = (PBRIDGE_METRICS_MESSAGE)Tracking;
+
+    if (NULL == message)
+    {
+        return;
+    }
+
+    PBRIDGE_METRICS metrics = message->Metrics;
+    const char* componentName = ('\0' != message->ComponentName[0]) ? message->ComponentName : NULL;
+    uint64_t latency = BridgeMetrics_GetTime(metrics) - message->SendTime;
+
+    Lock(metrics->Lock);
+    (void)PnP_Metrics_AddGauge(metrics->Registry, componentName, PNP_METRIC_MESSAGES_IN_FLIGHT, -1);
+    if (Confirmed)
+    {
+        (void)PnP_Metrics_AddCounter(metrics->Registry, componentName, PNP_METRIC_MESSAGES_CONFIRMED, 1);
+        (void)PnP_Metrics_Observe(metrics->Registry, componentName, PNP_METRIC_CONFIRMATION_LATENCY,
+            (latency > UINT32_MAX) ? UINT32_MAX : (uint32_t)latency);
+    }
+    else
+    {
+        (void)PnP_Metrics_AddCounter(metrics->Registry, componentName, PNP_METRIC_MESSAGES_FAILED, 1);
+    }
+    Unlock(metrics->Lock);
+
+    free(message);
+}
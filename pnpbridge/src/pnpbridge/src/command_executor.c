@@ -0,0 +1,589 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "pnpbridge_common.h"
+
+#include "command_executor.h"
+
+#include "azure_c_shared_utility/tickcounter.h"
+
+static const char CommandExecutor_EmptyResponse[] = "{}";
+static const char CommandExecutor_TimeoutResponse[] = "\"Command timed out\"";
+static const char CommandExecutor_ErrorResponse[] = "\"Command could not be run\"";
+
+// Answer of a command run by CommandExecutor_Run, filled in under the executor lock
+typedef struct _COMMAND_EXECUTOR_WAITER {
+    COND_HANDLE Answered;
+    bool IsAnswered;
+    int Status;
+    unsigned char* Response;
+    size_t ResponseSize;
+} COMMAND_EXECUTOR_WAITER, *PCOMMAND_EXECUTOR_WAITER;
+
+// A command received from IoT Hub that has not completed yet. It is answered through the client handle, or
+// through Waiter when the caller waits for the answer.
+typedef struct _COMMAND_EXECUTOR_COMMAND {
+    IOTHUB_CLIENT_CORE_HANDLE ClientHandle;
+    METHOD_HANDLE MethodId;
+    PCOMMAND_EXECUTOR_WAITER Waiter;
+    PPNPADAPTER_COMPONENT_TAG Component;
+    char* CommandName;
+    JSON_Value* CommandValue;
+    uint64_t Deadline;
+
+    // Item of the command in the executor's Outstanding list, NULL once the command has been answered
+    LIST_ITEM_HANDLE OutstandingItem;
+} COMMAND_EXECUTOR_COMMAND, *PCOMMAND_EXECUTOR_COMMAND;
+
+// Commands of one component, run in order by the component's worker thread
+typedef struct _COMMAND_EXECUTOR_COMPONENT {
+    char* ComponentName;
+    struct _COMMAND_EXECUTOR* Executor;
+
+    // List of PCOMMAND_EXECUTOR_COMMAND waiting for the worker thread
+    SINGLYLINKEDLIST_HANDLE Commands;
+    COND_HANDLE Condition;
+    THREAD_HANDLE WorkerThread;
+} COMMAND_EXECUTOR_COMPONENT, *PCOMMAND_EXECUTOR_COMPONENT;
+
+typedef struct _COMMAND_EXECUTOR {
+    unsigned int TimeoutMs;
+
+    // List of PCOMMAND_EXECUTOR_COMPONENT, indexed by component name in ComponentIndex
+    SINGLYLINKEDLIST_HANDLE Components;
+    PNP_COMPONENT_INDEX_HANDLE ComponentIndex;
+
+    // Commands that have not been answered, in order of their deadline since all commands have the same timeout
+    SINGLYLINKEDLIST_HANDLE Outstanding;
+
+    // Lock protects the components, their commands and Outstanding; TimeoutCondition wakes the timeout thread
+    // when a command becomes outstanding or the executor is stopping
+    LOCK_HANDLE Lock;
+    COND_HANDLE TimeoutCondition;
+    THREAD_HANDLE TimeoutThread;
+    TICK_COUNTER_HANDLE Clock;
+    bool Stop;
+} COMMAND_EXECUTOR, *PCOMMAND_EXECUTOR;
+
+IOTHUB_CLIENT_RESULT CommandExecutor_SendResponse(
+    IOTHUB_CLIENT_CORE_HANDLE ClientHandle,
+    METHOD_HANDLE MethodId,
+    int Status,
+    const unsigned char* Response,
+    size_t ResponseSize)
+{
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+
+    if ((NULL == Response) || (0 == ResponseSize))
+    {
+        Response = (const unsigned char*)CommandExecutor_EmptyResponse;
+        ResponseSize = sizeof(CommandExecutor_EmptyResponse) - 1;
+    }
+
+    if ((result = IoTHubClientCore_DeviceMethodResponse(ClientHandle, MethodId, Response, ResponseSize, Status)) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Command executor: Unable to send command response, error=%d", result);
+    }
+
+    return result;
+}
+
+// Answers a command, called without the executor lock held. A waiter stays valid until it is answered, so it
+// may be used here even though the command itself may already have been freed.
+static void CommandExecutor_Answer(
+    PCOMMAND_EXECUTOR Executor,
+    IOTHUB_CLIENT_CORE_HANDLE ClientHandle,
+    METHOD_HANDLE MethodId,
+    PCOMMAND_EXECUTOR_WAITER Waiter,
+    int Status,
+    const unsigned char* Response,
+    size_t ResponseSize)
+{
+    if (NULL == Waiter)
+    {
+        (void)CommandExecutor_SendResponse(ClientHandle, MethodId, Status, Response, ResponseSize);
+        return;
+    }
+
+    // The IoT Hub client frees the response of a synchronous method callback, so the waiter gets its own copy
+    unsigned char* response = NULL;
+    if ((NULL != Response) && (0 != ResponseSize))
+    {
+        if ((response = malloc(ResponseSize)) == NULL)
+        {
+            LogError("Command executor: Could not allocate command response");
+            Status = PNP_STATUS_INTERNAL_ERROR;
+            ResponseSize = 0;
+        }
+        else
+        {
+            memcpy(response, Response, ResponseSize);
+        }
+    }
+    else
+    {
+        ResponseSize = 0;
+    }
+
+    Lock(Executor->Lock);
+    Waiter->Status = Status;
+    Waiter->Response = response;
+    Waiter->ResponseSize = ResponseSize;
+    Waiter->IsAnswered = true;
+    Condition_Post(Waiter->Answered);
+    Unlock(Executor->Lock);
+}
+
+static uint64_t CommandExecutor_GetTime(
+    PCOMMAND_EXECUTOR Executor)
+{
+    tickcounter_ms_t now = 0;
+    (void)tickcounter_get_current_ms(Executor->Clock, &now);
+    return (uint64_t)now;
+}
+
+static void CommandExecutor_FreeCommand(
+    PCOMMAND_EXECUTOR_COMMAND Command)
+{
+    json_value_free(Command->CommandValue);
+    free(Command->CommandName);
+    free(Command);
+}
+
+// Takes the command out of Outstanding. Returns true if the caller is the one to answer it. Called with the
+// executor lock held.
+static bool CommandExecutor_TakeOutstanding(
+    PCOMMAND_EXECUTOR Executor,
+    PCOMMAND_EXECUTOR_COMMAND Command)
+{
+    if (NULL == Command->OutstandingItem)
+    {
+        return false;
+    }
+
+    singlylinkedlist_remove(Executor->Outstanding, Command->OutstandingItem);
+    Command->OutstandingItem = NULL;
+    return true;
+}
+
+// Runs the commands of one component in the order they arrived
+static int CommandExecutor_WorkerThread(
+    void* context)
+{
+    PCOMMAND_EXECUTOR_COMPONENT component = (PCOMMAND_EXECUTOR_COMPONENT)context;
+    PCOMMAND_EXECUTOR executor = component->Executor;
+
+    Lock(executor->Lock);
+    while (true)
+    {
+        LIST_ITEM_HANDLE commandItem = singlylinkedlist_get_head_item(component->Commands);
+        if (NULL == commandItem)
+        {
+            if (executor->Stop)
+            {
+                break;
+            }
+            Condition_Wait(component->Condition, executor->Lock, 0);
+            continue;
+        }
+
+        PCOMMAND_EXECUTOR_COMMAND command = (PCOMMAND_EXECUTOR_COMMAND)singlylinkedlist_item_get_value(commandItem);
+        singlylinkedlist_remove(component->Commands, commandItem);
+
+        if (NULL == command->OutstandingItem)
+        {
+            // Timed out while waiting for an earlier command of the component
+            CommandExecutor_FreeCommand(command);
+            continue;
+        }
+
+        if (executor->Stop)
+        {
+            (void)CommandExecutor_TakeOutstanding(executor, command);
+            Unlock(executor->Lock);
+            PnpBridgeMetrics_AddCounter(component->ComponentName, PNP_METRIC_COMMANDS_FAILED, 1);
+            CommandExecutor_Answer(executor, command->ClientHandle, command->MethodId, command->Waiter, PNP_STATUS_INTERNAL_ERROR,
+                (const unsigned char*)CommandExecutor_ErrorResponse, sizeof(CommandExecutor_ErrorResponse) - 1);
+            CommandExecutor_FreeCommand(command);
+            Lock(executor->Lock);
+            continue;
+        }
+        Unlock(executor->Lock);
+
+        unsigned char* response = NULL;
+        size_t responseSize = 0;
+        int status = command->Component->processCommand(command->Component, command->CommandName, command->CommandValue,
+            &response, &responseSize);
+
+        // Latency counts from the arrival of the command, including the time it waited for earlier commands
+        uint64_t latency = CommandExecutor_GetTime(executor) - (command->Deadline - executor->TimeoutMs);
+        PnpBridgeMetrics_ObserveDuration(component->ComponentName, PNP_METRIC_COMMAND_LATENCY,
+            (latency > UINT32_MAX) ? UINT32_MAX : (uint32_t)latency);
+
+        Lock(executor->Lock);
+        bool answer = CommandExecutor_TakeOutstanding(executor, command);
+        Unlock(executor->Lock);
+
+        if (answer)
+        {
+            if (status >= PNP_STATUS_BAD_FORMAT)
+            {
+                PnpBridgeMetrics_AddCounter(component->ComponentName, PNP_METRIC_COMMANDS_FAILED, 1);
+            }
+            CommandExecutor_Answer(executor, command->ClientHandle, command->MethodId, command->Waiter, status, response,
+                responseSize);
+        }
+        else
+        {
+            LogError("Command executor: Command %s of component %s completed after it timed out, dropping its response",
+                command->CommandName, component->ComponentName);
+        }
+
+        free(response);
+        CommandExecutor_FreeCommand(command);
+        Lock(executor->Lock);
+    }
+    Unlock(executor->Lock);
+
+    return 0;
+}
+
+// Answers commands that have not completed by their deadline. The adapter cannot be interrupted, so a running
+// command keeps its component's worker thread busy until it returns and its late result is dropped.
+static int CommandExecutor_TimeoutThread(
+    void* context)
+{
+    PCOMMAND_EXECUTOR executor = (PCOMMAND_EXECUTOR)context;
+
+    Lock(executor->Lock);
+    while (!executor->Stop)
+    {
+        int waitMs = 0;
+
+        LIST_ITEM_HANDLE commandItem = singlylinkedlist_get_head_item(executor->Outstanding);
+        if (NULL != commandItem)
+        {
+            PCOMMAND_EXECUTOR_COMMAND command = (PCOMMAND_EXECUTOR_COMMAND)singlylinkedlist_item_get_value(commandItem);
+            uint64_t now = CommandExecutor_GetTime(executor);
+            if (command->Deadline <= now)
+            {
+                // The worker thread frees the command once it is done with it, only use copies after unlocking
+                IOTHUB_CLIENT_CORE_HANDLE clientHandle = command->ClientHandle;
+                METHOD_HANDLE methodId = command->MethodId;
+                PCOMMAND_EXECUTOR_WAITER waiter = command->Waiter;
+
+                LogError("Command executor: Command %s of component %s timed out after %u ms", command->CommandName,
+                    command->Component->componentName, executor->TimeoutMs);
+                (void)CommandExecutor_TakeOutstanding(executor, command);
+                PnpBridgeMetrics_AddCounter(command->Component->componentName, PNP_METRIC_COMMANDS_FAILED, 1);
+
+                Unlock(executor->Lock);
+                CommandExecutor_Answer(executor, clientHandle, methodId, waiter, PNP_STATUS_TIMEOUT,
+                    (const unsigned char*)CommandExecutor_TimeoutResponse, sizeof(CommandExecutor_TimeoutResponse) - 1);
+                Lock(executor->Lock);
+                continue;
+            }
+            waitMs = (int)(command->Deadline - now);
+        }
+
+        // A wait of 0 blocks until a command arrives
+        Condition_Wait(executor->TimeoutCondition, executor->Lock, waitMs);
+    }
+    Unlock(executor->Lock);
+
+    return 0;
+}
+
+// Finds the component's command queue, creating it and starting its worker thread on its first command.
+// Called with the executor lock held.
+static PCOMMAND_EXECUTOR_COMPONENT CommandExecutor_GetComponent(
+    PCOMMAND_EXECUTOR Executor,
+    const char* ComponentName)
+{
+    PCOMMAND_EXECUTOR_COMPONENT component = PnP_ComponentIndex_Find(Executor->ComponentIndex, ComponentName, strlen(ComponentName));
+    if (NULL == component)
+    {
+        component = calloc(1, sizeof(COMMAND_EXECUTOR_COMPONENT));
+        if (NULL == component)
+        {
+            LogError("Command executor: Could not allocate component %s", ComponentName);
+            return NULL;
+        }
+
+        LIST_ITEM_HANDLE componentItem = NULL;
+        component->Executor = Executor;
+        if ((mallocAndStrcpy_s(&component->ComponentName, ComponentName) != 0) ||
+            ((component->Commands = singlylinkedlist_create()) == NULL) ||
+            ((component->Condition = Condition_Init()) == NULL) ||
+            ((componentItem = singlylinkedlist_add(Executor->Components, component)) == NULL))
+        {
+            LogError("Command executor: Could not create a command queue for component %s", ComponentName);
+            goto exit;
+        }
+
+        if (!PnP_ComponentIndex_Add(Executor->ComponentIndex, component->ComponentName, component))
+        {
+            LogError("Command executor: Could not index component %s", ComponentName);
+            singlylinkedlist_remove(Executor->Components, componentItem);
+            goto exit;
+        }
+    }
+
+    // A worker thread that could not be started is retried on the component's next command
+    if ((NULL == component->WorkerThread) &&
+        (ThreadAPI_Create(&component->WorkerThread, CommandExecutor_WorkerThread, component) != THREADAPI_OK))
+    {
+        LogError("Command executor: Could not start worker thread for component %s", ComponentName);
+        component->WorkerThread = NULL;
+        return NULL;
+    }
+
+    return component;
+
+exit:
+    if (NULL != component->Condition)
+    {
+        Condition_Deinit(component->Condition);
+    }
+    if (NULL != component->Commands)
+    {
+        singlylinkedlist_destroy(component->Commands);
+    }
+    free(component->ComponentName);
+    free(component);
+    return NULL;
+}
+
+COMMAND_EXECUTOR_HANDLE CommandExecutor_Create(
+    unsigned int TimeoutMs)
+{
+    PCOMMAND_EXECUTOR executor = calloc(1, sizeof(COMMAND_EXECUTOR));
+    if (NULL == executor)
+    {
+        LogError("Command executor: Could not allocate executor");
+        return NULL;
+    }
+
+    executor->TimeoutMs = TimeoutMs;
+
+    if (((executor->Components = singlylinkedlist_create()) == NULL) ||
+        ((executor->ComponentIndex = PnP_ComponentIndex_Create(0)) == NULL) ||
+        ((executor->Outstanding = singlylinkedlist_create()) == NULL) ||
+        ((executor->Lock = Lock_Init()) == NULL) ||
+        ((executor->TimeoutCondition = Condition_Init()) == NULL) ||
+        ((executor->Clock = tickcounter_create()) == NULL))
+    {
+        LogError("Command executor: Could not initialize executor");
+        goto exit;
+    }
+
+    if (ThreadAPI_Create(&executor->TimeoutThread, CommandExecutor_TimeoutThread, executor) != THREADAPI_OK)
+    {
+        LogError("Command executor: Could not start timeout thread");
+        executor->TimeoutThread = NULL;
+        goto exit;
+    }
+
+    LogInfo("Command executor: Commands time out after %u ms", TimeoutMs);
+    return executor;
+
+exit:
+    CommandExecutor_Destroy(executor);
+    return NULL;
+}
+
+void CommandExecutor_Destroy(
+    COMMAND_EXECUTOR_HANDLE Executor)
+{
+    PCOMMAND_EXECUTOR executor = (PCOMMAND_EXECUTOR)Executor;
+
+    if (NULL == executor)
+    {
+        return;
+    }
+
+    if (NULL != executor->Lock)
+    {
+        Lock(executor->Lock);
+        executor->Stop = true;
+        if (NULL != executor->TimeoutCondition)
+        {
+            Condition_Post(executor->TimeoutCondition);
+        }
+        LIST_ITEM_HANDLE componentItem = (NULL != executor->Components) ? singlylinkedlist_get_head_item(executor->Components) : NULL;
+        while (NULL != componentItem)
+        {
+            PCOMMAND_EXECUTOR_COMPONENT component = (PCOMMAND_EXECUTOR_COMPONENT)singlylinkedlist_item_get_value(componentItem);
+            Condition_Post(component->Condition);
+            componentItem = singlylinkedlist_get_next_item(componentItem);
+        }
+        Unlock(executor->Lock);
+    }
+
+    int threadResult = 0;
+    if (NULL != executor->TimeoutThread)
+    {
+        ThreadAPI_Join(executor->TimeoutThread, &threadResult);
+    }
+
+    // Worker threads answer the commands they have not started yet and exit once their queue is empty
+    if (NULL != executor->Components)
+    {
+        LIST_ITEM_HANDLE componentItem = singlylinkedlist_get_head_item(executor->Components);
+        while (NULL != componentItem)
+        {
+            PCOMMAND_EXECUTOR_COMPONENT component = (PCOMMAND_EXECUTOR_COMPONENT)singlylinkedlist_item_get_value(componentItem);
+            if (NULL != component->WorkerThread)
+            {
+                ThreadAPI_Join(component->WorkerThread, &threadResult);
+            }
+            singlylinkedlist_destroy(component->Commands);
+            Condition_Deinit(component->Condition);
+            free(component->ComponentName);
+            free(component);
+            componentItem = singlylinkedlist_get_next_item(componentItem);
+        }
+        singlylinkedlist_destroy(executor->Components);
+    }
+
+    PnP_ComponentIndex_Destroy(executor->ComponentIndex);
+    if (NULL != executor->Outstanding)
+    {
+        singlylinkedlist_destroy(executor->Outstanding);
+    }
+    if (NULL != executor->TimeoutCondition)
+    {
+        Condition_Deinit(executor->TimeoutCondition);
+    }
+    if (NULL != executor->Lock)
+    {
+        Lock_Deinit(executor->Lock);
+    }
+    if (NULL != executor->Clock)
+    {
+        tickcounter_destroy(executor->Clock);
+    }
+    free(executor);
+}
+
+// Queues a command on its component's worker thread, or answers it with PNP_STATUS_INTERNAL_ERROR if it cannot
+// be queued
+static void CommandExecutor_Queue(
+    PCOMMAND_EXECUTOR Executor,
+    IOTHUB_CLIENT_CORE_HANDLE ClientHandle,
+    METHOD_HANDLE MethodId,
+    PCOMMAND_EXECUTOR_WAITER Waiter,
+    PNPBRIDGE_COMPONENT_HANDLE ComponentHandle,
+    const char* CommandName,
+    JSON_Value* CommandValue)
+{
+    PCOMMAND_EXECUTOR executor = Executor;
+    PPNPADAPTER_COMPONENT_TAG componentTag = (PPNPADAPTER_COMPONENT_TAG)ComponentHandle;
+    bool queued = false;
+
+    PCOMMAND_EXECUTOR_COMMAND command = calloc(1, sizeof(COMMAND_EXECUTOR_COMMAND));
+    if (NULL == command)
+    {
+        LogError("Command executor: Could not allocate command %s", CommandName);
+        json_value_free(CommandValue);
+        goto exit;
+    }
+
+    command->ClientHandle = ClientHandle;
+    command->MethodId = MethodId;
+    command->Waiter = Waiter;
+    command->Component = componentTag;
+    command->CommandValue = CommandValue;
+    if (mallocAndStrcpy_s(&command->CommandName, CommandName) != 0)
+    {
+        LogError("Command executor: Could not copy command name %s", CommandName);
+        goto exit;
+    }
+
+    Lock(executor->Lock);
+    if (!executor->Stop)
+    {
+        PCOMMAND_EXECUTOR_COMPONENT component = CommandExecutor_GetComponent(executor, componentTag->componentName);
+        if (NULL != component)
+        {
+            bool firstOutstanding = (NULL == singlylinkedlist_get_head_item(executor->Outstanding));
+            command->Deadline = CommandExecutor_GetTime(executor) + executor->TimeoutMs;
+            if ((command->OutstandingItem = singlylinkedlist_add(executor->Outstanding, command)) != NULL)
+            {
+                if (singlylinkedlist_add(component->Commands, command) != NULL)
+                {
+                    Condition_Post(component->Condition);
+                    if (firstOutstanding)
+                    {
+                        Condition_Post(executor->TimeoutCondition);
+                    }
+                    queued = true;
+                }
+                else
+                {
+                    (void)CommandExecutor_TakeOutstanding(executor, command);
+                }
+            }
+        }
+    }
+    Unlock(executor->Lock);
+
+exit:
+    if (!queued)
+    {
+        LogError("Command executor: Could not queue command %s of component %s", CommandName, componentTag->componentName);
+        CommandExecutor_Answer(executor, ClientHandle, MethodId, Waiter, PNP_STATUS_INTERNAL_ERROR,
+            (const unsigned char*)CommandExecutor_ErrorResponse, sizeof(CommandExecutor_ErrorResponse) - 1);
+        if (NULL != command)
+        {
+            CommandExecutor_FreeCommand(command);
+        }
+    }
+}
+
+void CommandExecutor_Submit(
+    COMMAND_EXECUTOR_HANDLE Executor,
+    IOTHUB_CLIENT_CORE_HANDLE ClientHandle,
+    METHOD_HANDLE MethodId,
+    PNPBRIDGE_COMPONENT_HANDLE ComponentHandle,
+    const char* CommandName,
+    JSON_Value* CommandValue)
+{
+    CommandExecutor_Queue((PCOMMAND_EXECUTOR)Executor, ClientHandle, MethodId, NULL, ComponentHandle, CommandName,
+        CommandValue);
+}
+
+int CommandExecutor_Run(
+    COMMAND_EXECUTOR_HANDLE Executor,
+    PNPBRIDGE_COMPONENT_HANDLE ComponentHandle,
+    const char* CommandName,
+    JSON_Value* CommandValue,
+    unsigned char** Response,
+    size_t* ResponseSize)
+{
+    PCOMMAND_EXECUTOR executor = (PCOMMAND_EXECUTOR)Executor;
+    COMMAND_EXECUTOR_WAITER waiter;
+
+    memset(&waiter, 0, sizeof(waiter));
+    if ((waiter.Answered = Condition_Init()) == NULL)
+    {
+        LogError("Command executor: Could not wait for command %s", CommandName);
+        json_value_free(CommandValue);
+        return PNP_STATUS_INTERNAL_ERROR;
+    }
+
+    CommandExecutor_Queue(executor, NULL, NULL, &waiter, ComponentHandle, CommandName, CommandValue);
+
+    // The timeout thread answers the command by its deadline if the component's adapter has not
+    Lock(executor->Lock);
+    while (!waiter.IsAnswered)
+    {
+        Condition_Wait(waiter.Answered, executor->Lock, 0);
+    }
+    Unlock(executor->Lock);
+
+    Condition_Deinit(waiter.Answered);
+    *Response = waiter.Response;
+    *ResponseSize = waiter.ResponseSize;
+    return waiter.Status;
+}
@@ -307,6 +307,41 @@ JSON_Array* Configuration_GetDevices(JSON_Value* config) {
     return devices;
 }
 
+JSON_Object* Configuration_GetTelemetryBatchingParameters(JSON_Value* config) {
+    JSON_Object* jsonObject = json_value_get_object(config);
+    JSON_Object* batchingParams = json_object_get_object(jsonObject, PNP_CONFIG_TELEMETRY_BATCHING);
+
+    return batchingParams;
+}
+
+JSON_Object* Configuration_GetReportedPropertyCacheParameters(JSON_Value* config) {
+    JSON_Object* jsonObject = json_value_get_object(config);
+    JSON_Object* cacheParams = json_object_get_object(jsonObject, PNP_CONFIG_REPORTED_PROPERTY_CACHE);
+
+    return cacheParams;
+}
+
+JSON_Object* Configuration_GetCommandExecutionParameters(JSON_Value* config) {
+    JSON_Object* jsonObject = json_value_get_object(config);
+    JSON_Object* executionParams = json_object_get_object(jsonObject, PNP_CONFIG_COMMAND_EXECUTION);
+
+    return executionParams;
+}
+
+JSON_Object* Configuration_GetStoreAndForwardParameters(JSON_Value* config) {
+    JSON_Object* jsonObject = json_value_get_object(config);
+    JSON_Object* storeParams = json_object_get_object(jsonObject, PNP_CONFIG_STORE_AND_FORWARD);
+
+    return storeParams;
+}
+
+JSON_Object* Configuration_GetMetricsParameters(JSON_Value* config) {
+    JSON_Object* jsonObject = json_value_get_object(config);
+    JSON_Object* metricsParams = json_object_get_object(jsonObject, PNP_CONFIG_METRICS);
+
+    return metricsParams;
+}
+
 JSON_Object* Configuration_GetPnpParametersForDevice(JSON_Object* device) {
 
     if (device == NULL) {
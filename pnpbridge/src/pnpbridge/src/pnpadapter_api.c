@@ -5,6 +5,8 @@
 #include "pnpadapter_api.h"
 #include "pnpadapter_manager.h"
 
+extern PPNP_BRIDGE g_PnpBridge;
+
 void PnpAdapterHandleSetContext(PNPBRIDGE_ADAPTER_HANDLE AdapterHandle, void* AdapterContext)
 {
     PPNP_ADAPTER_CONTEXT_TAG adapterContextTag = (PPNP_ADAPTER_CONTEXT_TAG) AdapterHandle;
@@ -54,4 +56,56 @@ PNP_BRIDGE_IOT_TYPE PnpComponentHandleGetIoTType(PNPBRIDGE_COMPONENT_HANDLE Comp
 {
     PPNPADAPTER_COMPONENT_TAG componentContextTag = (PPNPADAPTER_COMPONENT_TAG)ComponentHandle;
     return componentContextTag->clientType;
-}
\ No newline at end of file
+}
+
+IOTHUB_CLIENT_RESULT PnpBridgeClient_SendTelemetry(PNP_BRIDGE_CLIENT_HANDLE ClientHandle, const char* ComponentName,
+    const char* TelemetryData)
+{
+    if ((NULL != g_PnpBridge) && (NULL != g_PnpBridge->PnpMgr) && (NULL != g_PnpBridge->PnpMgr->TelemetryPipeline))
+    {
+        return TelemetryPipeline_Submit(g_PnpBridge->PnpMgr->TelemetryPipeline, ClientHandle, ComponentName, TelemetryData);
+    }
+
+    if ((NULL != g_PnpBridge) && (NULL != g_PnpBridge->PnpMgr) && (NULL != g_PnpBridge->PnpMgr->StoreAndForward))
+    {
+        return StoreAndForward_Submit(g_PnpBridge->PnpMgr->StoreAndForward, ClientHandle, ComponentName, TelemetryData);
+    }
+
+    return TelemetryPipeline_SendMessage(ClientHandle, ComponentName, TelemetryData);
+}
+
+IOTHUB_CLIENT_RESULT PnpBridgeClient_ReportProperty(PNP_BRIDGE_CLIENT_HANDLE ClientHandle, const char* ComponentName,
+    const char* PropertyName, const char* PropertyValue)
+{
+    if ((NULL != g_PnpBridge) && (NULL != g_PnpBridge->PnpMgr) && (NULL != g_PnpBridge->PnpMgr->ReportedPropertyPipeline))
+    {
+        return ReportedPropertyPipeline_Submit(g_PnpBridge->PnpMgr->ReportedPropertyPipeline, ClientHandle, ComponentName,
+            PropertyName, PropertyValue);
+    }
+
+    return ReportedPropertyPipeline_SendReportedProperty(ClientHandle, ComponentName, PropertyName, PropertyValue);
+}
+
+void PnpBridgeMetrics_AddCounter(const char* ComponentName, const char* MetricName, uint64_t Delta)
+{
+    if ((NULL != g_PnpBridge) && (NULL != g_PnpBridge->PnpMgr) && (NULL != g_PnpBridge->PnpMgr->Metrics))
+    {
+        BridgeMetrics_AddCounter(g_PnpBridge->PnpMgr->Metrics, ComponentName, MetricName, Delta);
+    }
+}
+
+void PnpBridgeMetrics_SetGauge(const char* ComponentName, const char* MetricName, int64_t Value)
+{
+    if ((NULL != g_PnpBridge) && (NULL != g_PnpBridge->PnpMgr) && (NULL != g_PnpBridge->PnpMgr->Metrics))
+    {
+        BridgeMetrics_SetGauge(g_PnpBridge->PnpMgr->Metrics, ComponentName, MetricName, Value);
+    }
+}
+
+void PnpBridgeMetrics_ObserveDuration(const char* ComponentName, const char* MetricName, uint32_t DurationMs)
+{
+    if ((NULL != g_PnpBridge) && (NULL != g_PnpBridge->PnpMgr) && (NULL != g_PnpBridge->PnpMgr->Metrics))
+    {
+        BridgeMetrics_ObserveDuration(g_PnpBridge->PnpMgr->Metrics, ComponentName, MetricName, DurationMs);
+    }
+}
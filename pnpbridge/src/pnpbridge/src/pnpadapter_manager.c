@@ -101,6 +101,10 @@ IOTHUB_CLIENT_RESULT PnpAdapterManager_StopComponents(
     IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
     if (NULL != adapterMgr)
     {
+        // Let running commands complete before their components are stopped
+        CommandExecutor_Destroy(adapterMgr->CommandExecutor);
+        adapterMgr->CommandExecutor = NULL;
+
         LIST_ITEM_HANDLE adapterListItem = singlylinkedlist_get_head_item(adapterMgr->PnpAdapterHandleList);
 
         while (NULL != adapterListItem) {
@@ -120,6 +124,17 @@ IOTHUB_CLIENT_RESULT PnpAdapterManager_StopComponents(
             }
             adapterListItem = singlylinkedlist_get_next_item(adapterListItem);
         }
+
+        // Components no longer report telemetry, send what is still batched while the client handle is valid
+        TelemetryPipeline_Destroy(adapterMgr->TelemetryPipeline);
+        adapterMgr->TelemetryPipeline = NULL;
+        ReportedPropertyPipeline_Destroy(adapterMgr->ReportedPropertyPipeline);
+        adapterMgr->ReportedPropertyPipeline = NULL;
+        StoreAndForward_Destroy(adapterMgr->StoreAndForward);
+        adapterMgr->StoreAndForward = NULL;
+
+        // Metrics keep counting until the manager is released, only the endpoint and metrics telemetry stop here
+        BridgeMetrics_Stop(adapterMgr->Metrics);
     }
 
     return result;
@@ -250,6 +265,193 @@ bool PnpAdapterManager_AdapterCreated(
     return false;
 }
 
+IOTHUB_CLIENT_RESULT PnpAdapterManager_CreateMetrics(
+    PPNP_ADAPTER_MANAGER adapterMgr,
+    JSON_Value* config)
+{
+    JSON_Object* metricsParams = Configuration_GetMetricsParameters(config);
+    if (NULL == metricsParams)
+    {
+        return IOTHUB_CLIENT_OK;
+    }
+
+    const char* endpoint = json_object_get_string(metricsParams, PNP_CONFIG_METRICS_ENDPOINT);
+    double telemetryIntervalMs = 0;
+    if (json_object_has_value(metricsParams, PNP_CONFIG_METRICS_TELEMETRY_INTERVAL_MS))
+    {
+        telemetryIntervalMs = json_object_get_number(metricsParams, PNP_CONFIG_METRICS_TELEMETRY_INTERVAL_MS);
+    }
+
+    if (telemetryIntervalMs < 0)
+    {
+        LogError("%s must have a %s of at least 0", PNP_CONFIG_METRICS, PNP_CONFIG_METRICS_TELEMETRY_INTERVAL_MS);
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    adapterMgr->Metrics = BridgeMetrics_Create(endpoint, (unsigned int)telemetryIntervalMs);
+    if (NULL == adapterMgr->Metrics)
+    {
+        LogError("Failed to create the bridge metrics");
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT PnpAdapterManager_CreateStoreAndForward(
+    PPNP_ADAPTER_MANAGER adapterMgr,
+    JSON_Value* config)
+{
+    JSON_Object* storeParams = Configuration_GetStoreAndForwardParameters(config);
+    if (NULL == storeParams)
+    {
+        // Store and forward is opt-in, without it telemetry is only buffered in memory by the IoT Hub client
+        return IOTHUB_CLIENT_OK;
+    }
+
+    const char* path = json_object_get_string(storeParams, PNP_CONFIG_STORE_AND_FORWARD_PATH);
+    double segmentSize = PNP_STORE_AND_FORWARD_DEFAULT_SEGMENT_SIZE;
+    double maxSegments = PNP_STORE_AND_FORWARD_DEFAULT_MAX_SEGMENTS;
+    double replayRate = PNP_STORE_AND_FORWARD_DEFAULT_REPLAY_RATE;
+    if (json_object_has_value(storeParams, PNP_CONFIG_STORE_AND_FORWARD_SEGMENT_SIZE))
+    {
+        segmentSize = json_object_get_number(storeParams, PNP_CONFIG_STORE_AND_FORWARD_SEGMENT_SIZE);
+    }
+    if (json_object_has_value(storeParams, PNP_CONFIG_STORE_AND_FORWARD_MAX_SEGMENTS))
+    {
+        maxSegments = json_object_get_number(storeParams, PNP_CONFIG_STORE_AND_FORWARD_MAX_SEGMENTS);
+    }
+    if (json_object_has_value(storeParams, PNP_CONFIG_STORE_AND_FORWARD_REPLAY_RATE))
+    {
+        replayRate = json_object_get_number(storeParams, PNP_CONFIG_STORE_AND_FORWARD_REPLAY_RATE);
+    }
+
+    if (NULL == path || segmentSize < 1 || maxSegments < 2 || replayRate < 1)
+    {
+        LogError("%s must have a %s, a positive %s, a %s of at least 2 and a positive %s", PNP_CONFIG_STORE_AND_FORWARD,
+            PNP_CONFIG_STORE_AND_FORWARD_PATH, PNP_CONFIG_STORE_AND_FORWARD_SEGMENT_SIZE,
+            PNP_CONFIG_STORE_AND_FORWARD_MAX_SEGMENTS, PNP_CONFIG_STORE_AND_FORWARD_REPLAY_RATE);
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    adapterMgr->StoreAndForward = StoreAndForward_Create(path, (size_t)segmentSize, (size_t)maxSegments,
+        (unsigned int)replayRate);
+    if (NULL == adapterMgr->StoreAndForward)
+    {
+        LogError("Failed to create the store and forward telemetry queue");
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    // An edge module builds its components after it has connected
+    if ((NULL != g_PnpBridge) && g_PnpBridge->IotHandle.Connected)
+    {
+        StoreAndForward_SetConnected(adapterMgr->StoreAndForward, true);
+    }
+
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT PnpAdapterManager_CreateTelemetryPipeline(
+    PPNP_ADAPTER_MANAGER adapterMgr,
+    JSON_Value* config)
+{
+    JSON_Object* batchingParams = Configuration_GetTelemetryBatchingParameters(config);
+    if (NULL == batchingParams)
+    {
+        // Telemetry batching is opt-in, without it every reading is sent as its own message
+        return IOTHUB_CLIENT_OK;
+    }
+
+    double maxMessageSize = PNP_TELEMETRY_BATCHING_DEFAULT_MAX_MESSAGE_SIZE;
+    double maxLatencyMs = PNP_TELEMETRY_BATCHING_DEFAULT_MAX_LATENCY_MS;
+    if (json_object_has_value(batchingParams, PNP_CONFIG_TELEMETRY_BATCHING_MAX_MESSAGE_SIZE))
+    {
+        maxMessageSize = json_object_get_number(batchingParams, PNP_CONFIG_TELEMETRY_BATCHING_MAX_MESSAGE_SIZE);
+    }
+    if (json_object_has_value(batchingParams, PNP_CONFIG_TELEMETRY_BATCHING_MAX_LATENCY_MS))
+    {
+        maxLatencyMs = json_object_get_number(batchingParams, PNP_CONFIG_TELEMETRY_BATCHING_MAX_LATENCY_MS);
+    }
+
+    if (maxMessageSize < 1 || maxLatencyMs < 0)
+    {
+        LogError("%s must have a positive %s and a non-negative %s", PNP_CONFIG_TELEMETRY_BATCHING,
+            PNP_CONFIG_TELEMETRY_BATCHING_MAX_MESSAGE_SIZE, PNP_CONFIG_TELEMETRY_BATCHING_MAX_LATENCY_MS);
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    adapterMgr->TelemetryPipeline = TelemetryPipeline_Create((size_t)maxMessageSize, (unsigned int)maxLatencyMs,
+        adapterMgr->StoreAndForward);
+    if (NULL == adapterMgr->TelemetryPipeline)
+    {
+        LogError("Failed to create the telemetry pipeline");
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT PnpAdapterManager_CreateReportedPropertyPipeline(
+    PPNP_ADAPTER_MANAGER adapterMgr,
+    JSON_Value* config)
+{
+    JSON_Object* cacheParams = Configuration_GetReportedPropertyCacheParameters(config);
+    if (NULL == cacheParams)
+    {
+        // The reported property cache is opt-in, without it every property report is sent as its own patch
+        return IOTHUB_CLIENT_OK;
+    }
+
+    double flushIntervalMs = PNP_REPORTED_PROPERTY_CACHE_DEFAULT_FLUSH_INTERVAL_MS;
+    if (json_object_has_value(cacheParams, PNP_CONFIG_REPORTED_PROPERTY_CACHE_FLUSH_INTERVAL_MS))
+    {
+        flushIntervalMs = json_object_get_number(cacheParams, PNP_CONFIG_REPORTED_PROPERTY_CACHE_FLUSH_INTERVAL_MS);
+    }
+
+    if (flushIntervalMs < 0)
+    {
+        LogError("%s must have a non-negative %s", PNP_CONFIG_REPORTED_PROPERTY_CACHE,
+            PNP_CONFIG_REPORTED_PROPERTY_CACHE_FLUSH_INTERVAL_MS);
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    adapterMgr->ReportedPropertyPipeline = ReportedPropertyPipeline_Create((unsigned int)flushIntervalMs);
+    if (NULL == adapterMgr->ReportedPropertyPipeline)
+    {
+        LogError("Failed to create the reported property pipeline");
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT PnpAdapterManager_CreateCommandExecutor(
+    PPNP_ADAPTER_MANAGER adapterMgr,
+    JSON_Value* config)
+{
+    double timeoutMs = PNP_COMMAND_EXECUTION_DEFAULT_TIMEOUT_MS;
+    JSON_Object* executionParams = Configuration_GetCommandExecutionParameters(config);
+    if ((NULL != executionParams) && json_object_has_value(executionParams, PNP_CONFIG_COMMAND_EXECUTION_TIMEOUT_MS))
+    {
+        timeoutMs = json_object_get_number(executionParams, PNP_CONFIG_COMMAND_EXECUTION_TIMEOUT_MS);
+    }
+
+    if (timeoutMs < 1)
+    {
+        LogError("%s must have a positive %s", PNP_CONFIG_COMMAND_EXECUTION, PNP_CONFIG_COMMAND_EXECUTION_TIMEOUT_MS);
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    adapterMgr->CommandExecutor = CommandExecutor_Create((unsigned int)timeoutMs);
+    if (NULL == adapterMgr->CommandExecutor)
+    {
+        LogError("Failed to create the command executor");
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    return IOTHUB_CLIENT_OK;
+}
+
 IOTHUB_CLIENT_RESULT PnpAdapterManager_CreateManager(
     PPNP_ADAPTER_MANAGER* adapterMgr,
     JSON_Value* config)
@@ -264,7 +466,22 @@ IOTHUB_CLIENT_RESULT PnpAdapterManager_CreateManager(
     }
 
     adapterManager->NumComponents = 0;
+    adapterManager->ComponentsInModel = NULL;
+    adapterManager->ComponentIndex = NULL;
+    adapterManager->TelemetryPipeline = NULL;
+    adapterManager->ReportedPropertyPipeline = NULL;
+    adapterManager->CommandExecutor = NULL;
+    adapterManager->StoreAndForward = NULL;
+    adapterManager->Metrics = NULL;
     adapterManager->PnpAdapterHandleList = singlylinkedlist_create();
+
+    // Metrics come first so that everything created afterwards can update them
+    result = PnpAdapterManager_CreateMetrics(adapterManager, config);
+    if (!PNPBRIDGE_SUCCESS(result))
+    {
+        goto exit;
+    }
+
     JSON_Array* devices = Configuration_GetDevices(config);
     if (NULL == devices) {
         LogError("No configured devices in the pnpbridge config");
@@ -301,6 +518,30 @@ IOTHUB_CLIENT_RESULT PnpAdapterManager_CreateManager(
         }
     }
 
+    result = PnpAdapterManager_CreateStoreAndForward(adapterManager, config);
+    if (!PNPBRIDGE_SUCCESS(result))
+    {
+        goto exit;
+    }
+
+    result = PnpAdapterManager_CreateTelemetryPipeline(adapterManager, config);
+    if (!PNPBRIDGE_SUCCESS(result))
+    {
+        goto exit;
+    }
+
+    result = PnpAdapterManager_CreateReportedPropertyPipeline(adapterManager, config);
+    if (!PNPBRIDGE_SUCCESS(result))
+    {
+        goto exit;
+    }
+
+    result = PnpAdapterManager_CreateCommandExecutor(adapterManager, config);
+    if (!PNPBRIDGE_SUCCESS(result))
+    {
+        goto exit;
+    }
+
     *adapterMgr = adapterManager;
 
 exit:
@@ -319,6 +560,11 @@ void PnpAdapterManager_ReleaseManager(
 {
     if (NULL != adapterMgr)
     {
+        CommandExecutor_Destroy(adapterMgr->CommandExecutor);
+        TelemetryPipeline_Destroy(adapterMgr->TelemetryPipeline);
+        ReportedPropertyPipeline_Destroy(adapterMgr->ReportedPropertyPipeline);
+        StoreAndForward_Destroy(adapterMgr->StoreAndForward);
+
         LIST_ITEM_HANDLE adapterListItem = singlylinkedlist_get_head_item(adapterMgr->PnpAdapterHandleList);
 
         // Free adapter resources
@@ -344,6 +590,9 @@ void PnpAdapterManager_ReleaseManager(
         // Free components in model
         PnpAdapterManager_ReleaseComponentsInModel(adapterMgr);
 
+        // The client handle is gone, so no telemetry confirmation can still refer to the metrics
+        BridgeMetrics_Destroy(adapterMgr->Metrics);
+
         // Free adapter manager
         free(adapterMgr);
     }
@@ -499,13 +748,21 @@ IOTHUB_CLIENT_RESULT PnpAdapterManager_StartComponents(
 void PnpAdapterManager_ReleaseComponentsInModel(
         PPNP_ADAPTER_MANAGER adapterMgr)
 {
-    if (adapterMgr != NULL && adapterMgr->ComponentsInModel != NULL)
+    if (adapterMgr != NULL)
     {
-        for (unsigned int i = 0; i < adapterMgr->NumComponents; i++)
+        // The index only references the names in ComponentsInModel, so it goes first
+        PnP_ComponentIndex_Destroy(adapterMgr->ComponentIndex);
+        adapterMgr->ComponentIndex = NULL;
+
+        if (adapterMgr->ComponentsInModel != NULL)
         {
-            free(adapterMgr->ComponentsInModel[i]);
+            for (unsigned int i = 0; i < adapterMgr->NumComponents; i++)
+            {
+                free(adapterMgr->ComponentsInModel[i]);
+            }
+            free (adapterMgr->ComponentsInModel);
+            adapterMgr->ComponentsInModel = NULL;
         }
-        free (adapterMgr->ComponentsInModel);
     }
 }
 
@@ -516,8 +773,9 @@ IOTHUB_CLIENT_RESULT PnpAdapterManager_BuildComponentsInModel(
     unsigned int componentNumber = 0;
     if (NULL != adapterMgr)
     {
-        adapterMgr->ComponentsInModel = malloc(adapterMgr->NumComponents * sizeof(char*));
-        if (NULL == adapterMgr->ComponentsInModel)
+        adapterMgr->ComponentsInModel = calloc(adapterMgr->NumComponents, sizeof(char*));
+        adapterMgr->ComponentIndex = PnP_ComponentIndex_Create(adapterMgr->NumComponents);
+        if (NULL == adapterMgr->ComponentsInModel || NULL == adapterMgr->ComponentIndex)
         {
             result = IOTHUB_CLIENT_ERROR;
             goto exit;
@@ -530,10 +788,22 @@ IOTHUB_CLIENT_RESULT PnpAdapterManager_BuildComponentsInModel(
             PPNP_ADAPTER_CONTEXT_TAG adapterHandle = (PPNP_ADAPTER_CONTEXT_TAG)singlylinkedlist_item_get_value(adapterListItem);
 
             LIST_ITEM_HANDLE componentHandleItem = singlylinkedlist_get_head_item(adapterHandle->adapter->PnpComponentList);
-            while (NULL != componentHandleItem)
+            while (NULL != componentHandleItem && componentNumber < adapterMgr->NumComponents)
             {
                 PPNPADAPTER_COMPONENT_TAG componentHandle = (PPNPADAPTER_COMPONENT_TAG)singlylinkedlist_item_get_value(componentHandleItem);
-                mallocAndStrcpy_s((char**)&adapterMgr->ComponentsInModel[componentNumber++], componentHandle->componentName);
+                if (0 != mallocAndStrcpy_s(&adapterMgr->ComponentsInModel[componentNumber], componentHandle->componentName))
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    goto exit;
+                }
+
+                // Component names are the routing key for twin updates and methods, so duplicates cannot be told apart
+                if (!PnP_ComponentIndex_Add(adapterMgr->ComponentIndex, adapterMgr->ComponentsInModel[componentNumber++], componentHandle))
+                {
+                    LogError("Component %s could not be added to the component index", componentHandle->componentName);
+                    result = IOTHUB_CLIENT_ERROR;
+                    goto exit;
+                }
                 componentHandleItem = singlylinkedlist_get_next_item(componentHandleItem);
             }
             adapterListItem = singlylinkedlist_get_next_item(adapterListItem);
@@ -555,37 +825,84 @@ exit:
 PPNPADAPTER_COMPONENT_TAG PnpAdapterManager_GetComponentHandleFromComponentName(const char * ComponentName, size_t ComponentNameSize)
 {
     PPNPADAPTER_COMPONENT_TAG componentHandle = NULL;
-    bool componentFound = false;
     if (NULL != ComponentName)
     {
         if ((g_PnpBridge != NULL) && (g_PnpBridge->PnpMgr != NULL))
         {
-            LIST_ITEM_HANDLE adapterListItem = singlylinkedlist_get_head_item(g_PnpBridge->PnpMgr->PnpAdapterHandleList);
+            componentHandle = (PPNPADAPTER_COMPONENT_TAG)PnP_ComponentIndex_Find(g_PnpBridge->PnpMgr->ComponentIndex,
+                ComponentName, ComponentNameSize);
+        }
+    }
+    return componentHandle;
+}
 
-            while (NULL != adapterListItem && !componentFound)
-            {
-                PPNP_ADAPTER_CONTEXT_TAG adapterHandle = (PPNP_ADAPTER_CONTEXT_TAG)singlylinkedlist_item_get_value(adapterListItem);
+int PnpAdapterManager_DeviceMethodCallback(
+    const char* methodName,
+    const unsigned char* payload,
+    size_t size,
+    METHOD_HANDLE methodId,
+    void* userContextCallback)
+{
+    const char *componentName;
+    size_t componentNameSize;
+    const char *pnpCommandName;
+    char* jsonStr = NULL;
+    JSON_Value* commandValue = NULL;
+    int result = PNP_STATUS_SUCCESS;
 
-                LIST_ITEM_HANDLE componentHandleItem = singlylinkedlist_get_head_item(adapterHandle->adapter->PnpComponentList);
-                while (NULL != componentHandleItem)
-                {
-                    PPNPADAPTER_COMPONENT_TAG componentHandleIterator = (PPNPADAPTER_COMPONENT_TAG)singlylinkedlist_item_get_value(componentHandleItem);
-                    if (0 == strncmp(ComponentName, componentHandleIterator->componentName, ComponentNameSize))
-                    {
-                        componentHandle = componentHandleIterator;
-                        componentFound = true;
-                        break;
-                    }
-                    componentHandleItem = singlylinkedlist_get_next_item(componentHandleItem);
-                }
-                adapterListItem = singlylinkedlist_get_next_item(adapterListItem);
+    // The client handle the method arrived on, used to answer it
+    IOTHUB_CLIENT_CORE_HANDLE clientHandle = (IOTHUB_CLIENT_CORE_HANDLE)userContextCallback;
+
+    // Parse the methodName into its PnP componentName and pnpCommandName.
+    PnP_ParseCommandName(methodName, (const unsigned char**) (&componentName), &componentNameSize, &pnpCommandName);
+
+    // Parse the JSON of the payload request.
+    if ((jsonStr = PnP_CopyPayloadToString(payload, size)) == NULL)
+    {
+        LogError("Unable to allocate twin buffer");
+        result = PNP_STATUS_INTERNAL_ERROR;
+    }
+    else if ((commandValue = json_value_init_string(jsonStr)) == NULL)
+    {
+        LogError("Unable to parse twin JSON");
+        result = PNP_STATUS_INTERNAL_ERROR;
+    }
+    else
+    {
+        if (componentName != NULL)
+        {
+            LogInfo("Received PnP command for component=%.*s, command=%s", (int)componentNameSize, componentName, pnpCommandName);
+
+            PPNPADAPTER_COMPONENT_TAG componentHandle = PnpAdapterManager_GetComponentHandleFromComponentName(componentName, componentNameSize);
+            if ((componentHandle != NULL) && (g_PnpBridge->PnpMgr->CommandExecutor != NULL))
+            {
+                // The executor answers the command once the component's adapter has processed it
+                CommandExecutor_Submit(g_PnpBridge->PnpMgr->CommandExecutor, clientHandle, methodId, componentHandle,
+                    pnpCommandName, commandValue);
+                free(jsonStr);
+                return 0;
+            }
+            else
+            {
+                LogInfo("Pnp Bridge does not have a suitable adapter to route %.*s's method twin callback to at this time.",
+                    (int)componentNameSize, componentName);
+                result = PNP_STATUS_NOT_FOUND;
             }
         }
     }
-    return componentHandle;
+
+    (void)CommandExecutor_SendResponse(clientHandle, methodId, result, NULL, 0);
+
+    if (NULL != commandValue)
+    {
+        json_value_free(commandValue);
+    }
+    free(jsonStr);
+
+    return 0;
 }
 
-int PnpAdapterManager_DeviceMethodCallback(
+int PnpAdapterManager_ModuleMethodCallback(
     const char* methodName,
     const unsigned char* payload,
     size_t size,
@@ -600,7 +917,7 @@ int PnpAdapterManager_DeviceMethodCallback(
     JSON_Value* commandValue = NULL;
     int result = PNP_STATUS_SUCCESS;
 
-    // PnP APIs do not set userContextCallback for device method callbacks, ignore this
+    // PnP APIs do not set userContextCallback for module method callbacks, ignore this
     AZURE_UNREFERENCED_PARAMETER(userContextCallback);
 
     // Parse the methodName into its PnP componentName and pnpCommandName.
@@ -624,17 +941,28 @@ int PnpAdapterManager_DeviceMethodCallback(
             LogInfo("Received PnP command for component=%.*s, command=%s", (int)componentNameSize, componentName, pnpCommandName);
 
             PPNPADAPTER_COMPONENT_TAG componentHandle = PnpAdapterManager_GetComponentHandleFromComponentName(componentName, componentNameSize);
-            if (componentHandle != NULL)
+            if ((componentHandle != NULL) && (g_PnpBridge->PnpMgr->CommandExecutor != NULL))
             {
-                result = componentHandle->processCommand(componentHandle, pnpCommandName, commandValue, response, responseSize);
+                // The executor takes ownership of the command value and answers by the command timeout at the latest
+                result = CommandExecutor_Run(g_PnpBridge->PnpMgr->CommandExecutor, componentHandle, pnpCommandName,
+                    commandValue, response, responseSize);
+                commandValue = NULL;
             }
             else
             {
-                LogInfo("Pnp Bridge does not have a suitable adapter to route %s's method twin callback to at this time.", componentName);
+                LogInfo("Pnp Bridge does not have a suitable adapter to route %.*s's method twin callback to at this time.",
+                    (int)componentNameSize, componentName);
+                result = PNP_STATUS_NOT_FOUND;
             }
         }
     }
 
+    if (NULL != commandValue)
+    {
+        json_value_free(commandValue);
+    }
+    free(jsonStr);
+
     return result;
 }
 
@@ -680,6 +1008,33 @@ const char * BridgeState
 }
 
 
+void PnpAdapterManager_ConnectionStatusCallback(
+    IOTHUB_CLIENT_CONNECTION_STATUS result,
+    IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
+    void* userContextCallback)
+{
+    AZURE_UNREFERENCED_PARAMETER(userContextCallback);
+    LogInfo("PnpAdapterManager_ConnectionStatusCallback called, status=%d, reason=%d", result, reason);
+
+    if (NULL != g_PnpBridge)
+    {
+        g_PnpBridge->IotHandle.Connected = (IOTHUB_CLIENT_CONNECTION_AUTHENTICATED == result);
+    }
+
+    // Reported properties sent while the connection was down may not have reached the twin, report the
+    // whole cached state again in one patch instead of waiting for every component to report a change
+    if ((IOTHUB_CLIENT_CONNECTION_AUTHENTICATED == result) && (NULL != g_PnpBridge) && (NULL != g_PnpBridge->PnpMgr) &&
+        (NULL != g_PnpBridge->PnpMgr->ReportedPropertyPipeline))
+    {
+        ReportedPropertyPipeline_Resync(g_PnpBridge->PnpMgr->ReportedPropertyPipeline);
+    }
+
+    if ((NULL != g_PnpBridge) && (NULL != g_PnpBridge->PnpMgr) && (NULL != g_PnpBridge->PnpMgr->StoreAndForward))
+    {
+        StoreAndForward_SetConnected(g_PnpBridge->PnpMgr->StoreAndForward, IOTHUB_CLIENT_CONNECTION_AUTHENTICATED == result);
+    }
+}
+
 void PnpAdapterManager_DeviceTwinCallback(
     DEVICE_TWIN_UPDATE_STATE updateState,
     const unsigned char* payload,
@@ -710,8 +1065,8 @@ void PnpAdapterManager_DeviceTwinCallback(
         LogInfo("Processing property update for the device or module twin");
         // Invoke PnP_ProcessTwinData to actualy process the data. PnP_ProcessTwinData uses a visitor pattern to parse
         // the JSON and then visit each property, invoking PnpAdapterManager_RoutePropertyCallback on each element.
-        if (!PnP_ProcessTwinData(updateState, payload, size, (const char**) g_PnpBridge->PnpMgr->ComponentsInModel,
-                g_PnpBridge->PnpMgr->NumComponents, PnpAdapterManager_RoutePropertyCallback, userContextCallback))
+        if (!PnP_ProcessTwinData(updateState, payload, size, g_PnpBridge->PnpMgr->ComponentIndex,
+                PnpAdapterManager_RoutePropertyCallback, userContextCallback))
         {
             // If we're unable to parse the JSON for any reason (typically because the JSON is malformed or we ran out of memory)
             // there is no action we can take beyond logging.
@@ -18,8 +18,9 @@ bool g_PnpBridgeShutdown = false;
 IOTHUB_CLIENT_RESULT
 PnpBridge_InitializePnpModuleConfig(PNP_DEVICE_CONFIGURATION * PnpModuleConfig)
 {
-    PnpModuleConfig->deviceMethodCallback = (IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC) PnpAdapterManager_DeviceMethodCallback;
+    PnpModuleConfig->deviceMethodCallback = (IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC) PnpAdapterManager_ModuleMethodCallback;
     PnpModuleConfig->deviceTwinCallback = (IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK) PnpAdapterManager_DeviceTwinCallback;
+    PnpModuleConfig->connectionStatusCallback = (IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK) PnpAdapterManager_ConnectionStatusCallback;
     PnpModuleConfig->enableTracing = (strcmp(getenv(g_hubClientTraceEnabled), "true") == 0);
     PnpModuleConfig->modelId = getenv(g_pnpBridgeModuleRootModelId);
     // Note: User Agent String should not be changed
@@ -34,8 +35,9 @@ PnpBridge_InitializePnpDeviceConfig(PNPBRIDGE_CONFIGURATION * Configuration)
 {
     IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
 
-    Configuration->ConnParams->PnpDeviceConfiguration.deviceMethodCallback = (IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC) PnpAdapterManager_DeviceMethodCallback;
+    Configuration->ConnParams->PnpDeviceConfiguration.inboundDeviceMethodCallback = (IOTHUB_CLIENT_INBOUND_DEVICE_METHOD_CALLBACK) PnpAdapterManager_DeviceMethodCallback;
     Configuration->ConnParams->PnpDeviceConfiguration.deviceTwinCallback = (IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK) PnpAdapterManager_DeviceTwinCallback;
+    Configuration->ConnParams->PnpDeviceConfiguration.connectionStatusCallback = (IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK) PnpAdapterManager_ConnectionStatusCallback;
     Configuration->ConnParams->PnpDeviceConfiguration.enableTracing = Configuration->TraceOn;
     Configuration->ConnParams->PnpDeviceConfiguration.modelId = Configuration->ConnParams->RootInterfaceModelId;
     // Note: User Agent String should not be changed
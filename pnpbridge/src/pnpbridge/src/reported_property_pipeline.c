@@ -0,0 +1,293 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "pnpbridge_common.h"
+
+#include "reported_property_pipeline.h"
+#include "pnp_reported_property_cache.h"
+
+#include "azure_c_shared_utility/tickcounter.h"
+
+typedef struct _REPORTED_PROPERTY_PIPELINE {
+    unsigned int FlushIntervalMs;
+
+    // Last reported and pending value of every (component, property) pair
+    PNP_REPORTED_PROPERTY_CACHE_HANDLE Cache;
+
+    // All components of the bridge report on the same client handle
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle;
+
+    // Lock protects the cache; Condition wakes the flush thread when a property becomes pending
+    // or the pipeline is stopping
+    LOCK_HANDLE Lock;
+    COND_HANDLE Condition;
+    THREAD_HANDLE FlushThread;
+    TICK_COUNTER_HANDLE Clock;
+    uint64_t FirstPendingTime;
+    bool Stop;
+
+    // Statistics logged when the pipeline is destroyed
+    size_t ReportCount;
+    size_t PatchCount;
+} REPORTED_PROPERTY_PIPELINE, *PREPORTED_PROPERTY_PIPELINE;
+
+static void ReportedPropertyPipeline_ReportedStateCallback(
+    int pnpReportedStatus,
+    void* userContextCallback)
+{
+    AZURE_UNREFERENCED_PARAMETER(userContextCallback);
+    LogInfo("ReportedPropertyPipeline_ReportedStateCallback called, result=%d", pnpReportedStatus);
+}
+
+static IOTHUB_CLIENT_RESULT ReportedPropertyPipeline_SendPatch(
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* Patch)
+{
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+
+    if ((result = PnpBridgeClient_SendReportedState(ClientHandle, (const unsigned char*)Patch, strlen(Patch),
+            ReportedPropertyPipeline_ReportedStateCallback, NULL)) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Reported property pipeline: Unable to send reported state, error=%d", result);
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT ReportedPropertyPipeline_SendReportedProperty(
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName,
+    const char* PropertyName,
+    const char* PropertyValue)
+{
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+    STRING_HANDLE jsonToSend = NULL;
+
+    if ((jsonToSend = PnP_CreateReportedProperty(ComponentName, PropertyName, PropertyValue)) == NULL)
+    {
+        LogError("Reported property pipeline: Unable to build reported property for propertyName=%s, propertyValue=%s",
+            PropertyName, PropertyValue);
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        result = ReportedPropertyPipeline_SendPatch(ClientHandle, STRING_c_str(jsonToSend));
+        STRING_delete(jsonToSend);
+    }
+
+    return result;
+}
+
+static uint64_t ReportedPropertyPipeline_GetTime(
+    PREPORTED_PROPERTY_PIPELINE Pipeline)
+{
+    tickcounter_ms_t now = 0;
+    (void)tickcounter_get_current_ms(Pipeline->Clock, &now);
+    return (uint64_t)now;
+}
+
+// Sends every pending property in one patch. Called with the pipeline lock held.
+static void ReportedPropertyPipeline_Flush(
+    PREPORTED_PROPERTY_PIPELINE Pipeline)
+{
+    char* patch = PnP_ReportedPropertyCache_TakePatch(Pipeline->Cache);
+    if (NULL == patch)
+    {
+        return;
+    }
+
+    Pipeline->PatchCount++;
+    if (ReportedPropertyPipeline_SendPatch(Pipeline->ClientHandle, patch) != IOTHUB_CLIENT_OK)
+    {
+        // The twin may hold any mix of old and new values now, report them all again next interval
+        PnP_ReportedPropertyCache_Resync(Pipeline->Cache);
+        Pipeline->FirstPendingTime = ReportedPropertyPipeline_GetTime(Pipeline);
+    }
+
+    free(patch);
+}
+
+// Sends the pending patch once its oldest change has waited FlushIntervalMs, then sleeps until the next change
+static int ReportedPropertyPipeline_FlushThread(
+    void* context)
+{
+    PREPORTED_PROPERTY_PIPELINE pipeline = (PREPORTED_PROPERTY_PIPELINE)context;
+
+    Lock(pipeline->Lock);
+    while (!pipeline->Stop)
+    {
+        int waitMs = 0;
+
+        if ((NULL != pipeline->ClientHandle) && (PnP_ReportedPropertyCache_GetPendingCount(pipeline->Cache) > 0))
+        {
+            uint64_t now = ReportedPropertyPipeline_GetTime(pipeline);
+            uint64_t deadline = pipeline->FirstPendingTime + pipeline->FlushIntervalMs;
+            if (deadline <= now)
+            {
+                ReportedPropertyPipeline_Flush(pipeline);
+                continue;
+            }
+            waitMs = (int)(deadline - now);
+        }
+
+        // A wait of 0 blocks until a property becomes pending
+        Condition_Wait(pipeline->Condition, pipeline->Lock, waitMs);
+    }
+    Unlock(pipeline->Lock);
+
+    return 0;
+}
+
+// Wakes the flush thread if the pipeline just went from nothing pending to something pending.
+// Called with the pipeline lock held.
+static void ReportedPropertyPipeline_OnPending(
+    PREPORTED_PROPERTY_PIPELINE Pipeline,
+    size_t PreviousPendingCount)
+{
+    if ((0 == PreviousPendingCount) && (PnP_ReportedPropertyCache_GetPendingCount(Pipeline->Cache) > 0))
+    {
+        Pipeline->FirstPendingTime = ReportedPropertyPipeline_GetTime(Pipeline);
+        Condition_Post(Pipeline->Condition);
+    }
+}
+
+REPORTED_PROPERTY_PIPELINE_HANDLE ReportedPropertyPipeline_Create(
+    unsigned int FlushIntervalMs)
+{
+    PREPORTED_PROPERTY_PIPELINE pipeline = calloc(1, sizeof(REPORTED_PROPERTY_PIPELINE));
+    if (NULL == pipeline)
+    {
+        LogError("Reported property pipeline: Could not allocate pipeline");
+        return NULL;
+    }
+
+    pipeline->FlushIntervalMs = FlushIntervalMs;
+
+    if (((pipeline->Cache = PnP_ReportedPropertyCache_Create()) == NULL) ||
+        ((pipeline->Lock = Lock_Init()) == NULL) ||
+        ((pipeline->Condition = Condition_Init()) == NULL) ||
+        ((pipeline->Clock = tickcounter_create()) == NULL))
+    {
+        LogError("Reported property pipeline: Could not initialize pipeline");
+        goto exit;
+    }
+
+    if (ThreadAPI_Create(&pipeline->FlushThread, ReportedPropertyPipeline_FlushThread, pipeline) != THREADAPI_OK)
+    {
+        LogError("Reported property pipeline: Could not start flush thread");
+        pipeline->FlushThread = NULL;
+        goto exit;
+    }
+
+    LogInfo("Reported property pipeline: Reporting changed properties every %u ms", FlushIntervalMs);
+    return pipeline;
+
+exit:
+    ReportedPropertyPipeline_Destroy(pipeline);
+    return NULL;
+}
+
+void ReportedPropertyPipeline_Destroy(
+    REPORTED_PROPERTY_PIPELINE_HANDLE Pipeline)
+{
+    PREPORTED_PROPERTY_PIPELINE pipeline = (PREPORTED_PROPERTY_PIPELINE)Pipeline;
+
+    if (NULL == pipeline)
+    {
+        return;
+    }
+
+    if (NULL != pipeline->FlushThread)
+    {
+        Lock(pipeline->Lock);
+        pipeline->Stop = true;
+        Condition_Post(pipeline->Condition);
+        Unlock(pipeline->Lock);
+
+        int threadResult = 0;
+        ThreadAPI_Join(pipeline->FlushThread, &threadResult);
+
+        if (NULL != pipeline->ClientHandle)
+        {
+            ReportedPropertyPipeline_Flush(pipeline);
+        }
+    }
+
+    if (pipeline->ReportCount > 0)
+    {
+        LogInfo("Reported property pipeline: Reduced %lu property reports to %lu twin patches",
+            (unsigned long)pipeline->ReportCount, (unsigned long)pipeline->PatchCount);
+    }
+
+    PnP_ReportedPropertyCache_Destroy(pipeline->Cache);
+    if (NULL != pipeline->Condition)
+    {
+        Condition_Deinit(pipeline->Condition);
+    }
+    if (NULL != pipeline->Lock)
+    {
+        Lock_Deinit(pipeline->Lock);
+    }
+    if (NULL != pipeline->Clock)
+    {
+        tickcounter_destroy(pipeline->Clock);
+    }
+    free(pipeline);
+}
+
+IOTHUB_CLIENT_RESULT ReportedPropertyPipeline_Submit(
+    REPORTED_PROPERTY_PIPELINE_HANDLE Pipeline,
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName,
+    const char* PropertyName,
+    const char* PropertyValue)
+{
+    PREPORTED_PROPERTY_PIPELINE pipeline = (PREPORTED_PROPERTY_PIPELINE)Pipeline;
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+
+    Lock(pipeline->Lock);
+
+    pipeline->ReportCount++;
+
+    // The bridge can be reconfigured with a new client handle, the new twin needs the whole reported state
+    if (pipeline->ClientHandle != ClientHandle)
+    {
+        if (NULL != pipeline->ClientHandle)
+        {
+            ReportedPropertyPipeline_Flush(pipeline);
+        }
+        size_t pendingCount = PnP_ReportedPropertyCache_GetPendingCount(pipeline->Cache);
+        PnP_ReportedPropertyCache_Resync(pipeline->Cache);
+        pipeline->ClientHandle = ClientHandle;
+        ReportedPropertyPipeline_OnPending(pipeline, pendingCount);
+    }
+
+    size_t pendingCount = PnP_ReportedPropertyCache_GetPendingCount(pipeline->Cache);
+    switch (PnP_ReportedPropertyCache_Update(pipeline->Cache, ComponentName, PropertyName, PropertyValue))
+    {
+        case PNP_REPORTED_PROPERTY_CACHE_PENDING:
+            ReportedPropertyPipeline_OnPending(pipeline, pendingCount);
+            break;
+        case PNP_REPORTED_PROPERTY_CACHE_UNCHANGED:
+            break;
+        default:
+            pipeline->PatchCount++;
+            result = ReportedPropertyPipeline_SendReportedProperty(ClientHandle, ComponentName, PropertyName, PropertyValue);
+            break;
+    }
+
+    Unlock(pipeline->Lock);
+    return result;
+}
+
+void ReportedPropertyPipeline_Resync(
+    REPORTED_PROPERTY_PIPELINE_HANDLE Pipeline)
+{
+    PREPORTED_PROPERTY_PIPELINE pipeline = (PREPORTED_PROPERTY_PIPELINE)Pipeline;
+
+    Lock(pipeline->Lock);
+    size_t pendingCount = PnP_ReportedPropertyCache_GetPendingCount(pipeline->Cache);
+    PnP_ReportedPropertyCache_Resync(pipeline->Cache);
+    ReportedPropertyPipeline_OnPending(pipeline, pendingCount);
+    Unlock(pipeline->Lock);
+}
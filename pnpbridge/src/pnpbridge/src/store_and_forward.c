@@ -0,0 +1,253 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "pnpbridge_common.h"
+
+#include "store_and_forward.h"
+#include "telemetry_pipeline.h"
+#include "pnp_telemetry_store.h"
+
+#include "azure_c_shared_utility/tickcounter.h"
+
+// Interval in milliseconds at which stored telemetry is replayed
+#define STORE_AND_FORWARD_REPLAY_INTERVAL_MS 100
+
+typedef struct _STORE_AND_FORWARD {
+    unsigned int ReplayRate;
+
+    // Lock protects everything below; Condition wakes the replay thread when the connection comes back,
+    // when telemetry is stored while connected or when the store is stopping
+    LOCK_HANDLE Lock;
+    COND_HANDLE Condition;
+    THREAD_HANDLE ReplayThread;
+    TICK_COUNTER_HANDLE Clock;
+    bool Stop;
+
+    PNP_TELEMETRY_STORE_HANDLE Store;
+    bool Connected;
+
+    // Client handle stored telemetry is replayed on, the last one telemetry was submitted for
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle;
+
+    // Statistics logged when the store is destroyed
+    size_t StoredCount;
+    size_t ReplayedCount;
+} STORE_AND_FORWARD, *PSTORE_AND_FORWARD;
+
+static bool StoreAndForward_ReplayMessage(
+    const char* ComponentName,
+    const char* TelemetryData,
+    void* Context)
+{
+    PSTORE_AND_FORWARD storeAndForward = (PSTORE_AND_FORWARD)Context;
+    return TelemetryPipeline_SendMessage(storeAndForward->ClientHandle, ComponentName, TelemetryData) == IOTHUB_CLIENT_OK;
+}
+
+static uint64_t StoreAndForward_GetTime(
+    PSTORE_AND_FORWARD StoreAndForward)
+{
+    tickcounter_ms_t now = 0;
+    (void)tickcounter_get_current_ms(StoreAndForward->Clock, &now);
+    return (uint64_t)now;
+}
+
+// Replays stored telemetry while connected, paced to ReplayRate messages per second
+static int StoreAndForward_ReplayThread(
+    void* context)
+{
+    PSTORE_AND_FORWARD storeAndForward = (PSTORE_AND_FORWARD)context;
+    uint64_t lastReplay = StoreAndForward_GetTime(storeAndForward);
+    double credit = 0;
+
+    Lock(storeAndForward->Lock);
+    while (!storeAndForward->Stop)
+    {
+        uint64_t now = StoreAndForward_GetTime(storeAndForward);
+        bool replaying = storeAndForward->Connected && (NULL != storeAndForward->ClientHandle) &&
+            (PnP_TelemetryStore_GetMessageCount(storeAndForward->Store) > 0);
+
+        if (replaying)
+        {
+            // Unused credit is capped at one second worth of messages, so a long wait does not cause a burst
+            credit += (double)(now - lastReplay) * storeAndForward->ReplayRate / 1000;
+            if (credit > storeAndForward->ReplayRate)
+            {
+                credit = storeAndForward->ReplayRate;
+            }
+
+            size_t budget = (size_t)credit;
+            if (budget > 0)
+            {
+                size_t replayed = PnP_TelemetryStore_Replay(storeAndForward->Store, budget,
+                    StoreAndForward_ReplayMessage, storeAndForward);
+                storeAndForward->ReplayedCount += replayed;
+                credit -= (replayed < budget) ? credit : (double)replayed;
+
+                if (0 == PnP_TelemetryStore_GetMessageCount(storeAndForward->Store))
+                {
+                    LogInfo("Store and forward: Replayed all stored telemetry");
+                }
+            }
+        }
+        else
+        {
+            credit = 0;
+        }
+        lastReplay = now;
+
+        // A wait of 0 blocks until the connection comes back or telemetry is stored
+        Condition_Wait(storeAndForward->Condition, storeAndForward->Lock, replaying ? STORE_AND_FORWARD_REPLAY_INTERVAL_MS : 0);
+    }
+    Unlock(storeAndForward->Lock);
+
+    return 0;
+}
+
+STORE_AND_FORWARD_HANDLE StoreAndForward_Create(
+    const char* Path,
+    size_t SegmentSize,
+    size_t MaxSegments,
+    unsigned int ReplayRate)
+{
+    PSTORE_AND_FORWARD storeAndForward = calloc(1, sizeof(STORE_AND_FORWARD));
+    if (NULL == storeAndForward)
+    {
+        LogError("Store and forward: Could not allocate store");
+        return NULL;
+    }
+
+    storeAndForward->ReplayRate = ReplayRate;
+
+    if (((storeAndForward->Store = PnP_TelemetryStore_Open(Path, SegmentSize, MaxSegments)) == NULL) ||
+        ((storeAndForward->Lock = Lock_Init()) == NULL) ||
+        ((storeAndForward->Condition = Condition_Init()) == NULL) ||
+        ((storeAndForward->Clock = tickcounter_create()) == NULL))
+    {
+        LogError("Store and forward: Could not initialize store at %s", Path);
+        goto exit;
+    }
+
+    if (ThreadAPI_Create(&storeAndForward->ReplayThread, StoreAndForward_ReplayThread, storeAndForward) != THREADAPI_OK)
+    {
+        LogError("Store and forward: Could not start replay thread");
+        storeAndForward->ReplayThread = NULL;
+        goto exit;
+    }
+
+    LogInfo("Store and forward: Keeping up to %lu bytes of telemetry at %s, replaying %u messages per second",
+        (unsigned long)(SegmentSize * MaxSegments), Path, ReplayRate);
+    return storeAndForward;
+
+exit:
+    StoreAndForward_Destroy(storeAndForward);
+    return NULL;
+}
+
+void StoreAndForward_Destroy(
+    STORE_AND_FORWARD_HANDLE StoreAndForward)
+{
+    PSTORE_AND_FORWARD storeAndForward = (PSTORE_AND_FORWARD)StoreAndForward;
+
+    if (NULL == storeAndForward)
+    {
+        return;
+    }
+
+    if (NULL != storeAndForward->ReplayThread)
+    {
+        Lock(storeAndForward->Lock);
+        storeAndForward->Stop = true;
+        Condition_Post(storeAndForward->Condition);
+        Unlock(storeAndForward->Lock);
+
+        int threadResult = 0;
+        ThreadAPI_Join(storeAndForward->ReplayThread, &threadResult);
+    }
+
+    if (NULL != storeAndForward->Store)
+    {
+        LogInfo("Store and forward: Stored %lu messages, replayed %lu, dropped %lu, %lu left for the next run",
+            (unsigned long)storeAndForward->StoredCount, (unsigned long)storeAndForward->ReplayedCount,
+            (unsigned long)PnP_TelemetryStore_GetDroppedCount(storeAndForward->Store),
+            (unsigned long)PnP_TelemetryStore_GetMessageCount(storeAndForward->Store));
+        PnP_TelemetryStore_Close(storeAndForward->Store);
+    }
+
+    if (NULL != storeAndForward->Condition)
+    {
+        Condition_Deinit(storeAndForward->Condition);
+    }
+    if (NULL != storeAndForward->Lock)
+    {
+        Lock_Deinit(storeAndForward->Lock);
+    }
+    if (NULL != storeAndForward->Clock)
+    {
+        tickcounter_destroy(storeAndForward->Clock);
+    }
+    free(storeAndForward);
+}
+
+IOTHUB_CLIENT_RESULT StoreAndForward_Submit(
+    STORE_AND_FORWARD_HANDLE StoreAndForward,
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName,
+    const char* TelemetryData)
+{
+    PSTORE_AND_FORWARD storeAndForward = (PSTORE_AND_FORWARD)StoreAndForward;
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+
+    Lock(storeAndForward->Lock);
+
+    storeAndForward->ClientHandle = ClientHandle;
+
+    // Telemetry only bypasses the store when nothing older is waiting in it, to keep it in order
+    if (storeAndForward->Connected && (0 == PnP_TelemetryStore_GetMessageCount(storeAndForward->Store)))
+    {
+        result = TelemetryPipeline_SendMessage(ClientHandle, ComponentName, TelemetryData);
+    }
+    else if (PnP_TelemetryStore_Append(storeAndForward->Store, ComponentName, TelemetryData))
+    {
+        storeAndForward->StoredCount++;
+        if (storeAndForward->Connected && (1 == PnP_TelemetryStore_GetMessageCount(storeAndForward->Store)))
+        {
+            Condition_Post(storeAndForward->Condition);
+        }
+    }
+    else
+    {
+        // The IoT Hub client keeps what it cannot send in memory for a while, which beats losing it
+        LogError("Store and forward: Could not store telemetry of component %s, sending it", ComponentName);
+        result = TelemetryPipeline_SendMessage(ClientHandle, ComponentName, TelemetryData);
+    }
+
+    Unlock(storeAndForward->Lock);
+    return result;
+}
+
+void StoreAndForward_SetConnected(
+    STORE_AND_FORWARD_HANDLE StoreAndForward,
+    bool Connected)
+{
+    PSTORE_AND_FORWARD storeAndForward = (PSTORE_AND_FORWARD)StoreAndForward;
+
+    Lock(storeAndForward->Lock);
+    if (storeAndForward->Connected != Connected)
+    {
+        storeAndForward->Connected = Connected;
+        if (Connected)
+        {
+            if (PnP_TelemetryStore_GetMessageCount(storeAndForward->Store) > 0)
+            {
+                LogInfo("Store and forward: Connected, replaying %lu stored messages",
+                    (unsigned long)PnP_TelemetryStore_GetMessageCount(storeAndForward->Store));
+            }
+            Condition_Post(storeAndForward->Condition);
+        }
+        else
+        {
+            LogInfo("Store and forward: Disconnected, storing telemetry");
+        }
+    }
+    Unlock(storeAndForward->Lock);
+}
@@ -0,0 +1,377 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "pnpbridge_common.h"
+
+#include "telemetry_pipeline.h"
+#include "pnp_telemetry_batch.h"
+
+#include "azure_c_shared_utility/tickcounter.h"
+
+extern PPNP_BRIDGE g_PnpBridge;
+
+// Pending telemetry of one component
+typedef struct _TELEMETRY_PIPELINE_COMPONENT {
+    char* ComponentName;
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle;
+    PNP_TELEMETRY_BATCH_HANDLE Batch;
+} TELEMETRY_PIPELINE_COMPONENT, *PTELEMETRY_PIPELINE_COMPONENT;
+
+typedef struct _TELEMETRY_PIPELINE {
+    size_t MaxMessageSize;
+    unsigned int MaxLatencyMs;
+
+    // Store batches are handed to while IoT Hub cannot be reached, NULL when store and forward is not configured
+    STORE_AND_FORWARD_HANDLE StoreAndForward;
+
+    // List of PTELEMETRY_PIPELINE_COMPONENT, indexed by component name in ComponentIndex
+    SINGLYLINKEDLIST_HANDLE Components;
+    PNP_COMPONENT_INDEX_HANDLE ComponentIndex;
+
+    // Lock protects the components and their batches; Condition wakes the flush thread when
+    // a batch receives its first reading or the pipeline is stopping
+    LOCK_HANDLE Lock;
+    COND_HANDLE Condition;
+    THREAD_HANDLE FlushThread;
+    TICK_COUNTER_HANDLE Clock;
+    bool Stop;
+
+    // Statistics logged when the pipeline is destroyed
+    size_t ReadingCount;
+    size_t MessageCount;
+} TELEMETRY_PIPELINE, *PTELEMETRY_PIPELINE;
+
+static void TelemetryPipeline_SendEventCallback(
+    IOTHUB_CLIENT_CONFIRMATION_RESULT pnpSendEventStatus,
+    void* userContextCallback)
+{
+    LogInfo("TelemetryPipeline_SendEventCallback called, result=%d", pnpSendEventStatus);
+    BridgeMetrics_CompleteMessage(userContextCallback, IOTHUB_CLIENT_CONFIRMATION_OK == pnpSendEventStatus);
+}
+
+// Returns the metrics tracking context of a message, NULL when bridge metrics are not configured
+static void* TelemetryPipeline_TrackMessage(
+    const char* ComponentName)
+{
+    if ((NULL == g_PnpBridge) || (NULL == g_PnpBridge->PnpMgr))
+    {
+        return NULL;
+    }
+
+    return BridgeMetrics_TrackMessage(g_PnpBridge->PnpMgr->Metrics, ComponentName);
+}
+
+IOTHUB_CLIENT_RESULT TelemetryPipeline_SendMessage(
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName,
+    const char* TelemetryData)
+{
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+    IOTHUB_MESSAGE_HANDLE messageHandle = NULL;
+
+    if ((messageHandle = PnP_CreateTelemetryMessageHandle(ComponentName, TelemetryData)) == NULL)
+    {
+        LogError("Telemetry pipeline: PnP_CreateTelemetryMessageHandle failed for component %s", ComponentName);
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        void* tracking = TelemetryPipeline_TrackMessage(ComponentName);
+        if ((result = PnpBridgeClient_SendEventAsync(ClientHandle, messageHandle,
+                TelemetryPipeline_SendEventCallback, tracking)) != IOTHUB_CLIENT_OK)
+        {
+            LogError("Telemetry pipeline: IoTHub client call to _SendEventAsync failed for component %s, error=%d", ComponentName, result);
+            BridgeMetrics_CompleteMessage(tracking, false);
+        }
+    }
+
+    IoTHubMessage_Destroy(messageHandle);
+
+    return result;
+}
+
+// Hands a message to store and forward when it is configured, otherwise sends it
+static IOTHUB_CLIENT_RESULT TelemetryPipeline_Send(
+    PTELEMETRY_PIPELINE Pipeline,
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName,
+    const char* TelemetryData)
+{
+    Pipeline->MessageCount++;
+    if (NULL != Pipeline->StoreAndForward)
+    {
+        return StoreAndForward_Submit(Pipeline->StoreAndForward, ClientHandle, ComponentName, TelemetryData);
+    }
+    return TelemetryPipeline_SendMessage(ClientHandle, ComponentName, TelemetryData);
+}
+
+// Sends the component's pending readings as one message. Called with the pipeline lock held.
+static IOTHUB_CLIENT_RESULT TelemetryPipeline_FlushComponent(
+    PTELEMETRY_PIPELINE Pipeline,
+    PTELEMETRY_PIPELINE_COMPONENT Component)
+{
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+
+    if (PnP_TelemetryBatch_GetReadingCount(Component->Batch) > 0)
+    {
+        result = TelemetryPipeline_Send(Pipeline, Component->ClientHandle, Component->ComponentName,
+            PnP_TelemetryBatch_GetMessage(Component->Batch));
+        PnP_TelemetryBatch_Clear(Component->Batch);
+    }
+
+    return result;
+}
+
+static uint64_t TelemetryPipeline_GetTime(
+    PTELEMETRY_PIPELINE Pipeline)
+{
+    tickcounter_ms_t now = 0;
+    (void)tickcounter_get_current_ms(Pipeline->Clock, &now);
+    return (uint64_t)now;
+}
+
+// Sends every batch whose oldest reading has waited MaxLatencyMs, then sleeps until the next batch is due
+static int TelemetryPipeline_FlushThread(
+    void* context)
+{
+    PTELEMETRY_PIPELINE pipeline = (PTELEMETRY_PIPELINE)context;
+
+    Lock(pipeline->Lock);
+    while (!pipeline->Stop)
+    {
+        uint64_t now = TelemetryPipeline_GetTime(pipeline);
+        uint64_t nextDeadline = 0;
+
+        LIST_ITEM_HANDLE componentItem = singlylinkedlist_get_head_item(pipeline->Components);
+        while (NULL != componentItem)
+        {
+            PTELEMETRY_PIPELINE_COMPONENT component = (PTELEMETRY_PIPELINE_COMPONENT)singlylinkedlist_item_get_value(componentItem);
+            if (PnP_TelemetryBatch_GetReadingCount(component->Batch) > 0)
+            {
+                uint64_t deadline = PnP_TelemetryBatch_GetFirstReadingTime(component->Batch) + pipeline->MaxLatencyMs;
+                if (deadline <= now)
+                {
+                    (void)TelemetryPipeline_FlushComponent(pipeline, component);
+                }
+                else if (0 == nextDeadline || deadline < nextDeadline)
+                {
+                    nextDeadline = deadline;
+                }
+            }
+            componentItem = singlylinkedlist_get_next_item(componentItem);
+        }
+
+        // A wait of 0 blocks until a batch receives its first reading
+        Condition_Wait(pipeline->Condition, pipeline->Lock, (0 == nextDeadline) ? 0 : (int)(nextDeadline - now));
+    }
+    Unlock(pipeline->Lock);
+
+    return 0;
+}
+
+static PTELEMETRY_PIPELINE_COMPONENT TelemetryPipeline_GetComponent(
+    PTELEMETRY_PIPELINE Pipeline,
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName)
+{
+    PTELEMETRY_PIPELINE_COMPONENT component = PnP_ComponentIndex_Find(Pipeline->ComponentIndex, ComponentName, strlen(ComponentName));
+    if (NULL != component)
+    {
+        // The bridge can be reconfigured with a new client handle, readings queued for the old one go out first
+        if (component->ClientHandle != ClientHandle)
+        {
+            (void)TelemetryPipeline_FlushComponent(Pipeline, component);
+            component->ClientHandle = ClientHandle;
+        }
+        return component;
+    }
+
+    component = calloc(1, sizeof(TELEMETRY_PIPELINE_COMPONENT));
+    if (NULL == component)
+    {
+        LogError("Telemetry pipeline: Could not allocate component %s", ComponentName);
+        return NULL;
+    }
+
+    LIST_ITEM_HANDLE componentItem = NULL;
+    if ((mallocAndStrcpy_s(&component->ComponentName, ComponentName) != 0) ||
+        ((component->Batch = PnP_TelemetryBatch_Create(Pipeline->MaxMessageSize)) == NULL) ||
+        ((componentItem = singlylinkedlist_add(Pipeline->Components, component)) == NULL))
+    {
+        LogError("Telemetry pipeline: Could not create a batch for component %s", ComponentName);
+        goto exit;
+    }
+
+    if (!PnP_ComponentIndex_Add(Pipeline->ComponentIndex, component->ComponentName, component))
+    {
+        LogError("Telemetry pipeline: Could not index component %s", ComponentName);
+        singlylinkedlist_remove(Pipeline->Components, componentItem);
+        goto exit;
+    }
+
+    component->ClientHandle = ClientHandle;
+    return component;
+
+exit:
+    PnP_TelemetryBatch_Destroy(component->Batch);
+    free(component->ComponentName);
+    free(component);
+    return NULL;
+}
+
+TELEMETRY_PIPELINE_HANDLE TelemetryPipeline_Create(
+    size_t MaxMessageSize,
+    unsigned int MaxLatencyMs,
+    STORE_AND_FORWARD_HANDLE StoreAndForward)
+{
+    PTELEMETRY_PIPELINE pipeline = calloc(1, sizeof(TELEMETRY_PIPELINE));
+    if (NULL == pipeline)
+    {
+        LogError("Telemetry pipeline: Could not allocate pipeline");
+        return NULL;
+    }
+
+    pipeline->MaxMessageSize = MaxMessageSize;
+    pipeline->MaxLatencyMs = MaxLatencyMs;
+    pipeline->StoreAndForward = StoreAndForward;
+
+    if (((pipeline->Components = singlylinkedlist_create()) == NULL) ||
+        ((pipeline->ComponentIndex = PnP_ComponentIndex_Create(0)) == NULL) ||
+        ((pipeline->Lock = Lock_Init()) == NULL) ||
+        ((pipeline->Condition = Condition_Init()) == NULL) ||
+        ((pipeline->Clock = tickcounter_create()) == NULL))
+    {
+        LogError("Telemetry pipeline: Could not initialize pipeline");
+        goto exit;
+    }
+
+    if (ThreadAPI_Create(&pipeline->FlushThread, TelemetryPipeline_FlushThread, pipeline) != THREADAPI_OK)
+    {
+        LogError("Telemetry pipeline: Could not start flush thread");
+        pipeline->FlushThread = NULL;
+        goto exit;
+    }
+
+    LogInfo("Telemetry pipeline: Batching telemetry up to %lu bytes per message and %u ms per reading",
+        (unsigned long)MaxMessageSize, MaxLatencyMs);
+    return pipeline;
+
+exit:
+    TelemetryPipeline_Destroy(pipeline);
+    return NULL;
+}
+
+void TelemetryPipeline_Destroy(
+    TELEMETRY_PIPELINE_HANDLE Pipeline)
+{
+    PTELEMETRY_PIPELINE pipeline = (PTELEMETRY_PIPELINE)Pipeline;
+
+    if (NULL == pipeline)
+    {
+        return;
+    }
+
+    if (NULL != pipeline->FlushThread)
+    {
+        Lock(pipeline->Lock);
+        pipeline->Stop = true;
+        Condition_Post(pipeline->Condition);
+        Unlock(pipeline->Lock);
+
+        int threadResult = 0;
+        ThreadAPI_Join(pipeline->FlushThread, &threadResult);
+    }
+
+    if (NULL != pipeline->Components)
+    {
+        LIST_ITEM_HANDLE componentItem = singlylinkedlist_get_head_item(pipeline->Components);
+        while (NULL != componentItem)
+        {
+            PTELEMETRY_PIPELINE_COMPONENT component = (PTELEMETRY_PIPELINE_COMPONENT)singlylinkedlist_item_get_value(componentItem);
+            (void)TelemetryPipeline_FlushComponent(pipeline, component);
+            PnP_TelemetryBatch_Destroy(component->Batch);
+            free(component->ComponentName);
+            free(component);
+            componentItem = singlylinkedlist_get_next_item(componentItem);
+        }
+        singlylinkedlist_destroy(pipeline->Components);
+    }
+
+    if (pipeline->ReadingCount > 0)
+    {
+        LogInfo("Telemetry pipeline: Sent %lu readings in %lu messages",
+            (unsigned long)pipeline->ReadingCount, (unsigned long)pipeline->MessageCount);
+    }
+
+    PnP_ComponentIndex_Destroy(pipeline->ComponentIndex);
+    if (NULL != pipeline->Condition)
+    {
+        Condition_Deinit(pipeline->Condition);
+    }
+    if (NULL != pipeline->Lock)
+    {
+        Lock_Deinit(pipeline->Lock);
+    }
+    if (NULL != pipeline->Clock)
+    {
+        tickcounter_destroy(pipeline->Clock);
+    }
+    free(pipeline);
+}
+
+IOTHUB_CLIENT_RESULT TelemetryPipeline_Submit(
+    TELEMETRY_PIPELINE_HANDLE Pipeline,
+    PNP_BRIDGE_CLIENT_HANDLE ClientHandle,
+    const char* ComponentName,
+    const char* TelemetryData)
+{
+    PTELEMETRY_PIPELINE pipeline = (PTELEMETRY_PIPELINE)Pipeline;
+    IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+
+    if (NULL == ComponentName)
+    {
+        if (NULL != pipeline->StoreAndForward)
+        {
+            return StoreAndForward_Submit(pipeline->StoreAndForward, ClientHandle, ComponentName, TelemetryData);
+        }
+        return TelemetryPipeline_SendMessage(ClientHandle, ComponentName, TelemetryData);
+    }
+
+    Lock(pipeline->Lock);
+
+    pipeline->ReadingCount++;
+
+    PTELEMETRY_PIPELINE_COMPONENT component = TelemetryPipeline_GetComponent(pipeline, ClientHandle, ComponentName);
+    if (NULL == component)
+    {
+        result = TelemetryPipeline_Send(pipeline, ClientHandle, ComponentName, TelemetryData);
+        goto exit;
+    }
+
+    uint64_t now = TelemetryPipeline_GetTime(pipeline);
+    PNP_TELEMETRY_BATCH_RESULT batchResult = PnP_TelemetryBatch_Add(component->Batch, TelemetryData, now);
+    if (PNP_TELEMETRY_BATCH_FULL == batchResult)
+    {
+        result = TelemetryPipeline_FlushComponent(pipeline, component);
+        batchResult = PnP_TelemetryBatch_Add(component->Batch, TelemetryData, now);
+    }
+
+    if (PNP_TELEMETRY_BATCH_ADDED == batchResult)
+    {
+        // The flush thread only has to wake up for a batch that was empty, others are already scheduled
+        if (1 == PnP_TelemetryBatch_GetReadingCount(component->Batch))
+        {
+            Condition_Post(pipeline->Condition);
+        }
+    }
+    else
+    {
+        // Keep the component's telemetry in order: what is pending goes out before this reading
+        (void)TelemetryPipeline_FlushComponent(pipeline, component);
+        result = TelemetryPipeline_Send(pipeline, ClientHandle, ComponentName, TelemetryData);
+    }
+
+exit:
+    Unlock(pipeline->Lock);
+    return result;
+}
@@ -0,0 +1,413 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "pnpbridge_common.h"
+#include "command_executor.h"
+
+#define TEST_CLIENT_HANDLE ((IOTHUB_CLIENT_CORE_HANDLE)0x1)
+#define TEST_METHOD_ID(n) ((METHOD_HANDLE)(uintptr_t)(n))
+#define TEST_MAX_COMMANDS 16
+
+// Timeout for commands that are expected to complete, long enough to never expire on a loaded build machine
+#define TEST_LONG_TIMEOUT_MS 30000
+
+// Answers sent through IoTHubClientCore_DeviceMethodResponse, in the order they were sent
+typedef struct TestResponse {
+    uintptr_t MethodId;
+    int Status;
+    char Payload[64];
+} TestResponse;
+
+static LOCK_HANDLE g_testLock;
+static TestResponse g_responses[TEST_MAX_COMMANDS];
+static volatile int g_responseCount;
+
+// Commands handed to the components' processCommand, in the order they started
+static char g_started[TEST_MAX_COMMANDS][16];
+static volatile int g_startedCount;
+static volatile int g_completedCount;
+
+// A command named "block" does not return until the test releases it, like a device that stopped answering
+static volatile bool g_releaseBlocked;
+
+static uint64_t g_failedCommands;
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_DeviceMethodResponse(
+    IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle,
+    METHOD_HANDLE methodId,
+    const unsigned char* response,
+    size_t responseSize,
+    int statusCode)
+{
+    ASSERT_IS_TRUE(TEST_CLIENT_HANDLE == iotHubClientHandle);
+
+    Lock(g_testLock);
+    ASSERT_IS_TRUE(g_responseCount < TEST_MAX_COMMANDS);
+    TestResponse* answer = &g_responses[g_responseCount];
+    answer->MethodId = (uintptr_t)methodId;
+    answer->Status = statusCode;
+    size_t length = (responseSize < sizeof(answer->Payload)) ? responseSize : sizeof(answer->Payload) - 1;
+    memcpy(answer->Payload, response, length);
+    answer->Payload[length] = '\0';
+    g_responseCount++;
+    Unlock(g_testLock);
+
+    return IOTHUB_CLIENT_OK;
+}
+
+void PnpBridgeMetrics_AddCounter(
+    const char* ComponentName,
+    const char* MetricName,
+    uint64_t Delta)
+{
+    (void)ComponentName;
+    if (strcmp(MetricName, PNP_METRIC_COMMANDS_FAILED) == 0)
+    {
+        Lock(g_testLock);
+        g_failedCommands += Delta;
+        Unlock(g_testLock);
+    }
+}
+
+void PnpBridgeMetrics_ObserveDuration(
+    const char* ComponentName,
+    const char* MetricName,
+    uint32_t DurationMs)
+{
+    (void)ComponentName;
+    (void)MetricName;
+    (void)DurationMs;
+}
+
+// Answers every command with its own name
+static int TestComponent_ProcessCommand(
+    PNPBRIDGE_COMPONENT_HANDLE componentHandle,
+    const char* CommandName,
+    JSON_Value* CommandValue,
+    unsigned char** CommandResponse,
+    size_t* CommandResponseSize)
+{
+    (void)componentHandle;
+    (void)CommandValue;
+
+    Lock(g_testLock);
+    ASSERT_IS_TRUE(g_startedCount < TEST_MAX_COMMANDS);
+    (void)snprintf(g_started[g_startedCount], sizeof(g_started[0]), "%s", CommandName);
+    g_startedCount++;
+    Unlock(g_testLock);
+
+    if (strcmp(CommandName, "block") == 0)
+    {
+        while (!g_releaseBlocked)
+        {
+            ThreadAPI_Sleep(1);
+        }
+    }
+
+    size_t length = strlen(CommandName) + 2;
+    char* response = malloc(length + 1);
+    ASSERT_IS_NOT_NULL(response);
+    (void)snprintf(response, length + 1, "\"%s\"", CommandName);
+    *CommandResponse = (unsigned char*)response;
+    *CommandResponseSize = length;
+
+    Lock(g_testLock);
+    g_completedCount++;
+    Unlock(g_testLock);
+
+    return PNP_STATUS_SUCCESS;
+}
+
+static void TestComponent_Init(
+    PNPADAPTER_COMPONENT_TAG* component,
+    char* componentName)
+{
+    memset(component, 0, sizeof(*component));
+    component->componentName = componentName;
+    component->processCommand = TestComponent_ProcessCommand;
+}
+
+static void TestSubmit(
+    COMMAND_EXECUTOR_HANDLE executor,
+    PNPADAPTER_COMPONENT_TAG* component,
+    int methodId,
+    const char* commandName)
+{
+    JSON_Value* commandValue = json_value_init_null();
+    ASSERT_IS_NOT_NULL(commandValue);
+    CommandExecutor_Submit(executor, TEST_CLIENT_HANDLE, TEST_METHOD_ID(methodId), component, commandName, commandValue);
+}
+
+// Waits for count to reach the expected value, returns false after a few seconds
+static bool TestWaitFor(
+    volatile int* count,
+    int expected)
+{
+    for (int waitedMs = 0; waitedMs < 5000; waitedMs++)
+    {
+        if (*count >= expected)
+        {
+            return true;
+        }
+        ThreadAPI_Sleep(1);
+    }
+    return false;
+}
+
+static const TestResponse* TestFindResponse(
+    int methodId)
+{
+    for (int i = 0; i < g_responseCount; i++)
+    {
+        if (g_responses[i].MethodId == (uintptr_t)methodId)
+        {
+            return &g_responses[i];
+        }
+    }
+    return NULL;
+}
+
+static int TestReleaseBlocked_Thread(
+    void* context)
+{
+    (void)context;
+    // Give CommandExecutor_Destroy time to stop the executor while the blocked command is still running
+    ThreadAPI_Sleep(200);
+    g_releaseBlocked = true;
+    return 0;
+}
+
+BEGIN_TEST_SUITE(command_executor_ut)
+
+TEST_SUITE_INITIALIZE(suite_init)
+{
+    g_testLock = Lock_Init();
+    ASSERT_IS_NOT_NULL(g_testLock);
+}
+
+TEST_SUITE_CLEANUP(suite_cleanup)
+{
+    Lock_Deinit(g_testLock);
+}
+
+TEST_FUNCTION_INITIALIZE(test_init)
+{
+    memset(g_responses, 0, sizeof(g_responses));
+    memset(g_started, 0, sizeof(g_started));
+    g_responseCount = 0;
+    g_startedCount = 0;
+    g_completedCount = 0;
+    g_releaseBlocked = false;
+    g_failedCommands = 0;
+}
+
+TEST_FUNCTION(CommandExecutor_runs_commands_of_a_component_in_order)
+{
+    PNPADAPTER_COMPONENT_TAG component;
+    TestComponent_Init(&component, "sensor");
+
+    COMMAND_EXECUTOR_HANDLE executor = CommandExecutor_Create(TEST_LONG_TIMEOUT_MS);
+    ASSERT_IS_NOT_NULL(executor);
+
+    const char* commands[] = { "first", "second", "third", "fourth", "fifth" };
+    const int commandCount = (int)(sizeof(commands) / sizeof(commands[0]));
+    for (int i = 0; i < commandCount; i++)
+    {
+        TestSubmit(executor, &component, i + 1, commands[i]);
+    }
+
+    ASSERT_IS_TRUE(TestWaitFor(&g_responseCount, commandCount));
+    CommandExecutor_Destroy(executor);
+
+    ASSERT_ARE_EQUAL(int, commandCount, g_startedCount);
+    for (int i = 0; i < commandCount; i++)
+    {
+        char expected[16];
+        (void)snprintf(expected, sizeof(expected), "\"%s\"", commands[i]);
+        ASSERT_ARE_EQUAL(char_ptr, commands[i], g_started[i]);
+        ASSERT_ARE_EQUAL(int, i + 1, (int)g_responses[i].MethodId);
+        ASSERT_ARE_EQUAL(int, PNP_STATUS_SUCCESS, g_responses[i].Status);
+        ASSERT_ARE_EQUAL(char_ptr, expected, g_responses[i].Payload);
+    }
+    ASSERT_IS_TRUE(0 == g_failedCommands);
+}
+
+TEST_FUNCTION(CommandExecutor_slow_component_does_not_delay_other_components)
+{
+    PNPADAPTER_COMPONENT_TAG slowComponent;
+    PNPADAPTER_COMPONENT_TAG component;
+    TestComponent_Init(&slowComponent, "slow");
+    TestComponent_Init(&component, "sensor");
+
+    COMMAND_EXECUTOR_HANDLE executor = CommandExecutor_Create(TEST_LONG_TIMEOUT_MS);
+    ASSERT_IS_NOT_NULL(executor);
+
+    TestSubmit(executor, &slowComponent, 1, "block");
+    ASSERT_IS_TRUE(TestWaitFor(&g_startedCount, 1));
+    TestSubmit(executor, &component, 2, "read");
+
+    ASSERT_IS_TRUE(TestWaitFor(&g_responseCount, 1));
+    ASSERT_ARE_EQUAL(int, 2, (int)g_responses[0].MethodId);
+    ASSERT_ARE_EQUAL(int, PNP_STATUS_SUCCESS, g_responses[0].Status);
+
+    g_releaseBlocked = true;
+    ASSERT_IS_TRUE(TestWaitFor(&g_responseCount, 2));
+    CommandExecutor_Destroy(executor);
+
+    ASSERT_ARE_EQUAL(int, 1, (int)g_responses[1].MethodId);
+    ASSERT_ARE_EQUAL(char_ptr, "\"block\"", g_responses[1].Payload);
+}
+
+TEST_FUNCTION(CommandExecutor_answers_slow_command_with_timeout)
+{
+    PNPADAPTER_COMPONENT_TAG component;
+    TestComponent_Init(&component, "sensor");
+
+    COMMAND_EXECUTOR_HANDLE executor = CommandExecutor_Create(100);
+    ASSERT_IS_NOT_NULL(executor);
+
+    TestSubmit(executor, &component, 1, "block");
+    ASSERT_IS_TRUE(TestWaitFor(&g_responseCount, 1));
+
+    ASSERT_ARE_EQUAL(int, 1, (int)g_responses[0].MethodId);
+    ASSERT_ARE_EQUAL(int, PNP_STATUS_TIMEOUT, g_responses[0].Status);
+    ASSERT_ARE_EQUAL(char_ptr, "\"Command timed out\"", g_responses[0].Payload);
+    ASSERT_IS_TRUE(1 == g_failedCommands);
+
+    g_releaseBlocked = true;
+    CommandExecutor_Destroy(executor);
+}
+
+TEST_FUNCTION(CommandExecutor_drops_result_of_command_that_timed_out)
+{
+    PNPADAPTER_COMPONENT_TAG component;
+    TestComponent_Init(&component, "sensor");
+
+    COMMAND_EXECUTOR_HANDLE executor = CommandExecutor_Create(100);
+    ASSERT_IS_NOT_NULL(executor);
+
+    TestSubmit(executor, &component, 1, "block");
+    ASSERT_IS_TRUE(TestWaitFor(&g_responseCount, 1));
+    ASSERT_ARE_EQUAL(int, PNP_STATUS_TIMEOUT, g_responses[0].Status);
+
+    // The adapter completes the command after it has been answered, its result must not be sent a second time
+    g_releaseBlocked = true;
+    ASSERT_IS_TRUE(TestWaitFor(&g_completedCount, 1));
+
+    // A later command of the component still runs and is answered
+    TestSubmit(executor, &component, 2, "read");
+    ASSERT_IS_TRUE(TestWaitFor(&g_responseCount, 2));
+    CommandExecutor_Destroy(executor);
+
+    ASSERT_ARE_EQUAL(int, 2, g_responseCount);
+    ASSERT_ARE_EQUAL(int, 2, (int)g_responses[1].MethodId);
+    ASSERT_ARE_EQUAL(int, PNP_STATUS_SUCCESS, g_responses[1].Status);
+    ASSERT_ARE_EQUAL(char_ptr, "\"read\"", g_responses[1].Payload);
+}
+
+TEST_FUNCTION(CommandExecutor_Destroy_answers_queued_commands_with_error)
+{
+    PNPADAPTER_COMPONENT_TAG component;
+    TestComponent_Init(&component, "sensor");
+
+    COMMAND_EXECUTOR_HANDLE executor = CommandExecutor_Create(TEST_LONG_TIMEOUT_MS);
+    ASSERT_IS_NOT_NULL(executor);
+
+    TestSubmit(executor, &component, 1, "block");
+    ASSERT_IS_TRUE(TestWaitFor(&g_startedCount, 1));
+    TestSubmit(executor, &component, 2, "second");
+    TestSubmit(executor, &component, 3, "third");
+
+    THREAD_HANDLE releaseThread;
+    ASSERT_ARE_EQUAL(int, THREADAPI_OK, ThreadAPI_Create(&releaseThread, TestReleaseBlocked_Thread, NULL));
+
+    // Waits for the running command, the commands that have not started are answered without running
+    CommandExecutor_Destroy(executor);
+
+    int res = 0;
+    ThreadAPI_Join(releaseThread, &res);
+
+    ASSERT_ARE_EQUAL(int, 1, g_startedCount);
+    ASSERT_ARE_EQUAL(int, 3, g_responseCount);
+
+    const TestResponse* running = TestFindResponse(1);
+    ASSERT_IS_NOT_NULL(running);
+    ASSERT_ARE_EQUAL(int, PNP_STATUS_SUCCESS, running->Status);
+    ASSERT_ARE_EQUAL(char_ptr, "\"block\"", running->Payload);
+
+    for (int methodId = 2; methodId <= 3; methodId++)
+    {
+        const TestResponse* queued = TestFindResponse(methodId);
+        ASSERT_IS_NOT_NULL(queued);
+        ASSERT_ARE_EQUAL(int, PNP_STATUS_INTERNAL_ERROR, queued->Status);
+    }
+    ASSERT_IS_TRUE(2 == g_failedCommands);
+}
+
+TEST_FUNCTION(CommandExecutor_Run_returns_answer_of_component)
+{
+    PNPADAPTER_COMPONENT_TAG component;
+    TestComponent_Init(&component, "sensor");
+
+    COMMAND_EXECUTOR_HANDLE executor = CommandExecutor_Create(TEST_LONG_TIMEOUT_MS);
+    ASSERT_IS_NOT_NULL(executor);
+
+    unsigned char* response = NULL;
+    size_t responseSize = 0;
+    JSON_Value* commandValue = json_value_init_null();
+    ASSERT_IS_NOT_NULL(commandValue);
+    int status = CommandExecutor_Run(executor, &component, "read", commandValue, &response, &responseSize);
+    CommandExecutor_Destroy(executor);
+
+    ASSERT_ARE_EQUAL(int, PNP_STATUS_SUCCESS, status);
+    ASSERT_ARE_EQUAL(size_t, 6, responseSize);
+    ASSERT_ARE_EQUAL(int, 0, memcmp("\"read\"", response, responseSize));
+    free(response);
+
+    // The answer is returned to the caller instead of being sent through the client handle
+    ASSERT_ARE_EQUAL(int, 0, g_responseCount);
+}
+
+TEST_FUNCTION(CommandExecutor_Run_returns_timeout_for_slow_command)
+{
+    PNPADAPTER_COMPONENT_TAG component;
+    TestComponent_Init(&component, "sensor");
+
+    COMMAND_EXECUTOR_HANDLE executor = CommandExecutor_Create(100);
+    ASSERT_IS_NOT_NULL(executor);
+
+    unsigned char* response = NULL;
+    size_t responseSize = 0;
+    JSON_Value* commandValue = json_value_init_null();
+    ASSERT_IS_NOT_NULL(commandValue);
+    int status = CommandExecutor_Run(executor, &component, "block", commandValue, &response, &responseSize);
+
+    ASSERT_ARE_EQUAL(int, PNP_STATUS_TIMEOUT, status);
+    ASSERT_ARE_EQUAL(size_t, strlen("\"Command timed out\""), responseSize);
+    ASSERT_ARE_EQUAL(int, 0, memcmp("\"Command timed out\"", response, responseSize));
+    free(response);
+
+    // The late result of the adapter is dropped
+    g_releaseBlocked = true;
+    ASSERT_IS_TRUE(TestWaitFor(&g_completedCount, 1));
+    CommandExecutor_Destroy(executor);
+    ASSERT_ARE_EQUAL(int, 0, g_responseCount);
+    ASSERT_IS_TRUE(1 == g_failedCommands);
+}
+
+END_TEST_SUITE(command_executor_ut)
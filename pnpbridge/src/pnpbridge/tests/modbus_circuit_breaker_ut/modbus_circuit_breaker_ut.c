@@ -0,0 +1,99 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "ModbusCircuitBreaker.h"
+
+BEGIN_TEST_SUITE(modbus_circuit_breaker_ut)
+
+TEST_FUNCTION(ModbusCircuitBreaker_opens_after_consecutive_failures)
+{
+    ModbusCircuitBreaker breaker;
+    ModbusCircuitBreaker_Init(&breaker, 3, 1000, 8000);
+
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_Allow(&breaker, 0));
+    ASSERT_IS_FALSE(ModbusCircuitBreaker_RecordFailure(&breaker, 0));
+    ASSERT_IS_FALSE(ModbusCircuitBreaker_RecordFailure(&breaker, 100));
+
+    // A success in between starts the count over
+    ASSERT_IS_FALSE(ModbusCircuitBreaker_RecordSuccess(&breaker));
+    ASSERT_IS_FALSE(ModbusCircuitBreaker_RecordFailure(&breaker, 200));
+    ASSERT_IS_FALSE(ModbusCircuitBreaker_RecordFailure(&breaker, 300));
+    ASSERT_ARE_EQUAL(int, ModbusBreakerClosed, breaker.State);
+
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_RecordFailure(&breaker, 400));
+    ASSERT_ARE_EQUAL(int, ModbusBreakerOpen, breaker.State);
+    ASSERT_ARE_EQUAL(uint32_t, 1000, breaker.Backoff);
+    ASSERT_ARE_EQUAL(uint32_t, 1, breaker.TripCount);
+    ASSERT_IS_FALSE(ModbusCircuitBreaker_Allow(&breaker, 400));
+    ASSERT_IS_FALSE(ModbusCircuitBreaker_Allow(&breaker, 1399));
+}
+
+TEST_FUNCTION(ModbusCircuitBreaker_lets_a_single_probe_through_once_backoff_elapsed)
+{
+    ModbusCircuitBreaker breaker;
+    ModbusCircuitBreaker_Init(&breaker, 1, 1000, 8000);
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_RecordFailure(&breaker, 0));
+
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_Allow(&breaker, 1000));
+    ASSERT_ARE_EQUAL(int, ModbusBreakerHalfOpen, breaker.State);
+
+    // Other requests wait for the outcome of the probe
+    ASSERT_IS_FALSE(ModbusCircuitBreaker_Allow(&breaker, 1001));
+
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_RecordSuccess(&breaker));
+    ASSERT_ARE_EQUAL(int, ModbusBreakerClosed, breaker.State);
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_Allow(&breaker, 1002));
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_Allow(&breaker, 1002));
+}
+
+TEST_FUNCTION(ModbusCircuitBreaker_backs_off_exponentially_while_probes_fail)
+{
+    ModbusCircuitBreaker breaker;
+    ModbusCircuitBreaker_Init(&breaker, 1, 1000, 5000);
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_RecordFailure(&breaker, 0));
+
+    const uint32_t backoffs[] = { 2000, 4000, 5000, 5000 };
+    uint64_t now = 0;
+    for (size_t i = 0; i < sizeof(backoffs) / sizeof(backoffs[0]); i++)
+    {
+        now = breaker.RetryTime;
+        ASSERT_IS_TRUE(ModbusCircuitBreaker_Allow(&breaker, now));
+        ASSERT_IS_TRUE(ModbusCircuitBreaker_RecordFailure(&breaker, now + 10));
+        ASSERT_ARE_EQUAL(uint32_t, backoffs[i], breaker.Backoff);
+        ASSERT_ARE_EQUAL(uint64_t, now + 10 + backoffs[i], breaker.RetryTime);
+    }
+    ASSERT_ARE_EQUAL(uint32_t, 1, breaker.TripCount);
+
+    // Once the unit answers, the next outage starts from the minimum backoff again
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_Allow(&breaker, breaker.RetryTime));
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_RecordSuccess(&breaker));
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_RecordFailure(&breaker, 100000));
+    ASSERT_ARE_EQUAL(uint32_t, 1000, breaker.Backoff);
+    ASSERT_ARE_EQUAL(uint32_t, 2, breaker.TripCount);
+}
+
+TEST_FUNCTION(ModbusCircuitBreaker_ignores_late_failures_while_open)
+{
+    ModbusCircuitBreaker breaker;
+    ModbusCircuitBreaker_Init(&breaker, 1, 1000, 8000);
+    ASSERT_IS_TRUE(ModbusCircuitBreaker_RecordFailure(&breaker, 0));
+
+    // A request let through before the breaker opened fails afterwards
+    ASSERT_IS_FALSE(ModbusCircuitBreaker_RecordFailure(&breaker, 500));
+    ASSERT_ARE_EQUAL(uint32_t, 1000, breaker.Backoff);
+    ASSERT_ARE_EQUAL(uint64_t, 1000, breaker.RetryTime);
+}
+
+END_TEST_SUITE(modbus_circuit_breaker_ut)
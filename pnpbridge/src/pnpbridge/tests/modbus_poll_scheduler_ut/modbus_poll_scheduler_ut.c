@@ -0,0 +1,222 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "ModbusPollScheduler.h"
+
+// Time every simulated poll takes, the old per-thread loop waited a full period after each of these
+#define TEST_POLL_DURATION 30
+
+BEGIN_TEST_SUITE(modbus_poll_scheduler_ut)
+
+TEST_FUNCTION(ModbusPollQueue_pops_entries_in_deadline_order)
+{
+    ModbusPollQueue queue;
+    const uint64_t deadlines[] = { 500, 20, 300, 20, 0, 1000, 40, 7 };
+    const size_t count = sizeof(deadlines) / sizeof(deadlines[0]);
+    ASSERT_IS_TRUE(ModbusPollQueue_Init(&queue, count));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ASSERT_IS_NOT_NULL(ModbusPollQueue_Add(&queue, 1000, NULL, deadlines[i]));
+    }
+    ASSERT_IS_NULL(ModbusPollQueue_Add(&queue, 1000, NULL, 0));
+
+    uint64_t previous = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        PModbusPollEntry entry = ModbusPollQueue_Pop(&queue);
+        ASSERT_IS_NOT_NULL(entry);
+        ASSERT_IS_TRUE(entry->Deadline >= previous);
+        previous = entry->Deadline;
+    }
+    ASSERT_IS_NULL(ModbusPollQueue_Peek(&queue));
+    ASSERT_IS_NULL(ModbusPollQueue_Pop(&queue));
+
+    ModbusPollQueue_Deinit(&queue);
+}
+
+TEST_FUNCTION(ModbusPollQueue_reschedule_does_not_drift)
+{
+    ModbusPollQueue queue;
+    ASSERT_IS_TRUE(ModbusPollQueue_Init(&queue, 1));
+    ASSERT_IS_NOT_NULL(ModbusPollQueue_Add(&queue, 1000, NULL, 0));
+
+    // Every poll starts 5 ms late and takes TEST_POLL_DURATION, deadlines stay on the 1000 ms grid
+    for (uint64_t i = 0; i < 100; i++)
+    {
+        PModbusPollEntry entry = ModbusPollQueue_Pop(&queue);
+        ASSERT_ARE_EQUAL(int, (int)(i * 1000), (int)entry->Deadline);
+        uint64_t start = entry->Deadline + 5;
+        ASSERT_ARE_EQUAL(int, 0, ModbusPollQueue_Reschedule(&queue, entry, start, start + TEST_POLL_DURATION));
+    }
+
+    PModbusPollEntry entry = ModbusPollQueue_Peek(&queue);
+    ASSERT_ARE_EQUAL(int, 100000, (int)entry->Deadline);
+    ASSERT_ARE_EQUAL(int, 100, entry->PollCount);
+    ASSERT_ARE_EQUAL(int, 5, ModbusPollEntry_GetAverageJitter(entry));
+    ASSERT_ARE_EQUAL(int, 5, entry->MaxJitter);
+    ASSERT_ARE_EQUAL(int, 0, entry->SkippedCount);
+
+    ModbusPollQueue_Deinit(&queue);
+}
+
+TEST_FUNCTION(ModbusPollQueue_reschedule_skips_polls_that_are_a_period_late)
+{
+    ModbusPollQueue queue;
+    ASSERT_IS_TRUE(ModbusPollQueue_Init(&queue, 1));
+    ASSERT_IS_NOT_NULL(ModbusPollQueue_Add(&queue, 100, NULL, 0));
+
+    // A poll that takes 350 ms: the polls due at 100, 200 and 300 are late; 100 and 200 are a full period late
+    PModbusPollEntry entry = ModbusPollQueue_Pop(&queue);
+    ASSERT_ARE_EQUAL(int, 2, ModbusPollQueue_Reschedule(&queue, entry, 0, 350));
+    ASSERT_ARE_EQUAL(int, 300, (int)entry->Deadline);
+    ASSERT_ARE_EQUAL(int, 2, entry->SkippedCount);
+
+    // The late poll runs right away and then the schedule is back on the grid
+    entry = ModbusPollQueue_Pop(&queue);
+    ASSERT_ARE_EQUAL(int, 0, ModbusPollQueue_Reschedule(&queue, entry, 350, 360));
+    ASSERT_ARE_EQUAL(int, 400, (int)entry->Deadline);
+    ASSERT_ARE_EQUAL(int, 50, entry->MaxJitter);
+    ASSERT_ARE_EQUAL(int, 25, ModbusPollEntry_GetAverageJitter(entry));
+
+    ModbusPollQueue_Deinit(&queue);
+}
+
+TEST_FUNCTION(ModbusPollQueue_single_thread_serves_many_periods_without_drift)
+{
+    // Simulates the scheduler loop on a virtual clock: 40 points at four frequencies, each poll blocking
+    // the connection for TEST_POLL_DURATION ms, compared against the per-thread "read, then wait a period" loop.
+    const uint32_t periods[] = { 1000, 5000, 30000, 60000 };
+    const size_t pointCount = 40;
+    const uint64_t runTime = 10 * 60 * 1000;
+    ModbusPollQueue queue;
+    ASSERT_IS_TRUE(ModbusPollQueue_Init(&queue, pointCount));
+
+    for (size_t i = 0; i < pointCount; i++)
+    {
+        ASSERT_IS_NOT_NULL(ModbusPollQueue_Add(&queue, periods[i % 4], NULL, 0));
+    }
+
+    uint64_t now = 0;
+    for (;;)
+    {
+        PModbusPollEntry entry = ModbusPollQueue_Peek(&queue);
+        if (entry->Deadline > now)
+        {
+            now = entry->Deadline;
+        }
+        if (now >= runTime)
+        {
+            break;
+        }
+
+        entry = ModbusPollQueue_Pop(&queue);
+        (void)ModbusPollQueue_Reschedule(&queue, entry, now, now + TEST_POLL_DURATION);
+        now += TEST_POLL_DURATION;
+    }
+
+    for (size_t i = 0; i < pointCount; i++)
+    {
+        const ModbusPollEntry* entry = &queue.Entries[i];
+        uint32_t period = entry->Period;
+
+        // Drift free: exactly one poll per elapsed period
+        ASSERT_ARE_EQUAL(int, (int)(runTime / period), (int)(entry->PollCount + entry->SkippedCount));
+        ASSERT_ARE_EQUAL(int, 0, entry->SkippedCount);
+        // Jitter is bounded by the other polls that fall due at the same time
+        ASSERT_IS_TRUE(entry->MaxJitter < pointCount * TEST_POLL_DURATION);
+
+        // A thread that waits a full period after each poll only manages runTime / (period + poll time) polls
+        uint32_t driftingPolls = (uint32_t)(runTime / (period + TEST_POLL_DURATION));
+        ASSERT_IS_TRUE(entry->PollCount > driftingPolls);
+    }
+
+    ModbusPollQueue_Deinit(&queue);
+}
+
+TEST_FUNCTION(ModbusPollEntry_adapt_backs_off_while_steady_and_speeds_up_on_change)
+{
+    ModbusPollQueue queue;
+    ASSERT_IS_TRUE(ModbusPollQueue_Init(&queue, 1));
+    PModbusPollEntry entry = ModbusPollQueue_Add(&queue, 5000, NULL, 0);
+    ASSERT_IS_NOT_NULL(entry);
+    ModbusPollEntry_SetAdaptive(entry, 1000, 30000);
+    ASSERT_ARE_EQUAL(int, 5000, entry->Period);
+
+    // Flat readings double the period up to the maximum
+    ASSERT_IS_TRUE(ModbusPollEntry_Adapt(entry, ModbusPollSteady));
+    ASSERT_ARE_EQUAL(int, 10000, entry->Period);
+    ASSERT_IS_TRUE(ModbusPollEntry_Adapt(entry, ModbusPollSteady));
+    ASSERT_IS_TRUE(ModbusPollEntry_Adapt(entry, ModbusPollSteady));
+    ASSERT_ARE_EQUAL(int, 30000, entry->Period);
+    ASSERT_IS_FALSE(ModbusPollEntry_Adapt(entry, ModbusPollSteady));
+
+    // A failed poll says nothing about the value
+    ASSERT_IS_FALSE(ModbusPollEntry_Adapt(entry, ModbusPollFailed));
+    ASSERT_ARE_EQUAL(int, 30000, entry->Period);
+
+    // A change drops straight to the minimum period
+    ASSERT_IS_TRUE(ModbusPollEntry_Adapt(entry, ModbusPollChanged));
+    ASSERT_ARE_EQUAL(int, 1000, entry->Period);
+    ASSERT_IS_FALSE(ModbusPollEntry_Adapt(entry, ModbusPollChanged));
+
+    ModbusPollQueue_Deinit(&queue);
+}
+
+TEST_FUNCTION(ModbusPollEntry_adapt_leaves_fixed_periods_alone)
+{
+    ModbusPollQueue queue;
+    ASSERT_IS_TRUE(ModbusPollQueue_Init(&queue, 2));
+    PModbusPollEntry entry = ModbusPollQueue_Add(&queue, 5000, NULL, 0);
+    ASSERT_IS_FALSE(ModbusPollEntry_Adapt(entry, ModbusPollSteady));
+    ASSERT_IS_FALSE(ModbusPollEntry_Adapt(entry, ModbusPollChanged));
+    ASSERT_ARE_EQUAL(int, 5000, entry->Period);
+
+    // The configured period is clamped into the adaptive range
+    entry = ModbusPollQueue_Add(&queue, 500, NULL, 0);
+    ModbusPollEntry_SetAdaptive(entry, 1000, 30000);
+    ASSERT_ARE_EQUAL(int, 1000, entry->Period);
+
+    ModbusPollQueue_Deinit(&queue);
+}
+
+TEST_FUNCTION(ModbusPollQueue_adaptive_poll_follows_its_period_on_reschedule)
+{
+    ModbusPollQueue queue;
+    ASSERT_IS_TRUE(ModbusPollQueue_Init(&queue, 1));
+    PModbusPollEntry entry = ModbusPollQueue_Add(&queue, 1000, NULL, 0);
+    ModbusPollEntry_SetAdaptive(entry, 1000, 8000);
+
+    // Steady readings space the polls out: 0, 2000, 6000, 14000, 22000
+    const int expected[] = { 0, 2000, 6000, 14000, 22000 };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+    {
+        entry = ModbusPollQueue_Pop(&queue);
+        ASSERT_ARE_EQUAL(int, expected[i], (int)entry->Deadline);
+        (void)ModbusPollEntry_Adapt(entry, ModbusPollSteady);
+        ASSERT_ARE_EQUAL(int, 0, ModbusPollQueue_Reschedule(&queue, entry, entry->Deadline, entry->Deadline + TEST_POLL_DURATION));
+    }
+
+    // A change brings the next poll in a minimum period after the last one
+    entry = ModbusPollQueue_Pop(&queue);
+    ASSERT_ARE_EQUAL(int, 30000, (int)entry->Deadline);
+    (void)ModbusPollEntry_Adapt(entry, ModbusPollChanged);
+    ASSERT_ARE_EQUAL(int, 0, ModbusPollQueue_Reschedule(&queue, entry, entry->Deadline, entry->Deadline + TEST_POLL_DURATION));
+    ASSERT_ARE_EQUAL(int, 31000, (int)ModbusPollQueue_Peek(&queue)->Deadline);
+
+    ModbusPollQueue_Deinit(&queue);
+}
+
+END_TEST_SUITE(modbus_poll_scheduler_ut)
@@ -0,0 +1,271 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "ModbusReadBlock.h"
+
+static ModbusReadBlockItem MakeItem(uint8_t functionCode, uint16_t address, uint16_t length, int frequency)
+{
+    ModbusReadBlockItem item;
+    memset(&item, 0, sizeof(item));
+    item.Type = Telemetry;
+    item.FunctionCode = functionCode;
+    item.Address = address;
+    item.Length = length;
+    item.Frequency = frequency;
+    return item;
+}
+
+BEGIN_TEST_SUITE(modbus_read_block_ut)
+
+TEST_FUNCTION(ModbusPnp_PlanReadBlocks_merges_neighbouring_registers_with_same_frequency)
+{
+    // co2 (40001) and temperature (40003) from the DL679 sample, both polled every 5 seconds
+    ModbusReadBlockItem items[2];
+    items[0] = MakeItem(ReadHoldingRegisters, 0, 1, 5000);
+    items[1] = MakeItem(ReadHoldingRegisters, 2, 1, 5000);
+
+    PModbusReadBlock blocks = NULL;
+    size_t blockCount = 0;
+    ASSERT_IS_TRUE(ModbusPnp_PlanReadBlocks(items, 2, MODBUS_DEFAULT_MAX_READ_GAP, &blocks, &blockCount));
+
+    ASSERT_ARE_EQUAL(size_t, 1, blockCount);
+    ASSERT_ARE_EQUAL(int, ReadHoldingRegisters, blocks[0].FunctionCode);
+    ASSERT_ARE_EQUAL(int, 0, blocks[0].StartAddress);
+    ASSERT_ARE_EQUAL(int, 3, blocks[0].Length);
+    ASSERT_ARE_EQUAL(int, 5000, blocks[0].Frequency);
+    ASSERT_ARE_EQUAL(size_t, 2, blocks[0].ItemCount);
+
+    ModbusPnp_FreeReadBlocks(blocks, blockCount);
+}
+
+TEST_FUNCTION(ModbusPnp_PlanReadBlocks_keeps_function_codes_and_frequencies_apart)
+{
+    ModbusReadBlockItem items[4];
+    items[0] = MakeItem(ReadHoldingRegisters, 0, 1, 5000);
+    items[1] = MakeItem(ReadHoldingRegisters, 1, 1, 60000);
+    items[2] = MakeItem(ReadInputRegisters, 2, 1, 5000);
+    items[3] = MakeItem(ReadCoils, 304, 1, 1000);
+
+    PModbusReadBlock blocks = NULL;
+    size_t blockCount = 0;
+    ASSERT_IS_TRUE(ModbusPnp_PlanReadBlocks(items, 4, MODBUS_DEFAULT_MAX_READ_GAP, &blocks, &blockCount));
+
+    ASSERT_ARE_EQUAL(size_t, 4, blockCount);
+    for (size_t i = 0; i < blockCount; i++)
+    {
+        ASSERT_ARE_EQUAL(size_t, 1, blocks[i].ItemCount);
+        ASSERT_ARE_EQUAL(int, blocks[i].Items[0].Address, blocks[i].StartAddress);
+        ASSERT_ARE_EQUAL(int, blocks[i].Items[0].Length, blocks[i].Length);
+    }
+
+    ModbusPnp_FreeReadBlocks(blocks, blockCount);
+}
+
+TEST_FUNCTION(ModbusPnp_PlanReadBlocks_splits_on_gap_threshold)
+{
+    ModbusReadBlockItem items[3];
+    items[0] = MakeItem(ReadHoldingRegisters, 100, 2, 1000);
+    items[1] = MakeItem(ReadHoldingRegisters, 106, 1, 1000);   // 4 unused registers after the first item
+    items[2] = MakeItem(ReadHoldingRegisters, 112, 1, 1000);   // 5 unused registers after the second item
+
+    PModbusReadBlock blocks = NULL;
+    size_t blockCount = 0;
+    ASSERT_IS_TRUE(ModbusPnp_PlanReadBlocks(items, 3, 4, &blocks, &blockCount));
+
+    ASSERT_ARE_EQUAL(size_t, 2, blockCount);
+    ASSERT_ARE_EQUAL(int, 100, blocks[0].StartAddress);
+    ASSERT_ARE_EQUAL(int, 7, blocks[0].Length);
+    ASSERT_ARE_EQUAL(size_t, 2, blocks[0].ItemCount);
+    ASSERT_ARE_EQUAL(int, 112, blocks[1].StartAddress);
+    ASSERT_ARE_EQUAL(size_t, 1, blocks[1].ItemCount);
+
+    ModbusPnp_FreeReadBlocks(blocks, blockCount);
+}
+
+TEST_FUNCTION(ModbusPnp_PlanReadBlocks_negative_gap_disables_coalescing)
+{
+    ModbusReadBlockItem items[2];
+    items[0] = MakeItem(ReadHoldingRegisters, 0, 1, 5000);
+    items[1] = MakeItem(ReadHoldingRegisters, 1, 1, 5000);
+
+    PModbusReadBlock blocks = NULL;
+    size_t blockCount = 0;
+    ASSERT_IS_TRUE(ModbusPnp_PlanReadBlocks(items, 2, -1, &blocks, &blockCount));
+    ASSERT_ARE_EQUAL(size_t, 2, blockCount);
+
+    ModbusPnp_FreeReadBlocks(blocks, blockCount);
+}
+
+TEST_FUNCTION(ModbusPnp_PlanReadBlocks_respects_register_limit)
+{
+    ModbusReadBlockItem items[3];
+    items[0] = MakeItem(ReadHoldingRegisters, 0, 100, 1000);
+    items[1] = MakeItem(ReadHoldingRegisters, 100, 25, 1000);   // ends exactly at the limit
+    items[2] = MakeItem(ReadHoldingRegisters, 125, 1, 1000);
+
+    PModbusReadBlock blocks = NULL;
+    size_t blockCount = 0;
+    ASSERT_IS_TRUE(ModbusPnp_PlanReadBlocks(items, 3, MODBUS_DEFAULT_MAX_READ_GAP, &blocks, &blockCount));
+
+    ASSERT_ARE_EQUAL(size_t, 2, blockCount);
+    ASSERT_ARE_EQUAL(int, MODBUS_READ_MAX_REGISTERS, blocks[0].Length);
+    ASSERT_ARE_EQUAL(int, 125, blocks[1].StartAddress);
+
+    ModbusPnp_FreeReadBlocks(blocks, blockCount);
+}
+
+TEST_FUNCTION(ModbusPnp_PlanReadBlocks_handles_overlapping_items)
+{
+    ModbusReadBlockItem items[2];
+    items[0] = MakeItem(ReadHoldingRegisters, 10, 4, 1000);
+    items[1] = MakeItem(ReadHoldingRegisters, 11, 1, 1000);
+
+    PModbusReadBlock blocks = NULL;
+    size_t blockCount = 0;
+    ASSERT_IS_TRUE(ModbusPnp_PlanReadBlocks(items, 2, 0, &blocks, &blockCount));
+
+    ASSERT_ARE_EQUAL(size_t, 1, blockCount);
+    ASSERT_ARE_EQUAL(int, 10, blocks[0].StartAddress);
+    ASSERT_ARE_EQUAL(int, 4, blocks[0].Length);
+
+    ModbusPnp_FreeReadBlocks(blocks, blockCount);
+}
+
+TEST_FUNCTION(ModbusPnp_PlanReadBlocks_keeps_adaptive_polling_apart)
+{
+    ModbusReadBlockItem items[4];
+    items[0] = MakeItem(ReadHoldingRegisters, 0, 1, 5000);
+    items[1] = MakeItem(ReadHoldingRegisters, 1, 1, 5000);
+    items[1].AdaptivePolling.MinInterval = 1000;
+    items[1].AdaptivePolling.MaxInterval = 60000;
+    items[2] = MakeItem(ReadHoldingRegisters, 2, 1, 5000);
+    items[2].AdaptivePolling = items[1].AdaptivePolling;
+    items[3] = MakeItem(ReadHoldingRegisters, 3, 1, 5000);
+    items[3].AdaptivePolling = items[1].AdaptivePolling;
+    items[3].AdaptivePolling.ChangeThreshold = 0.5;
+
+    PModbusReadBlock blocks = NULL;
+    size_t blockCount = 0;
+    ASSERT_IS_TRUE(ModbusPnp_PlanReadBlocks(items, 4, MODBUS_DEFAULT_MAX_READ_GAP, &blocks, &blockCount));
+
+    // Only the two items that adapt the same way share a block
+    ASSERT_ARE_EQUAL(size_t, 3, blockCount);
+    ASSERT_ARE_EQUAL(size_t, 1, blocks[0].ItemCount);
+    ASSERT_ARE_EQUAL(int, 0, blocks[0].AdaptivePolling.MinInterval);
+    ASSERT_ARE_EQUAL(size_t, 2, blocks[1].ItemCount);
+    ASSERT_ARE_EQUAL(int, 1, blocks[1].StartAddress);
+    ASSERT_ARE_EQUAL(int, 1000, blocks[1].AdaptivePolling.MinInterval);
+    ASSERT_ARE_EQUAL(int, 60000, blocks[1].AdaptivePolling.MaxInterval);
+    ASSERT_ARE_EQUAL(size_t, 1, blocks[2].ItemCount);
+    ASSERT_ARE_EQUAL(int, 3, blocks[2].StartAddress);
+
+    ModbusPnp_FreeReadBlocks(blocks, blockCount);
+}
+
+TEST_FUNCTION(ModbusPnp_GetReadBlockDataSize_counts_registers_and_packed_bits)
+{
+    ModbusReadBlockItem registers[2];
+    registers[0] = MakeItem(ReadHoldingRegisters, 0, 1, 5000);
+    registers[1] = MakeItem(ReadHoldingRegisters, 2, 2, 5000);
+    ModbusReadBlockItem coils[2];
+    coils[0] = MakeItem(ReadCoils, 300, 1, 1000);
+    coils[1] = MakeItem(ReadCoils, 305, 4, 1000);
+
+    PModbusReadBlock blocks = NULL;
+    size_t blockCount = 0;
+    ASSERT_IS_TRUE(ModbusPnp_PlanReadBlocks(registers, 2, MODBUS_DEFAULT_MAX_READ_GAP, &blocks, &blockCount));
+    ASSERT_ARE_EQUAL(size_t, 1, blockCount);
+    ASSERT_ARE_EQUAL(int, 8, ModbusPnp_GetReadBlockDataSize(&blocks[0]));
+    ModbusPnp_FreeReadBlocks(blocks, blockCount);
+
+    // Coils 300..308 are packed into two bytes
+    ASSERT_IS_TRUE(ModbusPnp_PlanReadBlocks(coils, 2, MODBUS_DEFAULT_MAX_READ_GAP, &blocks, &blockCount));
+    ASSERT_ARE_EQUAL(size_t, 1, blockCount);
+    ASSERT_ARE_EQUAL(int, 9, blocks[0].Length);
+    ASSERT_ARE_EQUAL(int, 2, ModbusPnp_GetReadBlockDataSize(&blocks[0]));
+    ModbusPnp_FreeReadBlocks(blocks, blockCount);
+}
+
+TEST_FUNCTION(ModbusPnp_DecodeReadBlock_decodes_and_scales_every_item)
+{
+    ModbusReadBlockItem items[3];
+    items[0] = MakeItem(ReadHoldingRegisters, 0, 1, 5000);
+    items[0].DataType = NUMERIC;
+    items[0].NumberFormat.Type = ModbusInt16;
+    items[0].ConversionCoefficient = 0.01;
+    items[1] = MakeItem(ReadHoldingRegisters, 1, 2, 5000);
+    items[1].DataType = NUMERIC;
+    items[1].NumberFormat.Type = ModbusFloat32;
+    items[1].NumberFormat.WordOrder = ModbusLittleEndian;
+    items[1].ConversionCoefficient = 2;
+    items[2] = MakeItem(ReadHoldingRegisters, 3, 1, 5000);
+    items[2].DataType = HEXSTRING;
+    items[2].ConversionCoefficient = 1;
+
+    PModbusReadBlock blocks = NULL;
+    size_t blockCount = 0;
+    ASSERT_IS_TRUE(ModbusPnp_PlanReadBlocks(items, 3, MODBUS_DEFAULT_MAX_READ_GAP, &blocks, &blockCount));
+    ASSERT_ARE_EQUAL(size_t, 1, blockCount);
+
+    // -2357, then 1.5f low word first, then 0x0A0B
+    const uint8_t blockData[] = { 0xF6, 0xCB, 0x00, 0x00, 0x3F, 0xC0, 0x0A, 0x0B };
+    double values[3] = { 0 };
+    char text[MODBUS_VALUE_MAX_LENGTH];
+
+    ModbusPnp_DecodeReadBlock(&blocks[0], blockData, values);
+    ASSERT_IS_TRUE(3.0 == values[1]);
+    ASSERT_IS_TRUE(0.0 == values[2]);
+
+    ASSERT_ARE_EQUAL(int, 6, ModbusPnp_FormatReadBlockItem(&blocks[0], &blocks[0].Items[0], blockData, values[0], text, sizeof(text)));
+    ASSERT_ARE_EQUAL(char_ptr, "-23.57", text);
+    ASSERT_ARE_EQUAL(int, 1, ModbusPnp_FormatReadBlockItem(&blocks[0], &blocks[0].Items[1], blockData, values[1], text, sizeof(text)));
+    ASSERT_ARE_EQUAL(char_ptr, "3", text);
+    ASSERT_ARE_EQUAL(int, 6, ModbusPnp_FormatReadBlockItem(&blocks[0], &blocks[0].Items[2], blockData, values[2], text, sizeof(text)));
+    ASSERT_ARE_EQUAL(char_ptr, "\"0A0B\"", text);
+
+    ModbusPnp_FreeReadBlocks(blocks, blockCount);
+}
+
+TEST_FUNCTION(ModbusPnp_DecodeReadBlock_reads_bits_as_booleans)
+{
+    ModbusReadBlockItem items[2];
+    items[0] = MakeItem(ReadCoils, 300, 1, 1000);
+    items[0].ConversionCoefficient = 1;
+    items[1] = MakeItem(ReadCoils, 305, 1, 1000);
+    items[1].ConversionCoefficient = 1;
+
+    PModbusReadBlock blocks = NULL;
+    size_t blockCount = 0;
+    ASSERT_IS_TRUE(ModbusPnp_PlanReadBlocks(items, 2, MODBUS_DEFAULT_MAX_READ_GAP, &blocks, &blockCount));
+    ASSERT_ARE_EQUAL(size_t, 1, blockCount);
+
+    // Coils 300..305: 300 is on, 305 off
+    const uint8_t blockData[] = { 0x01 };
+    double values[2] = { 0 };
+    char text[MODBUS_VALUE_MAX_LENGTH];
+
+    ModbusPnp_DecodeReadBlock(&blocks[0], blockData, values);
+
+    ASSERT_ARE_EQUAL(int, 4, ModbusPnp_FormatReadBlockItem(&blocks[0], &blocks[0].Items[0], blockData, values[0], text, sizeof(text)));
+    ASSERT_ARE_EQUAL(char_ptr, "true", text);
+    ASSERT_ARE_EQUAL(int, 5, ModbusPnp_FormatReadBlockItem(&blocks[0], &blocks[0].Items[1], blockData, values[1], text, sizeof(text)));
+    ASSERT_ARE_EQUAL(char_ptr, "false", text);
+
+    ModbusPnp_FreeReadBlocks(blocks, blockCount);
+}
+
+END_TEST_SUITE(modbus_read_block_ut)
@@ -0,0 +1,315 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "azure_c_shared_utility/threadapi.h"
+
+#include "ModbusRtuBus.h"
+
+#define TEST_PORT "/dev/ttyTEST0"
+#define TEST_OTHER_PORT "/dev/ttyTEST1"
+#define TEST_BAUD_RATE 9600
+
+// 9600 baud, 8 data bits, one stop bit, no parity
+static const MODBUS_RTU_LINE_SETTINGS TestLine = { TEST_BAUD_RATE, 8, 0, 0 };
+
+// Stand-in for opening serial ports, the port configuration is the handle to return
+static int OpenedPorts;
+static int ClosedPorts;
+
+static bool TestOpenPort(
+    const void* portConfig,
+    HANDLE* port)
+{
+    if (NULL == portConfig)
+    {
+        return false;
+    }
+    *port = *(const HANDLE*)portConfig;
+    OpenedPorts++;
+    return true;
+}
+
+static bool TestClosePort(
+    HANDLE port)
+{
+    (void)port;
+    ClosedPorts++;
+    return true;
+}
+
+static const HANDLE TestPortHandle = 42;
+
+// A request waiting for the bus on its own thread. Once granted the bus it records its ID in the order the bus
+// was granted, which needs no other synchronization since the bus is granted to one request at a time.
+typedef struct TestRequest {
+    MODBUS_RTU_BUS_CLIENT_HANDLE Client;
+    int32_t DeadlineMs;
+    int Id;
+    int* Order;
+    int* OrderCount;
+    THREAD_HANDLE Thread;
+} TestRequest;
+
+static int TestRequest_Thread(
+    void* context)
+{
+    TestRequest* request = (TestRequest*)context;
+    HANDLE port;
+    ModbusRtuFrameTiming timing;
+    if (!ModbusRtuBus_Claim(request->Client, request->DeadlineMs, &port, &timing, NULL))
+    {
+        return -1;
+    }
+    request->Order[(*request->OrderCount)++] = request->Id;
+    ModbusRtuBus_Yield(request->Client, NULL);
+    return 0;
+}
+
+// Queues requests, in order, while holder has the bus, then hands the bus on and waits for all of them
+static void RunQueuedRequests(
+    MODBUS_RTU_BUS_CLIENT_HANDLE holder,
+    TestRequest* requests,
+    size_t requestCount)
+{
+    HANDLE port;
+    ModbusRtuFrameTiming timing;
+    ASSERT_IS_TRUE(ModbusRtuBus_Claim(holder, 0, &port, &timing, NULL));
+
+    for (size_t i = 0; i < requestCount; i++)
+    {
+        ASSERT_ARE_EQUAL(int, THREADAPI_OK, ThreadAPI_Create(&requests[i].Thread, TestRequest_Thread, &requests[i]));
+        ThreadAPI_Sleep(20);
+    }
+
+    ModbusRtuBus_Yield(holder, NULL);
+
+    for (size_t i = 0; i < requestCount; i++)
+    {
+        int res = 0;
+        ThreadAPI_Join(requests[i].Thread, &res);
+        ASSERT_ARE_EQUAL(int, 0, res);
+    }
+}
+
+static void SetRequest(
+    TestRequest* request,
+    MODBUS_RTU_BUS_CLIENT_HANDLE client,
+    int32_t deadlineMs,
+    int id,
+    int* order,
+    int* orderCount)
+{
+    request->Client = client;
+    request->DeadlineMs = deadlineMs;
+    request->Id = id;
+    request->Order = order;
+    request->OrderCount = orderCount;
+}
+
+BEGIN_TEST_SUITE(modbus_rtu_bus_ut)
+
+TEST_FUNCTION(ModbusRtuBus_Acquire_opens_each_port_once)
+{
+    OpenedPorts = 0;
+    ClosedPorts = 0;
+    MODBUS_RTU_BUS_POOL_HANDLE pool = ModbusRtuBus_CreatePool(TestOpenPort, TestClosePort);
+    ASSERT_IS_NOT_NULL(pool);
+
+    MODBUS_RTU_BUS_CLIENT_HANDLE first = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+    MODBUS_RTU_BUS_CLIENT_HANDLE second = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+    MODBUS_RTU_BUS_CLIENT_HANDLE third = ModbusRtuBus_Acquire(pool, TEST_OTHER_PORT, &TestLine, &TestPortHandle);
+    ASSERT_IS_NOT_NULL(first);
+    ASSERT_IS_NOT_NULL(second);
+    ASSERT_IS_NOT_NULL(third);
+    ASSERT_ARE_EQUAL(int, 2, OpenedPorts);
+    ASSERT_ARE_EQUAL(int, 0, strcmp(TEST_PORT, ModbusRtuBus_GetPortName(second)));
+
+    HANDLE port = 0;
+    ModbusRtuFrameTiming timing;
+    ASSERT_IS_TRUE(ModbusRtuBus_Claim(second, 0, &port, &timing, NULL));
+    ASSERT_ARE_EQUAL(int, TestPortHandle, port);
+    ASSERT_ARE_EQUAL(uint32_t, 4011, timing.FrameGapUs);
+    ModbusRtuBus_Yield(second, NULL);
+
+    ModbusRtuBus_Release(first);
+    ASSERT_ARE_EQUAL(int, 0, ClosedPorts);
+    ModbusRtuBus_Release(second);
+    ModbusRtuBus_Release(third);
+    ASSERT_ARE_EQUAL(int, 2, ClosedPorts);
+
+    ModbusRtuBus_DestroyPool(pool);
+}
+
+TEST_FUNCTION(ModbusRtuBus_Acquire_rejects_port_open_with_other_line_settings)
+{
+    ClosedPorts = 0;
+    MODBUS_RTU_BUS_POOL_HANDLE pool = ModbusRtuBus_CreatePool(TestOpenPort, TestClosePort);
+
+    MODBUS_RTU_BUS_CLIENT_HANDLE first = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+    ASSERT_IS_NOT_NULL(first);
+
+    MODBUS_RTU_LINE_SETTINGS otherBaudRate = TestLine;
+    otherBaudRate.BaudRate = 19200;
+    MODBUS_RTU_LINE_SETTINGS otherDataBits = TestLine;
+    otherDataBits.DataBits = 7;
+    MODBUS_RTU_LINE_SETTINGS otherStopBits = TestLine;
+    otherStopBits.StopBits = 2;
+    MODBUS_RTU_LINE_SETTINGS otherParity = TestLine;
+    otherParity.Parity = 2;
+
+    ASSERT_IS_NULL(ModbusRtuBus_Acquire(pool, TEST_PORT, &otherBaudRate, &TestPortHandle));
+    ASSERT_IS_NULL(ModbusRtuBus_Acquire(pool, TEST_PORT, &otherDataBits, &TestPortHandle));
+    ASSERT_IS_NULL(ModbusRtuBus_Acquire(pool, TEST_PORT, &otherStopBits, &TestPortHandle));
+    ASSERT_IS_NULL(ModbusRtuBus_Acquire(pool, TEST_PORT, &otherParity, &TestPortHandle));
+
+    ModbusRtuBus_Release(first);
+    ModbusRtuBus_DestroyPool(pool);
+    ASSERT_ARE_EQUAL(int, 1, ClosedPorts);
+}
+
+TEST_FUNCTION(ModbusRtuBus_Acquire_fails_when_port_cannot_be_opened)
+{
+    MODBUS_RTU_BUS_POOL_HANDLE pool = ModbusRtuBus_CreatePool(TestOpenPort, TestClosePort);
+
+    ASSERT_IS_NULL(ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, NULL));
+
+    // A later component on the port tries again
+    MODBUS_RTU_BUS_CLIENT_HANDLE client = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+    ASSERT_IS_NOT_NULL(client);
+
+    ModbusRtuBus_Release(client);
+    ModbusRtuBus_DestroyPool(pool);
+}
+
+TEST_FUNCTION(ModbusRtuBus_Claim_grants_earliest_deadline_first)
+{
+    MODBUS_RTU_BUS_POOL_HANDLE pool = ModbusRtuBus_CreatePool(TestOpenPort, TestClosePort);
+    MODBUS_RTU_BUS_CLIENT_HANDLE clients[4];
+    for (int i = 0; i < 4; i++)
+    {
+        clients[i] = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+        ASSERT_IS_NOT_NULL(clients[i]);
+    }
+
+    int order[3];
+    int orderCount = 0;
+    TestRequest requests[3];
+    SetRequest(&requests[0], clients[1], 1000, 1, order, &orderCount);
+    SetRequest(&requests[1], clients[2], -500, 2, order, &orderCount);
+    SetRequest(&requests[2], clients[3], 0, 3, order, &orderCount);
+    RunQueuedRequests(clients[0], requests, 3);
+
+    ASSERT_ARE_EQUAL(int, 3, orderCount);
+    ASSERT_ARE_EQUAL(int, 2, order[0]);
+    ASSERT_ARE_EQUAL(int, 3, order[1]);
+    ASSERT_ARE_EQUAL(int, 1, order[2]);
+
+    for (int i = 0; i < 4; i++)
+    {
+        ModbusRtuBus_Release(clients[i]);
+    }
+    ModbusRtuBus_DestroyPool(pool);
+}
+
+TEST_FUNCTION(ModbusRtuBus_Claim_limits_client_to_its_weight_per_round)
+{
+    MODBUS_RTU_BUS_POOL_HANDLE pool = ModbusRtuBus_CreatePool(TestOpenPort, TestClosePort);
+    MODBUS_RTU_BUS_CLIENT_HANDLE holder = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+    MODBUS_RTU_BUS_CLIENT_HANDLE busy = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+    MODBUS_RTU_BUS_CLIENT_HANDLE quiet = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+
+    // The busy client's requests are all further behind, but the quiet client gets its turn after the first
+    int order[4];
+    int orderCount = 0;
+    TestRequest requests[4];
+    SetRequest(&requests[0], busy, -300, 1, order, &orderCount);
+    SetRequest(&requests[1], busy, -200, 2, order, &orderCount);
+    SetRequest(&requests[2], busy, -100, 3, order, &orderCount);
+    SetRequest(&requests[3], quiet, 0, 4, order, &orderCount);
+    RunQueuedRequests(holder, requests, 4);
+
+    ASSERT_ARE_EQUAL(int, 4, orderCount);
+    ASSERT_ARE_EQUAL(int, 1, order[0]);
+    ASSERT_ARE_EQUAL(int, 4, order[1]);
+    ASSERT_ARE_EQUAL(int, 2, order[2]);
+    ASSERT_ARE_EQUAL(int, 3, order[3]);
+
+    ModbusRtuBus_Release(holder);
+    ModbusRtuBus_Release(busy);
+    ModbusRtuBus_Release(quiet);
+    ModbusRtuBus_DestroyPool(pool);
+}
+
+TEST_FUNCTION(ModbusRtuBus_Claim_grants_weighted_client_several_requests_per_round)
+{
+    MODBUS_RTU_BUS_POOL_HANDLE pool = ModbusRtuBus_CreatePool(TestOpenPort, TestClosePort);
+    MODBUS_RTU_BUS_CLIENT_HANDLE holder = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+    MODBUS_RTU_BUS_CLIENT_HANDLE busy = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+    MODBUS_RTU_BUS_CLIENT_HANDLE quiet = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+    ModbusRtuBus_SetWeight(busy, 2);
+
+    int order[4];
+    int orderCount = 0;
+    TestRequest requests[4];
+    SetRequest(&requests[0], busy, -300, 1, order, &orderCount);
+    SetRequest(&requests[1], busy, -200, 2, order, &orderCount);
+    SetRequest(&requests[2], busy, -100, 3, order, &orderCount);
+    SetRequest(&requests[3], quiet, 0, 4, order, &orderCount);
+    RunQueuedRequests(holder, requests, 4);
+
+    ASSERT_ARE_EQUAL(int, 4, orderCount);
+    ASSERT_ARE_EQUAL(int, 1, order[0]);
+    ASSERT_ARE_EQUAL(int, 2, order[1]);
+    ASSERT_ARE_EQUAL(int, 4, order[2]);
+    ASSERT_ARE_EQUAL(int, 3, order[3]);
+
+    ModbusRtuBus_Release(holder);
+    ModbusRtuBus_Release(busy);
+    ModbusRtuBus_Release(quiet);
+    ModbusRtuBus_DestroyPool(pool);
+}
+
+TEST_FUNCTION(ModbusRtuBus_Yield_reports_utilization_per_window)
+{
+    MODBUS_RTU_BUS_POOL_HANDLE pool = ModbusRtuBus_CreatePool(TestOpenPort, TestClosePort);
+    MODBUS_RTU_BUS_CLIENT_HANDLE client = ModbusRtuBus_Acquire(pool, TEST_PORT, &TestLine, &TestPortHandle);
+
+    // The bus is in use for half of the time
+    MODBUS_RTU_BUS_STATISTICS statistics;
+    bool windowEnded = false;
+    uint64_t exchanges = 0;
+    while (!windowEnded)
+    {
+        HANDLE port;
+        ModbusRtuFrameTiming timing;
+        ASSERT_IS_TRUE(ModbusRtuBus_Claim(client, 0, &port, &timing, NULL));
+        ThreadAPI_Sleep(10);
+        windowEnded = ModbusRtuBus_Yield(client, &statistics);
+        exchanges++;
+        ThreadAPI_Sleep(10);
+    }
+
+    ASSERT_ARE_EQUAL(uint64_t, exchanges, statistics.Transactions);
+    ASSERT_ARE_EQUAL(uint32_t, 0, statistics.WaitingRequests);
+    ASSERT_IS_TRUE(statistics.UtilizationPercent >= 25);
+    ASSERT_IS_TRUE(statistics.UtilizationPercent <= 75);
+
+    ModbusRtuBus_Release(client);
+    ModbusRtuBus_DestroyPool(pool);
+}
+
+END_TEST_SUITE(modbus_rtu_bus_ut)
@@ -0,0 +1,307 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#endif
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "testrunnerswitcher.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#include "ModbusRtuFraming.h"
+
+#define TEST_BAUD_RATE 9600
+
+// Read Holding Registers response of unit 1 carrying two registers, CRC included
+static const uint8_t ReadResponse[] = { 0x01, 0x03, 0x04, 0x00, 0x0A, 0x00, 0x0B, 0x9B, 0xF6 };
+
+// Stand-in for a Modbus RTU slave on the far end of a pseudo terminal. It writes its response in chunks,
+// pausing between them the way a slow slave or a USB serial adapter would.
+typedef struct TestSlave {
+    int Line;
+    THREAD_HANDLE Thread;
+    const uint8_t* Response;
+    size_t ResponseLength;
+    size_t ChunkLength;
+    unsigned int ChunkDelayMs;
+} TestSlave;
+
+static int TestSlave_Thread(
+    void* context)
+{
+    TestSlave* slave = (TestSlave*)context;
+    size_t sent = 0;
+    while (sent < slave->ResponseLength)
+    {
+        size_t chunk = slave->ResponseLength - sent;
+        if (chunk > slave->ChunkLength)
+        {
+            chunk = slave->ChunkLength;
+        }
+
+        ThreadAPI_Sleep(slave->ChunkDelayMs);
+        if (write(slave->Line, slave->Response + sent, chunk) != (ssize_t)chunk)
+        {
+            return -1;
+        }
+        sent += chunk;
+    }
+    return 0;
+}
+
+static void SetRawMode(
+    int fd)
+{
+    struct termios settings;
+    ASSERT_ARE_EQUAL(int, 0, tcgetattr(fd, &settings));
+    settings.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF);
+    settings.c_oflag &= ~OPOST;
+    settings.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    settings.c_cflag &= ~(CSIZE | PARENB);
+    settings.c_cflag |= CS8;
+    settings.c_cc[VMIN] = 0;
+    settings.c_cc[VTIME] = 0;
+    ASSERT_ARE_EQUAL(int, 0, tcsetattr(fd, TCSANOW, &settings));
+}
+
+// Opens a pseudo terminal, the master side standing for the serial port of the bridge and the slave side for
+// the line the simulated slave writes to
+static void OpenLine(
+    int* port,
+    int* line)
+{
+    *port = posix_openpt(O_RDWR | O_NOCTTY);
+    ASSERT_IS_TRUE(*port >= 0);
+    ASSERT_ARE_EQUAL(int, 0, grantpt(*port));
+    ASSERT_ARE_EQUAL(int, 0, unlockpt(*port));
+    *line = open(ptsname(*port), O_RDWR | O_NOCTTY);
+    ASSERT_IS_TRUE(*line >= 0);
+    SetRawMode(*line);
+    SetRawMode(*port);
+}
+
+static void TestSlave_Start(
+    TestSlave* slave,
+    int line,
+    const uint8_t* response,
+    size_t responseLength,
+    size_t chunkLength,
+    unsigned int chunkDelayMs)
+{
+    slave->Line = line;
+    slave->Response = response;
+    slave->ResponseLength = responseLength;
+    slave->ChunkLength = chunkLength;
+    slave->ChunkDelayMs = chunkDelayMs;
+    ASSERT_ARE_EQUAL(int, THREADAPI_OK, ThreadAPI_Create(&slave->Thread, TestSlave_Thread, slave));
+}
+
+static void TestSlave_Join(
+    TestSlave* slave)
+{
+    int res = 0;
+    ThreadAPI_Join(slave->Thread, &res);
+    ASSERT_ARE_EQUAL(int, 0, res);
+}
+
+// Reads a frame the simulated slave sends on a fresh line, returning its length and the time reading took
+static int ReadFrameFromSlave(
+    const uint8_t* response,
+    size_t responseLength,
+    size_t chunkLength,
+    unsigned int chunkDelayMs,
+    uint32_t responseTimeoutMs,
+    uint8_t* frame,
+    uint32_t capacity,
+    tickcounter_ms_t* elapsedMs)
+{
+    int port = -1;
+    int line = -1;
+    OpenLine(&port, &line);
+
+    ModbusRtuFrameTiming timing;
+    ModbusRtu_GetFrameTiming(TEST_BAUD_RATE, &timing);
+
+    TestSlave slave;
+    TestSlave_Start(&slave, line, response, responseLength, chunkLength, chunkDelayMs);
+
+    TICK_COUNTER_HANDLE clock = tickcounter_create();
+    tickcounter_ms_t start = 0;
+    tickcounter_ms_t end = 0;
+    (void)tickcounter_get_current_ms(clock, &start);
+
+    int result = ModbusRtu_ReadFrame(port, &timing, frame, capacity, responseTimeoutMs);
+
+    (void)tickcounter_get_current_ms(clock, &end);
+    tickcounter_destroy(clock);
+    *elapsedMs = end - start;
+
+    TestSlave_Join(&slave);
+    close(line);
+    close(port);
+    return result;
+}
+
+BEGIN_TEST_SUITE(modbus_rtu_framing_ut)
+
+TEST_FUNCTION(ModbusRtu_GetFrameTiming_derives_silent_interval_from_baud_rate)
+{
+    ModbusRtuFrameTiming timing;
+
+    ModbusRtu_GetFrameTiming(9600, &timing);
+    ASSERT_ARE_EQUAL(uint32_t, 1146, timing.CharacterTimeUs);
+    ASSERT_ARE_EQUAL(uint32_t, 4011, timing.FrameGapUs);
+
+    ModbusRtu_GetFrameTiming(19200, &timing);
+    ASSERT_ARE_EQUAL(uint32_t, 573, timing.CharacterTimeUs);
+    ASSERT_ARE_EQUAL(uint32_t, 2006, timing.FrameGapUs);
+}
+
+TEST_FUNCTION(ModbusRtu_GetFrameTiming_fixes_silent_interval_above_19200_baud)
+{
+    ModbusRtuFrameTiming timing;
+
+    ModbusRtu_GetFrameTiming(115200, &timing);
+    ASSERT_ARE_EQUAL(uint32_t, 96, timing.CharacterTimeUs);
+    ASSERT_ARE_EQUAL(uint32_t, 1750, timing.FrameGapUs);
+}
+
+TEST_FUNCTION(ModbusRtu_GetExpectedResponseLength_reads_length_from_function_code)
+{
+    const uint8_t writeResponse[] = { 0x01, 0x06, 0x00, 0x10, 0x00, 0x01 };
+    const uint8_t exceptionResponse[] = { 0x01, 0x83, 0x02 };
+    const uint8_t diagnosticsResponse[] = { 0x01, 0x08, 0x00, 0x00 };
+
+    ASSERT_ARE_EQUAL(int, 0, ModbusRtu_GetExpectedResponseLength(ReadResponse, 0));
+    ASSERT_ARE_EQUAL(int, 0, ModbusRtu_GetExpectedResponseLength(ReadResponse, 2));
+    ASSERT_ARE_EQUAL(int, (int)sizeof(ReadResponse), ModbusRtu_GetExpectedResponseLength(ReadResponse, 3));
+    ASSERT_ARE_EQUAL(int, 8, ModbusRtu_GetExpectedResponseLength(writeResponse, 2));
+    ASSERT_ARE_EQUAL(int, 5, ModbusRtu_GetExpectedResponseLength(exceptionResponse, 2));
+    ASSERT_ARE_EQUAL(int, -1, ModbusRtu_GetExpectedResponseLength(diagnosticsResponse, 2));
+}
+
+TEST_FUNCTION(ModbusRtu_IsResponseTo_matches_unit_and_function_code)
+{
+    // Read Holding Registers request to unit 1, CRC left out
+    const uint8_t request[] = { 0x01, 0x03, 0x00, 0x10, 0x00, 0x02 };
+    const uint8_t exceptionResponse[] = { 0x01, 0x83, 0x02, 0xC0, 0xF1 };
+    const uint8_t otherUnitResponse[] = { 0x02, 0x03, 0x04, 0x00, 0x0A, 0x00, 0x0B, 0x00, 0x00 };
+    const uint8_t otherFunctionResponse[] = { 0x01, 0x04, 0x04, 0x00, 0x0A, 0x00, 0x0B, 0x00, 0x00 };
+    const uint8_t otherFunctionException[] = { 0x01, 0x84, 0x02, 0x00, 0x00 };
+
+    ASSERT_IS_TRUE(ModbusRtu_IsResponseTo(request, ReadResponse, sizeof(ReadResponse)));
+    ASSERT_IS_TRUE(ModbusRtu_IsResponseTo(request, exceptionResponse, sizeof(exceptionResponse)));
+    ASSERT_IS_FALSE(ModbusRtu_IsResponseTo(request, otherUnitResponse, sizeof(otherUnitResponse)));
+    ASSERT_IS_FALSE(ModbusRtu_IsResponseTo(request, otherFunctionResponse, sizeof(otherFunctionResponse)));
+    ASSERT_IS_FALSE(ModbusRtu_IsResponseTo(request, otherFunctionException, sizeof(otherFunctionException)));
+    ASSERT_IS_FALSE(ModbusRtu_IsResponseTo(request, ReadResponse, 1));
+}
+
+TEST_FUNCTION(ModbusRtu_ReadFrame_returns_frame_once_line_is_silent)
+{
+    uint8_t frame[32];
+    tickcounter_ms_t elapsedMs = 0;
+
+    int length = ReadFrameFromSlave(ReadResponse, sizeof(ReadResponse), sizeof(ReadResponse), 0,
+        MODBUS_RTU_RESPONSE_TIMEOUT_MS, frame, sizeof(frame), &elapsedMs);
+
+    ASSERT_ARE_EQUAL(int, (int)sizeof(ReadResponse), length);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(frame, ReadResponse, sizeof(ReadResponse)));
+
+    // No fixed sleeps, the frame ends t3.5 after its last byte
+    ASSERT_IS_TRUE(elapsedMs < 100);
+}
+
+TEST_FUNCTION(ModbusRtu_ReadFrame_accumulates_frame_arriving_in_chunks)
+{
+    uint8_t frame[32];
+    tickcounter_ms_t elapsedMs = 0;
+
+    // Pauses between the chunks are longer than t3.5, the frame is complete only once all of it arrived
+    int length = ReadFrameFromSlave(ReadResponse, sizeof(ReadResponse), 2, 20,
+        MODBUS_RTU_RESPONSE_TIMEOUT_MS, frame, sizeof(frame), &elapsedMs);
+
+    ASSERT_ARE_EQUAL(int, (int)sizeof(ReadResponse), length);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(frame, ReadResponse, sizeof(ReadResponse)));
+}
+
+TEST_FUNCTION(ModbusRtu_ReadFrame_keeps_bytes_following_announced_length)
+{
+    uint8_t response[sizeof(ReadResponse) + 1];
+    memcpy(response, ReadResponse, sizeof(ReadResponse));
+    response[sizeof(ReadResponse)] = 0x55;
+    uint8_t frame[32];
+    tickcounter_ms_t elapsedMs = 0;
+
+    int length = ReadFrameFromSlave(response, sizeof(response), sizeof(response), 0,
+        MODBUS_RTU_RESPONSE_TIMEOUT_MS, frame, sizeof(frame), &elapsedMs);
+
+    ASSERT_ARE_EQUAL(int, (int)sizeof(response), length);
+}
+
+TEST_FUNCTION(ModbusRtu_ReadFrame_ends_frame_of_unknown_length_at_silent_interval)
+{
+    const uint8_t response[] = { 0x01, 0x08, 0x00, 0x00, 0xA5, 0x37, 0xDA, 0x8D };
+    uint8_t frame[32];
+    tickcounter_ms_t elapsedMs = 0;
+
+    int length = ReadFrameFromSlave(response, sizeof(response), sizeof(response), 0,
+        MODBUS_RTU_RESPONSE_TIMEOUT_MS, frame, sizeof(frame), &elapsedMs);
+
+    ASSERT_ARE_EQUAL(int, (int)sizeof(response), length);
+    ASSERT_IS_TRUE(elapsedMs < 100);
+}
+
+TEST_FUNCTION(ModbusRtu_ReadFrame_times_out_without_response)
+{
+    uint8_t frame[32];
+    tickcounter_ms_t elapsedMs = 0;
+
+    int length = ReadFrameFromSlave(ReadResponse, 0, 1, 0, 100, frame, sizeof(frame), &elapsedMs);
+
+    ASSERT_ARE_EQUAL(int, -1, length);
+    ASSERT_IS_TRUE(elapsedMs >= 100);
+    ASSERT_IS_TRUE(elapsedMs < 1000);
+}
+
+TEST_FUNCTION(ModbusRtu_ReadFrame_fails_on_frame_cut_short)
+{
+    uint8_t frame[32];
+    tickcounter_ms_t elapsedMs = 0;
+
+    int length = ReadFrameFromSlave(ReadResponse, sizeof(ReadResponse) - 3, sizeof(ReadResponse), 0,
+        100, frame, sizeof(frame), &elapsedMs);
+
+    ASSERT_ARE_EQUAL(int, -1, length);
+}
+
+TEST_FUNCTION(ModbusRtu_ReadFrame_fails_on_frame_longer_than_buffer)
+{
+    uint8_t frame[4];
+    tickcounter_ms_t elapsedMs = 0;
+
+    int length = ReadFrameFromSlave(ReadResponse, sizeof(ReadResponse), sizeof(ReadResponse), 0,
+        MODBUS_RTU_RESPONSE_TIMEOUT_MS, frame, sizeof(frame), &elapsedMs);
+
+    ASSERT_ARE_EQUAL(int, -1, length);
+}
+
+END_TEST_SUITE(modbus_rtu_framing_ut)
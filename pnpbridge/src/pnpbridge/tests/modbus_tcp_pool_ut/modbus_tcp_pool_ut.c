@@ -0,0 +1,421 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#endif
+
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "testrunnerswitcher.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#include "ModbusTcpPool.h"
+
+#define TEST_HOST "127.0.0.1"
+
+// Stand-in for a Modbus TCP slave, or a gateway to several of them. It answers Read Holding Registers requests
+// with registers holding their own address, reading every request that has arrived before answering any of them
+// so that pipelined requests are answered in batches, the way a gateway polling its serial line would.
+typedef struct TestSlave {
+    int Listener;
+    uint16_t Port;
+    THREAD_HANDLE Thread;
+    volatile bool Stop;
+    int DelayMs;                    // time taken to answer a batch of requests
+    bool Reverse;                   // answer the requests of a batch last one first
+    volatile bool DropNext;         // close the connection instead of answering the next batch
+    volatile int Accepted;
+    volatile int Answered;
+} TestSlave;
+
+static void TestSlave_Answer(
+    const uint8_t* request,
+    uint8_t* response,
+    size_t* responseLength)
+{
+    uint16_t address = (uint16_t)((request[8] << 8) | request[9]);
+    uint16_t count = (uint16_t)((request[10] << 8) | request[11]);
+
+    memcpy(response, request, 4);   // transaction and protocol IDs
+    response[4] = 0;
+    response[5] = (uint8_t)(3 + (2 * count));
+    response[6] = request[6];
+    response[7] = request[7];
+    response[8] = (uint8_t)(2 * count);
+    for (uint16_t i = 0; i < count; i++)
+    {
+        uint16_t value = (uint16_t)(address + i);
+        response[9 + (2 * i)] = (uint8_t)(value >> 8);
+        response[10 + (2 * i)] = (uint8_t)(value & 0xff);
+    }
+    *responseLength = 9 + (2 * count);
+}
+
+static void TestSlave_Serve(
+    TestSlave* slave,
+    int client)
+{
+    uint8_t received[1024];
+    size_t receivedLength = 0;
+    uint8_t responses[64][MODBUS_TCP_FRAME_MAX_LENGTH];
+    size_t responseLengths[64];
+
+    while (!slave->Stop)
+    {
+        struct pollfd pollClient = { client, POLLIN, 0 };
+        if (poll(&pollClient, 1, 20) <= 0)
+        {
+            continue;
+        }
+
+        ssize_t bytesReceived = recv(client, received + receivedLength, sizeof(received) - receivedLength, 0);
+        if (bytesReceived <= 0)
+        {
+            return;
+        }
+        receivedLength += (size_t)bytesReceived;
+
+        size_t responseCount = 0;
+        size_t offset = 0;
+        while (receivedLength - offset >= 12 && responseCount < 64)
+        {
+            TestSlave_Answer(received + offset, responses[responseCount], &responseLengths[responseCount]);
+            responseCount++;
+            offset += 12;
+        }
+        memmove(received, received + offset, receivedLength - offset);
+        receivedLength -= offset;
+
+        if (0 == responseCount)
+        {
+            continue;
+        }
+
+        if (slave->DropNext)
+        {
+            slave->DropNext = false;
+            return;
+        }
+
+        ThreadAPI_Sleep(slave->DelayMs);
+        for (size_t i = 0; i < responseCount; i++)
+        {
+            size_t index = slave->Reverse ? (responseCount - 1 - i) : i;
+            if (send(client, responses[index], responseLengths[index], 0) < 0)
+            {
+                return;
+            }
+            slave->Answered++;
+        }
+    }
+}
+
+static int TestSlave_Thread(
+    void* context)
+{
+    TestSlave* slave = (TestSlave*)context;
+
+    while (!slave->Stop)
+    {
+        struct pollfd pollListener = { slave->Listener, POLLIN, 0 };
+        if (poll(&pollListener, 1, 20) <= 0)
+        {
+            continue;
+        }
+
+        int client = accept(slave->Listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+        slave->Accepted++;
+        TestSlave_Serve(slave, client);
+        close(client);
+    }
+
+    return 0;
+}
+
+static void TestSlave_Start(
+    TestSlave* slave,
+    int delayMs,
+    bool reverse)
+{
+    memset(slave, 0, sizeof(*slave));
+    slave->DelayMs = delayMs;
+    slave->Reverse = reverse;
+
+    struct sockaddr_in address;
+    socklen_t addressLength = sizeof(address);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr(TEST_HOST);
+    address.sin_port = 0;
+
+    slave->Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ASSERT_IS_TRUE(slave->Listener >= 0);
+    ASSERT_ARE_EQUAL(int, 0, bind(slave->Listener, (struct sockaddr*)&address, sizeof(address)));
+    ASSERT_ARE_EQUAL(int, 0, listen(slave->Listener, 4));
+    ASSERT_ARE_EQUAL(int, 0, getsockname(slave->Listener, (struct sockaddr*)&address, &addressLength));
+    slave->Port = ntohs(address.sin_port);
+
+    ASSERT_ARE_EQUAL(int, THREADAPI_OK, ThreadAPI_Create(&slave->Thread, TestSlave_Thread, slave));
+}
+
+static void TestSlave_Stop(
+    TestSlave* slave)
+{
+    int res = 0;
+    slave->Stop = true;
+    ThreadAPI_Join(slave->Thread, &res);
+    close(slave->Listener);
+}
+
+static uint32_t MakeReadRequest(
+    uint8_t* request,
+    uint16_t address,
+    uint16_t count)
+{
+    memset(request, 0, 12);
+    request[5] = 6;                 // Unit ID + PDU
+    request[6] = 1;                 // Unit ID
+    request[7] = 3;                 // Read Holding Registers
+    request[8] = (uint8_t)(address >> 8);
+    request[9] = (uint8_t)(address & 0xff);
+    request[10] = (uint8_t)(count >> 8);
+    request[11] = (uint8_t)(count & 0xff);
+    return 12;
+}
+
+// Reads register address on the connection and checks it holds its own address
+static bool ReadOwnAddress(
+    MODBUS_TCP_CONNECTION_HANDLE connection,
+    uint16_t address)
+{
+    uint8_t request[12];
+    uint8_t response[MODBUS_TCP_FRAME_MAX_LENGTH];
+    uint32_t requestLength = MakeReadRequest(request, address, 1);
+
+    int responseLength = ModbusTcpPool_Transact(connection, request, requestLength, response, sizeof(response));
+    return 11 == responseLength && 3 == response[7] && 2 == response[8] &&
+        address == (uint16_t)((response[9] << 8) | response[10]);
+}
+
+typedef struct TestReader {
+    MODBUS_TCP_CONNECTION_HANDLE Connection;
+    uint16_t FirstAddress;
+    int RequestCount;
+    int Failures;
+    THREAD_HANDLE Thread;
+} TestReader;
+
+static int TestReader_Thread(
+    void* context)
+{
+    TestReader* reader = (TestReader*)context;
+    for (int i = 0; i < reader->RequestCount; i++)
+    {
+        if (!ReadOwnAddress(reader->Connection, (uint16_t)(reader->FirstAddress + i)))
+        {
+            reader->Failures++;
+        }
+    }
+    return 0;
+}
+
+// Reads requestCount registers from each of readerCount threads at once, returns the number of failed reads
+static int RunReaders(
+    MODBUS_TCP_CONNECTION_HANDLE connection,
+    TestReader* readers,
+    int readerCount,
+    int requestCount)
+{
+    for (int i = 0; i < readerCount; i++)
+    {
+        memset(&readers[i], 0, sizeof(readers[i]));
+        readers[i].Connection = connection;
+        readers[i].FirstAddress = (uint16_t)(i * 1000);
+        readers[i].RequestCount = requestCount;
+        ASSERT_ARE_EQUAL(int, THREADAPI_OK, ThreadAPI_Create(&readers[i].Thread, TestReader_Thread, &readers[i]));
+    }
+
+    int failures = 0;
+    for (int i = 0; i < readerCount; i++)
+    {
+        int res = 0;
+        ThreadAPI_Join(readers[i].Thread, &res);
+        failures += readers[i].Failures;
+    }
+    return failures;
+}
+
+BEGIN_TEST_SUITE(modbus_tcp_pool_ut)
+
+TEST_FUNCTION(ModbusTcp_GetFrameLength_waits_for_whole_frame)
+{
+    // Read Holding Registers response carrying one register
+    const uint8_t frame[] = { 0x12, 0x34, 0x00, 0x00, 0x00, 0x05, 0x01, 0x03, 0x02, 0x00, 0x2A };
+
+    ASSERT_ARE_EQUAL(int, 0, ModbusTcp_GetFrameLength(frame, 0));
+    ASSERT_ARE_EQUAL(int, 0, ModbusTcp_GetFrameLength(frame, 5));
+    ASSERT_ARE_EQUAL(int, 0, ModbusTcp_GetFrameLength(frame, sizeof(frame) - 1));
+    ASSERT_ARE_EQUAL(int, (int)sizeof(frame), ModbusTcp_GetFrameLength(frame, sizeof(frame)));
+}
+
+TEST_FUNCTION(ModbusTcp_GetFrameLength_rejects_invalid_headers)
+{
+    const uint8_t wrongProtocol[] = { 0x00, 0x01, 0x00, 0x01, 0x00, 0x05, 0x01, 0x03, 0x02, 0x00, 0x2A };
+    const uint8_t tooShort[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x01 };
+    const uint8_t tooLong[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0xFF, 0x01 };
+
+    ASSERT_ARE_EQUAL(int, -1, ModbusTcp_GetFrameLength(wrongProtocol, sizeof(wrongProtocol)));
+    ASSERT_ARE_EQUAL(int, -1, ModbusTcp_GetFrameLength(tooShort, sizeof(tooShort)));
+    ASSERT_ARE_EQUAL(int, -1, ModbusTcp_GetFrameLength(tooLong, sizeof(tooLong)));
+}
+
+TEST_FUNCTION(ModbusTcp_GetReconnectDelay_backs_off_exponentially_up_to_maximum)
+{
+    ASSERT_ARE_EQUAL(uint32_t, MODBUS_TCP_RECONNECT_MIN_DELAY_MS, ModbusTcp_GetReconnectDelay(0));
+    ASSERT_ARE_EQUAL(uint32_t, 2 * MODBUS_TCP_RECONNECT_MIN_DELAY_MS, ModbusTcp_GetReconnectDelay(1));
+    ASSERT_ARE_EQUAL(uint32_t, 8 * MODBUS_TCP_RECONNECT_MIN_DELAY_MS, ModbusTcp_GetReconnectDelay(3));
+    ASSERT_ARE_EQUAL(uint32_t, MODBUS_TCP_RECONNECT_MAX_DELAY_MS, ModbusTcp_GetReconnectDelay(20));
+    ASSERT_ARE_EQUAL(uint32_t, MODBUS_TCP_RECONNECT_MAX_DELAY_MS, ModbusTcp_GetReconnectDelay(UINT32_MAX));
+}
+
+TEST_FUNCTION(ModbusTcpPool_Acquire_shares_connection_per_host_and_port)
+{
+    TestSlave gateway;
+    TestSlave other;
+    TestSlave_Start(&gateway, 0, false);
+    TestSlave_Start(&other, 0, false);
+    MODBUS_TCP_POOL_HANDLE pool = ModbusTcpPool_Create();
+    ASSERT_IS_NOT_NULL(pool);
+
+    MODBUS_TCP_CONNECTION_HANDLE first = ModbusTcpPool_Acquire(pool, TEST_HOST, gateway.Port);
+    MODBUS_TCP_CONNECTION_HANDLE second = ModbusTcpPool_Acquire(pool, TEST_HOST, gateway.Port);
+    MODBUS_TCP_CONNECTION_HANDLE third = ModbusTcpPool_Acquire(pool, TEST_HOST, other.Port);
+    ASSERT_IS_NOT_NULL(first);
+    ASSERT_IS_TRUE(first == second);
+    ASSERT_IS_NOT_NULL(third);
+    ASSERT_IS_TRUE(first != third);
+
+    // The connection outlives the first component releasing it
+    ModbusTcpPool_Release(first);
+    ASSERT_IS_TRUE(ReadOwnAddress(second, 7));
+    ASSERT_IS_TRUE(ReadOwnAddress(third, 8));
+
+    ModbusTcpPool_Release(second);
+    ModbusTcpPool_Release(third);
+    ModbusTcpPool_Destroy(pool);
+    TestSlave_Stop(&gateway);
+    TestSlave_Stop(&other);
+
+    ASSERT_ARE_EQUAL(int, 1, gateway.Accepted);
+    ASSERT_ARE_EQUAL(int, 1, other.Accepted);
+}
+
+TEST_FUNCTION(ModbusTcpPool_Acquire_fails_when_nothing_listens)
+{
+    TestSlave slave;
+    TestSlave_Start(&slave, 0, false);
+    uint16_t port = slave.Port;
+    TestSlave_Stop(&slave);
+
+    MODBUS_TCP_POOL_HANDLE pool = ModbusTcpPool_Create();
+    ASSERT_IS_NULL(ModbusTcpPool_Acquire(pool, TEST_HOST, port));
+    ModbusTcpPool_Destroy(pool);
+}
+
+TEST_FUNCTION(ModbusTcpPool_Transact_matches_responses_by_transaction_id)
+{
+    // Responses to each batch come back in the reverse order of the requests
+    TestSlave slave;
+    TestSlave_Start(&slave, 20, true);
+    MODBUS_TCP_POOL_HANDLE pool = ModbusTcpPool_Create();
+    MODBUS_TCP_CONNECTION_HANDLE connection = ModbusTcpPool_Acquire(pool, TEST_HOST, slave.Port);
+    ASSERT_IS_NOT_NULL(connection);
+
+    TestReader readers[4];
+    ASSERT_ARE_EQUAL(int, 0, RunReaders(connection, readers, 4, 10));
+
+    ModbusTcpPool_Release(connection);
+    ModbusTcpPool_Destroy(pool);
+    TestSlave_Stop(&slave);
+    ASSERT_ARE_EQUAL(int, 40, slave.Answered);
+}
+
+TEST_FUNCTION(ModbusTcpPool_Transact_pipelines_requests_of_concurrent_callers)
+{
+    // Answering a batch takes 5 ms, one request at a time 200 requests would take at least a second
+    const int readerCount = 8;
+    const int requestCount = 25;
+    const int delayMs = 5;
+    TestSlave slave;
+    TestSlave_Start(&slave, delayMs, false);
+    MODBUS_TCP_POOL_HANDLE pool = ModbusTcpPool_Create();
+    MODBUS_TCP_CONNECTION_HANDLE connection = ModbusTcpPool_Acquire(pool, TEST_HOST, slave.Port);
+    ASSERT_IS_NOT_NULL(connection);
+
+    TICK_COUNTER_HANDLE clock = tickcounter_create();
+    tickcounter_ms_t start = 0;
+    tickcounter_ms_t end = 0;
+    (void)tickcounter_get_current_ms(clock, &start);
+
+    TestReader readers[8];
+    ASSERT_ARE_EQUAL(int, 0, RunReaders(connection, readers, readerCount, requestCount));
+
+    (void)tickcounter_get_current_ms(clock, &end);
+    tickcounter_destroy(clock);
+
+    ModbusTcpPool_Release(connection);
+    ModbusTcpPool_Destroy(pool);
+    TestSlave_Stop(&slave);
+
+    ASSERT_ARE_EQUAL(int, readerCount * requestCount, slave.Answered);
+    ASSERT_IS_TRUE(end - start < (tickcounter_ms_t)(readerCount * requestCount * delayMs / 2));
+}
+
+TEST_FUNCTION(ModbusTcpPool_Transact_reconnects_after_connection_drop)
+{
+    TestSlave slave;
+    TestSlave_Start(&slave, 0, false);
+    MODBUS_TCP_POOL_HANDLE pool = ModbusTcpPool_Create();
+    MODBUS_TCP_CONNECTION_HANDLE connection = ModbusTcpPool_Acquire(pool, TEST_HOST, slave.Port);
+    ASSERT_IS_NOT_NULL(connection);
+    ASSERT_IS_TRUE(ReadOwnAddress(connection, 1));
+
+    // The request in flight when the connection drops fails, requests succeed again once it is reconnected
+    slave.DropNext = true;
+    ASSERT_IS_FALSE(ReadOwnAddress(connection, 2));
+
+    bool reconnected = false;
+    for (int i = 0; i < 100 && !reconnected; i++)
+    {
+        ThreadAPI_Sleep(50);
+        reconnected = ReadOwnAddress(connection, 3);
+    }
+    ASSERT_IS_TRUE(reconnected);
+
+    ModbusTcpPool_Release(connection);
+    ModbusTcpPool_Destroy(pool);
+    TestSlave_Stop(&slave);
+    ASSERT_ARE_EQUAL(int, 2, slave.Accepted);
+}
+
+END_TEST_SUITE(modbus_tcp_pool_ut)
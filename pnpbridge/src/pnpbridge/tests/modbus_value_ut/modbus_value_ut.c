@@ -0,0 +1,115 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "ModbusValue.h"
+
+static double Decode(ModbusNumberType type, ModbusByteOrder wordOrder, ModbusByteOrder byteOrder, const uint8_t* data)
+{
+    ModbusNumberFormat format;
+    format.Type = type;
+    format.WordOrder = wordOrder;
+    format.ByteOrder = byteOrder;
+    return ModbusNumber_Decode(&format, data);
+}
+
+BEGIN_TEST_SUITE(modbus_value_ut)
+
+TEST_FUNCTION(ModbusNumber_GetRegisterCount_matches_number_size)
+{
+    ASSERT_ARE_EQUAL(int, 1, ModbusNumber_GetRegisterCount(ModbusUInt16));
+    ASSERT_ARE_EQUAL(int, 1, ModbusNumber_GetRegisterCount(ModbusInt16));
+    ASSERT_ARE_EQUAL(int, 2, ModbusNumber_GetRegisterCount(ModbusInt32));
+    ASSERT_ARE_EQUAL(int, 2, ModbusNumber_GetRegisterCount(ModbusFloat32));
+    ASSERT_ARE_EQUAL(int, 4, ModbusNumber_GetRegisterCount(ModbusUInt64));
+    ASSERT_ARE_EQUAL(int, 4, ModbusNumber_GetRegisterCount(ModbusFloat64));
+}
+
+TEST_FUNCTION(ModbusNumber_Decode_reads_signed_and_unsigned_registers)
+{
+    const uint8_t data[] = { 0xFF, 0xFE };
+
+    ASSERT_IS_TRUE(65534.0 == Decode(ModbusUInt16, ModbusBigEndian, ModbusBigEndian, data));
+    ASSERT_IS_TRUE(-2.0 == Decode(ModbusInt16, ModbusBigEndian, ModbusBigEndian, data));
+    ASSERT_IS_TRUE(-257.0 == Decode(ModbusInt16, ModbusBigEndian, ModbusLittleEndian, data));
+}
+
+TEST_FUNCTION(ModbusNumber_Decode_honours_word_and_byte_order_of_32_bit_values)
+{
+    // 1.5f is 0x3FC00000
+    const uint8_t abcd[] = { 0x3F, 0xC0, 0x00, 0x00 };
+    const uint8_t cdab[] = { 0x00, 0x00, 0x3F, 0xC0 };
+    const uint8_t badc[] = { 0xC0, 0x3F, 0x00, 0x00 };
+    const uint8_t dcba[] = { 0x00, 0x00, 0xC0, 0x3F };
+
+    ASSERT_IS_TRUE(1.5 == Decode(ModbusFloat32, ModbusBigEndian, ModbusBigEndian, abcd));
+    ASSERT_IS_TRUE(1.5 == Decode(ModbusFloat32, ModbusLittleEndian, ModbusBigEndian, cdab));
+    ASSERT_IS_TRUE(1.5 == Decode(ModbusFloat32, ModbusBigEndian, ModbusLittleEndian, badc));
+    ASSERT_IS_TRUE(1.5 == Decode(ModbusFloat32, ModbusLittleEndian, ModbusLittleEndian, dcba));
+
+    const uint8_t minusTwo[] = { 0xFF, 0xFE, 0xFF, 0xFF };
+    ASSERT_IS_TRUE(-2.0 == Decode(ModbusInt32, ModbusLittleEndian, ModbusBigEndian, minusTwo));
+    ASSERT_IS_TRUE(4294967294.0 == Decode(ModbusUInt32, ModbusLittleEndian, ModbusBigEndian, minusTwo));
+}
+
+TEST_FUNCTION(ModbusNumber_Decode_reads_64_bit_values)
+{
+    // -2.5 is 0xC004000000000000
+    const uint8_t minusTwoAndAHalf[] = { 0xC0, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    const uint8_t minusTwoAndAHalfLowWordFirst[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC0, 0x04 };
+    const uint8_t counter[] = { 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02 };
+    const uint8_t minusOne[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+    ASSERT_IS_TRUE(-2.5 == Decode(ModbusFloat64, ModbusBigEndian, ModbusBigEndian, minusTwoAndAHalf));
+    ASSERT_IS_TRUE(-2.5 == Decode(ModbusFloat64, ModbusLittleEndian, ModbusBigEndian, minusTwoAndAHalfLowWordFirst));
+    ASSERT_IS_TRUE(4294967298.0 == Decode(ModbusUInt64, ModbusBigEndian, ModbusBigEndian, counter));
+    ASSERT_IS_TRUE(-1.0 == Decode(ModbusInt64, ModbusBigEndian, ModbusBigEndian, minusOne));
+}
+
+TEST_FUNCTION(ModbusValue_FormatNumber_keeps_integers_and_drops_binary_noise)
+{
+    char text[MODBUS_VALUE_MAX_LENGTH];
+
+    ASSERT_ARE_EQUAL(int, 5, ModbusValue_FormatNumber(2357 * 0.01, text, sizeof(text)));
+    ASSERT_ARE_EQUAL(char_ptr, "23.57", text);
+
+    ASSERT_ARE_EQUAL(int, 10, ModbusValue_FormatNumber(4294967294.0, text, sizeof(text)));
+    ASSERT_ARE_EQUAL(char_ptr, "4294967294", text);
+
+    ASSERT_ARE_EQUAL(int, -1, ModbusValue_FormatNumber(4294967294.0, text, 10));
+}
+
+TEST_FUNCTION(ModbusValue_FormatString_takes_registers_last_first)
+{
+    const uint8_t data[] = { 'A', 'B', 'C', '!' };
+    char text[MODBUS_VALUE_MAX_LENGTH];
+
+    ASSERT_ARE_EQUAL(int, 7, ModbusValue_FormatString(STRING, data, 2, text, sizeof(text)));
+    ASSERT_ARE_EQUAL(char_ptr, "\"C21AB\"", text);
+
+    ASSERT_ARE_EQUAL(int, 10, ModbusValue_FormatString(HEXSTRING, data, 2, text, sizeof(text)));
+    ASSERT_ARE_EQUAL(char_ptr, "\"43214142\"", text);
+}
+
+TEST_FUNCTION(ModbusValue_FormatString_fails_when_text_does_not_fit)
+{
+    // A full read response of 125 registers fits in MODBUS_VALUE_MAX_LENGTH as hex
+    uint8_t data[250] = { 0 };
+    char text[MODBUS_VALUE_MAX_LENGTH];
+
+    ASSERT_ARE_EQUAL(int, 502, ModbusValue_FormatString(HEXSTRING, data, 125, text, sizeof(text)));
+    ASSERT_ARE_EQUAL(int, -1, ModbusValue_FormatString(HEXSTRING, data, 125, text, 502));
+}
+
+END_TEST_SUITE(modbus_value_ut)
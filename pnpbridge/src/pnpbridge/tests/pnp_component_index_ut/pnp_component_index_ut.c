@@ -0,0 +1,186 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "pnp_component_index.h"
+
+// Number of lookups timed for each index size in the lookup cost benchmark
+#define BENCHMARK_LOOKUP_COUNT 1000000
+
+static char** CreateComponentNames(size_t count)
+{
+    char** names = (char**)malloc(count * sizeof(char*));
+    ASSERT_IS_NOT_NULL(names);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        names[i] = (char*)malloc(32);
+        ASSERT_IS_NOT_NULL(names[i]);
+        (void)snprintf(names[i], 32, "sensor%lu", (unsigned long)i);
+    }
+
+    return names;
+}
+
+static void DestroyComponentNames(char** names, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free(names[i]);
+    }
+    free(names);
+}
+
+BEGIN_TEST_SUITE(pnp_component_index_ut)
+
+TEST_FUNCTION(PnP_ComponentIndex_Find_returns_added_components)
+{
+    PNP_COMPONENT_INDEX_HANDLE index = PnP_ComponentIndex_Create(2);
+    int first = 1;
+    int second = 2;
+
+    ASSERT_IS_NOT_NULL(index);
+    ASSERT_IS_TRUE(PnP_ComponentIndex_Add(index, "thermostat1", &first));
+    ASSERT_IS_TRUE(PnP_ComponentIndex_Add(index, "thermostat2", &second));
+
+    ASSERT_ARE_EQUAL(size_t, 2, PnP_ComponentIndex_GetCount(index));
+    ASSERT_ARE_EQUAL(void_ptr, &first, PnP_ComponentIndex_Find(index, "thermostat1", 11));
+    ASSERT_ARE_EQUAL(void_ptr, &second, PnP_ComponentIndex_Find(index, "thermostat2", 11));
+    ASSERT_IS_NULL(PnP_ComponentIndex_Find(index, "thermostat3", 11));
+
+    PnP_ComponentIndex_Destroy(index);
+}
+
+TEST_FUNCTION(PnP_ComponentIndex_Find_does_not_match_prefixes)
+{
+    PNP_COMPONENT_INDEX_HANDLE index = PnP_ComponentIndex_Create(2);
+    int sensor10 = 10;
+    int sensor1 = 1;
+
+    ASSERT_IS_NOT_NULL(index);
+    ASSERT_IS_TRUE(PnP_ComponentIndex_Add(index, "sensor10", &sensor10));
+
+    // "sensor1*getValue" is how a device method targeting component sensor1 arrives; only the first 7 characters are the component
+    ASSERT_IS_NULL(PnP_ComponentIndex_Find(index, "sensor1*getValue", 7));
+    ASSERT_IS_NULL(PnP_ComponentIndex_Find(index, "sensor100", 9));
+    ASSERT_IS_FALSE(PnP_ComponentIndex_Contains(index, "sensor1"));
+
+    ASSERT_IS_TRUE(PnP_ComponentIndex_Add(index, "sensor1", &sensor1));
+    ASSERT_ARE_EQUAL(void_ptr, &sensor1, PnP_ComponentIndex_Find(index, "sensor1*getValue", 7));
+    ASSERT_ARE_EQUAL(void_ptr, &sensor10, PnP_ComponentIndex_Find(index, "sensor10*getValue", 8));
+
+    PnP_ComponentIndex_Destroy(index);
+}
+
+TEST_FUNCTION(PnP_ComponentIndex_Add_rejects_duplicates)
+{
+    PNP_COMPONENT_INDEX_HANDLE index = PnP_ComponentIndex_Create(1);
+    int value = 0;
+
+    ASSERT_IS_NOT_NULL(index);
+    ASSERT_IS_TRUE(PnP_ComponentIndex_Add(index, "modbus", &value));
+    ASSERT_IS_FALSE(PnP_ComponentIndex_Add(index, "modbus", &value));
+    ASSERT_IS_FALSE(PnP_ComponentIndex_Add(index, NULL, &value));
+    ASSERT_ARE_EQUAL(size_t, 1, PnP_ComponentIndex_GetCount(index));
+
+    PnP_ComponentIndex_Destroy(index);
+}
+
+TEST_FUNCTION(PnP_ComponentIndex_handles_NULL_and_empty_index)
+{
+    PNP_COMPONENT_INDEX_HANDLE index = PnP_ComponentIndex_Create(0);
+
+    ASSERT_IS_NOT_NULL(index);
+    ASSERT_IS_NULL(PnP_ComponentIndex_Find(index, "sensor", 6));
+    ASSERT_IS_FALSE(PnP_ComponentIndex_Contains(index, "sensor"));
+    ASSERT_IS_NULL(PnP_ComponentIndex_Find(NULL, "sensor", 6));
+    ASSERT_IS_FALSE(PnP_ComponentIndex_Contains(NULL, "sensor"));
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_ComponentIndex_GetCount(NULL));
+
+    PnP_ComponentIndex_Destroy(index);
+    PnP_ComponentIndex_Destroy(NULL);
+}
+
+TEST_FUNCTION(PnP_ComponentIndex_grows_past_expected_count)
+{
+    const size_t count = 1000;
+    char** names = CreateComponentNames(count);
+    PNP_COMPONENT_INDEX_HANDLE index = PnP_ComponentIndex_Create(1);
+
+    ASSERT_IS_NOT_NULL(index);
+    for (size_t i = 0; i < count; i++)
+    {
+        ASSERT_IS_TRUE(PnP_ComponentIndex_Add(index, names[i], names[i]));
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, names[i], PnP_ComponentIndex_Find(index, names[i], strlen(names[i])));
+    }
+
+    PnP_ComponentIndex_Destroy(index);
+    DestroyComponentNames(names, count);
+}
+
+// Micro-benchmark: the cost of a lookup should stay flat as the number of components grows.
+// Timings are reported rather than asserted so the test stays reliable on loaded build machines.
+TEST_FUNCTION(PnP_ComponentIndex_Find_lookup_cost_benchmark)
+{
+    const size_t componentCounts[] = { 10, 100, 1000, 10000 };
+
+    for (size_t c = 0; c < sizeof(componentCounts) / sizeof(componentCounts[0]); c++)
+    {
+        size_t count = componentCounts[c];
+        char** names = CreateComponentNames(count);
+        size_t* nameSizes = (size_t*)malloc(count * sizeof(size_t));
+        PNP_COMPONENT_INDEX_HANDLE index = PnP_ComponentIndex_Create(count);
+        size_t found = 0;
+
+        ASSERT_IS_NOT_NULL(nameSizes);
+        ASSERT_IS_NOT_NULL(index);
+        for (size_t i = 0; i < count; i++)
+        {
+            nameSizes[i] = strlen(names[i]);
+            ASSERT_IS_TRUE(PnP_ComponentIndex_Add(index, names[i], names[i]));
+        }
+
+        clock_t start = clock();
+        for (size_t i = 0; i < BENCHMARK_LOOKUP_COUNT; i++)
+        {
+            // Stride through the names so successive lookups do not hit the same slot
+            size_t n = (i * 7919) % count;
+            if (PnP_ComponentIndex_Find(index, names[n], nameSizes[n]) != NULL)
+            {
+                found++;
+            }
+        }
+        clock_t elapsed = clock() - start;
+
+        ASSERT_ARE_EQUAL(size_t, BENCHMARK_LOOKUP_COUNT, found);
+        (void)printf("PnP_ComponentIndex_Find: %6lu components, %8.1f ns/lookup\r\n", (unsigned long)count,
+            ((double)elapsed * 1e9 / CLOCKS_PER_SEC) / BENCHMARK_LOOKUP_COUNT);
+
+        PnP_ComponentIndex_Destroy(index);
+        free(nameSizes);
+        DestroyComponentNames(names, count);
+    }
+}
+
+END_TEST_SUITE(pnp_component_index_ut)
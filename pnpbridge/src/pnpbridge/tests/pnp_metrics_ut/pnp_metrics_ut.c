@@ -0,0 +1,178 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "pnp_metrics.h"
+
+static void AssertText(PNP_METRICS_HANDLE metrics, const char* expectedText)
+{
+    char* text = PnP_Metrics_FormatText(metrics);
+    ASSERT_IS_NOT_NULL(text);
+    ASSERT_ARE_EQUAL(char_ptr, expectedText, text);
+    free(text);
+}
+
+static void AssertJson(PNP_METRICS_HANDLE metrics, const char* expectedJson)
+{
+    char* json = PnP_Metrics_FormatJson(metrics);
+    ASSERT_IS_NOT_NULL(json);
+    ASSERT_ARE_EQUAL(char_ptr, expectedJson, json);
+    free(json);
+}
+
+BEGIN_TEST_SUITE(pnp_metrics_ut)
+
+TEST_FUNCTION(PnP_Metrics_is_empty_when_created)
+{
+    PNP_METRICS_HANDLE metrics = PnP_Metrics_Create();
+    ASSERT_IS_NOT_NULL(metrics);
+
+    AssertText(metrics, "");
+    AssertJson(metrics, "{\"bridge\":{},\"components\":{}}");
+
+    PnP_Metrics_Destroy(metrics);
+}
+
+TEST_FUNCTION(PnP_Metrics_groups_series_of_a_metric_under_one_type)
+{
+    PNP_METRICS_HANDLE metrics = PnP_Metrics_Create();
+    ASSERT_IS_NOT_NULL(metrics);
+
+    ASSERT_IS_TRUE(PnP_Metrics_AddCounter(metrics, "meter1", "messages_sent_total", 2));
+    ASSERT_IS_TRUE(PnP_Metrics_AddGauge(metrics, "meter1", "messages_in_flight", 2));
+    ASSERT_IS_TRUE(PnP_Metrics_AddCounter(metrics, "meter2", "messages_sent_total", 1));
+    ASSERT_IS_TRUE(PnP_Metrics_AddCounter(metrics, "meter1", "messages_sent_total", 3));
+    ASSERT_IS_TRUE(PnP_Metrics_AddGauge(metrics, "meter1", "messages_in_flight", -1));
+    ASSERT_IS_TRUE(PnP_Metrics_SetGauge(metrics, NULL, "components", 2));
+
+    AssertText(metrics,
+        "# TYPE messages_sent_total counter\n"
+        "messages_sent_total{component=\"meter1\"} 5\n"
+        "messages_sent_total{component=\"meter2\"} 1\n"
+        "# TYPE messages_in_flight gauge\n"
+        "messages_in_flight{component=\"meter1\"} 1\n"
+        "# TYPE components gauge\n"
+        "components 2\n");
+    AssertJson(metrics,
+        "{\"bridge\":{\"components\":2},\"components\":{"
+        "\"meter1\":{\"messages_sent_total\":5,\"messages_in_flight\":1},"
+        "\"meter2\":{\"messages_sent_total\":1}}}");
+
+    PnP_Metrics_Destroy(metrics);
+}
+
+TEST_FUNCTION(PnP_Metrics_rejects_an_update_of_a_different_type)
+{
+    PNP_METRICS_HANDLE metrics = PnP_Metrics_Create();
+    ASSERT_IS_NOT_NULL(metrics);
+
+    ASSERT_IS_TRUE(PnP_Metrics_AddCounter(metrics, "meter1", "io_errors_total", 1));
+    ASSERT_IS_FALSE(PnP_Metrics_SetGauge(metrics, "meter1", "io_errors_total", 5));
+    ASSERT_IS_FALSE(PnP_Metrics_Observe(metrics, "meter2", "io_errors_total", 5));
+
+    AssertText(metrics,
+        "# TYPE io_errors_total counter\n"
+        "io_errors_total{component=\"meter1\"} 1\n");
+
+    PnP_Metrics_Destroy(metrics);
+}
+
+TEST_FUNCTION(PnP_Metrics_histogram_buckets_are_cumulative)
+{
+    PNP_METRICS_HANDLE metrics = PnP_Metrics_Create();
+    ASSERT_IS_NOT_NULL(metrics);
+
+    ASSERT_IS_TRUE(PnP_Metrics_Observe(metrics, "meter1", "poll_duration_ms", 0));
+    ASSERT_IS_TRUE(PnP_Metrics_Observe(metrics, "meter1", "poll_duration_ms", 7));
+    ASSERT_IS_TRUE(PnP_Metrics_Observe(metrics, "meter1", "poll_duration_ms", 10));
+    ASSERT_IS_TRUE(PnP_Metrics_Observe(metrics, "meter1", "poll_duration_ms", 45000));
+
+    AssertText(metrics,
+        "# TYPE poll_duration_ms histogram\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"1\"} 1\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"2\"} 1\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"5\"} 1\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"10\"} 3\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"20\"} 3\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"50\"} 3\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"100\"} 3\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"200\"} 3\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"500\"} 3\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"1000\"} 3\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"2000\"} 3\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"5000\"} 3\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"10000\"} 3\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"30000\"} 3\n"
+        "poll_duration_ms_bucket{component=\"meter1\",le=\"+Inf\"} 4\n"
+        "poll_duration_ms_sum{component=\"meter1\"} 45017\n"
+        "poll_duration_ms_count{component=\"meter1\"} 4\n");
+    AssertJson(metrics,
+        "{\"bridge\":{},\"components\":{\"meter1\":{\"poll_duration_ms\":{\"count\":4,\"avg\":11254,\"max\":45000}}}}");
+
+    PnP_Metrics_Destroy(metrics);
+}
+
+TEST_FUNCTION(PnP_Metrics_escapes_component_names)
+{
+    PNP_METRICS_HANDLE metrics = PnP_Metrics_Create();
+    ASSERT_IS_NOT_NULL(metrics);
+
+    ASSERT_IS_TRUE(PnP_Metrics_AddCounter(metrics, "a\"b\\c", "commands_total", 1));
+
+    AssertText(metrics,
+        "# TYPE commands_total counter\n"
+        "commands_total{component=\"a\\\"b\\\\c\"} 1\n");
+    AssertJson(metrics, "{\"bridge\":{},\"components\":{\"a\\\"b\\\\c\":{\"commands_total\":1}}}");
+
+    PnP_Metrics_Destroy(metrics);
+}
+
+TEST_FUNCTION(PnP_Metrics_update_cost)
+{
+    const int componentCount = 256;
+    const int updateCount = 1000000;
+    char names[256][16];
+
+    PNP_METRICS_HANDLE metrics = PnP_Metrics_Create();
+    ASSERT_IS_NOT_NULL(metrics);
+
+    for (int i = 0; i < componentCount; i++)
+    {
+        (void)snprintf(names[i], sizeof(names[i]), "meter%d", i);
+    }
+
+    // Updates run on the telemetry path, they have to stay cheap as the number of components grows
+    clock_t start = clock();
+    for (int i = 0; i < updateCount; i++)
+    {
+        ASSERT_IS_TRUE(PnP_Metrics_AddCounter(metrics, names[i % componentCount], "messages_sent_total", 1));
+        ASSERT_IS_TRUE(PnP_Metrics_Observe(metrics, names[i % componentCount], "confirmation_latency_ms", (uint32_t)(i % 200)));
+    }
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    char* text = PnP_Metrics_FormatText(metrics);
+    ASSERT_IS_NOT_NULL(text);
+    ASSERT_IS_NOT_NULL(strstr(text, "messages_sent_total{component=\"meter255\"} 3906\n"));
+    free(text);
+
+    (void)printf("PnP_Metrics: %d components, %.1f ns/update\r\n", componentCount, elapsed * 1e9 / (2.0 * updateCount));
+
+    PnP_Metrics_Destroy(metrics);
+}
+
+END_TEST_SUITE(pnp_metrics_ut)
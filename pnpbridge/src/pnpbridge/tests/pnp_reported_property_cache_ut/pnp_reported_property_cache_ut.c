@@ -0,0 +1,186 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "pnp_reported_property_cache.h"
+
+static void AssertPatch(PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache, const char* expectedPatch)
+{
+    char* patch = PnP_ReportedPropertyCache_TakePatch(propertyCache);
+    ASSERT_IS_NOT_NULL(patch);
+    ASSERT_ARE_EQUAL(char_ptr, expectedPatch, patch);
+    free(patch);
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_ReportedPropertyCache_GetPendingCount(propertyCache));
+}
+
+BEGIN_TEST_SUITE(pnp_reported_property_cache_ut)
+
+TEST_FUNCTION(PnP_ReportedPropertyCache_suppresses_unchanged_values)
+{
+    PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache = PnP_ReportedPropertyCache_Create();
+    ASSERT_IS_NOT_NULL(propertyCache);
+    ASSERT_IS_NULL(PnP_ReportedPropertyCache_TakePatch(propertyCache));
+
+    ASSERT_ARE_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_PENDING,
+        PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "firmwareVersion", "\"1.0.2\""));
+    ASSERT_ARE_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_UNCHANGED,
+        PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "firmwareVersion", "\"1.0.2\""));
+    AssertPatch(propertyCache, "{\"meter1\":{\"__t\":\"c\",\"firmwareVersion\":\"1.0.2\"}}");
+
+    // Every following poll reports the same value and nothing goes out
+    for (int i = 0; i < 100; i++)
+    {
+        ASSERT_ARE_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_UNCHANGED,
+            PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "firmwareVersion", "\"1.0.2\""));
+    }
+    ASSERT_IS_NULL(PnP_ReportedPropertyCache_TakePatch(propertyCache));
+
+    ASSERT_ARE_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_PENDING,
+        PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "firmwareVersion", "\"1.0.3\""));
+    AssertPatch(propertyCache, "{\"meter1\":{\"__t\":\"c\",\"firmwareVersion\":\"1.0.3\"}}");
+
+    PnP_ReportedPropertyCache_Destroy(propertyCache);
+}
+
+TEST_FUNCTION(PnP_ReportedPropertyCache_keys_on_component_and_property)
+{
+    PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache = PnP_ReportedPropertyCache_Create();
+    ASSERT_IS_NOT_NULL(propertyCache);
+
+    ASSERT_ARE_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_PENDING,
+        PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "modelName", "\"M100\""));
+    ASSERT_ARE_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_PENDING,
+        PnP_ReportedPropertyCache_Update(propertyCache, "meter2", "modelName", "\"M100\""));
+    ASSERT_ARE_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_PENDING,
+        PnP_ReportedPropertyCache_Update(propertyCache, NULL, "modelName", "\"Bridge\""));
+    ASSERT_ARE_EQUAL(size_t, 3, PnP_ReportedPropertyCache_GetPendingCount(propertyCache));
+
+    PnP_ReportedPropertyCache_Destroy(propertyCache);
+}
+
+TEST_FUNCTION(PnP_ReportedPropertyCache_merges_components_into_one_patch)
+{
+    PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache = PnP_ReportedPropertyCache_Create();
+    ASSERT_IS_NOT_NULL(propertyCache);
+
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "firmwareVersion", "\"1.0.2\"");
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, "meter2", "firmwareVersion", "\"2.1\"");
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, NULL, "state", "\"running\"");
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "modelName", "\"M100\"");
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, NULL, "uptime", "12");
+    // A later value replaces the pending one
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, "meter2", "firmwareVersion", "\"2.2\"");
+
+    ASSERT_ARE_EQUAL(size_t, 5, PnP_ReportedPropertyCache_GetPendingCount(propertyCache));
+    AssertPatch(propertyCache,
+        "{\"meter1\":{\"__t\":\"c\",\"firmwareVersion\":\"1.0.2\",\"modelName\":\"M100\"},"
+        "\"meter2\":{\"__t\":\"c\",\"firmwareVersion\":\"2.2\"},"
+        "\"state\":\"running\",\"uptime\":12}");
+
+    // Only what changed since then goes into the next patch
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "firmwareVersion", "\"1.0.2\"");
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, "meter2", "firmwareVersion", "\"2.2\"");
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, NULL, "uptime", "13");
+    AssertPatch(propertyCache, "{\"uptime\":13}");
+
+    PnP_ReportedPropertyCache_Destroy(propertyCache);
+}
+
+TEST_FUNCTION(PnP_ReportedPropertyCache_drops_a_change_that_is_reverted_before_it_is_sent)
+{
+    PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache = PnP_ReportedPropertyCache_Create();
+    ASSERT_IS_NOT_NULL(propertyCache);
+
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "mode", "1");
+    AssertPatch(propertyCache, "{\"meter1\":{\"__t\":\"c\",\"mode\":1}}");
+
+    ASSERT_ARE_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_PENDING, PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "mode", "2"));
+    ASSERT_ARE_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_UNCHANGED, PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "mode", "1"));
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_ReportedPropertyCache_GetPendingCount(propertyCache));
+    ASSERT_IS_NULL(PnP_ReportedPropertyCache_TakePatch(propertyCache));
+
+    PnP_ReportedPropertyCache_Destroy(propertyCache);
+}
+
+TEST_FUNCTION(PnP_ReportedPropertyCache_resync_reports_the_whole_state_once)
+{
+    PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache = PnP_ReportedPropertyCache_Create();
+    ASSERT_IS_NOT_NULL(propertyCache);
+
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "firmwareVersion", "\"1.0.2\"");
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, "meter2", "firmwareVersion", "\"2.1\"");
+    AssertPatch(propertyCache,
+        "{\"meter1\":{\"__t\":\"c\",\"firmwareVersion\":\"1.0.2\"},\"meter2\":{\"__t\":\"c\",\"firmwareVersion\":\"2.1\"}}");
+
+    // Reconnect while meter2 has a change pending: one patch carries everything
+    (void)PnP_ReportedPropertyCache_Update(propertyCache, "meter2", "firmwareVersion", "\"2.2\"");
+    PnP_ReportedPropertyCache_Resync(propertyCache);
+    PnP_ReportedPropertyCache_Resync(propertyCache);
+    ASSERT_ARE_EQUAL(size_t, 2, PnP_ReportedPropertyCache_GetPendingCount(propertyCache));
+    ASSERT_ARE_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_UNCHANGED,
+        PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "firmwareVersion", "\"1.0.2\""));
+    AssertPatch(propertyCache,
+        "{\"meter1\":{\"__t\":\"c\",\"firmwareVersion\":\"1.0.2\"},\"meter2\":{\"__t\":\"c\",\"firmwareVersion\":\"2.2\"}}");
+
+    ASSERT_ARE_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_UNCHANGED,
+        PnP_ReportedPropertyCache_Update(propertyCache, "meter1", "firmwareVersion", "\"1.0.2\""));
+
+    PnP_ReportedPropertyCache_Destroy(propertyCache);
+}
+
+TEST_FUNCTION(PnP_ReportedPropertyCache_reduces_twin_updates_for_polled_properties)
+{
+    // 20 Modbus components, each polling 4 read-only properties every cycle for 100 cycles; one property changes every 10 cycles
+    const int componentCount = 20;
+    const int propertyCount = 4;
+    const int cycleCount = 100;
+    int patchCount = 0;
+    char componentName[32];
+    char propertyName[32];
+    char propertyValue[32];
+
+    PNP_REPORTED_PROPERTY_CACHE_HANDLE propertyCache = PnP_ReportedPropertyCache_Create();
+    ASSERT_IS_NOT_NULL(propertyCache);
+
+    for (int cycle = 0; cycle < cycleCount; cycle++)
+    {
+        for (int component = 0; component < componentCount; component++)
+        {
+            (void)snprintf(componentName, sizeof(componentName), "meter%d", component);
+            for (int property = 0; property < propertyCount; property++)
+            {
+                (void)snprintf(propertyName, sizeof(propertyName), "property%d", property);
+                (void)snprintf(propertyValue, sizeof(propertyValue), "%d", (property == 0) ? (cycle / 10) : property);
+                ASSERT_ARE_NOT_EQUAL(int, PNP_REPORTED_PROPERTY_CACHE_ERROR,
+                    PnP_ReportedPropertyCache_Update(propertyCache, componentName, propertyName, propertyValue));
+            }
+        }
+
+        char* patch = PnP_ReportedPropertyCache_TakePatch(propertyCache);
+        if (patch != NULL)
+        {
+            patchCount++;
+            free(patch);
+        }
+    }
+
+    // 8000 reports without the cache; with it only the first cycle and the 9 changes produce a patch
+    ASSERT_ARE_EQUAL(int, 10, patchCount);
+
+    PnP_ReportedPropertyCache_Destroy(propertyCache);
+}
+
+END_TEST_SUITE(pnp_reported_property_cache_ut)
@@ -0,0 +1,172 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "pnp_telemetry_batch.h"
+
+// IoT Hub meters device to cloud messages in blocks of this size
+#define TEST_HUB_MESSAGE_BLOCK 4096
+
+BEGIN_TEST_SUITE(pnp_telemetry_batch_ut)
+
+TEST_FUNCTION(PnP_TelemetryBatch_coalesces_readings_into_one_object)
+{
+    PNP_TELEMETRY_BATCH_HANDLE batch = PnP_TelemetryBatch_Create(TEST_HUB_MESSAGE_BLOCK);
+    ASSERT_IS_NOT_NULL(batch);
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_TelemetryBatch_GetReadingCount(batch));
+
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED, PnP_TelemetryBatch_Add(batch, "{\"temperature\":21.5}", 100));
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED, PnP_TelemetryBatch_Add(batch, " { \"humidity\" : 40 } ", 250));
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED, PnP_TelemetryBatch_Add(batch, "{\"co2\":412,\"tvoc\":3}", 300));
+
+    ASSERT_ARE_EQUAL(size_t, 3, PnP_TelemetryBatch_GetReadingCount(batch));
+    ASSERT_ARE_EQUAL(int, 100, (int)PnP_TelemetryBatch_GetFirstReadingTime(batch));
+    ASSERT_ARE_EQUAL(char_ptr, "{\"temperature\":21.5,\"humidity\" : 40,\"co2\":412,\"tvoc\":3}", PnP_TelemetryBatch_GetMessage(batch));
+
+    PnP_TelemetryBatch_Clear(batch);
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_TelemetryBatch_GetReadingCount(batch));
+    ASSERT_ARE_EQUAL(char_ptr, "{}", PnP_TelemetryBatch_GetMessage(batch));
+
+    PnP_TelemetryBatch_Destroy(batch);
+}
+
+TEST_FUNCTION(PnP_TelemetryBatch_copies_nested_values_and_escaped_strings_verbatim)
+{
+    PNP_TELEMETRY_BATCH_HANDLE batch = PnP_TelemetryBatch_Create(TEST_HUB_MESSAGE_BLOCK);
+    ASSERT_IS_NOT_NULL(batch);
+
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED,
+        PnP_TelemetryBatch_Add(batch, "{\"accel\":{\"x\":1,\"y\":[2,{\"z\":\"}\"}]}}", 0));
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED,
+        PnP_TelemetryBatch_Add(batch, "{\"label\":\"a \\\"quoted\\\", value\"}", 0));
+    ASSERT_ARE_EQUAL(char_ptr, "{\"accel\":{\"x\":1,\"y\":[2,{\"z\":\"}\"}]},\"label\":\"a \\\"quoted\\\", value\"}",
+        PnP_TelemetryBatch_GetMessage(batch));
+
+    PnP_TelemetryBatch_Destroy(batch);
+}
+
+TEST_FUNCTION(PnP_TelemetryBatch_is_full_when_a_field_repeats)
+{
+    PNP_TELEMETRY_BATCH_HANDLE batch = PnP_TelemetryBatch_Create(TEST_HUB_MESSAGE_BLOCK);
+    ASSERT_IS_NOT_NULL(batch);
+
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED, PnP_TelemetryBatch_Add(batch, "{\"temperature\":21.5}", 0));
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED, PnP_TelemetryBatch_Add(batch, "{\"temperature_max\":30}", 0));
+
+    // A second reading of the same telemetry would overwrite the first one, so it starts the next message
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_FULL, PnP_TelemetryBatch_Add(batch, "{\"temperature\":21.7}", 10));
+    ASSERT_ARE_EQUAL(size_t, 2, PnP_TelemetryBatch_GetReadingCount(batch));
+    ASSERT_ARE_EQUAL(char_ptr, "{\"temperature\":21.5,\"temperature_max\":30}", PnP_TelemetryBatch_GetMessage(batch));
+
+    PnP_TelemetryBatch_Clear(batch);
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED, PnP_TelemetryBatch_Add(batch, "{\"temperature\":21.7}", 10));
+    ASSERT_ARE_EQUAL(int, 10, (int)PnP_TelemetryBatch_GetFirstReadingTime(batch));
+
+    PnP_TelemetryBatch_Destroy(batch);
+}
+
+TEST_FUNCTION(PnP_TelemetryBatch_never_exceeds_the_message_size)
+{
+    // {"t1":1,"t2":2} is 15 characters
+    PNP_TELEMETRY_BATCH_HANDLE batch = PnP_TelemetryBatch_Create(15);
+    ASSERT_IS_NOT_NULL(batch);
+
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED, PnP_TelemetryBatch_Add(batch, "{\"t1\":1}", 0));
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED, PnP_TelemetryBatch_Add(batch, "{\"t2\":2}", 0));
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_FULL, PnP_TelemetryBatch_Add(batch, "{\"t3\":3}", 0));
+    ASSERT_ARE_EQUAL(size_t, 15, strlen(PnP_TelemetryBatch_GetMessage(batch)));
+
+    // A reading too large for a message of its own is left for the caller to send as it is
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_NOT_BATCHABLE, PnP_TelemetryBatch_Add(batch, "{\"temperature\":21.5}", 0));
+    ASSERT_ARE_EQUAL(size_t, 2, PnP_TelemetryBatch_GetReadingCount(batch));
+
+    PnP_TelemetryBatch_Destroy(batch);
+}
+
+TEST_FUNCTION(PnP_TelemetryBatch_rejects_readings_that_are_not_objects)
+{
+    PNP_TELEMETRY_BATCH_HANDLE batch = PnP_TelemetryBatch_Create(TEST_HUB_MESSAGE_BLOCK);
+    ASSERT_IS_NOT_NULL(batch);
+
+    const char* readings[] = {
+        "",
+        "42",
+        "[1,2]",
+        "{}",
+        "{\"t\":1} trailing",
+        "{\"t\":1",
+        "{\"t\":\"unterminated}",
+        "{t:1}",
+        "{\"t\" 1}"
+    };
+
+    for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++)
+    {
+        ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_NOT_BATCHABLE, PnP_TelemetryBatch_Add(batch, readings[i], 0));
+    }
+
+    // Rejected readings leave nothing behind, not even their field names
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_TelemetryBatch_GetReadingCount(batch));
+    ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED, PnP_TelemetryBatch_Add(batch, "{\"t\":1}", 0));
+    ASSERT_ARE_EQUAL(char_ptr, "{\"t\":1}", PnP_TelemetryBatch_GetMessage(batch));
+
+    PnP_TelemetryBatch_Destroy(batch);
+}
+
+TEST_FUNCTION(PnP_TelemetryBatch_reduces_messages_for_a_multi_sensor_component)
+{
+    // A component reporting 12 sensors once a second for a minute, one reading per sensor as the adapters produce them
+    const size_t sensorCount = 12;
+    const size_t sampleCount = 60;
+    size_t messageCount = 0;
+    size_t blockCount = 0;
+    char reading[64];
+
+    PNP_TELEMETRY_BATCH_HANDLE batch = PnP_TelemetryBatch_Create(TEST_HUB_MESSAGE_BLOCK);
+    ASSERT_IS_NOT_NULL(batch);
+
+    for (size_t sample = 0; sample < sampleCount; sample++)
+    {
+        for (size_t sensor = 0; sensor < sensorCount; sensor++)
+        {
+            (void)snprintf(reading, sizeof(reading), "{\"sensor%lu\":%lu.25}", (unsigned long)sensor, (unsigned long)sample);
+
+            PNP_TELEMETRY_BATCH_RESULT result = PnP_TelemetryBatch_Add(batch, reading, sample * 1000);
+            if (PNP_TELEMETRY_BATCH_FULL == result)
+            {
+                size_t length = strlen(PnP_TelemetryBatch_GetMessage(batch));
+                ASSERT_IS_TRUE(length <= TEST_HUB_MESSAGE_BLOCK);
+                messageCount++;
+                blockCount += (length + TEST_HUB_MESSAGE_BLOCK - 1) / TEST_HUB_MESSAGE_BLOCK;
+                PnP_TelemetryBatch_Clear(batch);
+                result = PnP_TelemetryBatch_Add(batch, reading, sample * 1000);
+            }
+            ASSERT_ARE_EQUAL(int, PNP_TELEMETRY_BATCH_ADDED, result);
+        }
+    }
+    messageCount++;
+    blockCount++;
+
+    // One message per sample instead of one per reading
+    ASSERT_ARE_EQUAL(size_t, sampleCount, messageCount);
+    ASSERT_ARE_EQUAL(size_t, sampleCount, blockCount);
+
+    PnP_TelemetryBatch_Destroy(batch);
+}
+
+END_TEST_SUITE(pnp_telemetry_batch_ut)
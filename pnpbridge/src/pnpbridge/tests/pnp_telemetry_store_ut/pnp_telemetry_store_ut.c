@@ -0,0 +1,328 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "pnp_telemetry_store.h"
+
+#define TEST_STORE_PATH "pnp_telemetry_store_ut"
+#define TEST_SEGMENT_SIZE 1024
+#define TEST_MAX_SEGMENTS 4
+
+// Size on disk of the messages written by AppendSamples
+#define TEST_RECORD_SIZE 31
+#define TEST_RECORDS_PER_SEGMENT (TEST_SEGMENT_SIZE / TEST_RECORD_SIZE)
+
+// Stand-in for the IoT Hub client: records what it is sent while connected
+typedef struct TEST_CLIENT_TAG
+{
+    bool connected;
+    size_t failAfter;
+    size_t sentCount;
+    char lastComponent[32];
+    char lastMessage[64];
+    long nextSample;
+    bool inOrder;
+} TEST_CLIENT;
+
+static bool TestClient_Send(const char* componentName, const char* message, void* userContext)
+{
+    TEST_CLIENT* client = (TEST_CLIENT*)userContext;
+    long sample;
+
+    if (!client->connected || (client->sentCount == client->failAfter))
+    {
+        return false;
+    }
+
+    if ((sscanf(message, "{\"sample\":%ld}", &sample) != 1) || (sample != client->nextSample))
+    {
+        client->inOrder = false;
+    }
+    client->nextSample = sample + 1;
+
+    (void)snprintf(client->lastComponent, sizeof(client->lastComponent), "%s", (componentName != NULL) ? componentName : "");
+    (void)snprintf(client->lastMessage, sizeof(client->lastMessage), "%s", message);
+    client->sentCount++;
+    return true;
+}
+
+static void TestClient_Init(TEST_CLIENT* client, long firstSample)
+{
+    memset(client, 0, sizeof(*client));
+    client->connected = true;
+    client->failAfter = SIZE_MAX;
+    client->nextSample = firstSample;
+    client->inOrder = true;
+}
+
+static void AppendSamples(PNP_TELEMETRY_STORE_HANDLE store, long first, long count)
+{
+    char message[64];
+    for (long sample = first; sample < first + count; sample++)
+    {
+        (void)snprintf(message, sizeof(message), "{\"sample\":%05ld}", sample);
+        ASSERT_IS_TRUE(PnP_TelemetryStore_Append(store, "sensor", message));
+    }
+}
+
+static void RemoveStoreFiles(void)
+{
+    char path[128];
+    for (unsigned long sequence = 0; sequence < 4096; sequence++)
+    {
+        (void)snprintf(path, sizeof(path), "%s-%010lu.seg", TEST_STORE_PATH, sequence);
+        (void)remove(path);
+    }
+    (void)remove(TEST_STORE_PATH ".cursor");
+}
+
+static size_t CountSegmentFiles(void)
+{
+    char path[128];
+    size_t count = 0;
+    for (unsigned long sequence = 0; sequence < 4096; sequence++)
+    {
+        (void)snprintf(path, sizeof(path), "%s-%010lu.seg", TEST_STORE_PATH, sequence);
+        FILE* file = fopen(path, "rb");
+        if (file != NULL)
+        {
+            fclose(file);
+            count++;
+        }
+    }
+    return count;
+}
+
+BEGIN_TEST_SUITE(pnp_telemetry_store_ut)
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    RemoveStoreFiles();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    RemoveStoreFiles();
+}
+
+TEST_FUNCTION(PnP_TelemetryStore_replays_messages_in_order_after_an_outage)
+{
+    TEST_CLIENT client;
+    TestClient_Init(&client, 0);
+    PNP_TELEMETRY_STORE_HANDLE store = PnP_TelemetryStore_Open(TEST_STORE_PATH, TEST_SEGMENT_SIZE, TEST_MAX_SEGMENTS);
+    ASSERT_IS_NOT_NULL(store);
+
+    // Spans several segments
+    AppendSamples(store, 0, 100);
+    ASSERT_ARE_EQUAL(size_t, 100, PnP_TelemetryStore_GetMessageCount(store));
+
+    client.connected = false;
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_TelemetryStore_Replay(store, 100, TestClient_Send, &client));
+    ASSERT_ARE_EQUAL(size_t, 100, PnP_TelemetryStore_GetMessageCount(store));
+
+    // Messages keep arriving while the replay is in progress
+    client.connected = true;
+    ASSERT_ARE_EQUAL(size_t, 30, PnP_TelemetryStore_Replay(store, 30, TestClient_Send, &client));
+    AppendSamples(store, 100, 20);
+    ASSERT_ARE_EQUAL(size_t, 90, PnP_TelemetryStore_Replay(store, 1000, TestClient_Send, &client));
+
+    ASSERT_ARE_EQUAL(size_t, 120, client.sentCount);
+    ASSERT_IS_TRUE(client.inOrder);
+    ASSERT_ARE_EQUAL(char_ptr, "sensor", client.lastComponent);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"sample\":00119}", client.lastMessage);
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_TelemetryStore_GetMessageCount(store));
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_TelemetryStore_GetDroppedCount(store));
+
+    // Replayed segments are deleted
+    ASSERT_ARE_EQUAL(size_t, 1, CountSegmentFiles());
+
+    PnP_TelemetryStore_Close(store);
+}
+
+TEST_FUNCTION(PnP_TelemetryStore_keeps_messages_across_restarts)
+{
+    TEST_CLIENT client;
+    TestClient_Init(&client, 0);
+    PNP_TELEMETRY_STORE_HANDLE store = PnP_TelemetryStore_Open(TEST_STORE_PATH, TEST_SEGMENT_SIZE, TEST_MAX_SEGMENTS);
+    ASSERT_IS_NOT_NULL(store);
+
+    AppendSamples(store, 0, 60);
+    ASSERT_ARE_EQUAL(size_t, 25, PnP_TelemetryStore_Replay(store, 25, TestClient_Send, &client));
+    PnP_TelemetryStore_Close(store);
+
+    store = PnP_TelemetryStore_Open(TEST_STORE_PATH, TEST_SEGMENT_SIZE, TEST_MAX_SEGMENTS);
+    ASSERT_IS_NOT_NULL(store);
+    ASSERT_ARE_EQUAL(size_t, 35, PnP_TelemetryStore_GetMessageCount(store));
+
+    AppendSamples(store, 60, 10);
+    ASSERT_ARE_EQUAL(size_t, 45, PnP_TelemetryStore_Replay(store, 1000, TestClient_Send, &client));
+    ASSERT_ARE_EQUAL(size_t, 70, client.sentCount);
+    ASSERT_IS_TRUE(client.inOrder);
+
+    PnP_TelemetryStore_Close(store);
+}
+
+TEST_FUNCTION(PnP_TelemetryStore_leaves_unsent_messages_in_the_store)
+{
+    TEST_CLIENT client;
+    TestClient_Init(&client, 0);
+    PNP_TELEMETRY_STORE_HANDLE store = PnP_TelemetryStore_Open(TEST_STORE_PATH, TEST_SEGMENT_SIZE, TEST_MAX_SEGMENTS);
+    ASSERT_IS_NOT_NULL(store);
+
+    AppendSamples(store, 0, 10);
+
+    // The connection drops in the middle of the replay
+    client.failAfter = 4;
+    ASSERT_ARE_EQUAL(size_t, 4, PnP_TelemetryStore_Replay(store, 10, TestClient_Send, &client));
+    ASSERT_ARE_EQUAL(size_t, 6, PnP_TelemetryStore_GetMessageCount(store));
+
+    client.failAfter = SIZE_MAX;
+    ASSERT_ARE_EQUAL(size_t, 6, PnP_TelemetryStore_Replay(store, 10, TestClient_Send, &client));
+    ASSERT_IS_TRUE(client.inOrder);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"sample\":00009}", client.lastMessage);
+
+    PnP_TelemetryStore_Close(store);
+}
+
+TEST_FUNCTION(PnP_TelemetryStore_drops_the_oldest_segment_when_full)
+{
+    TEST_CLIENT client;
+    PNP_TELEMETRY_STORE_HANDLE store = PnP_TelemetryStore_Open(TEST_STORE_PATH, TEST_SEGMENT_SIZE, TEST_MAX_SEGMENTS);
+    ASSERT_IS_NOT_NULL(store);
+
+    AppendSamples(store, 0, 1000);
+
+    ASSERT_IS_TRUE(CountSegmentFiles() <= TEST_MAX_SEGMENTS);
+    ASSERT_ARE_EQUAL(size_t, 1000, PnP_TelemetryStore_GetMessageCount(store) + PnP_TelemetryStore_GetDroppedCount(store));
+    ASSERT_IS_TRUE(PnP_TelemetryStore_GetMessageCount(store) > (TEST_MAX_SEGMENTS - 1) * TEST_RECORDS_PER_SEGMENT);
+
+    // The newest messages are kept
+    TestClient_Init(&client, (long)PnP_TelemetryStore_GetDroppedCount(store));
+    size_t messageCount = PnP_TelemetryStore_GetMessageCount(store);
+    ASSERT_ARE_EQUAL(size_t, messageCount, PnP_TelemetryStore_Replay(store, 1000, TestClient_Send, &client));
+    ASSERT_IS_TRUE(client.inOrder);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"sample\":00999}", client.lastMessage);
+
+    PnP_TelemetryStore_Close(store);
+}
+
+TEST_FUNCTION(PnP_TelemetryStore_rejects_a_message_larger_than_a_segment)
+{
+    char message[TEST_SEGMENT_SIZE + 1];
+    PNP_TELEMETRY_STORE_HANDLE store = PnP_TelemetryStore_Open(TEST_STORE_PATH, TEST_SEGMENT_SIZE, TEST_MAX_SEGMENTS);
+    ASSERT_IS_NOT_NULL(store);
+
+    memset(message, 'x', TEST_SEGMENT_SIZE);
+    message[TEST_SEGMENT_SIZE] = '\0';
+    ASSERT_IS_FALSE(PnP_TelemetryStore_Append(store, "sensor", message));
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_TelemetryStore_GetMessageCount(store));
+
+    PnP_TelemetryStore_Close(store);
+}
+
+TEST_FUNCTION(PnP_TelemetryStore_drops_a_torn_record_on_open)
+{
+    TEST_CLIENT client;
+    TestClient_Init(&client, 0);
+    PNP_TELEMETRY_STORE_HANDLE store = PnP_TelemetryStore_Open(TEST_STORE_PATH, TEST_SEGMENT_SIZE, TEST_MAX_SEGMENTS);
+    ASSERT_IS_NOT_NULL(store);
+    AppendSamples(store, 0, 3);
+    PnP_TelemetryStore_Close(store);
+
+    // Corrupt the last byte of the last record, as if the bridge had stopped while writing it
+    FILE* segment = fopen(TEST_STORE_PATH "-0000000000.seg", "r+b");
+    ASSERT_IS_NOT_NULL(segment);
+    ASSERT_ARE_EQUAL(int, 0, fseek(segment, -1, SEEK_END));
+    ASSERT_ARE_EQUAL(int, '?', fputc('?', segment));
+    fclose(segment);
+
+    store = PnP_TelemetryStore_Open(TEST_STORE_PATH, TEST_SEGMENT_SIZE, TEST_MAX_SEGMENTS);
+    ASSERT_IS_NOT_NULL(store);
+    ASSERT_ARE_EQUAL(size_t, 2, PnP_TelemetryStore_GetMessageCount(store));
+
+    // The torn record is overwritten by the next message
+    AppendSamples(store, 2, 1);
+    ASSERT_ARE_EQUAL(size_t, 3, PnP_TelemetryStore_Replay(store, 10, TestClient_Send, &client));
+    ASSERT_IS_TRUE(client.inOrder);
+
+    PnP_TelemetryStore_Close(store);
+}
+
+TEST_FUNCTION(PnP_TelemetryStore_skips_a_corrupted_segment_on_replay)
+{
+    TEST_CLIENT client;
+    PNP_TELEMETRY_STORE_HANDLE store = PnP_TelemetryStore_Open(TEST_STORE_PATH, TEST_SEGMENT_SIZE, TEST_MAX_SEGMENTS);
+    ASSERT_IS_NOT_NULL(store);
+    AppendSamples(store, 0, 50);
+
+    // Corrupt the payload of the second record of the first, full segment
+    FILE* segment = fopen(TEST_STORE_PATH "-0000000000.seg", "r+b");
+    ASSERT_IS_NOT_NULL(segment);
+    ASSERT_ARE_EQUAL(int, 0, fseek(segment, TEST_RECORD_SIZE + 20, SEEK_SET));
+    ASSERT_ARE_NOT_EQUAL(int, EOF, fputc('7', segment));
+    fclose(segment);
+
+    TestClient_Init(&client, 0);
+    client.failAfter = 1;
+    ASSERT_ARE_EQUAL(size_t, 1, PnP_TelemetryStore_Replay(store, 100, TestClient_Send, &client));
+
+    // The rest of the first segment is dropped, replay resumes with the second one
+    TestClient_Init(&client, TEST_RECORDS_PER_SEGMENT);
+    ASSERT_ARE_EQUAL(size_t, 50 - TEST_RECORDS_PER_SEGMENT, PnP_TelemetryStore_Replay(store, 100, TestClient_Send, &client));
+    ASSERT_IS_TRUE(client.inOrder);
+    ASSERT_ARE_EQUAL(size_t, TEST_RECORDS_PER_SEGMENT - 1, PnP_TelemetryStore_GetDroppedCount(store));
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_TelemetryStore_GetMessageCount(store));
+
+    PnP_TelemetryStore_Close(store);
+}
+
+TEST_FUNCTION(PnP_TelemetryStore_replay_throughput)
+{
+    const long messageCount = 20000;
+    TEST_CLIENT client;
+    TestClient_Init(&client, 0);
+    PNP_TELEMETRY_STORE_HANDLE store = PnP_TelemetryStore_Open(TEST_STORE_PATH, 64 * 1024, 16);
+    ASSERT_IS_NOT_NULL(store);
+
+    // Outage: everything goes to disk
+    clock_t start = clock();
+    AppendSamples(store, 0, messageCount);
+    double appendSeconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    // Reconnect: drain the backlog in replay sized steps
+    start = clock();
+    size_t replayed = 0;
+    while (PnP_TelemetryStore_GetMessageCount(store) > 0)
+    {
+        replayed += PnP_TelemetryStore_Replay(store, 100, TestClient_Send, &client);
+    }
+    double replaySeconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    ASSERT_ARE_EQUAL(size_t, (size_t)messageCount, replayed);
+    ASSERT_IS_TRUE(client.inOrder);
+    ASSERT_ARE_EQUAL(size_t, 0, PnP_TelemetryStore_GetDroppedCount(store));
+
+    (void)printf("PnP_TelemetryStore: %ld messages, append %.0f msg/s, replay %.0f msg/s\r\n", messageCount,
+        (appendSeconds > 0) ? messageCount / appendSeconds : 0.0, (replaySeconds > 0) ? messageCount / replaySeconds : 0.0);
+
+    PnP_TelemetryStore_Close(store);
+}
+
+END_TEST_SUITE(pnp_telemetry_store_ut)
@@ -0,0 +1,207 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "serial_pnp_dispatch.h"
+
+// Number of lookups timed in the lookup cost benchmark
+#define BENCHMARK_LOOKUP_COUNT 1000000
+
+static char** CreateNames(size_t count)
+{
+    char** names = (char**)malloc(count * sizeof(char*));
+    ASSERT_IS_NOT_NULL(names);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        names[i] = (char*)malloc(32);
+        ASSERT_IS_NOT_NULL(names[i]);
+        (void)snprintf(names[i], 32, "event%lu", (unsigned long)i);
+    }
+
+    return names;
+}
+
+static void DestroyNames(char** names, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free(names[i]);
+    }
+    free(names);
+}
+
+BEGIN_TEST_SUITE(serial_pnp_dispatch_ut)
+
+TEST_FUNCTION(SerialPnp_Dispatch_finds_entries_by_name_and_index)
+{
+    SERIALPNP_DISPATCH_INTERFACE_SIZE sizes[1] = { { { 2, 1, 1 } } };
+    SERIALPNP_DISPATCH_HANDLE dispatch = SerialPnp_Dispatch_Create(sizes, 1);
+    int temperature = 1;
+    int humidity = 2;
+    int interval = 3;
+    int blink = 4;
+
+    ASSERT_IS_NOT_NULL(dispatch);
+    ASSERT_IS_TRUE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "temperature", &temperature));
+    ASSERT_IS_TRUE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "humidity", &humidity));
+    ASSERT_IS_TRUE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_PROPERTY, "interval", &interval));
+    ASSERT_IS_TRUE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_COMMAND, "blink", &blink));
+
+    ASSERT_ARE_EQUAL(void_ptr, &temperature, SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "temperature", 11));
+    ASSERT_ARE_EQUAL(void_ptr, &humidity, SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "humidity", 8));
+    ASSERT_ARE_EQUAL(void_ptr, &interval, SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_PROPERTY, "interval", 8));
+    ASSERT_ARE_EQUAL(void_ptr, &blink, SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_COMMAND, "blink", 5));
+
+    // Names are only found among entries of their own kind
+    ASSERT_IS_NULL(SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_COMMAND, "interval", 8));
+    ASSERT_IS_NULL(SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "pressure", 8));
+
+    ASSERT_ARE_EQUAL(void_ptr, &temperature, SerialPnp_Dispatch_FindByIndex(dispatch, 0, SERIALPNP_DISPATCH_EVENT, 0));
+    ASSERT_ARE_EQUAL(void_ptr, &humidity, SerialPnp_Dispatch_FindByIndex(dispatch, 0, SERIALPNP_DISPATCH_EVENT, 1));
+    ASSERT_IS_NULL(SerialPnp_Dispatch_FindByIndex(dispatch, 0, SERIALPNP_DISPATCH_EVENT, 2));
+    ASSERT_ARE_EQUAL(size_t, 2, SerialPnp_Dispatch_GetCount(dispatch, 0, SERIALPNP_DISPATCH_EVENT));
+
+    SerialPnp_Dispatch_Destroy(dispatch);
+}
+
+TEST_FUNCTION(SerialPnp_Dispatch_FindByName_matches_names_inside_packets)
+{
+    SERIALPNP_DISPATCH_INTERFACE_SIZE sizes[1] = { { { 2, 0, 0 } } };
+    SERIALPNP_DISPATCH_HANDLE dispatch = SerialPnp_Dispatch_Create(sizes, 1);
+    int tick = 1;
+    int ticks = 2;
+
+    // An event notification payload: interface number, name length, name, then the value
+    const char payload[] = { 1, 4, 't', 'i', 'c', 'k', 7, 0, 0, 0 };
+
+    ASSERT_IS_NOT_NULL(dispatch);
+    ASSERT_IS_TRUE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "ticks", &ticks));
+    ASSERT_IS_NULL(SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_EVENT, payload + 2, 4));
+
+    ASSERT_IS_TRUE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "tick", &tick));
+    ASSERT_ARE_EQUAL(void_ptr, &tick, SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_EVENT, payload + 2, 4));
+    ASSERT_ARE_EQUAL(void_ptr, &ticks, SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "ticks", 5));
+
+    SerialPnp_Dispatch_Destroy(dispatch);
+}
+
+TEST_FUNCTION(SerialPnp_Dispatch_keeps_interfaces_apart)
+{
+    SERIALPNP_DISPATCH_INTERFACE_SIZE sizes[2] = { { { 1, 0, 0 } }, { { 1, 0, 0 } } };
+    SERIALPNP_DISPATCH_HANDLE dispatch = SerialPnp_Dispatch_Create(sizes, 2);
+    int first = 1;
+    int second = 2;
+
+    ASSERT_IS_NOT_NULL(dispatch);
+    ASSERT_IS_TRUE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "temperature", &first));
+    ASSERT_IS_TRUE(SerialPnp_Dispatch_Add(dispatch, 1, SERIALPNP_DISPATCH_EVENT, "temperature", &second));
+
+    ASSERT_ARE_EQUAL(void_ptr, &first, SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "temperature", 11));
+    ASSERT_ARE_EQUAL(void_ptr, &second, SerialPnp_Dispatch_FindByName(dispatch, 1, SERIALPNP_DISPATCH_EVENT, "temperature", 11));
+    ASSERT_ARE_EQUAL(void_ptr, &second, SerialPnp_Dispatch_FindByIndex(dispatch, 1, SERIALPNP_DISPATCH_EVENT, 0));
+    ASSERT_IS_NULL(SerialPnp_Dispatch_FindByName(dispatch, 2, SERIALPNP_DISPATCH_EVENT, "temperature", 11));
+    ASSERT_IS_NULL(SerialPnp_Dispatch_FindByIndex(dispatch, 2, SERIALPNP_DISPATCH_EVENT, 0));
+
+    SerialPnp_Dispatch_Destroy(dispatch);
+}
+
+TEST_FUNCTION(SerialPnp_Dispatch_Add_keeps_first_definition_of_repeated_name)
+{
+    SERIALPNP_DISPATCH_INTERFACE_SIZE sizes[1] = { { { 2, 0, 0 } } };
+    SERIALPNP_DISPATCH_HANDLE dispatch = SerialPnp_Dispatch_Create(sizes, 1);
+    int first = 1;
+    int second = 2;
+    int third = 3;
+
+    ASSERT_IS_NOT_NULL(dispatch);
+    ASSERT_IS_TRUE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "tick", &first));
+    ASSERT_IS_TRUE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "tick", &second));
+    ASSERT_IS_FALSE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "tock", &third));
+    ASSERT_IS_FALSE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_COMMAND, "tock", &third));
+
+    ASSERT_ARE_EQUAL(void_ptr, &first, SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "tick", 4));
+    ASSERT_ARE_EQUAL(void_ptr, &second, SerialPnp_Dispatch_FindByIndex(dispatch, 0, SERIALPNP_DISPATCH_EVENT, 1));
+    ASSERT_IS_NULL(SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "tock", 4));
+
+    SerialPnp_Dispatch_Destroy(dispatch);
+}
+
+TEST_FUNCTION(SerialPnp_Dispatch_handles_NULL_and_empty_tables)
+{
+    SERIALPNP_DISPATCH_HANDLE dispatch = SerialPnp_Dispatch_Create(NULL, 0);
+
+    ASSERT_IS_NOT_NULL(dispatch);
+    ASSERT_IS_NULL(SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_EVENT, "tick", 4));
+    ASSERT_IS_NULL(SerialPnp_Dispatch_FindByName(NULL, 0, SERIALPNP_DISPATCH_EVENT, "tick", 4));
+    ASSERT_IS_NULL(SerialPnp_Dispatch_FindByIndex(NULL, 0, SERIALPNP_DISPATCH_EVENT, 0));
+    ASSERT_IS_FALSE(SerialPnp_Dispatch_Add(NULL, 0, SERIALPNP_DISPATCH_EVENT, "tick", NULL));
+    ASSERT_ARE_EQUAL(size_t, 0, SerialPnp_Dispatch_GetCount(NULL, 0, SERIALPNP_DISPATCH_EVENT));
+
+    SerialPnp_Dispatch_Destroy(dispatch);
+    SerialPnp_Dispatch_Destroy(NULL);
+}
+
+// Micro-benchmark: the cost of resolving an event name from a packet should stay flat as the number of events
+// grows. Timings are reported rather than asserted so the test stays reliable on loaded build machines.
+TEST_FUNCTION(SerialPnp_Dispatch_FindByName_lookup_cost_benchmark)
+{
+    const size_t eventCounts[] = { 4, 32, 256, 4096 };
+
+    for (size_t c = 0; c < sizeof(eventCounts) / sizeof(eventCounts[0]); c++)
+    {
+        size_t count = eventCounts[c];
+        char** names = CreateNames(count);
+        size_t* nameLengths = (size_t*)malloc(count * sizeof(size_t));
+        SERIALPNP_DISPATCH_INTERFACE_SIZE sizes[1] = { { { count, 0, 0 } } };
+        SERIALPNP_DISPATCH_HANDLE dispatch = SerialPnp_Dispatch_Create(sizes, 1);
+        size_t found = 0;
+
+        ASSERT_IS_NOT_NULL(nameLengths);
+        ASSERT_IS_NOT_NULL(dispatch);
+        for (size_t i = 0; i < count; i++)
+        {
+            nameLengths[i] = strlen(names[i]);
+            ASSERT_IS_TRUE(SerialPnp_Dispatch_Add(dispatch, 0, SERIALPNP_DISPATCH_EVENT, names[i], names[i]));
+        }
+
+        clock_t start = clock();
+        for (size_t i = 0; i < BENCHMARK_LOOKUP_COUNT; i++)
+        {
+            // Stride through the names so successive lookups do not hit the same slot
+            size_t n = (i * 7919) % count;
+            if (SerialPnp_Dispatch_FindByName(dispatch, 0, SERIALPNP_DISPATCH_EVENT, names[n], nameLengths[n]) == names[n])
+            {
+                found++;
+            }
+        }
+        clock_t elapsed = clock() - start;
+
+        ASSERT_ARE_EQUAL(size_t, BENCHMARK_LOOKUP_COUNT, found);
+        (void)printf("SerialPnp_Dispatch_FindByName: %5lu events, %8.1f ns/lookup\r\n", (unsigned long)count,
+            ((double)elapsed * 1e9 / CLOCKS_PER_SEC) / BENCHMARK_LOOKUP_COUNT);
+
+        SerialPnp_Dispatch_Destroy(dispatch);
+        free(nameLengths);
+        DestroyNames(names, count);
+    }
+}
+
+END_TEST_SUITE(serial_pnp_dispatch_ut)
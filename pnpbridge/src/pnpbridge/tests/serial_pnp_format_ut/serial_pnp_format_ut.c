@@ -0,0 +1,312 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "serial_pnp_format.h"
+
+#define TEST_MAX_MESSAGES 4
+
+typedef struct TEST_EVENT
+{
+    const char* Name;
+    Schema DataSchema;
+} TEST_EVENT;
+
+// Events of the interface the test batches are for, by their position in its descriptor
+static const TEST_EVENT TestEvents[] = {
+    { "temperature", Float },
+    { "count", Int },
+    { "label", String },
+    { "uptime", Long }
+};
+
+typedef struct TEST_SINK
+{
+    size_t Count;
+    char* Messages[TEST_MAX_MESSAGES];
+} TEST_SINK;
+
+static bool TestSink_Lookup(void* context, uint8_t index, const char** name, Schema* schema)
+{
+    (void)context;
+
+    if (index >= sizeof(TestEvents) / sizeof(TestEvents[0]))
+    {
+        return false;
+    }
+
+    *name = TestEvents[index].Name;
+    *schema = TestEvents[index].DataSchema;
+    return true;
+}
+
+static void TestSink_Send(void* context, const char* message)
+{
+    TEST_SINK* sink = (TEST_SINK*)context;
+
+    ASSERT_IS_TRUE(sink->Count < TEST_MAX_MESSAGES);
+    sink->Messages[sink->Count] = (char*)malloc(strlen(message) + 1);
+    ASSERT_IS_NOT_NULL(sink->Messages[sink->Count]);
+    strcpy(sink->Messages[sink->Count], message);
+    sink->Count++;
+}
+
+static void TestSink_Clear(TEST_SINK* sink)
+{
+    for (size_t i = 0; i < sink->Count; i++)
+    {
+        free(sink->Messages[i]);
+    }
+    memset(sink, 0, sizeof(*sink));
+}
+
+// Formats a value into a buffer of exactly the room it needs, so that writing past it is caught by the sanitizers
+static char* FormatValue(Schema schema, const uint8_t* data, size_t length)
+{
+    size_t size = SerialPnp_GetFormattedLength(schema, length);
+    char* formatted = (char*)malloc(size);
+    ASSERT_IS_NOT_NULL(formatted);
+
+    if (!SerialPnp_FormatBinarySchema(schema, data, length, formatted, size))
+    {
+        free(formatted);
+        return NULL;
+    }
+
+    return formatted;
+}
+
+static void AssertFormatsAs(Schema schema, const void* data, size_t length, const char* expected)
+{
+    char* formatted = FormatValue(schema, (const uint8_t*)data, length);
+
+    ASSERT_IS_NOT_NULL(formatted);
+    ASSERT_ARE_EQUAL(char_ptr, expected, formatted);
+    free(formatted);
+}
+
+BEGIN_TEST_SUITE(serial_pnp_format_ut)
+
+TEST_FUNCTION(SerialPnp_FormatBinarySchema_formats_every_schema)
+{
+    uint8_t byteValue = 200;
+    uint8_t trueValue = 1;
+    uint8_t falseValue = 0;
+    float floatValue = -21.5f;
+    double doubleValue = 2.5;
+    int32_t intValue = -123456;
+    int64_t longValue = -1234567890123LL;
+
+    AssertFormatsAs(Byte, &byteValue, 1, "200");
+    AssertFormatsAs(Boolean, &trueValue, 1, "true");
+    AssertFormatsAs(Boolean, &falseValue, 1, "false");
+    AssertFormatsAs(Float, &floatValue, sizeof(floatValue), "-21.500000");
+    AssertFormatsAs(Double, &doubleValue, sizeof(doubleValue), "2.5");
+    AssertFormatsAs(Int, &intValue, sizeof(intValue), "-123456");
+    AssertFormatsAs(Long, &longValue, sizeof(longValue), "-1234567890123");
+    AssertFormatsAs(String, "hello", 5, "\"hello\"");
+}
+
+TEST_FUNCTION(SerialPnp_FormatBinarySchema_formats_values_that_are_not_numbers_as_null)
+{
+    float floatValue = INFINITY;
+    double doubleValue = NAN;
+
+    AssertFormatsAs(Float, &floatValue, sizeof(floatValue), "null");
+    AssertFormatsAs(Double, &doubleValue, sizeof(doubleValue), "null");
+}
+
+TEST_FUNCTION(SerialPnp_FormatBinarySchema_reads_unaligned_and_padded_values)
+{
+    // The device library answers with 4 bytes whatever the schema, values follow a one byte header in packets
+    uint8_t packet[1 + sizeof(int64_t)] = { 0 };
+    int32_t intValue = 0x12345678;
+    int64_t longValue = INT64_MIN;
+
+    packet[1] = 7;
+    AssertFormatsAs(Byte, packet + 1, 4, "7");
+    AssertFormatsAs(Boolean, packet + 1, 4, "true");
+
+    memcpy(packet + 1, &intValue, sizeof(intValue));
+    AssertFormatsAs(Int, packet + 1, sizeof(intValue), "305419896");
+
+    memcpy(packet + 1, &longValue, sizeof(longValue));
+    AssertFormatsAs(Long, packet + 1, sizeof(longValue), "-9223372036854775808");
+}
+
+TEST_FUNCTION(SerialPnp_FormatBinarySchema_rejects_short_values_and_unknown_schemas)
+{
+    uint8_t data[8] = { 0 };
+    char formatted[SERIALPNP_MAX_VALUE_STRING_LENGTH];
+
+    ASSERT_IS_NULL(FormatValue(Byte, data, 0));
+    ASSERT_IS_NULL(FormatValue(Boolean, data, 0));
+    ASSERT_IS_NULL(FormatValue(Float, data, 3));
+    ASSERT_IS_NULL(FormatValue(Int, data, 3));
+    ASSERT_IS_NULL(FormatValue(Double, data, 7));
+    ASSERT_IS_NULL(FormatValue(Long, data, 4));
+    ASSERT_IS_NULL(FormatValue(Invalid, data, sizeof(data)));
+    ASSERT_IS_NULL(FormatValue((Schema)(String + 1), data, sizeof(data)));
+
+    // Nor does it write to a buffer with less room than it asks for
+    ASSERT_IS_FALSE(SerialPnp_FormatBinarySchema(Int, data, 4, formatted, sizeof(formatted) - 1));
+    ASSERT_IS_FALSE(SerialPnp_FormatBinarySchema(String, data, 4, formatted, SerialPnp_GetFormattedLength(String, 4) - 1));
+}
+
+TEST_FUNCTION(SerialPnp_FormatBinarySchema_escapes_and_terminates_strings)
+{
+    const uint8_t quoted[] = { 'a', '"', 'b', '\\', 'c', '\n', 0x1F };
+    const uint8_t terminated[] = { 'o', 'k', 0, 'x', 'y' };
+    const uint8_t controls[] = { 1, 2, 3 };
+
+    AssertFormatsAs(String, quoted, sizeof(quoted), "\"a\\\"b\\\\c\\u000a\\u001f\"");
+    AssertFormatsAs(String, terminated, sizeof(terminated), "\"ok\"");
+    AssertFormatsAs(String, "", 0, "\"\"");
+
+    // Every byte escaped fills the room asked for exactly
+    AssertFormatsAs(String, controls, sizeof(controls), "\"\\u0001\\u0002\\u0003\"");
+    ASSERT_ARE_EQUAL(size_t, strlen("\"\\u0001\\u0002\\u0003\"") + 1, SerialPnp_GetFormattedLength(String, sizeof(controls)));
+}
+
+TEST_FUNCTION(SerialPnp_FormatEventBatch_formats_entries_as_one_message)
+{
+    float temperature = 21.5f;
+    int32_t count = 3;
+    uint8_t entries[] = {
+        0, 4, 0, 0, 0, 0,
+        1, 4, 0, 0, 0, 0,
+        2, 2, 'o', 'n'
+    };
+    TEST_SINK sink = { 0 };
+
+    memcpy(entries + 2, &temperature, sizeof(temperature));
+    memcpy(entries + 8, &count, sizeof(count));
+
+    ASSERT_IS_TRUE(SerialPnp_FormatEventBatch(entries, sizeof(entries), TestSink_Lookup, TestSink_Send, &sink));
+    ASSERT_ARE_EQUAL(size_t, 1, sink.Count);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"temperature\":21.500000,\"count\":3,\"label\":\"on\"}", sink.Messages[0]);
+
+    TestSink_Clear(&sink);
+}
+
+TEST_FUNCTION(SerialPnp_FormatEventBatch_leaves_out_unknown_events_and_short_values)
+{
+    int32_t count = 9;
+    uint8_t entries[] = {
+        9, 1, 0,            // no such event
+        0, 2, 0, 0,         // too short for a Float
+        1, 4, 0, 0, 0, 0,
+        3, 0                // too short for a Long
+    };
+    TEST_SINK sink = { 0 };
+
+    memcpy(entries + 9, &count, sizeof(count));
+
+    ASSERT_IS_TRUE(SerialPnp_FormatEventBatch(entries, sizeof(entries), TestSink_Lookup, TestSink_Send, &sink));
+    ASSERT_ARE_EQUAL(size_t, 1, sink.Count);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"count\":9}", sink.Messages[0]);
+    TestSink_Clear(&sink);
+
+    // A batch left with nothing to send sends nothing
+    ASSERT_IS_TRUE(SerialPnp_FormatEventBatch(entries, 7, TestSink_Lookup, TestSink_Send, &sink));
+    ASSERT_ARE_EQUAL(size_t, 0, sink.Count);
+    ASSERT_IS_TRUE(SerialPnp_FormatEventBatch(entries, 0, TestSink_Lookup, TestSink_Send, &sink));
+    ASSERT_ARE_EQUAL(size_t, 0, sink.Count);
+}
+
+TEST_FUNCTION(SerialPnp_FormatEventBatch_rejects_truncated_entries)
+{
+    const uint8_t entries[] = {
+        1, 4, 5, 0, 0, 0,
+        1, 4, 6, 0, 0
+    };
+    TEST_SINK sink = { 0 };
+
+    // The last entry's value runs past the end
+    ASSERT_IS_FALSE(SerialPnp_FormatEventBatch(entries, sizeof(entries), TestSink_Lookup, TestSink_Send, &sink));
+    ASSERT_ARE_EQUAL(size_t, 0, sink.Count);
+
+    // The last entry's header runs past the end
+    ASSERT_IS_FALSE(SerialPnp_FormatEventBatch(entries, 7, TestSink_Lookup, TestSink_Send, &sink));
+    ASSERT_ARE_EQUAL(size_t, 0, sink.Count);
+
+    // The entries before it are complete
+    ASSERT_IS_TRUE(SerialPnp_FormatEventBatch(entries, 6, TestSink_Lookup, TestSink_Send, &sink));
+    ASSERT_ARE_EQUAL(size_t, 1, sink.Count);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"count\":5}", sink.Messages[0]);
+    TestSink_Clear(&sink);
+}
+
+TEST_FUNCTION(SerialPnp_FormatEventBatch_formats_oversized_entries)
+{
+    // Two String values of 255 control bytes each, escaped to far more than a message built on the stack holds
+    uint8_t entries[2 * (2 + 255)];
+    char* expected = (char*)malloc(2 * (12 + 6 * 255) + 3);
+    char* out = expected;
+    TEST_SINK sink = { 0 };
+
+    ASSERT_IS_NOT_NULL(expected);
+    out += sprintf(out, "{");
+    for (size_t e = 0; e < 2; e++)
+    {
+        uint8_t* entry = entries + e * (2 + 255);
+        entry[0] = (uint8_t)(2 - e * 2);     // label, then temperature with a value longer than a Float
+        entry[1] = 255;
+        memset(entry + 2, 0x01, 255);
+    }
+    out += sprintf(out, "\"label\":\"");
+    for (size_t i = 0; i < 255; i++)
+    {
+        out += sprintf(out, "\\u0001");
+    }
+    float temperature;
+    memcpy(&temperature, entries + (2 + 255) + 2, sizeof(temperature));
+    out += sprintf(out, "\",\"temperature\":%.6f}", temperature);
+
+    ASSERT_IS_TRUE(SERIALPNP_TELEMETRY_MESSAGE_LENGTH < strlen(expected));
+    ASSERT_IS_TRUE(SerialPnp_FormatEventBatch(entries, sizeof(entries), TestSink_Lookup, TestSink_Send, &sink));
+    ASSERT_ARE_EQUAL(size_t, 1, sink.Count);
+    ASSERT_ARE_EQUAL(char_ptr, expected, sink.Messages[0]);
+
+    TestSink_Clear(&sink);
+    free(expected);
+}
+
+TEST_FUNCTION(SerialPnp_FormatEventBatch_starts_a_new_message_for_repeated_events)
+{
+    const uint8_t entries[] = {
+        1, 4, 1, 0, 0, 0,
+        2, 1, 'a',
+        1, 4, 2, 0, 0, 0,
+        1, 4, 3, 0, 0, 0,
+        2, 1, 'b'
+    };
+    TEST_SINK sink = { 0 };
+
+    ASSERT_IS_TRUE(SerialPnp_FormatEventBatch(entries, sizeof(entries), TestSink_Lookup, TestSink_Send, &sink));
+    ASSERT_ARE_EQUAL(size_t, 3, sink.Count);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"count\":1,\"label\":\"a\"}", sink.Messages[0]);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"count\":2}", sink.Messages[1]);
+    ASSERT_ARE_EQUAL(char_ptr, "{\"count\":3,\"label\":\"b\"}", sink.Messages[2]);
+
+    TestSink_Clear(&sink);
+}
+
+END_TEST_SUITE(serial_pnp_format_ut)
@@ -0,0 +1,775 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef WIN32
+// posix_openpt, ptsname and cfmakeraw for the pty benchmark
+#define _GNU_SOURCE
+#endif
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#endif
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "serial_pnp_framing.h"
+
+#define TEST_PACKET_TYPE_EVENT 0x0A
+#define TEST_PACKET_TYPE_COMMAND_RESPONSE 0x06
+
+// Number of frames sent through the pty in the throughput benchmark
+#define BENCHMARK_FRAME_COUNT 20000
+#define BENCHMARK_FRAME_LENGTH 32
+
+// Bytes handed to the decoder per read when a test reads whatever is available
+#define TEST_READ_SIZE 512
+
+// Bytes sent through the encoder and decoder in the in-memory throughput benchmark
+#define BENCHMARK_CODEC_BYTES (16 * 1024 * 1024)
+
+#define MAX_TEST_FRAMES 512
+
+typedef struct TEST_FRAME_LOG {
+    size_t Count;
+    size_t Overflows;
+    size_t Lengths[MAX_TEST_FRAMES];
+    uint8_t Frames[MAX_TEST_FRAMES][SERIALPNP_RX_BUFFER_SIZE];
+} TEST_FRAME_LOG;
+
+static TEST_FRAME_LOG g_expectedFrames;
+static TEST_FRAME_LOG g_actualFrames;
+static uint8_t g_rxBuffer[SERIALPNP_RX_BUFFER_SIZE];
+
+static unsigned int NextRandom(unsigned int* seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static void LogFrame(TEST_FRAME_LOG* log, const uint8_t* frame, size_t length)
+{
+    ASSERT_IS_TRUE(log->Count < MAX_TEST_FRAMES);
+    memcpy(log->Frames[log->Count], frame, length);
+    log->Lengths[log->Count] = length;
+    log->Count++;
+}
+
+// Byte at a time decoder equivalent to the receive loop the chunked decoder replaced. Used as the reference
+// for the frames SerialPnp_UnsolicitedPacket is expected to see. A frame that reaches capacity bytes is
+// dropped, as the decoder does.
+typedef struct REFERENCE_DECODER {
+    uint8_t Buffer[SERIALPNP_RX_BUFFER_SIZE];
+    unsigned int Capacity;
+    unsigned int Index;
+    bool Escaped;
+} REFERENCE_DECODER;
+
+static bool ReferenceDecoder_Push(REFERENCE_DECODER* decoder, uint8_t inb, uint8_t packetType, size_t* length, bool* overflow)
+{
+    *overflow = false;
+
+    if (SERIALPNP_START_OF_FRAME_BYTE == inb)
+    {
+        decoder->Index = 0;
+        decoder->Escaped = false;
+        return false;
+    }
+
+    if (SERIALPNP_ESCAPE_BYTE == inb)
+    {
+        decoder->Escaped = true;
+        return false;
+    }
+
+    if (decoder->Escaped)
+    {
+        inb++;
+        decoder->Escaped = false;
+    }
+
+    decoder->Buffer[decoder->Index++] = inb;
+    if (decoder->Index >= decoder->Capacity)
+    {
+        decoder->Index = 0;
+        decoder->Escaped = false;
+        *overflow = true;
+        return false;
+    }
+
+    if (decoder->Index >= SERIALPNP_MIN_PACKET_LENGTH)
+    {
+        unsigned int packetLength = (unsigned int)(decoder->Buffer[0] | (decoder->Buffer[1] << 8));
+        if ((decoder->Index == packetLength) && (packetType == 0x00 || packetType == decoder->Buffer[2]))
+        {
+            *length = decoder->Index;
+            decoder->Index = 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Byte at a time escaping, the way the bridge and the device firmware used to send frames. Returns the number
+// of bytes written.
+static size_t ReferenceEscape(uint8_t* stream, const uint8_t* data, size_t length)
+{
+    size_t encoded = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if ((SERIALPNP_START_OF_FRAME_BYTE == data[i]) || (SERIALPNP_ESCAPE_BYTE == data[i]))
+        {
+            stream[encoded++] = SERIALPNP_ESCAPE_BYTE;
+            stream[encoded++] = (uint8_t)(data[i] - 1);
+        }
+        else
+        {
+            stream[encoded++] = data[i];
+        }
+    }
+
+    return encoded;
+}
+
+// Fills data with random bytes, one in every framingOneIn of them a start of frame or an escape byte
+static void FillRandom(uint8_t* data, size_t length, unsigned int framingOneIn, unsigned int seed)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned int r = NextRandom(&seed);
+        unsigned int framing = r % (2 * framingOneIn);
+        data[i] = (framing == 0) ? SERIALPNP_START_OF_FRAME_BYTE : (framing == 1) ? SERIALPNP_ESCAPE_BYTE : (uint8_t)(r >> 4);
+    }
+}
+
+// Appends the escaped encoding of a frame of the given type and total length to stream, the way the
+// bridge and the device firmware send it. Returns the number of bytes written.
+static size_t EncodeFrame(uint8_t* stream, uint8_t packetType, size_t length, unsigned int seed)
+{
+    uint8_t frame[SERIALPNP_RX_BUFFER_SIZE];
+
+    frame[0] = (uint8_t)(length & 0xFF);
+    frame[1] = (uint8_t)(length >> 8);
+    frame[2] = packetType;
+    for (size_t i = 3; i < length; i++)
+    {
+        // Sprinkle framing bytes through the payload so escapes are exercised
+        seed = seed * 1103515245 + 12345;
+        unsigned int r = (seed >> 16) % 16;
+        frame[i] = (r == 0) ? SERIALPNP_START_OF_FRAME_BYTE : (r == 1) ? SERIALPNP_ESCAPE_BYTE : (uint8_t)(seed >> 8);
+    }
+
+    stream[0] = SERIALPNP_START_OF_FRAME_BYTE;
+    return 1 + ReferenceEscape(stream + 1, frame, length);
+}
+
+static void DecodeWithReference(const uint8_t* stream, size_t streamLength, uint8_t packetType,
+    size_t capacity, TEST_FRAME_LOG* log)
+{
+    static REFERENCE_DECODER decoder;
+    memset(&decoder, 0, sizeof(decoder));
+    decoder.Capacity = (unsigned int)capacity;
+    log->Count = 0;
+    log->Overflows = 0;
+
+    for (size_t i = 0; i < streamLength; i++)
+    {
+        size_t length;
+        bool overflow;
+        if (ReferenceDecoder_Push(&decoder, stream[i], packetType, &length, &overflow))
+        {
+            LogFrame(log, decoder.Buffer, length);
+        }
+        if (overflow)
+        {
+            log->Overflows++;
+        }
+    }
+}
+
+// Feeds the stream to a decoder with a buffer of capacity bytes in chunks whose sizes come from chunkSizes,
+// cycling through them
+static void DecodeInChunks(const uint8_t* stream, size_t streamLength, uint8_t packetType, size_t capacity,
+    const size_t* chunkSizes, size_t chunkSizeCount, TEST_FRAME_LOG* log)
+{
+    static SERIALPNP_RX_DECODER decoder;
+    size_t offset = 0;
+    size_t chunkNumber = 0;
+
+    SerialPnp_RxDecoder_Init(&decoder, g_rxBuffer, capacity);
+    log->Count = 0;
+    log->Overflows = 0;
+
+    for (;;)
+    {
+        const uint8_t* packet;
+        size_t packetLength;
+        SERIALPNP_RX_DECODE_RESULT result = SerialPnp_RxDecoder_Decode(&decoder, packetType, &packet, &packetLength);
+
+        if (SERIALPNP_RX_DECODE_OVERFLOW == result)
+        {
+            log->Overflows++;
+            continue;
+        }
+        if (SERIALPNP_RX_DECODE_PACKET == result)
+        {
+            LogFrame(log, packet, packetLength);
+            continue;
+        }
+
+        if (offset == streamLength)
+        {
+            break;
+        }
+
+        size_t chunkSize;
+        uint8_t* chunk = SerialPnp_RxDecoder_GetChunk(&decoder, &chunkSize);
+        size_t count = chunkSizes[chunkNumber++ % chunkSizeCount];
+        if (count > chunkSize)
+        {
+            count = chunkSize;
+        }
+        if (count > streamLength - offset)
+        {
+            count = streamLength - offset;
+        }
+
+        memcpy(chunk, stream + offset, count);
+        offset += count;
+        SerialPnp_RxDecoder_SetChunkLength(&decoder, count);
+    }
+}
+
+static void AssertSameFrames(const TEST_FRAME_LOG* expected, const TEST_FRAME_LOG* actual)
+{
+    ASSERT_ARE_EQUAL(size_t, expected->Overflows, actual->Overflows);
+    ASSERT_ARE_EQUAL(size_t, expected->Count, actual->Count);
+    for (size_t i = 0; i < expected->Count; i++)
+    {
+        ASSERT_ARE_EQUAL(size_t, expected->Lengths[i], actual->Lengths[i]);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected->Frames[i], actual->Frames[i], expected->Lengths[i]));
+    }
+}
+
+static size_t BuildMixedStream(uint8_t* stream, unsigned int seed)
+{
+    size_t length = 0;
+
+    for (int i = 0; i < 64; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        unsigned int r = (seed >> 16);
+
+        switch (r % 6)
+        {
+        case 0:
+            // Line noise between frames, including stray escapes
+            for (unsigned int j = 0; j < (r >> 4) % 8; j++)
+            {
+                stream[length++] = (j % 3 == 2) ? SERIALPNP_ESCAPE_BYTE : (uint8_t)(r >> j);
+            }
+            break;
+        case 1:
+            // Frame cut short by the start of the next one
+            length += EncodeFrame(stream + length, TEST_PACKET_TYPE_EVENT, 40, r) / 2;
+            break;
+        case 2:
+            length += EncodeFrame(stream + length, TEST_PACKET_TYPE_COMMAND_RESPONSE, 4 + (r >> 4) % 200, r);
+            break;
+        default:
+            length += EncodeFrame(stream + length, TEST_PACKET_TYPE_EVENT, 4 + (r >> 4) % 300, r);
+            break;
+        }
+    }
+
+    return length;
+}
+
+static double GetSeconds(void)
+{
+#ifdef WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
+
+#ifndef WIN32
+typedef struct BENCHMARK_RESULT {
+    size_t Frames;
+    size_t Reads;
+    double Seconds;
+} BENCHMARK_RESULT;
+
+// Sends stream through a pseudo terminal from a child process and decodes it on the other side, reading at
+// most readSize bytes per read() call. readSize 1 is how the receive path used to read the port.
+static BENCHMARK_RESULT RunPtyBenchmark(const uint8_t* stream, size_t streamLength, size_t readSize)
+{
+    static SERIALPNP_RX_DECODER decoder;
+    BENCHMARK_RESULT result = { 0, 0, 0.0 };
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    ASSERT_IS_TRUE(master >= 0);
+    ASSERT_ARE_EQUAL(int, 0, grantpt(master));
+    ASSERT_ARE_EQUAL(int, 0, unlockpt(master));
+
+    int port = open(ptsname(master), O_RDWR | O_NOCTTY);
+    ASSERT_IS_TRUE(port >= 0);
+
+    struct termios tty;
+    ASSERT_ARE_EQUAL(int, 0, tcgetattr(port, &tty));
+    cfmakeraw(&tty);
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+    ASSERT_ARE_EQUAL(int, 0, tcsetattr(port, TCSANOW, &tty));
+
+    double start = GetSeconds();
+
+    pid_t writer = fork();
+    ASSERT_IS_TRUE(writer >= 0);
+    if (writer == 0)
+    {
+        size_t written = 0;
+        close(port);
+        while (written < streamLength)
+        {
+            ssize_t count = write(master, stream + written, streamLength - written);
+            if (count <= 0)
+            {
+                _exit(1);
+            }
+            written += (size_t)count;
+        }
+        _exit(0);
+    }
+
+    SerialPnp_RxDecoder_Init(&decoder, g_rxBuffer, sizeof(g_rxBuffer));
+    while (result.Frames < BENCHMARK_FRAME_COUNT)
+    {
+        const uint8_t* packet;
+        size_t packetLength;
+        SERIALPNP_RX_DECODE_RESULT decodeResult = SerialPnp_RxDecoder_Decode(&decoder, 0x00, &packet, &packetLength);
+        ASSERT_ARE_NOT_EQUAL(int, SERIALPNP_RX_DECODE_OVERFLOW, decodeResult);
+        if (SERIALPNP_RX_DECODE_PACKET == decodeResult)
+        {
+            result.Frames++;
+            continue;
+        }
+
+        size_t chunkSize;
+        uint8_t* chunk = SerialPnp_RxDecoder_GetChunk(&decoder, &chunkSize);
+        ssize_t count = read(port, chunk, (readSize < chunkSize) ? readSize : chunkSize);
+        result.Reads++;
+        ASSERT_IS_TRUE(count > 0);
+        SerialPnp_RxDecoder_SetChunkLength(&decoder, (size_t)count);
+    }
+
+    result.Seconds = GetSeconds() - start;
+
+    int status;
+    ASSERT_ARE_EQUAL(int, writer, waitpid(writer, &status, 0));
+    ASSERT_IS_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    close(port);
+    close(master);
+
+    return result;
+}
+#endif
+
+BEGIN_TEST_SUITE(serial_pnp_framing_ut)
+
+TEST_FUNCTION(SerialPnp_RxDecoder_decodes_escaped_frame)
+{
+    static SERIALPNP_RX_DECODER decoder;
+    const uint8_t stream[] = { SERIALPNP_START_OF_FRAME_BYTE, 0x06, 0x00, TEST_PACKET_TYPE_EVENT, 0x00,
+        SERIALPNP_ESCAPE_BYTE, SERIALPNP_START_OF_FRAME_BYTE - 1, SERIALPNP_ESCAPE_BYTE, SERIALPNP_ESCAPE_BYTE - 1 };
+    const uint8_t expected[] = { 0x06, 0x00, TEST_PACKET_TYPE_EVENT, 0x00, SERIALPNP_START_OF_FRAME_BYTE, SERIALPNP_ESCAPE_BYTE };
+    const uint8_t* packet;
+    size_t packetLength;
+    size_t chunkSize;
+
+    SerialPnp_RxDecoder_Init(&decoder, g_rxBuffer, sizeof(g_rxBuffer));
+    ASSERT_ARE_EQUAL(int, SERIALPNP_RX_DECODE_NEED_MORE, SerialPnp_RxDecoder_Decode(&decoder, 0x00, &packet, &packetLength));
+
+    uint8_t* chunk = SerialPnp_RxDecoder_GetChunk(&decoder, &chunkSize);
+    ASSERT_IS_TRUE(chunkSize >= sizeof(stream));
+    memcpy(chunk, stream, sizeof(stream));
+    SerialPnp_RxDecoder_SetChunkLength(&decoder, sizeof(stream));
+
+    ASSERT_ARE_EQUAL(int, SERIALPNP_RX_DECODE_PACKET, SerialPnp_RxDecoder_Decode(&decoder, 0x00, &packet, &packetLength));
+    ASSERT_ARE_EQUAL(size_t, sizeof(expected), packetLength);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(expected, packet, sizeof(expected)));
+    ASSERT_ARE_EQUAL(int, SERIALPNP_RX_DECODE_NEED_MORE, SerialPnp_RxDecoder_Decode(&decoder, 0x00, &packet, &packetLength));
+}
+
+TEST_FUNCTION(SerialPnp_RxDecoder_delivers_back_to_back_frames_from_one_chunk)
+{
+    static uint8_t stream[4 * SERIALPNP_RX_BUFFER_SIZE];
+    const size_t oneChunk[] = { TEST_READ_SIZE };
+    size_t length = 0;
+
+    for (unsigned int i = 0; i < 8; i++)
+    {
+        length += EncodeFrame(stream + length, TEST_PACKET_TYPE_EVENT, 16 + i, i);
+    }
+
+    DecodeWithReference(stream, length, 0x00, SERIALPNP_RX_BUFFER_SIZE, &g_expectedFrames);
+    DecodeInChunks(stream, length, 0x00, SERIALPNP_RX_BUFFER_SIZE, oneChunk, 1, &g_actualFrames);
+
+    ASSERT_ARE_EQUAL(size_t, 8, g_expectedFrames.Count);
+    AssertSameFrames(&g_expectedFrames, &g_actualFrames);
+}
+
+TEST_FUNCTION(SerialPnp_RxDecoder_matches_byte_at_a_time_decoder_for_any_chunking)
+{
+    static uint8_t stream[64 * 2 * SERIALPNP_RX_BUFFER_SIZE / 8];
+    const size_t chunkings[][4] = {
+        { 1, 1, 1, 1 },
+        { 2, 3, 5, 7 },
+        { 13, 1, 64, 3 },
+        { TEST_READ_SIZE, 17, TEST_READ_SIZE, 1 },
+    };
+    const uint8_t packetTypes[] = { 0x00, TEST_PACKET_TYPE_EVENT, TEST_PACKET_TYPE_COMMAND_RESPONSE };
+
+    for (unsigned int seed = 1; seed <= 16; seed++)
+    {
+        size_t length = BuildMixedStream(stream, seed);
+        ASSERT_IS_TRUE(length <= sizeof(stream));
+
+        for (size_t t = 0; t < sizeof(packetTypes); t++)
+        {
+            DecodeWithReference(stream, length, packetTypes[t], SERIALPNP_RX_BUFFER_SIZE, &g_expectedFrames);
+            ASSERT_ARE_EQUAL(size_t, 0, g_expectedFrames.Overflows);
+
+            for (size_t c = 0; c < sizeof(chunkings) / sizeof(chunkings[0]); c++)
+            {
+                DecodeInChunks(stream, length, packetTypes[t], SERIALPNP_RX_BUFFER_SIZE, chunkings[c], 4, &g_actualFrames);
+                AssertSameFrames(&g_expectedFrames, &g_actualFrames);
+            }
+        }
+    }
+}
+
+TEST_FUNCTION(SerialPnp_RxDecoder_skips_frames_of_other_types)
+{
+    static uint8_t stream[2 * SERIALPNP_RX_BUFFER_SIZE];
+    const size_t oneChunk[] = { TEST_READ_SIZE };
+    size_t length = 0;
+
+    length += EncodeFrame(stream + length, TEST_PACKET_TYPE_EVENT, 20, 1);
+    length += EncodeFrame(stream + length, TEST_PACKET_TYPE_COMMAND_RESPONSE, 12, 2);
+    length += EncodeFrame(stream + length, TEST_PACKET_TYPE_EVENT, 24, 3);
+
+    DecodeInChunks(stream, length, TEST_PACKET_TYPE_COMMAND_RESPONSE, SERIALPNP_RX_BUFFER_SIZE, oneChunk, 1, &g_actualFrames);
+
+    ASSERT_ARE_EQUAL(size_t, 1, g_actualFrames.Count);
+    ASSERT_ARE_EQUAL(size_t, 12, g_actualFrames.Lengths[0]);
+    ASSERT_ARE_EQUAL(int, TEST_PACKET_TYPE_COMMAND_RESPONSE, g_actualFrames.Frames[0][2]);
+}
+
+TEST_FUNCTION(SerialPnp_RxDecoder_reports_overflow_and_resynchronizes)
+{
+    static SERIALPNP_RX_DECODER decoder;
+    static uint8_t frame[64];
+    const uint8_t* packet;
+    size_t packetLength;
+    size_t chunkSize;
+    size_t sent = 0;
+    SERIALPNP_RX_DECODE_RESULT result = SERIALPNP_RX_DECODE_NEED_MORE;
+
+    SerialPnp_RxDecoder_Init(&decoder, g_rxBuffer, sizeof(g_rxBuffer));
+
+    // A frame header claiming more than fits in the buffer, followed by an endless payload
+    while (SERIALPNP_RX_DECODE_NEED_MORE == result)
+    {
+        uint8_t* chunk = SerialPnp_RxDecoder_GetChunk(&decoder, &chunkSize);
+        memset(chunk, 0x11, chunkSize);
+        if (sent == 0)
+        {
+            chunk[0] = SERIALPNP_START_OF_FRAME_BYTE;
+            chunk[1] = 0xFF;
+            chunk[2] = 0xFF;
+        }
+        SerialPnp_RxDecoder_SetChunkLength(&decoder, chunkSize);
+        sent += chunkSize;
+        ASSERT_IS_TRUE(sent <= 2 * SERIALPNP_RX_BUFFER_SIZE);
+
+        result = SerialPnp_RxDecoder_Decode(&decoder, 0x00, &packet, &packetLength);
+    }
+    ASSERT_ARE_EQUAL(int, SERIALPNP_RX_DECODE_OVERFLOW, result);
+
+    // The next well formed frame is still delivered
+    size_t frameLength = EncodeFrame(frame, TEST_PACKET_TYPE_EVENT, 8, 5);
+    while (SERIALPNP_RX_DECODE_NEED_MORE != SerialPnp_RxDecoder_Decode(&decoder, 0x00, &packet, &packetLength))
+    {
+    }
+    memcpy(SerialPnp_RxDecoder_GetChunk(&decoder, &chunkSize), frame, frameLength);
+    SerialPnp_RxDecoder_SetChunkLength(&decoder, frameLength);
+
+    ASSERT_ARE_EQUAL(int, SERIALPNP_RX_DECODE_PACKET, SerialPnp_RxDecoder_Decode(&decoder, 0x00, &packet, &packetLength));
+    ASSERT_ARE_EQUAL(size_t, 8, packetLength);
+}
+
+TEST_FUNCTION(SerialPnp_RxDecoder_fuzz_matches_byte_at_a_time_decoder)
+{
+    static uint8_t stream[64 * 2 * SERIALPNP_RX_BUFFER_SIZE / 8];
+    const size_t capacities[] = { SERIALPNP_MIN_PACKET_LENGTH + 1, 64, 301, SERIALPNP_RX_BUFFER_SIZE };
+    const uint8_t packetTypes[] = { 0x00, TEST_PACKET_TYPE_EVENT, TEST_PACKET_TYPE_COMMAND_RESPONSE };
+    size_t chunkSizes[16];
+
+    for (unsigned int seed = 1; seed <= 256; seed++)
+    {
+        unsigned int random = seed;
+        size_t length;
+
+        // Well formed frames with noise in between, or bytes that are mostly not frames at all
+        if (seed % 4 == 0)
+        {
+            length = 1 + NextRandom(&random) % sizeof(stream);
+            FillRandom(stream, length, 1 + NextRandom(&random) % 64, seed);
+        }
+        else
+        {
+            length = BuildMixedStream(stream, seed);
+        }
+
+        for (size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++)
+        {
+            chunkSizes[c] = 1 + NextRandom(&random) % ((c % 2 == 0) ? 8 : 2 * TEST_READ_SIZE);
+        }
+
+        size_t capacity = capacities[NextRandom(&random) % (sizeof(capacities) / sizeof(capacities[0]))];
+        uint8_t packetType = packetTypes[NextRandom(&random) % sizeof(packetTypes)];
+
+        DecodeWithReference(stream, length, packetType, capacity, &g_expectedFrames);
+        DecodeInChunks(stream, length, packetType, capacity, chunkSizes, sizeof(chunkSizes) / sizeof(chunkSizes[0]), &g_actualFrames);
+        AssertSameFrames(&g_expectedFrames, &g_actualFrames);
+    }
+}
+
+TEST_FUNCTION(SerialPnp_TxEncoder_escape_matches_byte_at_a_time_escaping_for_any_out_size)
+{
+    static uint8_t data[2048];
+    static uint8_t expected[2 * sizeof(data)];
+    static uint8_t escaped[2 * sizeof(data)];
+    const size_t outSizes[] = { SERIALPNP_ESCAPE_SEQUENCE_LENGTH, 3, 7, 16, 256, sizeof(escaped) };
+
+    for (unsigned int seed = 1; seed <= 64; seed++)
+    {
+        size_t length = (seed * 37) % sizeof(data);
+        FillRandom(data, length, 1 + seed % 16, seed);
+        size_t expectedLength = ReferenceEscape(expected, data, length);
+
+        for (size_t o = 0; o < sizeof(outSizes) / sizeof(outSizes[0]); o++)
+        {
+            size_t consumed = 0;
+            size_t escapedLength = 0;
+
+            while (consumed < length)
+            {
+                size_t previous = consumed;
+                size_t written = SerialPnp_TxEncoder_Escape(data, length, &consumed, escaped + escapedLength, outSizes[o]);
+
+                // Every call makes progress, and never ends on the first half of an escape sequence
+                ASSERT_IS_TRUE(consumed > previous);
+                ASSERT_IS_TRUE(written <= outSizes[o]);
+                ASSERT_ARE_NOT_EQUAL(int, SERIALPNP_ESCAPE_BYTE, escaped[escapedLength + written - 1]);
+                escapedLength += written;
+            }
+
+            ASSERT_ARE_EQUAL(size_t, expectedLength, escapedLength);
+            ASSERT_ARE_EQUAL(int, 0, memcmp(expected, escaped, expectedLength));
+        }
+    }
+}
+
+TEST_FUNCTION(SerialPnp_TxEncoder_runs_and_escape_sequences_round_trip_through_decoder)
+{
+    static SERIALPNP_RX_DECODER decoder;
+    // Small enough that the escaped frame fits in the receive buffer in one chunk
+    static uint8_t frame[(SERIALPNP_RX_BUFFER_SIZE - 1) / 2];
+    static uint8_t stream[1 + 2 * sizeof(frame)];
+    const uint8_t* packet;
+    size_t packetLength;
+    size_t chunkSize;
+
+    for (unsigned int seed = 1; seed <= 64; seed++)
+    {
+        size_t length = SERIALPNP_MIN_PACKET_LENGTH + (seed * 53) % (sizeof(frame) - SERIALPNP_MIN_PACKET_LENGTH);
+        size_t streamLength = 0;
+        size_t offset = 0;
+
+        FillRandom(frame, length, 1 + seed % 8, seed);
+        frame[0] = (uint8_t)(length & 0xFF);
+        frame[1] = (uint8_t)(length >> 8);
+        frame[2] = TEST_PACKET_TYPE_EVENT;
+
+        // Gather the frame the way the bridge hands it to writev
+        stream[streamLength++] = SERIALPNP_START_OF_FRAME_BYTE;
+        while (offset < length)
+        {
+            size_t run = SerialPnp_TxEncoder_GetRun(frame + offset, length - offset);
+            if (0 == run)
+            {
+                memcpy(stream + streamLength, SerialPnp_TxEncoder_GetEscapeSequence(frame[offset]), SERIALPNP_ESCAPE_SEQUENCE_LENGTH);
+                streamLength += SERIALPNP_ESCAPE_SEQUENCE_LENGTH;
+                offset++;
+            }
+            else
+            {
+                memcpy(stream + streamLength, frame + offset, run);
+                streamLength += run;
+                offset += run;
+            }
+        }
+
+        SerialPnp_RxDecoder_Init(&decoder, g_rxBuffer, sizeof(g_rxBuffer));
+        ASSERT_ARE_EQUAL(int, SERIALPNP_RX_DECODE_NEED_MORE, SerialPnp_RxDecoder_Decode(&decoder, 0x00, &packet, &packetLength));
+        uint8_t* chunk = SerialPnp_RxDecoder_GetChunk(&decoder, &chunkSize);
+        ASSERT_IS_TRUE(chunkSize >= streamLength);
+        memcpy(chunk, stream, streamLength);
+        SerialPnp_RxDecoder_SetChunkLength(&decoder, streamLength);
+
+        ASSERT_ARE_EQUAL(int, SERIALPNP_RX_DECODE_PACKET, SerialPnp_RxDecoder_Decode(&decoder, 0x00, &packet, &packetLength));
+        ASSERT_ARE_EQUAL(size_t, length, packetLength);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(frame, packet, length));
+    }
+}
+
+// In-memory throughput of the codec alone: frames escaped through a small buffer the way the device library
+// sends them, then decoded from reads of TEST_READ_SIZE bytes. Reported rather than asserted.
+TEST_FUNCTION(SerialPnp_codec_throughput_benchmark)
+{
+    const size_t frameLengths[] = { BENCHMARK_FRAME_LENGTH, 1024 };
+    static uint8_t frame[1024];
+    static SERIALPNP_RX_DECODER decoder;
+
+    for (size_t f = 0; f < sizeof(frameLengths) / sizeof(frameLengths[0]); f++)
+    {
+        size_t length = frameLengths[f];
+        size_t frameCount = BENCHMARK_CODEC_BYTES / length;
+        uint8_t* stream = (uint8_t*)malloc(frameCount * (1 + 2 * length));
+        size_t streamLength = 0;
+        size_t offset = 0;
+        size_t decoded = 0;
+
+        ASSERT_IS_NOT_NULL(stream);
+        FillRandom(frame, length, 64, (unsigned int)length);
+        frame[0] = (uint8_t)(length & 0xFF);
+        frame[1] = (uint8_t)(length >> 8);
+        frame[2] = TEST_PACKET_TYPE_EVENT;
+
+        double start = GetSeconds();
+        for (size_t i = 0; i < frameCount; i++)
+        {
+            uint8_t escaped[16];
+            size_t consumed = 0;
+
+            stream[streamLength++] = SERIALPNP_START_OF_FRAME_BYTE;
+            while (consumed < length)
+            {
+                size_t written = SerialPnp_TxEncoder_Escape(frame, length, &consumed, escaped, sizeof(escaped));
+                memcpy(stream + streamLength, escaped, written);
+                streamLength += written;
+            }
+        }
+        double encodeSeconds = GetSeconds() - start;
+
+        start = GetSeconds();
+        SerialPnp_RxDecoder_Init(&decoder, g_rxBuffer, sizeof(g_rxBuffer));
+        for (;;)
+        {
+            const uint8_t* packet;
+            size_t packetLength;
+            SERIALPNP_RX_DECODE_RESULT result = SerialPnp_RxDecoder_Decode(&decoder, 0x00, &packet, &packetLength);
+            ASSERT_ARE_NOT_EQUAL(int, SERIALPNP_RX_DECODE_OVERFLOW, result);
+            if (SERIALPNP_RX_DECODE_PACKET == result)
+            {
+                decoded++;
+                continue;
+            }
+            if (offset == streamLength)
+            {
+                break;
+            }
+
+            size_t chunkSize;
+            uint8_t* chunk = SerialPnp_RxDecoder_GetChunk(&decoder, &chunkSize);
+            size_t count = (TEST_READ_SIZE < chunkSize) ? TEST_READ_SIZE : chunkSize;
+            if (count > streamLength - offset)
+            {
+                count = streamLength - offset;
+            }
+            memcpy(chunk, stream + offset, count);
+            offset += count;
+            SerialPnp_RxDecoder_SetChunkLength(&decoder, count);
+        }
+        double decodeSeconds = GetSeconds() - start;
+
+        ASSERT_ARE_EQUAL(size_t, frameCount, decoded);
+        (void)printf("SerialPnp codec: frame length %4lu, encode %8.1f MB/s, decode %8.1f MB/s\r\n",
+            (unsigned long)length,
+            (double)(frameCount * length) / encodeSeconds / 1e6,
+            (double)(frameCount * length) / decodeSeconds / 1e6);
+
+        free(stream);
+    }
+}
+
+#ifndef WIN32
+// Throughput benchmark over a pseudo terminal: reading one byte per read() (the old receive loop) versus
+// reading whatever is available into the decoder's chunk buffer. Frames/sec and read() calls per frame are
+// reported rather than asserted, except that chunked reads must not need more syscalls than byte reads.
+TEST_FUNCTION(SerialPnp_RxDecoder_pty_throughput_benchmark)
+{
+    size_t streamCapacity = (size_t)BENCHMARK_FRAME_COUNT * (1 + 2 * BENCHMARK_FRAME_LENGTH);
+    uint8_t* stream = (uint8_t*)malloc(streamCapacity);
+    size_t streamLength = 0;
+    const size_t readSizes[] = { 1, TEST_READ_SIZE };
+    BENCHMARK_RESULT results[2];
+
+    ASSERT_IS_NOT_NULL(stream);
+    for (unsigned int i = 0; i < BENCHMARK_FRAME_COUNT; i++)
+    {
+        streamLength += EncodeFrame(stream + streamLength, TEST_PACKET_TYPE_EVENT, BENCHMARK_FRAME_LENGTH, i);
+    }
+
+    for (size_t r = 0; r < sizeof(readSizes) / sizeof(readSizes[0]); r++)
+    {
+        results[r] = RunPtyBenchmark(stream, streamLength, readSizes[r]);
+        ASSERT_ARE_EQUAL(size_t, BENCHMARK_FRAME_COUNT, results[r].Frames);
+        (void)printf("SerialPnp_RxDecoder: read size %4lu, %10.0f frames/sec, %8.3f syscalls/frame\r\n",
+            (unsigned long)readSizes[r],
+            (double)results[r].Frames / results[r].Seconds,
+            (double)results[r].Reads / (double)results[r].Frames);
+    }
+
+    ASSERT_IS_TRUE(results[1].Reads <= results[0].Reads);
+
+    free(stream);
+}
+#endif
+
+END_TEST_SUITE(serial_pnp_framing_ut)
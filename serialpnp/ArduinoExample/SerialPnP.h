@@ -11,9 +11,45 @@
 extern "C" {
 #endif
 
-// This may be adjusted to support longer schemas in the future.
+//
+// CONFIGURATION
+// Each of these may be overridden by defining it when compiling the library,
+// for instance with -DSERIALPNP_RXBUFFER_SIZE=128.
+//
+
+// This may be adjusted to support longer schemas in the future. Received packets
+// of up to SERIALPNP_RXBUFFER_SIZE - 1 bytes are decoded in place in this buffer.
+#ifndef SERIALPNP_RXBUFFER_SIZE
 #define SERIALPNP_RXBUFFER_SIZE         64
+#endif
+// Outgoing packets are escaped a piece of this many bytes at a time.
+#ifndef SERIALPNP_TXBUFFER_SIZE
+#define SERIALPNP_TXBUFFER_SIZE         16
+#endif
+// Properties and commands that can be defined with SerialPnP_NewProperty and
+// SerialPnP_NewCommand. Devices declared with SERIALPNP_DEVICE have no limit.
+#ifndef SERIALPNP_MAX_CALLBACK_COUNT
 #define SERIALPNP_MAX_CALLBACK_COUNT    8
+#endif
+// Bytes of event entries a batch holds before it is sent. Each entry takes the
+// size of its value plus 2.
+#ifndef SERIALPNP_EVENTBATCH_SIZE
+#define SERIALPNP_EVENTBATCH_SIZE       32
+#endif
+// Slots of the name lookup built for a device declared with SERIALPNP_DEVICE.
+// Must be a power of two, larger than the number of features of the device.
+#ifndef SERIALPNP_DISPATCH_SIZE
+#define SERIALPNP_DISPATCH_SIZE         32
+#endif
+// Define SERIALPNP_RING_BUFFERS to have the library buffer the serial port
+// itself, in ring buffers the platform fills and drains from its UART
+// interrupts (see below). Sizes must be powers of two, 128 at most.
+#ifndef SERIALPNP_RX_RING_SIZE
+#define SERIALPNP_RX_RING_SIZE          128
+#endif
+#ifndef SERIALPNP_TX_RING_SIZE
+#define SERIALPNP_TX_RING_SIZE          64
+#endif
 
 //
 // PLATFORM-SPECIFIC FUNCTIONS
@@ -45,6 +81,34 @@ SerialPnP_PlatformSerialWrite(
     char            Character
 );
 
+#ifdef SERIALPNP_RING_BUFFERS
+// With SERIALPNP_RING_BUFFERS the library implements the three functions above
+// itself. The platform instead passes every received byte to
+// SerialPnP_SerialRxIsr from its receive interrupt, and sends the bytes
+// SerialPnP_SerialTxIsr hands out from its transmit interrupt.
+
+// This function should enable the transmit interrupt, which then calls
+// SerialPnP_SerialTxIsr until it returns false. It is called whenever bytes
+// are queued, whether or not the interrupt is already enabled.
+void
+SerialPnP_PlatformSerialStartTx();
+
+// Queues a received byte. Returns false, dropping the byte, if the receive
+// ring is full. Safe to call from an interrupt.
+bool
+SerialPnP_SerialRxIsr(
+    uint8_t         Byte
+);
+
+// Takes the next byte to transmit. Returns false once there is none left, at
+// which point the transmit interrupt should be disabled. Safe to call from an
+// interrupt.
+bool
+SerialPnP_SerialTxIsr(
+    uint8_t*        Byte
+);
+#endif
+
 // This function should reset the state of the device.
 void
 SerialPnP_PlatformReset();
@@ -65,12 +129,74 @@ typedef enum _SerialPnPSchema {
     SerialPnPSchema_String,
 } SerialPnPSchema;
 
+// Feature types of a device declared with SERIALPNP_DEVICE, the descriptor
+// entry types they are sent as
+#define SERIALPNP_FEATURE_COMMAND       1
+#define SERIALPNP_FEATURE_PROPERTY      2
+#define SERIALPNP_FEATURE_EVENT         3
+
+#define SERIALPNP_PROPERTY_WRITEABLE    (1 << 0)
+#define SERIALPNP_PROPERTY_REQUIRED     (1 << 1)
+
+// An event, property or command of a device declared with SERIALPNP_DEVICE.
+// Declare these with the SERIALPNP_EVENT, SERIALPNP_PROPERTY and
+// SERIALPNP_COMMAND macros rather than directly.
+typedef struct _SerialPnPFeature {
+    uint8_t         Type;
+    uint8_t         Schema;         // schema of the value, or of the input of a command
+    uint8_t         OutputSchema;   // schema of the output of a command
+    uint8_t         Flags;          // SERIALPNP_PROPERTY_ flags of a property
+    const char*     Name;
+    const char*     DisplayName;
+    const char*     Description;
+    const char*     Units;
+    SerialPnPCb     Callback;
+} SerialPnPFeature;
+
+typedef struct _SerialPnPDevice {
+    const char*             Name;
+    const char*             InterfaceId;
+    const SerialPnPFeature* Features;
+    uint8_t                 FeatureCount;
+} SerialPnPDevice;
+
+#define SERIALPNP_EVENT(Name, DisplayName, Description, Schema, Units) \
+    { SERIALPNP_FEATURE_EVENT, (Schema), SerialPnPSchema_None, 0, \
+      (Name), (DisplayName), (Description), (Units), 0 }
+
+#define SERIALPNP_PROPERTY(Name, DisplayName, Description, Units, Schema, Required, Writeable, Callback) \
+    { SERIALPNP_FEATURE_PROPERTY, (Schema), SerialPnPSchema_None, \
+      ((Required) ? SERIALPNP_PROPERTY_REQUIRED : 0) | ((Writeable) ? SERIALPNP_PROPERTY_WRITEABLE : 0), \
+      (Name), (DisplayName), (Description), (Units), (SerialPnPCb) (Callback) }
+
+#define SERIALPNP_COMMAND(Name, DisplayName, Description, InputSchema, OutputSchema, Callback) \
+    { SERIALPNP_FEATURE_COMMAND, (InputSchema), (OutputSchema), 0, \
+      (Name), (DisplayName), (Description), "", (SerialPnPCb) (Callback) }
+
+// Declares a device with a single interface made up of the features in the
+// array Features, for SerialPnP_SetupDevice. Both stay in read-only memory
+// (flash, on most microcontrollers), and fail to compile if the device has
+// more features than fit in SERIALPNP_DISPATCH_SIZE.
+#define SERIALPNP_DEVICE(Variable, DeviceName, InterfaceIdUri, Features) \
+    typedef char Variable##_FitsDispatch[ \
+        (sizeof(Features) / sizeof((Features)[0]) < SERIALPNP_DISPATCH_SIZE) ? 1 : -1]; \
+    const SerialPnPDevice Variable = { \
+        (DeviceName), (InterfaceIdUri), (Features), sizeof(Features) / sizeof((Features)[0]) }
+
 // This function is called once to configure Serial PnP on the platform.
 void
 SerialPnP_Setup(
     const char*     DeviceName
 );
 
+// This function is called once instead of SerialPnP_Setup, SerialPnP_NewInterface
+// and the SerialPnP_New functions, to configure Serial PnP for a device declared
+// with SERIALPNP_DEVICE. The device is used in place and must not change.
+void
+SerialPnP_SetupDevice(
+    const SerialPnPDevice* Device
+);
+
 // This call must be made once to complete Serial PnP Setup, after all interaces have been defined.
 // It will notify the host that device initialization is complete.
 void
@@ -130,6 +256,44 @@ SerialPnP_SendEventInt(
     int32_t         Value
 );
 
+// Batches events to send several of them in one packet, which the gateway
+// reports as one telemetry message. Events are added to the batch after
+// SerialPnP_BeginEventBatch and sent with SerialPnP_SendEventBatch. A batch
+// that fills up is sent as it is and a new one started. Batched events are
+// sent by index, so only the events of the first interface can be batched.
+void
+SerialPnP_BeginEventBatch();
+
+void
+SerialPnP_AddEventFloat(
+    const char*     Name,
+    float           Value
+);
+
+void
+SerialPnP_AddEventInt(
+    const char*     Name,
+    int32_t         Value
+);
+
+void
+SerialPnP_SendEventBatch();
+
+// Pushes the current value of a property to the gateway, which reports it to
+// the cloud if it changed, so that changes the device makes on its own are
+// seen without polling the device with commands.
+void
+SerialPnP_SendPropertyFloat(
+    const char*     Name,
+    float           Value
+);
+
+void
+SerialPnP_SendPropertyInt(
+    const char*     Name,
+    int32_t         Value
+);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -5,12 +5,12 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 //
 #include "SerialPnP.h"
+#include "serial_pnp_framing.h"
 #include <string.h>
 #include <stdlib.h>
 
 #define SERIALPNP_PROTOCOL_VERSION          0x01
-#define SERIALPNP_PROTOCOL_PACKETSTART      0x5A
-#define SERIALPNP_PROTOCOL_ESCAPE           0xEF
+#define SERIALPNP_PROTOCOL_PACKETSTART      SERIALPNP_START_OF_FRAME_BYTE
 
 #define SERIALPNP_PACKETTYPE_NONE           0
 #define SERIALPNP_PACKETTYPE_RESETREQ       1
@@ -22,6 +22,9 @@
 #define SERIALPNP_PACKETTYPE_PROPREQ        7
 #define SERIALPNP_PACKETTYPE_PROPRESP       8
 #define SERIALPNP_PACKETTYPE_EVENT          10
+#define SERIALPNP_PACKETTYPE_DESCHASHREQ    11
+#define SERIALPNP_PACKETTYPE_DESCHASHRESP   12
+#define SERIALPNP_PACKETTYPE_EVENTBATCH     13
 
 #define SERIALPNP_DESCRIPTORTYPE_INTERFACE  5
 #define SERIALPNP_DESCRIPTORTYPE_COMMAND    1
@@ -56,25 +59,91 @@ typedef struct _SerialPnPCallback {
     void*                       Callback;
 } SerialPnPCallback;
 
+// Slot of the name lookup of a device declared with SERIALPNP_DEVICE
+typedef struct _SerialPnPDispatchSlot {
+    uint8_t                     Feature;    // index of the feature + 1, 0 if the slot is free
+    uint8_t                     Ordinal;    // position of the feature among the features of its type
+} SerialPnPDispatchSlot;
+
+// Input of a callback. Callbacks read it as the type of its schema, so it is
+// copied out of the packet, where it may not be aligned for that type.
+typedef union _SerialPnPInput {
+    int64_t                     AlignInteger;
+    double                      AlignFloat;
+    char                        Bytes[SERIALPNP_RXBUFFER_SIZE];
+} SerialPnPInput;
+
+// Where SerialPnP_EmitDescriptor sends the descriptor to
+typedef struct _SerialPnPDescriptorSink {
+    bool                        Send;       // write the descriptor to the serial port
+    uint16_t                    Length;
+    uint32_t                    Hash;       // FNV-1a
+} SerialPnPDescriptorSink;
+
+#ifdef SERIALPNP_RING_BUFFERS
+// Single producer, single consumer ring. Head is only advanced by the producer
+// and Tail by the consumer, and both are a byte wide so that they are read and
+// written atomically on any microcontroller. They run freely, so their
+// difference is the number of bytes in the ring.
+typedef struct _SerialPnPRing {
+    volatile uint8_t            Head;
+    volatile uint8_t            Tail;
+    uint8_t                     Mask;
+    volatile uint8_t*           Data;
+} SerialPnPRing;
+
+typedef char SerialPnPRxRingSizeCheck[((SERIALPNP_RX_RING_SIZE & (SERIALPNP_RX_RING_SIZE - 1)) == 0 &&
+                                       SERIALPNP_RX_RING_SIZE <= 128) ? 1 : -1];
+typedef char SerialPnPTxRingSizeCheck[((SERIALPNP_TX_RING_SIZE & (SERIALPNP_TX_RING_SIZE - 1)) == 0 &&
+                                       SERIALPNP_TX_RING_SIZE <= 128) ? 1 : -1];
+#endif
+
+typedef char SerialPnPDispatchSizeCheck[((SERIALPNP_DISPATCH_SIZE & (SERIALPNP_DISPATCH_SIZE - 1)) == 0 &&
+                                         SERIALPNP_DISPATCH_SIZE <= 256) ? 1 : -1];
+
 //
 // Global Variables
 //
 SerialPnPDescriptorEntry*       g_SerialPnPDescriptor = 0;
-char                            g_SerialPnPRxBuffer[SERIALPNP_RXBUFFER_SIZE];
-bool                            g_SerialPnPRxEscaped = false;
-uint8_t                         g_SerialPnPRxBufferIndex = 0;
+uint8_t                         g_SerialPnPRxBuffer[SERIALPNP_RXBUFFER_SIZE];
+SERIALPNP_RX_DECODER            g_SerialPnPRxDecoder;
 SerialPnPCallback               g_SerialPnPCallbacks[SERIALPNP_MAX_CALLBACK_COUNT];
+// Device declared with SERIALPNP_DEVICE, 0 if the descriptor is built at runtime
+const SerialPnPDevice*          g_SerialPnPDevice = 0;
+SerialPnPDispatchSlot           g_SerialPnPDispatch[SERIALPNP_DISPATCH_SIZE];
+#ifdef SERIALPNP_RING_BUFFERS
+volatile uint8_t                g_SerialPnPRxRingData[SERIALPNP_RX_RING_SIZE];
+volatile uint8_t                g_SerialPnPTxRingData[SERIALPNP_TX_RING_SIZE];
+SerialPnPRing                   g_SerialPnPRxRing = { 0, 0, SERIALPNP_RX_RING_SIZE - 1, g_SerialPnPRxRingData };
+SerialPnPRing                   g_SerialPnPTxRing = { 0, 0, SERIALPNP_TX_RING_SIZE - 1, g_SerialPnPTxRingData };
+#endif
+// Entries of the event batch being built: event index, value size, value
+uint8_t                         g_SerialPnPEventBatch[SERIALPNP_EVENTBATCH_SIZE];
+uint8_t                         g_SerialPnPEventBatchLength = 0;
 
 //
 // Internal Function Definitions
 //
 void
-SerialPnP_SendEventRaw(
+SerialPnP_SendNotificationRaw(
+    uint8_t                     PacketType,
     const char*                 Name,
     void*                       Value,
     uint8_t                     ValueSize
 );
 
+void
+SerialPnP_AddEventRaw(
+    const char*                 Name,
+    void*                       Value,
+    uint8_t                     ValueSize
+);
+
+int
+SerialPnP_FindEventIndex(
+    const char*                 Name
+);
+
 void
 SerialPnP_SerialWriteBuffer(
     char*                       Buffer,
@@ -97,13 +166,63 @@ SerialPnP_AddCallback(
     void*                       Callback
 );
 
-SerialPnPCallback*
+SerialPnPCb
 SerialPnP_FindCallback(
     uint8_t                     Type,
     const char*                 Name,
     uint8_t                     NameSize
 );
 
+uint8_t
+SerialPnP_HashName(
+    uint8_t                     Type,
+    const char*                 Name,
+    uint8_t                     NameSize
+);
+
+const SerialPnPFeature*
+SerialPnP_FindFeature(
+    uint8_t                     Type,
+    const char*                 Name,
+    uint8_t                     NameSize,
+    uint8_t*                    Ordinal
+);
+
+void
+SerialPnP_EmitDescriptor(
+    SerialPnPDescriptorSink*    Sink
+);
+
+void
+SerialPnP_EmitDescriptorBytes(
+    SerialPnPDescriptorSink*    Sink,
+    const char*                 Data,
+    uint16_t                    Size
+);
+
+void
+SerialPnP_EmitDescriptorString(
+    SerialPnPDescriptorSink*    Sink,
+    const char*                 String
+);
+
+void
+SerialPnP_Init();
+
+#ifdef SERIALPNP_RING_BUFFERS
+bool
+SerialPnP_RingPush(
+    SerialPnPRing*              Ring,
+    uint8_t                     Byte
+);
+
+bool
+SerialPnP_RingPop(
+    SerialPnPRing*              Ring,
+    uint8_t*                    Byte
+);
+#endif
+
 void
 SerialPnP_ProcessPacket(
     SerialPnPPacketHeader       *Packet
@@ -120,9 +239,7 @@ SerialPnP_Setup(
     char* rawDescriptorEntry;
     uint8_t deviceNameLength = strlen(DeviceName);
 
-    // Reset state
-    g_SerialPnPRxBufferIndex = 0;
-    g_SerialPnPRxEscaped = false;
+    g_SerialPnPDevice = 0;
 
     // First record holds version, name length, and name.
     g_SerialPnPDescriptor = malloc(sizeof(SerialPnPDescriptorEntry) +
@@ -138,10 +255,36 @@ SerialPnP_Setup(
            DeviceName,
            deviceNameLength);
 
-    memset(g_SerialPnPCallbacks, 0, sizeof(g_SerialPnPCallbacks));
+    SerialPnP_Init();
+}
 
-    // Call platform-specific initialization function for serial port.
-    SerialPnP_PlatformSerialInit();
+void
+SerialPnP_SetupDevice(
+    const SerialPnPDevice* Device
+)
+{
+    uint8_t ordinals[SERIALPNP_FEATURE_EVENT + 1] = {0};
+
+    g_SerialPnPDevice = Device;
+    g_SerialPnPDescriptor = 0;
+
+    // Index the features by name, so that requests find their callback
+    // without comparing the name of every feature
+    memset(g_SerialPnPDispatch, 0, sizeof(g_SerialPnPDispatch));
+
+    for (uint8_t f = 0; f < Device->FeatureCount; f++) {
+        const SerialPnPFeature* feature = &Device->Features[f];
+        uint8_t slot = SerialPnP_HashName(feature->Type, feature->Name, strlen(feature->Name));
+
+        while (g_SerialPnPDispatch[slot].Feature != 0) {
+            slot = (slot + 1) & (SERIALPNP_DISPATCH_SIZE - 1);
+        }
+
+        g_SerialPnPDispatch[slot].Feature = f + 1;
+        g_SerialPnPDispatch[slot].Ordinal = ordinals[feature->Type]++;
+    }
+
+    SerialPnP_Init();
 }
 
 void
@@ -359,40 +502,38 @@ SerialPnP_NewCommand(
 void
 SerialPnP_Process()
 {
-    while (SerialPnP_PlatformSerialAvailable()) {
-        char inb = SerialPnP_PlatformSerialRead();
-
-        if (inb == SERIALPNP_PROTOCOL_PACKETSTART) {
-            g_SerialPnPRxBufferIndex = 0;
-            g_SerialPnPRxEscaped = false;
+    SERIALPNP_RX_DECODE_RESULT result;
+    const uint8_t* packet;
+    size_t packetLength;
+    uint8_t* chunk;
+    size_t chunkSize;
+    size_t chunkLength;
+
+    for (;;) {
+        // Frames are decoded in place in g_SerialPnPRxBuffer, and one that does not fit is dropped
+        result = SerialPnp_RxDecoder_Decode(&g_SerialPnPRxDecoder, SERIALPNP_PACKETTYPE_NONE, &packet, &packetLength);
+
+        if (result == SERIALPNP_RX_DECODE_PACKET) {
+            SerialPnP_ProcessPacket((SerialPnPPacketHeader*) packet);
             continue;
         }
 
-        if (inb == SERIALPNP_PROTOCOL_ESCAPE) {
-            g_SerialPnPRxEscaped = true;
+        if (result == SERIALPNP_RX_DECODE_OVERFLOW) {
             continue;
         }
 
-        if (g_SerialPnPRxEscaped) {
-            inb++;
-            g_SerialPnPRxEscaped = false;
-        }
-
-        if (g_SerialPnPRxBufferIndex >= SERIALPNP_RXBUFFER_SIZE) {
-            g_SerialPnPRxBufferIndex = SERIALPNP_RXBUFFER_SIZE - 1;
+        if (!SerialPnP_PlatformSerialAvailable()) {
+            break;
         }
 
-        g_SerialPnPRxBuffer[g_SerialPnPRxBufferIndex++] = inb;
+        chunk = SerialPnp_RxDecoder_GetChunk(&g_SerialPnPRxDecoder, &chunkSize);
+        chunkLength = 0;
 
-        if (g_SerialPnPRxBufferIndex >= sizeof(SerialPnPPacketHeader)) {
-            SerialPnPPacketHeader *p = (SerialPnPPacketHeader*) g_SerialPnPRxBuffer;
-
-            if (p->Length == g_SerialPnPRxBufferIndex) {
-                // we can parse the packet now
-                SerialPnP_ProcessPacket(p);
-                g_SerialPnPRxBufferIndex = 0;
-            }
+        while ((chunkLength < chunkSize) && SerialPnP_PlatformSerialAvailable()) {
+            chunk[chunkLength++] = (uint8_t) SerialPnP_PlatformSerialRead();
         }
+
+        SerialPnp_RxDecoder_SetChunkLength(&g_SerialPnPRxDecoder, chunkLength);
     }
 }
 
@@ -402,7 +543,7 @@ SerialPnP_SendEventFloat(
     float           Value
 )
 {
-    SerialPnP_SendEventRaw(Name, (void*) &Value, sizeof(float));
+    SerialPnP_SendNotificationRaw(SERIALPNP_PACKETTYPE_EVENT, Name, (void*) &Value, sizeof(float));
 }
 
 void
@@ -411,14 +552,230 @@ SerialPnP_SendEventInt(
     int32_t         Value
 )
 {
-    SerialPnP_SendEventRaw(Name, (void*) &Value, sizeof(int32_t));
+    SerialPnP_SendNotificationRaw(SERIALPNP_PACKETTYPE_EVENT, Name, (void*) &Value, sizeof(int32_t));
+}
+
+void
+SerialPnP_SendPropertyFloat(
+    const char*     Name,
+    float           Value
+)
+{
+    SerialPnP_SendNotificationRaw(SERIALPNP_PACKETTYPE_PROPRESP, Name, (void*) &Value, sizeof(float));
+}
+
+void
+SerialPnP_SendPropertyInt(
+    const char*     Name,
+    int32_t         Value
+)
+{
+    SerialPnP_SendNotificationRaw(SERIALPNP_PACKETTYPE_PROPRESP, Name, (void*) &Value, sizeof(int32_t));
+}
+
+void
+SerialPnP_BeginEventBatch()
+{
+    g_SerialPnPEventBatchLength = 0;
+}
+
+void
+SerialPnP_AddEventFloat(
+    const char*     Name,
+    float           Value
+)
+{
+    SerialPnP_AddEventRaw(Name, (void*) &Value, sizeof(float));
+}
+
+void
+SerialPnP_AddEventInt(
+    const char*     Name,
+    int32_t         Value
+)
+{
+    SerialPnP_AddEventRaw(Name, (void*) &Value, sizeof(int32_t));
+}
+
+void
+SerialPnP_SendEventBatch()
+{
+    SerialPnPPacketHeader out = {0};
+
+    if (g_SerialPnPEventBatchLength == 0) {
+        return;
+    }
+
+    out.Length = sizeof(SerialPnPPacketHeader) +
+                 1 +
+                 g_SerialPnPEventBatchLength;
+
+    out.PacketType = SERIALPNP_PACKETTYPE_EVENTBATCH;
+
+    SerialPnP_PlatformSerialWrite(SERIALPNP_PROTOCOL_PACKETSTART); // need to send sync
+    SerialPnP_SerialWriteBuffer((char*) &out, sizeof(SerialPnPPacketHeader));
+    SerialPnP_SerialWriteChar(0); // interface id = 0
+    SerialPnP_SerialWriteBuffer((char*) g_SerialPnPEventBatch, g_SerialPnPEventBatchLength);
+
+    g_SerialPnPEventBatchLength = 0;
+}
+
+#ifdef SERIALPNP_RING_BUFFERS
+bool
+SerialPnP_SerialRxIsr(
+    uint8_t         Byte
+)
+{
+    return SerialPnP_RingPush(&g_SerialPnPRxRing, Byte);
 }
 
+bool
+SerialPnP_SerialTxIsr(
+    uint8_t*        Byte
+)
+{
+    return SerialPnP_RingPop(&g_SerialPnPTxRing, Byte);
+}
+
+unsigned int
+SerialPnP_PlatformSerialAvailable()
+{
+    return (uint8_t) (g_SerialPnPRxRing.Head - g_SerialPnPRxRing.Tail);
+}
+
+int
+SerialPnP_PlatformSerialRead()
+{
+    uint8_t b;
+
+    return SerialPnP_RingPop(&g_SerialPnPRxRing, &b) ? b : -1;
+}
+
+void
+SerialPnP_PlatformSerialWrite(
+    char            Character
+)
+{
+    // Wait for the transmit interrupt to make room
+    while (!SerialPnP_RingPush(&g_SerialPnPTxRing, (uint8_t) Character)) {
+        SerialPnP_PlatformSerialStartTx();
+    }
+
+    SerialPnP_PlatformSerialStartTx();
+}
+#endif
+
 //
 // Internal Function Implementations
 //
+#ifdef SERIALPNP_RING_BUFFERS
+bool
+SerialPnP_RingPush(
+    SerialPnPRing*              Ring,
+    uint8_t                     Byte
+)
+{
+    uint8_t head = Ring->Head;
+
+    if ((uint8_t) (head - Ring->Tail) > Ring->Mask) {
+        return false;
+    }
+
+    // The byte is stored before Head is advanced past it, both being volatile
+    Ring->Data[head & Ring->Mask] = Byte;
+    Ring->Head = head + 1;
+    return true;
+}
+
+bool
+SerialPnP_RingPop(
+    SerialPnPRing*              Ring,
+    uint8_t*                    Byte
+)
+{
+    uint8_t tail = Ring->Tail;
+
+    if (tail == Ring->Head) {
+        return false;
+    }
+
+    *Byte = Ring->Data[tail & Ring->Mask];
+    Ring->Tail = tail + 1;
+    return true;
+}
+#endif
+
+void
+SerialPnP_AddEventRaw(
+    const char*                 Name,
+    void*                       Value,
+    uint8_t                     ValueSize
+)
+{
+    int index = SerialPnP_FindEventIndex(Name);
+
+    if ((index < 0) || (ValueSize + 2 > SERIALPNP_EVENTBATCH_SIZE)) {
+        return;
+    }
+
+    // Send what has been batched so far if the event does not fit, or is already
+    // in the batch, as the gateway reports one value per event and message
+    if (g_SerialPnPEventBatchLength + ValueSize + 2 > SERIALPNP_EVENTBATCH_SIZE) {
+        SerialPnP_SendEventBatch();
+    }
+
+    for (uint8_t c = 0; c < g_SerialPnPEventBatchLength; c += 2 + g_SerialPnPEventBatch[c + 1]) {
+        if (g_SerialPnPEventBatch[c] == index) {
+            SerialPnP_SendEventBatch();
+            break;
+        }
+    }
+
+    g_SerialPnPEventBatch[g_SerialPnPEventBatchLength++] = (uint8_t) index;
+    g_SerialPnPEventBatch[g_SerialPnPEventBatchLength++] = ValueSize;
+    memcpy(&g_SerialPnPEventBatch[g_SerialPnPEventBatchLength], Value, ValueSize);
+    g_SerialPnPEventBatchLength += ValueSize;
+}
+
+int
+SerialPnP_FindEventIndex(
+    const char*                 Name
+)
+{
+    uint8_t nlen = strlen(Name);
+    int index = 0;
+    bool inInterface = false;
+
+    if (g_SerialPnPDevice) {
+        uint8_t ordinal;
+        return SerialPnP_FindFeature(SERIALPNP_FEATURE_EVENT, Name, nlen, &ordinal) ? ordinal : -1;
+    }
+
+    // The first record is the device name, the events are counted within the first interface
+    for (SerialPnPDescriptorEntry* entry = g_SerialPnPDescriptor ? g_SerialPnPDescriptor->Next : 0;
+         entry != 0;
+         entry = entry->Next) {
+
+        if (entry->Content[0] == SERIALPNP_DESCRIPTORTYPE_INTERFACE) {
+            if (inInterface) {
+                break;
+            }
+            inInterface = true;
+        } else if (entry->Content[0] == SERIALPNP_DESCRIPTORTYPE_EVENT) {
+            if ((entry->Content[1] == nlen) &&
+                (strncmp(&entry->Content[2], Name, nlen) == 0)) {
+                return index;
+            }
+            index++;
+        }
+    }
+
+    return -1;
+}
+
 void
-SerialPnP_SendEventRaw(
+SerialPnP_SendNotificationRaw(
+    uint8_t                     PacketType,
     const char*                 Name,
     void*                       Value,
     uint8_t                     ValueSize
@@ -433,7 +790,7 @@ SerialPnP_SendEventRaw(
                  nlen +
                  ValueSize;
 
-    out.PacketType = SERIALPNP_PACKETTYPE_EVENT;
+    out.PacketType = PacketType;
 
     SerialPnP_PlatformSerialWrite(SERIALPNP_PROTOCOL_PACKETSTART); // need to send sync
     SerialPnP_SerialWriteBuffer((char*) &out, sizeof(SerialPnPPacketHeader));
@@ -449,14 +806,20 @@ SerialPnP_SerialWriteBuffer(
     uint16_t                    BufferSize
 )
 {
-    uint16_t c;
-
-    for (c = 0; c < BufferSize; c++) {
-        if ((Buffer[c] == SERIALPNP_PROTOCOL_PACKETSTART) || (Buffer[c] == SERIALPNP_PROTOCOL_ESCAPE)) {
-            SerialPnP_PlatformSerialWrite(SERIALPNP_PROTOCOL_ESCAPE);
-            SerialPnP_PlatformSerialWrite(Buffer[c] - 1);
-        } else {
-            SerialPnP_PlatformSerialWrite(Buffer[c]);
+    uint8_t escaped[SERIALPNP_TXBUFFER_SIZE];
+    size_t consumed = 0;
+    size_t escapedLength;
+    size_t c;
+
+    while (consumed < BufferSize) {
+        escapedLength = SerialPnp_TxEncoder_Escape((const uint8_t*) Buffer,
+                                                   BufferSize,
+                                                   &consumed,
+                                                   escaped,
+                                                   sizeof(escaped));
+
+        for (c = 0; c < escapedLength; c++) {
+            SerialPnP_PlatformSerialWrite(escaped[c]);
         }
     }
 }
@@ -466,12 +829,7 @@ SerialPnP_SerialWriteChar(
     char                        Out
 )
 {
-    if ((Out == SERIALPNP_PROTOCOL_PACKETSTART) || (Out == SERIALPNP_PROTOCOL_ESCAPE)) {
-        SerialPnP_PlatformSerialWrite(SERIALPNP_PROTOCOL_ESCAPE);
-        SerialPnP_PlatformSerialWrite(Out - 1);
-    } else {
-        SerialPnP_PlatformSerialWrite(Out);
-    }
+    SerialPnP_SerialWriteBuffer(&Out, 1);
 }
 
 void
@@ -511,7 +869,7 @@ SerialPnP_AddCallback(
     }
 }
 
-SerialPnPCallback*
+SerialPnPCb
 SerialPnP_FindCallback(
     uint8_t                     Type,
     const char*                 Name,
@@ -521,6 +879,11 @@ SerialPnP_FindCallback(
     uint8_t c = 0;
     char* rawDescriptorEntry;
 
+    if (g_SerialPnPDevice) {
+        const SerialPnPFeature* feature = SerialPnP_FindFeature(Type, Name, NameSize, 0);
+        return feature ? feature->Callback : 0;
+    }
+
     while (c < SERIALPNP_MAX_CALLBACK_COUNT) {
         SerialPnPCallback* cc = &g_SerialPnPCallbacks[c];
 
@@ -536,7 +899,7 @@ SerialPnP_FindCallback(
         if ((*(rawDescriptorEntry) == Type) &&
             (*(rawDescriptorEntry+1) == NameSize)) {
             if (strncmp(rawDescriptorEntry+2, Name, NameSize) == 0) {
-                return cc;
+                return (SerialPnPCb) cc->Callback;
             }
         }
     }
@@ -544,6 +907,161 @@ SerialPnP_FindCallback(
     return 0;
 }
 
+uint8_t
+SerialPnP_HashName(
+    uint8_t                     Type,
+    const char*                 Name,
+    uint8_t                     NameSize
+)
+{
+    // FNV-1a over the type and the name
+    uint32_t hash = (2166136261u ^ Type) * 16777619u;
+
+    for (uint8_t c = 0; c < NameSize; c++) {
+        hash ^= (uint8_t) Name[c];
+        hash *= 16777619u;
+    }
+
+    return (uint8_t) ((hash ^ (hash >> 16)) & (SERIALPNP_DISPATCH_SIZE - 1));
+}
+
+const SerialPnPFeature*
+SerialPnP_FindFeature(
+    uint8_t                     Type,
+    const char*                 Name,
+    uint8_t                     NameSize,
+    uint8_t*                    Ordinal
+)
+{
+    uint8_t slot = SerialPnP_HashName(Type, Name, NameSize);
+
+    // The lookup always has a free slot, which ends the search for a name it does not hold
+    while (g_SerialPnPDispatch[slot].Feature != 0) {
+        const SerialPnPFeature* feature = &g_SerialPnPDevice->Features[g_SerialPnPDispatch[slot].Feature - 1];
+
+        if ((feature->Type == Type) &&
+            (strncmp(feature->Name, Name, NameSize) == 0) &&
+            (feature->Name[NameSize] == '\0')) {
+            if (Ordinal) {
+                *Ordinal = g_SerialPnPDispatch[slot].Ordinal;
+            }
+            return feature;
+        }
+
+        slot = (slot + 1) & (SERIALPNP_DISPATCH_SIZE - 1);
+    }
+
+    return 0;
+}
+
+void
+SerialPnP_EmitDescriptor(
+    SerialPnPDescriptorSink*    Sink
+)
+{
+    Sink->Length = 0;
+    Sink->Hash = 2166136261u;
+
+    if (!g_SerialPnPDevice) {
+        for (SerialPnPDescriptorEntry* entry = g_SerialPnPDescriptor;
+             entry != 0;
+             entry = entry->Next)
+        {
+            SerialPnP_EmitDescriptorBytes(Sink, entry->Content, entry->ContentSize);
+        }
+
+        return;
+    }
+
+    // The same records SerialPnP_Setup, SerialPnP_NewInterface and the
+    // SerialPnP_New functions build, straight from the device's tables
+    char header[3];
+    uint16_t interfaceIdUriLength = strlen(g_SerialPnPDevice->InterfaceId);
+
+    header[0] = SERIALPNP_PROTOCOL_VERSION;
+    SerialPnP_EmitDescriptorBytes(Sink, header, 1);
+    SerialPnP_EmitDescriptorString(Sink, g_SerialPnPDevice->Name);
+
+    header[0] = SERIALPNP_DESCRIPTORTYPE_INTERFACE;
+    header[1] = interfaceIdUriLength & 0xFF;
+    header[2] = interfaceIdUriLength >> 8;
+    SerialPnP_EmitDescriptorBytes(Sink, header, 3);
+    SerialPnP_EmitDescriptorBytes(Sink, g_SerialPnPDevice->InterfaceId, interfaceIdUriLength);
+
+    for (uint8_t f = 0; f < g_SerialPnPDevice->FeatureCount; f++) {
+        const SerialPnPFeature* feature = &g_SerialPnPDevice->Features[f];
+
+        header[0] = feature->Type;
+        SerialPnP_EmitDescriptorBytes(Sink, header, 1);
+        SerialPnP_EmitDescriptorString(Sink, feature->Name);
+        SerialPnP_EmitDescriptorString(Sink, feature->DisplayName);
+        SerialPnP_EmitDescriptorString(Sink, feature->Description);
+
+        if (feature->Type != SERIALPNP_FEATURE_COMMAND) {
+            SerialPnP_EmitDescriptorString(Sink, feature->Units);
+        }
+
+        // Schemas are 2 bytes wide
+        header[0] = feature->Schema;
+        header[1] = 0;
+        SerialPnP_EmitDescriptorBytes(Sink, header, 2);
+
+        if (feature->Type == SERIALPNP_FEATURE_PROPERTY) {
+            header[0] = feature->Flags;
+            SerialPnP_EmitDescriptorBytes(Sink, header, 1);
+        } else if (feature->Type == SERIALPNP_FEATURE_COMMAND) {
+            header[0] = feature->OutputSchema;
+            SerialPnP_EmitDescriptorBytes(Sink, header, 2);
+        }
+    }
+}
+
+void
+SerialPnP_EmitDescriptorBytes(
+    SerialPnPDescriptorSink*    Sink,
+    const char*                 Data,
+    uint16_t                    Size
+)
+{
+    Sink->Length += Size;
+
+    for (uint16_t c = 0; c < Size; c++) {
+        Sink->Hash ^= (uint8_t) Data[c];
+        Sink->Hash *= 16777619u;
+    }
+
+    if (Sink->Send) {
+        SerialPnP_SerialWriteBuffer((char*) Data, Size);
+    }
+}
+
+void
+SerialPnP_EmitDescriptorString(
+    SerialPnPDescriptorSink*    Sink,
+    const char*                 String
+)
+{
+    char length = (char) strlen(String);
+
+    SerialPnP_EmitDescriptorBytes(Sink, &length, 1);
+    SerialPnP_EmitDescriptorBytes(Sink, String, (uint8_t) length);
+}
+
+void
+SerialPnP_Init()
+{
+    // Reset state
+    SerialPnp_RxDecoder_Init(&g_SerialPnPRxDecoder,
+                             g_SerialPnPRxBuffer,
+                             sizeof(g_SerialPnPRxBuffer));
+
+    memset(g_SerialPnPCallbacks, 0, sizeof(g_SerialPnPCallbacks));
+    g_SerialPnPEventBatchLength = 0;
+
+    // Call platform-specific initialization function for serial port.
+    SerialPnP_PlatformSerialInit();
+}
+
 void
 SerialPnP_ProcessPacket(
     SerialPnPPacketHeader       *Packet
@@ -558,50 +1076,57 @@ SerialPnP_ProcessPacket(
     // Descriptor request
     } else if (Packet->PacketType == SERIALPNP_PACKETTYPE_DESCREQ) {
         // First we have to calculate length of the descriptor
-        uint16_t descriptorLength = 0;
+        SerialPnPDescriptorSink sink = {0};
+        SerialPnP_EmitDescriptor(&sink);
 
-        for (SerialPnPDescriptorEntry* entry = g_SerialPnPDescriptor;
-             entry != 0;
-             entry = entry->Next)
-        {
-            descriptorLength += entry->ContentSize;
-        }
-
-        out.Length = sizeof(SerialPnPPacketHeader) + descriptorLength;
+        out.Length = sizeof(SerialPnPPacketHeader) + sink.Length;
         out.PacketType = SERIALPNP_PACKETTYPE_DESCRESP;
 
         SerialPnP_PlatformSerialWrite(SERIALPNP_PROTOCOL_PACKETSTART); // need to send sync
         SerialPnP_SerialWriteBuffer((char*) &out, sizeof(SerialPnPPacketHeader));
 
         // Send actual descriptor, piece by piece
-        for (SerialPnPDescriptorEntry* entry = g_SerialPnPDescriptor;
-             entry != 0;
-             entry = entry->Next)
-        {
-            SerialPnP_SerialWriteBuffer(entry->Content, entry->ContentSize);
-        }
+        sink.Send = true;
+        SerialPnP_EmitDescriptor(&sink);
+
+    // Descriptor hash request, lets the gateway reuse a descriptor it cached
+    } else if (Packet->PacketType == SERIALPNP_PACKETTYPE_DESCHASHREQ) {
+        // FNV-1a over the descriptor, as it is sent in the descriptor response
+        SerialPnPDescriptorSink sink = {0};
+        SerialPnP_EmitDescriptor(&sink);
+        uint32_t hash = sink.Hash;
+
+        out.Length = sizeof(SerialPnPPacketHeader) + sizeof(hash);
+        out.PacketType = SERIALPNP_PACKETTYPE_DESCHASHRESP;
+
+        SerialPnP_PlatformSerialWrite(SERIALPNP_PROTOCOL_PACKETSTART); // need to send sync
+        SerialPnP_SerialWriteBuffer((char*) &out, sizeof(SerialPnPPacketHeader));
+        SerialPnP_SerialWriteBuffer((char*) &hash, sizeof(hash)); // little endian, as the rest of the packet
 
     // Property write request
     } else if (Packet->PacketType == SERIALPNP_PACKETTYPE_PROPREQ) {
         // find entry in table
         SerialPnPPacketBody* body = (SerialPnPPacketBody*) Packet->Body;
 
-        SerialPnPCallback* cb = 0;
+        SerialPnPCb cb = 0;
         cb = SerialPnP_FindCallback(SERIALPNP_DESCRIPTORTYPE_PROPERTY, //property type
                                     body->Payload,
                                     body->NameLength);
 
             uint32_t outp = -1;
+            uint16_t inputSize = Packet->Length - (sizeof(SerialPnPPacketHeader) +
+                                                   sizeof(SerialPnPPacketBody) +
+                                                   body->NameLength);
 
             if (cb) {
             // If there's no data, call it for output only
-            if (Packet->Length - (sizeof(SerialPnPPacketHeader) +
-                                  sizeof(SerialPnPPacketBody) +
-                                  body->NameLength) == 0) {
+            if (inputSize == 0) {
 
-                ((SerialPnPCb) cb->Callback)(0, &outp);
+                cb(0, &outp);
             } else {
-                ((SerialPnPCb) cb->Callback)(body->Payload + body->NameLength, &outp);
+                SerialPnPInput input;
+                memcpy(input.Bytes, body->Payload + body->NameLength, inputSize);
+                cb(input.Bytes, &outp);
             }
             }
 
@@ -611,6 +1136,7 @@ SerialPnP_ProcessPacket(
                          sizeof(outp); // payload size; uint32
 
             out.PacketType = SERIALPNP_PACKETTYPE_PROPRESP;
+            out.Reserved = Packet->Reserved; // request ID, echoed so the gateway can match the response
 
             SerialPnP_PlatformSerialWrite(SERIALPNP_PROTOCOL_PACKETSTART); // need to send sync
             SerialPnP_SerialWriteBuffer((char*) &out, sizeof(out));
@@ -623,15 +1149,20 @@ SerialPnP_ProcessPacket(
         // find entry in table
         SerialPnPPacketBody* body = (SerialPnPPacketBody*) Packet->Body;
 
-        SerialPnPCallback* cb = 0;
+        SerialPnPCb cb = 0;
         cb = SerialPnP_FindCallback(SERIALPNP_DESCRIPTORTYPE_COMMAND, //method type
                                     body->Payload,
                                     body->NameLength);
 
           int32_t outp = -1;
+          uint16_t inputSize = Packet->Length - (sizeof(SerialPnPPacketHeader) +
+                                                 sizeof(SerialPnPPacketBody) +
+                                                 body->NameLength);
 
           if (cb) {
-            ((SerialPnPCb) cb->Callback)(body->Payload + body->NameLength, &outp);
+            SerialPnPInput input = {0};
+            memcpy(input.Bytes, body->Payload + body->NameLength, inputSize);
+            cb(input.Bytes, &outp);
           }
    
             out.Length = sizeof(SerialPnPPacketHeader) +
@@ -640,6 +1171,7 @@ SerialPnP_ProcessPacket(
                          sizeof(outp); // payload size; uint32
 
             out.PacketType = SERIALPNP_PACKETTYPE_COMMANDRESP;
+            out.Reserved = Packet->Reserved; // request ID, echoed so the gateway can match the response
 
             SerialPnP_PlatformSerialWrite(SERIALPNP_PROTOCOL_PACKETSTART); // need to send sync
             SerialPnP_SerialWriteBuffer((char*) &out, sizeof(out));
@@ -0,0 +1,142 @@
+//
+// Serial PnP Host Build - Mock UART
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//
+#include "SerialPnP.h"
+#include "serial_pnp_framing.h"
+#include "mock_uart.h"
+#include <string.h>
+
+#define MOCKUART_WIRE_SIZE      65536
+#define MOCKUART_RXBUFFER_SIZE  4096
+
+//
+// Global Variables
+//
+uint8_t                         g_MockUartWire[MOCKUART_WIRE_SIZE];     // bytes the device sent
+size_t                          g_MockUartWireLength = 0;
+size_t                          g_MockUartWireRead = 0;
+uint8_t                         g_MockUartRxBuffer[MOCKUART_RXBUFFER_SIZE];
+SERIALPNP_RX_DECODER            g_MockUartRxDecoder;
+unsigned int                    g_MockUartResets = 0;
+
+//
+// Platform Function Implementations
+//
+void
+SerialPnP_PlatformSerialInit()
+{
+}
+
+void
+SerialPnP_PlatformSerialStartTx()
+{
+    uint8_t b;
+
+    while (SerialPnP_SerialTxIsr(&b)) {
+        if (g_MockUartWireLength < sizeof(g_MockUartWire)) {
+            g_MockUartWire[g_MockUartWireLength++] = b;
+        }
+    }
+}
+
+void
+SerialPnP_PlatformReset()
+{
+    g_MockUartResets++;
+    SerialPnP_Ready();
+}
+
+//
+// Public Function Implementations
+//
+void
+MockUart_Reset()
+{
+    g_MockUartWireLength = 0;
+    g_MockUartWireRead = 0;
+    g_MockUartResets = 0;
+    SerialPnp_RxDecoder_Init(&g_MockUartRxDecoder,
+                             g_MockUartRxBuffer,
+                             sizeof(g_MockUartRxBuffer));
+}
+
+void
+MockUart_SendPacket(
+    const uint8_t*  Packet,
+    size_t          Length
+)
+{
+    uint8_t escaped[64];
+    size_t consumed = 0;
+    size_t escapedLength;
+
+    escaped[0] = SERIALPNP_START_OF_FRAME_BYTE;
+    escapedLength = 1;
+
+    for (;;) {
+        for (size_t c = 0; c < escapedLength; c++) {
+            // The device empties the ring when it processes what it received
+            while (!SerialPnP_SerialRxIsr(escaped[c])) {
+                SerialPnP_Process();
+            }
+        }
+
+        if (consumed == Length) {
+            break;
+        }
+
+        escapedLength = SerialPnp_TxEncoder_Escape(Packet, Length, &consumed, escaped, sizeof(escaped));
+    }
+}
+
+const uint8_t*
+MockUart_ReadPacket(
+    size_t*         Length
+)
+{
+    const uint8_t* packet;
+    uint8_t* chunk;
+    size_t chunkSize;
+    size_t chunkLength;
+
+    for (;;) {
+        SERIALPNP_RX_DECODE_RESULT result = SerialPnp_RxDecoder_Decode(&g_MockUartRxDecoder, 0, &packet, Length);
+
+        if (result == SERIALPNP_RX_DECODE_PACKET) {
+            return packet;
+        }
+
+        if (result == SERIALPNP_RX_DECODE_OVERFLOW) {
+            continue;
+        }
+
+        if (g_MockUartWireRead == g_MockUartWireLength) {
+            return 0;
+        }
+
+        chunk = SerialPnp_RxDecoder_GetChunk(&g_MockUartRxDecoder, &chunkSize);
+        chunkLength = g_MockUartWireLength - g_MockUartWireRead;
+        if (chunkLength > chunkSize) {
+            chunkLength = chunkSize;
+        }
+
+        memcpy(chunk, &g_MockUartWire[g_MockUartWireRead], chunkLength);
+        g_MockUartWireRead += chunkLength;
+        SerialPnp_RxDecoder_SetChunkLength(&g_MockUartRxDecoder, chunkLength);
+    }
+}
+
+size_t
+MockUart_GetSentLength()
+{
+    return g_MockUartWireLength;
+}
+
+unsigned int
+MockUart_GetResetCount()
+{
+    return g_MockUartResets;
+}
@@ -0,0 +1,50 @@
+//
+// Serial PnP Host Build - Mock UART
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//
+// Stands in for the platform when the device library is built on a host with
+// SERIALPNP_RING_BUFFERS. Bytes sent to the device go through the library's
+// receive ring as a receive interrupt would deliver them, and bytes the device
+// sends are drained from its transmit ring as soon as they are queued, as if
+// the transmit interrupt fired at once.
+//
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Forgets the bytes the device sent and the resets it was asked for.
+void
+MockUart_Reset();
+
+// Frames and escapes a packet as the gateway does and delivers it to the
+// device. SerialPnP_Process is run whenever the receive ring fills up, so
+// packets larger than the ring can be sent.
+void
+MockUart_SendPacket(
+    const uint8_t*  Packet,
+    size_t          Length
+);
+
+// Decodes the next packet the device sent. Returns 0 if no complete packet
+// is left, otherwise a pointer valid until the next call.
+const uint8_t*
+MockUart_ReadPacket(
+    size_t*         Length
+);
+
+// Number of bytes the device sent since the last MockUart_Reset.
+size_t
+MockUart_GetSentLength();
+
+// Number of times the device was asked to reset since the last MockUart_Reset.
+unsigned int
+MockUart_GetResetCount();
+
+#ifdef __cplusplus
+}
+#endif
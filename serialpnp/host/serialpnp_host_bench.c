@@ -0,0 +1,116 @@
+//
+// Serial PnP Host Build - Benchmark
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//
+// Times requests through the mock UART, from the gateway framing the request
+// to it decoding the response, with the device's features defined at runtime
+// and declared with SERIALPNP_DEVICE. The request is for the last feature
+// defined, the one the runtime lookup reaches last.
+//
+#include "SerialPnP.h"
+#include "mock_uart.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ITERATIONS 200000
+
+void
+CbTwice(
+    int32_t*        Input,
+    int32_t*        Output
+)
+{
+    *Output = *Input * 2;
+}
+
+#define BENCH_COMMAND(Name) SERIALPNP_COMMAND(Name, "Command", "Benchmark command", \
+                                              SerialPnPSchema_Int, SerialPnPSchema_Int, CbTwice)
+
+static const char* g_CommandNames[SERIALPNP_MAX_CALLBACK_COUNT] = {
+    "command_0", "command_1", "command_2", "command_3", "command_4", "command_5", "command_6", "command_7"
+};
+
+static const SerialPnPFeature g_BenchFeatures[SERIALPNP_MAX_CALLBACK_COUNT] = {
+    BENCH_COMMAND("command_0"), BENCH_COMMAND("command_1"), BENCH_COMMAND("command_2"), BENCH_COMMAND("command_3"),
+    BENCH_COMMAND("command_4"), BENCH_COMMAND("command_5"), BENCH_COMMAND("command_6"), BENCH_COMMAND("command_7"),
+};
+
+SERIALPNP_DEVICE(g_BenchDevice, "Bench", "http://contoso.com/bench", g_BenchFeatures);
+
+static double
+GetSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void
+BenchRequest(
+    const char*     Label,
+    const uint8_t*  Request,
+    size_t          RequestLength
+)
+{
+    size_t length;
+    size_t sent = 0;
+    double start = GetSeconds();
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        MockUart_Reset();
+        MockUart_SendPacket(Request, RequestLength);
+        SerialPnP_Process();
+        if (!MockUart_ReadPacket(&length)) {
+            printf("%s: no response\n", Label);
+            return;
+        }
+        sent += MockUart_GetSentLength();
+    }
+
+    double seconds = GetSeconds() - start;
+    printf("%-32s %8.1f ns/request, %zu bytes sent per response\n",
+           Label, seconds * 1e9 / BENCH_ITERATIONS, sent / BENCH_ITERATIONS);
+}
+
+int
+main()
+{
+    uint8_t command[64];
+    const char* name = g_CommandNames[SERIALPNP_MAX_CALLBACK_COUNT - 1];
+    size_t nameLength = strlen(name);
+    size_t commandLength = 6 + nameLength + 4;
+    uint8_t descriptorRequest[4] = { 4, 0, 3, 0 };
+    uint8_t hashRequest[4] = { 4, 0, 11, 0 };
+    int32_t input = 21;
+
+    command[0] = (uint8_t) commandLength;
+    command[1] = 0;
+    command[2] = 5;
+    command[3] = 1;
+    command[4] = 0;
+    command[5] = (uint8_t) nameLength;
+    memcpy(&command[6], name, nameLength);
+    memcpy(&command[6 + nameLength], &input, sizeof(input));
+
+    SerialPnP_Setup("Bench");
+    SerialPnP_NewInterface("http://contoso.com/bench");
+    for (int c = 0; c < SERIALPNP_MAX_CALLBACK_COUNT; c++) {
+        SerialPnP_NewCommand(g_CommandNames[c], "Command", "Benchmark command",
+                             SerialPnPSchema_Int, SerialPnPSchema_Int, (SerialPnPCb*) CbTwice);
+    }
+
+    BenchRequest("runtime: command", command, commandLength);
+    BenchRequest("runtime: descriptor", descriptorRequest, sizeof(descriptorRequest));
+    BenchRequest("runtime: descriptor hash", hashRequest, sizeof(hashRequest));
+
+    SerialPnP_SetupDevice(&g_BenchDevice);
+
+    BenchRequest("SERIALPNP_DEVICE: command", command, commandLength);
+    BenchRequest("SERIALPNP_DEVICE: descriptor", descriptorRequest, sizeof(descriptorRequest));
+    BenchRequest("SERIALPNP_DEVICE: descriptor hash", hashRequest, sizeof(hashRequest));
+
+    return 0;
+}
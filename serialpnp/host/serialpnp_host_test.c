@@ -0,0 +1,395 @@
+//
+// Serial PnP Host Build - Tests
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//
+// Runs the device library against the mock UART, checking the packets it
+// sends back as the gateway would see them.
+//
+#include "SerialPnP.h"
+#include "mock_uart.h"
+#include <stdio.h>
+#include <string.h>
+
+#define PACKETTYPE_RESETREQ     1
+#define PACKETTYPE_RESETRESP    2
+#define PACKETTYPE_DESCREQ      3
+#define PACKETTYPE_DESCRESP     4
+#define PACKETTYPE_COMMANDREQ   5
+#define PACKETTYPE_COMMANDRESP  6
+#define PACKETTYPE_PROPREQ      7
+#define PACKETTYPE_PROPRESP     8
+#define PACKETTYPE_DESCHASHREQ  11
+#define PACKETTYPE_DESCHASHRESP 12
+#define PACKETTYPE_EVENTBATCH   13
+
+#define CHECK(Condition)                                                        \
+    do {                                                                        \
+        if (!(Condition)) {                                                     \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #Condition); \
+            g_Failures++;                                                       \
+        }                                                                       \
+    } while (0)
+
+// Internal to the library, checked directly
+const SerialPnPFeature*
+SerialPnP_FindFeature(
+    uint8_t         Type,
+    const char*     Name,
+    uint8_t         NameSize,
+    uint8_t*        Ordinal
+);
+
+unsigned int g_Failures = 0;
+int32_t g_Rate = 1000;
+
+void
+CbTwice(
+    int32_t*        Input,
+    int32_t*        Output
+)
+{
+    *Output = *Input * 2;
+}
+
+void
+CbRate(
+    int32_t*        Input,
+    int32_t*        Output
+)
+{
+    if (Input && (*Input > 0)) {
+        g_Rate = *Input;
+    }
+
+    *Output = g_Rate;
+}
+
+static const SerialPnPFeature g_ThermometerFeatures[] = {
+    SERIALPNP_EVENT("temperature", "Temperature", "Ambient temperature", SerialPnPSchema_Float, "celsius"),
+    SERIALPNP_EVENT("humidity", "Humidity", "Relative humidity", SerialPnPSchema_Int, "percent"),
+    SERIALPNP_PROPERTY("rate", "Sample Rate", "Sample rate", "ms", SerialPnPSchema_Int, false, true, CbRate),
+    SERIALPNP_COMMAND("twice", "Twice", "Doubles its input", SerialPnPSchema_Int, SerialPnPSchema_Int, CbTwice),
+};
+
+SERIALPNP_DEVICE(g_Thermometer, "Thermometer", "http://contoso.com/thermometer", g_ThermometerFeatures);
+
+static void
+SetupRuntimeThermometer()
+{
+    SerialPnP_Setup("Thermometer");
+    SerialPnP_NewInterface("http://contoso.com/thermometer");
+    SerialPnP_NewEvent("temperature", "Temperature", "Ambient temperature", SerialPnPSchema_Float, "celsius");
+    SerialPnP_NewEvent("humidity", "Humidity", "Relative humidity", SerialPnPSchema_Int, "percent");
+    SerialPnP_NewProperty("rate", "Sample Rate", "Sample rate", "ms", SerialPnPSchema_Int, false, true,
+                          (SerialPnPCb*) CbRate);
+    SerialPnP_NewCommand("twice", "Twice", "Doubles its input", SerialPnPSchema_Int, SerialPnPSchema_Int,
+                         (SerialPnPCb*) CbTwice);
+}
+
+// Builds a command or property request, returning its length
+static size_t
+BuildRequest(
+    uint8_t*        Packet,
+    uint8_t         PacketType,
+    uint8_t         RequestId,
+    const char*     Name,
+    const void*     Value,
+    size_t          ValueSize
+)
+{
+    size_t nameLength = strlen(Name);
+    size_t length = 6 + nameLength + ValueSize;
+
+    Packet[0] = (uint8_t) (length & 0xFF);
+    Packet[1] = (uint8_t) (length >> 8);
+    Packet[2] = PacketType;
+    Packet[3] = RequestId;
+    Packet[4] = 0;
+    Packet[5] = (uint8_t) nameLength;
+    memcpy(&Packet[6], Name, nameLength);
+    if (ValueSize) {
+        memcpy(&Packet[6 + nameLength], Value, ValueSize);
+    }
+
+    return length;
+}
+
+static size_t
+RequestDescriptor(
+    uint8_t*        Descriptor,
+    size_t          Size
+)
+{
+    uint8_t request[4] = { 4, 0, PACKETTYPE_DESCREQ, 0 };
+    const uint8_t* response;
+    size_t length;
+
+    MockUart_Reset();
+    MockUart_SendPacket(request, sizeof(request));
+    SerialPnP_Process();
+
+    response = MockUart_ReadPacket(&length);
+    if (!response || response[2] != PACKETTYPE_DESCRESP || length - 4 > Size) {
+        return 0;
+    }
+
+    memcpy(Descriptor, response + 4, length - 4);
+    return length - 4;
+}
+
+static void
+test_static_descriptor_matches_runtime_descriptor()
+{
+    uint8_t runtimeDescriptor[512];
+    uint8_t staticDescriptor[512];
+    size_t runtimeLength;
+    size_t staticLength;
+
+    SetupRuntimeThermometer();
+    runtimeLength = RequestDescriptor(runtimeDescriptor, sizeof(runtimeDescriptor));
+
+    SerialPnP_SetupDevice(&g_Thermometer);
+    staticLength = RequestDescriptor(staticDescriptor, sizeof(staticDescriptor));
+
+    CHECK(runtimeLength > 0);
+    CHECK(staticLength == runtimeLength);
+    CHECK(memcmp(staticDescriptor, runtimeDescriptor, runtimeLength) == 0);
+}
+
+static void
+test_descriptor_hash_is_fnv1a_of_descriptor()
+{
+    uint8_t descriptor[512];
+    uint8_t request[4] = { 4, 0, PACKETTYPE_DESCHASHREQ, 0 };
+    const uint8_t* response;
+    size_t descriptorLength;
+    size_t length;
+    uint32_t hash = 2166136261u;
+    uint32_t sentHash;
+
+    SerialPnP_SetupDevice(&g_Thermometer);
+    descriptorLength = RequestDescriptor(descriptor, sizeof(descriptor));
+
+    for (size_t c = 0; c < descriptorLength; c++) {
+        hash ^= descriptor[c];
+        hash *= 16777619u;
+    }
+
+    MockUart_Reset();
+    MockUart_SendPacket(request, sizeof(request));
+    SerialPnP_Process();
+
+    response = MockUart_ReadPacket(&length);
+    CHECK(response && length == 8 && response[2] == PACKETTYPE_DESCHASHRESP);
+    if (response && length == 8) {
+        sentHash = response[4] | (response[5] << 8) | (response[6] << 16) | ((uint32_t) response[7] << 24);
+        CHECK(sentHash == hash);
+    }
+}
+
+static void
+test_static_command_is_dispatched()
+{
+    uint8_t request[32];
+    // 0x5A and 0xEF have to be escaped on the way in and out
+    int32_t input = 0x37EF5A2D;
+    int32_t output;
+    const uint8_t* response;
+    size_t length;
+
+    SerialPnP_SetupDevice(&g_Thermometer);
+    MockUart_Reset();
+    MockUart_SendPacket(request, BuildRequest(request, PACKETTYPE_COMMANDREQ, 9, "twice", &input, sizeof(input)));
+    SerialPnP_Process();
+
+    response = MockUart_ReadPacket(&length);
+    CHECK(response && length == 6 + 5 + 4);
+    if (response && length == 6 + 5 + 4) {
+        CHECK(response[2] == PACKETTYPE_COMMANDRESP);
+        CHECK(response[3] == 9);
+        CHECK(memcmp(&response[6], "twice", 5) == 0);
+        memcpy(&output, &response[11], sizeof(output));
+        CHECK(output == input * 2);
+    }
+}
+
+static void
+test_unknown_command_answers_minus_one()
+{
+    uint8_t request[32];
+    int32_t input = 1;
+    int32_t output = 0;
+    const uint8_t* response;
+    size_t length;
+
+    SerialPnP_SetupDevice(&g_Thermometer);
+    MockUart_Reset();
+
+    // A prefix of a command's name, and a property's name, are not commands
+    MockUart_SendPacket(request, BuildRequest(request, PACKETTYPE_COMMANDREQ, 1, "twic", &input, sizeof(input)));
+    MockUart_SendPacket(request, BuildRequest(request, PACKETTYPE_COMMANDREQ, 2, "rate", &input, sizeof(input)));
+    SerialPnP_Process();
+
+    for (int c = 0; c < 2; c++) {
+        response = MockUart_ReadPacket(&length);
+        CHECK(response && response[2] == PACKETTYPE_COMMANDRESP && response[3] == c + 1);
+        if (response) {
+            memcpy(&output, &response[length - 4], sizeof(output));
+            CHECK(output == -1);
+        }
+    }
+}
+
+static void
+test_static_property_is_read_and_written()
+{
+    uint8_t request[32];
+    int32_t input = 250;
+    int32_t output = 0;
+    const uint8_t* response;
+    size_t length;
+
+    SerialPnP_SetupDevice(&g_Thermometer);
+    g_Rate = 1000;
+    MockUart_Reset();
+
+    MockUart_SendPacket(request, BuildRequest(request, PACKETTYPE_PROPREQ, 0, "rate", 0, 0));
+    MockUart_SendPacket(request, BuildRequest(request, PACKETTYPE_PROPREQ, 0, "rate", &input, sizeof(input)));
+    SerialPnP_Process();
+
+    response = MockUart_ReadPacket(&length);
+    CHECK(response && response[2] == PACKETTYPE_PROPRESP);
+    if (response) {
+        memcpy(&output, &response[length - 4], sizeof(output));
+        CHECK(output == 1000);
+    }
+
+    response = MockUart_ReadPacket(&length);
+    CHECK(response && response[2] == PACKETTYPE_PROPRESP);
+    if (response) {
+        memcpy(&output, &response[length - 4], sizeof(output));
+        CHECK(output == 250);
+    }
+    CHECK(g_Rate == 250);
+}
+
+#define TEST_EVENT(Name)    SERIALPNP_EVENT(Name, "E", "", SerialPnPSchema_Int, "")
+#define TEST_PROPERTY(Name) SERIALPNP_PROPERTY(Name, "P", "", "", SerialPnPSchema_Int, false, true, CbRate)
+#define TEST_COMMAND(Name)  SERIALPNP_COMMAND(Name, "C", "", SerialPnPSchema_Int, SerialPnPSchema_Int, CbTwice)
+
+static const SerialPnPFeature g_CrowdedFeatures[] = {
+    TEST_EVENT("a"), TEST_PROPERTY("a"), TEST_COMMAND("a"),
+    TEST_EVENT("e1"), TEST_EVENT("e2"), TEST_EVENT("e3"), TEST_EVENT("e4"), TEST_EVENT("e5"),
+    TEST_EVENT("e6"), TEST_EVENT("e7"), TEST_EVENT("e8"), TEST_EVENT("e9"),
+    TEST_PROPERTY("p1"), TEST_PROPERTY("p2"), TEST_PROPERTY("p3"), TEST_PROPERTY("p4"), TEST_PROPERTY("p5"),
+    TEST_PROPERTY("p6"), TEST_PROPERTY("p7"), TEST_PROPERTY("p8"),
+    TEST_COMMAND("c1"), TEST_COMMAND("c2"), TEST_COMMAND("c3"), TEST_COMMAND("c4"), TEST_COMMAND("c5"),
+    TEST_COMMAND("c6"), TEST_COMMAND("c7"), TEST_COMMAND("c8"), TEST_COMMAND("c9"), TEST_COMMAND("c10"),
+    TEST_COMMAND("a_command_with_a_much_longer_name"),
+};
+
+SERIALPNP_DEVICE(g_Crowded, "Crowded", "http://contoso.com/crowded", g_CrowdedFeatures);
+
+static void
+test_lookup_finds_every_feature_of_a_full_table()
+{
+    uint8_t ordinals[SERIALPNP_FEATURE_EVENT + 1] = {0};
+    uint8_t ordinal;
+
+    SerialPnP_SetupDevice(&g_Crowded);
+
+    for (uint8_t f = 0; f < g_Crowded.FeatureCount; f++) {
+        const SerialPnPFeature* feature = &g_CrowdedFeatures[f];
+
+        ordinal = 0xFF;
+        CHECK(SerialPnP_FindFeature(feature->Type, feature->Name, strlen(feature->Name), &ordinal) == feature);
+        CHECK(ordinal == ordinals[feature->Type]++);
+    }
+
+    CHECK(SerialPnP_FindFeature(SERIALPNP_FEATURE_COMMAND, "c11", 3, 0) == 0);
+    CHECK(SerialPnP_FindFeature(SERIALPNP_FEATURE_COMMAND, "c", 1, 0) == 0);
+    CHECK(SerialPnP_FindFeature(SERIALPNP_FEATURE_EVENT, "p1", 2, 0) == 0);
+}
+
+static void
+test_event_batch_uses_table_indexes()
+{
+    const uint8_t* response;
+    size_t length;
+
+    SerialPnP_SetupDevice(&g_Thermometer);
+    MockUart_Reset();
+
+    SerialPnP_BeginEventBatch();
+    SerialPnP_AddEventInt("humidity", 40);
+    SerialPnP_AddEventFloat("temperature", 21.5f);
+    SerialPnP_AddEventInt("rate", 1); // not an event
+    SerialPnP_SendEventBatch();
+
+    response = MockUart_ReadPacket(&length);
+    CHECK(response && response[2] == PACKETTYPE_EVENTBATCH && length == 5 + 6 + 6);
+    if (response && length == 5 + 6 + 6) {
+        CHECK(response[5] == 1 && response[6] == 4 && response[7] == 40);
+        CHECK(response[11] == 0 && response[12] == 4);
+    }
+}
+
+static void
+test_reset_request_resets_platform()
+{
+    uint8_t request[4] = { 4, 0, PACKETTYPE_RESETREQ, 0 };
+    const uint8_t* response;
+    size_t length;
+
+    SerialPnP_SetupDevice(&g_Thermometer);
+    MockUart_Reset();
+    MockUart_SendPacket(request, sizeof(request));
+    SerialPnP_Process();
+
+    CHECK(MockUart_GetResetCount() == 1);
+    response = MockUart_ReadPacket(&length);
+    CHECK(response && length == 4 && response[2] == PACKETTYPE_RESETRESP);
+}
+
+static void
+test_rx_ring_drops_bytes_once_full()
+{
+    unsigned int accepted = 0;
+
+    SerialPnP_SetupDevice(&g_Thermometer);
+
+    while (SerialPnP_SerialRxIsr(0) && accepted <= SERIALPNP_RX_RING_SIZE) {
+        accepted++;
+    }
+
+    CHECK(accepted == SERIALPNP_RX_RING_SIZE);
+    CHECK(SerialPnP_PlatformSerialAvailable() == SERIALPNP_RX_RING_SIZE);
+
+    SerialPnP_Process();
+    CHECK(SerialPnP_PlatformSerialAvailable() == 0);
+    CHECK(SerialPnP_PlatformSerialRead() == -1);
+}
+
+int
+main()
+{
+    test_static_descriptor_matches_runtime_descriptor();
+    test_descriptor_hash_is_fnv1a_of_descriptor();
+    test_static_command_is_dispatched();
+    test_unknown_command_answers_minus_one();
+    test_static_property_is_read_and_written();
+    test_lookup_finds_every_feature_of_a_full_table();
+    test_event_batch_uses_table_indexes();
+    test_reset_request_resets_platform();
+    test_rx_ring_drops_bytes_once_full();
+
+    if (g_Failures) {
+        printf("%u checks failed\n", g_Failures);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,234 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <string.h>
+
+#include "serial_pnp_framing.h"
+
+// Bytes searched at a time for framing bytes. Searching the whole remaining data instead would make every short
+// run as expensive as the distance to the next framing byte of the other kind.
+#define SERIALPNP_SCAN_WINDOW 64
+
+static const uint8_t SerialPnp_EscapeSequences[2][SERIALPNP_ESCAPE_SEQUENCE_LENGTH] = {
+    { SERIALPNP_ESCAPE_BYTE, SERIALPNP_START_OF_FRAME_BYTE - 1 },
+    { SERIALPNP_ESCAPE_BYTE, SERIALPNP_ESCAPE_BYTE - 1 }
+};
+
+// Returns how many bytes at the start of data are neither start of frame nor escape bytes
+static size_t SerialPnp_GetPlainRun(
+    const uint8_t* data,
+    size_t length)
+{
+    size_t run = 0;
+
+    while (run < length)
+    {
+        size_t window = (length - run < SERIALPNP_SCAN_WINDOW) ? length - run : SERIALPNP_SCAN_WINDOW;
+        size_t plain = window;
+
+        const uint8_t* special = (const uint8_t*)memchr(data + run, SERIALPNP_START_OF_FRAME_BYTE, plain);
+        if (NULL != special)
+        {
+            plain = (size_t)(special - (data + run));
+        }
+        special = (const uint8_t*)memchr(data + run, SERIALPNP_ESCAPE_BYTE, plain);
+        if (NULL != special)
+        {
+            plain = (size_t)(special - (data + run));
+        }
+
+        run += plain;
+        if (plain < window)
+        {
+            break;
+        }
+    }
+
+    return run;
+}
+
+void SerialPnp_RxDecoder_Init(
+    PSERIALPNP_RX_DECODER decoder,
+    uint8_t* buffer,
+    size_t capacity)
+{
+    decoder->Buffer = buffer;
+    decoder->Capacity = capacity;
+    decoder->BufferIndex = 0;
+    decoder->RawIndex = 0;
+    decoder->RawLength = 0;
+    decoder->Escaped = false;
+}
+
+uint8_t* SerialPnp_RxDecoder_GetChunk(
+    PSERIALPNP_RX_DECODER decoder,
+    size_t* chunkSize)
+{
+    // A frame that fills the buffer is dropped, so there is always room for one more byte
+    *chunkSize = decoder->Capacity - decoder->BufferIndex;
+    return decoder->Buffer + decoder->BufferIndex;
+}
+
+void SerialPnp_RxDecoder_SetChunkLength(
+    PSERIALPNP_RX_DECODER decoder,
+    size_t chunkLength)
+{
+    size_t chunkSize = decoder->Capacity - decoder->BufferIndex;
+
+    decoder->RawIndex = decoder->BufferIndex;
+    decoder->RawLength = decoder->BufferIndex + ((chunkLength > chunkSize) ? chunkSize : chunkLength);
+}
+
+// Returns how many more unescaped bytes can be appended before the frame has to be checked for completion
+// (or for overflow). Appending in steps of this size reproduces exactly the points at which a byte at a time
+// decoder would look at the frame.
+static size_t SerialPnp_RxDecoder_BytesToNextCheck(
+    PSERIALPNP_RX_DECODER decoder)
+{
+    size_t limit = decoder->Capacity - decoder->BufferIndex;
+
+    if (decoder->BufferIndex < SERIALPNP_MIN_PACKET_LENGTH)
+    {
+        limit = SERIALPNP_MIN_PACKET_LENGTH - decoder->BufferIndex;
+    }
+    else
+    {
+        size_t packetLength = (size_t)(decoder->Buffer[0] | (decoder->Buffer[1] << 8)); // LSB first, L-endian
+        if (decoder->BufferIndex < packetLength && (packetLength - decoder->BufferIndex) < limit)
+        {
+            limit = packetLength - decoder->BufferIndex;
+        }
+    }
+
+    return limit;
+}
+
+SERIALPNP_RX_DECODE_RESULT SerialPnp_RxDecoder_Decode(
+    PSERIALPNP_RX_DECODER decoder,
+    uint8_t packetType,
+    const uint8_t** packet,
+    size_t* packetLength)
+{
+    *packet = NULL;
+    *packetLength = 0;
+
+    while (decoder->RawIndex < decoder->RawLength)
+    {
+        // Unescaping only ever shrinks the data, so the frame never catches up with the raw bytes
+        const uint8_t* in = decoder->Buffer + decoder->RawIndex;
+        uint8_t* out = decoder->Buffer + decoder->BufferIndex;
+        size_t available = decoder->RawLength - decoder->RawIndex;
+        uint8_t inb = *in;
+
+        if (SERIALPNP_START_OF_FRAME_BYTE == inb)
+        {
+            decoder->BufferIndex = 0;
+            decoder->Escaped = false;
+            decoder->RawIndex++;
+            continue;
+        }
+
+        if (SERIALPNP_ESCAPE_BYTE == inb)
+        {
+            decoder->Escaped = true;
+            decoder->RawIndex++;
+            continue;
+        }
+
+        size_t run;
+        if (decoder->Escaped)
+        {
+            // If last byte was an escape byte, increment current byte by 1
+            *out = (uint8_t)(inb + 1);
+            decoder->Escaped = false;
+            run = 1;
+        }
+        else
+        {
+            // Take everything up to the next framing byte, or up to the next length check, in one go
+            run = SerialPnp_RxDecoder_BytesToNextCheck(decoder);
+            run = SerialPnp_GetPlainRun(in, (run > available) ? available : run);
+
+            // Bytes are already in place until an escape or a start of frame shifts the frame back
+            if (out != in)
+            {
+                memmove(out, in, run);
+            }
+        }
+
+        decoder->RawIndex += run;
+        decoder->BufferIndex += run;
+
+        if (decoder->BufferIndex >= decoder->Capacity)
+        {
+            // Drop the frame, the next start of frame byte resynchronizes the decoder
+            decoder->BufferIndex = 0;
+            decoder->Escaped = false;
+            return SERIALPNP_RX_DECODE_OVERFLOW;
+        }
+
+        // Minimum packet length is 4, so once we are >= 4 begin checking
+        // the receive buffer length against the length field.
+        if (decoder->BufferIndex >= SERIALPNP_MIN_PACKET_LENGTH)
+        {
+            size_t length = (size_t)(decoder->Buffer[0] | (decoder->Buffer[1] << 8)); // LSB first, L-endian
+
+            if ((decoder->BufferIndex == length) && (packetType == 0x00 || packetType == decoder->Buffer[2]))
+            {
+                *packet = decoder->Buffer;
+                *packetLength = decoder->BufferIndex;
+                decoder->BufferIndex = 0;
+                return SERIALPNP_RX_DECODE_PACKET;
+            }
+        }
+    }
+
+    return SERIALPNP_RX_DECODE_NEED_MORE;
+}
+
+size_t SerialPnp_TxEncoder_GetRun(
+    const uint8_t* data,
+    size_t length)
+{
+    return SerialPnp_GetPlainRun(data, length);
+}
+
+const uint8_t* SerialPnp_TxEncoder_GetEscapeSequence(
+    uint8_t escapedByte)
+{
+    return SerialPnp_EscapeSequences[(SERIALPNP_START_OF_FRAME_BYTE == escapedByte) ? 0 : 1];
+}
+
+size_t SerialPnp_TxEncoder_Escape(
+    const uint8_t* data,
+    size_t length,
+    size_t* consumed,
+    uint8_t* out,
+    size_t outSize)
+{
+    size_t written = 0;
+
+    while (*consumed < length && written < outSize)
+    {
+        // No point looking further ahead than out has room for
+        size_t remaining = length - *consumed;
+        size_t run = SerialPnp_GetPlainRun(data + *consumed, (remaining < outSize - written) ? remaining : outSize - written);
+        if (0 == run)
+        {
+            if (outSize - written < SERIALPNP_ESCAPE_SEQUENCE_LENGTH)
+            {
+                break;
+            }
+            memcpy(out + written, SerialPnp_TxEncoder_GetEscapeSequence(data[*consumed]), SERIALPNP_ESCAPE_SEQUENCE_LENGTH);
+            written += SERIALPNP_ESCAPE_SEQUENCE_LENGTH;
+            (*consumed)++;
+            continue;
+        }
+
+        memcpy(out + written, data + *consumed, run);
+        written += run;
+        *consumed += run;
+    }
+
+    return written;
+}
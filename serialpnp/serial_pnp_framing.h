@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+//
+// Serial PnP framing codec, shared by the bridge and the device side library in serialpnp/, which carries a
+// copy of this file and serial_pnp_framing.c. It only depends on the C standard library and never allocates.
+//
+// Frames on the wire start with SERIALPNP_START_OF_FRAME_BYTE, and any SERIALPNP_START_OF_FRAME_BYTE or
+// SERIALPNP_ESCAPE_BYTE inside a frame is sent as SERIALPNP_ESCAPE_BYTE followed by the original byte minus one.
+// The first two bytes of a frame are its unescaped length (LSB first) and the third is the packet type.
+//
+// The decoder works in a buffer supplied by the caller. Raw bytes are read into the free end of that buffer and
+// frames are unescaped in place, which never overtakes the raw bytes still to be decoded. Runs of bytes that
+// need no unescaping are located with memchr and are only moved once an escape has shifted the frame, so the
+// per-byte cost is paid only for start of frame and escape bytes.
+//
+// The encoder splits a packet into runs that go on the wire as they are and escape sequences, so that a frame
+// can be sent straight from the packet with writev, or escaped into a caller supplied buffer a piece at a time.
+//
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SERIALPNP_MIN_PACKET_LENGTH 4
+#define SERIALPNP_START_OF_FRAME_BYTE 0x5A
+#define SERIALPNP_ESCAPE_BYTE         0xEF
+
+// Length of the sequence an escaped byte is sent as
+#define SERIALPNP_ESCAPE_SEQUENCE_LENGTH 2
+
+// Size of the receive buffer the bridge gives each port's decoder, the largest unescaped frame it can receive
+#define SERIALPNP_RX_BUFFER_SIZE 4096
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef enum SERIALPNP_RX_DECODE_RESULT
+    {
+        SERIALPNP_RX_DECODE_NEED_MORE = 0,  // raw bytes are used up, read more into the chunk
+        SERIALPNP_RX_DECODE_PACKET,         // a complete frame was decoded
+        SERIALPNP_RX_DECODE_OVERFLOW        // frame does not fit in the receive buffer and was dropped
+    } SERIALPNP_RX_DECODE_RESULT;
+
+    typedef struct _SERIALPNP_RX_DECODER {
+        uint8_t* Buffer;        // unescaped bytes of the frame being received, followed by raw bytes
+        size_t Capacity;
+        size_t BufferIndex;     // end of the unescaped bytes
+        size_t RawIndex;        // raw bytes not yet decoded are Buffer[RawIndex, RawLength)
+        size_t RawLength;
+        bool Escaped;
+    } SERIALPNP_RX_DECODER, *PSERIALPNP_RX_DECODER;
+
+    // Starts decoding into buffer, which holds frames of up to capacity - 1 bytes and must outlive the decoder
+    void SerialPnp_RxDecoder_Init(
+        PSERIALPNP_RX_DECODER decoder,
+        uint8_t* buffer,
+        size_t capacity);
+
+    // Returns where new raw bytes should be read to and how many fit, at least one. Only valid once
+    // SerialPnp_RxDecoder_Decode has returned SERIALPNP_RX_DECODE_NEED_MORE.
+    uint8_t* SerialPnp_RxDecoder_GetChunk(
+        PSERIALPNP_RX_DECODER decoder,
+        size_t* chunkSize);
+
+    // Hands the chunkLength bytes read into the chunk over to the decoder.
+    void SerialPnp_RxDecoder_SetChunkLength(
+        PSERIALPNP_RX_DECODER decoder,
+        size_t chunkLength);
+
+    // Decodes buffered bytes until a frame of the given packetType (or of any type if packetType is 0)
+    // is complete. Complete frames of other types are not delivered, they remain at the start of the
+    // receive buffer until the next start of frame byte.
+    // On SERIALPNP_RX_DECODE_PACKET, *packet points into the buffer and stays valid until the next call.
+    SERIALPNP_RX_DECODE_RESULT SerialPnp_RxDecoder_Decode(
+        PSERIALPNP_RX_DECODER decoder,
+        uint8_t packetType,
+        const uint8_t** packet,
+        size_t* packetLength);
+
+    // Returns how many bytes at the start of data go on the wire as they are. When it returns 0, data[0] has to
+    // be escaped and SerialPnp_TxEncoder_GetEscapeSequence gives what it is sent as.
+    size_t SerialPnp_TxEncoder_GetRun(
+        const uint8_t* data,
+        size_t length);
+
+    // Returns the SERIALPNP_ESCAPE_SEQUENCE_LENGTH bytes that escapedByte is sent as
+    const uint8_t* SerialPnp_TxEncoder_GetEscapeSequence(
+        uint8_t escapedByte);
+
+    // Escapes data from *consumed on into out, without splitting escape sequences, and advances *consumed past
+    // the bytes escaped. Returns the number of bytes written to out. Called until *consumed reaches length, it
+    // escapes any amount of data through an out buffer of SERIALPNP_ESCAPE_SEQUENCE_LENGTH bytes or more.
+    size_t SerialPnp_TxEncoder_Escape(
+        const uint8_t* data,
+        size_t length,
+        size_t* consumed,
+        uint8_t* out,
+        size_t outSize);
+
+#ifdef __cplusplus
+}
+#endif